@@ -633,9 +633,11 @@ Status DirectSession::RunInternal(
   auto* handler_ptr = handler.get();
 
   Executor::Args::Runner default_runner = nullptr;
+  int default_runner_parallelism = 0;
 
   if (pool == nullptr) {
     default_runner = [](const Executor::Args::Closure& c) { c(); };
+    default_runner_parallelism = 1;
   } else if (handler_ptr != nullptr) {
     default_runner = [handler_ptr](Executor::Args::Closure c) {
       handler_ptr->ScheduleInterOpClosure(std::move(c));
@@ -644,6 +646,7 @@ Status DirectSession::RunInternal(
     default_runner = [pool](Executor::Args::Closure c) {
       pool->Schedule(std::move(c));
     };
+    default_runner_parallelism = pool->NumThreads();
   }
 
   // Start parallel Executors.
@@ -712,8 +715,8 @@ Status DirectSession::RunInternal(
   Status run_status;
 
   auto set_threadpool_args_for_item =
-      [&default_runner, &handler](const PerPartitionExecutorsAndLib& item,
-                                  Executor::Args* args) {
+      [&default_runner, &default_runner_parallelism, &handler](
+          const PerPartitionExecutorsAndLib& item, Executor::Args* args) {
         // TODO(azaks): support partial run.
         // TODO(azaks): if the device picks its own threadpool, we need to
         // assign
@@ -724,10 +727,12 @@ Status DirectSession::RunInternal(
         // specific thread pool(s).
         if (!device_thread_pool) {
           args->runner = default_runner;
+          args->runner_parallelism = default_runner_parallelism;
         } else {
           args->runner = [device_thread_pool](Executor::Args::Closure c) {
             device_thread_pool->Schedule(std::move(c));
           };
+          args->runner_parallelism = device_thread_pool->NumThreads();
         }
         if (handler != nullptr) {
           args->user_intra_op_threadpool =
@@ -1019,6 +1024,7 @@ Status DirectSession::PRunSetup(const std::vector<string>& input_names,
   args.runner = [this, pool](Executor::Args::Closure c) {
     pool->Schedule(std::move(c));
   };
+  args.runner_parallelism = pool->NumThreads();
   args.session_state = &session_state_;
   args.session_handle = session_handle_;
   args.tensor_store = &run_state->tensor_store;
@@ -36,6 +36,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/renamed_device.h"
 #include "tensorflow/core/common_runtime/simple_propagator_state.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
+#include "tensorflow/core/common_runtime/work_stealing_scheduler.h"
 #include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/collective.h"
@@ -62,11 +63,13 @@ limitations under the License.
 #include "tensorflow/core/lib/gtl/manual_constructor.h"
 #include "tensorflow/core/lib/hash/hash.h"
 #include "tensorflow/core/platform/context.h"
+#include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/numa.h"
 #include "tensorflow/core/platform/profile_utils/cpu_utils.h"
 #include "tensorflow/core/platform/status.h"
 #include "tensorflow/core/platform/thread_annotations.h"
@@ -147,7 +150,12 @@ typedef absl::InlinedVector<AllocatorAttributes, 4UL> AllocatorAttributeVec;
 
 class ExecutorImpl : public Executor {
  public:
-  explicit ExecutorImpl(const LocalExecutorParams& p) : immutable_state_(p) {}
+  // If `use_work_stealing` is true, every step dispatches its closures to a
+  // `WorkStealingScheduler` running as many workers on `Args::runner` as the
+  // runner runs closures concurrently.
+  explicit ExecutorImpl(const LocalExecutorParams& p,
+                        bool use_work_stealing = false)
+      : immutable_state_(p), use_work_stealing_(use_work_stealing) {}
 
   Status Initialize(const Graph& graph) {
     TF_RETURN_IF_ERROR(immutable_state_.Initialize(graph));
@@ -158,6 +166,9 @@ class ExecutorImpl : public Executor {
  private:
   void RunAsyncInternal(const Args& args, DoneCallback done) override;
 
+  // Creates the `ExecutorState` for one step and starts it.
+  void StartExecutorState(const Args& args, DoneCallback done);
+
   template <class PropagatorStateType>
   friend class ExecutorState;
 
@@ -225,6 +236,7 @@ class ExecutorImpl : public Executor {
 
   ImmutableExecutorState immutable_state_;
   KernelStats kernel_stats_;
+  const bool use_work_stealing_;
 
   ExecutorImpl(const ExecutorImpl&) = delete;
   void operator=(const ExecutorImpl&) = delete;
@@ -1512,6 +1524,67 @@ void ExecutorState<PropagatorStateType>::Finish() {
 }
 
 void ExecutorImpl::RunAsyncInternal(const Args& args, DoneCallback done) {
+  if (!use_work_stealing_ || args.runner == nullptr) {
+    StartExecutorState(args, std::move(done));
+    return;
+  }
+  // Route every closure of the step (kernels, async completions and the done
+  // callback) through work-stealing queues whose workers run on the step's
+  // runner, which keeps owning the threads and bounding the parallelism.
+  // Closures scheduled by `ScheduleReady()` on a worker stay on that worker's
+  // deque, so the successors of a node run where its outputs are cache- and
+  // NUMA-local unless an idle worker steals them.
+  //
+  // The workers are bounded by the parallelism of the runner, so that they
+  // never queue up behind each other in its pool.
+  int max_workers = args.runner_parallelism;
+  if (max_workers <= 0 && args.session_config != nullptr) {
+    max_workers = args.session_config->inter_op_parallelism_threads();
+  }
+  if (max_workers <= 0) max_workers = port::MaxParallelism();
+
+  std::shared_ptr<WorkStealingScheduler> scheduler;
+  const int num_numa_nodes = port::NUMANumNodes();
+  if (num_numa_nodes > 1 && max_workers >= num_numa_nodes) {
+    // One group of workers per NUMA node, each pinning the runner thread it
+    // runs on to its node. Pinning is cheap compared to a worker's lifetime,
+    // which spans all the closures it finds until it runs out of work. The
+    // runner's threads are shared with other steps and sessions, so a worker
+    // restores the affinity of its thread before returning it.
+    std::vector<WorkStealingScheduler::Runner> node_runners;
+    node_runners.reserve(num_numa_nodes);
+    for (int node = 0; node < num_numa_nodes; ++node) {
+      node_runners.push_back(
+          [runner = args.runner, node](std::function<void()> worker) {
+            runner([node, worker = std::move(worker)]() {
+              if (port::NUMAGetThreadNodeAffinity() == node) {
+                worker();
+                return;
+              }
+              // Save the exact CPUs the thread may run on, which need not
+              // match any node, rather than just the node it is pinned to.
+              port::NUMAThreadAffinity* previous_affinity =
+                  port::NUMASaveThreadAffinity();
+              port::NUMASetThreadNodeAffinity(node);
+              worker();
+              port::NUMARestoreThreadAffinity(previous_affinity);
+            });
+          });
+    }
+    scheduler = WorkStealingScheduler::CreatePerNumaNode(
+        std::move(node_runners), max_workers / num_numa_nodes);
+  } else {
+    scheduler = WorkStealingScheduler::Create(args.runner, max_workers);
+  }
+  Args work_stealing_args = args;
+  work_stealing_args.runner =
+      [scheduler = std::move(scheduler)](std::function<void()> fn) {
+        scheduler->Schedule(std::move(fn));
+      };
+  StartExecutorState(work_stealing_args, std::move(done));
+}
+
+void ExecutorImpl::StartExecutorState(const Args& args, DoneCallback done) {
   if (OpOrderDeterminismRequired()) {
     (new ExecutorState<OrderedPropagatorState>(args, immutable_state_,
                                                &kernel_stats_))
@@ -1540,6 +1613,18 @@ Status NewLocalExecutor(const LocalExecutorParams& params, const Graph& graph,
   return s;
 }
 
+Status NewWorkStealingExecutor(const LocalExecutorParams& params,
+                               const Graph& graph, Executor** executor) {
+  ExecutorImpl* impl = new ExecutorImpl(params, /*use_work_stealing=*/true);
+  const Status s = impl->Initialize(graph);
+  if (s.ok()) {
+    *executor = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
 Status CreateNonCachedKernel(Device* device, FunctionLibraryRuntime* flib,
                              const std::shared_ptr<const NodeProperties>& props,
                              int graph_def_version, OpKernel** kernel) {
@@ -1560,6 +1645,7 @@ class DefaultExecutorRegistrar {
     Factory* factory = new Factory;
     ExecutorFactory::Register("", factory);
     ExecutorFactory::Register("DEFAULT", factory);
+    ExecutorFactory::Register("WORK_STEALING", new WorkStealingFactory);
   }
 
  private:
@@ -1572,6 +1658,16 @@ class DefaultExecutorRegistrar {
       return absl::OkStatus();
     }
   };
+
+  class WorkStealingFactory : public ExecutorFactory {
+    Status NewExecutor(const LocalExecutorParams& params, const Graph& graph,
+                       std::unique_ptr<Executor>* out_executor) override {
+      Executor* ret = nullptr;
+      TF_RETURN_IF_ERROR(NewWorkStealingExecutor(params, graph, &ret));
+      out_executor->reset(ret);
+      return absl::OkStatus();
+    }
+  };
 };
 static DefaultExecutorRegistrar registrar;
 
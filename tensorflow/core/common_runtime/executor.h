@@ -121,6 +121,9 @@ class Executor {
     typedef std::function<void()> Closure;
     typedef std::function<void(Closure)> Runner;
     Runner runner = nullptr;
+    // Number of closures "runner" runs concurrently (e.g. the number of
+    // threads of the inter-op pool behind it), or 0 if unknown.
+    int runner_parallelism = 0;
 
     // If true, all kernels will be treated as "inexpensive", and hence executed
     // on the scheduling thread.
@@ -161,6 +164,24 @@ class Executor {
 ::tensorflow::Status NewLocalExecutor(const LocalExecutorParams& params,
                                       const Graph& graph, Executor** executor);
 
+// Like `NewLocalExecutor()`, but the returned executor dispatches the work of
+// each step to NUMA-aware work-stealing queues whose workers run on
+// `Args::runner` (see "./work_stealing_scheduler.h"). Ready successors of a
+// node are preferentially run on the worker, and otherwise on the NUMA node,
+// that produced their inputs.
+//
+// Each step runs up to `Args::runner_parallelism` workers, falling back to
+// the session's `inter_op_parallelism_threads` and then to the number of
+// schedulable CPUs. On NUMA machines the workers are split evenly over the
+// nodes and pin the runner threads they run on to their node.
+//
+// This executor is also registered with `ExecutorFactory` as
+// "WORK_STEALING", and can be selected through
+// `ConfigProto.Experimental.executor_type`.
+::tensorflow::Status NewWorkStealingExecutor(const LocalExecutorParams& params,
+                                             const Graph& graph,
+                                             Executor** executor);
+
 // A class to help run multiple executors in parallel and wait until
 // all of them are complete.
 //
@@ -22,6 +22,7 @@ limitations under the License.
 #include "absl/base/call_once.h"
 #include "tensorflow/core/common_runtime/bfc_allocator.h"
 #include "tensorflow/core/common_runtime/pool_allocator.h"
+#include "tensorflow/core/common_runtime/slab_allocator.h"
 #include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/log_memory.h"
 #include "tensorflow/core/framework/tracking_allocator.h"
@@ -73,7 +74,7 @@ Allocator* ProcessState::GetCPUAllocator(int numa_node) {
   while (cpu_allocators_.size() <= static_cast<size_t>(numa_node)) {
     // If visitors have been defined we need an Allocator built from
     // a SubAllocator.  Prefer BFCAllocator, but fall back to PoolAllocator
-    // depending on env var setting.
+    // or SlabAllocator depending on env var setting.
     const bool alloc_visitors_defined =
         (!cpu_alloc_visitors_.empty() || !cpu_free_visitors_.empty());
     bool use_bfc_allocator = false;
@@ -82,6 +83,14 @@ Allocator* ProcessState::GetCPUAllocator(int numa_node) {
     if (!status.ok()) {
       LOG(ERROR) << "GetCPUAllocator: " << status.message();
     }
+    // SlabAllocator replaces PoolAllocator when a SubAllocator is needed but
+    // BFCAllocator is not requested.
+    bool use_slab_allocator = false;
+    status = ReadBoolFromEnvVar("TF_CPU_ALLOCATOR_USE_SLAB", false,
+                                &use_slab_allocator);
+    if (!status.ok()) {
+      LOG(ERROR) << "GetCPUAllocator: " << status.message();
+    }
     Allocator* allocator = nullptr;
     SubAllocator* sub_allocator =
         (numa_enabled_ || alloc_visitors_defined || use_bfc_allocator)
@@ -109,6 +118,11 @@ Allocator* ProcessState::GetCPUAllocator(int numa_node) {
 
       VLOG(2) << "Using BFCAllocator with memory limit of "
               << cpu_mem_limit_in_mb << " MB for ProcessState CPU allocator";
+    } else if (sub_allocator && use_slab_allocator) {
+      allocator = new SlabAllocator(sub_allocator, "cpu_slab");
+      VLOG(2) << "Using SlabAllocator for ProcessState CPU allocator "
+              << "numa_enabled_=" << numa_enabled_
+              << " numa_node=" << numa_node;
     } else if (sub_allocator) {
       DCHECK(sub_allocator);
       allocator =
@@ -0,0 +1,423 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/slab_allocator.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+namespace {
+
+// Every buffer starts with this many bytes reserved for its `Header`, which
+// keeps user pointers aligned to `Allocator::kAllocatorAlignment`.
+constexpr size_t kHeaderBytes = Allocator::kAllocatorAlignment;
+
+// Number of bytes a batch of buffers moved between a CPU cache and the
+// central free lists aims for.
+constexpr size_t kBatchBytes = 64 << 10;
+constexpr int kMaxBatchSize = 32;
+
+size_t RoundUpTo(size_t n, size_t multiple) {
+  return (n + multiple - 1) / multiple * multiple;
+}
+
+template <typename T>
+void UpdateMax(std::atomic<T>* max, T value) {
+  T current = max->load(std::memory_order_relaxed);
+  while (value > current &&
+         !max->compare_exchange_weak(current, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
+// Stored immediately before every user pointer.
+struct SlabAllocator::Header {
+  void* block;
+  // Size class index, or -1 for buffers obtained directly from the
+  // SubAllocator.
+  int64_t cls;
+  size_t block_bytes;
+  size_t requested_bytes;
+};
+
+struct alignas(64) SlabAllocator::CpuCache {
+  mutex mu;
+  // Free buffers, indexed by size class.
+  std::vector<std::vector<void*>> free TF_GUARDED_BY(mu);
+  size_t cached_bytes TF_GUARDED_BY(mu) = 0;
+};
+
+struct alignas(64) SlabAllocator::CentralList {
+  mutex mu;
+  std::vector<void*> free TF_GUARDED_BY(mu);
+};
+
+SlabAllocator::SlabAllocator(SubAllocator* sub_allocator, std::string name,
+                             const Options& options)
+    : name_(std::move(name)), options_(options), sub_allocator_(sub_allocator) {
+  static_assert(sizeof(Header) <= kHeaderBytes,
+                "Header does not fit in kHeaderBytes");
+  // Four classes per power of two, starting with the smallest buffer that
+  // holds a header and one aligned cache line.
+  for (size_t base = 2 * kHeaderBytes; base <= options_.max_class_bytes;
+       base *= 2) {
+    for (int quarter = 0; quarter < 4; ++quarter) {
+      const size_t size =
+          RoundUpTo(base + quarter * (base / 4), kAllocatorAlignment);
+      if (size > options_.max_class_bytes) break;
+      if (class_sizes_.empty() || size > class_sizes_.back()) {
+        class_sizes_.push_back(size);
+      }
+    }
+  }
+  for (size_t size : class_sizes_) {
+    batch_sizes_.push_back(std::clamp<int>(kBatchBytes / size, 1,
+                                           kMaxBatchSize));
+    central_.push_back(std::make_unique<CentralList>());
+  }
+  const int num_caches = options_.num_cpu_caches > 0
+                             ? options_.num_cpu_caches
+                             : std::max(port::NumTotalCPUs(), 1);
+  for (int i = 0; i < num_caches; ++i) {
+    auto cache = std::make_unique<CpuCache>();
+    mutex_lock l(cache->mu);
+    cache->free.resize(class_sizes_.size());
+    cpu_caches_.push_back(std::move(cache));
+  }
+}
+
+SlabAllocator::~SlabAllocator() {
+  mutex_lock l(slabs_mu_);
+  for (const auto& [ptr, slab] : slabs_) {
+    sub_allocator_->Free(const_cast<char*>(ptr), slab.num_bytes);
+  }
+}
+
+int SlabAllocator::ClassIndex(size_t total_bytes) const {
+  auto it =
+      std::lower_bound(class_sizes_.begin(), class_sizes_.end(), total_bytes);
+  if (it == class_sizes_.end()) return -1;
+  return it - class_sizes_.begin();
+}
+
+size_t SlabAllocator::ClassSizeFor(size_t num_bytes) const {
+  const int cls = ClassIndex(num_bytes + kHeaderBytes);
+  return cls < 0 ? 0 : class_sizes_[cls];
+}
+
+SlabAllocator::CpuCache& SlabAllocator::CurrentCpuCache() {
+  int cpu = port::GetCurrentCPU();
+  if (cpu < 0) {
+    // The CPU cannot be identified on this platform: spread threads over the
+    // caches instead.
+    static std::atomic<int> next_thread_index{0};
+    static thread_local int thread_index = next_thread_index.fetch_add(1);
+    cpu = thread_index;
+  }
+  return *cpu_caches_[cpu % cpu_caches_.size()];
+}
+
+void* SlabAllocator::PrepareBlock(void* block, int cls, size_t block_bytes,
+                                  size_t alignment, size_t num_bytes) {
+  const size_t user_alignment = std::max(alignment, kAllocatorAlignment);
+  const uintptr_t user = RoundUpTo(
+      reinterpret_cast<uintptr_t>(block) + kHeaderBytes, user_alignment);
+  Header* header = reinterpret_cast<Header*>(user) - 1;
+  header->block = block;
+  header->cls = cls;
+  header->block_bytes = block_bytes;
+  header->requested_bytes = num_bytes;
+  return reinterpret_cast<void*>(user);
+}
+
+void SlabAllocator::RecordAlloc(size_t num_bytes) {
+  num_allocs_.fetch_add(1, std::memory_order_relaxed);
+  const int64_t in_use =
+      bytes_in_use_.fetch_add(num_bytes, std::memory_order_relaxed) +
+      num_bytes;
+  UpdateMax<int64_t>(&peak_bytes_in_use_, in_use);
+  UpdateMax<int64_t>(&largest_alloc_size_, num_bytes);
+}
+
+void* SlabAllocator::AllocateRaw(size_t alignment, size_t num_bytes) {
+  if (num_bytes == 0) return nullptr;
+  // Leaves room to advance the user pointer to a larger alignment.
+  const size_t total_bytes =
+      num_bytes + kHeaderBytes +
+      (alignment > kAllocatorAlignment ? alignment : 0);
+  const int cls = ClassIndex(total_bytes);
+  if (cls < 0) {
+    size_t bytes_received;
+    void* block =
+        sub_allocator_->Alloc(kAllocatorAlignment, total_bytes, &bytes_received);
+    if (block == nullptr) return nullptr;
+    direct_allocs_.fetch_add(1, std::memory_order_relaxed);
+    UpdateMax<int64_t>(&peak_pool_bytes_,
+                       pool_bytes_.fetch_add(bytes_received) + bytes_received);
+    RecordAlloc(num_bytes);
+    return PrepareBlock(block, -1, bytes_received, alignment, num_bytes);
+  }
+
+  CpuCache& cache = CurrentCpuCache();
+  void* block = nullptr;
+  {
+    mutex_lock l(cache.mu);
+    std::vector<void*>& free = cache.free[cls];
+    if (!free.empty()) {
+      block = free.back();
+      free.pop_back();
+      cache.cached_bytes -= class_sizes_[cls];
+    }
+  }
+  if (block != nullptr) {
+    cpu_cache_hits_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    block = AllocateFromCentral(cls, &cache);
+    if (block == nullptr) return nullptr;
+  }
+  RecordAlloc(num_bytes);
+  return PrepareBlock(block, cls, class_sizes_[cls], alignment, num_bytes);
+}
+
+void* SlabAllocator::AllocateFromCentral(int cls, CpuCache* cache) {
+  const size_t class_size = class_sizes_[cls];
+  const int batch_size = batch_sizes_[cls];
+  std::vector<void*> batch;
+  {
+    CentralList& central = *central_[cls];
+    mutex_lock l(central.mu);
+    const int n = std::min<int>(batch_size, central.free.size());
+    batch.assign(central.free.end() - n, central.free.end());
+    central.free.resize(central.free.size() - n);
+    central_free_bytes_.fetch_sub(n * class_size, std::memory_order_relaxed);
+  }
+  if (!batch.empty()) {
+    central_hits_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    // Carve a new slab. The SubAllocator may be slow (e.g. when it pins
+    // memory), so no lock is held while calling it.
+    const size_t slab_bytes =
+        std::max<size_t>(options_.slab_bytes / class_size, 1) * class_size;
+    size_t bytes_received;
+    char* slab = static_cast<char*>(
+        sub_allocator_->Alloc(kAllocatorAlignment, slab_bytes, &bytes_received));
+    if (slab == nullptr) return nullptr;
+    slab_count_.fetch_add(1, std::memory_order_relaxed);
+    UpdateMax<int64_t>(&peak_pool_bytes_,
+                       pool_bytes_.fetch_add(bytes_received) + bytes_received);
+    const size_t num_blocks = bytes_received / class_size;
+    DCHECK_GE(num_blocks, 1);
+    {
+      mutex_lock l(slabs_mu_);
+      slabs_.emplace(slab, Slab{bytes_received, num_blocks});
+    }
+    // Keeps a batch for this CPU and publishes the rest.
+    const size_t num_local = std::min<size_t>(num_blocks, batch_size);
+    for (size_t i = 0; i < num_local; ++i) {
+      batch.push_back(slab + i * class_size);
+    }
+    if (num_blocks > num_local) {
+      CentralList& central = *central_[cls];
+      mutex_lock l(central.mu);
+      for (size_t i = num_local; i < num_blocks; ++i) {
+        central.free.push_back(slab + i * class_size);
+      }
+      central_free_bytes_.fetch_add((num_blocks - num_local) * class_size,
+                                    std::memory_order_relaxed);
+    }
+  }
+
+  void* block = batch.back();
+  batch.pop_back();
+  if (!batch.empty()) {
+    mutex_lock l(cache->mu);
+    std::vector<void*>& free = cache->free[cls];
+    free.insert(free.end(), batch.begin(), batch.end());
+    cache->cached_bytes += batch.size() * class_size;
+  }
+  return block;
+}
+
+void SlabAllocator::DeallocateRaw(void* ptr) {
+  if (ptr == nullptr) return;
+  const Header* header = reinterpret_cast<const Header*>(ptr) - 1;
+  bytes_in_use_.fetch_sub(header->requested_bytes, std::memory_order_relaxed);
+  void* block = header->block;
+  if (header->cls < 0) {
+    const size_t block_bytes = header->block_bytes;
+    pool_bytes_.fetch_sub(block_bytes);
+    sub_allocator_->Free(block, block_bytes);
+    return;
+  }
+  const int cls = header->cls;
+  CpuCache& cache = CurrentCpuCache();
+  bool over_limit = false;
+  {
+    mutex_lock l(cache.mu);
+    cache.free[cls].push_back(block);
+    cache.cached_bytes += class_sizes_[cls];
+    if (cache.cached_bytes > options_.max_cpu_cache_bytes) {
+      ReleaseToCentral(cls, &cache);
+      over_limit = options_.max_central_free_bytes > 0 &&
+                   central_free_bytes_.load(std::memory_order_relaxed) >
+                       options_.max_central_free_bytes;
+    }
+  }
+  // The SubAllocator may be slow to free (e.g. when it unpins memory), so
+  // slabs are released without holding the cache lock.
+  if (over_limit) ReleaseFreeSlabs();
+}
+
+void SlabAllocator::ReleaseToCentral(int cls, CpuCache* cache) {
+  // Drains the class that overflowed first, then the others, down to half of
+  // the limit so that the next few frees do not release again.
+  const size_t target = options_.max_cpu_cache_bytes / 2;
+  for (int i = 0; i < static_cast<int>(class_sizes_.size()) &&
+                  cache->cached_bytes > target;
+       ++i) {
+    const int c = i == 0 ? cls : (i <= cls ? i - 1 : i);
+    std::vector<void*>& free = cache->free[c];
+    if (free.empty()) continue;
+    size_t n = 0;
+    while (n < free.size() &&
+           cache->cached_bytes - n * class_sizes_[c] > target) {
+      ++n;
+    }
+    CentralList& central = *central_[c];
+    mutex_lock l(central.mu);
+    central.free.insert(central.free.end(), free.end() - n, free.end());
+    free.resize(free.size() - n);
+    cache->cached_bytes -= n * class_sizes_[c];
+    central_free_bytes_.fetch_add(n * class_sizes_[c],
+                                  std::memory_order_relaxed);
+  }
+}
+
+void SlabAllocator::ReleaseFreeSlabs() {
+  // A release in progress serves concurrent callers too.
+  mutex_lock l(release_mu_, std::try_to_lock);
+  if (!l) return;
+
+  const int64_t target = options_.max_central_free_bytes / 2;
+  std::vector<std::pair<char*, size_t>> released;
+  for (int cls = class_sizes_.size() - 1;
+       cls >= 0 && central_free_bytes_.load() > target; --cls) {
+    const size_t class_size = class_sizes_[cls];
+    CentralList& central = *central_[cls];
+    mutex_lock central_lock(central.mu);
+    if (central.free.empty()) continue;
+    mutex_lock slabs_lock(slabs_mu_);
+
+    // Buffers of a class only come from slabs carved for that class, so a
+    // slab is free if all its buffers are in the central free list.
+    auto slab_of = [this](void* block) TF_EXCLUSIVE_LOCKS_REQUIRED(
+                       slabs_mu_) {
+      auto it = slabs_.upper_bound(static_cast<const char*>(block));
+      DCHECK(it != slabs_.begin());
+      return std::prev(it);
+    };
+    absl::flat_hash_map<const char*, size_t> num_free;
+    for (void* block : central.free) ++num_free[slab_of(block)->first];
+
+    absl::flat_hash_set<const char*> release;
+    int64_t released_bytes = 0;
+    for (const auto& [ptr, count] : num_free) {
+      const Slab& slab = slabs_.at(ptr);
+      if (count < slab.num_blocks ||
+          central_free_bytes_.load() - released_bytes <= target) {
+        continue;
+      }
+      release.insert(ptr);
+      released_bytes += slab.num_blocks * class_size;
+    }
+    if (release.empty()) continue;
+
+    central.free.erase(
+        std::remove_if(central.free.begin(), central.free.end(),
+                       [&](void* block) TF_EXCLUSIVE_LOCKS_REQUIRED(
+                           slabs_mu_) {
+                         return release.contains(slab_of(block)->first);
+                       }),
+        central.free.end());
+    central_free_bytes_.fetch_sub(released_bytes);
+    for (const char* ptr : release) {
+      auto it = slabs_.find(ptr);
+      released.emplace_back(const_cast<char*>(ptr), it->second.num_bytes);
+      slabs_.erase(it);
+    }
+  }
+
+  for (const auto& [ptr, num_bytes] : released) {
+    pool_bytes_.fetch_sub(num_bytes);
+    sub_allocator_->Free(ptr, num_bytes);
+  }
+  released_slabs_.fetch_add(released.size(), std::memory_order_relaxed);
+}
+
+size_t SlabAllocator::RequestedSize(const void* ptr) const {
+  CHECK(ptr);
+  return (reinterpret_cast<const Header*>(ptr) - 1)->requested_bytes;
+}
+
+size_t SlabAllocator::AllocatedSize(const void* ptr) const {
+  CHECK(ptr);
+  const Header* header = reinterpret_cast<const Header*>(ptr) - 1;
+  return header->block_bytes - (static_cast<const char*>(ptr) -
+                                static_cast<const char*>(header->block));
+}
+
+double SlabAllocator::hit_rate() const {
+  const int64_t hits = cpu_cache_hit_count() + central_hit_count();
+  const int64_t total = hits + slab_count();
+  return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+}
+
+absl::optional<AllocatorStats> SlabAllocator::GetStats() {
+  AllocatorStats stats;
+  stats.num_allocs = num_allocs_.load();
+  stats.bytes_in_use = bytes_in_use_.load();
+  stats.peak_bytes_in_use = peak_bytes_in_use_.load();
+  stats.largest_alloc_size = largest_alloc_size_.load();
+  stats.pool_bytes = pool_bytes_.load();
+  stats.peak_pool_bytes = peak_pool_bytes_.load();
+  for (int cls = class_sizes_.size() - 1; cls >= 0; --cls) {
+    CentralList& central = *central_[cls];
+    mutex_lock l(central.mu);
+    if (!central.free.empty()) {
+      stats.largest_free_block_bytes = class_sizes_[cls] - kHeaderBytes;
+      break;
+    }
+  }
+  return stats;
+}
+
+bool SlabAllocator::ClearStats() {
+  num_allocs_ = 0;
+  peak_bytes_in_use_ = bytes_in_use_.load();
+  largest_alloc_size_ = 0;
+  peak_pool_bytes_ = pool_bytes_.load();
+  return true;
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,209 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_SLAB_ALLOCATOR_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_SLAB_ALLOCATOR_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// A caching allocator for CPU-accessible memory (pageable or pinned host
+// memory) obtained from a SubAllocator, organized like tcmalloc:
+//
+//  * Requests are rounded up to one of a fixed set of size classes, four per
+//    power of two, so that freed buffers can be reused by requests of similar
+//    rather than identical size.
+//  * Buffers of a size class are carved out of large slabs obtained from the
+//    SubAllocator, which amortizes expensive SubAllocator calls such as
+//    pinning memory.
+//  * Freed buffers go to a cache owned by the CPU the freeing thread runs on,
+//    and allocations are served from the current CPU's cache first, so the
+//    common path takes only an uncontended per-CPU lock. Caches exchange
+//    buffers in batches with per-size-class central free lists.
+//
+// Requests larger than the largest size class go straight to the
+// SubAllocator, where rounding to a size class would waste the most memory.
+// Like PoolAllocator's `pool_size_limit`, `max_central_free_bytes` bounds the
+// free memory the allocator retains: beyond it, slabs whose buffers are all
+// in the central free lists are returned to the SubAllocator.
+//
+// Unlike PoolAllocator, which keeps every free buffer in a single LRU list
+// behind one mutex, allocations and deallocations from different CPUs do not
+// contend.
+//
+// Buffers carry a 64-byte header, so this allocator must not be used for
+// device memory.
+class SlabAllocator : public Allocator {
+ public:
+  struct Options {
+    Options() {}
+
+    // Size of the slabs requested from the SubAllocator. Size classes larger
+    // than this use slabs holding a single buffer.
+    size_t slab_bytes = 2 << 20;
+
+    // Largest size class. Larger requests bypass the caches.
+    size_t max_class_bytes = 256 << 10;
+
+    // Bytes of free buffers a per-CPU cache holds before returning buffers to
+    // the central free lists.
+    size_t max_cpu_cache_bytes = 8 << 20;
+
+    // Number of per-CPU caches. If <= 0, one per CPU of the machine.
+    int num_cpu_caches = 0;
+
+    // Bytes of free buffers the central free lists hold before free slabs are
+    // returned to the SubAllocator, down to half of this limit. If 0, slabs
+    // are only returned when the allocator is destroyed.
+    size_t max_central_free_bytes = 64 << 20;
+  };
+
+  // Takes ownership of `sub_allocator`.
+  SlabAllocator(SubAllocator* sub_allocator, std::string name,
+                const Options& options = Options());
+  ~SlabAllocator() override;
+
+  std::string Name() override { return name_; }
+
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override;
+  void DeallocateRaw(void* ptr) override;
+
+  bool TracksAllocationSizes() const override { return true; }
+  size_t RequestedSize(const void* ptr) const override;
+  size_t AllocatedSize(const void* ptr) const override;
+
+  // Reports, in addition to the usual counters:
+  //  * `pool_bytes`: bytes obtained from the SubAllocator. The difference with
+  //    `bytes_in_use` is the memory lost to fragmentation (rounding to size
+  //    classes and cached free buffers).
+  //  * `largest_free_block_bytes`: the largest size class with a free buffer
+  //    in the central free lists.
+  absl::optional<AllocatorStats> GetStats() override;
+  bool ClearStats() override;
+
+  AllocatorMemoryType GetMemoryType() const override {
+    return sub_allocator_->GetMemoryType();
+  }
+
+  // Counters for monitoring the effectiveness of the caches. As with
+  // PoolAllocator, these are read without synchronization.
+
+  // Allocations served by a per-CPU cache.
+  int64_t cpu_cache_hit_count() const { return cpu_cache_hits_.load(); }
+  // Allocations that refilled a per-CPU cache from the central free lists.
+  int64_t central_hit_count() const { return central_hits_.load(); }
+  // Slabs obtained from the SubAllocator.
+  int64_t slab_count() const { return slab_count_.load(); }
+  // Slabs returned to the SubAllocator before destruction.
+  int64_t released_slab_count() const { return released_slabs_.load(); }
+  // Allocations too large for any size class.
+  int64_t direct_alloc_count() const { return direct_allocs_.load(); }
+  // Fraction of cached-size allocations served without new slab memory.
+  double hit_rate() const;
+
+  // Returns the size of the smallest class that fits `num_bytes` including
+  // the buffer header, or 0 if `num_bytes` is too large. Exposed for testing.
+  size_t ClassSizeFor(size_t num_bytes) const;
+
+ private:
+  struct Header;
+  struct CpuCache;
+  struct CentralList;
+
+  // Returns the index in `class_sizes_` of the class holding `total_bytes`,
+  // or -1 if there is none.
+  int ClassIndex(size_t total_bytes) const;
+
+  CpuCache& CurrentCpuCache();
+
+  // Pops a free buffer of class `cls` from the central free list, or carves a
+  // new slab, moving a batch of further buffers into `cache`. `cache->mu`
+  // must not be held.
+  void* AllocateFromCentral(int cls, CpuCache* cache);
+
+  // Moves buffers of class `cls` from `cache` to the central free list until
+  // the cache is back under its byte limit.
+  void ReleaseToCentral(int cls, CpuCache* cache)
+      TF_NO_THREAD_SAFETY_ANALYSIS;
+
+  // Returns slabs whose buffers are all in the central free lists to the
+  // SubAllocator, largest classes first, until the central free lists hold
+  // at most half of `max_central_free_bytes`.
+  void ReleaseFreeSlabs();
+
+  // Writes the header of a buffer of `block_bytes` starting at `block` and
+  // returns the user pointer.
+  static void* PrepareBlock(void* block, int cls, size_t block_bytes,
+                            size_t alignment, size_t num_bytes);
+
+  void RecordAlloc(size_t num_bytes);
+
+  const std::string name_;
+  const Options options_;
+  const std::unique_ptr<SubAllocator> sub_allocator_;
+  // Sizes of the buffers of each class, in increasing order. Each is a
+  // multiple of `Allocator::kAllocatorAlignment`.
+  std::vector<size_t> class_sizes_;
+  // Number of buffers moved between a CPU cache and the central free list at
+  // once, for each class.
+  std::vector<int> batch_sizes_;
+
+  std::vector<std::unique_ptr<CpuCache>> cpu_caches_;
+  std::vector<std::unique_ptr<CentralList>> central_;
+
+  mutex slabs_mu_;
+  struct Slab {
+    size_t num_bytes;
+    size_t num_blocks;
+  };
+  // Live slabs, keyed by their start address.
+  std::map<const char*, Slab> slabs_ TF_GUARDED_BY(slabs_mu_);
+
+  // Serializes `ReleaseFreeSlabs()`.
+  mutex release_mu_;
+  // Bytes of the buffers in the central free lists.
+  std::atomic<int64_t> central_free_bytes_{0};
+
+  std::atomic<int64_t> cpu_cache_hits_{0};
+  std::atomic<int64_t> central_hits_{0};
+  std::atomic<int64_t> slab_count_{0};
+  std::atomic<int64_t> released_slabs_{0};
+  std::atomic<int64_t> direct_allocs_{0};
+
+  std::atomic<int64_t> num_allocs_{0};
+  std::atomic<int64_t> bytes_in_use_{0};
+  std::atomic<int64_t> peak_bytes_in_use_{0};
+  std::atomic<int64_t> largest_alloc_size_{0};
+  std::atomic<int64_t> pool_bytes_{0};
+  std::atomic<int64_t> peak_pool_bytes_{0};
+
+  SlabAllocator(const SlabAllocator&) = delete;
+  void operator=(const SlabAllocator&) = delete;
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_SLAB_ALLOCATOR_H_
@@ -0,0 +1,293 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/slab_allocator.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/pool_allocator.h"
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace {
+
+SubAllocator* NewSubAllocator() {
+  return new BasicCPUAllocator(port::kNUMANoAffinity, {}, {});
+}
+
+SlabAllocator::Options SmallOptions() {
+  SlabAllocator::Options options;
+  options.slab_bytes = 64 << 10;
+  options.max_class_bytes = 1 << 20;
+  options.max_cpu_cache_bytes = 256 << 10;
+  options.num_cpu_caches = 4;
+  return options;
+}
+
+TEST(SlabAllocatorTest, ZeroSizeBuffers) {
+  SlabAllocator a(NewSubAllocator(), "slab", SmallOptions());
+  EXPECT_EQ(nullptr, a.AllocateRaw(4, 0));
+  a.DeallocateRaw(nullptr);  // Should not crash.
+  EXPECT_EQ(0, a.slab_count());
+  EXPECT_EQ(0, a.cpu_cache_hit_count());
+}
+
+TEST(SlabAllocatorTest, ClassSizes) {
+  SlabAllocator a(NewSubAllocator(), "slab", SmallOptions());
+  size_t previous = 0;
+  for (size_t n = 1; n <= (1 << 20) - Allocator::kAllocatorAlignment; n *= 3) {
+    const size_t class_size = a.ClassSizeFor(n);
+    EXPECT_GE(class_size, n + Allocator::kAllocatorAlignment);
+    EXPECT_EQ(0, class_size % Allocator::kAllocatorAlignment);
+    // Four classes per power of two bound the rounding waste.
+    if (n >= 1024) EXPECT_LE(class_size, (n + 64) * 5 / 4 + 64);
+    EXPECT_GE(class_size, previous);
+    previous = class_size;
+  }
+  EXPECT_EQ(0, a.ClassSizeFor(1 << 20));
+}
+
+TEST(SlabAllocatorTest, LargeRequestsBypassSizeClasses) {
+  SlabAllocator a(NewSubAllocator(), "slab");
+  EXPECT_GT(a.ClassSizeFor(64 << 10), 0);
+  EXPECT_EQ(0, a.ClassSizeFor(1 << 20));
+  void* p = a.AllocateRaw(64, 1 << 20);
+  EXPECT_EQ(1, a.direct_alloc_count());
+  EXPECT_EQ(0, a.slab_count());
+  a.DeallocateRaw(p);
+}
+
+TEST(SlabAllocatorTest, AllocateSizesAndAlignments) {
+  SlabAllocator a(NewSubAllocator(), "slab", SmallOptions());
+  std::vector<void*> ptrs;
+  for (size_t alignment : {1, 8, 64, 256, 4096}) {
+    for (size_t n : {1, 7, 64, 100, 1000, 4097, 70000, 2 << 20}) {
+      void* p = a.AllocateRaw(alignment, n);
+      ASSERT_NE(nullptr, p);
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p) %
+                       std::max(alignment, Allocator::kAllocatorAlignment));
+      EXPECT_EQ(n, a.RequestedSize(p));
+      EXPECT_GE(a.AllocatedSize(p), n);
+      // The whole buffer must be writable without clobbering the header.
+      memset(p, 0xab, n);
+      EXPECT_EQ(n, a.RequestedSize(p));
+      ptrs.push_back(p);
+    }
+  }
+  for (void* p : ptrs) a.DeallocateRaw(p);
+  EXPECT_EQ(5, a.direct_alloc_count());
+  EXPECT_EQ(0, a.GetStats()->bytes_in_use);
+}
+
+TEST(SlabAllocatorTest, ReusesFreedBuffers) {
+  SlabAllocator::Options options = SmallOptions();
+  options.num_cpu_caches = 1;
+  SlabAllocator a(NewSubAllocator(), "slab", options);
+  void* p = a.AllocateRaw(64, 1000);
+  a.DeallocateRaw(p);
+  const int64_t slabs = a.slab_count();
+  EXPECT_EQ(1, slabs);
+  for (int i = 0; i < 100; ++i) {
+    // Sizes in the same class are served by the same buffers.
+    void* q = a.AllocateRaw(64, 990 + (i % 10));
+    ASSERT_NE(nullptr, q);
+    a.DeallocateRaw(q);
+  }
+  EXPECT_EQ(slabs, a.slab_count());
+  EXPECT_GE(a.hit_rate(), 0.99);
+}
+
+TEST(SlabAllocatorTest, OverflowingCpuCacheGoesToCentral) {
+  SlabAllocator::Options options = SmallOptions();
+  options.num_cpu_caches = 1;
+  SlabAllocator a(NewSubAllocator(), "slab", options);
+  const size_t n = 16 << 10;
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 64; ++i) ptrs.push_back(a.AllocateRaw(64, n));
+  for (void* p : ptrs) a.DeallocateRaw(p);
+  // 1MB was freed into a 256KB cache: the rest went to the central list.
+  EXPECT_GE(a.GetStats()->largest_free_block_bytes, n);
+  const int64_t slabs = a.slab_count();
+  ptrs.clear();
+  for (int i = 0; i < 64; ++i) ptrs.push_back(a.AllocateRaw(64, n));
+  for (void* p : ptrs) a.DeallocateRaw(p);
+  EXPECT_EQ(slabs, a.slab_count());
+  EXPECT_GT(a.central_hit_count(), 0);
+}
+
+TEST(SlabAllocatorTest, ReleasesFreeSlabsOverLimit) {
+  SlabAllocator::Options options = SmallOptions();
+  options.num_cpu_caches = 1;
+  options.max_cpu_cache_bytes = 64 << 10;
+  options.max_central_free_bytes = 256 << 10;
+  SlabAllocator a(NewSubAllocator(), "slab", options);
+  const size_t n = 16 << 10;
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 256; ++i) ptrs.push_back(a.AllocateRaw(64, n));
+  EXPECT_GE(a.GetStats()->pool_bytes.value(), 256 * n);
+  for (void* p : ptrs) a.DeallocateRaw(p);
+
+  // At most the central limit and the CPU cache stay with the allocator.
+  EXPECT_GT(a.released_slab_count(), 0);
+  EXPECT_LE(a.GetStats()->pool_bytes.value(),
+            options.max_central_free_bytes + options.max_cpu_cache_bytes +
+                2 * options.slab_bytes);
+
+  // Released memory is obtained again on demand.
+  ptrs.clear();
+  for (int i = 0; i < 256; ++i) ptrs.push_back(a.AllocateRaw(64, n));
+  for (void* p : ptrs) {
+    ASSERT_NE(nullptr, p);
+    memset(p, 0xab, n);
+  }
+  for (void* p : ptrs) a.DeallocateRaw(p);
+  EXPECT_EQ(0, a.GetStats()->bytes_in_use);
+}
+
+TEST(SlabAllocatorTest, KeepsSlabsWithLiveBuffers) {
+  SlabAllocator::Options options = SmallOptions();
+  options.num_cpu_caches = 1;
+  options.max_cpu_cache_bytes = 64 << 10;
+  options.max_central_free_bytes = 64 << 10;
+  SlabAllocator a(NewSubAllocator(), "slab", options);
+  const size_t n = 16 << 10;
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 64; ++i) ptrs.push_back(a.AllocateRaw(64, n));
+  // Frees every other buffer, which exceeds the limit but leaves most slabs
+  // with a live buffer.
+  std::vector<char*> live;
+  for (int i = 0; i < ptrs.size(); ++i) {
+    if (i % 2 == 0) {
+      live.push_back(static_cast<char*>(ptrs[i]));
+      memset(ptrs[i], 0xab, n);
+    } else {
+      a.DeallocateRaw(ptrs[i]);
+    }
+  }
+  EXPECT_GE(a.GetStats()->pool_bytes.value(), live.size() * n);
+  for (char* p : live) {
+    EXPECT_EQ(n, a.RequestedSize(p));
+    EXPECT_EQ(std::string(n, '\xab'), std::string(p, n));
+    a.DeallocateRaw(p);
+  }
+  EXPECT_GT(a.released_slab_count(), 0);
+}
+
+TEST(SlabAllocatorTest, Stats) {
+  SlabAllocator a(NewSubAllocator(), "slab", SmallOptions());
+  void* p1 = a.AllocateRaw(64, 1000);
+  void* p2 = a.AllocateRaw(64, 3000);
+  void* p3 = a.AllocateRaw(64, 4 << 20);
+  absl::optional<AllocatorStats> stats = a.GetStats();
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(3, stats->num_allocs);
+  EXPECT_EQ(1000 + 3000 + (4 << 20), stats->bytes_in_use);
+  EXPECT_EQ(4 << 20, stats->largest_alloc_size);
+  EXPECT_GE(stats->pool_bytes, stats->bytes_in_use);
+  a.DeallocateRaw(p3);
+  stats = a.GetStats();
+  EXPECT_EQ(4000, stats->bytes_in_use);
+  EXPECT_EQ(1000 + 3000 + (4 << 20), stats->peak_bytes_in_use);
+  // Direct allocations are returned immediately.
+  EXPECT_LT(stats->pool_bytes, 4 << 20);
+  EXPECT_TRUE(a.ClearStats());
+  stats = a.GetStats();
+  EXPECT_EQ(0, stats->num_allocs);
+  EXPECT_EQ(4000, stats->peak_bytes_in_use);
+  a.DeallocateRaw(p1);
+  a.DeallocateRaw(p2);
+}
+
+TEST(SlabAllocatorTest, ConcurrentAllocations) {
+  SlabAllocator a(NewSubAllocator(), "slab", SmallOptions());
+  constexpr int kThreads = 8;
+  thread::ThreadPool pool(Env::Default(), "test", kThreads);
+  BlockingCounter done(kThreads);
+  for (int t = 0; t < kThreads; ++t) {
+    pool.Schedule([&a, &done, t]() {
+      std::vector<void*> ptrs;
+      for (int i = 0; i < 2000; ++i) {
+        const size_t n = 1 + (i * 7919 + t) % 20000;
+        char* p = static_cast<char*>(a.AllocateRaw(64, n));
+        CHECK(p != nullptr);
+        p[0] = static_cast<char>(t);
+        p[n - 1] = static_cast<char>(t);
+        ptrs.push_back(p);
+        if (ptrs.size() > 16) {
+          // Frees happen on a different CPU from allocations at times.
+          char* q = static_cast<char*>(ptrs[i % ptrs.size()]);
+          CHECK_EQ(q[0], static_cast<char>(t));
+          a.DeallocateRaw(q);
+          ptrs[i % ptrs.size()] = ptrs.back();
+          ptrs.pop_back();
+        }
+      }
+      for (void* p : ptrs) a.DeallocateRaw(p);
+      done.DecrementCount();
+    });
+  }
+  done.Wait();
+  EXPECT_EQ(0, a.GetStats()->bytes_in_use);
+}
+
+template <typename AllocatorFactory>
+void BenchmarkAllocator(::testing::benchmark::State& state,
+                        AllocatorFactory factory) {
+  const int num_threads = state.range(0);
+  std::unique_ptr<Allocator> a = factory();
+  thread::ThreadPool pool(Env::Default(), "bench", num_threads);
+  for (auto s : state) {
+    BlockingCounter done(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+      pool.Schedule([&a, &done, t]() {
+        void* ptrs[8];
+        for (int i = 0; i < 1000; ++i) {
+          for (int j = 0; j < 8; ++j) {
+            ptrs[j] = a->AllocateRaw(64, 256 << ((i + j + t) % 8));
+          }
+          for (int j = 0; j < 8; ++j) a->DeallocateRaw(ptrs[j]);
+        }
+        done.DecrementCount();
+      });
+    }
+    done.Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * num_threads * 8000);
+}
+
+void BM_SlabAllocator(::testing::benchmark::State& state) {
+  BenchmarkAllocator(state, []() {
+    return std::make_unique<SlabAllocator>(NewSubAllocator(), "slab");
+  });
+}
+BENCHMARK(BM_SlabAllocator)->Arg(1)->Arg(4)->Arg(16);
+
+void BM_PoolAllocator(::testing::benchmark::State& state) {
+  BenchmarkAllocator(state, []() {
+    return std::make_unique<PoolAllocator>(
+        /*pool_size_limit=*/100, /*auto_resize=*/true, NewSubAllocator(),
+        new NoopRounder, "pool");
+  });
+}
+BENCHMARK(BM_PoolAllocator)->Arg(1)->Arg(4)->Arg(16);
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,211 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/work_stealing_scheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace {
+
+// Identifies the scheduler and deque of the worker running on the current
+// thread, if any.
+thread_local const WorkStealingScheduler* current_scheduler = nullptr;
+thread_local int current_worker_id = -1;
+
+// Cheap per-thread pseudo-random number, used to pick the first steal victim so
+// that idle workers do not all hammer the same deque.
+uint32 NextRandom() {
+  thread_local uint32 state =
+      static_cast<uint32>(Env::Default()->NowNanos()) | 1;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+}  // namespace
+
+std::shared_ptr<WorkStealingScheduler> WorkStealingScheduler::Create(
+    Runner runner, int max_workers) {
+  std::vector<Runner> node_runners;
+  node_runners.push_back(std::move(runner));
+  return CreatePerNumaNode(std::move(node_runners), max_workers);
+}
+
+std::shared_ptr<WorkStealingScheduler> WorkStealingScheduler::CreatePerNumaNode(
+    std::vector<Runner> node_runners, int max_workers_per_node) {
+  DCHECK(!node_runners.empty());
+  return std::shared_ptr<WorkStealingScheduler>(new WorkStealingScheduler(
+      std::move(node_runners), max_workers_per_node));
+}
+
+WorkStealingScheduler::WorkStealingScheduler(std::vector<Runner> node_runners,
+                                             int max_workers_per_node)
+    : nodes_(node_runners.size()),
+      slots_(node_runners.size() * std::max(1, max_workers_per_node)),
+      free_slots_(node_runners.size()) {
+  const int slots_per_node = std::max(1, max_workers_per_node);
+  for (int node_id = 0; node_id < nodes_.size(); ++node_id) {
+    Node& node = nodes_[node_id];
+    node.runner = std::move(node_runners[node_id]);
+    node.max_workers = slots_per_node;
+    // Each node owns `slots_per_node` consecutive deques, handed out lowest
+    // index first.
+    std::vector<int>& free_slots = free_slots_[node_id];
+    free_slots.reserve(slots_per_node);
+    for (int i = slots_per_node - 1; i >= 0; --i) {
+      const int slot_id = node_id * slots_per_node + i;
+      slots_[slot_id].node = node_id;
+      free_slots.push_back(slot_id);
+    }
+  }
+}
+
+int WorkStealingScheduler::CurrentWorkerId() const {
+  return current_scheduler == this ? current_worker_id : -1;
+}
+
+void WorkStealingScheduler::Schedule(std::function<void()> fn) {
+  const int worker_id = CurrentWorkerId();
+  const int slot_id =
+      worker_id >= 0 ? worker_id
+                     : next_external_.fetch_add(1, std::memory_order_relaxed) %
+                           slots_.size();
+  PushLocal(slot_id, std::move(fn));
+
+  // Start a worker if none is looking for work. The counter increment in
+  // `PushLocal()` and the load below are sequentially consistent with the
+  // corresponding operations of an exiting worker in `WorkerLoop()`, so either
+  // that worker observes the new task or it is observed here.
+  if (num_searching_.load() == 0) MaybeStartWorker(slots_[slot_id].node);
+}
+
+void WorkStealingScheduler::MaybeStartWorker(int preferred_node) {
+  const int num_nodes = nodes_.size();
+  for (int i = 0; i < num_nodes; ++i) {
+    const int node_id = (preferred_node + i) % num_nodes;
+    Node& node = nodes_[node_id];
+    int num_workers = node.num_workers.load();
+    while (num_workers < node.max_workers) {
+      if (node.num_workers.compare_exchange_weak(num_workers,
+                                                 num_workers + 1)) {
+        // The new worker is searching from the moment it is handed to the
+        // runner.
+        num_searching_.fetch_add(1);
+        node.runner([self = shared_from_this(), node_id]() {
+          self->WorkerLoop(node_id);
+        });
+        return;
+      }
+    }
+  }
+}
+
+void WorkStealingScheduler::PushLocal(int slot_id, std::function<void()> fn) {
+  Slot& slot = slots_[slot_id];
+  {
+    mutex_lock l(slot.mu);
+    slot.tasks.push_front(std::move(fn));
+  }
+  num_queued_.fetch_add(1);
+}
+
+bool WorkStealingScheduler::PopLocal(int slot_id, std::function<void()>* fn) {
+  Slot& slot = slots_[slot_id];
+  mutex_lock l(slot.mu);
+  if (slot.tasks.empty()) return false;
+  *fn = std::move(slot.tasks.front());
+  slot.tasks.pop_front();
+  num_queued_.fetch_sub(1);
+  return true;
+}
+
+bool WorkStealingScheduler::Steal(int thief_id, std::function<void()>* fn) {
+  auto try_steal_from = [&](int victim_id) {
+    Slot& victim = slots_[victim_id];
+    mutex_lock l(victim.mu);
+    if (victim.tasks.empty()) return false;
+    *fn = std::move(victim.tasks.back());
+    victim.tasks.pop_back();
+    num_queued_.fetch_sub(1);
+    return true;
+  };
+
+  const int num_slots = slots_.size();
+  const int thief_node = slots_[thief_id].node;
+  const int start = NextRandom() % num_slots;
+  // The first pass only visits deques of the thief's NUMA node, the second
+  // pass visits the remaining ones.
+  for (int pass = 0; pass < (nodes_.size() > 1 ? 2 : 1); ++pass) {
+    for (int i = 0; i < num_slots; ++i) {
+      const int victim_id = (start + i) % num_slots;
+      if (victim_id == thief_id) continue;
+      const bool is_local = slots_[victim_id].node == thief_node;
+      if (is_local != (pass == 0)) continue;
+      if (try_steal_from(victim_id)) return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingScheduler::WorkerLoop(int node_id) {
+  int slot_id;
+  {
+    mutex_lock l(mu_);
+    std::vector<int>& free_slots = free_slots_[node_id];
+    DCHECK(!free_slots.empty());
+    slot_id = free_slots.back();
+    free_slots.pop_back();
+  }
+
+  // Runner threads may run workers of several schedulers, and a closure may
+  // run a nested scheduler's worker inline.
+  const WorkStealingScheduler* const saved_scheduler = current_scheduler;
+  const int saved_worker_id = current_worker_id;
+  current_scheduler = this;
+  current_worker_id = slot_id;
+
+  std::function<void()> fn;
+  while (PopLocal(slot_id, &fn) || Steal(slot_id, &fn)) {
+    // Hand the search over to another worker before running `fn`, which may
+    // block, so that the remaining closures are not left waiting for it.
+    if (num_searching_.fetch_sub(1) == 1 && num_queued_.load() > 0) {
+      MaybeStartWorker(node_id);
+    }
+    fn();
+    fn = nullptr;
+    num_searching_.fetch_add(1);
+  }
+
+  current_scheduler = saved_scheduler;
+  current_worker_id = saved_worker_id;
+
+  {
+    mutex_lock l(mu_);
+    free_slots_[node_id].push_back(slot_id);
+  }
+  num_searching_.fetch_sub(1);
+  nodes_[node_id].num_workers.fetch_sub(1);
+  // A closure scheduled after the last steal attempt may not have started a
+  // worker, because this one was still searching.
+  if (num_queued_.load() > 0) MaybeStartWorker(node_id);
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,138 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_WORK_STEALING_SCHEDULER_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_WORK_STEALING_SCHEDULER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+
+// NUMA-aware work-stealing queues on top of existing runners (e.g. the
+// inter-op thread pool of a session).
+//
+// The scheduler does not own any threads. Its workers are closures passed to
+// a runner: at most `max_workers` of them are running at any time, each
+// draining its own task deque and exiting when there is no work left. The
+// runner therefore keeps bounding the parallelism and owning the threads, and a
+// worker blocked in a closure only blocks one of the runner's threads.
+//
+// The workers are partitioned into NUMA nodes, each with its own runner and
+// its own share of the deques. A worker is considered to run on the node of
+// the runner that started it; it is up to that runner to actually place the
+// worker there (see `CreatePerNumaNode()`).
+//
+// Closures scheduled from one of the scheduler's own workers are pushed onto
+// the front of that worker's deque and are therefore, unless stolen, run by
+// the same thread that produced them. Closures scheduled from any other thread
+// are distributed round-robin over the deques.
+//
+// An idle worker first drains its own deque (LIFO), then steals from the back
+// of the other deques of its NUMA node, and only then from the deques of the
+// other nodes. A new worker is started on the node of the deque that received
+// the closure, or on another node if that one already runs all its workers.
+//
+// This class is thread-safe. The runner closures keep the scheduler alive, so
+// it is safe to drop the last external reference with closures still queued.
+class WorkStealingScheduler
+    : public std::enable_shared_from_this<WorkStealingScheduler> {
+ public:
+  using Runner = std::function<void(std::function<void()>)>;
+
+  // Creates a scheduler that runs up to `max_workers` workers on `runner`, all
+  // of them on a single node.
+  static std::shared_ptr<WorkStealingScheduler> Create(Runner runner,
+                                                       int max_workers);
+
+  // Creates a scheduler that runs up to `max_workers_per_node` workers on each
+  // of `node_runners`. Workers started by `node_runners[i]` are treated as
+  // running on NUMA node `i`, so the runner is expected to run them on (or pin
+  // them to) that node.
+  static std::shared_ptr<WorkStealingScheduler> CreatePerNumaNode(
+      std::vector<Runner> node_runners, int max_workers_per_node);
+
+  // Schedules `fn` for execution, preferring the calling worker (if any).
+  void Schedule(std::function<void()> fn);
+
+  int MaxWorkers() const { return slots_.size(); }
+
+  int NumNumaNodes() const { return nodes_.size(); }
+
+  // Returns the index of the deque of the calling worker in [0, MaxWorkers()),
+  // or -1 if the caller is not a worker of this scheduler.
+  int CurrentWorkerId() const;
+
+ private:
+  // A task deque, owned by at most one running worker at a time.
+  struct Slot {
+    mutex mu;
+    std::deque<std::function<void()>> tasks TF_GUARDED_BY(mu);
+    // NUMA node of the workers that may own this deque.
+    int node = 0;
+  };
+
+  // The runner and workers of one NUMA node.
+  struct Node {
+    Runner runner;
+    int max_workers = 0;
+    std::atomic<int> num_workers{0};
+  };
+
+  WorkStealingScheduler(std::vector<Runner> node_runners,
+                        int max_workers_per_node);
+
+  // Starts a new worker on `preferred_node`, or on the next node that runs
+  // fewer than its maximum number of workers, if any.
+  void MaybeStartWorker(int preferred_node);
+
+  void WorkerLoop(int node_id);
+
+  // Pushes `fn` onto the front of the deque `slot_id`.
+  void PushLocal(int slot_id, std::function<void()> fn);
+
+  // Pops from the front of the deque `slot_id`.
+  bool PopLocal(int slot_id, std::function<void()>* fn);
+
+  // Steals from the back of another deque, visiting the deques of the thief's
+  // NUMA node before the other ones.
+  bool Steal(int thief_id, std::function<void()>* fn);
+
+  std::vector<Node> nodes_;
+  std::vector<Slot> slots_;
+
+  std::atomic<int64_t> num_queued_{0};
+  // Number of workers looking for a task rather than running one.
+  std::atomic<int> num_searching_{0};
+  std::atomic<uint64_t> next_external_{0};
+
+  mutex mu_;
+  // Deques of each node that are not owned by a running worker.
+  std::vector<std::vector<int>> free_slots_ TF_GUARDED_BY(mu_);
+
+  WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+  void operator=(const WorkStealingScheduler&) = delete;
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_WORK_STEALING_SCHEDULER_H_
@@ -0,0 +1,239 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/work_stealing_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/notification.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace {
+
+// Returns a scheduler running on `pool`, with up to `max_workers` workers.
+std::shared_ptr<WorkStealingScheduler> CreateScheduler(thread::ThreadPool* pool,
+                                                       int max_workers) {
+  return WorkStealingScheduler::Create(
+      [pool](std::function<void()> fn) { pool->Schedule(std::move(fn)); },
+      max_workers);
+}
+
+TEST(WorkStealingSchedulerTest, RunsAllClosures) {
+  thread::ThreadPool pool(Env::Default(), "test", 4);
+  auto scheduler = CreateScheduler(&pool, 4);
+  constexpr int kNumTasks = 10000;
+  std::atomic<int> count(0);
+  BlockingCounter counter(kNumTasks);
+  for (int i = 0; i < kNumTasks; ++i) {
+    scheduler->Schedule([&]() {
+      count.fetch_add(1);
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+  EXPECT_EQ(kNumTasks, count.load());
+}
+
+TEST(WorkStealingSchedulerTest, RunsOnRunner) {
+  int num_runner_calls = 0;
+  std::vector<std::function<void()>> pending;
+  auto scheduler = WorkStealingScheduler::Create(
+      [&](std::function<void()> fn) {
+        ++num_runner_calls;
+        pending.push_back(std::move(fn));
+      },
+      /*max_workers=*/2);
+
+  int count = 0;
+  for (int i = 0; i < 10; ++i) scheduler->Schedule([&]() { ++count; });
+  // Nothing runs until the runner runs a worker, and the first worker is
+  // searching, so no other one is started.
+  EXPECT_EQ(0, count);
+  ASSERT_EQ(1, num_runner_calls);
+
+  std::function<void()> worker = std::move(pending.back());
+  pending.pop_back();
+  worker();
+  EXPECT_EQ(10, count);
+}
+
+TEST(WorkStealingSchedulerTest, StealsFromOwnNumaNodeFirst) {
+  // Two fake NUMA nodes with two deques each, deques 0 and 1 on node 0 and
+  // deques 2 and 3 on node 1. The runners only record the workers, so that the
+  // test decides which ones run.
+  std::vector<std::function<void()>> pending[2];
+  std::vector<WorkStealingScheduler::Runner> node_runners;
+  for (int node = 0; node < 2; ++node) {
+    node_runners.push_back([&pending, node](std::function<void()> fn) {
+      pending[node].push_back(std::move(fn));
+    });
+  }
+  auto scheduler = WorkStealingScheduler::CreatePerNumaNode(
+      std::move(node_runners), /*max_workers_per_node=*/2);
+  ASSERT_EQ(2, scheduler->NumNumaNodes());
+  ASSERT_EQ(4, scheduler->MaxWorkers());
+
+  // Closures scheduled from outside go round-robin over the deques, so closure
+  // `i` lands on deque `i`. Only one worker is started, on the node of deque 0.
+  std::vector<int> order;
+  for (int i = 0; i < 4; ++i) {
+    scheduler->Schedule([&order, i]() { order.push_back(i); });
+  }
+  ASSERT_EQ(1, pending[0].size());
+  ASSERT_TRUE(pending[1].empty());
+
+  std::function<void()> worker = std::move(pending[0].back());
+  pending[0].pop_back();
+  worker();
+
+  // The worker drains deque 0, then steals from deque 1 on its own node, and
+  // only then from the deques of node 1, in random order.
+  ASSERT_EQ(4, order.size());
+  EXPECT_EQ(0, order[0]);
+  EXPECT_EQ(1, order[1]);
+  std::sort(order.begin() + 2, order.end());
+  EXPECT_EQ(2, order[2]);
+  EXPECT_EQ(3, order[3]);
+
+  // Let the workers started during the run find nothing to do and exit.
+  for (auto& node_pending : pending) {
+    while (!node_pending.empty()) {
+      worker = std::move(node_pending.back());
+      node_pending.pop_back();
+      worker();
+    }
+  }
+}
+
+TEST(WorkStealingSchedulerTest, CurrentWorkerId) {
+  thread::ThreadPool pool(Env::Default(), "test", 3);
+  auto scheduler = CreateScheduler(&pool, 3);
+  EXPECT_EQ(-1, scheduler->CurrentWorkerId());
+  std::atomic<int> worker_id(-2);
+  BlockingCounter counter(1);
+  scheduler->Schedule([&]() {
+    worker_id = scheduler->CurrentWorkerId();
+    counter.DecrementCount();
+  });
+  counter.Wait();
+  EXPECT_GE(worker_id.load(), 0);
+  EXPECT_LT(worker_id.load(), scheduler->MaxWorkers());
+}
+
+TEST(WorkStealingSchedulerTest, RecursiveFanOut) {
+  // Each task spawns two children from a worker, which exercises the local
+  // push and steal paths.
+  thread::ThreadPool pool(Env::Default(), "test", 4);
+  auto scheduler = CreateScheduler(&pool, 4);
+  constexpr int kDepth = 12;
+  BlockingCounter counter((1 << (kDepth + 1)) - 1);
+  std::function<void(int)> spawn = [&](int depth) {
+    if (depth < kDepth) {
+      scheduler->Schedule([&spawn, depth]() { spawn(depth + 1); });
+      scheduler->Schedule([&spawn, depth]() { spawn(depth + 1); });
+    }
+    counter.DecrementCount();
+  };
+  scheduler->Schedule([&]() { spawn(0); });
+  counter.Wait();
+}
+
+TEST(WorkStealingSchedulerTest, SingleWorkerKeepsLocalOrder) {
+  // With a single worker nothing can be stolen, and closures scheduled from the
+  // worker are run most-recent first.
+  thread::ThreadPool pool(Env::Default(), "test", 2);
+  auto scheduler = CreateScheduler(&pool, 1);
+  std::vector<int> order;
+  BlockingCounter counter(4);
+  scheduler->Schedule([&]() {
+    for (int i = 0; i < 3; ++i) {
+      scheduler->Schedule([&, i]() {
+        order.push_back(i);
+        counter.DecrementCount();
+      });
+    }
+    counter.DecrementCount();
+  });
+  counter.Wait();
+  EXPECT_EQ(std::vector<int>({2, 1, 0}), order);
+}
+
+TEST(WorkStealingSchedulerTest, BlockedWorkerDoesNotStarveOthers) {
+  // A closure blocked on a later closure must not prevent it from running on
+  // another worker.
+  thread::ThreadPool pool(Env::Default(), "test", 2);
+  auto scheduler = CreateScheduler(&pool, 2);
+  Notification unblock;
+  BlockingCounter counter(2);
+  scheduler->Schedule([&]() {
+    unblock.WaitForNotification();
+    counter.DecrementCount();
+  });
+  scheduler->Schedule([&]() {
+    unblock.Notify();
+    counter.DecrementCount();
+  });
+  counter.Wait();
+}
+
+TEST(WorkStealingSchedulerTest, OutlivesLastReference) {
+  thread::ThreadPool pool(Env::Default(), "test", 2);
+  std::atomic<int> count(0);
+  BlockingCounter counter(1000);
+  {
+    auto scheduler = CreateScheduler(&pool, 2);
+    for (int i = 0; i < 1000; ++i) {
+      scheduler->Schedule([&]() {
+        count.fetch_add(1);
+        counter.DecrementCount();
+      });
+    }
+  }
+  counter.Wait();
+  EXPECT_EQ(1000, count.load());
+}
+
+void BM_FanOut(::testing::benchmark::State& state) {
+  const int num_threads = state.range(0);
+  thread::ThreadPool pool(Env::Default(), "bench", num_threads);
+  auto scheduler = CreateScheduler(&pool, num_threads);
+  constexpr int kDepth = 10;
+  for (auto s : state) {
+    BlockingCounter counter((1 << (kDepth + 1)) - 1);
+    std::function<void(int)> spawn = [&](int depth) {
+      if (depth < kDepth) {
+        scheduler->Schedule([&spawn, depth]() { spawn(depth + 1); });
+        scheduler->Schedule([&spawn, depth]() { spawn(depth + 1); });
+      }
+      counter.DecrementCount();
+    };
+    scheduler->Schedule([&]() { spawn(0); });
+    counter.Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * ((1 << (kDepth + 1)) - 1));
+}
+BENCHMARK(BM_FanOut)->UseRealTime()->Arg(1)->Arg(4)->Arg(16);
+
+}  // namespace
+}  // namespace tensorflow
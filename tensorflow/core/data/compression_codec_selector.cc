@@ -0,0 +1,118 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/compression_codec_selector.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "tensorflow/core/data/compression_utils.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace tensorflow {
+namespace data {
+
+ElementCodecSelector::ElementCodecSelector(const Options& options, Env* env)
+    : options_(options), env_(env), stats_(options_.candidates.size()) {
+  DCHECK(!options_.candidates.empty());
+}
+
+Status ElementCodecSelector::Compress(const std::vector<Tensor>& element,
+                                      CompressedElement* out) {
+  const int64_t num_candidates = options_.candidates.size();
+  const int64_t trial_elements = num_candidates * options_.elements_per_trial;
+  int candidate;
+  bool in_trial;
+  {
+    mutex_lock l(mu_);
+    const int64_t position =
+        num_elements_++ % (trial_elements + options_.elements_between_trials);
+    in_trial = position < trial_elements;
+    candidate = in_trial ? position / options_.elements_per_trial : chosen_;
+  }
+  if (!in_trial) {
+    return CompressElement(element, options_.candidates[candidate], out);
+  }
+
+  const uint64_t start_micros = env_->NowMicros();
+  TF_RETURN_IF_ERROR(
+      CompressElement(element, options_.candidates[candidate], out));
+  const uint64_t micros = env_->NowMicros() - start_micros;
+  uint64_t uncompressed_bytes = 0;
+  for (const auto& metadata : out->component_metadata()) {
+    for (const uint64_t bytes : metadata.uncompressed_bytes()) {
+      uncompressed_bytes += bytes;
+    }
+  }
+
+  mutex_lock l(mu_);
+  Stats& stats = stats_[candidate];
+  ++stats.num_elements;
+  stats.uncompressed_bytes += uncompressed_bytes;
+  stats.compressed_bytes += out->data().size();
+  stats.micros += micros;
+  if (std::all_of(stats_.begin(), stats_.end(), [this](const Stats& stats) {
+        return stats.num_elements >= options_.elements_per_trial;
+      })) {
+    Choose();
+  }
+  return absl::OkStatus();
+}
+
+void ElementCodecSelector::Choose() {
+  int best_fast = -1;
+  double best_fast_ratio = std::numeric_limits<double>::infinity();
+  int fastest = 0;
+  double fastest_throughput = -1;
+  for (int i = 0; i < stats_.size(); ++i) {
+    const Stats& stats = stats_[i];
+    const double ratio = stats.uncompressed_bytes == 0
+                             ? 1
+                             : static_cast<double>(stats.compressed_bytes) /
+                                   stats.uncompressed_bytes;
+    const double throughput =
+        stats.micros == 0 ? std::numeric_limits<double>::infinity()
+                          : stats.uncompressed_bytes * 1e6 / stats.micros;
+    VLOG(2) << "Compression with " << options_.candidates[i].codec << ":"
+            << options_.candidates[i].level << ": ratio " << ratio
+            << ", throughput " << throughput << " bytes/s";
+    if (throughput >= options_.min_throughput_bytes_per_second &&
+        ratio < best_fast_ratio) {
+      best_fast = i;
+      best_fast_ratio = ratio;
+    }
+    if (throughput > fastest_throughput) {
+      fastest = i;
+      fastest_throughput = throughput;
+    }
+  }
+  const int chosen = best_fast >= 0 ? best_fast : fastest;
+  if (chosen != chosen_) {
+    VLOG(1) << "Compressing elements with " << options_.candidates[chosen].codec
+            << ":" << options_.candidates[chosen].level;
+  }
+  chosen_ = chosen;
+  stats_.assign(stats_.size(), Stats());
+}
+
+ElementCompressionOptions ElementCodecSelector::chosen() {
+  mutex_lock l(mu_);
+  return options_.candidates[chosen_];
+}
+
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,90 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_COMPRESSION_CODEC_SELECTOR_H_
+#define TENSORFLOW_CORE_DATA_COMPRESSION_CODEC_SELECTOR_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "tensorflow/core/data/compression_codecs.h"
+#include "tensorflow/core/framework/dataset.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+namespace data {
+
+// Compresses the elements of a dataset with the codec that best fits them.
+//
+// Periodically, a few elements are compressed with each candidate codec in
+// turn, measuring the compression ratio and throughput. Until the next trial,
+// elements are then compressed with the candidate of smallest ratio among
+// those fast enough for the CPU budget of the compressing worker, or with the
+// fastest candidate if none is.
+//
+// Thread-safe.
+class ElementCodecSelector {
+ public:
+  struct Options {
+    // Candidate codecs and levels. Ties go to the earliest.
+    std::vector<ElementCompressionOptions> candidates = {
+        {kSnappyCodec, 0}, {kZstdCodec, -1}, {kZstdCodec, 3}};
+    // Compression throughput, in uncompressed bytes per second, under which a
+    // candidate is too slow for the CPU budget.
+    double min_throughput_bytes_per_second = 200e6;
+    // Number of elements compressed with each candidate per trial.
+    int64_t elements_per_trial = 8;
+    // Number of elements compressed with the chosen candidate between
+    // trials.
+    int64_t elements_between_trials = 10000;
+  };
+
+  explicit ElementCodecSelector(const Options& options,
+                                Env* env = Env::Default());
+
+  // Compresses `element` into `*out`.
+  Status Compress(const std::vector<Tensor>& element, CompressedElement* out);
+
+  // Returns the candidate that compresses the elements between trials.
+  ElementCompressionOptions chosen();
+
+ private:
+  struct Stats {
+    int64_t num_elements = 0;
+    uint64_t uncompressed_bytes = 0;
+    uint64_t compressed_bytes = 0;
+    uint64_t micros = 0;
+  };
+
+  // Chooses a candidate from the stats of the last trial, and resets them.
+  void Choose() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const Options options_;
+  Env* const env_;
+
+  mutex mu_;
+  int64_t num_elements_ TF_GUARDED_BY(mu_) = 0;
+  int chosen_ TF_GUARDED_BY(mu_) = 0;
+  // Stats of each candidate in the current trial.
+  std::vector<Stats> stats_ TF_GUARDED_BY(mu_);
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_COMPRESSION_CODEC_SELECTOR_H_
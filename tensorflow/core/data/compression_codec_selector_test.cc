@@ -0,0 +1,119 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/compression_codec_selector.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/data/compression_codecs.h"
+#include "tensorflow/core/data/compression_utils.h"
+#include "tensorflow/core/data/dataset_test_base.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// An environment whose clock advances by 1ms whenever it is read, so that
+// each compression takes 1ms.
+class SteppingClockEnv : public EnvWrapper {
+ public:
+  SteppingClockEnv() : EnvWrapper(Env::Default()) {}
+
+  uint64_t NowMicros() const override {
+    now_micros_ += 1000;
+    return now_micros_;
+  }
+
+ private:
+  mutable uint64_t now_micros_ = 0;
+};
+
+// Zeros, which zstd compresses much better than snappy.
+std::vector<Tensor> CompressibleElement() {
+  Tensor zeros(DT_INT64, TensorShape({64, 1024}));
+  zeros.flat<int64_t>().setZero();
+  return {zeros};
+}
+
+ElementCodecSelector::Options TestOptions() {
+  ElementCodecSelector::Options options;
+  options.candidates = {{kSnappyCodec, 0}, {kZstdCodec, 3}};
+  options.elements_per_trial = 2;
+  options.elements_between_trials = 5;
+  return options;
+}
+
+TEST(ElementCodecSelectorTest, ChoosesSmallestRatio) {
+  SteppingClockEnv env;
+  ElementCodecSelector::Options options = TestOptions();
+  options.min_throughput_bytes_per_second = 0;
+  ElementCodecSelector selector(options, &env);
+
+  std::vector<std::string> codecs;
+  for (int i = 0; i < 9; ++i) {
+    CompressedElement compressed;
+    TF_ASSERT_OK(selector.Compress(CompressibleElement(), &compressed));
+    codecs.push_back(compressed.version() == 0 ? kSnappyCodec : kZstdCodec);
+    std::vector<Tensor> uncompressed;
+    TF_ASSERT_OK(UncompressElement(compressed, &uncompressed));
+    TF_EXPECT_OK(DatasetOpsTestBase::ExpectEqual(
+        CompressibleElement(), uncompressed, /*compare_order=*/true));
+  }
+  EXPECT_EQ(kZstdCodec, selector.chosen().codec);
+  // Two trial elements per candidate, then the chosen candidate.
+  EXPECT_EQ(std::vector<std::string>({kSnappyCodec, kSnappyCodec, kZstdCodec,
+                                      kZstdCodec, kZstdCodec, kZstdCodec,
+                                      kZstdCodec, kZstdCodec, kZstdCodec}),
+            codecs);
+}
+
+TEST(ElementCodecSelectorTest, ChoosesFastestOverBudget) {
+  SteppingClockEnv env;
+  ElementCodecSelector::Options options = TestOptions();
+  // Each compression of 512KB takes 1ms, i.e. 512MB/s, below the floor.
+  options.min_throughput_bytes_per_second = 1e12;
+  ElementCodecSelector selector(options, &env);
+  for (int i = 0; i < 4; ++i) {
+    CompressedElement compressed;
+    TF_ASSERT_OK(selector.Compress(CompressibleElement(), &compressed));
+  }
+  // All candidates are equally fast, so the first one wins.
+  EXPECT_EQ(kSnappyCodec, selector.chosen().codec);
+}
+
+TEST(ElementCodecSelectorTest, RunsTrialsPeriodically) {
+  SteppingClockEnv env;
+  ElementCodecSelector::Options options = TestOptions();
+  options.min_throughput_bytes_per_second = 0;
+  ElementCodecSelector selector(options, &env);
+  int num_snappy = 0;
+  // Two periods of 4 trial elements and 5 others.
+  for (int i = 0; i < 18; ++i) {
+    CompressedElement compressed;
+    TF_ASSERT_OK(selector.Compress(CompressibleElement(), &compressed));
+    num_snappy += compressed.version() == 0;
+  }
+  EXPECT_EQ(4, num_snappy);
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,267 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/compression_codecs.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/snappy.h"
+#include "tensorflow/core/platform/types.h"
+#include "zstd.h"  // from @net_zstd
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+class SnappyCodec : public ElementCodec {
+ public:
+  std::string Name() const override { return kSnappyCodec; }
+
+  Status Compress(const struct iovec* iov, size_t num_pieces,
+                  size_t num_bytes, int level,
+                  std::string* output) const override {
+    if (num_bytes > kuint32max) {
+      return errors::OutOfRange("Encountered dataset element of size ",
+                                num_bytes,
+                                ", exceeding the 4GB Snappy limit.");
+    }
+    if (!port::Snappy_CompressFromIOVec(iov, num_bytes, output)) {
+      return errors::Internal("Failed to compress using snappy.");
+    }
+    return absl::OkStatus();
+  }
+
+  Status Uncompress(absl::string_view input, const struct iovec* iov,
+                    size_t num_pieces, size_t num_bytes) const override {
+    size_t uncompressed_size;
+    if (!port::Snappy_GetUncompressedLength(input.data(), input.size(),
+                                            &uncompressed_size)) {
+      return errors::Internal(
+          "Could not get snappy uncompressed length. Compressed data size: ",
+          input.size());
+    }
+    if (uncompressed_size != num_bytes) {
+      return errors::Internal(
+          "Uncompressed size mismatch. Snappy expects ", uncompressed_size,
+          " whereas the tensor metadata suggests ", num_bytes);
+    }
+    if (!port::Snappy_UncompressToIOVec(input.data(), input.size(), iov,
+                                        num_pieces)) {
+      return errors::Internal("Failed to perform snappy decompression.");
+    }
+    return absl::OkStatus();
+  }
+};
+
+// Zstandard. Levels range from `ZSTD_minCLevel()` to `ZSTD_maxCLevel()`;
+// negative levels trade ratio for LZ4-like speeds.
+class ZstdCodec : public ElementCodec {
+ public:
+  std::string Name() const override { return kZstdCodec; }
+
+  Status Compress(const struct iovec* iov, size_t num_pieces,
+                  size_t num_bytes, int level,
+                  std::string* output) const override {
+    ZSTD_CCtx* context = CompressionContext();
+    ZSTD_CCtx_reset(context, ZSTD_reset_session_and_parameters);
+    TF_RETURN_IF_ERROR(ToStatus(
+        ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level)));
+    TF_RETURN_IF_ERROR(
+        ToStatus(ZSTD_CCtx_setPledgedSrcSize(context, num_bytes)));
+    // With a buffer of the bound size, compression never waits on output.
+    output->resize(ZSTD_compressBound(num_bytes));
+    ZSTD_outBuffer out = {output->data(), output->size(), 0};
+    for (size_t i = 0; i < num_pieces; ++i) {
+      ZSTD_inBuffer in = {iov[i].iov_base, iov[i].iov_len, 0};
+      while (in.pos < in.size) {
+        TF_RETURN_IF_ERROR(ToStatus(
+            ZSTD_compressStream2(context, &out, &in, ZSTD_e_continue)));
+        if (out.pos == out.size && in.pos < in.size) {
+          return errors::Internal("zstd compression exceeded its bound.");
+        }
+      }
+    }
+    ZSTD_inBuffer in = {nullptr, 0, 0};
+    size_t remaining;
+    do {
+      remaining = ZSTD_compressStream2(context, &out, &in, ZSTD_e_end);
+      TF_RETURN_IF_ERROR(ToStatus(remaining));
+      if (remaining > 0 && out.pos == out.size) {
+        return errors::Internal("zstd compression exceeded its bound.");
+      }
+    } while (remaining > 0);
+    output->resize(out.pos);
+    return absl::OkStatus();
+  }
+
+  Status Uncompress(absl::string_view input, const struct iovec* iov,
+                    size_t num_pieces, size_t num_bytes) const override {
+    const unsigned long long content_size =  // NOLINT
+        ZSTD_getFrameContentSize(input.data(), input.size());
+    if (content_size == ZSTD_CONTENTSIZE_ERROR) {
+      return errors::Internal("Invalid zstd frame. Compressed data size: ",
+                              input.size());
+    }
+    if (content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+        content_size != num_bytes) {
+      return errors::Internal("Uncompressed size mismatch. Zstd expects ",
+                              content_size,
+                              " whereas the tensor metadata suggests ",
+                              num_bytes);
+    }
+    ZSTD_DCtx* context = DecompressionContext();
+    ZSTD_DCtx_reset(context, ZSTD_reset_session_only);
+    ZSTD_inBuffer in = {input.data(), input.size(), 0};
+    size_t remaining = 1;
+    for (size_t i = 0; i < num_pieces; ++i) {
+      ZSTD_outBuffer out = {iov[i].iov_base, iov[i].iov_len, 0};
+      while (out.pos < out.size) {
+        const size_t in_pos = in.pos;
+        const size_t out_pos = out.pos;
+        remaining = ZSTD_decompressStream(context, &out, &in);
+        TF_RETURN_IF_ERROR(ToStatus(remaining));
+        if (in.pos == in_pos && out.pos == out_pos) {
+          return errors::Internal("Truncated zstd frame.");
+        }
+      }
+    }
+    // Consume the end of the frame, which doesn't hold any data.
+    while (remaining > 0) {
+      const size_t in_pos = in.pos;
+      ZSTD_outBuffer out = {nullptr, 0, 0};
+      remaining = ZSTD_decompressStream(context, &out, &in);
+      TF_RETURN_IF_ERROR(ToStatus(remaining));
+      if (remaining > 0 && in.pos == in_pos) {
+        return errors::Internal(
+            "zstd frame holds more data than the tensor metadata suggests (",
+            num_bytes, " bytes).");
+      }
+    }
+    if (in.pos != in.size) {
+      return errors::Internal("Unexpected data after the zstd frame.");
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  static Status ToStatus(size_t result) {
+    if (ZSTD_isError(result)) {
+      return errors::Internal("zstd error: ", ZSTD_getErrorName(result));
+    }
+    return absl::OkStatus();
+  }
+
+  // Contexts are expensive to create, so each thread reuses its own.
+  static ZSTD_CCtx* CompressionContext() {
+    struct Deleter {
+      void operator()(ZSTD_CCtx* context) { ZSTD_freeCCtx(context); }
+    };
+    thread_local std::unique_ptr<ZSTD_CCtx, Deleter> context(
+        ZSTD_createCCtx());
+    return context.get();
+  }
+
+  static ZSTD_DCtx* DecompressionContext() {
+    struct Deleter {
+      void operator()(ZSTD_DCtx* context) { ZSTD_freeDCtx(context); }
+    };
+    thread_local std::unique_ptr<ZSTD_DCtx, Deleter> context(
+        ZSTD_createDCtx());
+    return context.get();
+  }
+};
+
+mutex* get_lock() {
+  static mutex lock(LINKER_INITIALIZED);
+  return &lock;
+}
+
+using ElementCodecs = absl::flat_hash_map<std::string, const ElementCodec*>;
+
+// Codecs are looked up for every compressed and uncompressed element, so the
+// registry is never modified in place: `Register` publishes an updated copy,
+// and lookups read the current one without locking. Replaced copies are
+// leaked, as lookups may still be reading them, which is fine since codecs are
+// registered a handful of times per process.
+std::atomic<const ElementCodecs*>& element_codecs() {
+  static auto* codecs =
+      new std::atomic<const ElementCodecs*>(new ElementCodecs({
+          {kSnappyCodec, new SnappyCodec()},
+          {kZstdCodec, new ZstdCodec()},
+      }));
+  return *codecs;
+}
+
+}  // namespace
+
+void ElementCodec::Register(const ElementCodec* codec) {
+  mutex_lock l(*get_lock());
+  const ElementCodecs* codecs =
+      element_codecs().load(std::memory_order_acquire);
+  if (codecs->find(codec->Name()) != codecs->end()) {
+    LOG(ERROR) << "Two element codecs are being registered with name "
+               << codec->Name() << ". Ignoring the second one.";
+    return;
+  }
+  auto* updated_codecs = new ElementCodecs(*codecs);
+  updated_codecs->insert({codec->Name(), codec});
+  element_codecs().store(updated_codecs, std::memory_order_release);
+}
+
+Status ElementCodec::Get(absl::string_view name, const ElementCodec** codec) {
+  const ElementCodecs& codecs =
+      *element_codecs().load(std::memory_order_acquire);
+  auto it = codecs.find(name);
+  if (it != codecs.end()) {
+    *codec = it->second;
+    return absl::OkStatus();
+  }
+  std::vector<std::string> available_codecs;
+  for (const auto& codec : codecs) {
+    available_codecs.push_back(codec.first);
+  }
+  return errors::NotFound("No element codec has been registered with name ",
+                          name, ". The available codecs are: [ ",
+                          absl::StrJoin(available_codecs, ", "), " ]");
+}
+
+Status ParseElementCompressionOptions(absl::string_view spec,
+                                      ElementCompressionOptions* options) {
+  ElementCompressionOptions parsed;
+  const size_t colon = spec.find(':');
+  parsed.codec = std::string(spec.substr(0, colon));
+  if (colon != absl::string_view::npos &&
+      !absl::SimpleAtoi(spec.substr(colon + 1), &parsed.level)) {
+    return errors::InvalidArgument("Invalid compression level in \"", spec,
+                                   "\"; expected \"<codec>:<level>\".");
+  }
+  const ElementCodec* codec;
+  TF_RETURN_IF_ERROR(ElementCodec::Get(parsed.codec, &codec));
+  *options = std::move(parsed);
+  return absl::OkStatus();
+}
+
+}  // namespace data
+}  // namespace tensorflow
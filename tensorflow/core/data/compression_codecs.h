@@ -0,0 +1,79 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_COMPRESSION_CODECS_H_
+#define TENSORFLOW_CORE_DATA_COMPRESSION_CODECS_H_
+
+#include <cstddef>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/platform/snappy.h"
+#include "tensorflow/core/platform/status.h"
+
+namespace tensorflow {
+namespace data {
+
+// Names of the built-in codecs.
+constexpr char kSnappyCodec[] = "snappy";
+constexpr char kZstdCodec[] = "zstd";
+
+// A codec compressing the bytes of dataset elements, as gathered by
+// `CompressElement`. The bytes are read from and written to the tensor buffers
+// directly, through `iovec`s.
+//
+// Codecs are looked up by name when uncompressing, so implementations must be
+// registered by both the compressing and the uncompressing processes, and
+// must be thread-safe.
+class ElementCodec {
+ public:
+  virtual ~ElementCodec() = default;
+
+  // Name under which the codec is registered and recorded in the elements it
+  // compresses.
+  virtual std::string Name() const = 0;
+
+  // Compresses the `num_bytes` bytes of the `num_pieces` pieces of `iov` into
+  // `output`. `level` is codec-specific, 0 being the codec's default.
+  virtual Status Compress(const struct iovec* iov, size_t num_pieces,
+                          size_t num_bytes, int level,
+                          std::string* output) const = 0;
+
+  // Uncompresses `input` into the `num_bytes` bytes of the `num_pieces` pieces
+  // of `iov`. Fails if `input` doesn't hold exactly `num_bytes` bytes.
+  virtual Status Uncompress(absl::string_view input, const struct iovec* iov,
+                            size_t num_pieces, size_t num_bytes) const = 0;
+
+  // Registers a codec. The built-in codecs are always registered.
+  static void Register(const ElementCodec* codec);
+
+  // Gets the codec registered as `name`, and stores it to `*codec`.
+  static Status Get(absl::string_view name, const ElementCodec** codec);
+};
+
+// How to compress dataset elements.
+struct ElementCompressionOptions {
+  std::string codec = kSnappyCodec;
+  int level = 0;
+};
+
+// Parses `spec`, of the form "<codec>" or "<codec>:<level>" (for example
+// "zstd:-1"), into `*options`.
+Status ParseElementCompressionOptions(absl::string_view spec,
+                                      ElementCompressionOptions* options);
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_COMPRESSION_CODECS_H_
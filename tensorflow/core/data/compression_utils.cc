@@ -19,6 +19,7 @@ limitations under the License.
 #include <vector>
 
 #include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/data/compression_codecs.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/framework/variant_op_registry.h"
@@ -34,7 +35,12 @@ namespace {
 // Increment this when making changes to the `CompressedElement` proto. The
 // `UncompressElement` function will determine what to read according to the
 // version.
-constexpr int kCompressedElementVersion = 0;
+constexpr int kCompressedElementVersion = 1;
+
+// Version of the elements compressed with snappy, the only codec before
+// version 1. Such elements are still written with this version, so that
+// older readers can read them.
+constexpr int kSnappyCompressedElementVersion = 0;
 
 }  // namespace
 
@@ -63,6 +69,15 @@ class Iov {
 
 Status CompressElement(const std::vector<Tensor>& element,
                        CompressedElement* out) {
+  return CompressElement(element, ElementCompressionOptions(), out);
+}
+
+Status CompressElement(const std::vector<Tensor>& element,
+                       const ElementCompressionOptions& options,
+                       CompressedElement* out) {
+  const ElementCodec* codec;
+  TF_RETURN_IF_ERROR(ElementCodec::Get(options.codec, &codec));
+
   // First pass: preprocess the non`memcpy`able tensors.
   size_t num_string_tensors = 0;
   size_t num_string_tensor_strings = 0;
@@ -120,24 +135,28 @@ Status CompressElement(const std::vector<Tensor>& element,
     }
   }
 
-  if (iov.NumBytes() > kuint32max) {
-    return errors::OutOfRange("Encountered dataset element of size ",
-                              iov.NumBytes(),
-                              ", exceeding the 4GB Snappy limit.");
-  }
-  if (!port::Snappy_CompressFromIOVec(iov.Data(), iov.NumBytes(),
-                                      out->mutable_data())) {
-    return errors::Internal("Failed to compress using snappy.");
+  TF_RETURN_IF_ERROR(codec->Compress(iov.Data(), iov.NumPieces(),
+                                     iov.NumBytes(), options.level,
+                                     out->mutable_data()));
+  if (options.codec == kSnappyCodec) {
+    out->set_version(kSnappyCompressedElementVersion);
+  } else {
+    out->set_version(kCompressedElementVersion);
+    out->set_codec(options.codec);
   }
-  out->set_version(kCompressedElementVersion);
   VLOG(3) << "Compressed element from " << iov.NumBytes() << " bytes to "
-          << out->data().size() << " bytes";
+          << out->data().size() << " bytes with " << options.codec;
   return absl::OkStatus();
 }
 
 Status UncompressElement(const CompressedElement& compressed,
                          std::vector<Tensor>* out) {
-  if (compressed.version() != kCompressedElementVersion) {
+  const ElementCodec* codec;
+  if (compressed.version() == kSnappyCompressedElementVersion) {
+    TF_RETURN_IF_ERROR(ElementCodec::Get(kSnappyCodec, &codec));
+  } else if (compressed.version() == kCompressedElementVersion) {
+    TF_RETURN_IF_ERROR(ElementCodec::Get(compressed.codec(), &codec));
+  } else {
     return errors::Internal("Unsupported compressed element version: ",
                             compressed.version());
   }
@@ -190,24 +209,8 @@ Status UncompressElement(const CompressedElement& compressed,
   }
 
   // Step 2: Uncompress into the iovec.
-  const std::string& compressed_data = compressed.data();
-  size_t uncompressed_size;
-  if (!port::Snappy_GetUncompressedLength(
-          compressed_data.data(), compressed_data.size(), &uncompressed_size)) {
-    return errors::Internal(
-        "Could not get snappy uncompressed length. Compressed data size: ",
-        compressed_data.size());
-  }
-  if (uncompressed_size != static_cast<size_t>(iov.NumBytes())) {
-    return errors::Internal(
-        "Uncompressed size mismatch. Snappy expects ", uncompressed_size,
-        " whereas the tensor metadata suggests ", iov.NumBytes());
-  }
-  if (!port::Snappy_UncompressToIOVec(compressed_data.data(),
-                                      compressed_data.size(), iov.Data(),
-                                      iov.NumPieces())) {
-    return errors::Internal("Failed to perform snappy decompression.");
-  }
+  TF_RETURN_IF_ERROR(codec->Uncompress(compressed.data(), iov.Data(),
+                                       iov.NumPieces(), iov.NumBytes()));
 
   // Third pass: deserialize nonstring, non`memcpy`able tensors.
   nonmemcpyable_pos = nonmemcpyable.mdata();
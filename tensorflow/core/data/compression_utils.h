@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <vector>
 
+#include "tensorflow/core/data/compression_codecs.h"
 #include "tensorflow/core/framework/dataset.pb.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/platform/status.h"
@@ -29,11 +30,19 @@ namespace data {
 // In addition to writing the actual compressed bytes, `Compress` fills
 // out the per-component metadata for the `CompressedElement`.
 //
-// Returns an error if the uncompressed size of the element exceeds 4GB.
+// Compresses with snappy, which returns an error if the uncompressed size of
+// the element exceeds 4GB.
 Status CompressElement(const std::vector<Tensor>& element,
                        CompressedElement* out);
 
-// Uncompresses a `CompressedElement` into a vector of tensor components.
+// Like above, compressing with the codec and level of `options`. The tensor
+// bytes are streamed to the codec straight from the tensor buffers.
+Status CompressElement(const std::vector<Tensor>& element,
+                       const ElementCompressionOptions& options,
+                       CompressedElement* out);
+
+// Uncompresses a `CompressedElement` into a vector of tensor components, with
+// the codec it was compressed with.
 Status UncompressElement(const CompressedElement& compressed,
                          std::vector<Tensor>* out);
 
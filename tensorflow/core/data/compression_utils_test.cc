@@ -98,15 +98,74 @@ TEST_P(ParameterizedCompressionUtilsTest, VersionMismatch) {
   CompressedElement compressed;
   TF_ASSERT_OK(CompressElement(element, &compressed));
 
-  compressed.set_version(1);
+  compressed.set_version(2);
   std::vector<Tensor> round_trip_element;
   EXPECT_THAT(UncompressElement(compressed, &round_trip_element),
               StatusIs(error::INTERNAL));
 }
 
+TEST_P(ParameterizedCompressionUtilsTest, ZstdRoundTrip) {
+  std::vector<Tensor> element = GetParam();
+  for (int level : {-1, 0, 3}) {
+    ElementCompressionOptions options;
+    options.codec = kZstdCodec;
+    options.level = level;
+    CompressedElement compressed;
+    TF_ASSERT_OK(CompressElement(element, options, &compressed));
+    EXPECT_EQ(1, compressed.version());
+    EXPECT_EQ(kZstdCodec, compressed.codec());
+    std::vector<Tensor> round_trip_element;
+    TF_ASSERT_OK(UncompressElement(compressed, &round_trip_element));
+    TF_EXPECT_OK(
+        ExpectEqual(element, round_trip_element, /*compare_order=*/true));
+  }
+}
+
+TEST_P(ParameterizedCompressionUtilsTest, UnknownCodec) {
+  std::vector<Tensor> element = GetParam();
+  ElementCompressionOptions options;
+  options.codec = "unknown";
+  CompressedElement compressed;
+  EXPECT_THAT(CompressElement(element, options, &compressed),
+              StatusIs(error::NOT_FOUND));
+
+  TF_ASSERT_OK(CompressElement(element, &compressed));
+  compressed.set_version(1);
+  compressed.set_codec("unknown");
+  std::vector<Tensor> round_trip_element;
+  EXPECT_THAT(UncompressElement(compressed, &round_trip_element),
+              StatusIs(error::NOT_FOUND));
+}
+
 INSTANTIATE_TEST_SUITE_P(Instantiation, ParameterizedCompressionUtilsTest,
                          ::testing::ValuesIn(TestCases()));
 
+TEST(CompressionUtilsTest, ZstdCorruptedData) {
+  std::vector<Tensor> element = {CreateTensor<int64_t>(TensorShape{128, 128})};
+  ElementCompressionOptions options;
+  options.codec = kZstdCodec;
+  CompressedElement compressed;
+  TF_ASSERT_OK(CompressElement(element, options, &compressed));
+  compressed.mutable_data()->resize(compressed.data().size() - 4);
+  std::vector<Tensor> round_trip_element;
+  EXPECT_THAT(UncompressElement(compressed, &round_trip_element),
+              StatusIs(error::INTERNAL));
+}
+
+TEST(CompressionUtilsTest, ParseElementCompressionOptions) {
+  ElementCompressionOptions options;
+  TF_ASSERT_OK(ParseElementCompressionOptions("zstd:-3", &options));
+  EXPECT_EQ(kZstdCodec, options.codec);
+  EXPECT_EQ(-3, options.level);
+  TF_ASSERT_OK(ParseElementCompressionOptions("snappy", &options));
+  EXPECT_EQ(kSnappyCodec, options.codec);
+  EXPECT_EQ(0, options.level);
+  EXPECT_THAT(ParseElementCompressionOptions("zstd:fast", &options),
+              StatusIs(error::INVALID_ARGUMENT));
+  EXPECT_THAT(ParseElementCompressionOptions("lzma", &options),
+              StatusIs(error::NOT_FOUND));
+}
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
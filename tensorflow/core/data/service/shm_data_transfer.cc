@@ -0,0 +1,950 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/shm_data_transfer.h"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <linux/memfd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/data/service/data_transfer.h"
+#include "tensorflow/core/data/service/worker.pb.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/dataset.pb.h"
+#include "tensorflow/core/framework/metrics.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/variant.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/host_info.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/refcount.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/protobuf/service_config.pb.h"
+#include "tensorflow/core/util/env_var.h"
+#endif  // defined(__linux__)
+
+namespace tensorflow {
+namespace data {
+#if defined(__linux__)
+namespace {
+
+constexpr char kSocketNamePrefix[] = "tf_data_service_shm_";
+constexpr int64_t kDefaultRingBytes = 64 << 20;
+// Layout of the shared memory of a connection: the header, the request slot,
+// then the ring.
+constexpr size_t kHeaderBytes = 4096;
+constexpr size_t kMaxRequestBytes = 64 << 10;
+// Alignment of the frames in the ring, and of the payloads in the frames.
+constexpr size_t kAlignment = Allocator::kAllocatorAlignment;
+// How often blocked calls check for cancellation and for their peer going
+// away.
+constexpr int64_t kPollIntervalMs = 50;
+// How long clients wait for the server to accept their connection.
+constexpr int kConnectTimeoutMs = 10000;
+// Ports are picked in [1, kMaxPort) when `data_transfer_port` isn't set.
+constexpr int kMaxPort = 1 << 20;
+constexpr int kMaxBindAttempts = 100;
+
+// Values of `SharedHeader::state`.
+constexpr uint32_t kIdle = 0;
+constexpr uint32_t kRequest = 1;
+constexpr uint32_t kResponse = 2;
+
+// How the payload of a component is encoded.
+enum ComponentEncoding : uint64_t {
+  // The bytes of a tensor whose type can be memcpy-ed.
+  kRawBytes = 0,
+  // A serialized `TensorProto`.
+  kTensorProto = 1,
+  // A serialized `CompressedElement`.
+  kCompressedElement = 2,
+};
+
+// Start of the shared memory of a connection.
+struct SharedHeader {
+  // Futex word that the client sets to `kRequest` once the request slot holds
+  // a request, and that the server sets to `kResponse` once it has responded.
+  std::atomic<uint32_t> state;
+  // Size of the serialized `GetElementRequest` in the request slot.
+  uint64_t request_bytes;
+  // Position and size of the response. The response is at position
+  // `response_position % ring_bytes` of the ring, unless it is out of line, in
+  // which case its memfd is sent over the socket.
+  uint64_t response_position;
+  uint64_t response_bytes;
+  uint32_t response_out_of_line;
+  // Position up to which the client has released the ring. Positions only
+  // grow; the server owns the ones from `tail` to `tail + ring_bytes`.
+  std::atomic<uint64_t> tail;
+};
+static_assert(sizeof(SharedHeader) <= kHeaderBytes,
+              "The shared header doesn't fit in its page.");
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "Shared memory atomics must be lock-free.");
+
+// Sent by the server along with the memfd of a new connection.
+struct Handshake {
+  uint64_t memory_bytes;
+  uint64_t ring_bytes;
+  int64_t pid;
+};
+
+uint64_t RoundUp(uint64_t bytes) {
+  return (bytes + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// Waits until `*word` no longer holds `value`, or for `kPollIntervalMs`.
+void FutexWait(std::atomic<uint32_t>* word, uint32_t value) {
+  struct timespec timeout = {0, kPollIntervalMs * 1000000};
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, value,
+          &timeout, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>* word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX,
+          nullptr, nullptr, 0);
+}
+
+// Returns whether the peer of `socket` has closed the connection.
+bool PeerClosed(int socket) {
+  struct pollfd fd = {socket, POLLRDHUP, 0};
+  return poll(&fd, 1, 0) > 0 &&
+         (fd.revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL));
+}
+
+// Identifies the server process `pid` among the processes of all hosts.
+std::string ServerIdentity(int64_t pid) {
+  std::string boot_id;
+  if (!ReadFileToString(Env::Default(), "/proc/sys/kernel/random/boot_id",
+                        &boot_id)
+           .ok()) {
+    boot_id = port::Hostname();
+  }
+  return absl::StrCat(absl::StripAsciiWhitespace(boot_id), ":", pid);
+}
+
+// Returns the address of the abstract Unix domain socket of `port`.
+sockaddr_un SocketAddress(int port, socklen_t* length) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  const std::string name = absl::StrCat(kSocketNamePrefix, port);
+  // Abstract socket names start with a null byte.
+  memcpy(address.sun_path + 1, name.data(), name.size());
+  *length = offsetof(sockaddr_un, sun_path) + 1 + name.size();
+  return address;
+}
+
+// Sends `fd`, along with the `size` bytes of `payload`, over `socket`.
+Status SendFd(int socket, int fd, const void* payload, size_t size) {
+  struct iovec iov = {const_cast<void*>(payload), size};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  struct msghdr message = {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(header), &fd, sizeof(int));
+  if (sendmsg(socket, &message, MSG_NOSIGNAL) != static_cast<ssize_t>(size)) {
+    return errors::IOError("Failed to send a file descriptor", errno);
+  }
+  return absl::OkStatus();
+}
+
+// Receives a file descriptor into `*fd`, along with `size` bytes of payload,
+// from `socket`.
+Status ReceiveFd(int socket, int* fd, void* payload, size_t size) {
+  struct iovec iov = {payload, size};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  struct msghdr message = {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  const ssize_t received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+  if (received < 0) {
+    return errors::IOError("Failed to receive a file descriptor", errno);
+  }
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  if (received != static_cast<ssize_t>(size) || header == nullptr ||
+      header->cmsg_type != SCM_RIGHTS) {
+    return errors::Unavailable(
+        "The shm data transfer connection was closed while receiving a file "
+        "descriptor.");
+  }
+  memcpy(fd, CMSG_DATA(header), sizeof(int));
+  return absl::OkStatus();
+}
+
+// A memfd mapped into this process.
+class SharedMemory {
+ public:
+  // Creates a memfd of `size` bytes.
+  static Status Create(size_t size, std::unique_ptr<SharedMemory>* memory) {
+    const int fd = syscall(SYS_memfd_create, "tf_data_service_shm",
+                           MFD_CLOEXEC);
+    if (fd < 0) {
+      return errors::IOError("Failed to create a memfd", errno);
+    }
+    if (ftruncate(fd, size) != 0) {
+      const int error = errno;
+      close(fd);
+      return errors::IOError(absl::StrCat("Failed to resize a memfd to ",
+                                          size, " bytes"),
+                             error);
+    }
+    return Map(fd, size, memory);
+  }
+
+  // Maps the memfd `fd`, of `size` bytes, taking ownership of it.
+  static Status Map(int fd, size_t size,
+                    std::unique_ptr<SharedMemory>* memory) {
+    void* data =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      const int error = errno;
+      close(fd);
+      return errors::IOError(absl::StrCat("Failed to map ", size, " bytes"),
+                             error);
+    }
+    *memory = absl::WrapUnique(
+        new SharedMemory(fd, static_cast<char*>(data), size));
+    return absl::OkStatus();
+  }
+
+  ~SharedMemory() {
+    munmap(data_, size_);
+    close(fd_);
+  }
+
+  int fd() const { return fd_; }
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  SharedMemory(int fd, char* data, size_t size)
+      : fd_(fd), data_(data), size_(size) {}
+
+  const int fd_;
+  char* const data_;
+  const size_t size_;
+};
+
+// The payload of a component in a response.
+struct Payload {
+  ComponentEncoding encoding;
+  // Offset from the first payload of the response.
+  uint64_t offset;
+  uint64_t bytes;
+  // Set for `kRawBytes`.
+  const Tensor* tensor = nullptr;
+  // Set for `kCompressedElement`.
+  const CompressedElement* compressed = nullptr;
+  // Set for `kTensorProto`.
+  std::string serialized;
+};
+
+// A response as laid out in shared memory: the size of the metadata and the
+// metadata, as varints, then the payloads, each aligned to `kAlignment`.
+//
+// The metadata holds the status, the fields of the `GetElementResult`, and the
+// type, shape, encoding, offset and size of the payload of each component.
+class Response {
+ public:
+  Response(const Status& status, const GetElementResult& result) {
+    core::PutVarint64(&metadata_, static_cast<uint64_t>(status.code()));
+    core::PutVarint64(&metadata_, status.message().size());
+    absl::StrAppend(&metadata_, status.message());
+    if (!status.ok()) {
+      bytes_ = PayloadsOffset();
+      return;
+    }
+    core::PutVarint64(&metadata_, result.end_of_sequence);
+    core::PutVarint64(&metadata_, result.skip);
+    core::PutVarint64(&metadata_, result.element_index);
+    core::PutVarint64(&metadata_, result.components.size());
+    uint64_t offset = 0;
+    payloads_.resize(result.components.size());
+    for (int i = 0; i < result.components.size(); ++i) {
+      const Tensor& tensor = result.components[i];
+      Payload& payload = payloads_[i];
+      const CompressedElement* compressed =
+          tensor.dtype() == DT_VARIANT && tensor.NumElements() == 1
+              ? tensor.flat<Variant>()(0).get<CompressedElement>()
+              : nullptr;
+      if (DataTypeCanUseMemcpy(tensor.dtype())) {
+        payload.encoding = kRawBytes;
+        payload.tensor = &tensor;
+        payload.bytes = tensor.TotalBytes();
+      } else if (compressed != nullptr) {
+        payload.encoding = kCompressedElement;
+        payload.compressed = compressed;
+        payload.bytes = compressed->ByteSizeLong();
+      } else {
+        payload.encoding = kTensorProto;
+        TensorProto proto;
+        tensor.AsProtoTensorContent(&proto);
+        proto.SerializeToString(&payload.serialized);
+        payload.bytes = payload.serialized.size();
+      }
+      payload.offset = offset;
+      offset = RoundUp(offset + payload.bytes);
+      core::PutVarint64(&metadata_, payload.encoding);
+      core::PutVarint64(&metadata_, tensor.dtype());
+      core::PutVarint64(&metadata_, tensor.dims());
+      for (int64_t dim : tensor.shape().dim_sizes()) {
+        core::PutVarint64(&metadata_, dim);
+      }
+      core::PutVarint64(&metadata_, payload.offset);
+      core::PutVarint64(&metadata_, payload.bytes);
+    }
+    bytes_ = PayloadsOffset() + offset;
+  }
+
+  // Size of the response, a multiple of `kAlignment`.
+  uint64_t bytes() const { return bytes_; }
+
+  // Writes the response to `destination`, which must hold `bytes()` bytes.
+  Status WriteTo(char* destination) const {
+    char* metadata = core::EncodeVarint64(destination, metadata_.size());
+    memcpy(metadata, metadata_.data(), metadata_.size());
+    char* payloads = destination + PayloadsOffset();
+    for (const Payload& payload : payloads_) {
+      char* data = payloads + payload.offset;
+      switch (payload.encoding) {
+        case kRawBytes:
+          memcpy(data, payload.tensor->tensor_data().data(), payload.bytes);
+          break;
+        case kCompressedElement:
+          if (!payload.compressed->SerializeToArray(data, payload.bytes)) {
+            return errors::Internal(
+                "Failed to serialize a compressed element.");
+          }
+          break;
+        case kTensorProto:
+          memcpy(data, payload.serialized.data(), payload.bytes);
+          break;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  uint64_t PayloadsOffset() const {
+    return RoundUp(core::VarintLength(metadata_.size()) + metadata_.size());
+  }
+
+  std::string metadata_;
+  std::vector<Payload> payloads_;
+  uint64_t bytes_ = 0;
+};
+
+// A tensor buffer in a response, which it keeps alive.
+class ResponseBuffer : public TensorBuffer {
+ public:
+  ResponseBuffer(std::shared_ptr<const char> response, uint64_t offset,
+                 uint64_t bytes)
+      : TensorBuffer(const_cast<char*>(response.get()) + offset),
+        response_(std::move(response)),
+        bytes_(bytes) {}
+
+  size_t size() const override { return bytes_; }
+  TensorBuffer* root_buffer() override { return this; }
+  void FillAllocationDescription(AllocationDescription* proto) const override {
+    proto->set_requested_bytes(bytes_);
+    proto->set_allocator_name(kShmTransferProtocol);
+  }
+
+ private:
+  const std::shared_ptr<const char> response_;
+  const uint64_t bytes_;
+};
+
+// Decodes the response of `bytes` bytes at `response` into `result`. Tensors
+// whose type can be memcpy-ed point into `response`, unless `allocator` is
+// set, in which case they are copied to tensors it allocates.
+Status DecodeResponse(std::shared_ptr<const char> response, uint64_t bytes,
+                      Allocator* allocator, GetElementResult& result) {
+  absl::string_view input(response.get(), bytes);
+  uint64_t metadata_bytes;
+  if (!core::GetVarint64(&input, &metadata_bytes) ||
+      metadata_bytes > input.size()) {
+    return errors::DataLoss("Invalid shm data transfer response.");
+  }
+  const uint64_t payloads_offset =
+      RoundUp(core::VarintLength(metadata_bytes) + metadata_bytes);
+  absl::string_view metadata = input.substr(0, metadata_bytes);
+  bool valid = true;
+  auto next = [&metadata, &valid]() {
+    uint64_t value = 0;
+    valid = valid && core::GetVarint64(&metadata, &value);
+    return value;
+  };
+
+  const auto code = static_cast<absl::StatusCode>(next());
+  const uint64_t message_bytes = next();
+  if (!valid || message_bytes > metadata.size()) {
+    return errors::DataLoss("Invalid shm data transfer response.");
+  }
+  if (code != absl::StatusCode::kOk) {
+    return Status(code, metadata.substr(0, message_bytes));
+  }
+  metadata.remove_prefix(message_bytes);
+  result.end_of_sequence = next();
+  result.skip = next();
+  result.element_index = next();
+  const uint64_t num_components = next();
+  for (uint64_t i = 0; valid && i < num_components; ++i) {
+    const uint64_t encoding = next();
+    const auto dtype = static_cast<DataType>(next());
+    TensorShape shape;
+    const uint64_t dims = next();
+    for (uint64_t d = 0; valid && d < dims; ++d) {
+      valid = shape.AddDimWithStatus(next()).ok();
+    }
+    const uint64_t offset = payloads_offset + next();
+    const uint64_t payload_bytes = next();
+    if (!valid || offset > bytes || payload_bytes > bytes - offset) {
+      break;
+    }
+    const char* data = response.get() + offset;
+    switch (encoding) {
+      case kRawBytes: {
+        if (!DataTypeCanUseMemcpy(dtype) ||
+            shape.num_elements() * DataTypeSize(dtype) != payload_bytes) {
+          valid = false;
+        } else if (allocator != nullptr) {
+          result.components.emplace_back(allocator, dtype, shape);
+          const Tensor& tensor = result.components.back();
+          memcpy(const_cast<char*>(tensor.tensor_data().data()), data,
+                 payload_bytes);
+        } else if (payload_bytes == 0) {
+          result.components.emplace_back(dtype, shape);
+        } else {
+          result.components.emplace_back(
+              dtype, shape,
+              core::RefCountPtr<TensorBuffer>(
+                  new ResponseBuffer(response, offset, payload_bytes)));
+        }
+        break;
+      }
+      case kCompressedElement: {
+        CompressedElement compressed;
+        valid = compressed.ParseFromArray(data, payload_bytes);
+        Tensor tensor(DT_VARIANT, TensorShape{});
+        tensor.scalar<Variant>()() = std::move(compressed);
+        result.components.push_back(std::move(tensor));
+        break;
+      }
+      case kTensorProto: {
+        TensorProto proto;
+        result.components.emplace_back();
+        valid = proto.ParseFromArray(data, payload_bytes) &&
+                (allocator != nullptr
+                     ? result.components.back().FromProto(allocator, proto)
+                     : result.components.back().FromProto(proto));
+        break;
+      }
+      default:
+        valid = false;
+    }
+  }
+  if (!valid || result.components.size() != num_components) {
+    return errors::DataLoss("Invalid shm data transfer response.");
+  }
+  return absl::OkStatus();
+}
+
+// Tracks which parts of the ring of a client are still in use. Responses are
+// received in ring order, but released in any order, once all the tensors
+// pointing into them are destroyed.
+class ClientRing : public std::enable_shared_from_this<ClientRing> {
+ public:
+  ClientRing(std::unique_ptr<SharedMemory> memory, uint64_t ring_bytes)
+      : memory_(std::move(memory)),
+        header_(reinterpret_cast<SharedHeader*>(memory_->data())),
+        ring_(memory_->data() + kHeaderBytes + kMaxRequestBytes),
+        ring_bytes_(ring_bytes) {}
+
+  SharedHeader* header() const { return header_; }
+  char* request() const { return memory_->data() + kHeaderBytes; }
+
+  // Returns the response of `bytes` bytes at `position`, which releases its
+  // part of the ring once destroyed.
+  std::shared_ptr<const char> Receive(uint64_t position, uint64_t bytes) {
+    {
+      mutex_lock l(mu_);
+      // The server skips the end of the ring when a response doesn't fit.
+      if (position > received_) {
+        ReleaseLocked(received_, position);
+      }
+      received_ = position + bytes;
+    }
+    return std::shared_ptr<const char>(
+        ring_ + position % ring_bytes_,
+        [ring = shared_from_this(), position, bytes](const char*) {
+          mutex_lock l(ring->mu_);
+          ring->ReleaseLocked(position, position + bytes);
+        });
+  }
+
+ private:
+  void ReleaseLocked(uint64_t begin, uint64_t end)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    released_[begin] = end;
+    uint64_t tail = tail_;
+    for (auto it = released_.begin();
+         it != released_.end() && it->first == tail;
+         it = released_.erase(it)) {
+      tail = it->second;
+    }
+    if (tail != tail_) {
+      tail_ = tail;
+      header_->tail.store(tail, std::memory_order_release);
+    }
+  }
+
+  const std::unique_ptr<SharedMemory> memory_;
+  SharedHeader* const header_;
+  const char* const ring_;
+  const uint64_t ring_bytes_;
+
+  mutex mu_;
+  // End of the last response received.
+  uint64_t received_ TF_GUARDED_BY(mu_) = 0;
+  // Position up to which the ring is released.
+  uint64_t tail_ TF_GUARDED_BY(mu_) = 0;
+  // Released parts of the ring after `tail_`, by position.
+  std::map<uint64_t, uint64_t> released_ TF_GUARDED_BY(mu_);
+};
+
+class ShmDataTransferServer : public DataTransferServer {
+ public:
+  explicit ShmDataTransferServer(GetElementT get_element)
+      : get_element_(std::move(get_element)) {}
+
+  ~ShmDataTransferServer() override {
+    cancelled_ = true;
+    // The threads notice the cancellation within `kPollIntervalMs`.
+    accept_thread_.reset();
+    // Connection threads lock `mu_` when they finish, so they are joined
+    // without holding it.
+    absl::flat_hash_map<int64_t, std::unique_ptr<Thread>> connection_threads;
+    {
+      mutex_lock l(mu_);
+      connection_threads = std::move(connection_threads_);
+    }
+    connection_threads.clear();
+    if (listener_ >= 0) {
+      close(listener_);
+    }
+  }
+
+  Status Start(const experimental::WorkerConfig& config) override {
+    int64_t ring_bytes;
+    TF_RETURN_IF_ERROR(ReadInt64FromEnvVar("TF_DATA_SERVICE_SHM_RING_BYTES",
+                                           kDefaultRingBytes, &ring_bytes));
+    ring_bytes_ = RoundUp(std::max<int64_t>(ring_bytes, kAlignment));
+    listener_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener_ < 0) {
+      return errors::IOError("Failed to create a Unix domain socket", errno);
+    }
+    const int num_attempts =
+        config.data_transfer_port() > 0 ? 1 : kMaxBindAttempts;
+    int error = EADDRINUSE;
+    for (int i = 0; i < num_attempts && error == EADDRINUSE; ++i) {
+      port_ = config.data_transfer_port() > 0
+                  ? config.data_transfer_port()
+                  : 1 + random::New64() % (kMaxPort - 1);
+      socklen_t length;
+      const sockaddr_un address = SocketAddress(port_, &length);
+      error = bind(listener_, reinterpret_cast<const sockaddr*>(&address),
+                   length) == 0
+                  ? 0
+                  : errno;
+    }
+    if (error != 0) {
+      return errors::IOError(
+          absl::StrCat("Failed to bind the shm data transfer socket of port ",
+                       port_),
+          error);
+    }
+    if (listen(listener_, SOMAXCONN) != 0) {
+      return errors::IOError("Failed to listen on the shm data transfer socket",
+                             errno);
+    }
+    accept_thread_ = absl::WrapUnique(Env::Default()->StartThread(
+        /*thread_options=*/{}, /*name=*/"tf_data_service_shm_accept",
+        [this]() { AcceptLoop(); }));
+    return absl::OkStatus();
+  }
+
+  int Port() const override { return port_; }
+
+  absl::StatusOr<std::string> GetCompatibilityInfo() const override {
+    return ServerIdentity(getpid());
+  }
+
+ private:
+  void AcceptLoop() {
+    int64_t next_connection_id = 0;
+    while (!cancelled_) {
+      JoinFinishedConnections();
+      struct pollfd fd = {listener_, POLLIN, 0};
+      if (poll(&fd, 1, kPollIntervalMs) <= 0) {
+        continue;
+      }
+      const int socket = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (socket < 0) {
+        continue;
+      }
+      Status s = CheckPeer(socket);
+      if (!s.ok()) {
+        LOG(WARNING) << "Rejecting shm data transfer connection: " << s;
+        close(socket);
+        continue;
+      }
+      const int64_t id = next_connection_id++;
+      mutex_lock l(mu_);
+      connection_threads_[id] = absl::WrapUnique(Env::Default()->StartThread(
+          /*thread_options=*/{}, /*name=*/"tf_data_service_shm_connection",
+          [this, socket, id]() {
+            Status s = Serve(socket);
+            if (!s.ok()) {
+              LOG(WARNING) << "Closing shm data transfer connection: " << s;
+            }
+            close(socket);
+            mutex_lock l(mu_);
+            finished_connections_.push_back(id);
+          }));
+    }
+  }
+
+  // Only processes of the user running the server may read its elements.
+  static Status CheckPeer(int socket) {
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) !=
+        0) {
+      return errors::IOError("Failed to get the credentials of the peer",
+                             errno);
+    }
+    if (credentials.uid != getuid()) {
+      return errors::PermissionDenied("The peer runs as user ",
+                                      credentials.uid, " instead of ",
+                                      getuid(), ".");
+    }
+    return absl::OkStatus();
+  }
+
+  // Joins the threads of the connections that were closed.
+  void JoinFinishedConnections() {
+    // Joined when going out of scope, without holding `mu_`.
+    std::vector<std::unique_ptr<Thread>> finished_threads;
+    {
+      mutex_lock l(mu_);
+      for (int64_t id : finished_connections_) {
+        auto it = connection_threads_.find(id);
+        if (it == connection_threads_.end()) continue;
+        finished_threads.push_back(std::move(it->second));
+        connection_threads_.erase(it);
+      }
+      finished_connections_.clear();
+    }
+  }
+
+  // Serves the requests of the client connected through `socket` until it
+  // disconnects.
+  Status Serve(int socket) {
+    std::unique_ptr<SharedMemory> memory;
+    TF_RETURN_IF_ERROR(SharedMemory::Create(
+        kHeaderBytes + kMaxRequestBytes + ring_bytes_, &memory));
+    auto* header = new (memory->data()) SharedHeader();
+    const char* request_slot = memory->data() + kHeaderBytes;
+    char* ring = memory->data() + kHeaderBytes + kMaxRequestBytes;
+    const Handshake handshake = {memory->size(), ring_bytes_, getpid()};
+    TF_RETURN_IF_ERROR(
+        SendFd(socket, memory->fd(), &handshake, sizeof(handshake)));
+
+    // Position of the end of the last response written to the ring.
+    uint64_t head = 0;
+    while (true) {
+      uint32_t state;
+      while ((state = header->state.load(std::memory_order_acquire)) !=
+             kRequest) {
+        if (cancelled_ || PeerClosed(socket)) {
+          return absl::OkStatus();
+        }
+        FutexWait(&header->state, state);
+      }
+
+      GetElementRequest request;
+      GetElementResult result;
+      Status status =
+          header->request_bytes <= kMaxRequestBytes &&
+                  request.ParseFromArray(request_slot, header->request_bytes)
+              ? get_element_(&request, &result)
+              : errors::Internal("Failed to parse GetElementRequest.");
+      const Response response(status, result);
+
+      // Writes the response to the ring if there's room, skipping the end of
+      // the ring if needed, or out of line otherwise.
+      const uint64_t tail = header->tail.load(std::memory_order_acquire);
+      uint64_t position = head;
+      if (position % ring_bytes_ + response.bytes() > ring_bytes_) {
+        position += ring_bytes_ - position % ring_bytes_;
+      }
+      std::unique_ptr<SharedMemory> out_of_line;
+      char* destination;
+      if (position + response.bytes() - tail <= ring_bytes_) {
+        destination = ring + position % ring_bytes_;
+        head = position + response.bytes();
+      } else {
+        TF_RETURN_IF_ERROR(
+            SharedMemory::Create(response.bytes(), &out_of_line));
+        destination = out_of_line->data();
+      }
+      TF_RETURN_IF_ERROR(response.WriteTo(destination));
+      header->response_position = position;
+      header->response_bytes = response.bytes();
+      header->response_out_of_line = out_of_line != nullptr;
+      if (out_of_line) {
+        const uint64_t bytes = response.bytes();
+        TF_RETURN_IF_ERROR(
+            SendFd(socket, out_of_line->fd(), &bytes, sizeof(bytes)));
+      }
+      header->state.store(kResponse, std::memory_order_release);
+      FutexWake(&header->state);
+    }
+  }
+
+  const GetElementT get_element_;
+  std::atomic<bool> cancelled_ = false;
+  uint64_t ring_bytes_ = 0;
+  int listener_ = -1;
+  int port_ = 0;
+  std::unique_ptr<Thread> accept_thread_;
+
+  mutex mu_;
+  // Threads serving the connections, by connection id.
+  absl::flat_hash_map<int64_t, std::unique_ptr<Thread>> connection_threads_
+      TF_GUARDED_BY(mu_);
+  // Ids of the connections whose threads are done and can be joined.
+  std::vector<int64_t> finished_connections_ TF_GUARDED_BY(mu_);
+};
+
+class ShmDataTransferClient : public DataTransferClient {
+ public:
+  // Connects to the server at `config.address`.
+  static Status Connect(const Config& config,
+                        std::unique_ptr<DataTransferClient>* out) {
+    int port;
+    const size_t colon = config.address.rfind(':');
+    if (colon == std::string::npos ||
+        !absl::SimpleAtoi(config.address.substr(colon + 1), &port)) {
+      return errors::InvalidArgument("Invalid shm data transfer address ",
+                                     config.address);
+    }
+    const int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+      return errors::IOError("Failed to create a Unix domain socket", errno);
+    }
+    auto client = absl::WrapUnique(
+        new ShmDataTransferClient(config.address, sock, config.allocator));
+    socklen_t length;
+    const sockaddr_un address = SocketAddress(port, &length);
+    if (connect(sock, reinterpret_cast<const sockaddr*>(&address), length) !=
+        0) {
+      return errors::Unavailable("Failed to connect to the shm data transfer ",
+                                 "server at ", config.address,
+                                 "; it may be on another host: ",
+                                 strerror(errno));
+    }
+    struct pollfd fd = {sock, POLLIN, 0};
+    if (poll(&fd, 1, kConnectTimeoutMs) <= 0) {
+      return errors::DeadlineExceeded(
+          "Timed out waiting for the shm data transfer server at ",
+          config.address);
+    }
+    Handshake handshake;
+    int memory_fd;
+    TF_RETURN_IF_ERROR(
+        ReceiveFd(sock, &memory_fd, &handshake, sizeof(handshake)));
+    std::unique_ptr<SharedMemory> memory;
+    TF_RETURN_IF_ERROR(
+        SharedMemory::Map(memory_fd, handshake.memory_bytes, &memory));
+    client->server_pid_ = handshake.pid;
+    client->ring_ =
+        std::make_shared<ClientRing>(std::move(memory), handshake.ring_bytes);
+    *out = std::move(client);
+    return absl::OkStatus();
+  }
+
+  ~ShmDataTransferClient() override { close(socket_); }
+
+  Status GetElement(const GetElementRequest& req,
+                    GetElementResult& result) override {
+    VLOG(3) << "GetElement for task " << req.task_id()
+            << " from shm worker server.";
+    mutex_lock l(mu_);
+    // A cancelled request may still be pending, so the connection can't be
+    // reused.
+    if (cancelled_) {
+      return errors::Cancelled("Client for worker ", address_,
+                               " has been cancelled.");
+    }
+    const size_t request_bytes = req.ByteSizeLong();
+    if (request_bytes > kMaxRequestBytes) {
+      return errors::InvalidArgument("GetElementRequest of ", request_bytes,
+                                     " bytes exceeds the shm limit of ",
+                                     kMaxRequestBytes, " bytes.");
+    }
+    SharedHeader* header = ring_->header();
+    int64_t start_time_us = env_->NowMicros();
+    req.SerializeToArray(ring_->request(), request_bytes);
+    header->request_bytes = request_bytes;
+    header->state.store(kRequest, std::memory_order_release);
+    FutexWake(&header->state);
+
+    uint32_t state;
+    while ((state = header->state.load(std::memory_order_acquire)) !=
+           kResponse) {
+      if (cancelled_) {
+        return errors::Cancelled("Client for worker ", address_,
+                                 " has been cancelled.");
+      }
+      if (PeerClosed(socket_)) {
+        return errors::Unavailable("The shm data transfer server at ",
+                                   address_, " closed the connection.");
+      }
+      FutexWait(&header->state, state);
+    }
+    const uint64_t position = header->response_position;
+    const uint64_t bytes = header->response_bytes;
+    const bool out_of_line = header->response_out_of_line;
+    header->state.store(kIdle, std::memory_order_relaxed);
+
+    std::shared_ptr<const char> response;
+    if (out_of_line) {
+      int fd;
+      uint64_t out_of_line_bytes;
+      TF_RETURN_IF_ERROR(ReceiveFd(socket_, &fd, &out_of_line_bytes,
+                                   sizeof(out_of_line_bytes)));
+      std::unique_ptr<SharedMemory> memory;
+      TF_RETURN_IF_ERROR(SharedMemory::Map(fd, out_of_line_bytes, &memory));
+      std::shared_ptr<SharedMemory> shared_memory = std::move(memory);
+      response =
+          std::shared_ptr<const char>(shared_memory, shared_memory->data());
+    } else {
+      response = ring_->Receive(position, bytes);
+    }
+    int64_t end_time_us = env_->NowMicros();
+    metrics::RecordTFDataServiceGetElementDuration(kShmTransferProtocol,
+                                                   end_time_us - start_time_us);
+    return DecodeResponse(std::move(response), bytes, allocator_, result);
+  }
+
+  void TryCancel() override {
+    VLOG(2) << "Cancel ShmDataTransferClient for worker " << address_ << ".";
+    cancelled_ = true;
+  }
+
+  Status CheckCompatibility(
+      const std::string& server_compatibility_info) const override {
+    if (server_compatibility_info != ServerIdentity(server_pid_)) {
+      return errors::FailedPrecondition(
+          "The shm data transfer server at ", address_,
+          " is not on the same host as the client, or is not the server that "
+          "the client connected to.");
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  ShmDataTransferClient(const std::string& address, int socket,
+                        Allocator* allocator)
+      : address_(address), socket_(socket), allocator_(allocator) {}
+
+  const std::string address_;
+  const int socket_;
+  Allocator* const allocator_;
+  int64_t server_pid_ = 0;
+  std::shared_ptr<ClientRing> ring_;
+  std::atomic<bool> cancelled_ = false;
+  // Serializes requests, as the connection has a single request slot.
+  mutex mu_;
+};
+
+class ShmDataTransferRegistrar {
+ public:
+  ShmDataTransferRegistrar() {
+    DataTransferServer::Register(
+        kShmTransferProtocol,
+        [](DataTransferServer::GetElementT get_element,
+           std::shared_ptr<DataTransferServer>* server) {
+          *server = std::make_shared<ShmDataTransferServer>(get_element);
+          return absl::OkStatus();
+        });
+    DataTransferClient::Register(
+        kShmTransferProtocol, [](DataTransferClient::Config config,
+                                 std::unique_ptr<DataTransferClient>* client) {
+          return ShmDataTransferClient::Connect(config, client);
+        });
+  }
+};
+static ShmDataTransferRegistrar shm_data_transfer_registrar;
+
+}  // namespace
+#endif  // defined(__linux__)
+}  // namespace data
+}  // namespace tensorflow
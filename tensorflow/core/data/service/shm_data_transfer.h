@@ -0,0 +1,46 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_SERVICE_SHM_DATA_TRANSFER_H_
+#define TENSORFLOW_CORE_DATA_SERVICE_SHM_DATA_TRANSFER_H_
+
+namespace tensorflow {
+namespace data {
+
+// Data transfer protocol for clients on the same host as the tf.data service
+// worker, such as trainers reading from a colocated worker. Only available on
+// Linux.
+//
+// Each client connects to the worker through an abstract Unix domain socket
+// named after the data transfer port, and receives a shared memory region
+// (a memfd) holding a request slot and a ring buffer of responses. Requests
+// and responses are signaled with futexes on the shared memory, so the socket
+// is only used to set up connections, to detect peers going away, and to pass
+// the responses that don't fit in the ring as memfds of their own.
+//
+// Elements are not serialized: the worker copies the bytes of each tensor into
+// the ring, 64-byte aligned, and the client hands them out as tensors backed
+// by the shared memory, releasing their space in the ring once the tensors are
+// destroyed. Tensors of types that can't be memcpy-ed are sent as
+// `TensorProto`s, and compressed elements as `CompressedElement`s, so workers
+// serving colocated clients should usually not compress elements.
+//
+// The size of each client's ring defaults to 64MB, and can be set through the
+// `TF_DATA_SERVICE_SHM_RING_BYTES` environment variable of the worker.
+constexpr const char kShmTransferProtocol[] = "shm";
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_SERVICE_SHM_DATA_TRANSFER_H_
@@ -0,0 +1,227 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/shm_data_transfer.h"
+
+#include <stdlib.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/data/service/common.pb.h"
+#include "tensorflow/core/data/service/data_transfer.h"
+#include "tensorflow/core/data/service/dispatcher.pb.h"
+#include "tensorflow/core/data/service/dispatcher_client.h"
+#include "tensorflow/core/data/service/test_cluster.h"
+#include "tensorflow/core/data/service/test_util.h"
+#include "tensorflow/core/data/service/worker.pb.h"
+#include "tensorflow/core/data/service/worker_client.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/status_matchers.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/protobuf/error_codes.pb.h"
+#include "tensorflow/core/protobuf/service_config.pb.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::tensorflow::data::testing::RangeSquareDataset;
+using ::tensorflow::testing::StatusIs;
+using ::testing::HasSubstr;
+
+// Starts a shm data transfer server returning `components` for every
+// request, with `element_index` set to the requested task ID.
+std::shared_ptr<DataTransferServer> StartServer(
+    std::vector<Tensor> components) {
+  std::shared_ptr<DataTransferServer> server;
+  TF_CHECK_OK(DataTransferServer::Build(
+      kShmTransferProtocol,
+      [components](const GetElementRequest* request,
+                   GetElementResult* result) {
+        result->components = components;
+        result->element_index = request->task_id();
+        return absl::OkStatus();
+      },
+      &server));
+  TF_CHECK_OK(server->Start(experimental::WorkerConfig()));
+  return server;
+}
+
+std::unique_ptr<DataTransferClient> ConnectClient(
+    const DataTransferServer& server) {
+  DataTransferClient::Config config;
+  config.protocol = kShmTransferProtocol;
+  config.address = absl::StrCat("localhost:", server.Port());
+  config.accelerator_device_info = nullptr;
+  config.allocator = nullptr;
+  std::unique_ptr<DataTransferClient> client;
+  TF_CHECK_OK(DataTransferClient::Build(kShmTransferProtocol, config, &client));
+  return client;
+}
+
+GetElementRequest Request(int64_t task_id) {
+  GetElementRequest request;
+  request.set_task_id(task_id);
+  return request;
+}
+
+TEST(ShmDataTransferTest, GetElement) {
+  std::vector<Tensor> components = {
+      test::AsTensor<float>({1, 2, 3}, TensorShape({3})),
+      test::AsTensor<int64_t>({4, 5, 6, 7}, TensorShape({2, 2})),
+      test::AsTensor<tstring>({"a", "bc"})};
+  std::shared_ptr<DataTransferServer> server = StartServer(components);
+  std::unique_ptr<DataTransferClient> client = ConnectClient(*server);
+  TF_ASSERT_OK_AND_ASSIGN(std::string compatibility_info,
+                          server->GetCompatibilityInfo());
+  TF_EXPECT_OK(client->CheckCompatibility(compatibility_info));
+
+  for (int64_t i = 0; i < 3; ++i) {
+    GetElementResult result;
+    TF_ASSERT_OK(client->GetElement(Request(i), result));
+    EXPECT_EQ(result.element_index, i);
+    EXPECT_FALSE(result.end_of_sequence);
+    ASSERT_EQ(result.components.size(), components.size());
+    for (int j = 0; j < components.size(); ++j) {
+      test::ExpectEqual(result.components[j], components[j]);
+    }
+  }
+}
+
+TEST(ShmDataTransferTest, IncompatibleServer) {
+  std::shared_ptr<DataTransferServer> server = StartServer({});
+  std::unique_ptr<DataTransferClient> client = ConnectClient(*server);
+  EXPECT_THAT(client->CheckCompatibility("other-host:1"),
+              StatusIs(error::FAILED_PRECONDITION));
+}
+
+TEST(ShmDataTransferTest, ServerError) {
+  std::shared_ptr<DataTransferServer> server;
+  TF_ASSERT_OK(DataTransferServer::Build(
+      kShmTransferProtocol,
+      [](const GetElementRequest*, GetElementResult*) {
+        return errors::NotFound("No task");
+      },
+      &server));
+  TF_ASSERT_OK(server->Start(experimental::WorkerConfig()));
+  std::unique_ptr<DataTransferClient> client = ConnectClient(*server);
+  GetElementResult result;
+  EXPECT_THAT(client->GetElement(Request(0), result),
+              StatusIs(error::NOT_FOUND, HasSubstr("No task")));
+}
+
+TEST(ShmDataTransferTest, ElementsOutliveRing) {
+  // A ring of 4KB holds three of these 1KB elements at a time, so keeping
+  // them alive forces the server to wrap around and then to send elements out
+  // of line.
+  setenv("TF_DATA_SERVICE_SHM_RING_BYTES", "4096", /*overwrite=*/1);
+  std::shared_ptr<DataTransferServer> server =
+      StartServer({test::AsTensor<int32_t>(std::vector<int32_t>(256, 7))});
+  unsetenv("TF_DATA_SERVICE_SHM_RING_BYTES");
+  std::unique_ptr<DataTransferClient> client = ConnectClient(*server);
+
+  std::vector<GetElementResult> results(10);
+  for (int64_t i = 0; i < results.size(); ++i) {
+    TF_ASSERT_OK(client->GetElement(Request(i), results[i]));
+    // Releases every other element to leave holes in the ring.
+    if (i % 2 == 1) {
+      results[i - 1].components.clear();
+    }
+  }
+  for (int64_t i = 1; i < results.size(); i += 2) {
+    EXPECT_EQ(results[i].element_index, i);
+    test::ExpectEqual(results[i].components[0],
+                      test::AsTensor<int32_t>(std::vector<int32_t>(256, 7)));
+  }
+}
+
+TEST(ShmDataTransferTest, CancelClient) {
+  std::shared_ptr<DataTransferServer> server = StartServer({});
+  std::unique_ptr<DataTransferClient> client = ConnectClient(*server);
+  client->TryCancel();
+  GetElementResult result;
+  EXPECT_THAT(client->GetElement(Request(0), result),
+              StatusIs(error::CANCELLED,
+                       HasSubstr("has been cancelled")));
+}
+
+TEST(ShmDataTransferTest, ServerShutsDown) {
+  std::shared_ptr<DataTransferServer> server = StartServer({});
+  std::unique_ptr<DataTransferClient> client = ConnectClient(*server);
+  server.reset();
+  GetElementResult result;
+  EXPECT_THAT(client->GetElement(Request(0), result),
+              StatusIs(error::UNAVAILABLE));
+}
+
+TEST(ShmDataTransferTest, ReadFromTestCluster) {
+  TestCluster cluster(/*num_workers=*/1, kShmTransferProtocol);
+  TF_ASSERT_OK(cluster.Initialize());
+  DataServiceDispatcherClient dispatcher(cluster.DispatcherAddress(), "grpc");
+  const int64_t range = 5;
+  std::string dataset_id;
+  TF_ASSERT_OK(dispatcher.RegisterDataset(
+      RangeSquareDataset(range), DataServiceMetadata(),
+      /*requested_dataset_id=*/std::nullopt, dataset_id));
+  ProcessingModeDef processing_mode;
+  processing_mode.set_sharding_policy(ProcessingModeDef::OFF);
+  int64_t job_id = 0;
+  TF_ASSERT_OK(dispatcher.GetOrCreateJob(
+      dataset_id, processing_mode, /*job_name=*/std::nullopt,
+      /*num_consumers=*/std::nullopt, /*use_cross_trainer_cache=*/false,
+      TARGET_WORKERS_AUTO, job_id));
+  int64_t iteration_client_id = 0;
+  TF_ASSERT_OK(dispatcher.GetOrCreateIteration(job_id, /*repetition=*/0,
+                                               iteration_client_id));
+  ClientHeartbeatRequest request;
+  ClientHeartbeatResponse response;
+  request.set_iteration_client_id(iteration_client_id);
+  TF_ASSERT_OK(dispatcher.ClientHeartbeat(request, response));
+  ASSERT_EQ(response.task_info_size(), 1);
+  const TaskInfo& task = response.task_info(0);
+
+  std::optional<DataTransferServerInfo> shm_server;
+  for (const DataTransferServerInfo& info : task.transfer_servers()) {
+    if (info.protocol() == kShmTransferProtocol) {
+      shm_server = info;
+    }
+  }
+  ASSERT_TRUE(shm_server.has_value());
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<DataServiceWorkerClient> client,
+      CreateDataServiceWorkerClient("grpc", *shm_server,
+                                    /*accelerator_device_info=*/nullptr,
+                                    /*allocator=*/nullptr));
+  for (int64_t i = 0; i < range; ++i) {
+    GetElementRequest get_element_request;
+    get_element_request.set_task_id(task.task_id());
+    GetElementResult result;
+    TF_ASSERT_OK(client->GetElement(get_element_request, result));
+    EXPECT_FALSE(result.end_of_sequence);
+    test::ExpectEqual(result.components[0], Tensor(int64_t{i * i}));
+  }
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
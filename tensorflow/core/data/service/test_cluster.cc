@@ -100,6 +100,7 @@ Status TestCluster::AddWorker(
   config.set_protocol(kProtocol);
   if (data_transfer_protocol.has_value()) {
     config.set_data_transfer_protocol(*data_transfer_protocol);
+    config.set_data_transfer_address("localhost:%dts_port%");
   }
   config.set_dispatcher_address(dispatcher_address_);
   std::string worker_address =
@@ -0,0 +1,441 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/snapshot_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "tensorflow/core/data/snapshot_utils.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/env_time.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/file_statistics.h"
+#include "tensorflow/core/platform/host_info.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/random.h"
+#include "tensorflow/core/platform/statusor.h"
+#include "tensorflow/core/protobuf/snapshot.pb.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// Claims are directories named by the claim prefix and their generation.
+constexpr char kClaimPrefix[] = "writer.claim.";
+constexpr char kHeartbeatFilename[] = "heartbeat";
+constexpr char kRunHeartbeatFilename[] = "writer.heartbeat";
+constexpr char kEntryFilename[] = "cache.entry";
+// Prefix of the directories being deleted from the cache.
+constexpr char kEvictedPrefix[] = ".evicted-";
+
+}  // namespace
+
+SnapshotCache::SnapshotCache(Env* env, const Options& options)
+    : env_(env), options_(options) {}
+
+std::string SnapshotCache::NewOwnerId() {
+  return absl::StrCat(port::Hostname(), "-", Env::Default()->GetProcessId(),
+                      "-", random::New64());
+}
+
+absl::StatusOr<bool> SnapshotCache::TryClaim(uint64 hash,
+                                             const std::string& owner) {
+  TF_RETURN_IF_ERROR(env_->RecursivelyCreateDir(
+      snapshot_util::HashDirectory(options_.root, hash)));
+  TF_ASSIGN_OR_RETURN(int64_t generation, CurrentClaimGeneration(hash));
+  if (generation >= 0) {
+    TF_ASSIGN_OR_RETURN(bool live, HasLiveClaim(hash));
+    if (live) {
+      return false;
+    }
+  }
+  // Writers racing for the claim, or for taking over the same expired claim,
+  // all try to create the claim of the next generation, and directory
+  // creation lets only one of them succeed.
+  const std::string claim_dir = ClaimDirectory(hash, generation + 1);
+  absl::Status s = env_->CreateDir(claim_dir);
+  if (errors::IsAlreadyExists(s)) {
+    return false;
+  }
+  TF_RETURN_IF_ERROR(s);
+  TF_RETURN_IF_ERROR(WriteHeartbeat(claim_dir, owner, EnvTime::NowMicros()));
+  if (generation >= 0) {
+    LOG(INFO) << "Took over the expired claim of the snapshot in "
+              << snapshot_util::HashDirectory(options_.root, hash);
+  }
+
+  // Deletes the claims that were taken over.
+  std::vector<std::string> children;
+  TF_RETURN_IF_ERROR(env_->GetChildren(
+      snapshot_util::HashDirectory(options_.root, hash), &children));
+  for (const std::string& child : children) {
+    int64_t child_generation;
+    if (absl::StartsWith(child, kClaimPrefix) &&
+        absl::SimpleAtoi(child.substr(strlen(kClaimPrefix)),
+                         &child_generation) &&
+        child_generation <= generation) {
+      TF_RETURN_IF_ERROR(Remove(ClaimDirectory(hash, child_generation)));
+    }
+  }
+  return true;
+}
+
+absl::Status SnapshotCache::RenewClaim(uint64 hash, const std::string& owner) {
+  TF_ASSIGN_OR_RETURN(std::string claim_dir, OwnedClaimDirectory(hash, owner));
+  return WriteHeartbeat(claim_dir, owner, EnvTime::NowMicros());
+}
+
+absl::Status SnapshotCache::ReleaseClaim(uint64 hash,
+                                         const std::string& owner) {
+  absl::StatusOr<std::string> claim_dir = OwnedClaimDirectory(hash, owner);
+  if (errors::IsFailedPrecondition(claim_dir.status())) {
+    return absl::OkStatus();
+  }
+  TF_RETURN_IF_ERROR(claim_dir.status());
+  // Expires the claim instead of deleting it, so that claim generations keep
+  // increasing.
+  return WriteHeartbeat(*claim_dir, owner, /*now_micros=*/0);
+}
+
+absl::Status SnapshotCache::RenewRun(const std::string& run_dir) {
+  return WriteStringToFile(env_, io::JoinPath(run_dir, kRunHeartbeatFilename),
+                           absl::StrCat(EnvTime::NowMicros()));
+}
+
+absl::Status SnapshotCache::Commit(uint64 hash) {
+  const std::string hash_dir =
+      snapshot_util::HashDirectory(options_.root, hash);
+  experimental::SnapshotMetadataRecord metadata;
+  bool file_exists;
+  TF_RETURN_IF_ERROR(
+      snapshot_util::ReadMetadataFile(env_, hash_dir, &metadata, &file_exists));
+  if (!file_exists || !metadata.finalized()) {
+    return errors::FailedPrecondition("Snapshot in ", hash_dir,
+                                      " is not finalized.");
+  }
+
+  // Deletes the runs of the writers that didn't finish the snapshot. Writers
+  // renew their runs ten times per lease, so runs that have not been written
+  // or renewed for a lease are abandoned, while the others may still be
+  // finished by writers resumed from a checkpoint.
+  const int64_t now = EnvTime::NowMicros();
+  std::vector<std::string> children;
+  TF_RETURN_IF_ERROR(env_->GetChildren(hash_dir, &children));
+  for (const std::string& child : children) {
+    const std::string path = io::JoinPath(hash_dir, child);
+    if (child == metadata.run_id() || absl::StartsWith(child, kClaimPrefix) ||
+        !env_->IsDirectory(path).ok()) {
+      continue;
+    }
+    TF_ASSIGN_OR_RETURN(int64_t last_modified_micros,
+                        LastModifiedMicros(path));
+    if (now - last_modified_micros >= options_.claim_lease_micros) {
+      TF_RETURN_IF_ERROR(Remove(path));
+    }
+  }
+
+  experimental::SnapshotCacheEntry entry;
+  TF_ASSIGN_OR_RETURN(int64_t size_bytes, DirectorySize(hash_dir));
+  entry.set_size_bytes(size_bytes);
+  entry.set_last_access_micros(EnvTime::NowMicros());
+  TF_RETURN_IF_ERROR(WriteEntry(hash, entry));
+  return EvictToBudget();
+}
+
+absl::Status SnapshotCache::RecordAccess(uint64 hash) {
+  experimental::SnapshotCacheEntry entry;
+  absl::Status s = ReadBinaryProto(env_, EntryFilename(hash), &entry);
+  if (errors::IsNotFound(s)) {
+    // The snapshot was written outside of the cache, and is accounted for
+    // by the time of its last modification.
+    return absl::OkStatus();
+  }
+  TF_RETURN_IF_ERROR(s);
+  entry.set_last_access_micros(EnvTime::NowMicros());
+  return WriteEntry(hash, entry);
+}
+
+absl::Status SnapshotCache::EvictToBudget() {
+  if (options_.max_bytes <= 0) {
+    return absl::OkStatus();
+  }
+  struct Candidate {
+    int64_t last_access_micros;
+    int64_t size_bytes;
+    std::string dir;
+  };
+  std::vector<Candidate> candidates;
+  int64_t total_bytes = 0;
+  const int64_t now = EnvTime::NowMicros();
+
+  std::vector<std::string> children;
+  TF_RETURN_IF_ERROR(env_->GetChildren(options_.root, &children));
+  for (const std::string& child : children) {
+    const std::string dir = io::JoinPath(options_.root, child);
+    if (absl::StartsWith(child, kEvictedPrefix)) {
+      // Left over by an eviction that was interrupted.
+      int64_t undeleted_files, undeleted_dirs;
+      env_->DeleteRecursively(dir, &undeleted_files, &undeleted_dirs)
+          .IgnoreError();
+      continue;
+    }
+    uint64 hash;
+    if (!absl::SimpleAtoi(child, &hash)) {
+      continue;
+    }
+
+    Candidate candidate{0, 0, dir};
+    experimental::SnapshotCacheEntry entry;
+    absl::Status s = ReadBinaryProto(env_, EntryFilename(hash), &entry);
+    if (s.ok()) {
+      candidate.last_access_micros = entry.last_access_micros();
+      candidate.size_bytes = entry.size_bytes();
+    } else if (errors::IsNotFound(s)) {
+      // The snapshot is being written, or was abandoned by its writer, or was
+      // written outside of the cache.
+      TF_ASSIGN_OR_RETURN(bool live, HasLiveClaim(hash));
+      if (live) {
+        continue;
+      }
+      FileStatistics stat;
+      s = env_->Stat(dir, &stat);
+      if (errors::IsNotFound(s)) {
+        continue;
+      }
+      TF_RETURN_IF_ERROR(s);
+      candidate.last_access_micros = stat.mtime_nsec / 1000;
+      TF_ASSIGN_OR_RETURN(candidate.size_bytes, DirectorySize(dir));
+    } else {
+      return s;
+    }
+    total_bytes += candidate.size_bytes;
+    if (now - candidate.last_access_micros >=
+        options_.eviction_grace_period_micros) {
+      candidates.push_back(std::move(candidate));
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate& a, const Candidate& b) {
+              return a.last_access_micros < b.last_access_micros;
+            });
+  for (const Candidate& candidate : candidates) {
+    if (total_bytes <= options_.max_bytes) {
+      break;
+    }
+    LOG(INFO) << "Evicting the snapshot in " << candidate.dir << " ("
+              << candidate.size_bytes << " bytes) from the snapshot cache.";
+    TF_RETURN_IF_ERROR(Remove(candidate.dir));
+    total_bytes -= candidate.size_bytes;
+  }
+  if (total_bytes > options_.max_bytes) {
+    VLOG(1) << "Snapshot cache in " << options_.root << " uses " << total_bytes
+            << " bytes, over its budget of " << options_.max_bytes
+            << " bytes, but its other snapshots are in use.";
+  }
+  return absl::OkStatus();
+}
+
+std::string SnapshotCache::ClaimDirectory(uint64 hash,
+                                          int64_t generation) const {
+  return io::JoinPath(snapshot_util::HashDirectory(options_.root, hash),
+                      absl::StrCat(kClaimPrefix, generation));
+}
+
+std::string SnapshotCache::EntryFilename(uint64 hash) const {
+  return io::JoinPath(snapshot_util::HashDirectory(options_.root, hash),
+                      kEntryFilename);
+}
+
+absl::StatusOr<int64_t> SnapshotCache::CurrentClaimGeneration(uint64 hash) {
+  std::vector<std::string> children;
+  absl::Status s = env_->GetChildren(
+      snapshot_util::HashDirectory(options_.root, hash), &children);
+  if (errors::IsNotFound(s)) {
+    return -1;
+  }
+  TF_RETURN_IF_ERROR(s);
+  int64_t generation = -1;
+  for (const std::string& child : children) {
+    int64_t child_generation;
+    if (absl::StartsWith(child, kClaimPrefix) &&
+        absl::SimpleAtoi(child.substr(strlen(kClaimPrefix)),
+                         &child_generation)) {
+      generation = std::max(generation, child_generation);
+    }
+  }
+  return generation;
+}
+
+absl::Status SnapshotCache::ReadClaim(const std::string& claim_dir,
+                                      std::string* owner,
+                                      int64_t* last_renewal_micros) {
+  std::string heartbeat;
+  absl::Status s = ReadFileToString(
+      env_, io::JoinPath(claim_dir, kHeartbeatFilename), &heartbeat);
+  if (!s.ok() && !errors::IsNotFound(s)) {
+    return s;
+  }
+  // The heartbeat holds the owner and the last renewal time on two lines.
+  std::vector<std::string> lines = absl::StrSplit(heartbeat, '\n');
+  if (s.ok() && lines.size() == 2 &&
+      absl::SimpleAtoi(lines[1], last_renewal_micros)) {
+    *owner = lines[0];
+    return absl::OkStatus();
+  }
+  // The writer may have been interrupted before its first heartbeat, in
+  // which case the claim has no owner and was last renewed when created.
+  owner->clear();
+  FileStatistics stat;
+  TF_RETURN_IF_ERROR(env_->Stat(claim_dir, &stat));
+  *last_renewal_micros = stat.mtime_nsec / 1000;
+  return absl::OkStatus();
+}
+
+absl::StatusOr<bool> SnapshotCache::HasLiveClaim(uint64 hash) {
+  TF_ASSIGN_OR_RETURN(int64_t generation, CurrentClaimGeneration(hash));
+  if (generation < 0) {
+    return false;
+  }
+  std::string owner;
+  int64_t last_renewal_micros;
+  absl::Status s = ReadClaim(ClaimDirectory(hash, generation), &owner,
+                             &last_renewal_micros);
+  if (errors::IsNotFound(s)) {
+    // Deleted by the writer that took it over.
+    return true;
+  }
+  TF_RETURN_IF_ERROR(s);
+  return EnvTime::NowMicros() - last_renewal_micros <
+         options_.claim_lease_micros;
+}
+
+absl::StatusOr<std::string> SnapshotCache::OwnedClaimDirectory(
+    uint64 hash, const std::string& owner) {
+  TF_ASSIGN_OR_RETURN(int64_t generation, CurrentClaimGeneration(hash));
+  if (generation >= 0) {
+    const std::string claim_dir = ClaimDirectory(hash, generation);
+    std::string claim_owner;
+    int64_t last_renewal_micros;
+    absl::Status s = ReadClaim(claim_dir, &claim_owner, &last_renewal_micros);
+    if (!errors::IsNotFound(s)) {
+      TF_RETURN_IF_ERROR(s);
+    }
+    if (s.ok() && claim_owner == owner) {
+      return claim_dir;
+    }
+  }
+  return errors::FailedPrecondition(
+      "The snapshot in ", snapshot_util::HashDirectory(options_.root, hash),
+      " is not claimed by ", owner, ".");
+}
+
+absl::Status SnapshotCache::WriteHeartbeat(const std::string& claim_dir,
+                                           const std::string& owner,
+                                           int64_t now_micros) {
+  const std::string heartbeat_filename =
+      io::JoinPath(claim_dir, kHeartbeatFilename);
+  const std::string tmp_filename =
+      absl::StrCat(heartbeat_filename, "-tmp-", random::New64());
+  TF_RETURN_IF_ERROR(WriteStringToFile(env_, tmp_filename,
+                                       absl::StrCat(owner, "\n", now_micros)));
+  return env_->RenameFile(tmp_filename, heartbeat_filename);
+}
+
+absl::Status SnapshotCache::WriteEntry(
+    uint64 hash, const experimental::SnapshotCacheEntry& entry) {
+  const std::string entry_filename = EntryFilename(hash);
+  const std::string tmp_filename =
+      absl::StrCat(entry_filename, "-tmp-", random::New64());
+  TF_RETURN_IF_ERROR(WriteBinaryProto(env_, tmp_filename, entry));
+  return env_->RenameFile(tmp_filename, entry_filename);
+}
+
+absl::StatusOr<int64_t> SnapshotCache::DirectorySize(const std::string& dir) {
+  std::vector<std::string> children;
+  absl::Status s = env_->GetChildren(dir, &children);
+  if (errors::IsNotFound(s)) {
+    return 0;
+  }
+  TF_RETURN_IF_ERROR(s);
+  int64_t size_bytes = 0;
+  for (const std::string& child : children) {
+    const std::string path = io::JoinPath(dir, child);
+    FileStatistics stat;
+    s = env_->Stat(path, &stat);
+    if (errors::IsNotFound(s)) {
+      // Deleted concurrently, e.g. a temporary file that was renamed.
+      continue;
+    }
+    TF_RETURN_IF_ERROR(s);
+    if (stat.is_directory) {
+      TF_ASSIGN_OR_RETURN(int64_t child_bytes, DirectorySize(path));
+      size_bytes += child_bytes;
+    } else {
+      size_bytes += stat.length;
+    }
+  }
+  return size_bytes;
+}
+
+absl::StatusOr<int64_t> SnapshotCache::LastModifiedMicros(
+    const std::string& dir) {
+  FileStatistics stat;
+  TF_RETURN_IF_ERROR(env_->Stat(dir, &stat));
+  int64_t last_modified_micros = stat.mtime_nsec / 1000;
+  std::vector<std::string> children;
+  TF_RETURN_IF_ERROR(env_->GetChildren(dir, &children));
+  for (const std::string& child : children) {
+    const std::string path = io::JoinPath(dir, child);
+    absl::Status s = env_->Stat(path, &stat);
+    if (errors::IsNotFound(s)) {
+      continue;
+    }
+    TF_RETURN_IF_ERROR(s);
+    int64_t child_micros = stat.mtime_nsec / 1000;
+    if (stat.is_directory) {
+      TF_ASSIGN_OR_RETURN(child_micros, LastModifiedMicros(path));
+    }
+    last_modified_micros = std::max(last_modified_micros, child_micros);
+  }
+  return last_modified_micros;
+}
+
+absl::Status SnapshotCache::Remove(const std::string& dir) {
+  const std::string evicted_dir = io::JoinPath(
+      options_.root, absl::StrCat(kEvictedPrefix, random::New64()));
+  absl::Status s = env_->RenameFile(dir, evicted_dir);
+  if (errors::IsNotFound(s)) {
+    // Removed concurrently.
+    return absl::OkStatus();
+  }
+  TF_RETURN_IF_ERROR(s);
+  int64_t undeleted_files, undeleted_dirs;
+  return env_->DeleteRecursively(evicted_dir, &undeleted_files,
+                                 &undeleted_dirs);
+}
+
+}  // namespace data
+}  // namespace tensorflow
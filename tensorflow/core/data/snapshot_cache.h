@@ -0,0 +1,137 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_SNAPSHOT_CACHE_H_
+#define TENSORFLOW_CORE_DATA_SNAPSHOT_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/protobuf/snapshot.pb.h"
+
+namespace tensorflow {
+namespace data {
+
+// A store of `snapshot` outputs shared by all the jobs pointing at the same
+// snapshot directory. Snapshots are stored under the fingerprint of the graph
+// of the dataset they materialize (see `snapshot_util::HashDirectory`), so
+// identical input pipelines of different jobs read the output of the first
+// job to run them to completion.
+//
+// The cache makes the following guarantees on top of the snapshot layout:
+//
+// - At most one job writes the snapshot of a graph at a time: writers claim
+//   a snapshot by exclusively creating a claim directory, record their owner
+//   id in it, and renew it while writing. Jobs that find a live claim pass
+//   their input through instead of writing a duplicate snapshot. Claims of
+//   writers that stopped renewing them for `claim_lease_micros` are taken
+//   over by creating the claim of the next generation, so that only one of
+//   the writers racing for an expired claim gets it.
+// - Once committed, snapshots are accounted for, and the least recently used
+//   ones are evicted until the cache fits in `max_bytes`. Snapshots read in
+//   the last `eviction_grace_period_micros` are never evicted, and readers
+//   record their accesses while reading.
+// - Runs of other writers are only deleted once they have not been written
+//   or renewed for a lease.
+//
+// The guarantees rely on directory creation and renames being atomic, which
+// holds for local and most network file systems.
+class SnapshotCache {
+ public:
+  struct Options {
+    // Root directory of the cache.
+    std::string root;
+    // Disk budget of the cache. Zero or less means unlimited.
+    int64_t max_bytes = 0;
+    // Time after which the claim of a writer that didn't renew it expires.
+    int64_t claim_lease_micros = 5LL * 60 * 1000 * 1000;
+    // Time after being read during which a snapshot isn't evicted.
+    int64_t eviction_grace_period_micros = 60LL * 60 * 1000 * 1000;
+  };
+
+  SnapshotCache(Env* env, const Options& options);
+
+  // Returns an owner id for claims, unique across processes and hosts.
+  static std::string NewOwnerId();
+
+  const Options& options() const { return options_; }
+  const std::string& root() const { return options_.root; }
+
+  // Tries to claim the writing of the snapshot with `hash` for `owner`.
+  // Returns false if another writer holds a live claim, or won the race for
+  // the claim.
+  absl::StatusOr<bool> TryClaim(uint64 hash, const std::string& owner);
+
+  // Extends the claim of the snapshot with `hash` by another lease. Returns
+  // `FailedPrecondition` if `owner` doesn't hold the claim any more, e.g.
+  // because it was taken over after `owner` failed to renew it in time.
+  absl::Status RenewClaim(uint64 hash, const std::string& owner);
+
+  // Releases the claim of the snapshot with `hash` if `owner` holds it.
+  absl::Status ReleaseClaim(uint64 hash, const std::string& owner);
+
+  // Records that the writer of the run in `run_dir` is alive, so that the run
+  // isn't deleted when another writer commits the snapshot.
+  absl::Status RenewRun(const std::string& run_dir);
+
+  // Accounts for the finalized snapshot with `hash`, then evicts the least
+  // recently used snapshots until the cache fits in its budget.
+  absl::Status Commit(uint64 hash);
+
+  // Marks the snapshot with `hash` as used now.
+  absl::Status RecordAccess(uint64 hash);
+
+  // Evicts the least recently used snapshots, as well as snapshots abandoned
+  // by their writers, until the cache fits in its budget.
+  absl::Status EvictToBudget();
+
+ private:
+  std::string ClaimDirectory(uint64 hash, int64_t generation) const;
+  std::string EntryFilename(uint64 hash) const;
+
+  // Returns the generation of the current claim of the snapshot with `hash`,
+  // or -1 if it was never claimed.
+  absl::StatusOr<int64_t> CurrentClaimGeneration(uint64 hash);
+  // Reads the owner and last renewal time of the claim in `claim_dir`.
+  absl::Status ReadClaim(const std::string& claim_dir, std::string* owner,
+                         int64_t* last_renewal_micros);
+  // Returns whether the claim of the snapshot with `hash` has been renewed in
+  // the last lease.
+  absl::StatusOr<bool> HasLiveClaim(uint64 hash);
+  // Returns the claim directory of the snapshot with `hash` if `owner` holds
+  // its claim, and `FailedPrecondition` otherwise.
+  absl::StatusOr<std::string> OwnedClaimDirectory(uint64 hash,
+                                                  const std::string& owner);
+  absl::Status WriteHeartbeat(const std::string& claim_dir,
+                              const std::string& owner, int64_t now_micros);
+  absl::Status WriteEntry(uint64 hash,
+                          const experimental::SnapshotCacheEntry& entry);
+  absl::StatusOr<int64_t> DirectorySize(const std::string& dir);
+  // Returns the last modification time of `dir` or of any file under it.
+  absl::StatusOr<int64_t> LastModifiedMicros(const std::string& dir);
+  // Atomically moves `dir` out of the cache before deleting it.
+  absl::Status Remove(const std::string& dir);
+
+  Env* const env_;
+  const Options options_;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_SNAPSHOT_CACHE_H_
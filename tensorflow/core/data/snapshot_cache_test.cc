@@ -0,0 +1,240 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/snapshot_cache.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "tensorflow/core/data/snapshot_utils.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/threadpool.h"
+#include "tensorflow/core/protobuf/snapshot.pb.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+SnapshotCache::Options TestOptions() {
+  SnapshotCache::Options options;
+  EXPECT_TRUE(Env::Default()->LocalTempFilename(&options.root));
+  options.eviction_grace_period_micros = 0;
+  return options;
+}
+
+// Writes a finalized snapshot of `size_bytes` bytes with `hash` in the cache.
+void WriteSnapshot(const SnapshotCache& cache, uint64 hash, int64_t size_bytes,
+                   const std::string& run_id = "1") {
+  const std::string hash_dir = snapshot_util::HashDirectory(cache.root(), hash);
+  const std::string shard_dir = snapshot_util::ShardDirectory(
+      snapshot_util::RunDirectory(hash_dir, run_id), /*shard_id=*/0);
+  TF_ASSERT_OK(Env::Default()->RecursivelyCreateDir(shard_dir));
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(),
+                                 io::JoinPath(shard_dir, "00000000.snapshot"),
+                                 std::string(size_bytes, 'a')));
+  experimental::SnapshotMetadataRecord metadata;
+  metadata.set_run_id(run_id);
+  metadata.set_finalized(true);
+  TF_ASSERT_OK(
+      snapshot_util::WriteMetadataFile(Env::Default(), hash_dir, &metadata));
+}
+
+bool SnapshotExists(const SnapshotCache& cache, uint64 hash) {
+  return Env::Default()
+      ->FileExists(snapshot_util::HashDirectory(cache.root(), hash))
+      .ok();
+}
+
+// Runs `TryClaim` of the snapshot with `hash` for `num_writers` writers at
+// once, and returns the number of writers that got the claim.
+int NumContendingWritersClaiming(SnapshotCache& cache, uint64 hash,
+                                 int num_writers) {
+  std::atomic<int> num_claimed = 0;
+  {
+    thread::ThreadPool pool(Env::Default(), "writers", num_writers);
+    for (int i = 0; i < num_writers; ++i) {
+      pool.Schedule([&cache, &num_claimed, hash]() {
+        absl::StatusOr<bool> claimed =
+            cache.TryClaim(hash, SnapshotCache::NewOwnerId());
+        TF_EXPECT_OK(claimed.status());
+        if (claimed.ok() && *claimed) {
+          ++num_claimed;
+        }
+      });
+    }
+  }
+  return num_claimed;
+}
+
+TEST(SnapshotCacheTest, ClaimIsExclusive) {
+  SnapshotCache cache(Env::Default(), TestOptions());
+  TF_ASSERT_OK_AND_ASSIGN(bool claimed, cache.TryClaim(/*hash=*/1, "a"));
+  EXPECT_TRUE(claimed);
+  TF_ASSERT_OK_AND_ASSIGN(claimed, cache.TryClaim(/*hash=*/1, "b"));
+  EXPECT_FALSE(claimed);
+  TF_ASSERT_OK_AND_ASSIGN(claimed, cache.TryClaim(/*hash=*/2, "b"));
+  EXPECT_TRUE(claimed);
+
+  TF_ASSERT_OK(cache.ReleaseClaim(/*hash=*/1, "a"));
+  TF_ASSERT_OK_AND_ASSIGN(claimed, cache.TryClaim(/*hash=*/1, "b"));
+  EXPECT_TRUE(claimed);
+}
+
+TEST(SnapshotCacheTest, ContendingWritersClaimOnce) {
+  SnapshotCache cache(Env::Default(), TestOptions());
+  EXPECT_EQ(NumContendingWritersClaiming(cache, /*hash=*/1,
+                                         /*num_writers=*/8),
+            1);
+}
+
+TEST(SnapshotCacheTest, ExpiredClaimIsTakenOver) {
+  SnapshotCache::Options options = TestOptions();
+  options.claim_lease_micros = 0;
+  SnapshotCache cache(Env::Default(), options);
+  TF_ASSERT_OK_AND_ASSIGN(bool claimed, cache.TryClaim(/*hash=*/1, "a"));
+  EXPECT_TRUE(claimed);
+  TF_ASSERT_OK_AND_ASSIGN(claimed, cache.TryClaim(/*hash=*/1, "b"));
+  EXPECT_TRUE(claimed);
+  EXPECT_TRUE(
+      errors::IsFailedPrecondition(cache.RenewClaim(/*hash=*/1, "a")));
+  TF_EXPECT_OK(cache.RenewClaim(/*hash=*/1, "b"));
+}
+
+TEST(SnapshotCacheTest, ContendingWritersTakeOverExpiredClaimOnce) {
+  SnapshotCache::Options options = TestOptions();
+  options.claim_lease_micros = 1000 * 1000;
+  SnapshotCache cache(Env::Default(), options);
+  TF_ASSERT_OK_AND_ASSIGN(bool claimed, cache.TryClaim(/*hash=*/1, "a"));
+  ASSERT_TRUE(claimed);
+  Env::Default()->SleepForMicroseconds(options.claim_lease_micros);
+
+  EXPECT_EQ(NumContendingWritersClaiming(cache, /*hash=*/1,
+                                         /*num_writers=*/8),
+            1);
+  EXPECT_TRUE(
+      errors::IsFailedPrecondition(cache.RenewClaim(/*hash=*/1, "a")));
+}
+
+TEST(SnapshotCacheTest, OnlyOwnerRenewsAndReleasesClaim) {
+  SnapshotCache cache(Env::Default(), TestOptions());
+  EXPECT_TRUE(
+      errors::IsFailedPrecondition(cache.RenewClaim(/*hash=*/1, "a")));
+  TF_ASSERT_OK_AND_ASSIGN(bool claimed, cache.TryClaim(/*hash=*/1, "a"));
+  ASSERT_TRUE(claimed);
+
+  EXPECT_TRUE(
+      errors::IsFailedPrecondition(cache.RenewClaim(/*hash=*/1, "b")));
+  TF_EXPECT_OK(cache.ReleaseClaim(/*hash=*/1, "b"));
+  TF_ASSERT_OK_AND_ASSIGN(claimed, cache.TryClaim(/*hash=*/1, "b"));
+  EXPECT_FALSE(claimed);
+  TF_EXPECT_OK(cache.RenewClaim(/*hash=*/1, "a"));
+}
+
+TEST(SnapshotCacheTest, CommitRequiresFinalizedSnapshot) {
+  SnapshotCache cache(Env::Default(), TestOptions());
+  EXPECT_TRUE(errors::IsFailedPrecondition(cache.Commit(/*hash=*/1)));
+}
+
+TEST(SnapshotCacheTest, CommitDeletesAbandonedRuns) {
+  SnapshotCache::Options options = TestOptions();
+  options.claim_lease_micros = 0;
+  SnapshotCache cache(Env::Default(), options);
+  WriteSnapshot(cache, /*hash=*/1, /*size_bytes=*/10, /*run_id=*/"1");
+  WriteSnapshot(cache, /*hash=*/1, /*size_bytes=*/10, /*run_id=*/"2");
+  TF_ASSERT_OK(cache.Commit(/*hash=*/1));
+
+  const std::string hash_dir =
+      snapshot_util::HashDirectory(cache.root(), /*hash=*/1);
+  EXPECT_FALSE(Env::Default()
+                   ->FileExists(snapshot_util::RunDirectory(hash_dir, "1"))
+                   .ok());
+  TF_EXPECT_OK(Env::Default()->FileExists(
+      snapshot_util::RunDirectory(hash_dir, "2")));
+}
+
+TEST(SnapshotCacheTest, CommitKeepsRunsOfLiveWriters) {
+  SnapshotCache cache(Env::Default(), TestOptions());
+  WriteSnapshot(cache, /*hash=*/1, /*size_bytes=*/10, /*run_id=*/"1");
+  const std::string hash_dir =
+      snapshot_util::HashDirectory(cache.root(), /*hash=*/1);
+  TF_ASSERT_OK(cache.RenewRun(snapshot_util::RunDirectory(hash_dir, "1")));
+  WriteSnapshot(cache, /*hash=*/1, /*size_bytes=*/10, /*run_id=*/"2");
+  TF_ASSERT_OK(cache.Commit(/*hash=*/1));
+
+  TF_EXPECT_OK(Env::Default()->FileExists(
+      snapshot_util::RunDirectory(hash_dir, "1")));
+  TF_EXPECT_OK(Env::Default()->FileExists(
+      snapshot_util::RunDirectory(hash_dir, "2")));
+}
+
+TEST(SnapshotCacheTest, EvictsLeastRecentlyUsedSnapshots) {
+  SnapshotCache::Options options = TestOptions();
+  options.max_bytes = 2500;
+  SnapshotCache cache(Env::Default(), options);
+  WriteSnapshot(cache, /*hash=*/1, /*size_bytes=*/1000);
+  TF_ASSERT_OK(cache.Commit(/*hash=*/1));
+  Env::Default()->SleepForMicroseconds(1000);
+  WriteSnapshot(cache, /*hash=*/2, /*size_bytes=*/1000);
+  TF_ASSERT_OK(cache.Commit(/*hash=*/2));
+  Env::Default()->SleepForMicroseconds(1000);
+  TF_ASSERT_OK(cache.RecordAccess(/*hash=*/1));
+  Env::Default()->SleepForMicroseconds(1000);
+
+  WriteSnapshot(cache, /*hash=*/3, /*size_bytes=*/1000);
+  TF_ASSERT_OK(cache.Commit(/*hash=*/3));
+  EXPECT_TRUE(SnapshotExists(cache, /*hash=*/1));
+  EXPECT_FALSE(SnapshotExists(cache, /*hash=*/2));
+  EXPECT_TRUE(SnapshotExists(cache, /*hash=*/3));
+}
+
+TEST(SnapshotCacheTest, DoesNotEvictRecentlyReadSnapshots) {
+  SnapshotCache::Options options = TestOptions();
+  options.max_bytes = 1500;
+  options.eviction_grace_period_micros = 60LL * 1000 * 1000;
+  SnapshotCache cache(Env::Default(), options);
+  WriteSnapshot(cache, /*hash=*/1, /*size_bytes=*/1000);
+  TF_ASSERT_OK(cache.Commit(/*hash=*/1));
+  WriteSnapshot(cache, /*hash=*/2, /*size_bytes=*/1000);
+  TF_ASSERT_OK(cache.Commit(/*hash=*/2));
+  EXPECT_TRUE(SnapshotExists(cache, /*hash=*/1));
+  EXPECT_TRUE(SnapshotExists(cache, /*hash=*/2));
+}
+
+TEST(SnapshotCacheTest, EvictsAbandonedSnapshots) {
+  SnapshotCache::Options options = TestOptions();
+  options.max_bytes = 1500;
+  options.claim_lease_micros = 0;
+  SnapshotCache cache(Env::Default(), options);
+  TF_ASSERT_OK_AND_ASSIGN(bool claimed, cache.TryClaim(/*hash=*/1, "a"));
+  ASSERT_TRUE(claimed);
+  WriteSnapshot(cache, /*hash=*/1, /*size_bytes=*/1000);
+  Env::Default()->SleepForMicroseconds(1000);
+
+  WriteSnapshot(cache, /*hash=*/2, /*size_bytes=*/1000);
+  TF_ASSERT_OK(cache.Commit(/*hash=*/2));
+  EXPECT_FALSE(SnapshotExists(cache, /*hash=*/1));
+  EXPECT_TRUE(SnapshotExists(cache, /*hash=*/2));
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,325 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/tfrecord_index.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/raw_coding.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/statusor.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+constexpr absl::string_view kMagic = "TFRIDX01";
+constexpr size_t kHeaderBytes = 16;
+
+absl::Status ReadHeader(const std::string& index_filename,
+                        RandomAccessFile* file, int64_t* num_records) {
+  char scratch[kHeaderBytes];
+  absl::string_view header;
+  absl::Status s = file->Read(/*offset=*/0, kHeaderBytes, &header, scratch);
+  if (!s.ok() && !errors::IsOutOfRange(s)) {
+    return s;
+  }
+  if (header.size() != kHeaderBytes ||
+      header.substr(0, kMagic.size()) != kMagic) {
+    return errors::DataLoss(index_filename, " is not a TFRecord index.");
+  }
+  *num_records = static_cast<int64_t>(core::DecodeFixed64(header.data() + 8));
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+std::string TFRecordIndexFilename(absl::string_view filename) {
+  return absl::StrCat(filename, kTFRecordIndexSuffix);
+}
+
+absl::Status WriteTFRecordIndex(Env* env, const std::string& filename) {
+  std::unique_ptr<RandomAccessFile> file;
+  TF_RETURN_IF_ERROR(env->NewRandomAccessFile(filename, &file));
+  io::SequentialRecordReader reader(
+      file.get(), io::RecordReaderOptions::CreateRecordReaderOptions(
+                      /*compression_type=*/""));
+  std::string offsets;
+  int64_t num_records = 0;
+  while (true) {
+    core::PutFixed64(&offsets, reader.TellOffset());
+    int num_skipped;
+    absl::Status s = reader.SkipRecords(/*num_to_skip=*/1, &num_skipped);
+    if (errors::IsOutOfRange(s)) {
+      break;
+    }
+    TF_RETURN_IF_ERROR(s);
+    ++num_records;
+  }
+
+  std::string contents(kMagic);
+  core::PutFixed64(&contents, num_records);
+  absl::StrAppend(&contents, offsets);
+  core::PutFixed32(&contents,
+                   crc32c::Mask(crc32c::Value(offsets.data(), offsets.size())));
+  const std::string index_filename = TFRecordIndexFilename(filename);
+  const std::string tmp_filename = absl::StrCat(index_filename, ".tmp");
+  TF_RETURN_IF_ERROR(WriteStringToFile(env, tmp_filename, contents));
+  return env->RenameFile(tmp_filename, index_filename);
+}
+
+absl::StatusOr<int64_t> ReadTFRecordIndexSize(Env* env,
+                                              const std::string& filename) {
+  const std::string index_filename = TFRecordIndexFilename(filename);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_RETURN_IF_ERROR(env->NewRandomAccessFile(index_filename, &file));
+  int64_t num_records;
+  TF_RETURN_IF_ERROR(ReadHeader(index_filename, file.get(), &num_records));
+  return num_records;
+}
+
+absl::Status ReadTFRecordIndex(Env* env, const std::string& filename,
+                               std::vector<uint64_t>* offsets) {
+  const std::string index_filename = TFRecordIndexFilename(filename);
+  std::string contents;
+  TF_RETURN_IF_ERROR(ReadFileToString(env, index_filename, &contents));
+  if (contents.size() < kHeaderBytes ||
+      absl::string_view(contents).substr(0, kMagic.size()) != kMagic) {
+    return errors::DataLoss(index_filename, " is not a TFRecord index.");
+  }
+  const uint64_t num_offsets =
+      core::DecodeFixed64(contents.data() + kMagic.size()) + 1;
+  const size_t offsets_bytes = num_offsets * sizeof(uint64_t);
+  if (contents.size() != kHeaderBytes + offsets_bytes + sizeof(uint32_t)) {
+    return errors::DataLoss("Truncated TFRecord index ", index_filename);
+  }
+  const char* data = contents.data() + kHeaderBytes;
+  const uint32_t masked_crc = core::DecodeFixed32(data + offsets_bytes);
+  if (crc32c::Unmask(masked_crc) != crc32c::Value(data, offsets_bytes)) {
+    return errors::DataLoss("Corrupted TFRecord index ", index_filename);
+  }
+  offsets->resize(num_offsets);
+  for (uint64_t i = 0; i < num_offsets; ++i) {
+    (*offsets)[i] = core::DecodeFixed64(data + i * sizeof(uint64_t));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ParseTFRecord(absl::string_view bytes, tstring* record) {
+  constexpr size_t kHeaderSize = io::RecordReader::kHeaderSize;
+  constexpr size_t kFooterSize = io::RecordReader::kFooterSize;
+  if (bytes.size() < kHeaderSize + kFooterSize) {
+    return errors::DataLoss("Truncated TFRecord of ", bytes.size(), " bytes.");
+  }
+  const uint64_t length = core::DecodeFixed64(bytes.data());
+  if (crc32c::Unmask(core::DecodeFixed32(bytes.data() + sizeof(uint64_t))) !=
+      crc32c::Value(bytes.data(), sizeof(uint64_t))) {
+    return errors::DataLoss("Corrupted TFRecord header.");
+  }
+  if (bytes.size() != kHeaderSize + length + kFooterSize) {
+    return errors::DataLoss("TFRecord of ", length, " bytes doesn't match ",
+                            "its indexed size of ", bytes.size(), " bytes.");
+  }
+  const char* data = bytes.data() + kHeaderSize;
+  if (crc32c::Unmask(core::DecodeFixed32(data + length)) !=
+      crc32c::Value(data, length)) {
+    return errors::DataLoss("Corrupted TFRecord.");
+  }
+  record->assign(data, length);
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::unique_ptr<IndexedTFRecordReader>>
+IndexedTFRecordReader::Create(Env* env, std::vector<std::string> filenames,
+                              int64_t max_index_bytes,
+                              int64_t max_open_files) {
+  std::vector<int64_t> cumulative_records = {0};
+  cumulative_records.reserve(filenames.size() + 1);
+  for (const std::string& filename : filenames) {
+    TF_ASSIGN_OR_RETURN(int64_t num_records,
+                        ReadTFRecordIndexSize(env, filename));
+    cumulative_records.push_back(cumulative_records.back() + num_records);
+  }
+  return absl::WrapUnique(new IndexedTFRecordReader(
+      env, std::move(filenames), std::move(cumulative_records),
+      max_index_bytes, max_open_files));
+}
+
+IndexedTFRecordReader::IndexedTFRecordReader(
+    Env* env, std::vector<std::string> filenames,
+    std::vector<int64_t> cumulative_records, int64_t max_index_bytes,
+    int64_t max_open_files)
+    : env_(env),
+      filenames_(std::move(filenames)),
+      cumulative_records_(std::move(cumulative_records)),
+      max_index_bytes_(max_index_bytes),
+      max_open_files_(max_open_files) {}
+
+absl::Status IndexedTFRecordReader::Read(
+    absl::Span<const int64_t> indices, std::vector<tstring>* records,
+    std::function<void(std::function<void()>)>* runner) {
+  struct Request {
+    int64_t file_index;
+    uint64_t start;
+    uint64_t end;
+    size_t position;
+  };
+  std::vector<Request> requests;
+  requests.reserve(indices.size());
+  // Keeps the files open until the reads complete, even if they are closed
+  // by the reader in between.
+  absl::flat_hash_map<int64_t, std::shared_ptr<RandomAccessFile>> files;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    const int64_t index = indices[i];
+    if (index < 0 || index >= num_records()) {
+      return errors::OutOfRange("Index out of range [0, ", num_records(),
+                                "):", index);
+    }
+    const int64_t file_index =
+        std::upper_bound(cumulative_records_.begin(), cumulative_records_.end(),
+                         index) -
+        cumulative_records_.begin() - 1;
+    TF_ASSIGN_OR_RETURN(OpenFile file, GetFile(file_index));
+    files[file_index] = std::move(file.file);
+    const int64_t record = index - cumulative_records_[file_index];
+    requests.push_back({file_index, (*file.offsets)[record],
+                        (*file.offsets)[record + 1], i});
+  }
+
+  // Coalesces the requests into reads of consecutive ranges of the files.
+  std::sort(requests.begin(), requests.end(),
+            [](const Request& a, const Request& b) {
+              return std::make_pair(a.file_index, a.start) <
+                     std::make_pair(b.file_index, b.start);
+            });
+  struct CoalescedRead {
+    int64_t file_index;
+    uint64_t start;
+    uint64_t end;
+    std::vector<const Request*> requests;
+  };
+  std::vector<CoalescedRead> reads;
+  for (const Request& request : requests) {
+    if (!reads.empty() && reads.back().file_index == request.file_index &&
+        request.start <= reads.back().end + kMaxGapBytes &&
+        request.end - reads.back().start <= kMaxReadBytes) {
+      reads.back().end = std::max(reads.back().end, request.end);
+      reads.back().requests.push_back(&request);
+      continue;
+    }
+    reads.push_back(
+        {request.file_index, request.start, request.end, {&request}});
+  }
+
+  records->clear();
+  records->resize(indices.size());
+  auto read_fn = [&](const CoalescedRead& read) -> absl::Status {
+    const size_t n = read.end - read.start;
+    auto scratch = std::make_unique<char[]>(n);
+    absl::string_view result;
+    absl::Status s =
+        files.at(read.file_index)->Read(read.start, n, &result, scratch.get());
+    if (!s.ok() && !errors::IsOutOfRange(s)) {
+      return s;
+    }
+    if (result.size() != n) {
+      return errors::DataLoss("Truncated read of ", n, " bytes at offset ",
+                              read.start, " of ", filenames_[read.file_index]);
+    }
+    for (const Request* request : read.requests) {
+      TF_RETURN_IF_ERROR(ParseTFRecord(
+          result.substr(request->start - read.start,
+                        request->end - request->start),
+          &(*records)[request->position]));
+    }
+    return absl::OkStatus();
+  };
+  if (runner == nullptr || reads.size() == 1) {
+    for (const CoalescedRead& read : reads) {
+      TF_RETURN_IF_ERROR(read_fn(read));
+    }
+    return absl::OkStatus();
+  }
+  std::vector<absl::Status> statuses(reads.size());
+  BlockingCounter counter(reads.size());
+  for (size_t i = 0; i < reads.size(); ++i) {
+    (*runner)([&, i]() {
+      statuses[i] = read_fn(reads[i]);
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+  for (const absl::Status& s : statuses) {
+    TF_RETURN_IF_ERROR(s);
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<IndexedTFRecordReader::OpenFile>
+IndexedTFRecordReader::GetFile(int64_t file_index) {
+  mutex_lock l(mu_);
+  auto it = files_.find(file_index);
+  if (it != files_.end()) {
+    lru_.splice(lru_.end(), lru_, it->second.lru_position);
+    return it->second.open_file;
+  }
+
+  const std::string& filename = filenames_[file_index];
+  std::unique_ptr<RandomAccessFile> file;
+  TF_RETURN_IF_ERROR(env_->NewRandomAccessFile(filename, &file));
+  auto offsets = std::make_shared<std::vector<uint64_t>>();
+  TF_RETURN_IF_ERROR(ReadTFRecordIndex(env_, filename, offsets.get()));
+  const int64_t num_records =
+      cumulative_records_[file_index + 1] - cumulative_records_[file_index];
+  uint64 file_size;
+  TF_RETURN_IF_ERROR(env_->GetFileSize(filename, &file_size));
+  if (offsets->size() != num_records + 1 || offsets->back() != file_size) {
+    return errors::FailedPrecondition(
+        "The index of ", filename, " is out of date. Rebuild it with ",
+        "`bazel run //tensorflow/core/data:tfrecord_indexer -- --files=",
+        filename, "`.");
+  }
+  OpenFile open_file{std::move(file), std::move(offsets)};
+  files_[file_index] = {open_file, lru_.insert(lru_.end(), file_index)};
+  index_bytes_ += open_file.offsets->size() * sizeof(uint64_t);
+  while ((index_bytes_ > max_index_bytes_ || lru_.size() > max_open_files_) &&
+         lru_.size() > 1) {
+    const OpenFile& evicted = files_.at(lru_.front()).open_file;
+    index_bytes_ -= evicted.offsets->size() * sizeof(uint64_t);
+    files_.erase(lru_.front());
+    lru_.pop_front();
+  }
+  return open_file;
+}
+
+}  // namespace data
+}  // namespace tensorflow
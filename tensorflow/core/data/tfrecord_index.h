@@ -0,0 +1,135 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_TFRECORD_INDEX_H_
+#define TENSORFLOW_CORE_DATA_TFRECORD_INDEX_H_
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/tstring.h"
+
+namespace tensorflow {
+namespace data {
+
+// Sidecar indexes give random access to the records of uncompressed TFRecord
+// files. The index of `<file>` is stored in `<file>.tfrecord_index` as:
+//
+//   magic: "TFRIDX01"
+//   fixed64: number of records N
+//   (N + 1) x fixed64: offset of each record, followed by the size of the file
+//   fixed32: masked crc32c of the offsets
+//
+// Records are located without reading the index in full, which is only loaded
+// when one of its records is read.
+constexpr char kTFRecordIndexSuffix[] = ".tfrecord_index";
+
+// Returns the name of the index of the TFRecord file `filename`.
+std::string TFRecordIndexFilename(absl::string_view filename);
+
+// Scans the uncompressed TFRecord file `filename` and writes its index.
+absl::Status WriteTFRecordIndex(Env* env, const std::string& filename);
+
+// Reads the number of records from the index of `filename`.
+absl::StatusOr<int64_t> ReadTFRecordIndexSize(Env* env,
+                                              const std::string& filename);
+
+// Reads the offsets of the records of `filename` from its index, followed by
+// the size of `filename`.
+absl::Status ReadTFRecordIndex(Env* env, const std::string& filename,
+                               std::vector<uint64_t>* offsets);
+
+// Parses `bytes` holding a record, including its header and footer, as
+// written by `io::RecordWriter`.
+absl::Status ParseTFRecord(absl::string_view bytes, tstring* record);
+
+// Reads records of indexed TFRecord files by their position in the files. To
+// limit the number of I/O operations, reads of records close to each other in
+// a file are coalesced. Thread-safe.
+class IndexedTFRecordReader {
+ public:
+  // Reads of records less than `kMaxGapBytes` apart are coalesced, as long as
+  // the coalesced read is smaller than `kMaxReadBytes`.
+  static constexpr int64_t kMaxGapBytes = 64 << 10;
+  static constexpr int64_t kMaxReadBytes = 16 << 20;
+
+  // Reads the number of records of each file. A file is opened and the
+  // offsets of its records are loaded when first needed, and the least
+  // recently used files are closed when their offsets take more than
+  // `max_index_bytes`, or when more than `max_open_files` files are open.
+  static absl::StatusOr<std::unique_ptr<IndexedTFRecordReader>> Create(
+      Env* env, std::vector<std::string> filenames,
+      int64_t max_index_bytes = 256 << 20, int64_t max_open_files = 256);
+
+  int64_t num_records() const { return cumulative_records_.back(); }
+
+  // Reads the records at the given positions. If `runner` is not null, the
+  // reads are issued in parallel on it.
+  absl::Status Read(absl::Span<const int64_t> indices,
+                    std::vector<tstring>* records,
+                    std::function<void(std::function<void()>)>* runner =
+                        nullptr);
+
+ private:
+  // An open file and the offsets of its records. Shared with the reads in
+  // flight, so that closing the file doesn't wait for them.
+  struct OpenFile {
+    std::shared_ptr<RandomAccessFile> file;
+    std::shared_ptr<const std::vector<uint64_t>> offsets;
+  };
+
+  struct File {
+    OpenFile open_file;
+    // Position in `lru_`.
+    std::list<int64_t>::iterator lru_position;
+  };
+
+  IndexedTFRecordReader(Env* env, std::vector<std::string> filenames,
+                        std::vector<int64_t> cumulative_records,
+                        int64_t max_index_bytes, int64_t max_open_files);
+
+  // Opens the file with `file_index` and loads its offsets if needed.
+  absl::StatusOr<OpenFile> GetFile(int64_t file_index);
+
+  Env* const env_;
+  const std::vector<std::string> filenames_;
+  // Number of records in the files before each file, and in total.
+  const std::vector<int64_t> cumulative_records_;
+  const int64_t max_index_bytes_;
+  const int64_t max_open_files_;
+
+  mutex mu_;
+  // Open files by index.
+  absl::flat_hash_map<int64_t, File> files_ TF_GUARDED_BY(mu_);
+  // Indexes of the open files, least recently used first.
+  std::list<int64_t> lru_ TF_GUARDED_BY(mu_);
+  int64_t index_bytes_ TF_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_TFRECORD_INDEX_H_
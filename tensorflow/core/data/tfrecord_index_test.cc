@@ -0,0 +1,204 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/tfrecord_index.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::testing::ElementsAre;
+
+std::string Record(int64_t file_index, int64_t record_index) {
+  return absl::StrCat("record_", file_index, "_", record_index);
+}
+
+// Writes `num_records` records to a new TFRecord file and returns its name.
+std::string WriteRecords(int64_t file_index, int64_t num_records) {
+  std::string filename;
+  EXPECT_TRUE(Env::Default()->LocalTempFilename(&filename));
+  std::unique_ptr<WritableFile> file;
+  TF_CHECK_OK(Env::Default()->NewWritableFile(filename, &file));
+  io::RecordWriter writer(file.get());
+  for (int64_t i = 0; i < num_records; ++i) {
+    TF_CHECK_OK(writer.WriteRecord(Record(file_index, i)));
+  }
+  TF_CHECK_OK(writer.Close());
+  TF_CHECK_OK(file->Close());
+  return filename;
+}
+
+TEST(TFRecordIndexTest, WriteAndReadIndex) {
+  const std::string filename = WriteRecords(/*file_index=*/0, 3);
+  TF_ASSERT_OK(WriteTFRecordIndex(Env::Default(), filename));
+  TF_ASSERT_OK_AND_ASSIGN(int64_t num_records,
+                          ReadTFRecordIndexSize(Env::Default(), filename));
+  EXPECT_EQ(num_records, 3);
+
+  std::vector<uint64_t> offsets;
+  TF_ASSERT_OK(ReadTFRecordIndex(Env::Default(), filename, &offsets));
+  uint64 file_size;
+  TF_ASSERT_OK(Env::Default()->GetFileSize(filename, &file_size));
+  ASSERT_EQ(offsets.size(), 4);
+  EXPECT_EQ(offsets.front(), 0);
+  EXPECT_EQ(offsets.back(), file_size);
+}
+
+TEST(TFRecordIndexTest, EmptyFile) {
+  const std::string filename = WriteRecords(/*file_index=*/0, 0);
+  TF_ASSERT_OK(WriteTFRecordIndex(Env::Default(), filename));
+  TF_ASSERT_OK_AND_ASSIGN(int64_t num_records,
+                          ReadTFRecordIndexSize(Env::Default(), filename));
+  EXPECT_EQ(num_records, 0);
+}
+
+TEST(TFRecordIndexTest, CorruptedIndex) {
+  const std::string filename = WriteRecords(/*file_index=*/0, 3);
+  TF_ASSERT_OK(WriteTFRecordIndex(Env::Default(), filename));
+  std::string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), TFRecordIndexFilename(filename),
+                                &contents));
+  contents[20] ^= 1;
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(),
+                                 TFRecordIndexFilename(filename), contents));
+  std::vector<uint64_t> offsets;
+  EXPECT_TRUE(errors::IsDataLoss(
+      ReadTFRecordIndex(Env::Default(), filename, &offsets)));
+}
+
+TEST(TFRecordIndexTest, CorruptedRecord) {
+  const std::string filename = WriteRecords(/*file_index=*/0, 1);
+  std::string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), filename, &contents));
+  tstring record;
+  TF_ASSERT_OK(ParseTFRecord(contents, &record));
+  EXPECT_EQ(record, Record(0, 0));
+
+  contents[contents.size() - 5] ^= 1;
+  EXPECT_TRUE(errors::IsDataLoss(ParseTFRecord(contents, &record)));
+  EXPECT_TRUE(errors::IsDataLoss(
+      ParseTFRecord(absl::string_view(contents).substr(0, 4), &record)));
+}
+
+class IndexedTFRecordReaderTest : public ::testing::TestWithParam<bool> {
+ protected:
+  std::function<void(std::function<void()>)>* runner() {
+    if (!GetParam()) {
+      return nullptr;
+    }
+    return &runner_;
+  }
+
+ private:
+  thread::ThreadPool pool_{Env::Default(), "test", /*num_threads=*/4};
+  std::function<void(std::function<void()>)> runner_ =
+      [this](std::function<void()> fn) { pool_.Schedule(std::move(fn)); };
+};
+
+TEST_P(IndexedTFRecordReaderTest, ReadsAcrossFiles) {
+  std::vector<std::string> filenames = {WriteRecords(/*file_index=*/0, 3),
+                                        WriteRecords(/*file_index=*/1, 0),
+                                        WriteRecords(/*file_index=*/2, 2)};
+  for (const std::string& filename : filenames) {
+    TF_ASSERT_OK(WriteTFRecordIndex(Env::Default(), filename));
+  }
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<IndexedTFRecordReader> reader,
+      IndexedTFRecordReader::Create(Env::Default(), filenames));
+  EXPECT_EQ(reader->num_records(), 5);
+
+  std::vector<tstring> records;
+  TF_ASSERT_OK(reader->Read({4, 0, 2, 3, 2}, &records, runner()));
+  EXPECT_THAT(records, ElementsAre(Record(2, 1), Record(0, 0), Record(0, 2),
+                                   Record(2, 0), Record(0, 2)));
+  EXPECT_TRUE(errors::IsOutOfRange(reader->Read({5}, &records, runner())));
+}
+
+TEST_P(IndexedTFRecordReaderTest, EvictsLeastRecentlyUsedIndexes) {
+  std::vector<std::string> filenames = {WriteRecords(/*file_index=*/0, 10),
+                                        WriteRecords(/*file_index=*/1, 10)};
+  for (const std::string& filename : filenames) {
+    TF_ASSERT_OK(WriteTFRecordIndex(Env::Default(), filename));
+  }
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<IndexedTFRecordReader> reader,
+      IndexedTFRecordReader::Create(Env::Default(), filenames,
+                                    /*max_index_bytes=*/1));
+  std::vector<tstring> records;
+  for (int64_t i = 0; i < 20; i += 3) {
+    TF_ASSERT_OK(reader->Read({i, 19 - i}, &records, runner()));
+    EXPECT_THAT(records, ElementsAre(Record(i / 10, i % 10),
+                                     Record((19 - i) / 10, (19 - i) % 10)));
+  }
+}
+
+TEST_P(IndexedTFRecordReaderTest, ClosesLeastRecentlyUsedFiles) {
+  std::vector<std::string> filenames = {WriteRecords(/*file_index=*/0, 10),
+                                        WriteRecords(/*file_index=*/1, 10),
+                                        WriteRecords(/*file_index=*/2, 10)};
+  for (const std::string& filename : filenames) {
+    TF_ASSERT_OK(WriteTFRecordIndex(Env::Default(), filename));
+  }
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<IndexedTFRecordReader> reader,
+      IndexedTFRecordReader::Create(Env::Default(), filenames,
+                                    /*max_index_bytes=*/256 << 20,
+                                    /*max_open_files=*/2));
+  std::vector<tstring> records;
+  for (int64_t i = 0; i < 30; i += 4) {
+    TF_ASSERT_OK(reader->Read({i, 29 - i, (i + 10) % 30}, &records, runner()));
+    EXPECT_THAT(records, ElementsAre(Record(i / 10, i % 10),
+                                     Record((29 - i) / 10, (29 - i) % 10),
+                                     Record((i + 10) % 30 / 10, i % 10)));
+  }
+}
+
+TEST_P(IndexedTFRecordReaderTest, DetectsOutOfDateIndex) {
+  const std::string filename = WriteRecords(/*file_index=*/0, 3);
+  TF_ASSERT_OK(WriteTFRecordIndex(Env::Default(), filename));
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<IndexedTFRecordReader> reader,
+      IndexedTFRecordReader::Create(Env::Default(), {filename}));
+  std::unique_ptr<WritableFile> file;
+  TF_ASSERT_OK(Env::Default()->NewAppendableFile(filename, &file));
+  io::RecordWriter writer(file.get());
+  TF_ASSERT_OK(writer.WriteRecord("appended"));
+  TF_ASSERT_OK(writer.Close());
+  TF_ASSERT_OK(file->Close());
+
+  std::vector<tstring> records;
+  EXPECT_TRUE(
+      errors::IsFailedPrecondition(reader->Read({0}, &records, runner())));
+}
+
+INSTANTIATE_TEST_SUITE_P(Parallel, IndexedTFRecordReaderTest,
+                         ::testing::Bool());
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,74 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+// Writes the indexes that enable random access to uncompressed TFRecord files
+// (e.g. for `TFRecordDataset` with `global_shuffle`):
+//
+//   tfrecord_indexer --files=/path/to/data-*.tfrecord
+//
+// Every file matching one of the comma-separated patterns gets a
+// `<file>.tfrecord_index` next to it. Indexes must be rebuilt when the files
+// change.
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_split.h"
+#include "tensorflow/core/data/tfrecord_index.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/command_line_flags.h"
+
+int main(int argc, char** argv) {
+  std::string files;
+  std::vector<tensorflow::Flag> flag_list = {
+      tensorflow::Flag("files", &files,
+                       "Comma-separated file patterns of the uncompressed "
+                       "TFRecord files to index."),
+  };
+  bool parse_result = tensorflow::Flags::Parse(&argc, argv, flag_list);
+  if (!parse_result || files.empty()) {
+    std::cerr << tensorflow::Flags::Usage(argv[0], flag_list);
+    return -1;
+  }
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+
+  tensorflow::Env* env = tensorflow::Env::Default();
+  int num_indexed = 0;
+  std::vector<std::string> patterns =
+      absl::StrSplit(files, ',', absl::SkipEmpty());
+  for (const std::string& pattern : patterns) {
+    std::vector<std::string> filenames;
+    tensorflow::Status status = env->GetMatchingPaths(pattern, &filenames);
+    if (!status.ok()) {
+      LOG(ERROR) << "Failed to match " << pattern << ": " << status;
+      return 1;
+    }
+    if (filenames.empty()) {
+      LOG(ERROR) << "No files match " << pattern;
+      return 1;
+    }
+    for (const std::string& filename : filenames) {
+      status = tensorflow::data::WriteTFRecordIndex(env, filename);
+      if (!status.ok()) {
+        LOG(ERROR) << "Failed to index " << filename << ": " << status;
+        return 1;
+      }
+      ++num_indexed;
+    }
+  }
+  LOG(INFO) << "Indexed " << num_indexed << " TFRecord files.";
+  return 0;
+}
@@ -198,6 +198,12 @@ auto* tf_data_iterator_gap_msec_histogram = tsl::monitoring::Sampler<0>::New(
 auto* tf_data_optimization_counter = tsl::monitoring::Counter<1>::New(
     "/tensorflow/data/optimization", "tf.data optimization", "name");
 
+auto* tf_data_vectorized_map_counter = tsl::monitoring::Counter<1>::New(
+    "/tensorflow/data/vectorized_map",
+    "The number of micro-batches and of elements mapped at once by tf.data "
+    "map transformations.",
+    "type");
+
 auto* tf_data_service_workers_created_counter =
     tsl::monitoring::Counter<0>::New(
         "/tensorflow/data/service/workers_created",
@@ -608,6 +614,15 @@ void RecordTFDataOptimization(const string& name, int64_t num_changes) {
   tf_data_optimization_counter->GetCell(name)->IncrementBy(num_changes);
 }
 
+void RecordTFDataVectorizedMap(int64_t num_elements) {
+  static auto* batches_cell =
+      tf_data_vectorized_map_counter->GetCell("batches");
+  static auto* elements_cell =
+      tf_data_vectorized_map_counter->GetCell("elements");
+  batches_cell->IncrementBy(1);
+  elements_cell->IncrementBy(num_elements);
+}
+
 void RecordTFDataServiceWorkerCreated() {
   tf_data_service_workers_created_counter->GetCell()->IncrementBy(1);
 }
@@ -144,6 +144,10 @@ void RecordTFDataIteratorGap(uint64 duration_us);
 // The `name` argument identifies the optimization (e.g. "noop_elimination").
 void RecordTFDataOptimization(const string& name, int64_t num_changes);
 
+// Records that a tf.data map transformation applied its function to a
+// micro-batch of `num_elements` elements at once.
+void RecordTFDataVectorizedMap(int64_t num_elements);
+
 // Records that a tf.data service worker has been created.
 void RecordTFDataServiceWorkerCreated();
 
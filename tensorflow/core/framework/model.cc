@@ -64,6 +64,12 @@ constexpr double kBufferDownsizeMultipliter = 0.9;
 // Threshold of low buffer watermark before a buffer is a candidate for
 // upsizing.
 constexpr int64_t kBufferLowWatermarkThreshold = 2;
+// In cost-based optimization, a thread is only given to a stage if it shortens
+// the stage by at least this fraction.
+constexpr double kCostBasedMinMarginalGain = 0.05;
+// In cost-based optimization, the current allocation is kept unless the new one
+// is faster, or uses fewer threads, by at least this fraction.
+constexpr double kCostBasedMinRelativeChange = 0.1;
 
 constexpr char kDataService[] = "DataService";
 constexpr char kFlatMap[] = "FlatMap";
@@ -206,6 +212,23 @@ class NodeParallelismParameters {
   absl::flat_hash_map<const Node*, Parameter*> node_parallelism_;
 };
 
+// Returns the time it takes the slowest stage of the pipeline to produce the
+// elements needed to produce one element at the root of the pipeline.
+double SlowestStageTimeNsec(const ModelTiming& model_timing) {
+  double slowest_stage_time_nsec = 0.0;
+  for (const auto& root : model_timing.GetStageRoots()) {
+    const ModelTiming::NodeTiming* root_timing =
+        model_timing.GetTiming(root.get());
+    if (root_timing == nullptr) {
+      continue;
+    }
+    slowest_stage_time_nsec =
+        std::max(slowest_stage_time_nsec,
+                 root_timing->total_time_nsec * root_timing->pipeline_ratio);
+  }
+  return slowest_stage_time_nsec;
+}
+
 // Replaces `\[[0-9].+\]` with `\[\]`.
 std::string RemoveArrayIndices(absl::string_view s) {
   absl::string_view::size_type start_pos = 0;
@@ -2403,12 +2426,19 @@ void Model::Optimize(AutotuneAlgorithm algorithm,
       OptimizeStageBased(snapshot, optimization_params, cancellation_manager,
                          ram_budget_manager);
       break;
+    case AutotuneAlgorithm::COST_BASED:
+      OptimizeCostBased(snapshot, optimization_params, cancellation_manager,
+                        ram_budget_manager);
+      break;
     default:
       VLOG(2) << "Autotuning algorithm was not recognized. Aborting "
                  "optimization.";
       return;
   }
-  if (experiments_.contains("autotune_buffer_optimization")) {
+  // Cost-based optimization leaves the buffer sizes to the buffer optimization,
+  // which gets the RAM budget its parallelism parameters didn't use.
+  if (algorithm == AutotuneAlgorithm::COST_BASED ||
+      experiments_.contains("autotune_buffer_optimization")) {
     OptimizeBuffers(snapshot, optimization_params.ram_budget());
   }
   {
@@ -2574,10 +2604,11 @@ Status Model::OptimizeLoop(AutotuneAlgorithm algorithm,
     int64_t start_ms = EnvTime::NowMicros() / EnvTime::kMillisToMicros;
     double model_input_time = 0.0;
     // Model input time is set to 0 for all optimization algorithms except for
-    // stage-based optimization algorithm for historical reason. In stage-based
-    // optimization algorithm, the model input time is used as a target
+    // stage-based and cost-based optimization algorithms for historical reason.
+    // In these algorithms, the model input time is used as a target
     // optimization time of all stages in the pipeline.
-    if (algorithm == AutotuneAlgorithm::STAGE_BASED) {
+    if (algorithm == AutotuneAlgorithm::STAGE_BASED ||
+        algorithm == AutotuneAlgorithm::COST_BASED) {
       model_input_time = ComputeTargetTimeNsec();
     }
     Optimize(algorithm, cpu_budget_func, ram_budget_share, fixed_ram_budget,
@@ -3020,6 +3051,143 @@ void Model::OptimizeStageBasedNonAsyncInterleaveManyNodes(
   }
 }
 
+void Model::OptimizeCostBased(std::shared_ptr<Node> snapshot,
+                              const OptimizationParams& optimization_params,
+                              CancellationManager* cancellation_manager,
+                              RamBudgetManager& ram_budget_manager) {
+  VLOG(2) << "Starting optimization of tunable parameters with Cost-Based "
+             "optimization with a target time of "
+          << optimization_params.model_input_time() << " nanoseconds.";
+  Node::NodeVector all_nodes =
+      snapshot->CollectNodes(TraversalOrder::BFS, IsAnyNode);
+  all_nodes.push_back(snapshot);
+  Node::ModelParameters parallelism_parameters;
+  for (const auto& node : all_nodes) {
+    for (auto& pair : node->CollectNodeTunableParameters()) {
+      if (pair.second->name == kParallelism) {
+        parallelism_parameters.push_back(std::move(pair));
+      }
+    }
+  }
+  if (parallelism_parameters.empty()) {
+    metrics::RecordTFDataAutotuneStoppingCriteria("no_optimizable_parameter");
+    return;
+  }
+
+  // Records the current allocation, i.e. the state values the pipeline runs
+  // with. It is kept unless the new one is clearly better so that noise in the
+  // measured processing times doesn't make the allocation oscillate.
+  std::vector<double> current_values;
+  double current_threads = 0.0;
+  for (auto& pair : parallelism_parameters) {
+    Parameter& parameter = *pair.second;
+    {
+      mutex_lock l(*parameter.state->mu);
+      parameter.value =
+          std::clamp<double>(parameter.state->value, parameter.min,
+                             parameter.max);
+    }
+    current_values.push_back(parameter.value);
+    current_threads += parameter.value;
+  }
+  const double current_time_nsec = SlowestStageTimeNsec(ModelTiming(snapshot));
+  const double current_bytes = TotalMaximumBufferedBytes(snapshot);
+
+  // Starting from the minimal parallelism, repeatedly gives a thread to the
+  // slowest stage as long as it shortens the stage enough and the CPU and RAM
+  // budgets allow it. The stage times are modeled from the measured processing
+  // time per element of their nodes, divided by their parallelism.
+  double threads = 0.0;
+  for (auto& pair : parallelism_parameters) {
+    pair.second->value = pair.second->min;
+    threads += pair.second->value;
+  }
+  ModelTiming model_timing(snapshot);
+  ModelTimingPriorityQueue priority_queue(model_timing);
+  NodeParallelismParameters node_parallelism;
+  std::string stopping_criteria = "empty_critical_queue";
+  while (true) {
+    if (cancellation_manager->IsCancelled()) {
+      // The allocation is incomplete, so leave the state values unchanged.
+      return;
+    }
+    absl::StatusOr<std::pair<double, Node*>> critical_root_status =
+        priority_queue.PopSlowestStageRoot();
+    if (!critical_root_status.ok()) {
+      break;
+    }
+    const auto [stage_time_nsec, stage_root] = critical_root_status.value();
+    // Removes the `<index>` of `[<index>]` to reduce the number of labels.
+    const std::string stage_name = RemoveArrayIndices(stage_root->long_name());
+    if (stage_time_nsec <= optimization_params.model_input_time()) {
+      stopping_criteria = "target_time_reached";
+      break;
+    }
+    Parameter* parallelism_parameter = node_parallelism.Get(stage_root);
+    if (parallelism_parameter == nullptr) {
+      stopping_criteria = strings::StrCat("no_optimizable_parameter:",
+                                          stage_name);
+      break;
+    }
+    if (parallelism_parameter->value >= parallelism_parameter->max) {
+      stopping_criteria = strings::StrCat("parameter_max_exceeded:",
+                                          stage_name);
+      break;
+    }
+    if (threads + 1.0 > optimization_params.cpu_budget()) {
+      stopping_criteria = "cpu_budget_exceeded";
+      break;
+    }
+    parallelism_parameter->value += 1.0;
+    model_timing.ComputeNodeTotalTime(*stage_root);
+    const ModelTiming::NodeTiming* root_timing =
+        model_timing.GetTiming(stage_root);
+    const double new_stage_time_nsec =
+        root_timing->total_time_nsec * root_timing->pipeline_ratio;
+    if (stage_time_nsec - new_stage_time_nsec <
+        kCostBasedMinMarginalGain * stage_time_nsec) {
+      stopping_criteria =
+          strings::StrCat("marginal_gain_too_small:", stage_name);
+    } else if (TotalMaximumBufferedBytes(snapshot) >
+               optimization_params.ram_budget()) {
+      stopping_criteria = strings::StrCat("ram_budget_exceeded:", stage_name);
+    } else {
+      threads += 1.0;
+      priority_queue.Push(stage_root, *root_timing);
+      continue;
+    }
+    parallelism_parameter->value -= 1.0;
+    model_timing.ComputeNodeTotalTime(*stage_root);
+    break;
+  }
+  metrics::RecordTFDataAutotuneStoppingCriteria(stopping_criteria);
+
+  const double new_time_nsec = SlowestStageTimeNsec(model_timing);
+  const bool current_fits_budgets =
+      current_threads <= optimization_params.cpu_budget() &&
+      current_bytes <= optimization_params.ram_budget();
+  const bool faster =
+      new_time_nsec < (1.0 - kCostBasedMinRelativeChange) * current_time_nsec;
+  const bool cheaper =
+      threads < (1.0 - kCostBasedMinRelativeChange) * current_threads &&
+      new_time_nsec <= (1.0 + kCostBasedMinRelativeChange) * current_time_nsec;
+  if (current_fits_budgets && !faster && !cheaper) {
+    VLOG(2) << "Keeping the current allocation of " << current_threads
+            << " threads, whose slowest stage takes " << current_time_nsec
+            << " nanoseconds, over an allocation of " << threads
+            << " threads, whose slowest stage takes " << new_time_nsec
+            << " nanoseconds.";
+    for (int i = 0; i < parallelism_parameters.size(); ++i) {
+      parallelism_parameters[i].second->value = current_values[i];
+    }
+    return;
+  }
+  if (ram_budget_manager.RequestModelAllocation(
+          TotalMaximumBufferedBytes(snapshot))) {
+    UpdateStateValues(&parallelism_parameters);
+  }
+}
+
 void Model::OptimizeBuffers(std::shared_ptr<Node> snapshot,
                             int64_t ram_budget) {
   VLOG(2) << "Starting optimization of buffer_size parameters.";
@@ -1025,9 +1025,9 @@ class Model {
   // Records gap time between consecutive `GetNext()` calls.
   void RecordIteratorGapTime(uint64_t duration_usec);
 
-  // Computes the target time in nsecs to use for `STAGE_BASED` autotune
-  // algorithm. Returns 0 if there if there are not sufficient recorded iterator
-  // gap times to produce a good estimate.
+  // Computes the target time in nsecs to use for `STAGE_BASED` and
+  // `COST_BASED` autotune algorithms. Returns 0 if there if there are not
+  // sufficient recorded iterator gap times to produce a good estimate.
   double ComputeTargetTimeNsec();
 
   // Computes the target time in nsecs to use for estimating input bottlenecks.
@@ -1131,6 +1131,21 @@ class Model {
                           CancellationManager* cancellation_manager,
                           RamBudgetManager& ram_budget_manager);
 
+  // This optimization fits the time each stage takes to produce an element from
+  // the measured processing time of its nodes and its parallelism. Starting
+  // from the minimal parallelism, it then repeatedly gives a thread to the
+  // slowest stage until the slowest stage is faster than the target time, the
+  // thread no longer shortens it by a meaningful fraction, or the total
+  // parallelism or the maximum buffered bytes would exceed the CPU or RAM
+  // budget. The RAM budget left is then used by `OptimizeBuffers`. The current
+  // allocation is kept if it fits the budgets and the new one isn't clearly
+  // faster or cheaper, which keeps noisy measurements from making the
+  // allocation oscillate.
+  void OptimizeCostBased(std::shared_ptr<Node> snapshot,
+                         const OptimizationParams& optimization_params,
+                         CancellationManager* cancellation_manager,
+                         RamBudgetManager& ram_budget_manager);
+
   // This is the first part of the stage-based optimization that optimizes
   // tunable parallelism parameters for async interleave many nodes only. We
   // separately optimize async interleave many nodes more aggressively because
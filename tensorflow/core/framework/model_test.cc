@@ -21,9 +21,11 @@ limitations under the License.
 #include <functional>
 #include <memory>
 #include <optional>
+#include <random>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include "absl/status/status.h"
@@ -36,6 +38,7 @@ limitations under the License.
 #include "tensorflow/core/lib/monitoring/cell_reader.h"
 #include "tensorflow/core/platform/stringprintf.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 namespace data {
@@ -3158,6 +3161,155 @@ TEST_F(ModelTimingTest, OptimizeStageBased_PipelineRatioLessThanOne) {
   EXPECT_EQ(14, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
 }
 
+// Two parallel map stages: the first takes 620ns per element and the second
+// takes 700ns per element, plus 10ns for its synchronous input.
+constexpr char kTwoStagesModel[] = R"pb(
+  nodes: {
+    key: 1
+    value: {
+      id: 1
+      name: "ParallelMapV2"
+      autotune: true
+      num_elements: 100
+      processing_time: 62000
+      bytes_produced: 10000
+      node_class: ASYNC_KNOWN_RATIO
+      ratio: 1
+      inputs: 2
+      parameters: {
+        name: "parallelism"
+        value: 4
+        state_value: 4
+        min: 1
+        max: 16
+        tunable: true
+      }
+    }
+  }
+  nodes: {
+    key: 2
+    value: {
+      id: 2
+      name: "ParallelMapV2"
+      autotune: true
+      num_elements: 100
+      processing_time: 70000
+      bytes_produced: 10000
+      node_class: ASYNC_KNOWN_RATIO
+      ratio: 1
+      inputs: 3
+      parameters: {
+        name: "parallelism"
+        value: 4
+        state_value: 4
+        min: 1
+        max: 16
+        tunable: true
+      }
+    }
+  }
+  nodes: {
+    key: 3
+    value: {
+      id: 3
+      name: "SSTable"
+      autotune: true
+      num_elements: 100
+      processing_time: 1000
+      node_class: KNOWN_RATIO
+      ratio: 2
+    }
+  }
+  output: 1
+)pb";
+
+TEST_F(ModelTimingTest, OptimizeCostBased_CappedByCpuBudget) {
+  BuildModelFromProto(kTwoStagesModel);
+
+  CellReader<int64_t> cell_reader(
+      "/tensorflow/data/autotune_stopping_criteria");
+  CancellationManager cancellation_manager;
+  RamBudgetManager ram_budget_manager(0);
+  model_->Optimize(AutotuneAlgorithm::COST_BASED, CpuBudgetFunc(10),
+                   /*ram_budget_share=*/1.0,
+                   /*fixed_ram_budget=*/100000,
+                   /*model_input_time=*/0, ram_budget_manager,
+                   &cancellation_manager);
+
+  // Unlike stage-based optimization, the total parallelism stays within the
+  // CPU budget.
+  EXPECT_EQ(5, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+  EXPECT_EQ(5, GetNode(/*node_id=*/2)->parameter_value("parallelism"));
+  EXPECT_EQ(cell_reader.Delta("cpu_budget_exceeded"), 1);
+}
+
+TEST_F(ModelTimingTest, OptimizeCostBased_KeepsAllocationUnlessClearlyBetter) {
+  BuildModelFromProto(kTwoStagesModel);
+
+  CancellationManager cancellation_manager;
+  RamBudgetManager ram_budget_manager(0);
+  model_->Optimize(AutotuneAlgorithm::COST_BASED, CpuBudgetFunc(13),
+                   /*ram_budget_share=*/1.0,
+                   /*fixed_ram_budget=*/100000,
+                   /*model_input_time=*/0, ram_budget_manager,
+                   &cancellation_manager);
+  EXPECT_EQ(6, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+  EXPECT_EQ(7, GetNode(/*node_id=*/2)->parameter_value("parallelism"));
+
+  // With one more thread, the slowest stage would only be 6% faster.
+  model_->Optimize(AutotuneAlgorithm::COST_BASED, CpuBudgetFunc(14),
+                   /*ram_budget_share=*/1.0,
+                   /*fixed_ram_budget=*/100000,
+                   /*model_input_time=*/0, ram_budget_manager,
+                   &cancellation_manager);
+  EXPECT_EQ(6, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+  EXPECT_EQ(7, GetNode(/*node_id=*/2)->parameter_value("parallelism"));
+
+  model_->Optimize(AutotuneAlgorithm::COST_BASED, CpuBudgetFunc(20),
+                   /*ram_budget_share=*/1.0,
+                   /*fixed_ram_budget=*/100000,
+                   /*model_input_time=*/0, ram_budget_manager,
+                   &cancellation_manager);
+  EXPECT_EQ(9, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+  EXPECT_EQ(11, GetNode(/*node_id=*/2)->parameter_value("parallelism"));
+}
+
+TEST_F(ModelTimingTest, OptimizeCostBased_CappedByRamBudget) {
+  BuildModelFromProto(kTwoStagesModel);
+
+  CellReader<int64_t> cell_reader(
+      "/tensorflow/data/autotune_stopping_criteria");
+  CancellationManager cancellation_manager;
+  RamBudgetManager ram_budget_manager(0);
+  // Each thread buffers an element of 100 bytes, so the current parallelism
+  // doesn't fit the budget and is lowered instead of being kept.
+  model_->Optimize(AutotuneAlgorithm::COST_BASED, CpuBudgetFunc(10),
+                   /*ram_budget_share=*/1.0,
+                   /*fixed_ram_budget=*/500,
+                   /*model_input_time=*/0, ram_budget_manager,
+                   &cancellation_manager);
+  EXPECT_EQ(2, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+  EXPECT_EQ(3, GetNode(/*node_id=*/2)->parameter_value("parallelism"));
+  EXPECT_EQ(cell_reader.Delta("ram_budget_exceeded:ParallelMapV2(id:1)"), 1);
+}
+
+TEST_F(ModelTimingTest, OptimizeCostBased_TargetTimeReached) {
+  BuildModelFromProto(kTwoStagesModel);
+
+  CellReader<int64_t> cell_reader(
+      "/tensorflow/data/autotune_stopping_criteria");
+  CancellationManager cancellation_manager;
+  RamBudgetManager ram_budget_manager(0);
+  model_->Optimize(AutotuneAlgorithm::COST_BASED, CpuBudgetFunc(20),
+                   /*ram_budget_share=*/1.0,
+                   /*fixed_ram_budget=*/100000,
+                   /*model_input_time=*/200, ram_budget_manager,
+                   &cancellation_manager);
+  EXPECT_EQ(4, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+  EXPECT_EQ(4, GetNode(/*node_id=*/2)->parameter_value("parallelism"));
+  EXPECT_EQ(cell_reader.Delta("target_time_reached"), 1);
+}
+
 TEST_F(ModelTimingTest, ComputeTargetTime) {
   model_ = std::make_unique<Model>();
 
@@ -3695,6 +3847,132 @@ TEST(NodeTest, TotalMaximumBufferedBytesNoValueWhenElementSizeNotProvided) {
   EXPECT_EQ(root->TotalMaximumBufferedBytes(), 0.);
 }
 
+// A synthetic pipeline of parallel map stages on a host whose cores are shared
+// with other work.
+struct SimulatedPipeline {
+  // CPU time per element of each stage, from the output of the pipeline.
+  std::vector<double> stage_cost_nsec;
+  // Cores available to the pipeline, which is also its CPU budget.
+  int64_t num_cores;
+};
+
+const std::vector<SimulatedPipeline>& SimulatedPipelines() {
+  static const auto* const pipelines = new std::vector<SimulatedPipeline>({
+      {/*stage_cost_nsec=*/{200000, 200000}, /*num_cores=*/8},
+      {/*stage_cost_nsec=*/{50000, 400000, 100000}, /*num_cores=*/16},
+      {/*stage_cost_nsec=*/{300000, 300000, 300000, 300000}, /*num_cores=*/4},
+  });
+  return *pipelines;
+}
+
+// Simulates rounds of autotuning of `pipeline` with `algorithm`. In each
+// round, the stages report the processing time of a batch of elements given
+// their current parallelism, and the model is optimized. Threads beyond the
+// number of cores are time-sliced, which slows down every stage, and the
+// measured processing times carry a deterministic noise of up to 5%.
+//
+// Reports the number of rounds until the parallelism stopped changing, the
+// number of changes in the second half of the rounds, and the throughput of
+// the final allocation relative to the best one possible with the cores.
+void BM_AutotuneSimulation(::testing::benchmark::State& state) {
+  const auto algorithm = static_cast<AutotuneAlgorithm>(state.range(0));
+  const SimulatedPipeline& pipeline = SimulatedPipelines()[state.range(1)];
+  constexpr int kRounds = 50;
+  constexpr int kElementsPerRound = 100;
+  constexpr int64_t kElementSize = 1024;
+
+  int last_change_round = 0;
+  int late_changes = 0;
+  double throughput_ratio = 0.0;
+  for (auto s : state) {
+    Model model;
+    std::vector<std::shared_ptr<Node>> stages;
+    std::vector<std::shared_ptr<SharedState>> parallelism;
+    std::shared_ptr<Node> output;
+    for (int i = 0; i < pipeline.stage_cost_nsec.size(); ++i) {
+      parallelism.push_back(std::make_shared<SharedState>(
+          /*value=*/1, std::make_shared<mutex>(),
+          std::make_shared<condition_variable>()));
+      std::shared_ptr<Node> stage;
+      model.AddNode(
+          [&](Node::Args args) {
+            return MakeAsyncKnownRatioNode(
+                std::move(args), /*ratio=*/1,
+                {MakeParameter(kParallelism, parallelism.back(), /*min=*/1,
+                               /*max=*/4 * pipeline.num_cores)},
+                /*is_legacy_prefetch_autotuned=*/false);
+          },
+          "ParallelMapV2", output, &stage);
+      stages.push_back(stage);
+      output = stage;
+    }
+
+    std::mt19937 noise_generator(/*seed=*/42);
+    std::uniform_real_distribution<double> noise(0.95, 1.05);
+    CancellationManager cancellation_manager;
+    RamBudgetManager ram_budget_manager(0);
+    std::vector<int64_t> previous_allocation;
+    last_change_round = 0;
+    late_changes = 0;
+    double slowest_stage_nsec = 0.0;
+    for (int round = 0; round < kRounds; ++round) {
+      double threads = 0.0;
+      std::vector<int64_t> allocation;
+      for (const auto& parallelism_state : parallelism) {
+        allocation.push_back(parallelism_state->value);
+        threads += parallelism_state->value;
+      }
+      if (allocation != previous_allocation) {
+        last_change_round = round;
+        late_changes += round >= kRounds / 2;
+      }
+      previous_allocation = allocation;
+
+      const double slowdown =
+          std::max(1.0, threads / static_cast<double>(pipeline.num_cores));
+      slowest_stage_nsec = 0.0;
+      for (int i = 0; i < stages.size(); ++i) {
+        const double cost_nsec = pipeline.stage_cost_nsec[i] * slowdown;
+        slowest_stage_nsec =
+            std::max(slowest_stage_nsec, cost_nsec / allocation[i]);
+        for (int j = 0; j < kElementsPerRound; ++j) {
+          stages[i]->add_processing_time(
+              static_cast<int64_t>(cost_nsec * noise(noise_generator)));
+          stages[i]->record_bytes_produced(kElementSize);
+          stages[i]->record_element();
+        }
+      }
+      model.Optimize(algorithm, CpuBudgetFunc(pipeline.num_cores),
+                     /*ram_budget_share=*/1.0,
+                     /*fixed_ram_budget=*/int64_t{1} << 30,
+                     /*model_input_time=*/0, ram_budget_manager,
+                     &cancellation_manager);
+    }
+    // With the CPU time of all stages perfectly spread over the cores.
+    double best_slowest_stage_nsec = 0.0;
+    for (double cost_nsec : pipeline.stage_cost_nsec) {
+      best_slowest_stage_nsec += cost_nsec;
+    }
+    best_slowest_stage_nsec /= pipeline.num_cores;
+    throughput_ratio = best_slowest_stage_nsec / slowest_stage_nsec;
+  }
+  state.counters["rounds_to_converge"] = last_change_round;
+  state.counters["late_changes"] = late_changes;
+  state.counters["throughput_ratio"] = throughput_ratio;
+}
+BENCHMARK(BM_AutotuneSimulation)
+    ->ArgNames({"algorithm", "pipeline"})
+    ->Apply([](::benchmark::internal::Benchmark* benchmark) {
+      for (AutotuneAlgorithm algorithm :
+           {AutotuneAlgorithm::MAX_PARALLELISM, AutotuneAlgorithm::STAGE_BASED,
+            AutotuneAlgorithm::COST_BASED}) {
+        for (int pipeline = 0; pipeline < SimulatedPipelines().size();
+             ++pipeline) {
+          benchmark->Args({algorithm, pipeline});
+        }
+      }
+    });
+
 }  // namespace
 }  // namespace model
 }  // namespace data
@@ -40,6 +40,7 @@ constexpr char kShuffleAndRepeatDataset[] = "ShuffleAndRepeatDataset";
 constexpr char kShuffleAndRepeatDatasetV2[] = "ShuffleAndRepeatDatasetV2";
 
 constexpr char kReshuffleEachIteration[] = "reshuffle_each_iteration";
+constexpr char kMemoryBudgetBytes[] = "memory_budget_bytes";
 
 Status FuseShuffleV1AndRepeat(const NodeDef& shuffle_node,
                               const NodeDef& repeat_node,
@@ -168,6 +169,11 @@ Status ShuffleAndRepeatFusion::OptimizeAndCollectStats(
 
     const NodeDef& shuffle_node =
         *graph_utils::GetInputNode(repeat_node, graph);
+    // The fused op has no byte budget for its buffer.
+    if (shuffle_node.attr().contains(kMemoryBudgetBytes) &&
+        shuffle_node.attr().at(kMemoryBudgetBytes).i() > 0) {
+      continue;
+    }
 
     NodeDef fused_node;
     if (shuffle_node.op() == kShuffleDataset) {
@@ -65,6 +65,7 @@ struct AdaptiveBatchSchedulerParams {
   int32 max_inflight_batches;
   int32 batches_to_average_over;
   int64_t full_batch_scheduling_boost_micros;
+  int64_t target_p99_latency_micros;
 };
 
 AdaptiveBatchSchedulerParams GetAdaptiveBatchSchedulerParams(
@@ -90,6 +91,10 @@ AdaptiveBatchSchedulerParams GetAdaptiveBatchSchedulerParams(
       option.has_full_batch_scheduling_boost_micros()
           ? option.full_batch_scheduling_boost_micros().value()
           : kBoostMicrosNotSet;
+  params.target_p99_latency_micros =
+      option.has_target_p99_latency_micros()
+          ? option.target_p99_latency_micros().value()
+          : 0;
   return params;
 }
 
@@ -109,6 +114,10 @@ void SetNodeAttrs(const AdaptiveBatchSchedulerParams& params, NodeDef* node) {
         kFullBatchSchedulingBoostMicros,
         params.full_batch_scheduling_boost_micros, node);
   }
+  if (params.target_p99_latency_micros > 0) {
+    ::tensorflow::graph_transforms::SetNodeAttr(
+        kTargetP99LatencyMicrosAttr, params.target_p99_latency_micros, node);
+  }
 }
 
 void UpdateBatchOps(GraphDef* graph, BatchOpRewriteFunction rewrite_fn) {
@@ -265,6 +274,11 @@ Status BatchOpRewriter::Optimize(Cluster* cluster, const GrapplerItem& item,
               kEnableLargeBatchSplitting,
               !batch_options.disable_large_batch_splitting(), batch_op);
         }
+        if (batch_options.has_enable_zero_copy_batching()) {
+          ::tensorflow::graph_transforms::SetNodeAttr(
+              kEnableZeroCopyBatchingAttr,
+              batch_options.enable_zero_copy_batching(), batch_op);
+        }
       });
     }
   }
@@ -30,6 +30,8 @@ constexpr char kMaxInflightBatchesAttr[] = "_max_inflight_batches";
 constexpr char kBatchesToAverageOverAttr[] = "_batches_to_average_over";
 constexpr char kFullBatchSchedulingBoostMicros[] =
     "_full_batch_scheduling_boost_micros";  // NOLINT(whitespace/line_length)
+constexpr char kTargetP99LatencyMicrosAttr[] = "_target_p99_latency_micros";
+constexpr char kEnableZeroCopyBatchingAttr[] = "_enable_zero_copy_batching";
 
 constexpr int64_t kMinInflightBatches = 16;
 constexpr int64_t kInitialInflightBatches = 16;
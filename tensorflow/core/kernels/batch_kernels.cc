@@ -39,6 +39,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/batching_util/batch_resource_base.h"
 #include "tensorflow/core/kernels/batching_util/batch_scheduler.h"
 #include "tensorflow/core/kernels/batching_util/batch_scheduler_utils.h"
+#include "tensorflow/core/kernels/batching_util/batch_size_controller.h"
 #include "tensorflow/core/kernels/batching_util/bounded_executor.h"
 #include "tensorflow/core/kernels/batching_util/concat_split_util.h"
 #include "tensorflow/core/kernels/batching_util/periodic_function.h"
@@ -65,6 +66,8 @@ constexpr char kMaxInflightBatchesAttr[] = "_max_inflight_batches";
 constexpr char kBatchesToAverageOverAttr[] = "_batches_to_average_over";
 constexpr char kFullBatchSchedulingBoostMicros[] =
     "_full_batch_scheduling_boost_micros";
+constexpr char kTargetP99LatencyMicrosAttr[] = "_target_p99_latency_micros";
+constexpr char kEnableZeroCopyBatchingAttr[] = "_enable_zero_copy_batching";
 
 // Default thread count in the per-process batching thread pool.
 constexpr int64_t kBatchThreadPoolSize = 128;
@@ -179,7 +182,9 @@ class BatchResource : public serving::BatchResourceBase {
                   serving::MixedPriorityBatchingPolicy::
                       kLowPriorityPaddingWithMaxBatchSize,
                   enable_large_batch_splitting,
-                  /*batch_padding_policy=*/"PAD_UP", resource);
+                  /*batch_padding_policy=*/"PAD_UP",
+                  /*enable_earliest_deadline_first=*/false,
+                  /*deadline_margin_micros=*/0, resource);
   }
 
   static Status Create(
@@ -193,9 +198,12 @@ class BatchResource : public serving::BatchResourceBase {
       const std::vector<int32>& low_priority_allowed_batch_sizes,
       serving::MixedPriorityBatchingPolicy mixed_priority_batching_policy,
       bool enable_large_batch_splitting, absl::string_view batch_padding_policy,
+      bool enable_earliest_deadline_first, int64_t deadline_margin_micros,
       std::unique_ptr<BatchResource>* resource) {
     BatcherT::Options batcher_options;
     batcher_options.num_batch_threads = num_batch_threads;
+    batcher_options.enable_earliest_deadline_first =
+        enable_earliest_deadline_first;
     std::shared_ptr<BatcherT> batcher;
     TF_RETURN_IF_ERROR(BatcherT::Create(batcher_options, &batcher));
 
@@ -208,7 +216,8 @@ class BatchResource : public serving::BatchResourceBase {
             /*disable_padding=*/false, batch_padding_policy,
             low_priority_max_batch_size, low_priority_batch_timeout_micros,
             low_priority_max_enqueued_batches, low_priority_allowed_batch_sizes,
-            mixed_priority_batching_policy),
+            mixed_priority_batching_policy, enable_earliest_deadline_first,
+            deadline_margin_micros),
         allowed_batch_sizes));
     return absl::OkStatus();
   }
@@ -219,18 +228,31 @@ class BatchResource : public serving::BatchResourceBase {
       int32_t max_batch_size, int32_t batch_timeout_micros,
       int32_t max_enqueued_batches,
       const std::vector<int32>& allowed_batch_sizes,
+      int64_t target_p99_latency_micros,
       std::unique_ptr<BatchResource>* resource) {
     std::shared_ptr<AdaptiveBatcherT> batcher;
     TF_RETURN_IF_ERROR(AdaptiveBatcherT::Create(
         adaptive_shared_batch_scheduler_options, &batcher));
 
-    resource->reset(new BatchResource(
-        has_process_batch_function, std::move(batcher),
+    AdaptiveBatcherT::QueueOptions batcher_queue_options =
         GetAdaptiveBatcherQueueOptions(
             max_batch_size, batch_timeout_micros, max_enqueued_batches,
             /*enable_large_batch_splitting=*/true, allowed_batch_sizes,
-            /*disable_padding=*/false),
-        allowed_batch_sizes));
+            /*disable_padding=*/false);
+    if (target_p99_latency_micros > 0) {
+      serving::BatchSizeController::Options controller_options;
+      controller_options.target_p99_latency_micros = target_p99_latency_micros;
+      controller_options.allowed_batch_sizes = allowed_batch_sizes;
+      // Waiting longer than a quarter of the latency budget to fill a batch
+      // rarely pays off.
+      controller_options.max_batch_timeout_micros = std::max<int64_t>(
+          batch_timeout_micros, target_p99_latency_micros / 4);
+      batcher_queue_options.batch_size_controller_options = controller_options;
+    }
+
+    resource->reset(new BatchResource(has_process_batch_function,
+                                      std::move(batcher), batcher_queue_options,
+                                      allowed_batch_sizes));
     return absl::OkStatus();
   }
 
@@ -316,6 +338,22 @@ BatchFunctionKernel::BatchFunctionKernel(OpKernelConstruction* c)
                                  &enable_large_batch_splitting_));
     has_attribute_enable_large_batch_splitting_ = true;
   }
+  if (c->HasAttr("enable_earliest_deadline_first")) {
+    OP_REQUIRES_OK(c, c->GetAttr("enable_earliest_deadline_first",
+                                 &enable_earliest_deadline_first_));
+  }
+  if (c->HasAttr("deadline_margin_micros")) {
+    OP_REQUIRES_OK(
+        c, c->GetAttr("deadline_margin_micros", &deadline_margin_micros_));
+    OP_REQUIRES(c, deadline_margin_micros_ >= 0,
+                errors::InvalidArgument(
+                    "deadline_margin_micros must be non-negative; was ",
+                    deadline_margin_micros_));
+  }
+  if (c->HasAttr(kEnableZeroCopyBatchingAttr)) {
+    OP_REQUIRES_OK(c, c->GetAttr(kEnableZeroCopyBatchingAttr,
+                                 &enable_zero_copy_batching_));
+  }
 
   // Helper function `SetAdaptiveBatchSchedulerOptions` calls
   // `OP_REQUIRES_OK`, which exits the current function upon error.
@@ -419,10 +457,12 @@ void BatchFunctionKernel::ComputeAsync(OpKernelContext* c, DoneCallback done) {
           /*has_process_batch_function=*/true,
           adaptive_shared_batch_scheduler_options, max_batch_size_,
           batch_timeout_micros_, max_enqueued_batches_, allowed_batch_sizes_,
+          adaptive_batch_scheduler_options_->target_p99_latency_micros,
           &new_resource));
       if (session_metadata) {
         new_resource->set_session_metadata(*session_metadata);
       }
+      new_resource->set_enable_zero_copy_batching(enable_zero_copy_batching_);
       *r = new_resource.release();
       return absl::OkStatus();
     };
@@ -441,10 +481,12 @@ void BatchFunctionKernel::ComputeAsync(OpKernelContext* c, DoneCallback done) {
           low_priority_batch_timeout_micros_,
           low_priority_max_enqueued_batches_, low_priority_allowed_batch_sizes_,
           mixed_priority_batching_policy, enable_large_batch_splitting_,
-          batch_padding_policy_, &new_resource));
+          batch_padding_policy_, enable_earliest_deadline_first_,
+          deadline_margin_micros_, &new_resource));
       if (session_metadata) {
         new_resource->set_session_metadata(*session_metadata);
       }
+      new_resource->set_enable_zero_copy_batching(enable_zero_copy_batching_);
       *r = new_resource.release();
       return absl::OkStatus();
     };
@@ -626,6 +668,11 @@ void BatchFunctionKernel::SetAdaptiveBatchSchedulerOptions(
                                  &options.full_batch_scheduling_boost_micros));
   }
 
+  if (c->HasAttr(kTargetP99LatencyMicrosAttr)) {
+    OP_REQUIRES_OK(c, c->GetAttr(kTargetP99LatencyMicrosAttr,
+                                 &options.target_p99_latency_micros));
+  }
+
   // At this point, the batch kernel is configured to use adaptive scheduling.
   // To validate or return error at kernel construction time, invokes
   // `GetOrCreateBatchThreadsPool` and validates returned `thread_pool` is
@@ -116,6 +116,11 @@ class BatchFunctionKernel : public AsyncOpKernel {
   absl::optional<FunctionLibraryRuntime::Handle> fhandle_ TF_GUARDED_BY(mu_);
   bool enable_large_batch_splitting_ = false;
   bool has_attribute_enable_large_batch_splitting_ = false;
+  bool enable_earliest_deadline_first_ = false;
+  int64_t deadline_margin_micros_ = 0;
+  // Set by the private `_enable_zero_copy_batching` attr; see
+  // BatchResourceBase::set_enable_zero_copy_batching().
+  bool enable_zero_copy_batching_ = false;
   bool enable_adaptive_batch_threads_ = false;
 
   mutex mu_;
@@ -129,6 +134,9 @@ class BatchFunctionKernel : public AsyncOpKernel {
     int32 max_in_flight_batches_limit = kMaxInflightBatches;
     int32 batches_to_average_over = kBatchesToAverageOver;
     int64 full_batch_scheduling_boost_micros = -1;
+    // If positive, the batch size and timeout are tuned towards this p99
+    // batch latency.
+    int64 target_p99_latency_micros = 0;
   };
   absl::optional<AdaptiveBatchSchedulerOptions>
       adaptive_batch_scheduler_options_ = absl::nullopt;
@@ -26,6 +26,7 @@ limitations under the License.
 
 #include "absl/types/optional.h"
 #include "tensorflow/core/kernels/batching_util/batch_scheduler.h"
+#include "tensorflow/core/kernels/batching_util/batch_size_controller.h"
 #include "tensorflow/core/kernels/batching_util/periodic_function.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
@@ -74,6 +75,10 @@ class ASBSQueue;
 // CPU utilization - If the batch processing is cpu dominated, you can reap
 //   latency gains when underutilized by increasing the processing rate, but
 //   back the rate off when the load increases to avoid overload.
+//
+// Optionally, each queue can also tune its maximum batch size and batch
+// timeout towards a target p99 latency (see
+// QueueOptions::batch_size_controller_options).
 
 template <typename TaskType>
 class AdaptiveSharedBatchScheduler
@@ -171,6 +176,12 @@ class AdaptiveSharedBatchScheduler
 
     // If true, the padding will not be appended.
     bool disable_padding = false;
+
+    // If set, the queue's maximum batch size and batch timeout are tuned by a
+    // BatchSizeController from the latency of its batches, starting from (and
+    // never exceeding) `max_batch_size`, and starting from
+    // `batch_timeout_micros`.
+    absl::optional<BatchSizeController::Options> batch_size_controller_options;
   };
 
   using BatchProcessor = std::function<void(std::unique_ptr<Batch<TaskType>>)>;
@@ -300,8 +311,11 @@ class ASBSQueue : public BatchScheduler<TaskType> {
   using QueueOptions =
       typename AdaptiveSharedBatchScheduler<TaskType>::QueueOptions;
 
+  // `batch_size_controller` may be null, in which case the batch size and
+  // timeout are those of `options`.
   ASBSQueue(std::shared_ptr<AdaptiveSharedBatchScheduler<TaskType>> scheduler,
-            const QueueOptions& options);
+            const QueueOptions& options,
+            std::shared_ptr<BatchSizeController> batch_size_controller);
 
   ~ASBSQueue() override;
 
@@ -326,12 +340,19 @@ class ASBSQueue : public BatchScheduler<TaskType> {
   // Number of size 1 tasks which could currently be scheduled without failing.
   size_t SchedulingCapacityLocked() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Maximum size and timeout of new batches, possibly tuned by
+  // batch_size_controller_.
+  int CurrentMaxBatchSize() const;
+  int64_t CurrentBatchTimeoutMicros() const;
+
   // Returns uint64 one greater than was returned by the previous call.
   // Context id is reused after std::numeric_limits<uint64>::max is exhausted.
   static uint64 NewTraceMeContextIdForBatch();
 
   std::shared_ptr<AdaptiveSharedBatchScheduler<TaskType>> scheduler_;
   const QueueOptions options_;
+  // Shared with the batches of this queue, which report their latency to it.
+  const std::shared_ptr<BatchSizeController> batch_size_controller_;
   // Owned by scheduler_.
   ASBSBatch<TaskType>* current_batch_ TF_GUARDED_BY(mu_) = nullptr;
   int64_t num_enqueued_batches_ TF_GUARDED_BY(mu_) = 0;
@@ -346,11 +367,14 @@ template <typename TaskType>
 class ASBSBatch : public Batch<TaskType> {
  public:
   ASBSBatch(ASBSQueue<TaskType>* queue, int64_t creation_time_micros,
-            int64_t batch_timeout_micros, uint64 traceme_context_id)
+            int64_t batch_timeout_micros, uint64 traceme_context_id,
+            std::shared_ptr<BatchSizeController> batch_size_controller =
+                nullptr)
       : queue_(queue),
         creation_time_micros_(creation_time_micros),
         schedulable_time_micros_(creation_time_micros + batch_timeout_micros),
-        traceme_context_id_(traceme_context_id) {}
+        traceme_context_id_(traceme_context_id),
+        batch_size_controller_(std::move(batch_size_controller)) {}
 
   ~ASBSBatch() override {}
 
@@ -362,11 +386,18 @@ class ASBSBatch : public Batch<TaskType> {
 
   uint64 traceme_context_id() const { return traceme_context_id_; }
 
+  // The controller of the queue that created this batch, if any. Unlike the
+  // queue, it outlives the batch's processing.
+  const std::shared_ptr<BatchSizeController>& batch_size_controller() const {
+    return batch_size_controller_;
+  }
+
  private:
   ASBSQueue<TaskType>* queue_;
   const int64_t creation_time_micros_;
   const int64_t schedulable_time_micros_;
   const uint64 traceme_context_id_;
+  const std::shared_ptr<BatchSizeController> batch_size_controller_;
   ASBSBatch(const ASBSBatch&) = delete;
   void operator=(const ASBSBatch&) = delete;
 };
@@ -467,9 +498,16 @@ Status AdaptiveSharedBatchScheduler<TaskType>::AddQueue(
           options.max_batch_size);
     }
   }
+  std::shared_ptr<BatchSizeController> batch_size_controller;
+  if (options.batch_size_controller_options.has_value()) {
+    TF_RETURN_IF_ERROR(BatchSizeController::Create(
+        *options.batch_size_controller_options, options.max_batch_size,
+        options.batch_timeout_micros, &batch_size_controller));
+  }
   internal::ASBSQueue<TaskType>* asbs_queue_raw;
   queue->reset(asbs_queue_raw = new internal::ASBSQueue<TaskType>(
-                   this->shared_from_this(), options));
+                   this->shared_from_this(), options,
+                   std::move(batch_size_controller)));
   mutex_lock l(mu_);
   queues_and_callbacks_[asbs_queue_raw] = process_batch_callback;
   return absl::OkStatus();
@@ -642,9 +680,18 @@ void AdaptiveSharedBatchScheduler<TaskType>::CallbackWrapper(
       tsl::profiler::ContextType::kAdaptiveSharedBatchScheduler,
       batch->traceme_context_id());
   const int64_t start_time = batch->creation_time_micros();
+  // The callback takes ownership of the batch.
+  std::shared_ptr<BatchSizeController> batch_size_controller =
+      batch->batch_size_controller();
+  const int batch_size = batch->size();
+  const int64_t processing_start_time = GetEnv()->NowMicros();
   callback(std::unique_ptr<Batch<TaskType>>(
       const_cast<internal::ASBSBatch<TaskType>*>(batch)));
   int64_t end_time = GetEnv()->NowMicros();
+  if (batch_size_controller != nullptr) {
+    batch_size_controller->RecordBatch(batch_size, end_time - start_time,
+                                       end_time - processing_start_time);
+  }
   mutex_lock l(mu_);
   if (is_express) {
     in_flight_express_batches_--;
@@ -709,8 +756,11 @@ namespace internal {
 template <typename TaskType>
 ASBSQueue<TaskType>::ASBSQueue(
     std::shared_ptr<AdaptiveSharedBatchScheduler<TaskType>> scheduler,
-    const QueueOptions& options)
-    : scheduler_(scheduler), options_(options) {}
+    const QueueOptions& options,
+    std::shared_ptr<BatchSizeController> batch_size_controller)
+    : scheduler_(scheduler),
+      options_(options),
+      batch_size_controller_(std::move(batch_size_controller)) {}
 
 template <typename TaskType>
 ASBSQueue<TaskType>::~ASBSQueue() {
@@ -747,16 +797,24 @@ Status ASBSQueue<TaskType>::Schedule(std::unique_ptr<TaskType>* task) {
   std::vector<std::unique_ptr<TaskType>> tasks_to_schedule;
   std::vector<ASBSBatch<TaskType>*> new_batches;
   bool closed_batch = false;
+  const int max_batch_size = CurrentMaxBatchSize();
   {
     mutex_lock l(mu_);
     if (size > SchedulingCapacityLocked()) {
       return errors::Unavailable("The batch scheduling queue is full");
     }
 
+    // The current batch may have been opened under a larger maximum, in which
+    // case it is already full.
+    if (current_batch_ && current_batch_->size() >= max_batch_size) {
+      current_batch_->Close();
+      closed_batch = true;
+      current_batch_ = nullptr;
+    }
     int remaining_batch_size =
         current_batch_ == nullptr
-            ? options_.max_batch_size
-            : options_.max_batch_size - current_batch_->size();
+            ? max_batch_size
+            : max_batch_size - current_batch_->size();
     if (options_.split_input_task_func == nullptr ||
         size <= remaining_batch_size) {
       // Either we don't allow task splitting or task fits within the current
@@ -767,13 +825,12 @@ Status ASBSQueue<TaskType>::Schedule(std::unique_ptr<TaskType>* task) {
       // Beyond this point Schedule should not fail, as the caller has been
       // promised that all of the split tasks will be scheduled.
       TF_RETURN_IF_ERROR(options_.split_input_task_func(
-          task, remaining_batch_size, options_.max_batch_size,
-          &tasks_to_schedule));
+          task, remaining_batch_size, max_batch_size, &tasks_to_schedule));
     }
     for (auto& task : tasks_to_schedule) {
       // Can't fit within current batch, close it off and try to create another.
       if (current_batch_ &&
-          current_batch_->size() + task->size() > options_.max_batch_size) {
+          current_batch_->size() + task->size() > max_batch_size) {
         current_batch_->Close();
         closed_batch = true;
         current_batch_ = nullptr;
@@ -786,7 +843,8 @@ Status ASBSQueue<TaskType>::Schedule(std::unique_ptr<TaskType>* task) {
         // are processed in the same batch and should share traceme_context_id.
         current_batch_ = new ASBSBatch<TaskType>(
             this, scheduler_->GetEnv()->NowMicros(),
-            options_.batch_timeout_micros, NewTraceMeContextIdForBatch());
+            CurrentBatchTimeoutMicros(), NewTraceMeContextIdForBatch(),
+            batch_size_controller_);
         new_batches.push_back(current_batch_);
       }
 
@@ -806,8 +864,7 @@ Status ASBSQueue<TaskType>::Schedule(std::unique_ptr<TaskType>* task) {
       bool reached_max_tasks =
           (options_.max_tasks_per_batch.has_value() &&
            current_batch_->num_tasks() >= options_.max_tasks_per_batch.value());
-      if (current_batch_->size() == options_.max_batch_size ||
-          reached_max_tasks) {
+      if (current_batch_->size() >= max_batch_size || reached_max_tasks) {
         current_batch_->Close();
         closed_batch = true;
         current_batch_ = nullptr;
@@ -850,11 +907,30 @@ size_t ASBSQueue<TaskType>::SchedulingCapacity() const {
 
 template <typename TaskType>
 size_t ASBSQueue<TaskType>::SchedulingCapacityLocked() const {
+  const int max_batch_size = CurrentMaxBatchSize();
+  // The current batch may exceed a maximum lowered since it was opened.
   const int current_batch_capacity =
-      current_batch_ ? options_.max_batch_size - current_batch_->size() : 0;
+      current_batch_
+          ? std::max(max_batch_size - static_cast<int>(current_batch_->size()),
+                     0)
+          : 0;
   const int spare_batches =
       options_.max_enqueued_batches - num_enqueued_batches_;
-  return spare_batches * options_.max_batch_size + current_batch_capacity;
+  return spare_batches * max_batch_size + current_batch_capacity;
+}
+
+template <typename TaskType>
+int ASBSQueue<TaskType>::CurrentMaxBatchSize() const {
+  return batch_size_controller_ == nullptr
+             ? options_.max_batch_size
+             : batch_size_controller_->max_batch_size();
+}
+
+template <typename TaskType>
+int64_t ASBSQueue<TaskType>::CurrentBatchTimeoutMicros() const {
+  return batch_size_controller_ == nullptr
+             ? options_.batch_timeout_micros
+             : batch_size_controller_->batch_timeout_micros();
 }
 
 template <typename TaskType>
@@ -517,6 +517,59 @@ TEST(AdaptiveSharedBatchSchedulerTest, MaxTasksPerBatch) {
     if (processed_batches == 3) break;
   }
 }
+
+TEST(AdaptiveSharedBatchSchedulerTest, BatchSizeController) {
+  mutex mu;
+  std::vector<int> batch_sizes;
+  auto queue_callback =
+      [&mu, &batch_sizes](std::unique_ptr<Batch<FakeTask>> batch) {
+        ASSERT_TRUE(batch->IsClosed());
+        // Every batch misses the latency target.
+        Env::Default()->SleepForMicroseconds(100);
+        mutex_lock l(mu);
+        batch_sizes.push_back(batch->size());
+      };
+  std::shared_ptr<AdaptiveSharedBatchScheduler<FakeTask>> scheduler;
+  TF_ASSERT_OK(AdaptiveSharedBatchScheduler<FakeTask>::Create({}, &scheduler));
+  std::unique_ptr<BatchScheduler<FakeTask>> queue;
+
+  AdaptiveSharedBatchScheduler<FakeTask>::QueueOptions queue_options;
+  queue_options.max_batch_size = 8;
+  queue_options.max_enqueued_batches = 10;
+  queue_options.batch_timeout_micros = 1000000000000;
+  BatchSizeController::Options controller_options;
+  controller_options.target_p99_latency_micros = 1;
+  controller_options.max_batch_timeout_micros = 1000000000000;
+  controller_options.batches_per_adjustment = 1;
+  queue_options.batch_size_controller_options = controller_options;
+  TF_ASSERT_OK(scheduler->AddQueue(queue_options, queue_callback, &queue));
+  EXPECT_EQ(80, queue->SchedulingCapacity());
+
+  // Each batch halves the maximum batch size, and only full batches are
+  // processed before the timeout.
+  for (const int expected_batch_size : {8, 4, 2, 1}) {
+    for (int i = 0; i < expected_batch_size; ++i) {
+      TF_ASSERT_OK(ScheduleTask(1, queue.get()));
+    }
+    // Wait for the batch to be processed and seen by the controller.
+    const int next_max_batch_size = std::max(expected_batch_size / 2, 1);
+    while (true) {
+      {
+        mutex_lock l(mu);
+        if (!batch_sizes.empty() &&
+            queue->SchedulingCapacity() == 10 * next_max_batch_size) {
+          break;
+        }
+      }
+      Env::Default()->SleepForMicroseconds(10);
+    }
+    mutex_lock l(mu);
+    ASSERT_EQ(1, batch_sizes.size());
+    EXPECT_EQ(expected_batch_size, batch_sizes.back());
+    batch_sizes.clear();
+  }
+}
+
 }  // namespace anonymous
 }  // namespace serving
 }  // namespace tensorflow
@@ -0,0 +1,193 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/batching_util/batch_buffer_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/batch_util.h"
+
+namespace tensorflow {
+namespace serving {
+
+BatchBufferPool::BatchBufferPool(int max_buffers_per_shape,
+                                 int64_t max_pooled_bytes)
+    : max_buffers_per_shape_(max_buffers_per_shape),
+      max_pooled_bytes_(max_pooled_bytes) {}
+
+Tensor BatchBufferPool::Acquire(Allocator* allocator, DataType dtype,
+                                const TensorShape& shape) {
+  // The elements of other types own memory the byte budget doesn't see.
+  if (DataTypeCanUseMemcpy(dtype)) {
+    mutex_lock l(mu_);
+    Key key{allocator, dtype, shape};
+    auto it = buffers_by_key_.find(key);
+    if (it != buffers_by_key_.end()) {
+      for (const LruList::iterator& entry : it->second) {
+        if (entry->buffer.RefCountIsOne()) {
+          lru_.splice(lru_.begin(), lru_, entry);
+          // Copying the tensor takes a reference, so the buffer won't be
+          // handed out again until the caller is done with it.
+          return entry->buffer;
+        }
+      }
+    }
+    const int num_buffers_with_key =
+        it == buffers_by_key_.end() ? 0 : it->second.size();
+    const int64_t bytes =
+        shape.num_elements() * static_cast<int64_t>(DataTypeSize(dtype));
+    if (num_buffers_with_key < max_buffers_per_shape_ && MakeRoom(bytes)) {
+      lru_.push_front(Entry{key, Tensor(allocator, dtype, shape), bytes});
+      // Evictions by `MakeRoom()` may have invalidated `it`.
+      buffers_by_key_[std::move(key)].push_back(lru_.begin());
+      num_pooled_bytes_ += bytes;
+      ++num_allocated_buffers_;
+      return lru_.front().buffer;
+    }
+  }
+  return Tensor(allocator, dtype, shape);
+}
+
+bool BatchBufferPool::MakeRoom(int64_t bytes) {
+  if (bytes > max_pooled_bytes_) return false;
+  auto entry = lru_.end();
+  while (num_pooled_bytes_ + bytes > max_pooled_bytes_ &&
+         entry != lru_.begin()) {
+    --entry;
+    if (!entry->buffer.RefCountIsOne()) continue;
+    auto it = buffers_by_key_.find(entry->key);
+    std::vector<LruList::iterator>& entries = it->second;
+    entries.erase(std::find(entries.begin(), entries.end(), entry));
+    if (entries.empty()) buffers_by_key_.erase(it);
+    num_pooled_bytes_ -= entry->bytes;
+    entry = lru_.erase(entry);
+  }
+  return num_pooled_bytes_ + bytes <= max_pooled_bytes_;
+}
+
+int64_t BatchBufferPool::num_allocated_buffers() const {
+  mutex_lock l(mu_);
+  return num_allocated_buffers_;
+}
+
+int64_t BatchBufferPool::num_pooled_bytes() const {
+  mutex_lock l(mu_);
+  return num_pooled_bytes_;
+}
+
+BatchBuffer::BatchBuffer(Tensor buffer) : buffer_(std::move(buffer)) {
+  DCHECK_GE(buffer_.dims(), 1);
+}
+
+Status BatchBuffer::CheckRowShape(const Tensor& input) const {
+  if (input.dtype() != buffer_.dtype()) {
+    return errors::InvalidArgument("Cannot add a tensor of type ",
+                                   DataTypeString(input.dtype()),
+                                   " to a batch of type ",
+                                   DataTypeString(buffer_.dtype()));
+  }
+  bool same_row_shape = input.dims() == buffer_.dims();
+  for (int i = 1; same_row_shape && i < input.dims(); ++i) {
+    same_row_shape = input.dim_size(i) == buffer_.dim_size(i);
+  }
+  if (!same_row_shape) {
+    return errors::InvalidArgument(
+        "Cannot add a tensor of shape ", input.shape().DebugString(),
+        " to a batch of shape ", buffer_.shape().DebugString());
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<Tensor> BatchBuffer::Reserve(int64_t num_rows) {
+  if (num_rows < 0 || num_rows_ + num_rows > capacity()) {
+    return errors::ResourceExhausted("Cannot reserve ", num_rows,
+                                     " rows in a batch with ",
+                                     capacity() - num_rows_, " free rows");
+  }
+  Tensor slot = buffer_.Slice(num_rows_, num_rows_ + num_rows);
+  num_rows_ += num_rows;
+  return slot;
+}
+
+Status BatchBuffer::Append(const Tensor& input) {
+  TF_RETURN_IF_ERROR(CheckRowShape(input));
+  const int64_t num_rows = input.dim_size(0);
+  if (num_rows_ + num_rows > capacity()) {
+    return errors::ResourceExhausted("Cannot append ", num_rows,
+                                     " rows to a batch with ",
+                                     capacity() - num_rows_, " free rows");
+  }
+  if (num_rows > 0) {
+    TF_RETURN_IF_ERROR(batch_util::CopyContiguousSlices(
+        input, /*src_offset=*/0, /*dst_offset=*/num_rows_, num_rows,
+        &buffer_));
+  }
+  num_rows_ += num_rows;
+  return absl::OkStatus();
+}
+
+Tensor BatchBuffer::Finish() const {
+  if (num_rows_ == capacity()) return buffer_;
+  return buffer_.Slice(0, num_rows_);
+}
+
+Status SplitAsSlices(const Tensor& input, absl::Span<const int64_t> sizes,
+                     std::vector<Tensor>* outputs) {
+  if (input.dims() == 0) {
+    return errors::InvalidArgument("Cannot split a zero-dimensional tensor");
+  }
+  int64_t total_size = 0;
+  for (const int64_t size : sizes) {
+    total_size += size;
+  }
+  if (total_size != input.dim_size(0)) {
+    return errors::InvalidArgument(
+        "The values in 'sizes' do not sum to the zeroth-dimension size of "
+        "'input'");
+  }
+  outputs->reserve(outputs->size() + sizes.size());
+  int64_t position = 0;
+  for (const int64_t size : sizes) {
+    Tensor slice = input.Slice(position, position + size);
+    if (slice.IsAligned()) {
+      outputs->push_back(std::move(slice));
+    } else {
+      TensorShape shape = input.shape();
+      shape.set_dim(0, size);
+      Tensor copy(input.dtype(), shape);
+      if (size > 0) {
+        TF_RETURN_IF_ERROR(batch_util::CopyContiguousSlices(
+            input, /*src_offset=*/position, /*dst_offset=*/0, size, &copy));
+      }
+      outputs->push_back(std::move(copy));
+    }
+    position += size;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace serving
+}  // namespace tensorflow
@@ -0,0 +1,164 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_BATCHING_UTIL_BATCH_BUFFER_POOL_H_
+#define TENSORFLOW_CORE_KERNELS_BATCHING_UTIL_BATCH_BUFFER_POOL_H_
+
+#include <cstdint>
+#include <list>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+namespace serving {
+
+// A pool of host tensors to assemble batches in.
+//
+// Batches of a given model input have the same dtype and usually one of a few
+// shapes (the allowed batch sizes), so their buffers can be recycled instead of
+// being allocated for every batch. A pooled buffer is handed out again once all
+// the tensors sharing it, e.g. slices returned by BatchBuffer, are destroyed.
+//
+// Inputs whose inner dimensions vary from batch to batch (e.g. sequences)
+// produce new shapes all the time, so the pool is bounded in bytes: when it is
+// full, the least recently used free buffers are evicted to make room. Only
+// buffers of memcpy-able dtypes are pooled.
+//
+// Thread-safe.
+class BatchBufferPool {
+ public:
+  static constexpr int64_t kDefaultMaxPooledBytes = int64_t{256} << 20;
+
+  // At most `max_buffers_per_shape` buffers of each dtype and shape, and at
+  // most `max_pooled_bytes` bytes in total, are pooled; further requests are
+  // served by unpooled tensors.
+  explicit BatchBufferPool(int max_buffers_per_shape = 4,
+                           int64_t max_pooled_bytes = kDefaultMaxPooledBytes);
+
+  // Returns a tensor of the given dtype and shape allocated by `allocator`,
+  // whose contents are unspecified. Buffers are only reused for requests with
+  // the same allocator.
+  Tensor Acquire(Allocator* allocator, DataType dtype,
+                 const TensorShape& shape);
+
+  // Number of buffers allocated by the pool so far, not counting unpooled
+  // ones. Exposed for testing and benchmarks.
+  int64_t num_allocated_buffers() const;
+
+  // Total size of the buffers currently held by the pool.
+  int64_t num_pooled_bytes() const;
+
+ private:
+  struct Key {
+    Allocator* allocator;
+    DataType dtype;
+    TensorShape shape;
+
+    bool operator==(const Key& other) const {
+      return allocator == other.allocator && dtype == other.dtype &&
+             shape == other.shape;
+    }
+    template <typename H>
+    friend H AbslHashValue(H h, const Key& key) {
+      return H::combine(std::move(h), key.allocator, key.dtype,
+                        key.shape.dim_sizes());
+    }
+  };
+  struct Entry {
+    Key key;
+    Tensor buffer;
+    int64_t bytes;
+  };
+  using LruList = std::list<Entry>;
+
+  // Evicts free buffers, least recently used first, until `bytes` more fit
+  // in the pool. Returns false if they still don't.
+  bool MakeRoom(int64_t bytes) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const int max_buffers_per_shape_;
+  const int64_t max_pooled_bytes_;
+
+  mutable mutex mu_;
+  // Pooled buffers, most recently used first. A buffer is free iff the pool
+  // holds the only reference to it.
+  LruList lru_ TF_GUARDED_BY(mu_);
+  // The buffers in `lru_` of each key.
+  absl::flat_hash_map<Key, std::vector<LruList::iterator>> buffers_by_key_
+      TF_GUARDED_BY(mu_);
+  int64_t num_pooled_bytes_ TF_GUARDED_BY(mu_) = 0;
+  int64_t num_allocated_buffers_ TF_GUARDED_BY(mu_) = 0;
+
+  BatchBufferPool(const BatchBufferPool&) = delete;
+  void operator=(const BatchBufferPool&) = delete;
+};
+
+// A batch being assembled, row by row along the 0th dimension, in a single
+// preallocated buffer (typically from a BatchBufferPool).
+//
+// Producers that can write their input in place reserve a slot with Reserve()
+// and fill it; others copy an existing tensor with Append(). Finish() then
+// returns the assembled batch without a further copy.
+//
+// Not thread-safe; distinct slots may however be filled concurrently.
+class BatchBuffer {
+ public:
+  // `buffer` must have at least one dimension; its 0th dimension is the
+  // capacity in rows.
+  explicit BatchBuffer(Tensor buffer);
+
+  // Reserves the next `num_rows` rows and returns a tensor aliasing them.
+  // The returned tensor may not be aligned (see Tensor::Slice()), so it should
+  // be filled through `tensor_data()` or `unaligned_flat()`.
+  absl::StatusOr<Tensor> Reserve(int64_t num_rows);
+
+  // Copies `input`, whose shape must match the buffer's except in the 0th
+  // dimension, into the next rows.
+  Status Append(const Tensor& input);
+
+  int64_t num_rows() const { return num_rows_; }
+  int64_t capacity() const { return buffer_.dim_size(0); }
+
+  // Returns the rows appended or reserved so far, sharing the buffer.
+  Tensor Finish() const;
+
+ private:
+  Status CheckRowShape(const Tensor& input) const;
+
+  Tensor buffer_;
+  int64_t num_rows_ = 0;
+};
+
+// Splits `input` along its 0th dimension into pieces of `sizes` rows, which
+// must sum to the 0th dimension of `input`. Pieces that would be aligned (see
+// Tensor::IsAligned()) share the buffer of `input`; the others are copied so
+// that every output satisfies the alignment requirement of Tensor::flat().
+Status SplitAsSlices(const Tensor& input, absl::Span<const int64_t> sizes,
+                     std::vector<Tensor>* outputs);
+
+}  // namespace serving
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_BATCHING_UTIL_BATCH_BUFFER_POOL_H_
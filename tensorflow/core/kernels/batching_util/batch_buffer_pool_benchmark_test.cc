@@ -0,0 +1,114 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Benchmarks batch assembly and output splitting with pooled buffers and
+// sliced outputs against the copying tensor::Concat / tensor::Split path used
+// by BatchResourceBase by default.
+
+#include <cstdint>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_util.h"
+#include "tensorflow/core/kernels/batching_util/batch_buffer_pool.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace serving {
+namespace {
+
+// Each task contributes one row of `kRowElements` floats.
+constexpr int64_t kRowElements = 1024;
+
+std::vector<Tensor> MakeInputs(int num_tasks) {
+  std::vector<Tensor> inputs;
+  inputs.reserve(num_tasks);
+  for (int i = 0; i < num_tasks; ++i) {
+    Tensor input(DT_FLOAT, TensorShape({1, kRowElements}));
+    input.flat<float>().setConstant(i);
+    inputs.push_back(std::move(input));
+  }
+  return inputs;
+}
+
+void BM_ConcatInputs(::testing::benchmark::State& state) {
+  const int num_tasks = state.range(0);
+  const std::vector<Tensor> inputs = MakeInputs(num_tasks);
+  for (auto s : state) {
+    Tensor batched;
+    TF_CHECK_OK(tensor::Concat(inputs, &batched));
+    testing::DoNotOptimize(batched);
+  }
+  state.SetItemsProcessed(state.iterations() * num_tasks);
+  state.SetBytesProcessed(state.iterations() * num_tasks * kRowElements *
+                          sizeof(float));
+}
+BENCHMARK(BM_ConcatInputs)->Arg(8)->Arg(64)->Arg(512);
+
+void BM_AssembleInPooledBuffer(::testing::benchmark::State& state) {
+  const int num_tasks = state.range(0);
+  const std::vector<Tensor> inputs = MakeInputs(num_tasks);
+  BatchBufferPool pool;
+  for (auto s : state) {
+    BatchBuffer batch(
+        pool.Acquire(cpu_allocator(), DT_FLOAT,
+                     TensorShape({num_tasks, kRowElements})));
+    for (const Tensor& input : inputs) {
+      TF_CHECK_OK(batch.Append(input));
+    }
+    Tensor batched = batch.Finish();
+    testing::DoNotOptimize(batched);
+  }
+  CHECK_EQ(pool.num_allocated_buffers(), 1);
+  state.SetItemsProcessed(state.iterations() * num_tasks);
+  state.SetBytesProcessed(state.iterations() * num_tasks * kRowElements *
+                          sizeof(float));
+}
+BENCHMARK(BM_AssembleInPooledBuffer)->Arg(8)->Arg(64)->Arg(512);
+
+void BM_SplitOutputs(::testing::benchmark::State& state) {
+  const int num_tasks = state.range(0);
+  Tensor output(DT_FLOAT, TensorShape({num_tasks, kRowElements}));
+  output.flat<float>().setZero();
+  const std::vector<int64_t> sizes(num_tasks, 1);
+  for (auto s : state) {
+    std::vector<Tensor> split;
+    TF_CHECK_OK(tensor::Split(output, sizes, &split));
+    testing::DoNotOptimize(split);
+  }
+  state.SetItemsProcessed(state.iterations() * num_tasks);
+}
+BENCHMARK(BM_SplitOutputs)->Arg(8)->Arg(64)->Arg(512);
+
+void BM_SplitAsSlices(::testing::benchmark::State& state) {
+  const int num_tasks = state.range(0);
+  Tensor output(DT_FLOAT, TensorShape({num_tasks, kRowElements}));
+  output.flat<float>().setZero();
+  const std::vector<int64_t> sizes(num_tasks, 1);
+  for (auto s : state) {
+    std::vector<Tensor> split;
+    TF_CHECK_OK(SplitAsSlices(output, sizes, &split));
+    testing::DoNotOptimize(split);
+  }
+  state.SetItemsProcessed(state.iterations() * num_tasks);
+}
+BENCHMARK(BM_SplitAsSlices)->Arg(8)->Arg(64)->Arg(512);
+
+}  // namespace
+}  // namespace serving
+}  // namespace tensorflow
@@ -0,0 +1,204 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/batching_util/batch_buffer_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace serving {
+namespace {
+
+TEST(BatchBufferPoolTest, ReusesReleasedBuffers) {
+  Allocator* allocator = cpu_allocator();
+  BatchBufferPool pool;
+  const void* data;
+  {
+    Tensor buffer = pool.Acquire(allocator, DT_FLOAT, TensorShape({8, 2}));
+    data = buffer.tensor_data().data();
+  }
+  Tensor buffer = pool.Acquire(allocator, DT_FLOAT, TensorShape({8, 2}));
+  EXPECT_EQ(data, buffer.tensor_data().data());
+  EXPECT_EQ(1, pool.num_allocated_buffers());
+
+  // Other shapes and dtypes get their own buffers.
+  Tensor other_shape = pool.Acquire(allocator, DT_FLOAT, TensorShape({4, 2}));
+  Tensor other_dtype = pool.Acquire(allocator, DT_INT32, TensorShape({8, 2}));
+  EXPECT_EQ(3, pool.num_allocated_buffers());
+}
+
+TEST(BatchBufferPoolTest, DoesNotReuseBuffersWithLiveSlices) {
+  Allocator* allocator = cpu_allocator();
+  BatchBufferPool pool;
+  Tensor slice;
+  {
+    Tensor buffer = pool.Acquire(allocator, DT_FLOAT, TensorShape({8, 2}));
+    slice = buffer.Slice(0, 4);
+  }
+  Tensor buffer = pool.Acquire(allocator, DT_FLOAT, TensorShape({8, 2}));
+  EXPECT_FALSE(buffer.SharesBufferWith(slice));
+  EXPECT_EQ(2, pool.num_allocated_buffers());
+}
+
+TEST(BatchBufferPoolTest, CapsBuffersPerShape) {
+  Allocator* allocator = cpu_allocator();
+  BatchBufferPool pool(/*max_buffers_per_shape=*/2);
+  std::vector<Tensor> buffers;
+  for (int i = 0; i < 4; ++i) {
+    buffers.push_back(pool.Acquire(allocator, DT_FLOAT, TensorShape({8})));
+  }
+  EXPECT_EQ(2, pool.num_allocated_buffers());
+  buffers.clear();
+  for (int i = 0; i < 4; ++i) {
+    buffers.push_back(pool.Acquire(allocator, DT_FLOAT, TensorShape({8})));
+  }
+  EXPECT_EQ(2, pool.num_allocated_buffers());
+}
+
+TEST(BatchBufferPoolTest, EvictsLeastRecentlyUsedBuffers) {
+  Allocator* allocator = cpu_allocator();
+  // Room for two buffers of 8 floats.
+  BatchBufferPool pool(/*max_buffers_per_shape=*/4, /*max_pooled_bytes=*/64);
+  const void* recently_used;
+  {
+    Tensor old_buffer = pool.Acquire(allocator, DT_FLOAT, TensorShape({8}));
+    Tensor recent_buffer =
+        pool.Acquire(allocator, DT_FLOAT, TensorShape({2, 4}));
+    recently_used = recent_buffer.tensor_data().data();
+  }
+  // A new shape evicts the buffer of shape {8}.
+  { Tensor buffer = pool.Acquire(allocator, DT_FLOAT, TensorShape({4, 2})); }
+  EXPECT_EQ(3, pool.num_allocated_buffers());
+  EXPECT_EQ(64, pool.num_pooled_bytes());
+
+  Tensor buffer = pool.Acquire(allocator, DT_FLOAT, TensorShape({2, 4}));
+  EXPECT_EQ(recently_used, buffer.tensor_data().data());
+  EXPECT_EQ(3, pool.num_allocated_buffers());
+}
+
+TEST(BatchBufferPoolTest, DoesNotEvictBuffersInUse) {
+  Allocator* allocator = cpu_allocator();
+  BatchBufferPool pool(/*max_buffers_per_shape=*/4, /*max_pooled_bytes=*/64);
+  Tensor first = pool.Acquire(allocator, DT_FLOAT, TensorShape({8}));
+  Tensor second = pool.Acquire(allocator, DT_FLOAT, TensorShape({2, 4}));
+  Tensor unpooled = pool.Acquire(allocator, DT_FLOAT, TensorShape({4, 2}));
+  // Larger than the whole pool.
+  Tensor too_large = pool.Acquire(allocator, DT_FLOAT, TensorShape({32}));
+  EXPECT_EQ(2, pool.num_allocated_buffers());
+  EXPECT_EQ(64, pool.num_pooled_bytes());
+}
+
+TEST(BatchBufferTest, AppendAndReserve) {
+  BatchBuffer batch(Tensor(DT_INT32, TensorShape({4, 2})));
+  EXPECT_EQ(4, batch.capacity());
+  TF_ASSERT_OK(batch.Append(test::AsTensor<int32>({1, 2}, {1, 2})));
+  absl::StatusOr<Tensor> slot = batch.Reserve(2);
+  TF_ASSERT_OK(slot.status());
+  EXPECT_EQ(TensorShape({2, 2}), slot->shape());
+  auto slot_data = slot->unaligned_flat<int32>();
+  for (int i = 0; i < slot_data.size(); ++i) slot_data(i) = 3 + i;
+  EXPECT_EQ(3, batch.num_rows());
+
+  Tensor result = batch.Finish();
+  test::ExpectTensorEqual<int32>(
+      test::AsTensor<int32>({1, 2, 3, 4, 5, 6}, {3, 2}), result);
+}
+
+TEST(BatchBufferTest, FinishReturnsWholeBufferWhenFull) {
+  Tensor buffer(DT_FLOAT, TensorShape({2}));
+  BatchBuffer batch(buffer);
+  TF_ASSERT_OK(batch.Append(test::AsTensor<float>({1.0, 2.0})));
+  Tensor result = batch.Finish();
+  EXPECT_TRUE(result.SharesBufferWith(buffer));
+  EXPECT_TRUE(result.IsAligned());
+  test::ExpectTensorEqual<float>(test::AsTensor<float>({1.0, 2.0}), result);
+}
+
+TEST(BatchBufferTest, AppendStrings) {
+  BatchBuffer batch(Tensor(DT_STRING, TensorShape({3})));
+  TF_ASSERT_OK(batch.Append(test::AsTensor<tstring>({"a", "b"})));
+  TF_ASSERT_OK(batch.Append(test::AsTensor<tstring>({"c"})));
+  test::ExpectTensorEqual<tstring>(test::AsTensor<tstring>({"a", "b", "c"}),
+                                   batch.Finish());
+}
+
+TEST(BatchBufferTest, Overflow) {
+  BatchBuffer batch(Tensor(DT_FLOAT, TensorShape({2})));
+  TF_ASSERT_OK(batch.Append(test::AsTensor<float>({1.0})));
+  EXPECT_EQ(absl::StatusCode::kResourceExhausted,
+            batch.Append(test::AsTensor<float>({2.0, 3.0})).code());
+  EXPECT_EQ(absl::StatusCode::kResourceExhausted,
+            batch.Reserve(2).status().code());
+  EXPECT_EQ(1, batch.num_rows());
+}
+
+TEST(BatchBufferTest, ShapeMismatch) {
+  BatchBuffer batch(Tensor(DT_FLOAT, TensorShape({4, 2})));
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            batch.Append(test::AsTensor<float>({1.0, 2.0, 3.0}, {1, 3}))
+                .code());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            batch.Append(test::AsTensor<int32>({1, 2}, {1, 2})).code());
+  EXPECT_EQ(0, batch.num_rows());
+}
+
+TEST(SplitAsSlicesTest, AlignedPiecesShareTheInput) {
+  // Rows of 16 floats are 64 bytes, so every piece is aligned.
+  Tensor input(DT_FLOAT, TensorShape({4, 16}));
+  input.flat<float>().setZero();
+  std::vector<Tensor> outputs;
+  TF_ASSERT_OK(SplitAsSlices(input, {1, 3}, &outputs));
+  ASSERT_EQ(2, outputs.size());
+  EXPECT_EQ(TensorShape({1, 16}), outputs[0].shape());
+  EXPECT_EQ(TensorShape({3, 16}), outputs[1].shape());
+  EXPECT_TRUE(outputs[0].SharesBufferWith(input));
+  EXPECT_TRUE(outputs[1].SharesBufferWith(input));
+}
+
+TEST(SplitAsSlicesTest, UnalignedPiecesAreCopied) {
+  Tensor input = test::AsTensor<float>({1.0, 2.0, 3.0, 4.0});
+  std::vector<Tensor> outputs;
+  TF_ASSERT_OK(SplitAsSlices(input, {1, 0, 3}, &outputs));
+  ASSERT_EQ(3, outputs.size());
+  EXPECT_TRUE(outputs[0].SharesBufferWith(input));
+  EXPECT_FALSE(outputs[2].SharesBufferWith(input));
+  EXPECT_TRUE(outputs[2].IsAligned());
+  test::ExpectTensorEqual<float>(test::AsTensor<float>({1.0}), outputs[0]);
+  EXPECT_EQ(0, outputs[1].NumElements());
+  test::ExpectTensorEqual<float>(test::AsTensor<float>({2.0, 3.0, 4.0}),
+                                 outputs[2]);
+}
+
+TEST(SplitAsSlicesTest, InvalidSizes) {
+  Tensor input = test::AsTensor<float>({1.0, 2.0, 3.0, 4.0});
+  std::vector<Tensor> outputs;
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            SplitAsSlices(input, {1, 2}, &outputs).code());
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            SplitAsSlices(Tensor(1.0f), {1}, &outputs).code());
+}
+
+}  // namespace
+}  // namespace serving
+}  // namespace tensorflow
@@ -214,6 +214,32 @@ void RecordBatchDelayUsV2(int64_t batch_delay_us, const string& model_name,
       ->Add(static_cast<double>(batch_delay_us));
 }
 
+void RecordQueuingDelayUs(int64_t queuing_delay_us, const string& model_name,
+                          const string& op_name, bool low_priority) {
+  static auto* cell = tensorflow::monitoring::Sampler<3>::New(
+      {"/tensorflow/serving/batching/queuing_delay_us",
+       "Tracks the time (in microseconds) inputs spend enqueued before their "
+       "batch is processed, by model_name (if available) and priority.",
+       "model_name", "op_name", "priority"},
+      // It's 27 buckets with the last bucket being 2^26 to DBL_MAX;
+      // so the limits are [1, 2, 4, 8, ..., 64 * 1024 * 1024, DBL_MAX].
+      monitoring::Buckets::Exponential(1, 2, 27));
+  cell->GetCell(model_name, op_name, low_priority ? "low" : "high")
+      ->Add(static_cast<double>(queuing_delay_us));
+}
+
+void RecordDeadlineMissUs(int64_t deadline_miss_us, const string& model_name,
+                          const string& op_name) {
+  static auto* cell = tensorflow::monitoring::Sampler<2>::New(
+      {"/tensorflow/serving/batching/deadline_miss_us",
+       "Tracks by how long (in microseconds) inputs dropped from the batch "
+       "queue missed their deadline, by model_name (if available).",
+       "model_name", "op_name"},
+      monitoring::Buckets::Exponential(1, 2, 27));
+  cell->GetCell(model_name, op_name)
+      ->Add(static_cast<double>(deadline_miss_us));
+}
+
 void RecordBatchParamBatchTimeoutMicros(int64_t batch_timeout_micros,
                                         const string& model_name,
                                         const string& op_name) {
@@ -287,6 +313,24 @@ const string& GetModelName(OpKernelContext* ctx) {
   return ctx->session_metadata()->name();
 }
 
+bool IsLowPriorityTask(const BatchResourceBase::BatchTask& task) {
+  return task.criticality() == tsl::criticality::Criticality::kSheddablePlus ||
+         task.criticality() == tsl::criticality::Criticality::kSheddable;
+}
+
+// Completes a task that missed its deadline while enqueued.
+void FailExpiredTask(std::unique_ptr<BatchResourceBase::BatchTask> task) {
+  const uint64 now_micros = EnvTime::NowMicros();
+  RecordDeadlineMissUs(now_micros - task->deadline_micros(),
+                       GetModelName(task->context),
+                       task->context->op_kernel().name());
+  WithContext wc(task->propagated_context);
+  task->status->Update(absl::DeadlineExceededError(absl::StrCat(
+      "Batching input missed its deadline by ",
+      now_micros - task->deadline_micros(), " us while enqueued.")));
+  task->done_callback();
+}
+
 // Returns the sum of the task sizes. The caller must guarantee that the
 // unique_ptrs in the argument vectors are not null.
 int GetTotalTaskSize(
@@ -316,6 +360,7 @@ BatchResourceBase::BatchTask::CreateSplitTask(
   task->status = this->status;
   task->is_partial = true;
   task->start_time = this->start_time;
+  task->deadline_micros_val = this->deadline_micros_val;
   task->request_cost = this->request_cost;
   task->forced_warmup_batch_size = this->forced_warmup_batch_size;
 
@@ -380,6 +425,10 @@ Status BatchResourceBase::RegisterInput(
   TF_ASSIGN_OR_RETURN(std::unique_ptr<BatchTask> batch_components,
                       create_batch_task_fn());
   batch_components->start_time = EnvTime::NowNanos();
+  if (context->deadline().has_value()) {
+    batch_components->deadline_micros_val = static_cast<uint64>(
+        std::max<int64_t>(0, absl::ToUnixMicros(*context->deadline())));
+  }
   batch_components->guid = guid;
   batch_components->propagated_context = Context(ContextKind::kThread);
 
@@ -535,7 +584,8 @@ BatchResourceBase::GetBatcherQueueOptions(
     int32_t low_priority_batch_timeout_micros,
     int32_t low_priority_max_enqueued_batches,
     const std::vector<int32>& low_priority_allowed_batch_sizes,
-    MixedPriorityBatchingPolicy mixed_priority_batching_policy) {
+    MixedPriorityBatchingPolicy mixed_priority_batching_policy,
+    bool enable_earliest_deadline_first, int64_t deadline_margin_micros) {
   BatcherT::QueueOptions batcher_queue_options;
   batcher_queue_options.input_batch_size_limit = max_batch_size;
   batcher_queue_options.max_enqueued_batches = max_enqueued_batches;
@@ -592,6 +642,12 @@ BatchResourceBase::GetBatcherQueueOptions(
     }
   }
   batcher_queue_options.disable_padding = disable_padding;
+  if (enable_earliest_deadline_first) {
+    batcher_queue_options.deadline_margin_micros = deadline_margin_micros;
+    // Inputs whose step deadline passed while enqueued are failed instead of
+    // being batched; their outputs would be discarded anyway.
+    batcher_queue_options.expired_task_callback = &FailExpiredTask;
+  }
 
   return batcher_queue_options;
 }
@@ -751,14 +807,49 @@ Status BatchResourceBase::ConcatInputTensors(
     }
 
     Tensor concatenated_tensor;
-    Status concat_status =
-        Concat(context, to_concatenate, &concatenated_tensor);
-    TF_RETURN_IF_ERROR(concat_status);
+    if (!enable_zero_copy_batching_) {
+      Status concat_status =
+          Concat(context, to_concatenate, &concatenated_tensor);
+      TF_RETURN_IF_ERROR(concat_status);
+    } else if (to_concatenate.size() == 1) {
+      // A lone unpadded input is already the batch.
+      concatenated_tensor = std::move(to_concatenate[0]);
+    } else {
+      TF_RETURN_IF_ERROR(AssembleInPooledBuffer(context, to_concatenate,
+                                                &concatenated_tensor));
+    }
     concatenated_tensors->push_back(concatenated_tensor);
   }
   return absl::OkStatus();
 }
 
+Status BatchResourceBase::AssembleInPooledBuffer(
+    OpKernelContext* context, absl::Span<const Tensor> inputs,
+    Tensor* batched) const {
+  int64_t num_rows = 0;
+  for (const Tensor& input : inputs) {
+    num_rows += input.dim_size(0);
+  }
+  // With allowed batch sizes, batches are already padded to one of them.
+  // Otherwise, rounding the buffer up to a power of two bounds the number of
+  // distinct shapes in the pool.
+  int64_t capacity = num_rows;
+  if (allowed_batch_sizes_.empty()) {
+    capacity = 1;
+    while (capacity < num_rows) capacity <<= 1;
+  }
+  TensorShape buffer_shape = inputs[0].shape();
+  buffer_shape.set_dim(0, capacity);
+  BatchBuffer buffer(batch_buffer_pool_.Acquire(
+      context->get_allocator(AllocatorAttributes()), inputs[0].dtype(),
+      buffer_shape));
+  for (const Tensor& input : inputs) {
+    TF_RETURN_IF_ERROR(buffer.Append(input));
+  }
+  *batched = buffer.Finish();
+  return absl::OkStatus();
+}
+
 /*static*/ Status BatchResourceBase::SplitInputTask(
     std::unique_ptr<BatchTask>* input_task_ptr, int open_batch_remaining_slot,
     int max_batch_size, std::vector<std::unique_ptr<BatchTask>>* output_tasks) {
@@ -908,8 +999,17 @@ Status BatchResourceBase::SplitOutputTensors(
     }
 
     std::vector<Tensor> split_tensor;
-    const Status split_status = tensor::Split(
-        output_tensor, task_sizes_plus_optional_padding, &split_tensor);
+    Status split_status;
+    if (!enable_zero_copy_batching_) {
+      split_status = tensor::Split(
+          output_tensor, task_sizes_plus_optional_padding, &split_tensor);
+    } else if (task_sizes_plus_optional_padding.size() == 1) {
+      // A lone unpadded task gets the whole batched output.
+      split_tensor.push_back(output_tensor);
+    } else {
+      split_status = SplitAsSlices(
+          output_tensor, task_sizes_plus_optional_padding, &split_tensor);
+    }
     DCHECK(split_status.ok()) << split_status;
     if (!split_status.ok()) {
       return errors::Internal("Tensor split operation failed: ",
@@ -1041,6 +1141,14 @@ void BatchResourceBase::ProcessFuncBatch(
     RecordBatchDelayUsV2((current_time - batch->task(i).start_time) * 1e-3,
                          model_name, last_task_context->op_kernel().name(),
                          processed_size);
+    RecordQueuingDelayUs((current_time - batch->task(i).start_time) / 1000,
+                         model_name, last_task_context->op_kernel().name(),
+                         IsLowPriorityTask(batch->task(i)));
+  }
+  for (const std::unique_ptr<BatchTask>& task : unbatched_tasks) {
+    RecordQueuingDelayUs((current_time - task->start_time) / 1000, model_name,
+                         last_task_context->op_kernel().name(),
+                         /*low_priority=*/true);
   }
   // Releases the cleanup method here, because the callback of the function
   // library runtime will handle it now.
@@ -1208,6 +1316,10 @@ Status BatchResourceBase::LookupOrCreateBatcherQueue(const string& queue_name,
     BatcherT::QueueOptions batcher_queue_options = batcher_queue_options_;
     batcher_queue_options.model_batch_stats = &GlobalBatchStatsRegistry().model(
         /* model_name= */ model_name, /* op_name= */ op_name);
+    if (batcher_queue_options.enable_lazy_split) {
+      // Lazy split doesn't support dropping expired tasks.
+      batcher_queue_options.expired_task_callback = nullptr;
+    }
 
     TF_RETURN_IF_ERROR(batcher_->AddQueue(
         batcher_queue_options,
@@ -1218,8 +1330,17 @@ Status BatchResourceBase::LookupOrCreateBatcherQueue(const string& queue_name,
         reduced_process_batch_callback = [this](std::unique_ptr<BatchT> batch) {
           ProcessBatchCallBack(std::move(batch), {});
         };
+    AdaptiveBatcherT::QueueOptions adaptive_batcher_queue_options =
+        adaptive_batcher_queue_options_;
+    if (adaptive_batcher_queue_options.batch_size_controller_options
+            .has_value()) {
+      adaptive_batcher_queue_options.batch_size_controller_options->model_name =
+          model_name;
+      adaptive_batcher_queue_options.batch_size_controller_options->op_name =
+          op_name;
+    }
     TF_RETURN_IF_ERROR(adaptive_batcher_->AddQueue(
-        adaptive_batcher_queue_options_, reduced_process_batch_callback,
+        adaptive_batcher_queue_options, reduced_process_batch_callback,
         &new_queue));
   } else {
     return errors::Internal("No batcher defined.");
@@ -34,6 +34,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/kernels/batching_util/adaptive_shared_batch_scheduler.h"
+#include "tensorflow/core/kernels/batching_util/batch_buffer_pool.h"
 #include "tensorflow/core/kernels/batching_util/batch_scheduler.h"
 #include "tensorflow/core/kernels/batching_util/batch_scheduler_utils.h"
 #include "tensorflow/core/kernels/batching_util/shared_batch_scheduler.h"
@@ -137,6 +138,13 @@ class BatchResourceBase : public ResourceBase {
       return criticality_val;
     };
 
+    // Time, in Env::NowMicros() units, by which the task must start
+    // processing. Set from the deadline of the step running the batch op, if
+    // any; tasks still enqueued past it fail with DEADLINE_EXCEEDED.
+    uint64 deadline_micros_val = kNoDeadline;
+
+    uint64 deadline_micros() const override { return deadline_micros_val; }
+
     // If nonzero, make a batch of this size entirely out of padding. This
     // batch is processed, but is not propagated to the kernel outputs.
     int forced_warmup_batch_size = 0;
@@ -186,6 +194,16 @@ class BatchResourceBase : public ResourceBase {
 
   const SessionMetadata& session_metadata() const { return session_metadata_; }
 
+  // If true, batched inputs are assembled in pooled buffers rather than newly
+  // allocated ones, and the outputs of each task share the buffer of the
+  // batched output wherever alignment allows, instead of being copied out of
+  // it. The latter keeps a whole batched output alive for as long as any task
+  // holds its slice, hence it is opt-in. Must be set before the first input is
+  // registered.
+  void set_enable_zero_copy_batching(bool enable) {
+    enable_zero_copy_batching_ = enable;
+  }
+
   using CreateBatchTaskFn =
       std::function<StatusOr<std::unique_ptr<BatchTask>>()>;
 
@@ -221,7 +239,9 @@ class BatchResourceBase : public ResourceBase {
       int32_t low_priority_batch_timeout_micros,
       int32_t low_priority_max_enqueued_batches,
       const std::vector<int32>& low_priority_allowed_batch_sizes,
-      MixedPriorityBatchingPolicy mixed_priority_batching_policy);
+      MixedPriorityBatchingPolicy mixed_priority_batching_policy,
+      bool enable_earliest_deadline_first = false,
+      int64_t deadline_margin_micros = 0);
 
   static AdaptiveBatcherT::QueueOptions GetAdaptiveBatcherQueueOptions(
       int32_t max_batch_size, int32_t batch_timeout_micros,
@@ -308,6 +328,12 @@ class BatchResourceBase : public ResourceBase {
       OpKernelContext* context,
       std::vector<Tensor>* concatenated_tensors) const;
 
+  // Concatenates `inputs` along the 0th dimension in a buffer from
+  // `batch_buffer_pool_`, allocated by the allocator of `context`.
+  Status AssembleInPooledBuffer(OpKernelContext* context,
+                                absl::Span<const Tensor> inputs,
+                                Tensor* batched) const;
+
   Status SplitOutputTensors(
       const std::vector<Tensor>& combined_outputs, BatchT* batch,
       std::vector<std::unique_ptr<BatchTask>>& unbatched_tasks) const;
@@ -372,6 +398,10 @@ class BatchResourceBase : public ResourceBase {
   // A concatenated string of <allowed_batch_sizes_>, separated by ",". This is
   // used to record batching parameter.
   string allowed_batch_sizes_str_;
+
+  // See set_enable_zero_copy_batching().
+  bool enable_zero_copy_batching_ = false;
+  mutable BatchBufferPool batch_buffer_pool_;
 };
 
 }  // namespace serving
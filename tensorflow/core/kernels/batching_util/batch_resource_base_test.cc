@@ -37,6 +37,7 @@ limitations under the License.
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/kernels/batching_util/batch_scheduler.h"
@@ -418,6 +419,33 @@ TEST(SplitBatchCostsAndRecordMetricsTest, GlobalBatchStatsProcessedSize) {
             original_cumulative_processed_size + 4);
 }
 
+TEST(GetBatcherQueueOptionsTest, DeadlineSchedulingIsOptIn) {
+  BatchResourceBase::BatcherT::QueueOptions default_options =
+      BatchResourceBase::GetBatcherQueueOptions(
+          /*num_batch_threads=*/1, /*max_batch_size=*/4,
+          /*batch_timeout_micros=*/0, /*max_enqueued_batches=*/1,
+          /*allowed_batch_sizes=*/{}, /*enable_large_batch_splitting=*/false,
+          /*disable_padding=*/false);
+  EXPECT_EQ(default_options.deadline_margin_micros, 0);
+  EXPECT_FALSE(default_options.expired_task_callback);
+
+  BatchResourceBase::BatcherT::QueueOptions deadline_options =
+      BatchResourceBase::GetBatcherQueueOptions(
+          /*num_batch_threads=*/1, /*max_batch_size=*/4,
+          /*batch_timeout_micros=*/0, /*max_enqueued_batches=*/1,
+          /*allowed_batch_sizes=*/{}, /*enable_large_batch_splitting=*/false,
+          /*disable_padding=*/false, /*batch_padding_policy=*/"PAD_UP",
+          /*low_priority_max_batch_size=*/0,
+          /*low_priority_batch_timeout_micros=*/0,
+          /*low_priority_max_enqueued_batches=*/0,
+          /*low_priority_allowed_batch_sizes=*/{},
+          MixedPriorityBatchingPolicy::kLowPriorityPaddingWithMaxBatchSize,
+          /*enable_earliest_deadline_first=*/true,
+          /*deadline_margin_micros=*/100);
+  EXPECT_EQ(deadline_options.deadline_margin_micros, 100);
+  EXPECT_TRUE(deadline_options.expired_task_callback);
+}
+
 class BatchResourceBaseTest : public ::testing::Test {
  protected:
   // Like BatchResourceBase but overrides abstract methods, one of which
@@ -444,6 +472,29 @@ class BatchResourceBaseTest : public ::testing::Test {
     mutable Notification process_func_batch_called_;
   };
 
+  // Like MyBatchResource but runs the identity function on the first batched
+  // input, which it exposes as batched_input().
+  class IdentityBatchResource : public BatchResourceBase {
+   public:
+    using BatchResourceBase::BatchResourceBase;
+
+    std::string DebugString() const override { return ""; }
+
+    void ProcessFuncBatchImpl(
+        const BatchResourceBase::BatchTask& /* last_task */,
+        absl::Span<const Tensor> inputs, std::vector<Tensor>* combined_outputs,
+        std::function<void(const absl::Status&)> done) const override {
+      batched_input_ = inputs[0];
+      combined_outputs->push_back(inputs[0]);
+      done(absl::OkStatus());
+    }
+
+    const Tensor& batched_input() const { return batched_input_; }
+
+   private:
+    mutable Tensor batched_input_;
+  };
+
   BatchResourceBaseTest() {
     // The whole point of this test fixture is to create a usable batch function
     // context, context_.
@@ -507,6 +558,40 @@ class BatchResourceBaseTest : public ::testing::Test {
     context_ = std::make_unique<OpKernelContext>(&params_);
   }
 
+  // Runs input_tensor_ through an IdentityBatchResource as a batch of its own,
+  // and returns the batched input the resource got and the output of the task.
+  void RunLoneTask(bool enable_zero_copy_batching, Tensor* batched_input,
+                   Tensor* output) {
+    std::shared_ptr<SharedBatchScheduler<BatchResourceBase::BatchTask>>
+        batcher;
+    TF_CHECK_OK(SharedBatchScheduler<BatchResourceBase::BatchTask>::Create(
+        {}, &batcher));
+    IdentityBatchResource* batch_resource = new IdentityBatchResource(
+        /* has_process_batch_function */ true,
+        /* batcher= */ batcher,
+        /* batcher_queue_options */ {},
+        /* allowed_batch_sizes */ {});
+    batch_resource->set_enable_zero_copy_batching(enable_zero_copy_batching);
+
+    Notification done;
+    TF_CHECK_OK(batch_resource->RegisterInput(
+        /* guid= */
+        0, /* context= */ context_.get(),
+        /* batcher_queue_name= */ "batcher_queue_name",
+        /* create_batch_task_fn= */
+        []() -> absl::StatusOr<std::unique_ptr<BatchResourceBase::BatchTask>> {
+          return std::make_unique<BatchResourceBase::BatchTask>();
+        },
+        /* done_callback= */ [&done] { done.Notify(); },
+        /* forced_warmup_batch_size= */ 0));
+    done.WaitForNotification();
+    TF_CHECK_OK(context_->status());
+
+    *batched_input = batch_resource->batched_input();
+    *output = *context_->mutable_output(0);
+    batch_resource->Unref();
+  }
+
   std::unique_ptr<Device> device_;
 
   std::unique_ptr<OpKernel> batch_kernel_;
@@ -622,6 +707,30 @@ TEST_F(BatchResourceBaseTest, ConfiguredBatchPaddingPolicyMetric) {
   my_batch_resource->Unref();
 }
 
+TEST_F(BatchResourceBaseTest, CopiesLoneTaskByDefault) {
+  input_tensor_.flat<int64_t>().setConstant(7);
+  Tensor batched_input;
+  Tensor output;
+  RunLoneTask(/* enable_zero_copy_batching= */ false, &batched_input, &output);
+
+  EXPECT_EQ(input_tensor_.shape(), batched_input.shape());
+  EXPECT_FALSE(batched_input.SharesBufferWith(input_tensor_));
+  EXPECT_EQ(input_tensor_.shape(), output.shape());
+  EXPECT_FALSE(output.SharesBufferWith(batched_input));
+  test::ExpectTensorEqual<int64_t>(input_tensor_, output);
+}
+
+TEST_F(BatchResourceBaseTest, PassesLoneTaskThroughWithZeroCopyBatching) {
+  input_tensor_.flat<int64_t>().setConstant(7);
+  Tensor batched_input;
+  Tensor output;
+  RunLoneTask(/* enable_zero_copy_batching= */ true, &batched_input, &output);
+
+  EXPECT_TRUE(batched_input.SharesBufferWith(input_tensor_));
+  EXPECT_TRUE(output.SharesBufferWith(batched_input));
+  test::ExpectTensorEqual<int64_t>(input_tensor_, output);
+}
+
 }  // namespace
 }  // namespace serving
 }  // namespace tensorflow
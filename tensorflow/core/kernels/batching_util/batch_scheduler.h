@@ -33,6 +33,7 @@ limitations under the License.
 #include <cstddef>
 #include <deque>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <utility>
@@ -91,6 +92,14 @@ class BatchTask {
   virtual tsl::criticality::Criticality criticality() const {
     return tsl::criticality::Criticality::kCritical;
   }
+
+  // Value of deadline_micros() for tasks without a deadline.
+  static constexpr uint64 kNoDeadline = std::numeric_limits<uint64>::max();
+
+  // Returns the time, in Env::NowMicros() units, by which processing of the
+  // task should start. Schedulers may use it to order batches and to drop
+  // tasks that can no longer meet it. It defaults to kNoDeadline.
+  virtual uint64 deadline_micros() const { return kNoDeadline; }
 };
 
 // A thread-safe collection of BatchTasks. Tasks can be either added or removed
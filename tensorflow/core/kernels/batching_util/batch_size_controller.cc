@@ -0,0 +1,258 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/batching_util/batch_size_controller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/kernels/batching_util/batch_scheduler_utils.h"
+#include "tensorflow/core/lib/monitoring/gauge.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace tensorflow {
+namespace serving {
+namespace {
+
+// The size is stepped up only while the p99 latency is below this fraction of
+// the target, to leave headroom for load spikes.
+constexpr double kLatencyHeadroom = 0.8;
+// Batches are considered to fill up if their mean size is at least this
+// fraction of the maximum batch size.
+constexpr double kFullBatchFraction = 0.8;
+// A step up that lowers the processing rate by more than this fraction is
+// reverted.
+constexpr double kMinEfficiencyGain = -0.05;
+
+void RecordAdaptiveMaxBatchSize(int64_t max_batch_size,
+                                const std::string& model_name,
+                                const std::string& op_name) {
+  static auto* cell = monitoring::Gauge<int64_t, 2>::New(
+      "/tensorflow/serving/batching/adaptive_max_batch_size",
+      "Tracks the maximum batch size chosen by the batch size controller.",
+      "model_name", "op_name");
+  cell->GetCell(model_name, op_name)->Set(max_batch_size);
+}
+
+void RecordAdaptiveBatchTimeoutMicros(int64_t batch_timeout_micros,
+                                      const std::string& model_name,
+                                      const std::string& op_name) {
+  static auto* cell = monitoring::Gauge<int64_t, 2>::New(
+      "/tensorflow/serving/batching/adaptive_batch_timeout_micros",
+      "Tracks the batch timeout chosen by the batch size controller.",
+      "model_name", "op_name");
+  cell->GetCell(model_name, op_name)->Set(batch_timeout_micros);
+}
+
+void RecordAdaptiveP99LatencyMicros(int64_t p99_latency_micros,
+                                    const std::string& model_name,
+                                    const std::string& op_name) {
+  static auto* cell = monitoring::Gauge<int64_t, 2>::New(
+      "/tensorflow/serving/batching/adaptive_p99_latency_micros",
+      "Tracks the p99 batch latency observed by the batch size controller in "
+      "its last adjustment window.",
+      "model_name", "op_name");
+  cell->GetCell(model_name, op_name)->Set(p99_latency_micros);
+}
+
+void RecordAdaptivePaddingFraction(double padding_fraction,
+                                   const std::string& model_name,
+                                   const std::string& op_name) {
+  static auto* cell = monitoring::Gauge<double, 2>::New(
+      "/tensorflow/serving/batching/adaptive_padding_fraction",
+      "Tracks the fraction of padded rows observed by the batch size "
+      "controller in its last adjustment window.",
+      "model_name", "op_name");
+  cell->GetCell(model_name, op_name)->Set(padding_fraction);
+}
+
+std::vector<int> CandidateSizes(const std::vector<int32>& allowed_batch_sizes,
+                                int max_batch_size) {
+  std::vector<int> sizes;
+  if (allowed_batch_sizes.empty()) {
+    for (int size = 1; size < max_batch_size; size *= 2) {
+      sizes.push_back(size);
+    }
+  } else {
+    for (const int32 size : allowed_batch_sizes) {
+      if (size < max_batch_size) sizes.push_back(size);
+    }
+  }
+  sizes.push_back(max_batch_size);
+  return sizes;
+}
+
+}  // namespace
+
+/*static*/ Status BatchSizeController::Create(
+    const Options& options, int max_batch_size, int64_t batch_timeout_micros,
+    std::shared_ptr<BatchSizeController>* controller) {
+  if (options.target_p99_latency_micros <= 0) {
+    return errors::InvalidArgument(
+        "target_p99_latency_micros must be positive; was ",
+        options.target_p99_latency_micros);
+  }
+  if (options.min_batch_timeout_micros < 0 ||
+      options.max_batch_timeout_micros < options.min_batch_timeout_micros) {
+    return errors::InvalidArgument(
+        "Batch timeout bounds must satisfy 0 <= min_batch_timeout_micros <= "
+        "max_batch_timeout_micros; got ",
+        options.min_batch_timeout_micros, " and ",
+        options.max_batch_timeout_micros);
+  }
+  if (options.batches_per_adjustment < 1) {
+    return errors::InvalidArgument(
+        "batches_per_adjustment must be positive; was ",
+        options.batches_per_adjustment);
+  }
+  if (max_batch_size <= 0) {
+    return errors::InvalidArgument("max_batch_size must be positive; was ",
+                                   max_batch_size);
+  }
+  if (!std::is_sorted(options.allowed_batch_sizes.begin(),
+                      options.allowed_batch_sizes.end())) {
+    return errors::InvalidArgument(
+        "allowed_batch_sizes must be in increasing order");
+  }
+  std::vector<int> candidate_sizes =
+      CandidateSizes(options.allowed_batch_sizes, max_batch_size);
+  const int size_index = candidate_sizes.size() - 1;
+  controller->reset(new BatchSizeController(
+      options, std::move(candidate_sizes), size_index,
+      std::clamp(batch_timeout_micros, options.min_batch_timeout_micros,
+                 options.max_batch_timeout_micros)));
+  return absl::OkStatus();
+}
+
+BatchSizeController::BatchSizeController(const Options& options,
+                                         std::vector<int> candidate_sizes,
+                                         int size_index,
+                                         int64_t batch_timeout_micros)
+    : options_(options),
+      candidate_sizes_(std::move(candidate_sizes)),
+      size_index_(size_index),
+      batch_timeout_micros_(batch_timeout_micros),
+      size_index_ceiling_(size_index) {
+  latencies_micros_.reserve(options_.batches_per_adjustment);
+  mutex_lock l(mu_);
+  ExportMetrics(/*p99_latency_micros=*/0, /*padding_fraction=*/0);
+}
+
+void BatchSizeController::RecordBatch(int batch_size, int64_t latency_micros,
+                                      int64_t processing_micros) {
+  mutex_lock l(mu_);
+  latencies_micros_.push_back(latency_micros);
+  num_rows_ += batch_size;
+  num_padded_rows_ +=
+      GetNextAllowedBatchSize(batch_size, options_.allowed_batch_sizes,
+                              /*disable_padding=*/false) -
+      batch_size;
+  total_processing_micros_ += processing_micros;
+  if (latencies_micros_.size() >= options_.batches_per_adjustment) {
+    Adjust();
+  }
+}
+
+void BatchSizeController::Adjust() {
+  const int64_t num_batches = latencies_micros_.size();
+  auto p99_it = latencies_micros_.begin() +
+                static_cast<int64_t>(std::ceil(0.99 * num_batches)) - 1;
+  std::nth_element(latencies_micros_.begin(), p99_it, latencies_micros_.end());
+  const int64_t p99_latency_micros = *p99_it;
+  const double padding_fraction =
+      num_padded_rows_ == 0
+          ? 0
+          : static_cast<double>(num_padded_rows_) /
+                (num_rows_ + num_padded_rows_);
+  // Queueing time depends on the load rather than on the batch size, so the
+  // efficiency of a size is measured from the processing time only.
+  const double rows_per_second =
+      total_processing_micros_ == 0
+          ? 0
+          : num_rows_ * 1e6 / total_processing_micros_;
+  const double fill_fraction = static_cast<double>(num_rows_) / num_batches /
+                               candidate_sizes_[size_index_];
+
+  int size_index = size_index_;
+  int64_t batch_timeout_micros = batch_timeout_micros_;
+  bool step_up = false;
+  if (p99_latency_micros > options_.target_p99_latency_micros) {
+    // Over the target: smaller batches finish sooner, and a shorter timeout
+    // cuts queueing.
+    size_index = std::max(size_index - 1, 0);
+    batch_timeout_micros =
+        std::max(batch_timeout_micros / 2, options_.min_batch_timeout_micros);
+    size_index_ceiling_ = candidate_sizes_.size() - 1;
+  } else if (last_step_was_up_ && last_rows_per_second_ > 0 &&
+             rows_per_second <
+                 last_rows_per_second_ * (1 + kMinEfficiencyGain)) {
+    // The last step up didn't pay off; go back and stay there.
+    size_index = std::max(size_index - 1, 0);
+    size_index_ceiling_ = size_index;
+  } else if (p99_latency_micros <
+             kLatencyHeadroom * options_.target_p99_latency_micros) {
+    if (fill_fraction >= kFullBatchFraction &&
+        size_index < size_index_ceiling_) {
+      ++size_index;
+      step_up = true;
+    } else if (padding_fraction > options_.max_padding_fraction) {
+      // Batches leave underfilled: waiting longer pads less.
+      batch_timeout_micros = std::min(
+          std::max(2 * batch_timeout_micros,
+                   options_.min_batch_timeout_micros +
+                       (options_.max_batch_timeout_micros -
+                        options_.min_batch_timeout_micros) /
+                           8),
+          options_.max_batch_timeout_micros);
+    }
+  }
+  VLOG(2) << "Batch size controller: p99_latency_micros="
+          << p99_latency_micros << " padding_fraction=" << padding_fraction
+          << " fill_fraction=" << fill_fraction
+          << " rows_per_second=" << rows_per_second
+          << " max_batch_size=" << candidate_sizes_[size_index]
+          << " batch_timeout_micros=" << batch_timeout_micros;
+
+  size_index_ = size_index;
+  batch_timeout_micros_ = batch_timeout_micros;
+  last_rows_per_second_ = rows_per_second;
+  last_step_was_up_ = step_up;
+  latencies_micros_.clear();
+  num_rows_ = 0;
+  num_padded_rows_ = 0;
+  total_processing_micros_ = 0;
+  ExportMetrics(p99_latency_micros, padding_fraction);
+}
+
+void BatchSizeController::ExportMetrics(int64_t p99_latency_micros,
+                                        double padding_fraction) {
+  RecordAdaptiveMaxBatchSize(max_batch_size(), options_.model_name,
+                             options_.op_name);
+  RecordAdaptiveBatchTimeoutMicros(batch_timeout_micros(), options_.model_name,
+                                   options_.op_name);
+  RecordAdaptiveP99LatencyMicros(p99_latency_micros, options_.model_name,
+                                 options_.op_name);
+  RecordAdaptivePaddingFraction(padding_fraction, options_.model_name,
+                                options_.op_name);
+}
+
+}  // namespace serving
+}  // namespace tensorflow
@@ -0,0 +1,136 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_BATCHING_UTIL_BATCH_SIZE_CONTROLLER_H_
+#define TENSORFLOW_CORE_KERNELS_BATCHING_UTIL_BATCH_SIZE_CONTROLLER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace serving {
+
+// Tunes the maximum batch size and the batch timeout of a batching queue from
+// the latency and padding of the batches it produced, so that throughput is
+// maximized while the 99th percentile batch latency stays under a target.
+//
+// The maximum batch size moves along a ladder of candidate sizes: the allowed
+// batch sizes if any, so that full batches need no padding, or else powers of
+// two. Every `batches_per_adjustment` batches, the controller
+//   - steps the size down and halves the timeout if the p99 latency is above
+//     the target;
+//   - if the p99 latency is comfortably below the target, steps the size up
+//     when batches fill up (larger batches amortize more work), unless the
+//     last step up made processing less efficient, or else lengthens the
+//     timeout when underfilled batches waste too much padding.
+// This replaces hand-tuning these parameters per model and hardware.
+//
+// Its state is exported through /tensorflow/serving/batching/adaptive_*
+// gauges, labeled by `model_name` and `op_name`.
+//
+// Thread-safe.
+class BatchSizeController {
+ public:
+  struct Options {
+    // Target for the 99th percentile latency of a batch, from its creation
+    // to the end of its processing. Must be positive.
+    int64_t target_p99_latency_micros = 0;
+    // Sizes the maximum batch size may take, in increasing order. Batches are
+    // assumed to be padded up to the next allowed size. If empty, batches are
+    // not padded, and the maximum batch size takes power-of-two values.
+    std::vector<int32> allowed_batch_sizes;
+    // Bounds of the batch timeout.
+    int64_t min_batch_timeout_micros = 0;
+    int64_t max_batch_timeout_micros = 10 * 1000;
+    // Number of batches between adjustments. Larger values give less noisy
+    // percentiles, but react more slowly to load changes.
+    int64_t batches_per_adjustment = 100;
+    // Fraction of padded rows above which the timeout is lengthened.
+    double max_padding_fraction = 0.1;
+    // Labels of the exported metrics.
+    std::string model_name;
+    std::string op_name;
+  };
+
+  // Creates a controller whose maximum batch size starts at (and never
+  // exceeds) `max_batch_size`, and whose timeout starts at
+  // `batch_timeout_micros`, clamped to the configured bounds.
+  static Status Create(const Options& options, int max_batch_size,
+                       int64_t batch_timeout_micros,
+                       std::shared_ptr<BatchSizeController>* controller);
+
+  // Current maximum batch size.
+  int max_batch_size() const {
+    return candidate_sizes_[size_index_.load(std::memory_order_relaxed)];
+  }
+
+  // Current batch timeout.
+  int64_t batch_timeout_micros() const {
+    return batch_timeout_micros_.load(std::memory_order_relaxed);
+  }
+
+  // Reports a batch of `batch_size` rows (before padding) that took
+  // `latency_micros` from its creation to the end of its processing, of which
+  // `processing_micros` were spent processing it.
+  void RecordBatch(int batch_size, int64_t latency_micros,
+                   int64_t processing_micros);
+
+ private:
+  BatchSizeController(const Options& options, std::vector<int> candidate_sizes,
+                      int size_index, int64_t batch_timeout_micros);
+
+  // Adjusts the parameters from the batches recorded since the last call.
+  void Adjust() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  void ExportMetrics(int64_t p99_latency_micros, double padding_fraction)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const Options options_;
+  // Increasing candidate values of the maximum batch size.
+  const std::vector<int> candidate_sizes_;
+
+  std::atomic<int> size_index_;
+  std::atomic<int64_t> batch_timeout_micros_;
+
+  mutex mu_;
+  // Latencies of the batches recorded since the last adjustment.
+  std::vector<int64_t> latencies_micros_ TF_GUARDED_BY(mu_);
+  int64_t num_rows_ TF_GUARDED_BY(mu_) = 0;
+  int64_t num_padded_rows_ TF_GUARDED_BY(mu_) = 0;
+  int64_t total_processing_micros_ TF_GUARDED_BY(mu_) = 0;
+  // Rows processed per second of batch processing in the previous window, and
+  // whether the size was stepped up at the end of it.
+  double last_rows_per_second_ TF_GUARDED_BY(mu_) = 0;
+  bool last_step_was_up_ TF_GUARDED_BY(mu_) = false;
+  // Index above which stepping up was found not to pay off. Reset whenever the
+  // latency target forces a step down, as the workload may have changed.
+  int size_index_ceiling_ TF_GUARDED_BY(mu_);
+
+  BatchSizeController(const BatchSizeController&) = delete;
+  void operator=(const BatchSizeController&) = delete;
+};
+
+}  // namespace serving
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_BATCHING_UTIL_BATCH_SIZE_CONTROLLER_H_
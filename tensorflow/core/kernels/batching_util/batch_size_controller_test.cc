@@ -0,0 +1,167 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/batching_util/batch_size_controller.h"
+
+#include <memory>
+
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace serving {
+namespace {
+
+BatchSizeController::Options TestOptions() {
+  BatchSizeController::Options options;
+  options.target_p99_latency_micros = 1000;
+  options.allowed_batch_sizes = {8, 16, 32, 64};
+  options.min_batch_timeout_micros = 0;
+  options.max_batch_timeout_micros = 800;
+  options.batches_per_adjustment = 10;
+  return options;
+}
+
+// Records a window of batches of `batch_size` rows taking `latency_micros`,
+// all of it processing unless `processing_micros` is given.
+void RecordWindow(BatchSizeController* controller, int batch_size,
+                  int64_t latency_micros, int64_t processing_micros = -1) {
+  if (processing_micros < 0) processing_micros = latency_micros;
+  for (int i = 0; i < 10; ++i) {
+    controller->RecordBatch(batch_size, latency_micros, processing_micros);
+  }
+}
+
+TEST(BatchSizeControllerTest, BadOptions) {
+  std::shared_ptr<BatchSizeController> controller;
+  BatchSizeController::Options options = TestOptions();
+  options.target_p99_latency_micros = 0;
+  EXPECT_FALSE(BatchSizeController::Create(options, 64, 0, &controller).ok());
+  options = TestOptions();
+  options.max_batch_timeout_micros = -1;
+  EXPECT_FALSE(BatchSizeController::Create(options, 64, 0, &controller).ok());
+  options = TestOptions();
+  options.batches_per_adjustment = 0;
+  EXPECT_FALSE(BatchSizeController::Create(options, 64, 0, &controller).ok());
+  options = TestOptions();
+  options.allowed_batch_sizes = {16, 8};
+  EXPECT_FALSE(BatchSizeController::Create(options, 64, 0, &controller).ok());
+  EXPECT_FALSE(
+      BatchSizeController::Create(TestOptions(), 0, 0, &controller).ok());
+}
+
+TEST(BatchSizeControllerTest, InitialState) {
+  std::shared_ptr<BatchSizeController> controller;
+  TF_ASSERT_OK(BatchSizeController::Create(TestOptions(), 64,
+                                           /*batch_timeout_micros=*/5000,
+                                           &controller));
+  EXPECT_EQ(64, controller->max_batch_size());
+  // Clamped to max_batch_timeout_micros.
+  EXPECT_EQ(800, controller->batch_timeout_micros());
+}
+
+TEST(BatchSizeControllerTest, DefaultTimeoutBounds) {
+  BatchSizeController::Options options;
+  options.target_p99_latency_micros = 1000;
+  std::shared_ptr<BatchSizeController> controller;
+  TF_ASSERT_OK(BatchSizeController::Create(options, 64,
+                                           /*batch_timeout_micros=*/500,
+                                           &controller));
+  EXPECT_EQ(500, controller->batch_timeout_micros());
+}
+
+TEST(BatchSizeControllerTest, StepsDownOverTarget) {
+  std::shared_ptr<BatchSizeController> controller;
+  TF_ASSERT_OK(BatchSizeController::Create(TestOptions(), 64,
+                                           /*batch_timeout_micros=*/800,
+                                           &controller));
+  RecordWindow(controller.get(), 64, 2000);
+  EXPECT_EQ(32, controller->max_batch_size());
+  EXPECT_EQ(400, controller->batch_timeout_micros());
+  RecordWindow(controller.get(), 32, 1500);
+  RecordWindow(controller.get(), 16, 1200);
+  RecordWindow(controller.get(), 8, 1100);
+  // Never below the smallest allowed size.
+  EXPECT_EQ(8, controller->max_batch_size());
+}
+
+TEST(BatchSizeControllerTest, StepsUpUnderTargetWhenBatchesFill) {
+  std::shared_ptr<BatchSizeController> controller;
+  TF_ASSERT_OK(BatchSizeController::Create(TestOptions(), 64, 0, &controller));
+  RecordWindow(controller.get(), 64, 2000);
+  EXPECT_EQ(32, controller->max_batch_size());
+  // Well under target, full batches, and processing gets more efficient.
+  RecordWindow(controller.get(), 32, 400);
+  EXPECT_EQ(64, controller->max_batch_size());
+  // Already at the largest size: hold.
+  RecordWindow(controller.get(), 64, 700);
+  EXPECT_EQ(64, controller->max_batch_size());
+}
+
+TEST(BatchSizeControllerTest, RevertsUnprofitableStepUp) {
+  std::shared_ptr<BatchSizeController> controller;
+  TF_ASSERT_OK(BatchSizeController::Create(TestOptions(), 64, 0, &controller));
+  RecordWindow(controller.get(), 64, 2000);
+  RecordWindow(controller.get(), 32, 400);
+  ASSERT_EQ(64, controller->max_batch_size());
+  // Twice the rows took more than twice as long: back to 32, and stay there.
+  RecordWindow(controller.get(), 64, 900);
+  EXPECT_EQ(32, controller->max_batch_size());
+  RecordWindow(controller.get(), 32, 400);
+  EXPECT_EQ(32, controller->max_batch_size());
+}
+
+TEST(BatchSizeControllerTest, IgnoresQueueingWhenMeasuringEfficiency) {
+  std::shared_ptr<BatchSizeController> controller;
+  TF_ASSERT_OK(BatchSizeController::Create(TestOptions(), 64, 0, &controller));
+  RecordWindow(controller.get(), 64, 2000);
+  RecordWindow(controller.get(), 32, 400, /*processing_micros=*/200);
+  ASSERT_EQ(64, controller->max_batch_size());
+  // Batches queue for longer, but twice the rows take less than twice the
+  // processing time: the step up paid off.
+  RecordWindow(controller.get(), 64, 900, /*processing_micros=*/300);
+  EXPECT_EQ(64, controller->max_batch_size());
+}
+
+TEST(BatchSizeControllerTest, LengthensTimeoutToReducePadding) {
+  std::shared_ptr<BatchSizeController> controller;
+  TF_ASSERT_OK(BatchSizeController::Create(TestOptions(), 64, 0, &controller));
+  // Batches of 9 rows are padded to 16, and don't fill up.
+  RecordWindow(controller.get(), 9, 300);
+  EXPECT_EQ(64, controller->max_batch_size());
+  EXPECT_EQ(100, controller->batch_timeout_micros());
+  RecordWindow(controller.get(), 9, 300);
+  EXPECT_EQ(200, controller->batch_timeout_micros());
+  RecordWindow(controller.get(), 9, 300);
+  RecordWindow(controller.get(), 9, 300);
+  RecordWindow(controller.get(), 9, 300);
+  EXPECT_EQ(800, controller->batch_timeout_micros());
+}
+
+TEST(BatchSizeControllerTest, PowerOfTwoSizesWithoutAllowedBatchSizes) {
+  BatchSizeController::Options options = TestOptions();
+  options.allowed_batch_sizes.clear();
+  std::shared_ptr<BatchSizeController> controller;
+  TF_ASSERT_OK(BatchSizeController::Create(options, 48, 0, &controller));
+  EXPECT_EQ(48, controller->max_batch_size());
+  RecordWindow(controller.get(), 48, 2000);
+  EXPECT_EQ(32, controller->max_batch_size());
+  RecordWindow(controller.get(), 32, 2000);
+  EXPECT_EQ(16, controller->max_batch_size());
+}
+
+}  // namespace
+}  // namespace serving
+}  // namespace tensorflow
@@ -18,6 +18,7 @@ limitations under the License.
 
 #include <stddef.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
@@ -94,6 +95,14 @@ namespace serving {
 // BasicBatchScheduler instance, in the sense that it has maximum batch size and
 // timeout parameters, which govern when a batch is eligible to be processed.
 //
+// With `Options::enable_earliest_deadline_first`, the batch threads instead
+// serve first the queue whose schedulable batch holds the task with the
+// earliest deadline (see BatchTask::deadline_micros()), falling back to
+// round-robin order among batches without deadlines. Queues can additionally
+// close batches early to meet deadlines and drop tasks whose deadline has
+// passed; see `QueueOptions::deadline_margin_micros` and
+// `QueueOptions::expired_task_callback`.
+//
 // Each queue is independently configured with a maximum size (in terms of the
 // maximum number of batches worth of enqueued tasks). For online serving, it is
 // recommended that the queue sizes be configured such that the sum of the sizes
@@ -143,6 +152,12 @@ class SharedBatchScheduler
     // The environment to use.
     // (Typically only overridden by test code.)
     Env* env = Env::Default();
+
+    // If true, a batch thread looking for work picks, among the queues with a
+    // schedulable batch, the one whose batch contains the earliest task
+    // deadline. Ties, including batches without deadlines, are broken in
+    // round-robin order.
+    bool enable_earliest_deadline_first = false;
   };
   // Ownership is shared between the caller of Create() and any queues created
   // via AddQueue().
@@ -282,6 +297,24 @@ class SharedBatchScheduler
     // effective only when enable_priority_queue is true.
     MixedPriorityBatchingPolicy mixed_priority_batching_policy =
         MixedPriorityBatchingPolicy::kLowPriorityPaddingWithMaxBatchSize;
+
+    // The open batch becomes schedulable, even if neither full nor timed out,
+    // once the earliest deadline of its tasks is less than this many
+    // microseconds away. Should roughly be the time to process a batch, so
+    // that waiting for a fuller batch doesn't make tasks miss their deadline.
+    //
+    // Only tasks with a deadline (see BatchTask::deadline_micros()) have an
+    // effect. Must be non-negative.
+    int64_t deadline_margin_micros = 0;
+
+    // If set, tasks whose deadline has passed are not processed: Schedule()
+    // rejects them with a DEADLINE_EXCEEDED error, and those expiring while
+    // enqueued are removed from their batch (or from the padding tasks) right
+    // before it is processed and handed to this callback instead, on a batch
+    // thread. The callback is responsible for completing the task.
+    //
+    // Must be unset if `enable_lazy_split` is true.
+    std::function<void(std::unique_ptr<TaskType>)> expired_task_callback;
   };
   // This method is marked virtual for testing purposes only.
   virtual Status AddQueue(const QueueOptions& options,
@@ -430,7 +463,20 @@ class Queue {
   std::vector<std::unique_ptr<TaskType>> GetLowPriorityTasksForPadding(
       size_t batch_size);
 
+  // Returns true iff ScheduleBatch() would currently return a batch, in which
+  // case `*deadline_micros` is set to the earliest deadline of its tasks, or
+  // BatchTask::kNoDeadline if it has none. Batches of queues with
+  // `enable_lazy_split` are reported without deadline.
+  bool PeekSchedulableBatchDeadline(uint64* deadline_micros) const;
+
+  // If `QueueOptions::expired_task_callback` is set, removes the tasks of
+  // `batch` whose deadline has passed and hands them to the callback. Returns
+  // a closed batch with the remaining tasks, which may be empty.
+  std::unique_ptr<Batch<TaskType>> DropExpiredTasks(
+      std::unique_ptr<Batch<TaskType>> batch);
+
   // Processes a batch that has been returned earlier by ScheduleBatch().
+  // An empty batch is not passed on to the process-batch callback.
   void ProcessBatch(std::unique_ptr<Batch<TaskType>> batch,
                     std::vector<std::unique_ptr<TaskType>> padding_task);
 
@@ -466,6 +512,18 @@ class Queue {
   // Returns true iff the task is a low priority task based on the queue option.
   bool IsLowPriorityTask(std::unique_ptr<TaskType>* task);
 
+  // Returns the deadline of `task`, or BatchTask::kNoDeadline if `TaskType`
+  // doesn't derive from BatchTask.
+  static uint64 TaskDeadlineMicros(const TaskType& task);
+
+  // Returns the earliest deadline of the tasks in `batch`.
+  static uint64 BatchDeadlineMicros(const Batch<TaskType>& batch);
+
+  // Moves the tasks in `tasks` whose deadline is at or before `now_micros` to
+  // `expired_task_callback`. Returns the number of tasks removed.
+  int DropExpiredTasks(uint64 now_micros,
+                       std::vector<std::unique_ptr<TaskType>>* tasks);
+
   // Implementation of ScheduleWithoutOrEagerSplit above. Enqueues `task` as it
   // is or split it inline (eagerly) to form batches to be processed by
   // `Queue<TaskType>::ProcessBatch`
@@ -492,8 +550,11 @@ class Queue {
       TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
   // Determines whether the low priority tasks in `low_priority_tasks_` can form
-  // a batch on their own. If yes, returns a batch that is ready to be
-  // processed. Otherwise, returns an empty unique_ptr.
+  // a batch on their own.
+  bool IsLowPriorityBatchSchedulable() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // If IsLowPriorityBatchSchedulable(), returns a batch of low priority tasks
+  // that is ready to be processed. Otherwise, returns an empty unique_ptr.
   std::unique_ptr<Batch<TaskType>> ScheduleLowPriorityBatch()
       TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
@@ -608,6 +669,12 @@ class Queue {
   // might contain an approximate value (see ScheduleBatchWithEagerSplit).
   uint64 open_batch_start_time_micros_ TF_GUARDED_BY(mu_);
 
+  // The earliest deadline of the tasks in the open (back-most) batch in
+  // 'high_priority_batches_', or BatchTask::kNoDeadline if none has one. Not
+  // maintained when `enable_lazy_split` is true.
+  uint64 open_batch_deadline_micros_ TF_GUARDED_BY(mu_) =
+      BatchTask::kNoDeadline;
+
   // Whether this queue contains a batch that is eligible to be scheduled.
   // Used to keep track of when to call 'schedulable_batch_callback_'.
   bool schedulable_batch_ TF_GUARDED_BY(mu_) = false;
@@ -740,6 +807,18 @@ Status SharedBatchScheduler<TaskType>::AddQueueAfterRewritingOptions(
         "enable_large_batch_splitting is enabled.");
   }
 
+  if (options.deadline_margin_micros < 0) {
+    return errors::InvalidArgument(
+        "deadline_margin_micros must be non-negative; was ",
+        options.deadline_margin_micros);
+  }
+
+  if (options.enable_lazy_split && options.expired_task_callback) {
+    return errors::InvalidArgument(
+        "expired_task_callback is not supported when enable_lazy_split is "
+        "enabled.");
+  }
+
   if (options.enable_large_batch_splitting &&
       (options.input_batch_size_limit < options.max_execution_batch_size)) {
     return errors::InvalidArgument(
@@ -803,6 +882,28 @@ void SharedBatchScheduler<TaskType>::GetNextWorkItem_Locked(
   BatchUniquePtr batch_to_process;
   internal::Queue<TaskType>* queue_for_batch = nullptr;
   const int num_queues = queues_.size();
+  if (options_.enable_earliest_deadline_first && num_queues > 1) {
+    // Start the round-robin scan below at the queue whose schedulable batch
+    // has the earliest deadline. Scanning from 'next_queue_to_schedule_' and
+    // only replacing the best queue on a strictly earlier deadline keeps ties
+    // in round-robin order.
+    typename QueueList::iterator earliest_queue = queues_.end();
+    uint64 earliest_deadline_micros = BatchTask::kNoDeadline;
+    typename QueueList::iterator it = next_queue_to_schedule_;
+    for (int i = 0; i < num_queues; ++i) {
+      uint64 deadline_micros;
+      if ((*it)->PeekSchedulableBatchDeadline(&deadline_micros) &&
+          (earliest_queue == queues_.end() ||
+           deadline_micros < earliest_deadline_micros)) {
+        earliest_queue = it;
+        earliest_deadline_micros = deadline_micros;
+      }
+      if (++it == queues_.end()) it = queues_.begin();
+    }
+    if (earliest_queue != queues_.end()) {
+      next_queue_to_schedule_ = earliest_queue;
+    }
+  }
   for (int num_queues_tried = 0;
        !BatchExists(batch_to_process) && num_queues_tried < num_queues;
        ++num_queues_tried) {
@@ -881,12 +982,19 @@ void SharedBatchScheduler<TaskType>::ThreadLogic() {
     // `enable_lazy_split=false`.
     batch_to_schedule =
         std::move(absl::get<BatchTaskUniqueptr>(batch_to_process));
+    batch_to_schedule =
+        queue_for_batch->DropExpiredTasks(std::move(batch_to_schedule));
   }
 
-  size_t batch_size_to_schedule = batch_to_schedule->size();
-  queue_for_batch->ProcessBatch(
-      std::move(batch_to_schedule),
-      queue_for_batch->GetLowPriorityTasksForPadding(batch_size_to_schedule));
+  // Padding is computed after expired tasks were dropped, so that low priority
+  // tasks can take their slots. A batch left empty is not padded.
+  std::vector<std::unique_ptr<TaskType>> padding_tasks;
+  if (!batch_to_schedule->empty()) {
+    padding_tasks = queue_for_batch->GetLowPriorityTasksForPadding(
+        batch_to_schedule->size());
+  }
+  queue_for_batch->ProcessBatch(std::move(batch_to_schedule),
+                                std::move(padding_tasks));
 }
 
 namespace internal {
@@ -1020,6 +1128,26 @@ bool Queue<TaskType>::IsLowPriorityTask(std::unique_ptr<TaskType>* task) {
   return false;
 }
 
+template <typename TaskType>
+uint64 Queue<TaskType>::TaskDeadlineMicros(const TaskType& task) {
+  if constexpr (std::is_base_of_v<BatchTask, TaskType>) {
+    return task.deadline_micros();
+  }
+  return BatchTask::kNoDeadline;
+}
+
+template <typename TaskType>
+uint64 Queue<TaskType>::BatchDeadlineMicros(const Batch<TaskType>& batch) {
+  uint64 deadline_micros = BatchTask::kNoDeadline;
+  if constexpr (std::is_base_of_v<BatchTask, TaskType>) {
+    for (int i = 0; i < batch.num_tasks(); ++i) {
+      deadline_micros =
+          std::min(deadline_micros, batch.task(i).deadline_micros());
+    }
+  }
+  return deadline_micros;
+}
+
 template <typename TaskType>
 Status Queue<TaskType>::ScheduleWithoutOrEagerSplitImpl(
     std::unique_ptr<TaskType>* task) {
@@ -1052,7 +1180,10 @@ Status Queue<TaskType>::ScheduleWithoutOrEagerSplitImpl(
     }
     if (batches.back()->empty()) {
       open_batch_start_time_micros_ = env_->NowMicros();
+      open_batch_deadline_micros_ = BatchTask::kNoDeadline;
     }
+    open_batch_deadline_micros_ = std::min(
+        open_batch_deadline_micros_, TaskDeadlineMicros(*output_tasks[i]));
     tsl::profiler::TraceMeProducer trace_me(
         [&output_tasks, i] {
           return profiler::TraceMeEncode("ScheduleOutputTask",
@@ -1080,6 +1211,13 @@ Status Queue<TaskType>::ScheduleWithoutOrEagerSplit(
         {{"batching_input_task_size", (*task)->size()}});
   });
 
+  if (options_.expired_task_callback &&
+      TaskDeadlineMicros(**task) <= env_->NowMicros()) {
+    return absl::DeadlineExceededError(
+        "The task's deadline passed before it could be scheduled for "
+        "batching.");
+  }
+
   bool notify_of_schedulable_batch = false;
   {
     mutex_lock l(mu_);
@@ -1258,7 +1396,10 @@ Queue<TaskType>::ScheduleBatchWithEagerSplit() {
 
       // Move the trimmed tasks, if any, into the new batch.
       Batch<TaskType>& new_batch = *batches[1];
+      open_batch_deadline_micros_ = BatchTask::kNoDeadline;
       for (std::unique_ptr<TaskType>& task : trimmed_tasks) {
+        open_batch_deadline_micros_ =
+            std::min(open_batch_deadline_micros_, TaskDeadlineMicros(*task));
         new_batch.AddTask(std::move(task));
       }
       if (!new_batch.empty()) {
@@ -1331,6 +1472,66 @@ Queue<TaskType>::ScheduleBatch() {
   return std::move(task_handles_to_schedule);
 }
 
+template <typename TaskType>
+bool Queue<TaskType>::PeekSchedulableBatchDeadline(
+    uint64* deadline_micros) const {
+  *deadline_micros = BatchTask::kNoDeadline;
+  mutex_lock l(mu_);
+  if (options_.enable_lazy_split) {
+    return task_handle_batches_.size() >= 2 || IsOpenBatchSchedulable();
+  }
+  const std::deque<std::unique_ptr<Batch<TaskType>>>& batches = GetBatches();
+  if (batches.size() >= 2) {
+    *deadline_micros = BatchDeadlineMicros(*batches.front());
+    return true;
+  }
+  if (IsOpenBatchSchedulable()) {
+    *deadline_micros = open_batch_deadline_micros_;
+    return true;
+  }
+  // Low priority tasks are only used as padding for deadline purposes; a batch
+  // made of them alone is ordered as if it had no deadline.
+  return IsLowPriorityBatchSchedulable();
+}
+
+template <typename TaskType>
+int Queue<TaskType>::DropExpiredTasks(
+    uint64 now_micros, std::vector<std::unique_ptr<TaskType>>* tasks) {
+  int num_dropped = 0;
+  auto kept = tasks->begin();
+  for (auto it = tasks->begin(); it != tasks->end(); ++it) {
+    if (TaskDeadlineMicros(**it) <= now_micros) {
+      options_.expired_task_callback(std::move(*it));
+      ++num_dropped;
+    } else {
+      *kept++ = std::move(*it);
+    }
+  }
+  tasks->erase(kept, tasks->end());
+  return num_dropped;
+}
+
+template <typename TaskType>
+std::unique_ptr<Batch<TaskType>> Queue<TaskType>::DropExpiredTasks(
+    std::unique_ptr<Batch<TaskType>> batch) {
+  if (!options_.expired_task_callback) {
+    return batch;
+  }
+  const uint64 now_micros = env_->NowMicros();
+  if (BatchDeadlineMicros(*batch) > now_micros) {
+    return batch;
+  }
+  std::vector<std::unique_ptr<TaskType>> tasks = batch->RemoveAllTasks();
+  DropExpiredTasks(now_micros, &tasks);
+  auto remaining_batch =
+      std::make_unique<Batch<TaskType>>(batch->traceme_context_id());
+  for (std::unique_ptr<TaskType>& task : tasks) {
+    remaining_batch->AddTask(std::move(task));
+  }
+  remaining_batch->Close();
+  return remaining_batch;
+}
+
 template <typename TaskType>
 std::vector<std::unique_ptr<TaskType>> Queue<TaskType>::GetLowPriorityTasks(
     size_t size) {
@@ -1343,6 +1544,9 @@ std::vector<std::unique_ptr<TaskType>> Queue<TaskType>::GetLowPriorityTasks(
     mutex_lock l(mu_);
     low_priority_tasks_to_pad = GetLowPriorityTaskQueue().RemoveTask(size);
   }
+  if (options_.expired_task_callback) {
+    DropExpiredTasks(env_->NowMicros(), &low_priority_tasks_to_pad);
+  }
   return low_priority_tasks_to_pad;
 }
 
@@ -1383,8 +1587,10 @@ void Queue<TaskType>::ProcessBatch(
       tsl::profiler::ContextType::kSharedBatchScheduler,
       batch->traceme_context_id());
 
-  if (std::holds_alternative<ProcessBatchCallbackWithoutPaddingTasks>(
-          process_batch_callback_)) {
+  if (batch->empty() && padding_task.empty()) {
+    // All tasks of the batch were dropped; see DropExpiredTasks().
+  } else if (std::holds_alternative<ProcessBatchCallbackWithoutPaddingTasks>(
+                 process_batch_callback_)) {
     std::get<ProcessBatchCallbackWithoutPaddingTasks>(process_batch_callback_)(
         std::move(batch));
   } else {
@@ -1465,9 +1671,13 @@ bool Queue<TaskType>::IsOpenBatchSchedulableAfterEagerSplit() const {
   if (open_batch->empty()) {
     return false;
   }
+  const uint64 now_micros = env_->NowMicros();
   return closed_ || open_batch->size() >= max_execution_batch_size() ||
-         env_->NowMicros() >=
-             open_batch_start_time_micros_ + options_.batch_timeout_micros;
+         now_micros >=
+             open_batch_start_time_micros_ + options_.batch_timeout_micros ||
+         (open_batch_deadline_micros_ != BatchTask::kNoDeadline &&
+          now_micros + options_.deadline_margin_micros >=
+              open_batch_deadline_micros_);
 }
 
 template <typename TaskType>
@@ -1486,24 +1696,28 @@ bool Queue<TaskType>::IsOpenBatchSchedulable() const {
 }
 
 template <typename TaskType>
-std::unique_ptr<Batch<TaskType>> Queue<TaskType>::ScheduleLowPriorityBatch() {
-  std::unique_ptr<Batch<TaskType>> batch_to_schedule;
+bool Queue<TaskType>::IsLowPriorityBatchSchedulable() const {
   if (!options_.enable_priority_queue || low_priority_tasks_.empty()) {
-    // Return early if priority queue is disabled or there is no low priority
-    // task.
-    return batch_to_schedule;
+    // Priority queue is disabled or there is no low priority task.
+    return false;
   }
   if (env_->NowMicros() <
           *low_priority_tasks_.EarliestTaskStartTime() +
               options_.low_priority_queue_options.batch_timeout_micros &&
       low_priority_tasks_.size() <
           options_.low_priority_queue_options.max_execution_batch_size) {
-    // Return early if the low priority tasks can't fill up the max batch size
-    // and the earliest task didn't time out.
-    return batch_to_schedule;
+    // The low priority tasks can't fill up the max batch size and the earliest
+    // task didn't time out.
+    return false;
   }
-  if (!GetBatches().empty() && !GetBatches().front()->empty()) {
-    // Return early if there is a non-empty high priority batch in the queue.
+  // There must be no non-empty high priority batch in the queue.
+  return GetBatches().empty() || GetBatches().front()->empty();
+}
+
+template <typename TaskType>
+std::unique_ptr<Batch<TaskType>> Queue<TaskType>::ScheduleLowPriorityBatch() {
+  std::unique_ptr<Batch<TaskType>> batch_to_schedule;
+  if (!IsLowPriorityBatchSchedulable()) {
     return batch_to_schedule;
   }
 
@@ -53,8 +53,11 @@ using ::testing::HasSubstr;
 class FakeTask : public BatchTask {
  public:
   explicit FakeTask(size_t size, tsl::criticality::Criticality criticality =
-                                     tsl::criticality::Criticality::kCritical)
-      : size_(size), criticality_(criticality) {}
+                                     tsl::criticality::Criticality::kCritical,
+                    uint64 deadline_micros = kNoDeadline)
+      : size_(size),
+        criticality_(criticality),
+        deadline_micros_(deadline_micros) {}
 
   ~FakeTask() override = default;
 
@@ -64,9 +67,12 @@ class FakeTask : public BatchTask {
     return criticality_;
   }
 
+  uint64 deadline_micros() const override { return deadline_micros_; }
+
  private:
   const size_t size_;
   const tsl::criticality::Criticality criticality_;
+  const uint64 deadline_micros_;
 
   FakeTask(const FakeTask&) = delete;
   void operator=(const FakeTask&) = delete;
@@ -110,6 +116,19 @@ Status ScheduleTask(size_t task_size, BatchScheduler<FakeTask>* scheduler,
   return status;
 }
 
+// Creates a critical FakeTask of size 'task_size' that must start processing by
+// 'deadline_micros', and calls 'scheduler->Schedule()' on that task. Returns
+// the resulting status.
+Status ScheduleTaskWithDeadline(size_t task_size, uint64 deadline_micros,
+                                BatchScheduler<FakeTask>* scheduler) {
+  std::unique_ptr<FakeTask> task(new FakeTask(
+      task_size, tsl::criticality::Criticality::kCritical, deadline_micros));
+  Status status = scheduler->Schedule(&task);
+  // Schedule() should have consumed 'task' iff it returned Status::OK.
+  CHECK_EQ(status.ok(), task == nullptr);
+  return status;
+}
+
 // Helper function similar to the function above. Creates a FakeTask of size
 // 'task_size' and calls 'scheduler->Schedule()' on that task. Returns the
 // resulting status.
@@ -1690,6 +1709,182 @@ INSTANTIATE_TEST_SUITE_P(
                       std::make_tuple(/*enable_input_batch_split=*/false,
                                       /*enable_lazy_split=*/false)));
 
+TEST(SharedBatchSchedulerDeadlineTest, InvalidDeadlineOptions) {
+  auto callback = [](std::unique_ptr<Batch<FakeTask>> batch) {};
+  auto scheduler = CreateSharedBatchScheduler(1);
+  std::unique_ptr<Queue> queue;
+
+  QueueOptions options = CreateQueueOptions(
+      /*max_execution_batch_size=*/4, /*input_batch_size_limit=*/4,
+      /*batch_timeout_micros=*/10, /*max_enqueued_batches=*/2,
+      /*enable_large_batch_splitting=*/false, /*enable_lazy_split=*/false,
+      /*split_func=*/nullptr);
+  options.deadline_margin_micros = -1;
+  EXPECT_THAT(scheduler->AddQueue(options, callback, &queue),
+              testing::StatusIs(error::INVALID_ARGUMENT,
+                                HasSubstr("deadline_margin_micros")));
+
+  options = CreateQueueOptions(
+      /*max_execution_batch_size=*/4, /*input_batch_size_limit=*/4,
+      /*batch_timeout_micros=*/10, /*max_enqueued_batches=*/2,
+      /*enable_large_batch_splitting=*/true, /*enable_lazy_split=*/true,
+      [](std::unique_ptr<FakeTask>* input_task, int first_output_task_size,
+         int input_batch_size_limit,
+         std::vector<std::unique_ptr<FakeTask>>* output_tasks) {
+        output_tasks->push_back(std::move(*input_task));
+        return absl::OkStatus();
+      });
+  options.expired_task_callback = [](std::unique_ptr<FakeTask> task) {};
+  EXPECT_THAT(scheduler->AddQueue(options, callback, &queue),
+              testing::StatusIs(error::INVALID_ARGUMENT,
+                                HasSubstr("expired_task_callback")));
+}
+
+TEST(SharedBatchSchedulerDeadlineTest, EarliestDeadlineFirstAcrossQueues) {
+  Scheduler::Options scheduler_options;
+  scheduler_options.num_batch_threads = 1;
+  scheduler_options.enable_earliest_deadline_first = true;
+  std::shared_ptr<Scheduler> scheduler;
+  TF_ASSERT_OK(Scheduler::Create(scheduler_options, &scheduler));
+
+  // Full batches are schedulable immediately; nothing times out.
+  const QueueOptions options = CreateQueueOptions(
+      /*max_execution_batch_size=*/2, /*input_batch_size_limit=*/2,
+      /*batch_timeout_micros=*/1000 * 1000 * 1000, /*max_enqueued_batches=*/4,
+      /*enable_large_batch_splitting=*/false, /*enable_lazy_split=*/false,
+      /*split_func=*/nullptr);
+
+  mutex mu;
+  std::vector<std::string> processed;
+  auto record = [&mu, &processed](std::string name) {
+    mutex_lock l(mu);
+    processed.push_back(std::move(name));
+  };
+
+  // Occupies the only batch thread while the other queues fill up.
+  Notification blocker_started, unblock;
+  auto blocker_queue = CreateQueue(
+      scheduler, options, [&](std::unique_ptr<Batch<FakeTask>> batch) {
+        blocker_started.Notify();
+        unblock.WaitForNotification();
+      });
+  // Round-robin order would serve `late_queue` first.
+  auto late_queue = CreateQueue(scheduler, options,
+                                [&](std::unique_ptr<Batch<FakeTask>> batch) {
+                                  record("late");
+                                });
+  auto early_queue = CreateQueue(scheduler, options,
+                                 [&](std::unique_ptr<Batch<FakeTask>> batch) {
+                                   record("early");
+                                 });
+
+  TF_ASSERT_OK(ScheduleTask(2, blocker_queue.get()));
+  blocker_started.WaitForNotification();
+
+  const uint64 now_micros = Env::Default()->NowMicros();
+  const uint64 kSecondMicros = 1000 * 1000;
+  TF_ASSERT_OK(ScheduleTaskWithDeadline(2, now_micros + 200 * kSecondMicros,
+                                        late_queue.get()));
+  TF_ASSERT_OK(ScheduleTaskWithDeadline(2, now_micros + 100 * kSecondMicros,
+                                        early_queue.get()));
+  TF_ASSERT_OK(ScheduleTask(2, late_queue.get()));
+  unblock.Notify();
+
+  // Destroying the queues waits for all their batches to be processed.
+  blocker_queue.reset();
+  late_queue.reset();
+  early_queue.reset();
+  mutex_lock l(mu);
+  EXPECT_THAT(processed, ::testing::ElementsAre("early", "late", "late"));
+}
+
+TEST(SharedBatchSchedulerDeadlineTest, ClosesOpenBatchAheadOfDeadline) {
+  test_util::FakeClockEnv env(Env::Default());
+  Notification start_teardown, stop_teardown;
+  std::unique_ptr<Thread> teardown_thread =
+      CreateFakeClockAdvancerThread(&env, &start_teardown, &stop_teardown);
+
+  {
+    Notification batch_processed;
+    auto callback = [&](std::unique_ptr<Batch<FakeTask>> batch) {
+      EXPECT_EQ(1, batch->num_tasks());
+      batch_processed.Notify();
+    };
+
+    auto scheduler = CreateSharedBatchScheduler(1, &env);
+    QueueOptions options = CreateQueueOptions(
+        /*max_execution_batch_size=*/4, /*input_batch_size_limit=*/4,
+        /*batch_timeout_micros=*/1000, /*max_enqueued_batches=*/2,
+        /*enable_large_batch_splitting=*/false, /*enable_lazy_split=*/false,
+        /*split_func=*/nullptr);
+    options.deadline_margin_micros = 20;
+    auto queue = CreateQueue(scheduler, options, callback);
+
+    TF_ASSERT_OK(ScheduleTaskWithDeadline(1, /*deadline_micros=*/50,
+                                          queue.get()));
+    env.AdvanceByMicroseconds(29);
+    Env::Default()->SleepForMicroseconds(10 * 1000 /* 10 milliseconds */);
+    EXPECT_FALSE(batch_processed.HasBeenNotified());
+    // The deadline is now within the margin, well before the batch timeout.
+    env.AdvanceByMicroseconds(1);
+    batch_processed.WaitForNotification();
+
+    start_teardown.Notify();
+  }
+  stop_teardown.Notify();
+}
+
+TEST(SharedBatchSchedulerDeadlineTest, DropsExpiredTasks) {
+  test_util::FakeClockEnv env(Env::Default());
+  Notification start_teardown, stop_teardown;
+  std::unique_ptr<Thread> teardown_thread =
+      CreateFakeClockAdvancerThread(&env, &start_teardown, &stop_teardown);
+
+  {
+    mutex mu;
+    std::vector<size_t> expired_task_sizes;
+    Notification batch_processed;
+    auto callback = [&](std::unique_ptr<Batch<FakeTask>> batch) {
+      ASSERT_EQ(1, batch->num_tasks());
+      EXPECT_EQ(2, batch->task(0).size());
+      batch_processed.Notify();
+    };
+
+    auto scheduler = CreateSharedBatchScheduler(1, &env);
+    QueueOptions options = CreateQueueOptions(
+        /*max_execution_batch_size=*/4, /*input_batch_size_limit=*/4,
+        /*batch_timeout_micros=*/1000, /*max_enqueued_batches=*/2,
+        /*enable_large_batch_splitting=*/false, /*enable_lazy_split=*/false,
+        /*split_func=*/nullptr);
+    options.expired_task_callback = [&](std::unique_ptr<FakeTask> task) {
+      mutex_lock l(mu);
+      expired_task_sizes.push_back(task->size());
+    };
+    auto queue = CreateQueue(scheduler, options, callback);
+
+    env.AdvanceByMicroseconds(100);
+    // Already expired tasks are rejected.
+    EXPECT_THAT(
+        ScheduleTaskWithDeadline(3, /*deadline_micros=*/100, queue.get()),
+        testing::StatusIs(error::DEADLINE_EXCEEDED));
+    TF_ASSERT_OK(
+        ScheduleTaskWithDeadline(1, /*deadline_micros=*/110, queue.get()));
+    TF_ASSERT_OK(ScheduleTask(2, queue.get()));
+
+    // The batch is closed at the deadline of its first task, which is dropped
+    // by the time the batch gets processed.
+    env.AdvanceByMicroseconds(10);
+    batch_processed.WaitForNotification();
+    {
+      mutex_lock l(mu);
+      EXPECT_THAT(expired_task_sizes, ::testing::ElementsAre(1));
+    }
+
+    start_teardown.Notify();
+  }
+  stop_teardown.Notify();
+}
+
 #ifdef PLATFORM_GOOGLE
 // This benchmark relies on https://github.com/google/benchmark features,
 // (in particular, `Benchmark::ThreadRange`) not available in open-sourced TF
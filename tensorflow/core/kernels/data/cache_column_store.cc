@@ -0,0 +1,227 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/cache_column_store.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_util.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/snappy.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// Compressed chunks must be at least this fraction smaller than the raw ones
+// to be worth decompressing on reads.
+constexpr double kMinCompressionSaving = 0.125;
+
+bool IsPackable(const Tensor& value) {
+  return DataTypeCanUseMemcpy(value.dtype());
+}
+
+bool CanShareChunk(const Tensor& a, const Tensor& b) {
+  if (IsPackable(a) != IsPackable(b)) return false;
+  if (!IsPackable(a)) return true;
+  return a.dtype() == b.dtype() && a.shape() == b.shape();
+}
+
+// Returns the distance between consecutive values of `row_bytes` bytes in a
+// chunk. Values are padded to the allocator alignment, so that they can be
+// handed out as slices, when that costs at most 1/8 of extra memory.
+int64_t RowStride(int64_t row_bytes) {
+  constexpr int64_t kAlignment = Allocator::kAllocatorAlignment;
+  const int64_t aligned_bytes =
+      (row_bytes + kAlignment - 1) / kAlignment * kAlignment;
+  return aligned_bytes - row_bytes <= row_bytes / 8 ? aligned_bytes
+                                                     : row_bytes;
+}
+
+char* MutableData(Tensor& tensor) {
+  return const_cast<char*>(tensor.tensor_data().data());
+}
+
+}  // namespace
+
+CacheColumnStore::CacheColumnStore(const Options& options)
+    : options_(options) {}
+
+Status CacheColumnStore::Append(const std::vector<Tensor>& element) {
+  if (num_elements_ == 0) {
+    columns_.resize(element.size());
+  } else if (element.size() != columns_.size()) {
+    return errors::InvalidArgument("Expected an element of ", columns_.size(),
+                                   " components, got ", element.size());
+  }
+  for (int i = 0; i < element.size(); ++i) {
+    Column& column = columns_[i];
+    const Tensor& value = element[i];
+    if (!column.pending.empty() &&
+        !CanShareChunk(column.pending.front(), value)) {
+      TF_RETURN_IF_ERROR(Seal(column));
+    }
+    column.pending.push_back(value);
+    size_bytes_ += value.TotalBytes();
+    if (column.pending.size() >= options_.rows_per_chunk) {
+      TF_RETURN_IF_ERROR(Seal(column));
+    }
+  }
+  ++num_elements_;
+  return absl::OkStatus();
+}
+
+Status CacheColumnStore::Finalize() {
+  for (Column& column : columns_) {
+    TF_RETURN_IF_ERROR(Seal(column));
+  }
+  return absl::OkStatus();
+}
+
+Status CacheColumnStore::Seal(Column& column) {
+  if (column.pending.empty()) return absl::OkStatus();
+  Chunk chunk;
+  chunk.first_row = column.num_packed_rows;
+  chunk.num_rows = column.pending.size();
+  int64_t pending_bytes = 0;
+  for (const Tensor& value : column.pending) {
+    pending_bytes += value.TotalBytes();
+  }
+  int64_t chunk_bytes;
+  if (!IsPackable(column.pending.front())) {
+    chunk.rows = std::move(column.pending);
+    chunk_bytes = pending_bytes;
+  } else {
+    const Tensor& first = column.pending.front();
+    chunk.packed = true;
+    chunk.dtype = first.dtype();
+    chunk.row_shape = first.shape();
+    chunk.row_bytes = first.TotalBytes();
+    chunk.row_stride = RowStride(chunk.row_bytes);
+    const int64_t num_bytes = chunk.num_rows * chunk.row_stride;
+    Tensor data(DT_UINT8, TensorShape({num_bytes}));
+    char* dst = MutableData(data);
+    for (const Tensor& value : column.pending) {
+      std::memcpy(dst, value.tensor_data().data(), chunk.row_bytes);
+      std::memset(dst + chunk.row_bytes, 0,
+                  chunk.row_stride - chunk.row_bytes);
+      dst += chunk.row_stride;
+    }
+    chunk_bytes = num_bytes;
+    std::string compressed_data;
+    if (options_.compress && num_bytes > 0 &&
+        port::Snappy_Compress(data.tensor_data().data(), num_bytes,
+                              &compressed_data) &&
+        compressed_data.size() < (1 - kMinCompressionSaving) * num_bytes) {
+      chunk_bytes = compressed_data.size();
+      chunk.compressed_data = std::move(compressed_data);
+    } else {
+      chunk.data = std::move(data);
+    }
+  }
+  column.pending.clear();
+  column.num_packed_rows += chunk.num_rows;
+  column.chunks.push_back(std::move(chunk));
+  size_bytes_ += chunk_bytes - pending_bytes;
+  return absl::OkStatus();
+}
+
+CacheColumnStore::Reader::Reader(const CacheColumnStore* store)
+    : store_(store),
+      chunk_indices_(store->columns_.size(), -1),
+      decompressed_(store->columns_.size()) {}
+
+Status CacheColumnStore::Reader::Get(int64_t index,
+                                     std::vector<Tensor>* element) {
+  if (index < 0 || index >= store_->num_elements()) {
+    return errors::OutOfRange("Element ", index, " is out of range [0, ",
+                              store_->num_elements(), ")");
+  }
+  element->clear();
+  element->reserve(store_->columns_.size());
+  for (int i = 0; i < store_->columns_.size(); ++i) {
+    const Column& column = store_->columns_[i];
+    if (index >= column.num_packed_rows) {
+      element->push_back(column.pending[index - column.num_packed_rows]);
+      continue;
+    }
+    int64_t& chunk_index = chunk_indices_[i];
+    if (chunk_index < 0 ||
+        index < column.chunks[chunk_index].first_row ||
+        index >= column.chunks[chunk_index].first_row +
+                     column.chunks[chunk_index].num_rows) {
+      auto it = std::upper_bound(
+          column.chunks.begin(), column.chunks.end(), index,
+          [](int64_t index, const Chunk& chunk) {
+            return index < chunk.first_row;
+          });
+      chunk_index = std::distance(column.chunks.begin(), it) - 1;
+      decompressed_[i] = Tensor();
+    }
+    const Chunk& chunk = column.chunks[chunk_index];
+    const int64_t row = index - chunk.first_row;
+    if (!chunk.packed) {
+      element->push_back(chunk.rows[row]);
+      continue;
+    }
+    if (chunk.row_bytes == 0) {
+      element->emplace_back(chunk.dtype, chunk.row_shape);
+      continue;
+    }
+    const Tensor* data = &chunk.data;
+    if (!chunk.compressed_data.empty()) {
+      Tensor& decompressed = decompressed_[i];
+      if (!decompressed.IsInitialized()) {
+        const int64_t num_bytes = chunk.num_rows * chunk.row_stride;
+        size_t uncompressed_length;
+        if (!port::Snappy_GetUncompressedLength(chunk.compressed_data.data(),
+                                                chunk.compressed_data.size(),
+                                                &uncompressed_length) ||
+            uncompressed_length != num_bytes) {
+          return errors::DataLoss("Corrupted cache chunk");
+        }
+        decompressed = Tensor(DT_UINT8, TensorShape({num_bytes}));
+        if (!port::Snappy_Uncompress(chunk.compressed_data.data(),
+                                     chunk.compressed_data.size(),
+                                     MutableData(decompressed))) {
+          return errors::DataLoss("Failed to decompress cache chunk");
+        }
+      }
+      data = &decompressed;
+    }
+    const int64_t offset = row * chunk.row_stride;
+    Tensor value;
+    TF_RETURN_IF_ERROR(value.BitcastFrom(
+        data->Slice(offset, offset + chunk.row_bytes), chunk.dtype,
+        chunk.row_shape));
+    if (!value.IsAligned()) {
+      value = tensor::DeepCopy(value);
+    }
+    element->push_back(std::move(value));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,125 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_KERNELS_DATA_CACHE_COLUMN_STORE_H_
+#define TENSORFLOW_CORE_KERNELS_DATA_CACHE_COLUMN_STORE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/platform/status.h"
+
+namespace tensorflow {
+namespace data {
+
+// Holds the dataset elements of a `MemoryCache` column by column.
+//
+// Consecutive values of a component that have the same dtype and shape, and
+// whose dtype can be memcpy-ed, are packed back to back into chunks of up to
+// `rows_per_chunk` rows, optionally snappy-compressed. This replaces one
+// allocation and one `Tensor` per component of each element by one per chunk,
+// which matters for elements made of many small features. Other values are
+// kept as their own tensors.
+//
+// Values are handed out as slices of their chunk when the slice is aligned,
+// which packing arranges for values of at least a few hundred bytes, and as
+// copies otherwise.
+class CacheColumnStore {
+ public:
+  struct Options {
+    // Maximum number of values per chunk.
+    int64_t rows_per_chunk = 1024;
+    // Whether to snappy-compress the chunks. Chunks that don't compress well
+    // are kept uncompressed.
+    bool compress = false;
+  };
+
+  explicit CacheColumnStore(const Options& options);
+
+  // Appends `element`. All elements must have the same number of components.
+  // Values are packed once a chunk fills up; until then, they are held as is.
+  // Not thread-safe.
+  Status Append(const std::vector<Tensor>& element);
+
+  // Packs the values held as is. Not thread-safe.
+  Status Finalize();
+
+  int64_t num_elements() const { return num_elements_; }
+
+  // Number of bytes held, for the packed values and those held as is.
+  int64_t size_bytes() const { return size_bytes_; }
+
+  // Reads the elements of a store. The store must outlive the reader, and
+  // may not be appended to while being read. Reading is fastest in order, as
+  // the reader keeps the last chunk of each column it decompressed.
+  class Reader {
+   public:
+    explicit Reader(const CacheColumnStore* store);
+
+    Status Get(int64_t index, std::vector<Tensor>* element);
+
+   private:
+    const CacheColumnStore* const store_;  // not owned.
+    // For each column, the index of the chunk read last, and its
+    // decompressed data if it is compressed.
+    std::vector<int64_t> chunk_indices_;
+    std::vector<Tensor> decompressed_;
+  };
+
+ private:
+  struct Chunk {
+    int64_t first_row = 0;
+    int64_t num_rows = 0;
+    // Packed values share `dtype` and `row_shape`, and start every
+    // `row_stride` bytes of `data`, or of `compressed_data` once
+    // decompressed.
+    bool packed = false;
+    DataType dtype = DT_INVALID;
+    TensorShape row_shape;
+    int64_t row_bytes = 0;
+    int64_t row_stride = 0;
+    Tensor data;
+    std::string compressed_data;
+    // Values that are not packed.
+    std::vector<Tensor> rows;
+  };
+
+  struct Column {
+    std::vector<Chunk> chunks;
+    // Values not packed yet, which follow those of `chunks`.
+    std::vector<Tensor> pending;
+    int64_t num_packed_rows = 0;
+  };
+
+  // Moves the pending values of `column` into a new chunk.
+  Status Seal(Column& column);
+
+  const Options options_;
+  std::vector<Column> columns_;
+  int64_t num_elements_ = 0;
+  int64_t size_bytes_ = 0;
+
+  CacheColumnStore(const CacheColumnStore&) = delete;
+  void operator=(const CacheColumnStore&) = delete;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_DATA_CACHE_COLUMN_STORE_H_
@@ -0,0 +1,160 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/cache_column_store.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// An element with a scalar, a large vector, a string, and a vector whose
+// length varies with `i`.
+std::vector<Tensor> MakeElement(int64_t i) {
+  Tensor large(DT_FLOAT, TensorShape({256}));
+  large.flat<float>().setConstant(i);
+  Tensor ragged(DT_INT64, TensorShape({i % 3}));
+  ragged.flat<int64_t>().setConstant(i);
+  return {test::AsScalar<int64_t>(i), large,
+          test::AsTensor<tstring>({absl::StrCat("element_", i)}), ragged};
+}
+
+void ExpectElementEqual(const std::vector<Tensor>& expected,
+                        const std::vector<Tensor>& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    test::ExpectEqual(expected[i], actual[i]);
+    EXPECT_TRUE(actual[i].IsAligned());
+  }
+}
+
+class CacheColumnStoreTest : public ::testing::TestWithParam<bool> {
+ protected:
+  CacheColumnStore::Options GetOptions() const {
+    CacheColumnStore::Options options;
+    options.rows_per_chunk = 8;
+    options.compress = GetParam();
+    return options;
+  }
+};
+
+TEST_P(CacheColumnStoreTest, RoundTrip) {
+  CacheColumnStore store(GetOptions());
+  for (int64_t i = 0; i < 50; ++i) {
+    TF_ASSERT_OK(store.Append(MakeElement(i)));
+  }
+  TF_ASSERT_OK(store.Finalize());
+  EXPECT_EQ(50, store.num_elements());
+
+  CacheColumnStore::Reader reader(&store);
+  for (int64_t i = 0; i < 50; ++i) {
+    std::vector<Tensor> element;
+    TF_ASSERT_OK(reader.Get(i, &element));
+    ExpectElementEqual(MakeElement(i), element);
+  }
+  // Out of order.
+  for (int64_t i : {42, 3, 17, 3, 49, 0}) {
+    std::vector<Tensor> element;
+    TF_ASSERT_OK(reader.Get(i, &element));
+    ExpectElementEqual(MakeElement(i), element);
+  }
+}
+
+TEST_P(CacheColumnStoreTest, ReadsValuesNotPackedYet) {
+  CacheColumnStore store(GetOptions());
+  for (int64_t i = 0; i < 5; ++i) {
+    TF_ASSERT_OK(store.Append(MakeElement(i)));
+  }
+  CacheColumnStore::Reader reader(&store);
+  for (int64_t i = 0; i < 5; ++i) {
+    std::vector<Tensor> element;
+    TF_ASSERT_OK(reader.Get(i, &element));
+    ExpectElementEqual(MakeElement(i), element);
+  }
+}
+
+TEST_P(CacheColumnStoreTest, Errors) {
+  CacheColumnStore store(GetOptions());
+  TF_ASSERT_OK(store.Append(MakeElement(0)));
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            store.Append({test::AsScalar<int64_t>(1)}).code());
+  TF_ASSERT_OK(store.Finalize());
+  CacheColumnStore::Reader reader(&store);
+  std::vector<Tensor> element;
+  EXPECT_EQ(absl::StatusCode::kOutOfRange, reader.Get(1, &element).code());
+  EXPECT_EQ(absl::StatusCode::kOutOfRange, reader.Get(-1, &element).code());
+}
+
+INSTANTIATE_TEST_SUITE_P(Compression, CacheColumnStoreTest,
+                         ::testing::Bool());
+
+TEST(CacheColumnStoreTest, PacksSmallValues) {
+  CacheColumnStore store(CacheColumnStore::Options{});
+  int64_t unpacked_bytes = 0;
+  for (int64_t i = 0; i < 1000; ++i) {
+    TF_ASSERT_OK(store.Append({test::AsScalar<float>(i)}));
+    unpacked_bytes += sizeof(float);
+  }
+  TF_ASSERT_OK(store.Finalize());
+  // Scalars are packed without padding.
+  EXPECT_EQ(unpacked_bytes, store.size_bytes());
+}
+
+TEST(CacheColumnStoreTest, HandsOutSlicesOfLargeValues) {
+  CacheColumnStore store(CacheColumnStore::Options{});
+  for (int64_t i = 0; i < 4; ++i) {
+    TF_ASSERT_OK(store.Append({MakeElement(i)[1]}));
+  }
+  TF_ASSERT_OK(store.Finalize());
+  CacheColumnStore::Reader reader(&store);
+  std::vector<Tensor> first, second;
+  TF_ASSERT_OK(reader.Get(0, &first));
+  TF_ASSERT_OK(reader.Get(1, &second));
+  EXPECT_TRUE(first[0].SharesBufferWith(second[0]));
+  EXPECT_TRUE(second[0].IsAligned());
+}
+
+TEST(CacheColumnStoreTest, CompressesChunks) {
+  CacheColumnStore::Options options;
+  options.compress = true;
+  CacheColumnStore store(options);
+  Tensor zeros(DT_FLOAT, TensorShape({1024}));
+  zeros.flat<float>().setZero();
+  for (int64_t i = 0; i < 16; ++i) {
+    TF_ASSERT_OK(store.Append({zeros}));
+  }
+  TF_ASSERT_OK(store.Finalize());
+  if (store.size_bytes() == 16 * zeros.TotalBytes()) {
+    GTEST_SKIP() << "Snappy is not available on this platform.";
+  }
+  EXPECT_LT(store.size_bytes(), zeros.TotalBytes());
+  CacheColumnStore::Reader reader(&store);
+  std::vector<Tensor> element;
+  TF_ASSERT_OK(reader.Get(7, &element));
+  test::ExpectEqual(zeros, element[0]);
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -17,6 +17,7 @@ limitations under the License.
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <utility>
@@ -31,13 +32,16 @@ limitations under the License.
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/kernels/data/cache_column_store.h"
 #include "tensorflow/core/kernels/data/cache_ops.h"
+#include "tensorflow/core/kernels/data/cache_spill_file.h"
 #include "tensorflow/core/kernels/data/iterator_ops.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/refcount.h"
+#include "tensorflow/core/platform/statusor.h"
 #include "tensorflow/core/util/tensor_bundle/naming.h"
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 
@@ -52,6 +56,11 @@ namespace data {
 /* static */ constexpr const char* const CacheDatasetOp::kFileName;
 /* static */ constexpr const char* const CacheDatasetOp::kOutputTypes;
 /* static */ constexpr const char* const CacheDatasetOp::kOutputShapes;
+/* static */ constexpr const char* const CacheDatasetOp::kMemoryBudgetBytes;
+/* static */ constexpr const char* const CacheDatasetOp::kSpillDirectory;
+/* static */ constexpr const char* const CacheDatasetOp::kSpillPrefetchDepth;
+/* static */ constexpr const char* const CacheDatasetOp::kColumnar;
+/* static */ constexpr const char* const CacheDatasetOp::kCompressColumns;
 
 namespace {
 
@@ -842,6 +851,27 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
   }
 
  protected:
+  // Returns the attributes holding the options of the cache.
+  std::vector<std::pair<StringPiece, AttrValue>> CacheOptionsAttrs(
+      DatasetGraphDefBuilder* b) const {
+    const MemoryCache::Options& options = cache_->options();
+    AttrValue memory_budget_bytes;
+    b->BuildAttrValue(options.memory_budget_bytes, &memory_budget_bytes);
+    AttrValue spill_directory;
+    b->BuildAttrValue(options.spill_directory, &spill_directory);
+    AttrValue spill_prefetch_depth;
+    b->BuildAttrValue(options.spill_prefetch_depth, &spill_prefetch_depth);
+    AttrValue columnar;
+    b->BuildAttrValue(options.columnar, &columnar);
+    AttrValue compress_columns;
+    b->BuildAttrValue(options.compress_columns, &compress_columns);
+    return {{kMemoryBudgetBytes, memory_budget_bytes},
+            {kSpillDirectory, spill_directory},
+            {kSpillPrefetchDepth, spill_prefetch_depth},
+            {kColumnar, columnar},
+            {kCompressColumns, compress_columns}};
+  }
+
   class MemoryIterator : public DatasetIterator<MemoryDatasetBase> {
    public:
     explicit MemoryIterator(const Params& params, MemoryCache* cache)
@@ -877,8 +907,18 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       mutex_lock l(mu_);
       if (cache_->IsCompleted()) {
         TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kCacheCompleted, ""));
-        TF_RETURN_IF_ERROR(
-            WriteElementsToCheckpoint(writer, prefix(), cache_->data()));
+        if (cache_->spilled() == nullptr && cache_->columns() == nullptr) {
+          TF_RETURN_IF_ERROR(
+              WriteElementsToCheckpoint(writer, prefix(), cache_->data()));
+        } else {
+          // Spill files don't outlive the process, and packed columns are an
+          // in-memory representation, so elements are checkpointed as
+          // tensors.
+          std::vector<std::vector<Tensor>> elements;
+          TF_RETURN_IF_ERROR(cache_->GetAll(&elements));
+          TF_RETURN_IF_ERROR(
+              WriteElementsToCheckpoint(writer, prefix(), elements));
+        }
       }
       TF_RETURN_IF_ERROR(global_shuffle_iterator_.Save(prefix(), ctx, writer));
       return SaveInput(ctx, writer, iterator_);
@@ -896,17 +936,146 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         std::vector<std::vector<Tensor>> temp_cache;
         TF_RETURN_IF_ERROR(
             ReadElementsFromCheckpoint(ctx, reader, prefix(), &temp_cache));
-        cache_->Complete(std::move(temp_cache));
+        TF_RETURN_IF_ERROR(CompleteWithinBudget(ctx, std::move(temp_cache)));
       }
       TF_RETURN_IF_ERROR(InitializeIterator(ctx));
       return RestoreInput(ctx, reader, iterator_);
     }
 
    private:
+    // Accumulates cache elements in memory up to the memory budget of the
+    // cache, and in a spill file past it. In memory, elements are held as
+    // tensors or, if the cache is columnar, packed into a `CacheColumnStore`.
+    class TieredCacheBuilder {
+     public:
+      explicit TieredCacheBuilder(MemoryCache* cache) : cache_(cache) {}
+
+      bool empty() const { return num_elements() == 0; }
+
+      int64_t num_elements() const {
+        return (columns_ ? columns_->num_elements() : elements_.size()) +
+               (spill_file_ ? spill_file_->num_elements() : 0);
+      }
+
+      // Returns the size of the packed in-memory elements, if the cache is
+      // columnar.
+      int64_t column_bytes() const {
+        return columns_ ? columns_->size_bytes() : 0;
+      }
+
+      // Adds `element`. Returns whether it is held in memory as is.
+      StatusOr<bool> Add(IteratorContext* ctx,
+                         const std::vector<Tensor>& element) {
+        const MemoryCache::Options& options = cache_->options();
+        const int64_t budget = options.memory_budget_bytes;
+        if (spill_file_ == nullptr) {
+          const int64_t bytes = GetTotalBytes(element);
+          const int64_t bytes_in_memory =
+              columns_ ? columns_->size_bytes() : bytes_in_memory_;
+          if (budget <= 0 || bytes_in_memory + bytes <= budget) {
+            if (options.columnar) {
+              if (columns_ == nullptr) {
+                CacheColumnStore::Options column_options;
+                column_options.compress = options.compress_columns;
+                columns_ = std::make_shared<CacheColumnStore>(column_options);
+              }
+              TF_RETURN_IF_ERROR(columns_->Append(element));
+              return false;
+            }
+            elements_.push_back(element);
+            bytes_in_memory_ += bytes;
+            return true;
+          }
+          TF_RETURN_IF_ERROR(CacheSpillFile::Create(
+              ctx->env(), cache_->options().spill_directory, &spill_file_));
+          VLOG(2) << "Cache memory budget of " << budget
+                  << " bytes exhausted after " << num_elements()
+                  << " elements; spilling further elements to "
+                  << spill_file_->filename();
+        }
+        TF_RETURN_IF_ERROR(spill_file_->Append(element));
+        return false;
+      }
+
+      // Copies all the elements added so far into `elements`.
+      Status GetAll(std::vector<std::vector<Tensor>>* elements) {
+        *elements = elements_;
+        if (columns_) {
+          CacheColumnStore::Reader reader(columns_.get());
+          elements->resize(columns_->num_elements());
+          for (int64_t i = 0; i < columns_->num_elements(); ++i) {
+            TF_RETURN_IF_ERROR(reader.Get(i, &(*elements)[i]));
+          }
+        }
+        if (spill_file_) {
+          TF_RETURN_IF_ERROR(spill_file_->Flush());
+          for (int64_t i = 0; i < spill_file_->num_elements(); ++i) {
+            elements->emplace_back();
+            TF_RETURN_IF_ERROR(spill_file_->Read(i, &elements->back()));
+          }
+        }
+        return absl::OkStatus();
+      }
+
+      // Moves the elements added so far into the cache, and marks it as
+      // completed.
+      Status Complete() {
+        std::shared_ptr<const CacheSpillFile> spilled;
+        if (spill_file_) {
+          TF_RETURN_IF_ERROR(spill_file_->Flush());
+          spilled = std::move(spill_file_);
+        }
+        if (columns_) {
+          TF_RETURN_IF_ERROR(columns_->Finalize());
+          cache_->Complete(std::shared_ptr<const CacheColumnStore>(
+                               std::move(columns_)),
+                           std::move(spilled));
+        } else {
+          cache_->Complete(std::move(elements_), std::move(spilled));
+        }
+        Clear();
+        return absl::OkStatus();
+      }
+
+      void Clear() {
+        elements_.clear();
+        bytes_in_memory_ = 0;
+        columns_.reset();
+        spill_file_.reset();
+      }
+
+     private:
+      MemoryCache* const cache_;  // not owned.
+      std::vector<std::vector<Tensor>> elements_;
+      int64_t bytes_in_memory_ = 0;
+      std::shared_ptr<CacheColumnStore> columns_;
+      std::unique_ptr<CacheSpillFile> spill_file_;
+    };
+
+    // Completes the cache with `elements`, spilling those over its memory
+    // budget and packing the others if the cache is columnar.
+    Status CompleteWithinBudget(IteratorContext* ctx,
+                                std::vector<std::vector<Tensor>>&& elements)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (cache_->options().memory_budget_bytes <= 0 &&
+          !cache_->options().columnar) {
+        cache_->Complete(std::move(elements));
+        return absl::OkStatus();
+      }
+      TieredCacheBuilder builder(cache_);
+      for (std::vector<Tensor>& element : elements) {
+        TF_RETURN_IF_ERROR(builder.Add(ctx, element).status());
+        element.clear();
+      }
+      return builder.Complete();
+    }
+
     class MemoryWriterIterator : public DatasetIterator<MemoryDatasetBase> {
      public:
       explicit MemoryWriterIterator(const Params& params, MemoryCache* cache)
-          : DatasetIterator<MemoryDatasetBase>(params), cache_(cache) {}
+          : DatasetIterator<MemoryDatasetBase>(params),
+            cache_(cache),
+            temp_cache_(cache) {}
 
       ~MemoryWriterIterator() override {
         mutex_lock l(mu_);
@@ -930,16 +1099,23 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         if (*end_of_sequence) {
           if (!cache_->IsCompleted()) {
             VLOG(2) << "Finalizing the cache because EOF has been reached.";
-            cache_->Complete(std::move(temp_cache_));
+            TF_RETURN_IF_ERROR(temp_cache_.Complete());
           }
           return absl::OkStatus();
         }
-        RecordBufferEnqueue(ctx, *out_tensors);
-        temp_cache_.emplace_back(*out_tensors);
-        if (temp_cache_.size() == dataset()->input_->Cardinality()) {
+        const int64_t column_bytes = temp_cache_.column_bytes();
+        TF_ASSIGN_OR_RETURN(bool in_memory, temp_cache_.Add(ctx, *out_tensors));
+        if (in_memory) {
+          RecordBufferEnqueue(ctx, *out_tensors);
+        } else if (temp_cache_.column_bytes() > column_bytes &&
+                   ctx->model() != nullptr && model_node() != nullptr) {
+          model_node()->record_buffer_event(
+              temp_cache_.column_bytes() - column_bytes, 1);
+        }
+        if (temp_cache_.num_elements() == dataset()->input_->Cardinality()) {
           VLOG(2) << "Finalizing the cache because its size matches the "
                      "expected input cardinality.";
-          cache_->Complete(std::move(temp_cache_));
+          TF_RETURN_IF_ERROR(temp_cache_.Complete());
         }
         return absl::OkStatus();
       }
@@ -955,8 +1131,10 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
                           IteratorStateWriter* writer) override {
         mutex_lock l(mu_);
         if (!cache_->IsCompleted()) {
+          std::vector<std::vector<Tensor>> elements;
+          TF_RETURN_IF_ERROR(temp_cache_.GetAll(&elements));
           TF_RETURN_IF_ERROR(
-              WriteElementsToCheckpoint(writer, prefix(), temp_cache_));
+              WriteElementsToCheckpoint(writer, prefix(), elements));
         }
         return SaveInput(ctx, writer, input_impl_);
       }
@@ -965,8 +1143,14 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
                              IteratorStateReader* reader) override {
         mutex_lock l(mu_);
         if (!reader->Contains(prefix(), kCacheCompleted)) {
+          std::vector<std::vector<Tensor>> elements;
           TF_RETURN_IF_ERROR(
-              ReadElementsFromCheckpoint(ctx, reader, prefix(), &temp_cache_));
+              ReadElementsFromCheckpoint(ctx, reader, prefix(), &elements));
+          temp_cache_.Clear();
+          for (std::vector<Tensor>& element : elements) {
+            TF_RETURN_IF_ERROR(temp_cache_.Add(ctx, element).status());
+            element.clear();
+          }
         }
         return RestoreInput(ctx, reader, input_impl_);
       }
@@ -975,7 +1159,7 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       mutex mu_;
       std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(mu_);
       MemoryCache* const cache_ TF_GUARDED_BY(mu_);  // not owned.
-      std::vector<std::vector<Tensor>> temp_cache_ TF_GUARDED_BY(mu_);
+      TieredCacheBuilder temp_cache_ TF_GUARDED_BY(mu_);
     };  // MemoryWriterIterator
 
     class MemoryReaderIterator : public DatasetIterator<MemoryDatasetBase> {
@@ -983,7 +1167,13 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       explicit MemoryReaderIterator(const Params& params, MemoryCache* cache)
           : DatasetIterator<MemoryDatasetBase>(params),
             cache_(cache),
-            index_(0) {}
+            index_(0),
+            columns_(cache->columns()) {
+        if (columns_) {
+          column_reader_ =
+              std::make_unique<CacheColumnStore::Reader>(columns_.get());
+        }
+      }
 
       Status Initialize(IteratorContext* ctx) override {
         // The memory allocated for the cache is owned by the parent
@@ -992,7 +1182,16 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         // is that this is incorrect if there are concurrent instances of this
         // iterator.
         tf_shared_lock l(mu_);
-        for (size_t i = 0; i < cache_->size(); ++i) {
+        if (columns_) {
+          // Packed columns are not held as tensors, so their size is recorded
+          // as is.
+          if (ctx->model() != nullptr && model_node() != nullptr) {
+            model_node()->record_buffer_event(columns_->size_bytes(),
+                                              columns_->num_elements());
+          }
+          return absl::OkStatus();
+        }
+        for (size_t i = 0; i < cache_->num_in_memory(); ++i) {
           RecordBufferEnqueue(ctx, cache_->at(i));
         }
         return absl::OkStatus();
@@ -1002,10 +1201,39 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
                              std::vector<Tensor>* out_tensors,
                              bool* end_of_sequence) override {
         mutex_lock l(mu_);
-        if (index_ < cache_->size()) {
-          const std::vector<Tensor>& cache_tensors = cache_->at(index_);
-          out_tensors->insert(out_tensors->begin(), cache_tensors.begin(),
-                              cache_tensors.end());
+        const size_t num_in_memory = cache_->num_in_memory();
+        if (index_ < num_in_memory) {
+          if (column_reader_) {
+            std::vector<Tensor> element;
+            TF_RETURN_IF_ERROR(column_reader_->Get(index_, &element));
+            out_tensors->insert(out_tensors->begin(),
+                                std::make_move_iterator(element.begin()),
+                                std::make_move_iterator(element.end()));
+          } else {
+            const std::vector<Tensor>& cache_tensors = cache_->at(index_);
+            out_tensors->insert(out_tensors->begin(), cache_tensors.begin(),
+                                cache_tensors.end());
+          }
+          index_++;
+          *end_of_sequence = false;
+          return absl::OkStatus();
+        } else if (index_ < cache_->size()) {
+          if (spill_reader_ == nullptr) {
+            spill_reader_ = std::make_unique<CacheSpillFileReader>(
+                cache_->spilled(), index_ - num_in_memory,
+                cache_->options().spill_prefetch_depth, *ctx->runner(),
+                ctx->cancellation_manager());
+          }
+          std::vector<Tensor> element;
+          bool end_of_file = false;
+          TF_RETURN_IF_ERROR(spill_reader_->GetNext(&element, &end_of_file));
+          if (end_of_file) {
+            return errors::Internal("Cache spill file ended at element ",
+                                    index_);
+          }
+          out_tensors->insert(out_tensors->begin(),
+                              std::make_move_iterator(element.begin()),
+                              std::make_move_iterator(element.end()));
           index_++;
           *end_of_sequence = false;
           return absl::OkStatus();
@@ -1041,6 +1269,7 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
           }
           index_ = static_cast<size_t>(temp);
         }
+        spill_reader_.reset();
         return absl::OkStatus();
       }
 
@@ -1048,6 +1277,12 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       mutex mu_;
       MemoryCache* const cache_ TF_GUARDED_BY(mu_);  // not owned.
       size_t index_ TF_GUARDED_BY(mu_);
+      // Packed in-memory elements, if the cache is columnar.
+      const std::shared_ptr<const CacheColumnStore> columns_;
+      std::unique_ptr<CacheColumnStore::Reader> column_reader_
+          TF_GUARDED_BY(mu_);
+      // Reads the spilled elements ahead once `index_` reaches them.
+      std::unique_ptr<CacheSpillFileReader> spill_reader_ TF_GUARDED_BY(mu_);
     };  // MemoryReaderIterator
 
     Status InitializeIterator(IteratorContext* ctx)
@@ -1112,8 +1347,8 @@ class CacheDatasetOp::MemoryDataset : public CacheDatasetOp::MemoryDatasetBase {
     TF_RETURN_IF_ERROR(b->AddInputDataset(ctx, input_, &input_node));
     Node* filename_node = nullptr;
     TF_RETURN_IF_ERROR(b->AddScalar(tstring(""), &filename_node));
-    TF_RETURN_IF_ERROR(
-        b->AddDataset(this, {input_node, filename_node}, output));
+    TF_RETURN_IF_ERROR(b->AddDataset(this, {input_node, filename_node},
+                                     CacheOptionsAttrs(b), output));
     return absl::OkStatus();
   }
 
@@ -1161,8 +1396,9 @@ class CacheDatasetOp::MemoryDatasetV2
     Tensor handle(DT_RESOURCE, TensorShape({}));
     handle.scalar<ResourceHandle>()() = resource_handle_;
     TF_RETURN_IF_ERROR(b->AddTensor(handle, &resource_handle_node));
-    TF_RETURN_IF_ERROR(b->AddDataset(
-        this, {input_node, filename_node, resource_handle_node}, output));
+    TF_RETURN_IF_ERROR(
+        b->AddDataset(this, {input_node, filename_node, resource_handle_node},
+                      CacheOptionsAttrs(b), output));
     return absl::OkStatus();
   }
 
@@ -1175,7 +1411,35 @@ class CacheDatasetOp::MemoryDatasetV2
 
 CacheDatasetOp::CacheDatasetOp(OpKernelConstruction* ctx)
     : UnaryDatasetOpKernel(ctx),
-      op_version_(ctx->def().op() == kCacheDataset ? 1 : 2) {}
+      op_version_(ctx->def().op() == kCacheDataset ? 1 : 2) {
+  if (ctx->HasAttr(kMemoryBudgetBytes)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kMemoryBudgetBytes,
+                                     &cache_options_.memory_budget_bytes));
+    OP_REQUIRES(ctx, cache_options_.memory_budget_bytes >= 0,
+                errors::InvalidArgument(
+                    "`memory_budget_bytes` must be non-negative; was ",
+                    cache_options_.memory_budget_bytes));
+  }
+  if (ctx->HasAttr(kSpillDirectory)) {
+    OP_REQUIRES_OK(
+        ctx, ctx->GetAttr(kSpillDirectory, &cache_options_.spill_directory));
+  }
+  if (ctx->HasAttr(kSpillPrefetchDepth)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kSpillPrefetchDepth,
+                                     &cache_options_.spill_prefetch_depth));
+    OP_REQUIRES(ctx, cache_options_.spill_prefetch_depth > 0,
+                errors::InvalidArgument(
+                    "`spill_prefetch_depth` must be positive; was ",
+                    cache_options_.spill_prefetch_depth));
+  }
+  if (ctx->HasAttr(kColumnar)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kColumnar, &cache_options_.columnar));
+  }
+  if (ctx->HasAttr(kCompressColumns)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kCompressColumns,
+                                     &cache_options_.compress_columns));
+  }
+}
 
 void CacheDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
                                  DatasetBase** output) {
@@ -1198,8 +1462,9 @@ void CacheDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
         OP_REQUIRES_OK(
             ctx,
             ctx->resource_manager()->LookupOrCreate<MemoryCacheManager>(
-                container, name, &manager, [](MemoryCacheManager** manager) {
-                  *manager = new MemoryCacheManager();
+                container, name, &manager,
+                [this](MemoryCacheManager** manager) {
+                  *manager = new MemoryCacheManager(cache_options_);
                   return absl::OkStatus();
                 }));
         handle = MakeResourceHandle<MemoryCacheManager>(ctx, container, name);
@@ -1213,8 +1478,9 @@ void CacheDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
       MemoryCacheManager* manager;
       OP_REQUIRES_OK(
           ctx, ctx->resource_manager()->LookupOrCreate<MemoryCacheManager>(
-                   container, name, &manager, [](MemoryCacheManager** manager) {
-                     *manager = new MemoryCacheManager();
+                   container, name, &manager,
+                   [this](MemoryCacheManager** manager) {
+                     *manager = new MemoryCacheManager(cache_options_);
                      return absl::OkStatus();
                    }));
       auto handle =
@@ -16,6 +16,7 @@ limitations under the License.
 #define TENSORFLOW_CORE_KERNELS_DATA_CACHE_DATASET_OPS_H_
 
 #include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/kernels/data/cache_ops.h"
 
 namespace tensorflow {
 namespace data {
@@ -30,6 +31,13 @@ class CacheDatasetOp : public UnaryDatasetOpKernel {
   static constexpr const char* const kFileName = "filename";
   static constexpr const char* const kOutputTypes = "output_types";
   static constexpr const char* const kOutputShapes = "output_shapes";
+  static constexpr const char* const kMemoryBudgetBytes =
+      "memory_budget_bytes";
+  static constexpr const char* const kSpillDirectory = "spill_directory";
+  static constexpr const char* const kSpillPrefetchDepth =
+      "spill_prefetch_depth";
+  static constexpr const char* const kColumnar = "columnar";
+  static constexpr const char* const kCompressColumns = "compress_columns";
 
   explicit CacheDatasetOp(OpKernelConstruction* ctx);
 
@@ -44,6 +52,8 @@ class CacheDatasetOp : public UnaryDatasetOpKernel {
   class MemoryDatasetV2;
 
   const int op_version_;
+  // Options of the memory caches created by the op.
+  MemoryCache::Options cache_options_;
 };
 
 }  // namespace data
@@ -14,6 +14,10 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/cache_ops.h"
 
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
@@ -34,9 +38,25 @@ constexpr char kMemoryCache[] = "MemoryCache";
 string MemoryCacheManager::DebugString() const { return kMemoryCache; }
 
 void MemoryCache::Complete(std::vector<std::vector<Tensor>>&& cache) {
+  Complete(std::move(cache), /*spilled=*/nullptr);
+}
+
+void MemoryCache::Complete(std::vector<std::vector<Tensor>>&& cache,
+                           std::shared_ptr<const CacheSpillFile> spilled) {
   mutex_lock l(mu_);
   if (!completed_) {
     cache_ = std::move(cache);
+    spilled_ = std::move(spilled);
+    completed_ = true;
+  }
+}
+
+void MemoryCache::Complete(std::shared_ptr<const CacheColumnStore> columns,
+                           std::shared_ptr<const CacheSpillFile> spilled) {
+  mutex_lock l(mu_);
+  if (!completed_) {
+    columns_ = std::move(columns);
+    spilled_ = std::move(spilled);
     completed_ = true;
   }
 }
@@ -50,6 +70,8 @@ void MemoryCache::Reset() {
   mutex_lock l(mu_);
   completed_ = false;
   cache_.clear();
+  columns_.reset();
+  spilled_.reset();
 }
 
 const std::vector<Tensor>& MemoryCache::at(int64_t index) {
@@ -60,7 +82,16 @@ const std::vector<Tensor>& MemoryCache::at(int64_t index) {
 
 size_t MemoryCache::size() {
   tf_shared_lock l(mu_);
-  return cache_.size();
+  return NumInMemoryLocked() + (spilled_ ? spilled_->num_elements() : 0);
+}
+
+size_t MemoryCache::num_in_memory() {
+  tf_shared_lock l(mu_);
+  return NumInMemoryLocked();
+}
+
+size_t MemoryCache::NumInMemoryLocked() {
+  return columns_ ? columns_->num_elements() : cache_.size();
 }
 
 const std::vector<std::vector<Tensor>>& MemoryCache::data() {
@@ -68,6 +99,36 @@ const std::vector<std::vector<Tensor>>& MemoryCache::data() {
   return cache_;
 }
 
+std::shared_ptr<const CacheColumnStore> MemoryCache::columns() {
+  tf_shared_lock l(mu_);
+  return columns_;
+}
+
+std::shared_ptr<const CacheSpillFile> MemoryCache::spilled() {
+  tf_shared_lock l(mu_);
+  return spilled_;
+}
+
+Status MemoryCache::GetAll(std::vector<std::vector<Tensor>>* elements) {
+  tf_shared_lock l(mu_);
+  *elements = cache_;
+  if (columns_) {
+    CacheColumnStore::Reader reader(columns_.get());
+    elements->resize(columns_->num_elements());
+    for (int64_t i = 0; i < columns_->num_elements(); ++i) {
+      TF_RETURN_IF_ERROR(reader.Get(i, &(*elements)[i]));
+    }
+  }
+  if (spilled_) {
+    elements->reserve(elements->size() + spilled_->num_elements());
+    for (int64_t i = 0; i < spilled_->num_elements(); ++i) {
+      elements->emplace_back();
+      TF_RETURN_IF_ERROR(spilled_->Read(i, &elements->back()));
+    }
+  }
+  return absl::OkStatus();
+}
+
 AnonymousMemoryCacheHandleOp::AnonymousMemoryCacheHandleOp(
     OpKernelConstruction* ctx)
     : AnonymousResourceOp<MemoryCacheManager>(ctx,
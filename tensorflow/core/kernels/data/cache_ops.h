@@ -16,8 +16,15 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_DATA_CACHE_OPS_H_
 #define TENSORFLOW_CORE_KERNELS_DATA_CACHE_OPS_H_
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/kernels/data/cache_column_store.h"
+#include "tensorflow/core/kernels/data/cache_spill_file.h"
 
 namespace tensorflow {
 namespace data {
@@ -27,40 +34,97 @@ namespace data {
 // The expected use is that a single `MemoryWriterIterator` populates the
 // cache with dataset elements. Once all elements are cached, the cache can
 // be used by one or more `MemoryReaderIterator`s.
+//
+// With a memory budget, the cache is tiered: the elements that fit in the
+// budget are kept in memory, and the remaining ones are spilled to a local
+// `CacheSpillFile`. The in-memory elements always come first.
+//
+// The in-memory elements are held either as tensors, or packed into a
+// `CacheColumnStore`.
 class MemoryCache {
  public:
+  struct Options {
+    // Maximum number of bytes of tensor data to keep in memory. 0 means no
+    // limit, in which case nothing is spilled.
+    int64_t memory_budget_bytes = 0;
+    // Directory of the spill files; a temporary directory if empty.
+    std::string spill_directory;
+    // Number of spilled elements each reader reads ahead.
+    int64_t spill_prefetch_depth = 16;
+    // Whether to pack the in-memory elements into a `CacheColumnStore`, and
+    // whether to compress its chunks.
+    bool columnar = false;
+    bool compress_columns = false;
+  };
+
   MemoryCache() = default;
+  explicit MemoryCache(const Options& options) : options_(options) {}
+
+  const Options& options() const { return options_; }
 
   // Marks the cache as completed.
   void Complete(std::vector<std::vector<Tensor>>&& cache);
 
+  // Marks the cache as completed, with `spilled` holding the elements that
+  // follow those of `cache`.
+  void Complete(std::vector<std::vector<Tensor>>&& cache,
+                std::shared_ptr<const CacheSpillFile> spilled);
+
+  // Marks the cache as completed, with `columns` holding the in-memory
+  // elements and `spilled` those that follow.
+  void Complete(std::shared_ptr<const CacheColumnStore> columns,
+                std::shared_ptr<const CacheSpillFile> spilled);
+
   // Returns whether the cache is completed.
   bool IsCompleted();
 
   // Resets the cache.
   void Reset();
 
-  // Returns the element at the given index.
+  // Returns the element at the given index, which must be less than
+  // `num_in_memory()`. Only valid if the elements are not in `columns()`.
   const std::vector<Tensor>& at(int64_t index);
 
-  // Returns the size of the cache.
+  // Returns the size of the cache, including spilled elements.
   size_t size();
 
-  // Returns a reference to the cache's data. The returned reference will be
-  // invalidated by any call to Reset().
+  // Returns the number of elements held in memory.
+  size_t num_in_memory();
+
+  // Returns a reference to the cache's in-memory data, unless it is held in
+  // `columns()`. The returned reference will be invalidated by any call to
+  // Reset().
   const std::vector<std::vector<Tensor>>& data();
 
+  // Returns the column store holding the in-memory elements, or nullptr if
+  // they are held as tensors.
+  std::shared_ptr<const CacheColumnStore> columns();
+
+  // Returns the spilled elements, or nullptr if none.
+  std::shared_ptr<const CacheSpillFile> spilled();
+
+  // Copies all the elements, including spilled ones, into `elements`.
+  Status GetAll(std::vector<std::vector<Tensor>>* elements);
+
  private:
+  size_t NumInMemoryLocked() TF_SHARED_LOCKS_REQUIRED(mu_);
+
+  const Options options_;
+
   mutex mu_;
   // Determines whether all elements of the dataset have been cached.
   bool completed_ TF_GUARDED_BY(mu_) = false;
   std::vector<std::vector<Tensor>> cache_ TF_GUARDED_BY(mu_);
+  std::shared_ptr<const CacheColumnStore> columns_ TF_GUARDED_BY(mu_);
+  std::shared_ptr<const CacheSpillFile> spilled_ TF_GUARDED_BY(mu_);
 };
 
 // A resource wrapping a shared instance of a memory cache.
 class MemoryCacheManager : public ResourceBase {
  public:
   MemoryCacheManager() : cache_(std::make_shared<MemoryCache>()) {}
+  explicit MemoryCacheManager(const MemoryCache::Options& options)
+      : cache_(std::make_shared<MemoryCache>(options)) {}
 
   string DebugString() const override;
 
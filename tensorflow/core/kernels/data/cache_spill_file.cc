@@ -0,0 +1,283 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/cache_spill_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/strcat.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// How a component is encoded in a record.
+enum ComponentEncoding : uint32 {
+  kRawBytes = 0,
+  kTensorProto = 1,
+};
+
+}  // namespace
+
+void EncodeElement(const std::vector<Tensor>& element, std::string* record) {
+  record->clear();
+  core::PutVarint32(record, element.size());
+  for (const Tensor& component : element) {
+    core::PutVarint32(record, component.dtype());
+    if (DataTypeCanUseMemcpy(component.dtype())) {
+      core::PutVarint32(record, kRawBytes);
+      core::PutVarint32(record, component.dims());
+      for (int i = 0; i < component.dims(); ++i) {
+        core::PutVarint64(record, component.dim_size(i));
+      }
+      const StringPiece data = component.tensor_data();
+      core::PutVarint64(record, data.size());
+      record->append(data.data(), data.size());
+    } else {
+      core::PutVarint32(record, kTensorProto);
+      TensorProto proto;
+      component.AsProtoField(&proto);
+      const std::string serialized = proto.SerializeAsString();
+      core::PutVarint64(record, serialized.size());
+      record->append(serialized);
+    }
+  }
+}
+
+Status DecodeElement(StringPiece record, std::vector<Tensor>* element) {
+  const auto corrupted = [] {
+    return errors::DataLoss("Corrupted cache spill file record");
+  };
+  uint32 num_components;
+  if (!core::GetVarint32(&record, &num_components)) return corrupted();
+  element->clear();
+  element->reserve(num_components);
+  for (uint32 i = 0; i < num_components; ++i) {
+    uint32 dtype, encoding;
+    if (!core::GetVarint32(&record, &dtype) ||
+        !core::GetVarint32(&record, &encoding)) {
+      return corrupted();
+    }
+    if (encoding == kRawBytes) {
+      uint32 dims;
+      if (!core::GetVarint32(&record, &dims)) return corrupted();
+      TensorShape shape;
+      for (uint32 d = 0; d < dims; ++d) {
+        uint64 dim_size;
+        if (!core::GetVarint64(&record, &dim_size)) return corrupted();
+        TF_RETURN_IF_ERROR(shape.AddDimWithStatus(dim_size));
+      }
+      uint64 num_bytes;
+      if (!core::GetVarint64(&record, &num_bytes) ||
+          record.size() < num_bytes) {
+        return corrupted();
+      }
+      Tensor component(static_cast<DataType>(dtype), shape);
+      if (component.tensor_data().size() != num_bytes) return corrupted();
+      if (num_bytes > 0) {
+        std::memcpy(const_cast<char*>(component.tensor_data().data()),
+                    record.data(), num_bytes);
+      }
+      record.remove_prefix(num_bytes);
+      element->push_back(std::move(component));
+    } else if (encoding == kTensorProto) {
+      uint64 num_bytes;
+      if (!core::GetVarint64(&record, &num_bytes) ||
+          record.size() < num_bytes) {
+        return corrupted();
+      }
+      TensorProto proto;
+      if (!proto.ParseFromArray(record.data(), num_bytes)) return corrupted();
+      Tensor component;
+      if (!component.FromProto(proto)) return corrupted();
+      record.remove_prefix(num_bytes);
+      element->push_back(std::move(component));
+    } else {
+      return corrupted();
+    }
+  }
+  return absl::OkStatus();
+}
+
+/*static*/ Status CacheSpillFile::Create(
+    Env* env, const std::string& directory,
+    std::unique_ptr<CacheSpillFile>* file) {
+  std::string filename;
+  if (directory.empty()) {
+    filename = io::GetTempFilename("spill");
+  } else {
+    TF_RETURN_IF_ERROR(env->RecursivelyCreateDir(directory));
+    filename = io::JoinPath(directory, strings::StrCat("tf_data_cache_",
+                                                       random::New64(),
+                                                       ".spill"));
+  }
+  std::unique_ptr<WritableFile> writer;
+  TF_RETURN_IF_ERROR(env->NewWritableFile(filename, &writer));
+  file->reset(new CacheSpillFile(env, std::move(filename), std::move(writer)));
+  return absl::OkStatus();
+}
+
+CacheSpillFile::CacheSpillFile(Env* env, std::string filename,
+                               std::unique_ptr<WritableFile> writer)
+    : env_(env), filename_(std::move(filename)), writer_(std::move(writer)) {}
+
+CacheSpillFile::~CacheSpillFile() {
+  {
+    mutex_lock l(mu_);
+    reader_.reset();
+  }
+  Status s = writer_->Close();
+  if (s.ok()) s = env_->DeleteFile(filename_);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to delete cache spill file " << filename_ << ": "
+                 << s;
+  }
+}
+
+Status CacheSpillFile::Append(const std::vector<Tensor>& element) {
+  EncodeElement(element, &record_);
+  TF_RETURN_IF_ERROR(writer_->Append(record_));
+  offsets_.push_back(offsets_.back() + record_.size());
+  return absl::OkStatus();
+}
+
+Status CacheSpillFile::Flush() { return writer_->Flush(); }
+
+Status CacheSpillFile::GetReader(RandomAccessFile** reader) const {
+  mutex_lock l(mu_);
+  if (reader_ == nullptr) {
+    TF_RETURN_IF_ERROR(env_->NewRandomAccessFile(filename_, &reader_));
+  }
+  *reader = reader_.get();
+  return absl::OkStatus();
+}
+
+Status CacheSpillFile::Read(int64_t index, std::vector<Tensor>* element) const {
+  if (index < 0 || index >= num_elements()) {
+    return errors::OutOfRange("Element ", index, " is out of range [0, ",
+                              num_elements(), ") of cache spill file ",
+                              filename_);
+  }
+  RandomAccessFile* reader;
+  TF_RETURN_IF_ERROR(GetReader(&reader));
+  const uint64_t num_bytes = offsets_[index + 1] - offsets_[index];
+  std::string scratch;
+  scratch.resize(num_bytes);
+  StringPiece record;
+  TF_RETURN_IF_ERROR(
+      reader->Read(offsets_[index], num_bytes, &record, scratch.data()));
+  if (record.size() != num_bytes) {
+    return errors::DataLoss("Truncated cache spill file ", filename_);
+  }
+  return DecodeElement(record, element);
+}
+
+CacheSpillFileReader::CacheSpillFileReader(
+    std::shared_ptr<const CacheSpillFile> file, int64_t start_index,
+    int64_t prefetch_depth, std::function<void(std::function<void()>)> runner,
+    CancellationManager* cancellation_manager)
+    : file_(std::move(file)),
+      prefetch_depth_(std::max<int64_t>(prefetch_depth, 1)),
+      runner_(std::move(runner)),
+      cancellation_manager_(cancellation_manager),
+      next_index_(start_index) {
+  if (cancellation_manager_ != nullptr) {
+    cancellation_token_ = cancellation_manager_->get_cancellation_token();
+    if (!cancellation_manager_->RegisterCallback(cancellation_token_,
+                                                 [this]() { Cancel(); })) {
+      cancellation_token_ = CancellationManager::kInvalidToken;
+      Cancel();
+    }
+  }
+}
+
+CacheSpillFileReader::~CacheSpillFileReader() {
+  if (cancellation_token_ != CancellationManager::kInvalidToken) {
+    cancellation_manager_->DeregisterCallback(cancellation_token_);
+  }
+  mutex_lock l(mu_);
+  while (num_in_flight_ > 0) {
+    cond_var_.wait(l);
+  }
+}
+
+void CacheSpillFileReader::Cancel() {
+  mutex_lock l(mu_);
+  cancelled_ = true;
+  cond_var_.notify_all();
+}
+
+void CacheSpillFileReader::ScheduleReads() {
+  while (static_cast<int64_t>(slots_.size()) < prefetch_depth_ &&
+         next_index_ + static_cast<int64_t>(slots_.size()) <
+             file_->num_elements()) {
+    const int64_t index = next_index_ + slots_.size();
+    auto slot = std::make_shared<Slot>();
+    slots_.push_back(slot);
+    ++num_in_flight_;
+    runner_([this, slot, index]() {
+      std::vector<Tensor> element;
+      Status status = file_->Read(index, &element);
+      mutex_lock l(mu_);
+      slot->status = std::move(status);
+      slot->element = std::move(element);
+      slot->done = true;
+      --num_in_flight_;
+      cond_var_.notify_all();
+    });
+  }
+}
+
+Status CacheSpillFileReader::GetNext(std::vector<Tensor>* element,
+                                     bool* end_of_file) {
+  mutex_lock l(mu_);
+  if (next_index_ >= file_->num_elements()) {
+    *end_of_file = true;
+    return absl::OkStatus();
+  }
+  ScheduleReads();
+  std::shared_ptr<Slot> slot = slots_.front();
+  while (!slot->done && !cancelled_) {
+    cond_var_.wait(l);
+  }
+  if (!slot->done) {
+    return errors::Cancelled("Reading the cache spill file was cancelled");
+  }
+  slots_.pop_front();
+  ++next_index_;
+  ScheduleReads();
+  *end_of_file = false;
+  TF_RETURN_IF_ERROR(slot->status);
+  *element = std::move(slot->element);
+  return absl::OkStatus();
+}
+
+}  // namespace data
+}  // namespace tensorflow
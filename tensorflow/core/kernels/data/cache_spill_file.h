@@ -0,0 +1,154 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_KERNELS_DATA_CACHE_SPILL_FILE_H_
+#define TENSORFLOW_CORE_KERNELS_DATA_CACHE_SPILL_FILE_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/cancellation.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/stringpiece.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+namespace data {
+
+// Encodes `element` into `record` in the format of the records of a
+// `CacheSpillFile`.
+void EncodeElement(const std::vector<Tensor>& element, std::string* record);
+
+// Decodes a record produced by `EncodeElement()`.
+Status DecodeElement(StringPiece record, std::vector<Tensor>* element);
+
+// An append-only local file holding the dataset elements that overflow the
+// memory budget of a `MemoryCache`.
+//
+// Elements are appended in order by a single writer, then read back by index
+// by any number of readers. Each element is stored as one record of its
+// components; components of types that can be memcpy-ed are stored as their
+// shape followed by their raw bytes, others as serialized `TensorProto`s. The
+// record offsets are kept in memory, so the file is only meaningful to the
+// process that wrote it, and it is deleted when the object is destroyed.
+class CacheSpillFile {
+ public:
+  // Creates an empty spill file in `directory`, or in a temporary directory
+  // if `directory` is empty.
+  static Status Create(Env* env, const std::string& directory,
+                       std::unique_ptr<CacheSpillFile>* file);
+
+  ~CacheSpillFile();
+
+  // Appends `element`. Not thread-safe.
+  Status Append(const std::vector<Tensor>& element);
+
+  // Makes the appended elements visible to `Read()`.
+  Status Flush();
+
+  // Reads the element at `index`, which must have been appended and flushed.
+  // May be called concurrently with other reads, but not with `Append()`.
+  Status Read(int64_t index, std::vector<Tensor>* element) const;
+
+  int64_t num_elements() const { return offsets_.size() - 1; }
+
+  // Number of bytes written so far.
+  uint64_t size_bytes() const { return offsets_.back(); }
+
+  const std::string& filename() const { return filename_; }
+
+ private:
+  CacheSpillFile(Env* env, std::string filename,
+                 std::unique_ptr<WritableFile> writer);
+
+  Status GetReader(RandomAccessFile** reader) const;
+
+  Env* const env_;
+  const std::string filename_;
+  std::unique_ptr<WritableFile> writer_;
+  // `offsets_[i]` is the offset of element `i`; the last entry is the end of
+  // the file.
+  std::vector<uint64_t> offsets_ = {0};
+  // Reusable buffer for encoding an element.
+  std::string record_;
+
+  mutable mutex mu_;
+  mutable std::unique_ptr<RandomAccessFile> reader_ TF_GUARDED_BY(mu_);
+
+  CacheSpillFile(const CacheSpillFile&) = delete;
+  void operator=(const CacheSpillFile&) = delete;
+};
+
+// Reads the elements of a `CacheSpillFile` in order, keeping up to
+// `prefetch_depth` reads in flight on `runner` so that reading a spilled tier
+// is not bound by the latency of a single read.
+//
+// Waiting for a read is interrupted once `cancellation_manager`, if not null,
+// is cancelled.
+class CacheSpillFileReader {
+ public:
+  CacheSpillFileReader(std::shared_ptr<const CacheSpillFile> file,
+                       int64_t start_index, int64_t prefetch_depth,
+                       std::function<void(std::function<void()>)> runner,
+                       CancellationManager* cancellation_manager = nullptr);
+
+  // Waits for the reads in flight.
+  ~CacheSpillFileReader();
+
+  // Returns the next element, or sets `end_of_file` once all elements were
+  // read. Returns a CANCELLED error once cancelled.
+  Status GetNext(std::vector<Tensor>* element, bool* end_of_file);
+
+ private:
+  struct Slot {
+    bool done = false;
+    Status status;
+    std::vector<Tensor> element;
+  };
+
+  void ScheduleReads() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  void Cancel();
+
+  const std::shared_ptr<const CacheSpillFile> file_;
+  const int64_t prefetch_depth_;
+  const std::function<void(std::function<void()>)> runner_;
+  CancellationManager* const cancellation_manager_;  // not owned.
+  CancellationToken cancellation_token_ = CancellationManager::kInvalidToken;
+
+  mutex mu_;
+  condition_variable cond_var_;
+  // Index of the element returned by the next call to `GetNext()`.
+  int64_t next_index_ TF_GUARDED_BY(mu_);
+  // Reads of elements `next_index_`, `next_index_ + 1`, ... in order.
+  std::deque<std::shared_ptr<Slot>> slots_ TF_GUARDED_BY(mu_);
+  int num_in_flight_ TF_GUARDED_BY(mu_) = 0;
+  bool cancelled_ TF_GUARDED_BY(mu_) = false;
+
+  CacheSpillFileReader(const CacheSpillFileReader&) = delete;
+  void operator=(const CacheSpillFileReader&) = delete;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_DATA_CACHE_SPILL_FILE_H_
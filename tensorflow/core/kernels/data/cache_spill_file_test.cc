@@ -0,0 +1,170 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/cache_spill_file.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/framework/cancellation.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+std::vector<Tensor> MakeElement(int i) {
+  return {test::AsTensor<float>({1.0f * i, 2.0f * i}, {1, 2}),
+          test::AsTensor<tstring>({absl::StrCat("element_", i)}),
+          Tensor(DT_INT64, TensorShape({0, 3}))};
+}
+
+void ExpectElementEqual(const std::vector<Tensor>& expected,
+                        const std::vector<Tensor>& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    test::ExpectEqual(expected[i], actual[i]);
+  }
+}
+
+std::unique_ptr<CacheSpillFile> CreateSpillFile(int num_elements) {
+  std::unique_ptr<CacheSpillFile> file;
+  TF_CHECK_OK(CacheSpillFile::Create(
+      Env::Default(), io::JoinPath(testing::TmpDir(), "cache_spill_file_test"),
+      &file));
+  for (int i = 0; i < num_elements; ++i) {
+    TF_CHECK_OK(file->Append(MakeElement(i)));
+  }
+  TF_CHECK_OK(file->Flush());
+  return file;
+}
+
+TEST(CacheSpillFileTest, RoundTrip) {
+  std::unique_ptr<CacheSpillFile> file = CreateSpillFile(/*num_elements=*/5);
+  EXPECT_EQ(5, file->num_elements());
+  EXPECT_GT(file->size_bytes(), 0);
+  // Reads are random access.
+  for (int i : {3, 0, 4, 1, 2}) {
+    std::vector<Tensor> element;
+    TF_ASSERT_OK(file->Read(i, &element));
+    ExpectElementEqual(MakeElement(i), element);
+  }
+}
+
+TEST(CacheSpillFileTest, ReadOutOfRange) {
+  std::unique_ptr<CacheSpillFile> file = CreateSpillFile(/*num_elements=*/2);
+  std::vector<Tensor> element;
+  EXPECT_EQ(absl::StatusCode::kOutOfRange, file->Read(2, &element).code());
+  EXPECT_EQ(absl::StatusCode::kOutOfRange, file->Read(-1, &element).code());
+}
+
+TEST(CacheSpillFileTest, DeletesFileOnDestruction) {
+  std::unique_ptr<CacheSpillFile> file = CreateSpillFile(/*num_elements=*/1);
+  const std::string filename = file->filename();
+  TF_EXPECT_OK(Env::Default()->FileExists(filename));
+  file.reset();
+  EXPECT_EQ(absl::StatusCode::kNotFound,
+            Env::Default()->FileExists(filename).code());
+}
+
+TEST(CacheSpillFileTest, CreatesTemporaryFileWithoutDirectory) {
+  std::unique_ptr<CacheSpillFile> file;
+  TF_ASSERT_OK(CacheSpillFile::Create(Env::Default(), "", &file));
+  TF_ASSERT_OK(file->Append(MakeElement(7)));
+  TF_ASSERT_OK(file->Flush());
+  std::vector<Tensor> element;
+  TF_ASSERT_OK(file->Read(0, &element));
+  ExpectElementEqual(MakeElement(7), element);
+}
+
+class CacheSpillFileReaderTest : public ::testing::TestWithParam<int> {};
+
+TEST_P(CacheSpillFileReaderTest, ReadsInOrder) {
+  const int prefetch_depth = GetParam();
+  std::shared_ptr<const CacheSpillFile> file =
+      CreateSpillFile(/*num_elements=*/20);
+  thread::ThreadPool pool(Env::Default(), "cache_spill_file_test",
+                          /*num_threads=*/4);
+  for (int start_index : {0, 7, 20}) {
+    CacheSpillFileReader reader(
+        file, start_index, prefetch_depth,
+        [&pool](std::function<void()> fn) { pool.Schedule(std::move(fn)); });
+    for (int i = start_index; i < 20; ++i) {
+      std::vector<Tensor> element;
+      bool end_of_file = true;
+      TF_ASSERT_OK(reader.GetNext(&element, &end_of_file));
+      ASSERT_FALSE(end_of_file);
+      ExpectElementEqual(MakeElement(i), element);
+    }
+    std::vector<Tensor> element;
+    bool end_of_file = false;
+    TF_ASSERT_OK(reader.GetNext(&element, &end_of_file));
+    EXPECT_TRUE(end_of_file);
+  }
+}
+
+TEST_P(CacheSpillFileReaderTest, DestroyWithReadsInFlight) {
+  std::shared_ptr<const CacheSpillFile> file =
+      CreateSpillFile(/*num_elements=*/20);
+  thread::ThreadPool pool(Env::Default(), "cache_spill_file_test",
+                          /*num_threads=*/4);
+  CacheSpillFileReader reader(
+      file, /*start_index=*/0, GetParam(),
+      [&pool](std::function<void()> fn) { pool.Schedule(std::move(fn)); });
+  std::vector<Tensor> element;
+  bool end_of_file;
+  TF_ASSERT_OK(reader.GetNext(&element, &end_of_file));
+}
+
+TEST_P(CacheSpillFileReaderTest, CancelsPendingRead) {
+  std::shared_ptr<const CacheSpillFile> file =
+      CreateSpillFile(/*num_elements=*/20);
+  // Holds the reads back so that the reader waits for them.
+  std::vector<std::function<void()>> pending_reads;
+  CancellationManager cancellation_manager;
+  {
+    CacheSpillFileReader reader(
+        file, /*start_index=*/0, GetParam(),
+        [&pending_reads](std::function<void()> fn) {
+          pending_reads.push_back(std::move(fn));
+        },
+        &cancellation_manager);
+    cancellation_manager.StartCancel();
+    std::vector<Tensor> element;
+    bool end_of_file;
+    EXPECT_EQ(absl::StatusCode::kCancelled,
+              reader.GetNext(&element, &end_of_file).code());
+    for (std::function<void()>& read : pending_reads) {
+      read();
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(PrefetchDepths, CacheSpillFileReaderTest,
+                         ::testing::Values(1, 4, 32));
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
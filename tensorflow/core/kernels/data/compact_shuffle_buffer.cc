@@ -0,0 +1,377 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/compact_shuffle_buffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/kernels/data/cache_spill_file.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/strcat.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// The spill file is not compacted before its holes take this many bytes, to
+// avoid rewriting small files over and over.
+constexpr uint64_t kMinSpillCompactionBytes = 64 << 20;
+
+Status ReadRecord(RandomAccessFile* file, uint64_t offset, uint64_t size,
+                  std::string* scratch, StringPiece* record) {
+  scratch->resize(size);
+  Status s = file->Read(offset, size, record, scratch->data());
+  if (!s.ok() && !errors::IsOutOfRange(s)) {
+    return s;
+  }
+  if (record->size() != size) {
+    return errors::DataLoss("Truncated shuffle buffer spill file");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+CompactShuffleBuffer::CompactShuffleBuffer(Env* env, const Options& options)
+    : env_(env), options_(options) {}
+
+CompactShuffleBuffer::~CompactShuffleBuffer() { DeleteSpillFile(); }
+
+void CompactShuffleBuffer::Resize(int64_t size) {
+  for (int64_t i = size; i < slots_.size(); ++i) {
+    Release(&slots_[i]);
+  }
+  slots_.resize(size);
+  MaybeCompactMemory();
+}
+
+bool CompactShuffleBuffer::IsFull() const {
+  if (options_.memory_budget_bytes <= 0) {
+    return false;
+  }
+  return memory_bytes_ + spilled_bytes_ >=
+         options_.memory_budget_bytes +
+             std::max<int64_t>(options_.spill_budget_bytes, 0);
+}
+
+Status CompactShuffleBuffer::Put(int64_t index,
+                                 const std::vector<Tensor>& element) {
+  EncodeElement(element, &record_);
+  return PutEncoded(index, record_);
+}
+
+Status CompactShuffleBuffer::PutEncoded(int64_t index, StringPiece record) {
+  Slot& slot = slots_.at(index);
+  Release(&slot);
+  if (record.empty()) {
+    return absl::OkStatus();
+  }
+  // Elements are spilled only once they no longer fit in memory, and memory
+  // is allowed to go over budget when the spill budget is used up as well.
+  const bool spill =
+      options_.memory_budget_bytes > 0 && options_.spill_budget_bytes > 0 &&
+      memory_bytes_ > 0 &&
+      memory_bytes_ + static_cast<int64_t>(record.size()) >
+          options_.memory_budget_bytes &&
+      spilled_bytes_ < options_.spill_budget_bytes;
+  if (spill) {
+    return Spill(record, &slot);
+  }
+  StoreInMemory(record, &slot);
+  return absl::OkStatus();
+}
+
+Status CompactShuffleBuffer::Take(int64_t index,
+                                  std::vector<Tensor>* element) {
+  Slot& slot = slots_.at(index);
+  if (slot.tier == Tier::kEmpty) {
+    element->clear();
+    return absl::OkStatus();
+  }
+  StringPiece record;
+  TF_RETURN_IF_ERROR(Read(slot, &scratch_, &record));
+  TF_RETURN_IF_ERROR(DecodeElement(record, element));
+  Release(&slot);
+  MaybeCompactMemory();
+  return MaybeCompactSpillFile();
+}
+
+Status CompactShuffleBuffer::GetEncoded(int64_t index, std::string* record) {
+  const Slot& slot = slots_.at(index);
+  if (slot.tier == Tier::kEmpty) {
+    record->clear();
+    return absl::OkStatus();
+  }
+  StringPiece data;
+  TF_RETURN_IF_ERROR(Read(slot, &scratch_, &data));
+  record->assign(data.data(), data.size());
+  return absl::OkStatus();
+}
+
+void CompactShuffleBuffer::Swap(int64_t i, int64_t j) {
+  std::swap(slots_.at(i), slots_.at(j));
+}
+
+Status CompactShuffleBuffer::Prefetch(int64_t index) {
+  const Slot& slot = slots_.at(index);
+  if (slot.tier != Tier::kSpilled) {
+    return absl::OkStatus();
+  }
+  if (prefetched_ != nullptr && prefetched_->offset == slot.offset &&
+      prefetched_->size == slot.size) {
+    return absl::OkStatus();
+  }
+  DropPrefetchedRecord();
+  TF_RETURN_IF_ERROR(PrepareSpillReader());
+  if (prefetch_thread_ == nullptr) {
+    prefetch_thread_ = std::make_unique<thread::ThreadPool>(
+        env_, "compact_shuffle_buffer_prefetch", /*num_threads=*/1);
+  }
+  auto record = std::make_shared<PrefetchedRecord>();
+  record->offset = slot.offset;
+  record->size = slot.size;
+  // The spill file is neither compacted nor deleted before the read is done
+  // (see `DropPrefetchedRecord()`), so the thread can use the reader as is.
+  prefetch_thread_->Schedule([record, file = spill_reader_.get()]() {
+    std::string scratch;
+    StringPiece data;
+    record->status =
+        ReadRecord(file, record->offset, record->size, &scratch, &data);
+    if (record->status.ok()) {
+      if (data.data() == scratch.data()) {
+        record->data = std::move(scratch);
+      } else {
+        record->data.assign(data.data(), data.size());
+      }
+    }
+    record->done.Notify();
+  });
+  prefetched_ = std::move(record);
+  return absl::OkStatus();
+}
+
+void CompactShuffleBuffer::StoreInMemory(StringPiece record, Slot* slot) {
+  const uint64_t size = record.size();
+  int64_t block_index = current_block_;
+  if (block_index < 0 ||
+      blocks_[block_index].capacity - blocks_[block_index].used < size) {
+    if (free_blocks_.empty()) {
+      block_index = blocks_.size();
+      blocks_.emplace_back();
+    } else {
+      block_index = free_blocks_.back();
+      free_blocks_.pop_back();
+    }
+    Block& block = blocks_[block_index];
+    block.capacity = std::max(size, kBlockBytes);
+    block.data.reset(new char[block.capacity]);
+    allocated_bytes_ += block.capacity;
+    if (size < kBlockBytes) {
+      const int64_t previous_block = current_block_;
+      current_block_ = block_index;
+      if (previous_block >= 0 && blocks_[previous_block].live == 0) {
+        memory_holes_ -= blocks_[previous_block].used;
+        allocated_bytes_ -= blocks_[previous_block].capacity;
+        blocks_[previous_block] = Block();
+        free_blocks_.push_back(previous_block);
+      }
+    }
+  }
+  Block& block = blocks_[block_index];
+  std::memcpy(block.data.get() + block.used, record.data(), size);
+  slot->tier = Tier::kMemory;
+  slot->block = block_index;
+  slot->offset = block.used;
+  slot->size = size;
+  block.used += size;
+  block.live += size;
+  memory_bytes_ += size;
+}
+
+Status CompactShuffleBuffer::Spill(StringPiece record, Slot* slot) {
+  if (spill_writer_ == nullptr) {
+    TF_RETURN_IF_ERROR(OpenSpillFile());
+  }
+  TF_RETURN_IF_ERROR(spill_writer_->Append(record));
+  slot->tier = Tier::kSpilled;
+  slot->offset = spill_file_size_;
+  slot->size = record.size();
+  spill_file_size_ += record.size();
+  spilled_bytes_ += record.size();
+  spill_needs_flush_ = true;
+  return absl::OkStatus();
+}
+
+Status CompactShuffleBuffer::Read(const Slot& slot, std::string* scratch,
+                                  StringPiece* record) {
+  if (slot.tier == Tier::kMemory) {
+    *record = StringPiece(blocks_[slot.block].data.get() + slot.offset,
+                          slot.size);
+    return absl::OkStatus();
+  }
+  if (prefetched_ != nullptr && prefetched_->offset == slot.offset &&
+      prefetched_->size == slot.size) {
+    std::shared_ptr<PrefetchedRecord> prefetched = std::move(prefetched_);
+    prefetched->done.WaitForNotification();
+    TF_RETURN_IF_ERROR(prefetched->status);
+    *scratch = std::move(prefetched->data);
+    *record = *scratch;
+    return absl::OkStatus();
+  }
+  TF_RETURN_IF_ERROR(PrepareSpillReader());
+  return ReadRecord(spill_reader_.get(), slot.offset, slot.size, scratch,
+                    record);
+}
+
+Status CompactShuffleBuffer::PrepareSpillReader() {
+  if (spill_needs_flush_) {
+    TF_RETURN_IF_ERROR(spill_writer_->Flush());
+    spill_needs_flush_ = false;
+  }
+  if (spill_reader_ == nullptr) {
+    TF_RETURN_IF_ERROR(
+        env_->NewRandomAccessFile(spill_filename_, &spill_reader_));
+  }
+  return absl::OkStatus();
+}
+
+void CompactShuffleBuffer::DropPrefetchedRecord() {
+  if (prefetched_ != nullptr) {
+    prefetched_->done.WaitForNotification();
+    prefetched_.reset();
+  }
+}
+
+void CompactShuffleBuffer::Release(Slot* slot) {
+  if (slot->tier == Tier::kMemory) {
+    Block& block = blocks_[slot->block];
+    block.live -= slot->size;
+    memory_bytes_ -= slot->size;
+    memory_holes_ += slot->size;
+    if (block.live == 0 && slot->block != current_block_) {
+      memory_holes_ -= block.used;
+      allocated_bytes_ -= block.capacity;
+      block = Block();
+      free_blocks_.push_back(slot->block);
+    }
+  } else if (slot->tier == Tier::kSpilled) {
+    spilled_bytes_ -= slot->size;
+  }
+  *slot = Slot();
+}
+
+void CompactShuffleBuffer::MaybeCompactMemory() {
+  if (memory_holes_ <= std::max<uint64_t>(memory_bytes_ / 2, kBlockBytes)) {
+    return;
+  }
+  std::vector<Block> blocks = std::move(blocks_);
+  blocks_.clear();
+  free_blocks_.clear();
+  current_block_ = -1;
+  memory_bytes_ = 0;
+  allocated_bytes_ = 0;
+  memory_holes_ = 0;
+  for (Slot& slot : slots_) {
+    if (slot.tier == Tier::kMemory) {
+      StoreInMemory(
+          StringPiece(blocks[slot.block].data.get() + slot.offset, slot.size),
+          &slot);
+    }
+  }
+}
+
+Status CompactShuffleBuffer::MaybeCompactSpillFile() {
+  if (spill_writer_ == nullptr) {
+    return absl::OkStatus();
+  }
+  if (spilled_bytes_ == 0) {
+    DeleteSpillFile();
+    return absl::OkStatus();
+  }
+  const uint64_t holes = spill_file_size_ - spilled_bytes_;
+  if (holes <= std::max<uint64_t>(spilled_bytes_, kMinSpillCompactionBytes)) {
+    return absl::OkStatus();
+  }
+  DropPrefetchedRecord();
+  if (spill_needs_flush_) {
+    TF_RETURN_IF_ERROR(spill_writer_->Flush());
+  }
+  std::unique_ptr<RandomAccessFile> reader;
+  TF_RETURN_IF_ERROR(env_->NewRandomAccessFile(spill_filename_, &reader));
+  const std::string filename = spill_filename_;
+  std::unique_ptr<WritableFile> writer = std::move(spill_writer_);
+  spill_reader_.reset();
+  spill_file_size_ = 0;
+  spilled_bytes_ = 0;
+  TF_RETURN_IF_ERROR(OpenSpillFile());
+  for (Slot& slot : slots_) {
+    if (slot.tier == Tier::kSpilled) {
+      StringPiece record;
+      TF_RETURN_IF_ERROR(ReadRecord(reader.get(), slot.offset, slot.size,
+                                    &scratch_, &record));
+      TF_RETURN_IF_ERROR(Spill(record, &slot));
+    }
+  }
+  reader.reset();
+  Status s = writer->Close();
+  if (s.ok()) s = env_->DeleteFile(filename);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to delete shuffle buffer spill file " << filename
+                 << ": " << s;
+  }
+  return absl::OkStatus();
+}
+
+Status CompactShuffleBuffer::OpenSpillFile() {
+  if (options_.spill_directory.empty()) {
+    spill_filename_ = io::GetTempFilename("spill");
+  } else {
+    TF_RETURN_IF_ERROR(env_->RecursivelyCreateDir(options_.spill_directory));
+    spill_filename_ = io::JoinPath(
+        options_.spill_directory,
+        strings::StrCat("tf_data_shuffle_", random::New64(), ".spill"));
+  }
+  spill_needs_flush_ = false;
+  return env_->NewWritableFile(spill_filename_, &spill_writer_);
+}
+
+void CompactShuffleBuffer::DeleteSpillFile() {
+  DropPrefetchedRecord();
+  if (spill_writer_ == nullptr) {
+    return;
+  }
+  spill_reader_.reset();
+  Status s = spill_writer_->Close();
+  if (s.ok()) s = env_->DeleteFile(spill_filename_);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to delete shuffle buffer spill file "
+                 << spill_filename_ << ": " << s;
+  }
+  spill_writer_.reset();
+  spill_needs_flush_ = false;
+  spill_file_size_ = 0;
+}
+
+}  // namespace data
+}  // namespace tensorflow
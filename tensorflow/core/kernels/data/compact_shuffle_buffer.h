@@ -0,0 +1,204 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_KERNELS_DATA_COMPACT_SHUFFLE_BUFFER_H_
+#define TENSORFLOW_CORE_KERNELS_DATA_COMPACT_SHUFFLE_BUFFER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/notification.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/stringpiece.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace data {
+
+// Storage for the elements of a shuffle buffer, sized in bytes rather than in
+// number of elements.
+//
+// Elements are stored serialized (see `EncodeElement()`) in large blocks of
+// memory instead of as individual tensors, so the memory used by the buffer
+// is known and its per-element overhead is small. Once the memory budget is
+// used up, further elements are spilled to a local file, up to a budget of
+// their own. Elements are addressed by slot independently of where they are
+// stored, so a shuffle sampling slots uniformly samples the spilled elements
+// as often as the others.
+//
+// Both tiers are logs: removing an element leaves a hole, and a tier is
+// compacted once its holes take more than half of the bytes of its elements.
+// A spilled element can be read ahead on a background thread with
+// `Prefetch()`, so that taking it does not wait for the disk.
+// Not thread-safe.
+class CompactShuffleBuffer {
+ public:
+  struct Options {
+    // Number of bytes of serialized elements to keep in memory. The shuffle
+    // buffer is byte-budgeted only if this is positive.
+    int64_t memory_budget_bytes = 0;
+    // Number of bytes of serialized elements to spill to disk once the memory
+    // budget is used up. 0 disables spilling.
+    int64_t spill_budget_bytes = 0;
+    // Directory of the spill file; a temporary directory if empty.
+    std::string spill_directory;
+  };
+
+  // Size of the blocks of memory holding the elements. Larger elements get
+  // blocks of their own.
+  static constexpr uint64_t kBlockBytes = 4 << 20;
+
+  CompactShuffleBuffer(Env* env, const Options& options);
+
+  // Waits for the prefetched element, if any, and deletes the spill file.
+  ~CompactShuffleBuffer();
+
+  // Returns the number of slots, each of which holds an element or is empty.
+  int64_t size() const { return slots_.size(); }
+
+  // Changes the number of slots. Elements of removed slots are dropped.
+  void Resize(int64_t size);
+
+  // Returns whether the buffered elements use up the memory and spill
+  // budgets, at which point no more elements should be added.
+  bool IsFull() const;
+
+  // Stores `element` in the slot with `index`, replacing its element if any.
+  Status Put(int64_t index, const std::vector<Tensor>& element);
+
+  // Stores the element serialized in `record` in the slot with `index`. An
+  // empty `record` empties the slot.
+  Status PutEncoded(int64_t index, StringPiece record);
+
+  // Moves the element in the slot with `index` to `element`, leaving the slot
+  // empty. An empty slot yields an element without components.
+  Status Take(int64_t index, std::vector<Tensor>* element);
+
+  // Copies the serialized element in the slot with `index` to `record`, which
+  // is left empty if the slot is empty.
+  Status GetEncoded(int64_t index, std::string* record);
+
+  // Starts reading the element in the slot with `index` on a background
+  // thread if it is spilled. At most one element is prefetched at a time, and
+  // it is dropped unless it is the next spilled element to be read.
+  Status Prefetch(int64_t index);
+
+  // Swaps the contents of the slots with `i` and `j`.
+  void Swap(int64_t i, int64_t j);
+
+  // Bytes of the serialized elements held in memory and spilled to disk.
+  int64_t memory_bytes() const { return memory_bytes_; }
+  int64_t spilled_bytes() const { return spilled_bytes_; }
+
+  // Bytes of memory allocated for the elements, including holes and the
+  // unused end of the blocks.
+  int64_t allocated_bytes() const { return allocated_bytes_; }
+
+ private:
+  enum class Tier : uint8_t { kEmpty, kMemory, kSpilled };
+
+  struct Slot {
+    Tier tier = Tier::kEmpty;
+    // Index of the block in `blocks_` if the element is in memory.
+    int64_t block = 0;
+    // Offset of the element in its block or in the spill file.
+    uint64_t offset = 0;
+    uint64_t size = 0;
+  };
+
+  struct Block {
+    std::unique_ptr<char[]> data;
+    uint64_t capacity = 0;
+    uint64_t used = 0;
+    // Bytes of the elements still in the block.
+    uint64_t live = 0;
+  };
+
+  // A spilled element being read in the background, identified by its
+  // location in the spill file.
+  struct PrefetchedRecord {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    Notification done;
+    Status status;
+    std::string data;
+  };
+
+  // Copies `record` to memory and points `slot` at it.
+  void StoreInMemory(StringPiece record, Slot* slot);
+  // Appends `record` to the spill file and points `slot` at it.
+  Status Spill(StringPiece record, Slot* slot);
+  // Returns the serialized element of the non-empty `slot`, using `scratch`
+  // as storage for spilled elements.
+  Status Read(const Slot& slot, std::string* scratch, StringPiece* record);
+  // Empties `slot`.
+  void Release(Slot* slot);
+
+  // Flushes the spill file and opens it for reading, if needed.
+  Status PrepareSpillReader();
+  // Waits for the prefetched element, if any, and drops it.
+  void DropPrefetchedRecord();
+
+  // Moves the elements in memory to new blocks if the holes in the current
+  // ones take too much memory.
+  void MaybeCompactMemory();
+  // Moves the spilled elements to a new spill file if the holes in the
+  // current one take too much disk space.
+  Status MaybeCompactSpillFile();
+  Status OpenSpillFile();
+  void DeleteSpillFile();
+
+  Env* const env_;
+  const Options options_;
+
+  std::vector<Slot> slots_;
+  // Blocks of memory, in which `current_block_` is the one being filled. The
+  // memory of blocks without elements is freed, and their index reused.
+  std::vector<Block> blocks_;
+  std::vector<int64_t> free_blocks_;
+  int64_t current_block_ = -1;
+  int64_t memory_bytes_ = 0;
+  int64_t allocated_bytes_ = 0;
+  // Bytes of the blocks used by elements that were removed.
+  uint64_t memory_holes_ = 0;
+
+  std::string spill_filename_;
+  std::unique_ptr<WritableFile> spill_writer_;
+  std::unique_ptr<RandomAccessFile> spill_reader_;
+  // Whether elements were appended to the spill file since the last flush.
+  bool spill_needs_flush_ = false;
+  uint64_t spill_file_size_ = 0;
+  int64_t spilled_bytes_ = 0;
+
+  // Reads spilled elements ahead of `Take()`, created on first use.
+  std::unique_ptr<thread::ThreadPool> prefetch_thread_;
+  std::shared_ptr<PrefetchedRecord> prefetched_;
+
+  // Reusable buffers for encoding and reading elements.
+  std::string record_;
+  std::string scratch_;
+
+  CompactShuffleBuffer(const CompactShuffleBuffer&) = delete;
+  void operator=(const CompactShuffleBuffer&) = delete;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_DATA_COMPACT_SHUFFLE_BUFFER_H_
@@ -0,0 +1,240 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/compact_shuffle_buffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/random/philox_random.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// Returns an element identified by `i`, with a payload of `num_bytes`.
+std::vector<Tensor> MakeElement(int64_t i, int64_t num_bytes = 16) {
+  Tensor payload(DT_UINT8, TensorShape({num_bytes}));
+  payload.flat<uint8>().setConstant(static_cast<uint8>(i));
+  return {test::AsScalar<int64_t>(i),
+          test::AsTensor<tstring>({absl::StrCat("element_", i)}), payload};
+}
+
+int64_t ElementId(const std::vector<Tensor>& element) {
+  return element[0].scalar<int64_t>()();
+}
+
+TEST(CompactShuffleBufferTest, PutAndTake) {
+  CompactShuffleBuffer buffer(Env::Default(), {});
+  buffer.Resize(3);
+  TF_ASSERT_OK(buffer.Put(0, MakeElement(0)));
+  TF_ASSERT_OK(buffer.Put(2, MakeElement(2)));
+  buffer.Swap(0, 1);
+
+  std::vector<Tensor> element;
+  TF_ASSERT_OK(buffer.Take(1, &element));
+  test::ExpectEqual(element[1], MakeElement(0)[1]);
+  test::ExpectEqual(element[2], MakeElement(0)[2]);
+  TF_ASSERT_OK(buffer.Take(0, &element));
+  EXPECT_TRUE(element.empty());
+  TF_ASSERT_OK(buffer.Take(2, &element));
+  EXPECT_EQ(ElementId(element), 2);
+  EXPECT_EQ(buffer.memory_bytes(), 0);
+}
+
+TEST(CompactShuffleBufferTest, EncodedRoundTrip) {
+  CompactShuffleBuffer buffer(Env::Default(), {});
+  buffer.Resize(2);
+  TF_ASSERT_OK(buffer.Put(0, MakeElement(7)));
+  std::string record;
+  TF_ASSERT_OK(buffer.GetEncoded(0, &record));
+  TF_ASSERT_OK(buffer.PutEncoded(1, record));
+  TF_ASSERT_OK(buffer.GetEncoded(0, &record));
+  EXPECT_FALSE(record.empty());
+  TF_ASSERT_OK(buffer.PutEncoded(0, ""));
+
+  std::vector<Tensor> element;
+  TF_ASSERT_OK(buffer.Take(1, &element));
+  EXPECT_EQ(ElementId(element), 7);
+  TF_ASSERT_OK(buffer.GetEncoded(0, &record));
+  EXPECT_TRUE(record.empty());
+}
+
+TEST(CompactShuffleBufferTest, IsFullOnceBudgetIsUsedUp) {
+  CompactShuffleBuffer::Options options;
+  options.memory_budget_bytes = 1000;
+  CompactShuffleBuffer buffer(Env::Default(), options);
+  buffer.Resize(100);
+  int64_t i = 0;
+  while (!buffer.IsFull()) {
+    TF_ASSERT_OK(buffer.Put(i, MakeElement(i, /*num_bytes=*/100)));
+    ++i;
+  }
+  EXPECT_GE(buffer.memory_bytes(), 1000);
+  EXPECT_LT(buffer.memory_bytes(), 1200);
+  EXPECT_EQ(buffer.spilled_bytes(), 0);
+}
+
+TEST(CompactShuffleBufferTest, SpillsOnceMemoryBudgetIsUsedUp) {
+  CompactShuffleBuffer::Options options;
+  options.memory_budget_bytes = 1000;
+  options.spill_budget_bytes = 2000;
+  options.spill_directory = testing::TmpDir();
+  CompactShuffleBuffer buffer(Env::Default(), options);
+  buffer.Resize(100);
+  int64_t num_elements = 0;
+  while (!buffer.IsFull()) {
+    TF_ASSERT_OK(buffer.Put(num_elements,
+                            MakeElement(num_elements, /*num_bytes=*/100)));
+    ++num_elements;
+  }
+  EXPECT_LE(buffer.memory_bytes(), 1000);
+  EXPECT_GE(buffer.spilled_bytes(), 1000);
+
+  for (int64_t i = num_elements - 1; i >= 0; --i) {
+    std::vector<Tensor> element;
+    TF_ASSERT_OK(buffer.Take(i, &element));
+    EXPECT_EQ(ElementId(element), i);
+    test::ExpectEqual(element[2], MakeElement(i, /*num_bytes=*/100)[2]);
+  }
+  EXPECT_EQ(buffer.memory_bytes(), 0);
+  EXPECT_EQ(buffer.spilled_bytes(), 0);
+}
+
+TEST(CompactShuffleBufferTest, TakesPrefetchedElements) {
+  CompactShuffleBuffer::Options options;
+  options.memory_budget_bytes = 100;
+  options.spill_budget_bytes = 10000;
+  options.spill_directory = testing::TmpDir();
+  CompactShuffleBuffer buffer(Env::Default(), options);
+  buffer.Resize(10);
+  for (int64_t i = 0; i < 10; ++i) {
+    TF_ASSERT_OK(buffer.Put(i, MakeElement(i, /*num_bytes=*/100)));
+  }
+  ASSERT_GT(buffer.spilled_bytes(), 0);
+
+  // Prefetched elements follow their slot, and prefetching in-memory or empty
+  // slots does nothing.
+  std::vector<Tensor> element;
+  TF_ASSERT_OK(buffer.Prefetch(0));
+  TF_ASSERT_OK(buffer.Prefetch(5));
+  buffer.Swap(5, 9);
+  TF_ASSERT_OK(buffer.Take(9, &element));
+  EXPECT_EQ(ElementId(element), 5);
+  test::ExpectEqual(element[2], MakeElement(5, /*num_bytes=*/100)[2]);
+  TF_ASSERT_OK(buffer.Prefetch(9));
+
+  // A prefetched element that is not taken is dropped by the next prefetch.
+  TF_ASSERT_OK(buffer.Prefetch(6));
+  TF_ASSERT_OK(buffer.Prefetch(7));
+  for (int64_t i : {7, 6, 5, 0}) {
+    TF_ASSERT_OK(buffer.Take(i, &element));
+    EXPECT_EQ(ElementId(element), i == 5 ? 9 : i);
+  }
+}
+
+TEST(CompactShuffleBufferTest, ReclaimsMemoryOfTakenElements) {
+  constexpr int64_t kElementBytes = 64 << 10;
+  CompactShuffleBuffer::Options options;
+  options.memory_budget_bytes = 16 << 20;
+  CompactShuffleBuffer buffer(Env::Default(), options);
+  buffer.Resize(1000);
+  random::PhiloxRandom generator(/*seed=*/1);
+  std::vector<Tensor> element;
+  for (int64_t i = 0; i < 5000; ++i) {
+    const int64_t index = generator()[0] % buffer.size();
+    TF_ASSERT_OK(buffer.Take(index, &element));
+    TF_ASSERT_OK(buffer.Put(index, MakeElement(i, kElementBytes)));
+  }
+  EXPECT_LE(buffer.allocated_bytes(),
+            buffer.memory_bytes() * 3 / 2 +
+                2 * CompactShuffleBuffer::kBlockBytes);
+}
+
+// Shuffles a stream of elements of variable sizes with a buffer of at most
+// `state.range(0)` KiB, spilling `state.range(1)` KiB more to disk. Reports
+// the mean distance between the input and output positions of the elements
+// relative to the number of elements (about 1/3 for a perfect shuffle),
+// along with the memory allocated by the buffer.
+void BM_ShuffleQualityVersusMemory(::testing::benchmark::State& state) {
+  constexpr int64_t kNumElements = 20000;
+  CompactShuffleBuffer::Options options;
+  options.memory_budget_bytes = state.range(0) << 10;
+  options.spill_budget_bytes = state.range(1) << 10;
+  options.spill_directory = testing::TmpDir();
+  std::vector<std::vector<Tensor>> inputs;
+  random::PhiloxRandom generator(/*seed=*/1);
+  for (int64_t i = 0; i < kNumElements; ++i) {
+    // Sizes between 1 KiB and 64 KiB, like small encoded images.
+    inputs.push_back(MakeElement(i, 1024 + generator()[0] % 65536));
+  }
+
+  double displacement = 0;
+  int64_t max_allocated_bytes = 0;
+  for (auto s : state) {
+    CompactShuffleBuffer buffer(Env::Default(), options);
+    buffer.Resize(kNumElements);
+    std::vector<int64_t> occupied;
+    std::vector<int64_t> free_slots;
+    for (int64_t i = kNumElements - 1; i >= 0; --i) {
+      free_slots.push_back(i);
+    }
+    int64_t next_input = 0;
+    int64_t next_output = 0;
+    displacement = 0;
+    std::vector<Tensor> element;
+    while (next_output < kNumElements) {
+      if (next_input < kNumElements && !buffer.IsFull()) {
+        const int64_t slot = free_slots.back();
+        free_slots.pop_back();
+        TF_CHECK_OK(buffer.Put(slot, inputs[next_input++]));
+        occupied.push_back(slot);
+        max_allocated_bytes =
+            std::max(max_allocated_bytes, buffer.allocated_bytes());
+        continue;
+      }
+      const int64_t i = generator()[0] % occupied.size();
+      const int64_t slot = occupied[i];
+      occupied[i] = occupied.back();
+      occupied.pop_back();
+      TF_CHECK_OK(buffer.Take(slot, &element));
+      free_slots.push_back(slot);
+      displacement += std::abs(ElementId(element) - next_output++);
+    }
+  }
+  state.counters["displacement"] = displacement / kNumElements / kNumElements;
+  state.counters["allocated_mb"] = max_allocated_bytes / (1 << 20);
+}
+
+BENCHMARK(BM_ShuffleQualityVersusMemory)
+    ->ArgPair(1 << 10, 0)
+    ->ArgPair(16 << 10, 0)
+    ->ArgPair(64 << 10, 0)
+    ->ArgPair(256 << 10, 0)
+    ->ArgPair(16 << 10, 240 << 10);
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -15,6 +15,12 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/data/experimental/compression_ops.h"
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/data/compression_codec_selector.h"
+#include "tensorflow/core/data/compression_codecs.h"
 #include "tensorflow/core/data/compression_utils.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/variant.h"
@@ -24,8 +30,34 @@ namespace tensorflow {
 namespace data {
 namespace experimental {
 
+namespace {
+
+constexpr char kAdaptiveCodec[] = "adaptive";
+
+}  // namespace
+
+/* static */ constexpr const char* const CompressElementOp::kCodec;
+/* static */ constexpr const char* const
+    CompressElementOp::kAdaptiveMinThroughputMbps;
+
 CompressElementOp::CompressElementOp(OpKernelConstruction* ctx)
-    : OpKernel(ctx) {}
+    : OpKernel(ctx) {
+  std::string codec;
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kCodec, &codec));
+  if (codec != kAdaptiveCodec) {
+    OP_REQUIRES_OK(
+        ctx, ParseElementCompressionOptions(codec, &compression_options_));
+    return;
+  }
+  ElementCodecSelector::Options selector_options;
+  int64_t min_mbps;
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kAdaptiveMinThroughputMbps, &min_mbps));
+  OP_REQUIRES(ctx, min_mbps >= 0,
+              errors::InvalidArgument("`", kAdaptiveMinThroughputMbps,
+                                      "` must be >= 0, got ", min_mbps));
+  selector_options.min_throughput_bytes_per_second = min_mbps * 1e6;
+  codec_selector_ = std::make_unique<ElementCodecSelector>(selector_options);
+}
 
 void CompressElementOp::Compute(OpKernelContext* ctx) {
   std::vector<Tensor> components;
@@ -34,7 +66,12 @@ void CompressElementOp::Compute(OpKernelContext* ctx) {
     components.push_back(ctx->input(i));
   }
   CompressedElement compressed;
-  OP_REQUIRES_OK(ctx, CompressElement(components, &compressed));
+  if (codec_selector_) {
+    OP_REQUIRES_OK(ctx, codec_selector_->Compress(components, &compressed));
+  } else {
+    OP_REQUIRES_OK(ctx, CompressElement(components, compression_options_,
+                                        &compressed));
+  }
 
   Tensor* output;
   OP_REQUIRES_OK(ctx, ctx->allocate_output(0, TensorShape({}), &output));
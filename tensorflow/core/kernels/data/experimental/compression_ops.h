@@ -15,17 +15,35 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_DATA_EXPERIMENTAL_COMPRESSION_OPS_H_
 #define TENSORFLOW_CORE_KERNELS_DATA_EXPERIMENTAL_COMPRESSION_OPS_H_
 
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/data/compression_codec_selector.h"
+#include "tensorflow/core/data/compression_codecs.h"
 #include "tensorflow/core/framework/dataset.h"
 
 namespace tensorflow {
 namespace data {
 namespace experimental {
 
+// Compresses with the codec set by the `codec` attr: "<codec>[:<level>]"
+// (snappy by default), or "adaptive" to pick a codec from measurements on the
+// elements of the dataset, within the compression throughput floor set by the
+// `adaptive_min_throughput_mbps` attr.
 class CompressElementOp : public OpKernel {
  public:
+  static constexpr const char* const kCodec = "codec";
+  static constexpr const char* const kAdaptiveMinThroughputMbps =
+      "adaptive_min_throughput_mbps";
+
   explicit CompressElementOp(OpKernelConstruction* ctx);
 
   void Compute(OpKernelContext* ctx) override;
+
+ private:
+  ElementCompressionOptions compression_options_;
+  // Set in "adaptive" mode.
+  std::unique_ptr<ElementCodecSelector> codec_selector_;
 };
 
 class UncompressElementOp : public OpKernel {
@@ -25,6 +25,7 @@ limitations under the License.
 #include "absl/time/clock.h"
 #include "tensorflow/core/data/hash_utils.h"
 #include "tensorflow/core/data/serialization_utils.h"
+#include "tensorflow/core/data/snapshot_cache.h"
 #include "tensorflow/core/data/snapshot_utils.h"
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -65,6 +66,12 @@ namespace experimental {
     SnapshotDatasetV2Op::kReaderFuncTarguments;
 /* static */ constexpr const char* const
     SnapshotDatasetV2Op::kShardFuncTarguments;
+/* static */ constexpr const char* const SnapshotDatasetV2Op::kSharedCache;
+/* static */ constexpr const char* const
+    SnapshotDatasetV2Op::kSharedCacheMaxBytes;
+/* static */ constexpr const char* const SnapshotDatasetV2Op::kNumReaderShards;
+/* static */ constexpr const char* const
+    SnapshotDatasetV2Op::kReaderShardIndex;
 /* static */ constexpr const int SnapshotDatasetV2Op::kFileFormatVersion;
 
 // ==== Snapshot Implementation ====
@@ -95,6 +102,10 @@ namespace experimental {
  *       ...
  *     - graphhash3/
  *       ...
+ *
+ * When `shared_cache` is set, the user specified path is used as a cache
+ * shared by all jobs pointing at it, in the same layout. See `SnapshotCache`
+ * for the additional files the cache keeps in each graph hash directory.
  */
 
 class SnapshotDatasetV2Op::Dataset : public DatasetBase {
@@ -103,7 +114,9 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
           const std::string& path, const std::string& compression,
           const std::string& reader_prefix, const std::string& writer_prefix,
           std::unique_ptr<CapturedFunction> reader_func,
-          std::unique_ptr<CapturedFunction> shard_func)
+          std::unique_ptr<CapturedFunction> shard_func,
+          std::unique_ptr<SnapshotCache> cache, int64_t num_reader_shards,
+          int64_t reader_shard_index)
       : DatasetBase(DatasetContext(ctx)),
         input_(input),
         hash_(hash),
@@ -112,7 +125,10 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
         reader_prefix_(reader_prefix),
         writer_prefix_(writer_prefix),
         reader_func_(std::move(reader_func)),
-        shard_func_(std::move(shard_func)) {
+        shard_func_(std::move(shard_func)),
+        cache_(std::move(cache)),
+        num_reader_shards_(num_reader_shards),
+        reader_shard_index_(reader_shard_index) {
     input_->Ref();
   }
 
@@ -143,6 +159,9 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
   }
 
   int64_t CardinalityInternal(CardinalityOptions options) const override {
+    // A reader shard gets either some shards of the snapshot or some elements
+    // of the input, depending on whether the snapshot is committed.
+    if (num_reader_shards_ > 1) return kUnknownCardinality;
     return input_->Cardinality();
   }
 
@@ -204,6 +223,19 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
     b->BuildAttrValue(shard_func_other_args_types,
                       &shard_func_arguments_types_attr);
 
+    AttrValue shared_cache_attr;
+    b->BuildAttrValue(cache_ != nullptr, &shared_cache_attr);
+
+    AttrValue shared_cache_max_bytes_attr;
+    b->BuildAttrValue(cache_ != nullptr ? cache_->options().max_bytes : 0,
+                      &shared_cache_max_bytes_attr);
+
+    AttrValue num_reader_shards_attr;
+    b->BuildAttrValue(num_reader_shards_, &num_reader_shards_attr);
+
+    AttrValue reader_shard_index_attr;
+    b->BuildAttrValue(reader_shard_index_, &reader_shard_index_attr);
+
     return b->AddDataset(
         this,
         /*inputs=*/
@@ -220,7 +252,11 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
          {kReaderFunc, reader_func_attr},
          {kShardFunc, shard_func_attr},
          {kReaderFuncTarguments, reader_func_arguments_types_attr},
-         {kShardFuncTarguments, shard_func_arguments_types_attr}},
+         {kShardFuncTarguments, shard_func_arguments_types_attr},
+         {kSharedCache, shared_cache_attr},
+         {kSharedCacheMaxBytes, shared_cache_max_bytes_attr},
+         {kNumReaderShards, num_reader_shards_attr},
+         {kReaderShardIndex, reader_shard_index_attr}},
         output);
   }
 
@@ -235,6 +271,15 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
   std::unique_ptr<CapturedFunction> reader_func_;
   std::unique_ptr<CapturedFunction> shard_func_;
 
+  // Cache rooted at `path_` shared across jobs, or nullptr if the snapshot
+  // isn't shared.
+  const std::unique_ptr<SnapshotCache> cache_;
+
+  // Number of readers splitting the shards of the snapshot, and index of the
+  // shards read by this dataset.
+  const int64_t num_reader_shards_;
+  const int64_t reader_shard_index_;
+
   class Reader : public DatasetIterator<Dataset> {
    public:
     static constexpr const char* const kIteratorName = "Reader";
@@ -265,6 +310,19 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
                                        snapshot_util::kShardDirectorySuffix)),
           &snapshot_shard_dirs));
       std::sort(snapshot_shard_dirs.begin(), snapshot_shard_dirs.end());
+      if (dataset()->num_reader_shards_ > 1) {
+        std::vector<std::string> reader_shard_dirs;
+        for (int64_t i = dataset()->reader_shard_index_;
+             i < snapshot_shard_dirs.size();
+             i += dataset()->num_reader_shards_) {
+          reader_shard_dirs.push_back(std::move(snapshot_shard_dirs[i]));
+        }
+        snapshot_shard_dirs = std::move(reader_shard_dirs);
+      }
+      if (dataset()->cache_ != nullptr) {
+        TF_RETURN_IF_ERROR(dataset()->cache_->RecordAccess(dataset()->hash_));
+        last_access_micros_ = EnvTime::NowMicros();
+      }
 
       DatasetBase* dataset_of_snapshot_files;
       TF_RETURN_IF_ERROR(snapshot_util::Reader::MakeNestedDataset(
@@ -297,6 +355,7 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
                            std::vector<Tensor>* out_tensors,
                            bool* end_of_sequence) override {
       mutex_lock l(mu_);
+      TF_RETURN_IF_ERROR(MaybeRecordAccess());
       return input_impl_->GetNext(ctx, out_tensors, end_of_sequence);
     }
 
@@ -315,10 +374,25 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
     }
 
    private:
+    // Records the access to the snapshot in the cache ten times per eviction
+    // grace period, so that it isn't evicted while being read.
+    Status MaybeRecordAccess() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const int64_t now = EnvTime::NowMicros();
+      if (dataset()->cache_ == nullptr ||
+          now - last_access_micros_ <
+              dataset()->cache_->options().eviction_grace_period_micros / 10) {
+        return absl::OkStatus();
+      }
+      last_access_micros_ = now;
+      return dataset()->cache_->RecordAccess(dataset()->hash_);
+    }
+
     const int64_t start_index_;
 
     mutex mu_;
 
+    int64_t last_access_micros_ TF_GUARDED_BY(mu_) = 0;
+
     std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(mu_);
 
     DatasetBase* input_ TF_GUARDED_BY(mu_) = nullptr;
@@ -334,15 +408,28 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
     static constexpr const char* const kCurrentCheckpointId =
         "current_checkpoint_id";
 
-    explicit Writer(const Params& params)
+    // `holds_claim` is whether the snapshot has already been claimed in the
+    // cache of the dataset for `claim_owner`.
+    Writer(const Params& params, const std::string& claim_owner,
+           bool holds_claim)
         : DatasetIterator<Dataset>(params),
           writers_closed_(false),
           run_id_(0),
-          current_checkpoint_id_(0) {}
+          current_checkpoint_id_(0),
+          claim_owner_(claim_owner),
+          holds_claim_(holds_claim),
+          last_claim_renewal_micros_(EnvTime::NowMicros()) {}
 
     ~Writer() override {
       mutex_lock l(mu_);
       SignalEOF(true);
+      if (holds_claim_) {
+        Status s =
+            dataset()->cache_->ReleaseClaim(dataset()->hash_, claim_owner_);
+        if (!s.ok()) {
+          LOG(WARNING) << "Failed to release the snapshot cache claim: " << s;
+        }
+      }
     }
 
     Status Initialize(IteratorContext* ctx) override {
@@ -380,9 +467,15 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
                   dataset()->hash_),
               run_id_);
           TF_RETURN_IF_ERROR(ctx->env()->RecursivelyCreateDir(run_dir_));
-          TF_RETURN_IF_ERROR(
-              WriteMetadataFile(ctx->env(), /*finalized=*/false));
+          // In the cache, the snapshot is claimed instead, and a non-finalized
+          // metadata file could overwrite the one of a concurrent writer that
+          // took over the claim.
+          if (dataset()->cache_ == nullptr) {
+            TF_RETURN_IF_ERROR(
+                WriteMetadataFile(ctx->env(), /*finalized=*/false));
+          }
         }
+        TF_RETURN_IF_ERROR(MaybeRenewClaim());
 
         // Writers have either encountered an error or are closed.
         {
@@ -403,7 +496,11 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
             mutex_lock wsl(writer_status_mu_);
             TF_RETURN_IF_ERROR(writer_status_);
           }
-          return WriteMetadataFile(ctx->env(), /*finalized=*/true);
+          TF_RETURN_IF_ERROR(WriteMetadataFile(ctx->env(), /*finalized=*/true));
+          if (dataset()->cache_ != nullptr) {
+            TF_RETURN_IF_ERROR(dataset()->cache_->Commit(dataset()->hash_));
+          }
+          return absl::OkStatus();
         }
 
         int64_t shard_index = 0;
@@ -465,6 +562,15 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
           run_id_);
       current_checkpoint_id_ = static_cast<uint64>(current_checkpoint_id);
 
+      if (dataset()->cache_ != nullptr && !holds_claim_) {
+        TF_ASSIGN_OR_RETURN(holds_claim_, dataset()->cache_->TryClaim(
+                                              dataset()->hash_, claim_owner_));
+        if (!holds_claim_) {
+          LOG(WARNING) << "Resuming the snapshot in " << run_dir_
+                       << " claimed by another writer. The last writer to "
+                       << "finish it wins.";
+        }
+      }
       return RestoreInput(ctx, reader, input_impl_);
     }
 
@@ -511,6 +617,31 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
       return snapshot_util::WriteMetadataFile(env, hash_directory, &metadata);
     }
 
+    // Renews the run, and the claim of the snapshot if held, ten times per
+    // lease. Writers that lost their claim keep writing their run, which is
+    // used if they finish the snapshot last.
+    Status MaybeRenewClaim() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const int64_t now = EnvTime::NowMicros();
+      if (dataset()->cache_ == nullptr ||
+          now - last_claim_renewal_micros_ <
+              dataset()->cache_->options().claim_lease_micros / 10) {
+        return absl::OkStatus();
+      }
+      last_claim_renewal_micros_ = now;
+      TF_RETURN_IF_ERROR(dataset()->cache_->RenewRun(run_dir_));
+      if (!holds_claim_) {
+        return absl::OkStatus();
+      }
+      Status s = dataset()->cache_->RenewClaim(dataset()->hash_, claim_owner_);
+      if (errors::IsFailedPrecondition(s)) {
+        LOG(WARNING) << "Lost the claim of the snapshot in " << run_dir_
+                     << " to another writer: " << s;
+        holds_claim_ = false;
+        return absl::OkStatus();
+      }
+      return s;
+    }
+
     void SignalEOF(bool mark_closed) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       if (!writers_closed_) {
         // Push the end of sequence signal to each of the threads to close
@@ -542,6 +673,12 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
 
     std::unique_ptr<InstantiatedCapturedFunction> instantiated_shard_func_
         TF_GUARDED_BY(mu_);
+
+    // Whether this writer holds the claim of the snapshot in the cache, which
+    // it releases when destroyed.
+    const std::string claim_owner_;
+    bool holds_claim_ TF_GUARDED_BY(mu_);
+    int64_t last_claim_renewal_micros_ TF_GUARDED_BY(mu_);
   };
 
   class Passthrough : public DatasetIterator<Dataset> {
@@ -580,12 +717,14 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
    public:
     static constexpr const char* const kIteratorMode = "iterator_mode";
     static constexpr const char* const kIndex = "index";
+    static constexpr const char* const kInputIndex = "input_index";
     static constexpr const char* const kGraphHashDirectory =
         "graph_hash_directory";
 
     explicit Iterator(const Params& params)
         : DatasetIterator<Dataset>(params),
           index_(0),
+          input_index_(0),
           hash_dir_(snapshot_util::HashDirectory(dataset()->path_,
                                                  dataset()->hash_)) {}
 
@@ -605,6 +744,9 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
           return s;
         }
       }
+      if (mode_ != snapshot_util::READER && dataset()->num_reader_shards_ > 1) {
+        return GetNextOfShard(ctx, out_tensors, end_of_sequence);
+      }
       index_++;
       return iterator_->GetNext(ctx, out_tensors, end_of_sequence);
     }
@@ -618,6 +760,8 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name(kIteratorMode),
                                                static_cast<int64_t>(mode_)));
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name(kIndex), index_));
+        TF_RETURN_IF_ERROR(
+            writer->WriteScalar(full_name(kInputIndex), input_index_));
         TF_RETURN_IF_ERROR(
             writer->WriteScalar(full_name(kGraphHashDirectory), hash_dir_));
       }
@@ -635,8 +779,29 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
     }
 
    private:
+    // Until the snapshot is committed, every reader shard runs the whole
+    // input, which may also be written to the snapshot, and keeps the elements
+    // at its index modulo the number of shards.
+    Status GetNextOfShard(IteratorContext* ctx,
+                          std::vector<Tensor>* out_tensors,
+                          bool* end_of_sequence)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      while (true) {
+        out_tensors->clear();
+        TF_RETURN_IF_ERROR(
+            iterator_->GetNext(ctx, out_tensors, end_of_sequence));
+        if (*end_of_sequence) return absl::OkStatus();
+        if (input_index_++ % dataset()->num_reader_shards_ ==
+            dataset()->reader_shard_index_) {
+          index_++;
+          return absl::OkStatus();
+        }
+      }
+    }
+
     Status InitializeIterator(IteratorContext* ctx, IteratorStateReader* reader)
         TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      bool holds_claim = false;
       if (reader != nullptr) {
         // Check whether the computed hash directory is the same.
         tstring hash_dir;
@@ -666,6 +831,10 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
         mode_ = snapshot_util::Mode(iterator_mode);
 
         TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(kIndex), &index_));
+        if (reader->Contains(full_name(kInputIndex))) {
+          TF_RETURN_IF_ERROR(
+              reader->ReadScalar(full_name(kInputIndex), &input_index_));
+        }
       } else {
         experimental::SnapshotMetadataRecord metadata;
         bool file_exists;
@@ -679,9 +848,14 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
         // would always write a new snapshot regardless of whether someone else
         // is currently writing one. Setting this to 0 ensures that all previous
         // snapshots will be ignored and we will proceed to writing.
-        TF_RETURN_IF_ERROR(snapshot_util::DetermineOpState(
-            /*mode_string=*/"", file_exists, &metadata,
-            /*pending_snapshot_expiry_seconds=*/0, &mode_));
+        if (dataset()->cache_ != nullptr) {
+          TF_RETURN_IF_ERROR(
+              DetermineCacheState(ctx, file_exists, metadata, &holds_claim));
+        } else {
+          TF_RETURN_IF_ERROR(snapshot_util::DetermineOpState(
+              /*mode_string=*/"", file_exists, &metadata,
+              /*pending_snapshot_expiry_seconds=*/0, &mode_));
+        }
       }
 
       switch (mode_) {
@@ -692,8 +866,10 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
               index_);
           break;
         case snapshot_util::WRITER:
-          iterator_ = std::make_unique<Writer>(Writer::Params{
-              dataset(), absl::StrCat(prefix(), Writer::kIteratorName)});
+          iterator_ = std::make_unique<Writer>(
+              Writer::Params{dataset(),
+                             absl::StrCat(prefix(), Writer::kIteratorName)},
+              claim_owner_, holds_claim);
           break;
         case snapshot_util::PASSTHROUGH:
           iterator_ = std::make_unique<Passthrough>(Passthrough::Params{
@@ -704,11 +880,48 @@ class SnapshotDatasetV2Op::Dataset : public DatasetBase {
       return iterator_->Initialize(ctx);
     }
 
+    // Unlike with `snapshot_util::DetermineOpState`, at most one job writes
+    // a snapshot of the cache at a time, while the others pass their input
+    // through until the snapshot is finalized.
+    Status DetermineCacheState(
+        IteratorContext* ctx, bool file_exists,
+        const experimental::SnapshotMetadataRecord& metadata,
+        bool* holds_claim) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      SnapshotCache* cache = dataset()->cache_.get();
+      *holds_claim = false;
+      if (!file_exists || !metadata.finalized()) {
+        TF_ASSIGN_OR_RETURN(*holds_claim,
+                            cache->TryClaim(dataset()->hash_, claim_owner_));
+        if (!*holds_claim) {
+          mode_ = snapshot_util::PASSTHROUGH;
+          return absl::OkStatus();
+        }
+        // The previous writer may have finalized the snapshot in between.
+        experimental::SnapshotMetadataRecord claimed_metadata;
+        TF_RETURN_IF_ERROR(snapshot_util::ReadMetadataFile(
+            ctx->env(), io::JoinPath(dataset()->reader_prefix_, hash_dir_),
+            &claimed_metadata, &file_exists));
+        if (!file_exists || !claimed_metadata.finalized()) {
+          mode_ = snapshot_util::WRITER;
+          return absl::OkStatus();
+        }
+        *holds_claim = false;
+        TF_RETURN_IF_ERROR(cache->ReleaseClaim(dataset()->hash_, claim_owner_));
+      }
+      mode_ = snapshot_util::READER;
+      return absl::OkStatus();
+    }
+
     mutex mu_;
     int64_t index_ TF_GUARDED_BY(mu_);
+    // Number of elements of the input seen by a reader shard that isn't
+    // reading the snapshot.
+    int64_t input_index_ TF_GUARDED_BY(mu_);
     std::unique_ptr<IteratorBase> iterator_ TF_GUARDED_BY(mu_);
     snapshot_util::Mode mode_ TF_GUARDED_BY(mu_);
     const std::string hash_dir_;
+    // Owner of the claims of the snapshot in the cache made by this iterator.
+    const std::string claim_owner_ = SnapshotCache::NewOwnerId();
   };
 };
 
@@ -737,6 +950,26 @@ SnapshotDatasetV2Op::SnapshotDatasetV2Op(OpKernelConstruction* ctx)
                                                &reader_func_metadata_));
   OP_REQUIRES_OK(ctx, FunctionMetadata::Create(ctx, kShardFunc, shard_params,
                                                &shard_func_metadata_));
+
+  if (ctx->HasAttr(kSharedCache)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kSharedCache, &shared_cache_));
+  }
+  if (ctx->HasAttr(kSharedCacheMaxBytes)) {
+    OP_REQUIRES_OK(
+        ctx, ctx->GetAttr(kSharedCacheMaxBytes, &shared_cache_max_bytes_));
+  }
+  if (ctx->HasAttr(kNumReaderShards)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kNumReaderShards, &num_reader_shards_));
+  }
+  if (ctx->HasAttr(kReaderShardIndex)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kReaderShardIndex, &reader_shard_index_));
+  }
+  OP_REQUIRES(ctx,
+              num_reader_shards_ >= 1 && reader_shard_index_ >= 0 &&
+                  reader_shard_index_ < num_reader_shards_,
+              errors::InvalidArgument("Invalid reader shard index ",
+                                      reader_shard_index_, " out of ",
+                                      num_reader_shards_, " reader shards."));
 }
 
 void SnapshotDatasetV2Op::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
@@ -773,9 +1006,18 @@ void SnapshotDatasetV2Op::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
                  CapturedFunction::Create(ctx, shard_func_metadata_,
                                           kShardFuncOtherArgs, &shard_func));
 
+  std::unique_ptr<SnapshotCache> cache;
+  if (shared_cache_) {
+    SnapshotCache::Options options;
+    options.root = io::JoinPath(writer_prefix_, path);
+    options.max_bytes = shared_cache_max_bytes_;
+    cache = std::make_unique<SnapshotCache>(ctx->env(), options);
+  }
+
   *output = new SnapshotDatasetV2Op::Dataset(
       ctx, input, hash, path, compression, reader_prefix_, writer_prefix_,
-      std::move(reader_func), std::move(shard_func));
+      std::move(reader_func), std::move(shard_func), std::move(cache),
+      num_reader_shards_, reader_shard_index_);
 }
 
 namespace {
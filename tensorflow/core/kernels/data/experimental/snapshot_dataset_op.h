@@ -60,6 +60,11 @@ class SnapshotDatasetV2Op : public UnaryDatasetOpKernel {
   static constexpr const char* const kReaderFuncTarguments =
       "Treader_func_args";
   static constexpr const char* const kShardFuncTarguments = "Tshard_func_args";
+  static constexpr const char* const kSharedCache = "shared_cache";
+  static constexpr const char* const kSharedCacheMaxBytes =
+      "shared_cache_max_bytes";
+  static constexpr const char* const kNumReaderShards = "num_reader_shards";
+  static constexpr const char* const kReaderShardIndex = "reader_shard_index";
   // Note: If a new constant is declared here, it *must* be defined in
   // snapshot_dataset_op.cc, otherwise it will not compile in debug mode.
 
@@ -83,6 +88,10 @@ class SnapshotDatasetV2Op : public UnaryDatasetOpKernel {
   std::string writer_prefix_;
   bool hash_valid_;
   uint64 hash_;
+  bool shared_cache_ = false;
+  int64_t shared_cache_max_bytes_ = 0;
+  int64_t num_reader_shards_ = 1;
+  int64_t reader_shard_index_ = 0;
 
   std::shared_ptr<FunctionMetadata> reader_func_metadata_;
   std::shared_ptr<FunctionMetadata> shard_func_metadata_;
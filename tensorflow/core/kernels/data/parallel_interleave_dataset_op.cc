@@ -18,6 +18,7 @@ limitations under the License.
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>  // NOLINT
 #include <cmath>
 #include <deque>
 #include <memory>
@@ -45,6 +46,7 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/platform/blocking_counter.h"
 #include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env_time.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/stringprintf.h"
 #include "tensorflow/core/profiler/lib/traceme.h"
@@ -82,6 +84,7 @@ namespace data {
 /* static */ constexpr const char* const
     ParallelInterleaveDatasetOp::kDeterministic;
 /* static */ constexpr const char* const ParallelInterleaveDatasetOp::kSloppy;
+/* static */ constexpr const char* const ParallelInterleaveDatasetOp::kAdaptive;
 
 namespace {
 
@@ -93,6 +96,7 @@ constexpr char kEndOfInput[] = "end_of_input";
 constexpr char kElementIdCounter[] = "element_id_counter";
 constexpr char kCurrentElements[] = "current_elements";
 constexpr char kCurrentElementsSize[] = "current_elements.size";
+constexpr char kAdaptiveCycle[] = "adaptive_cycle";
 constexpr char kFutureElements[] = "future_elements";
 constexpr char kFutureElementsSize[] = "future_elements.size";
 constexpr char kResultsSuffix[] = ".results";
@@ -123,6 +127,15 @@ constexpr double kDefaultPerIteratorPrefetchFactor = 2.0L;
 // Period between reporting dataset statistics.
 constexpr int kStatsReportingPeriodMillis = 1000;
 
+// In the adaptive mode, an element whose iterator has not produced a result
+// for `kStallFactor` times the average latency of the iterators, and at least
+// `kMinStallMicros`, is considered stalled.
+constexpr double kStallFactor = 4.0;
+constexpr int64_t kMinStallMicros = 1000;
+
+// Weight of the latest latency in the moving averages of latencies.
+constexpr double kLatencyDecay = 0.1;
+
 inline int64_t CeilDiv(int64_t numerator, int64_t denominator) {
   return (numerator + denominator - 1) / denominator;
 }
@@ -201,7 +214,8 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           std::unique_ptr<CapturedFunction> captured_func, int64_t cycle_length,
           int64_t block_length, int64_t buffer_output_elements,
           int64_t prefetch_input_elements, int64_t num_parallel_calls,
-          DeterminismPolicy deterministic, const DataTypeVector& output_types,
+          DeterminismPolicy deterministic, bool adaptive,
+          const DataTypeVector& output_types,
           const std::vector<PartialTensorShape>& output_shapes, int op_version)
       : DatasetBase(DatasetContext(ctx)),
         input_(input),
@@ -215,6 +229,7 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
             prefetch_input_elements, cycle_length_)),
         num_parallel_calls_(num_parallel_calls),
         deterministic_(deterministic),
+        adaptive_(adaptive),
         output_types_(output_types),
         output_shapes_(output_shapes),
         op_version_(op_version),
@@ -227,6 +242,7 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
               strings::Printf("%lld", static_cast<long long>(cycle_length))},
              {"deterministic",
               deterministic.IsNondeterministic() ? "false" : "true"},
+             {"adaptive", adaptive_ ? "true" : "false"},
              {"buffer_output_elements",
               strings::Printf("%lld",
                               static_cast<long long>(buffer_output_elements_))},
@@ -349,6 +365,11 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       b->BuildAttrValue(deterministic_.String(), &deterministic_attr);
       attrs.emplace_back(kDeterministic, deterministic_attr);
     }
+    if (op_version_ >= 4) {
+      AttrValue adaptive_attr;
+      b->BuildAttrValue(adaptive_, &adaptive_attr);
+      attrs.emplace_back(kAdaptive, adaptive_attr);
+    }
 
     TF_RETURN_IF_ERROR(b->AddDataset(this, inputs, list_inputs, attrs, output));
     return absl::OkStatus();
@@ -365,7 +386,10 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
               params.dataset->num_parallel_calls_, mu_,
               num_parallel_calls_cond_var_)),
           deterministic_(deterministic),
-          current_elements_(params.dataset->cycle_length_) {}
+          adaptive_(!deterministic && params.dataset->adaptive_),
+          max_cycle_length_(adaptive_ ? 2 * params.dataset->cycle_length_
+                                      : params.dataset->cycle_length_),
+          current_elements_(max_cycle_length_) {}
 
     ~ParallelInterleaveIterator() override { CancelThreads(/*wait=*/true); }
 
@@ -385,12 +409,15 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       // support `num_threads` concurrent tasks without blocking indefinitely.
       //
       // Allocate one thread for the worker manager, one thread for stats
-      // collection, `cycle_length_` threads for the current workers, and
-      // `future_elements_prefetch_` for the future workers.
+      // collection, `cycle_length_` threads for the current workers,
+      // `future_elements_prefetch_` for the future workers, and one thread for
+      // each extra slot of the cycle in the adaptive mode.
       int max_current_workers = dataset()->cycle_length_;
       int future_workers =
           dataset()->prefetch_input_elements_ + dataset()->cycle_length_;
-      int num_threads = 1 + max_current_workers + future_workers;
+      int speculative_workers = max_cycle_length_ - dataset()->cycle_length_;
+      int num_threads =
+          1 + max_current_workers + future_workers + speculative_workers;
       if (ctx->stats_aggregator()) {
         num_threads++;
       }
@@ -432,6 +459,11 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
             VLOG(3) << "Blocked waiting for element "
                     << current_elements_[cycle_index_]->id;
             current_elements_[cycle_index_]->cond_var.wait(l);
+          } else if (adaptive_) {
+            // Wakes up periodically to look for stalled elements.
+            any_element_available_cond_var_.wait_for(
+                l, std::chrono::microseconds(std::max<int64_t>(
+                       kMinStallMicros, latency_micros_)));
           } else {
             any_element_available_cond_var_.wait(l);
           }
@@ -487,7 +519,7 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
                kMaxBufferedElements,
                ComputeMaxBufferedElements(dataset()->prefetch_input_elements_,
                                           dataset()->buffer_output_elements_,
-                                          dataset()->cycle_length_))});
+                                          max_cycle_length_))});
     }
 
     Status SaveInternal(SerializationContext* ctx,
@@ -525,11 +557,14 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           prefix(), kEndOfInput, static_cast<int64_t>(end_of_input_)));
       TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kElementIdCounter,
                                              element_id_counter_));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(
+          prefix(), kAdaptiveCycle, static_cast<int64_t>(adaptive_)));
       TF_RETURN_IF_ERROR(WriteCurrentElements(ctx, writer));
       TF_RETURN_IF_ERROR(WriteFutureElements(ctx, writer));
       // Wake workers back up.
       current_workers_cond_var_.notify_all();
       future_workers_cond_var_.notify_all();
+      speculative_workers_cond_var_.notify_all();
       return absl::OkStatus();
     }
 
@@ -551,9 +586,18 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
             reader->ReadScalar(prefix(), kEndOfInput, &end_of_input));
         end_of_input_ = static_cast<bool>(end_of_input);
       }
-      TF_RETURN_IF_ERROR(ReadCurrentElements(ctx, reader));
+      std::vector<std::shared_ptr<Element>> extra_elements;
+      TF_RETURN_IF_ERROR(ReadCurrentElements(ctx, reader, &extra_elements));
       TF_RETURN_IF_ERROR(ReadFutureElements(ctx, reader));
       mutex_lock l(*mu_);
+      // The elements of the extra slots of an adaptive cycle that don't fit in
+      // the cycle are moved into it first as its slots free up.
+      future_elements_.insert(future_elements_.begin(), extra_elements.begin(),
+                              extra_elements.end());
+      if (cycle_index_ >= current_elements_.size()) {
+        cycle_index_ = 0;
+        block_index_ = 0;
+      }
       initial_elements_created_ = false;
       for (int i = 0; i < current_elements_.size(); ++i) {
         int index = (cycle_index_ + i) % current_elements_.size();
@@ -668,6 +712,13 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       // Whether we tried to initialize the element, but the input iterator
       // was exhausted so we could produce no inputs.
       bool no_input TF_GUARDED_BY(&ParallelInterleaveIterator::mu_) = false;
+      // Time at which the element last started being processed or produced a
+      // result, and moving average of the time its iterator takes to produce
+      // a result. Only tracked in the adaptive mode.
+      int64_t last_progress_micros
+          TF_GUARDED_BY(&ParallelInterleaveIterator::mu_) = 0;
+      double latency_micros TF_GUARDED_BY(&ParallelInterleaveIterator::mu_) =
+          0;
       // Condition variable for communicating between current worker threads
       // and GetNext.
       condition_variable cond_var;
@@ -676,9 +727,10 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           TF_EXCLUSIVE_LOCKS_REQUIRED(&ParallelInterleaveIterator::mu_) {
         return absl::StrFormat(
             "Element(id: %d, iterator_null: %d, results_size: %d, "
-            "cycle_index: %d, active: %d, initialized: %d, no_input: %d)",
+            "cycle_index: %d, active: %d, initialized: %d, no_input: %d, "
+            "latency_micros: %.0f)",
             id, iterator == nullptr, results.size(), cycle_index, active,
-            initialized, no_input);
+            initialized, no_input, latency_micros);
       }
     };
 
@@ -698,6 +750,7 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       }
       current_workers_cond_var_.notify_all();
       future_workers_cond_var_.notify_all();
+      speculative_workers_cond_var_.notify_all();
       num_parallel_calls_cond_var_->notify_all();
       stats_thread_cond_var_.notify_all();
       while (wait && outstanding_threads_ > 0) {
@@ -764,16 +817,97 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       }
       // If we are allowed to be nondeterministic (i.e. return results out of
       // order), try to find an element in the cycle that has a result
-      // available.
-      for (int i = 0; i < dataset()->cycle_length_; ++i) {
-        if (ConsumeHelper(ctx, result)) {
-          return true;
+      // available. In the adaptive mode, the cycle is widened when none is
+      // available because of stalled elements, and searched again.
+      for (int attempt = 0; attempt < 2; ++attempt) {
+        for (int i = 0; i < current_elements_.size(); ++i) {
+          if (ConsumeHelper(ctx, result)) {
+            return true;
+          }
+          AdvanceToNextInCycle();
+        }
+        if (!adaptive_ || !MaybeWidenCycle(ctx)) {
+          break;
         }
-        AdvanceToNextInCycle();
       }
       return false;
     }
 
+    // Returns whether `element` has not made progress for much longer than
+    // elements usually take to produce a result.
+    bool IsStalled(const Element& element, int64_t now_micros)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!element.active || !element.iterator || !element.results.empty()) {
+        return false;
+      }
+      const double threshold_micros = std::max<double>(
+          kStallFactor * latency_micros_, kMinStallMicros);
+      return now_micros - element.last_progress_micros > threshold_micros;
+    }
+
+    // If an element of the cycle is stalled, moves the next element into one
+    // of the `max_cycle_length_ - cycle_length_` extra slots of the cycle so
+    // that results can be produced around the stalled element. The extra
+    // slots are not refilled when their elements are exhausted, so the cycle
+    // narrows back once the stalls are over, and the number of buffered
+    // results stays bounded by that of a cycle of `max_cycle_length_`.
+    // Returns whether the cycle was widened.
+    bool MaybeWidenCycle(IteratorContext* ctx)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const int64_t now_micros = EnvTime::NowMicros();
+      bool stalled = false;
+      for (int64_t i = 0; i <= last_valid_current_element_; ++i) {
+        if (current_elements_[i] &&
+            IsStalled(*current_elements_[i], now_micros)) {
+          stalled = true;
+          break;
+        }
+      }
+      if (!stalled) {
+        return false;
+      }
+      for (int64_t i = dataset()->cycle_length_; i < max_cycle_length_; ++i) {
+        if (current_elements_[i]) {
+          continue;
+        }
+        std::shared_ptr<Element> element;
+        if (!future_elements_.empty()) {
+          element = std::move(future_elements_.front());
+          future_elements_.pop_front();
+          if (element->iterator) {
+            EnableAutotune(ctx, element->iterator.get());
+          }
+          future_workers_cond_var_.notify_one();
+        } else {
+          element = MakeElement(ctx);
+          if (!element) {
+            return false;
+          }
+        }
+        VLOG(2) << "Widening the interleave cycle around a stalled element "
+                << "with element " << element->id;
+        element->cycle_index = i;
+        current_elements_[i] = element;
+        speculative_workers_cond_var_.notify_one();
+        last_valid_current_element_ =
+            std::max(last_valid_current_element_, i);
+        return true;
+      }
+      return false;
+    }
+
+    // Records that `element` took `latency_micros` to produce a result.
+    void RecordLatency(Element& element, int64_t latency_micros)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      auto update = [latency_micros](double average) {
+        return average == 0 ? latency_micros
+                            : (1 - kLatencyDecay) * average +
+                                  kLatencyDecay * latency_micros;
+      };
+      element.latency_micros = update(element.latency_micros);
+      latency_micros_ = update(latency_micros_);
+    }
+
     // Consumes a result (if available), returning an indication of whether
     // a result is available. If `true` is returned, `result` either
     // points to a valid result or is null if end of input has been reached.
@@ -802,8 +936,12 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           std::swap(*result, element->results.front());
           element->results.pop_front();
           if (!element->active) {
-            elements_to_process_.push_back(cycle_index_);
-            current_workers_cond_var_.notify_one();
+            if (cycle_index_ >= dataset()->cycle_length_) {
+              speculative_workers_cond_var_.notify_one();
+            } else {
+              elements_to_process_.push_back(cycle_index_);
+              current_workers_cond_var_.notify_one();
+            }
           }
           AdvancePosition();
           return true;
@@ -815,7 +953,10 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
         // We've consumed all results from the element. Get a new element from
         // future_elements, or create a new element if no future elements are
         // available.
-        if (!future_elements_.empty()) {
+        if (cycle_index_ >= dataset()->cycle_length_) {
+          // Extra slots of the adaptive mode are not refilled.
+          current_elements_[cycle_index_].reset();
+        } else if (!future_elements_.empty()) {
           std::shared_ptr<Element> future_element =
               std::move(future_elements_.front());
           future_elements_.pop_front();
@@ -836,14 +977,14 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
             element->cycle_index = cycle_index_;
             current_workers_cond_var_.notify_one();
           }
-          while (last_valid_current_element_ >= 0 &&
-                 !current_elements_[last_valid_current_element_]) {
-            last_valid_current_element_--;
-            if (cycle_index_ > last_valid_current_element_) {
-              // We are about to move the cycle index below in
-              // AdvanceToNextInCycle().
-              cycle_index_ = last_valid_current_element_;
-            }
+        }
+        while (last_valid_current_element_ >= 0 &&
+               !current_elements_[last_valid_current_element_]) {
+          last_valid_current_element_--;
+          if (cycle_index_ > last_valid_current_element_) {
+            // We are about to move the cycle index below in
+            // AdvanceToNextInCycle().
+            cycle_index_ = last_valid_current_element_;
           }
         }
         if (last_valid_current_element_ != -1) {
@@ -898,6 +1039,15 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       for (int i = 0; i < future_workers; ++i) {
         StartFutureWorkerThread(ctx);
       }
+      for (int i = dataset()->cycle_length_; i < max_cycle_length_; ++i) {
+        {
+          mutex_lock l(*mu_);
+          IncrementOutstandingThreads();
+          IncrementActiveWorkers();
+        }
+        thread_pool_->Schedule(
+            [this, ctx]() { SpeculativeWorkerThread(ctx); });
+      }
       while (true) {
         {
           mutex_lock l(*mu_);
@@ -989,6 +1139,9 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           }
           VLOG(3) << "Current worker woke up to process " << element->id;
           element->active = true;
+          if (adaptive_) {
+            element->last_progress_micros = EnvTime::NowMicros();
+          }
         }
         // Loop on the element until we fill its results buffer or reach end of
         // input for the element.
@@ -1007,6 +1160,59 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       }
     }
 
+    // Speculative workers process the elements in the extra slots of the cycle
+    // in the adaptive mode, so that results can be produced around stalled
+    // elements even when all current workers are blocked on them.
+    void SpeculativeWorkerThread(std::shared_ptr<IteratorContext> ctx)
+        TF_LOCKS_EXCLUDED(mu_) {
+      RecordStart(ctx.get());
+      std::shared_ptr<Element> element;
+      auto done = [&]() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        element.reset();
+        RecordStop(ctx.get());
+        DecrementActiveWorkers();
+        DecrementOutstandingThreads();
+      };
+      while (true) {
+        {
+          mutex_lock l(*mu_);
+          element.reset();
+          while (!cancelled_) {
+            if (!wait_for_checkpoint_) {
+              for (int64_t i = dataset()->cycle_length_; i < max_cycle_length_;
+                   ++i) {
+                if (NeedsProcessing(current_elements_[i]) &&
+                    !current_elements_[i]->active) {
+                  element = current_elements_[i];
+                  break;
+                }
+              }
+            }
+            if (element) {
+              break;
+            }
+            WaitWorkerThread(ctx.get(), &speculative_workers_cond_var_, &l);
+          }
+          if (cancelled_) {
+            done();
+            return;
+          }
+          element->active = true;
+          element->last_progress_micros = EnvTime::NowMicros();
+        }
+        while (true) {
+          ProcessElement(ctx.get(), element);
+          {
+            mutex_lock l(*mu_);
+            if (!NeedsProcessing(element)) {
+              element->active = false;
+              break;
+            }
+          }
+        }
+      }
+    }
+
     // Future workers process elements after the current interleave cycle. A
     // future worker's job is to keep `future_elements_` filled with elements.
     // Elements in `future_elements` have had their first `kPerIteratorPrefetch`
@@ -1029,7 +1235,10 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           mutex_lock l(*mu_);
           if (element) {
             element->active = false;
-            if (element->cycle_index != -1) {
+            if (element->cycle_index >= dataset()->cycle_length_) {
+              // A speculative worker may need to process the element further.
+              speculative_workers_cond_var_.notify_one();
+            } else if (element->cycle_index != -1) {
               element->cond_var.notify_one();
               // A current worker may need to process the element further.
               elements_to_process_.push_back(element->cycle_index);
@@ -1052,6 +1261,9 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           }
           VLOG(3) << "Future worker created element " << element->id;
           element->active = true;
+          if (adaptive_) {
+            element->last_progress_micros = EnvTime::NowMicros();
+          }
           future_elements_.push_back(element);
         }
         ProcessElement(ctx.get(), element);
@@ -1091,9 +1303,16 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
         });
         bool end_of_input = false;
         IteratorContext nested_ctx = MakeNestedIteratorContext(ctx);
+        const int64_t start_micros = adaptive_ ? EnvTime::NowMicros() : 0;
         result->status = iterator->GetNext(&nested_ctx, &result->return_values,
                                            &end_of_input);
         result->checkpoint.Merge(nested_ctx.checkpoint());
+        if (adaptive_) {
+          const int64_t now_micros = EnvTime::NowMicros();
+          mutex_lock l(*mu_);
+          RecordLatency(*element, now_micros - start_micros);
+          element->last_progress_micros = now_micros;
+        }
         if (result->status.ok() && end_of_input) {
           mutex_lock l(*mu_);
           element->iterator.reset();
@@ -1478,14 +1697,26 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       return absl::OkStatus();
     }
 
-    Status ReadCurrentElements(IteratorContext* ctx,
-                               IteratorStateReader* reader) {
+    // Reads the elements of the cycle. The cycle of an adaptive iterator has
+    // `cycle_length_` extra slots: they are left empty when an adaptive
+    // iterator restores a checkpoint of a non-adaptive one, and in the other
+    // direction, the elements of the extra slots are appended to
+    // `extra_elements` instead.
+    Status ReadCurrentElements(
+        IteratorContext* ctx, IteratorStateReader* reader,
+        std::vector<std::shared_ptr<Element>>* extra_elements) {
       int64_t size;
       {
         mutex_lock l(*mu_);
         TF_RETURN_IF_ERROR(
             reader->ReadScalar(prefix(), kCurrentElementsSize, &size));
-        if (current_elements_.size() != size) {
+        int64_t saved_adaptive = 0;
+        if (reader->Contains(prefix(), kAdaptiveCycle)) {
+          TF_RETURN_IF_ERROR(
+              reader->ReadScalar(prefix(), kAdaptiveCycle, &saved_adaptive));
+        }
+        const int64_t saved_cycle_length = saved_adaptive ? size / 2 : size;
+        if (saved_cycle_length != dataset()->cycle_length_) {
           // This could mean two things: (1) the user created their checkpoint
           // from a dataset with one cycle_length, then changed the cycle_length
           // and tried to restore from the old checkpoint, or (2) the user set
@@ -1494,10 +1725,10 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           // with a different CPU budget (causing autotune to pick a different
           // cycle length).
           return errors::FailedPrecondition(
-              "The iterator cycle length ", current_elements_.size(),
+              "The iterator cycle length ", dataset()->cycle_length_,
               " is different from the cycle length to restore from the "
               "checkpoint: ",
-              size);
+              saved_cycle_length);
         }
       }
       if (size == 0) {
@@ -1511,7 +1742,11 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
         DCHECK(element == nullptr);
       }
       for (int idx = 0; idx < size; ++idx) {
-        current_elements_[idx] = std::move(elements[idx]);
+        if (idx < current_elements_.size()) {
+          current_elements_[idx] = std::move(elements[idx]);
+        } else if (elements[idx] != nullptr) {
+          extra_elements->push_back(std::move(elements[idx]));
+        }
       }
       return absl::OkStatus();
     }
@@ -1639,6 +1874,9 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
     // Condition variable for waking up future workers.
     condition_variable future_workers_cond_var_;
 
+    // Condition variable for waking up speculative workers.
+    condition_variable speculative_workers_cond_var_;
+
     // Condition variable for waking up the stats thread.
     condition_variable stats_thread_cond_var_;
 
@@ -1672,6 +1910,15 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
     // Determines whether outputs can be produced in deterministic order.
     const bool deterministic_;
 
+    // Whether the cycle is widened around stalled elements, and its maximum
+    // length when widened.
+    const bool adaptive_;
+    const int64_t max_cycle_length_;
+
+    // Moving average of the time the iterators of the elements take to produce
+    // a result. Only tracked in the adaptive mode.
+    double latency_micros_ TF_GUARDED_BY(mu_) = 0;
+
     // Controls cancellation of `input_impl_`. Must be ordered before
     // `input_impl_` so that `input_impl_` is destroyed first.
     std::unique_ptr<CancellationManager> cancellation_manager_;
@@ -1747,6 +1994,7 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
   const int64_t prefetch_input_elements_;
   const int64_t num_parallel_calls_;
   const DeterminismPolicy deterministic_;
+  const bool adaptive_;
   const DataTypeVector output_types_;
   const std::vector<PartialTensorShape> output_shapes_;
   const int op_version_;
@@ -1777,6 +2025,9 @@ ParallelInterleaveDatasetOp::ParallelInterleaveDatasetOp(
     OP_REQUIRES_OK(
         ctx, DeterminismPolicy::FromString(deterministic, &deterministic_));
   }
+  if (op_version_ >= 4 && ctx->HasAttr(kAdaptive)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kAdaptive, &adaptive_));
+  }
 }
 
 void ParallelInterleaveDatasetOp::MakeDataset(OpKernelContext* ctx,
@@ -1843,7 +2094,7 @@ void ParallelInterleaveDatasetOp::MakeDataset(OpKernelContext* ctx,
   *output = new Dataset(
       ctx, input, std::move(captured_func), cycle_length, block_length,
       buffer_output_elements, prefetch_input_elements, num_parallel_calls,
-      deterministic_, output_types_, output_shapes_, op_version_);
+      deterministic_, adaptive_, output_types_, output_shapes_, op_version_);
 }
 
 namespace {
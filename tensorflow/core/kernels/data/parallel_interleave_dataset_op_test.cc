@@ -12,10 +12,20 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/parallel_interleave_dataset_op.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <memory>
+#include <string>
+#include <vector>
 
+#include "absl/strings/match.h"
 #include "tensorflow/core/data/dataset_test_base.h"
+#include "tensorflow/core/data/serialization_utils.h"
 #include "tensorflow/core/graph/graph_def_builder.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/notification.h"
+#include "tensorflow/core/platform/null_file_system.h"
+#include "tensorflow/core/platform/path.h"
 
 namespace tensorflow {
 namespace data {
@@ -95,7 +105,8 @@ class ParallelInterleaveDatasetParams : public DatasetParams {
                     {"Targuments", type_arguments_},
                     {"output_shapes", output_shapes_},
                     {"output_types", output_dtypes_},
-                    {"metadata", ""}};
+                    {"metadata", ""},
+                    {"adaptive", adaptive_}};
     return absl::OkStatus();
   }
 
@@ -103,6 +114,8 @@ class ParallelInterleaveDatasetParams : public DatasetParams {
     return ParallelInterleaveDatasetOp::kDatasetType;
   }
 
+  void set_adaptive(bool adaptive) { adaptive_ = adaptive; }
+
   std::vector<FunctionDef> func_lib() const override { return func_lib_; }
 
  private:
@@ -116,6 +129,7 @@ class ParallelInterleaveDatasetParams : public DatasetParams {
   std::vector<FunctionDef> func_lib_;
   DataTypeVector type_arguments_;
   std::string deterministic_;
+  bool adaptive_ = false;
 };
 
 class ParallelInterleaveDatasetOpTest : public DatasetOpsTestBase {};
@@ -885,6 +899,252 @@ ITERATOR_SAVE_AND_RESTORE_TEST_P(ParallelInterleaveDatasetOpTest,
                                  ParallelInterleaveDatasetParams,
                                  IteratorSaveAndRestoreTestCases())
 
+// Local file system whose reads of files with "slow" in their name block until
+// `ReleaseSlowReads()` is called, to simulate stragglers among remote files.
+class DelayInjectingFileSystem : public NullFileSystem {
+ public:
+  TF_USE_FILESYSTEM_METHODS_WITH_NO_TRANSACTION_SUPPORT;
+
+  static void ReleaseSlowReads() { SlowReads().Notify(); }
+
+  Status NewRandomAccessFile(
+      const string& fname, TransactionToken* token,
+      std::unique_ptr<RandomAccessFile>* result) override {
+    const string local_name = TranslateName(fname);
+    std::unique_ptr<RandomAccessFile> file;
+    TF_RETURN_IF_ERROR(Env::Default()->NewRandomAccessFile(local_name, &file));
+    *result = std::make_unique<DelayedFile>(
+        std::move(file), absl::StrContains(local_name, "slow"));
+    return absl::OkStatus();
+  }
+
+  Status FileExists(const string& fname, TransactionToken* token) override {
+    return Env::Default()->FileExists(TranslateName(fname));
+  }
+
+  Status GetFileSize(const string& fname, TransactionToken* token,
+                     uint64* size) override {
+    return Env::Default()->GetFileSize(TranslateName(fname), size);
+  }
+
+  string TranslateName(const string& name) const override {
+    StringPiece scheme, host, path;
+    io::ParseURI(name, &scheme, &host, &path);
+    return string(path);
+  }
+
+ private:
+  class DelayedFile : public RandomAccessFile {
+   public:
+    DelayedFile(std::unique_ptr<RandomAccessFile> file, bool slow)
+        : file_(std::move(file)), slow_(slow) {}
+
+    Status Read(uint64 offset, size_t n, StringPiece* result,
+                char* scratch) const override {
+      if (slow_) {
+        // Times out rather than hanging if the test fails.
+        WaitForNotificationWithTimeout(&SlowReads(),
+                                       /*timeout_in_us=*/30 * 1000 * 1000);
+      }
+      return file_->Read(offset, n, result, scratch);
+    }
+
+   private:
+    const std::unique_ptr<RandomAccessFile> file_;
+    const bool slow_;
+  };
+
+  static Notification& SlowReads() {
+    static Notification* notification = new Notification();
+    return *notification;
+  }
+};
+
+REGISTER_FILE_SYSTEM("delayed", DelayInjectingFileSystem);
+
+FunctionDef MakeTextLineDataset() {
+  return FunctionDefHelper::Create(
+      /*function_name=*/"MakeTextLineDataset",
+      /*in_def=*/{"filename: string"},
+      /*out_def=*/{"y: variant"},
+      /*attr_def=*/{},
+      /*node_def=*/
+      {{{"compression_type"},
+        "Const",
+        {},
+        {{"value", test::AsScalar<tstring>("")}, {"dtype", DT_STRING}}},
+       {{"buffer_size"},
+        "Const",
+        {},
+        {{"value", test::AsScalar<int64_t>(0)}, {"dtype", DT_INT64}}},
+       {{"dataset"},
+        "TextLineDataset",
+        {"filename", "compression_type:output:0", "buffer_size:output:0"},
+        {}}},
+      /*ret_def=*/{{"y", "dataset:handle:0"}});
+}
+
+// A non-deterministic interleave over a cycle of one slow and several fast
+// files, which produces the lines of the fast files before the slow file can
+// be read only if the cycle is widened around it.
+ParallelInterleaveDatasetParams StragglerDatasetParams(
+    const std::vector<tstring>& filenames) {
+  auto tensor_slice_dataset_params = TensorSliceDatasetParams(
+      /*components=*/{CreateTensor<tstring>(
+          TensorShape{static_cast<int64_t>(filenames.size())}, filenames)},
+      /*node_name=*/"tensor_slice");
+  return ParallelInterleaveDatasetParams(
+      tensor_slice_dataset_params,
+      /*other_arguments=*/{},
+      /*cycle_length=*/1,
+      /*block_length=*/1,
+      /*buffer_output_elements=*/1,
+      /*prefetch_input_elements=*/1,
+      /*num_parallel_calls=*/1,
+      /*func=*/FunctionDefHelper::FunctionRef("MakeTextLineDataset"),
+      /*func_lib=*/{MakeTextLineDataset()},
+      /*type_arguments=*/{},
+      /*output_dtypes=*/{DT_STRING},
+      /*output_shapes=*/{PartialTensorShape({})},
+      /*deterministic=*/DeterminismPolicy::kNondeterministic,
+      /*node_name=*/kNodeName);
+}
+
+TEST_F(ParallelInterleaveDatasetOpTest, AdaptiveCycleReadsAroundStragglers) {
+  std::vector<tstring> filenames;
+  for (const std::string name : {"slow", "fast_0", "fast_1"}) {
+    const std::string filename =
+        io::JoinPath(testing::TmpDir(), absl::StrCat(name, ".txt"));
+    TF_ASSERT_OK(WriteStringToFile(Env::Default(), filename,
+                                   absl::StrCat(name, "_a\n", name, "_b\n")));
+    filenames.push_back(absl::StrCat("delayed://", filename));
+  }
+  auto dataset_params = StragglerDatasetParams(filenames);
+  dataset_params.set_adaptive(true);
+  TF_ASSERT_OK(Initialize(dataset_params));
+
+  // The reads of the slow file block until the lines of the fast files are
+  // produced, which would deadlock without the adaptive mode.
+  std::vector<std::string> lines;
+  bool end_of_sequence = false;
+  while (lines.size() < 4) {
+    std::vector<Tensor> next;
+    TF_ASSERT_OK(
+        iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+    ASSERT_FALSE(end_of_sequence);
+    lines.push_back(std::string(next[0].scalar<tstring>()()));
+  }
+  for (const std::string& line : lines) {
+    EXPECT_TRUE(absl::StartsWith(line, "fast_")) << line;
+  }
+
+  DelayInjectingFileSystem::ReleaseSlowReads();
+  while (true) {
+    std::vector<Tensor> next;
+    TF_ASSERT_OK(
+        iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+    if (end_of_sequence) {
+      break;
+    }
+    lines.push_back(std::string(next[0].scalar<tstring>()()));
+  }
+  std::sort(lines.begin(), lines.end());
+  EXPECT_EQ(lines, std::vector<std::string>({"fast_0_a", "fast_0_b",
+                                             "fast_1_a", "fast_1_b", "slow_a",
+                                             "slow_b"}));
+}
+
+// Checkpoints a non-deterministic interleave with a cycle smaller than its
+// input, and restores the checkpoint with the adaptive mode toggled.
+class AdaptiveInterleaveCheckpointTest
+    : public ParallelInterleaveDatasetOpTest {
+ protected:
+  void CheckRestoreAcrossAdaptiveModes(bool save_adaptive) {
+    auto dataset_params = ParallelInterleaveDatasetParams(
+        TensorSliceDatasetParams(
+            /*components=*/{CreateTensor<int64_t>(
+                TensorShape{3, 3, 1}, {0, 1, 2, 3, 4, 5, 6, 7, 8})},
+            /*node_name=*/"tensor_slice"),
+        /*other_arguments=*/{},
+        /*cycle_length=*/2,
+        /*block_length=*/1,
+        /*buffer_output_elements=*/1,
+        /*prefetch_input_elements=*/1,
+        /*num_parallel_calls=*/2,
+        /*func=*/
+        MakeTensorSliceDatasetFunc(
+            DataTypeVector({DT_INT64}),
+            std::vector<PartialTensorShape>({PartialTensorShape({1})})),
+        /*func_lib=*/{test::function::MakeTensorSliceDataset()},
+        /*type_arguments=*/{},
+        /*output_dtypes=*/{DT_INT64},
+        /*output_shapes=*/{PartialTensorShape({1})},
+        /*deterministic=*/DeterminismPolicy::kNondeterministic,
+        /*node_name=*/kNodeName);
+    TF_ASSERT_OK(InitializeRuntime(dataset_params));
+    std::unique_ptr<TestDataset> saved_dataset;
+    TF_ASSERT_OK(MakeDatasetInMode(dataset_params, save_adaptive,
+                                   &saved_dataset));
+    std::unique_ptr<TestDataset> restored_dataset;
+    TF_ASSERT_OK(MakeDatasetInMode(dataset_params, !save_adaptive,
+                                   &restored_dataset));
+
+    std::unique_ptr<TestIterator> iterator;
+    TF_ASSERT_OK(MakeIterator(dataset_params, *saved_dataset, &iterator));
+    std::vector<Tensor> outputs;
+    bool end_of_sequence = false;
+    for (int i = 0; i < 4; ++i) {
+      std::vector<Tensor> next;
+      TF_ASSERT_OK(iterator->GetNext(&next, &end_of_sequence));
+      ASSERT_FALSE(end_of_sequence);
+      outputs.insert(outputs.end(), next.begin(), next.end());
+    }
+
+    std::unique_ptr<SerializationContext> serialization_ctx;
+    TF_ASSERT_OK(CreateSerializationContext(&serialization_ctx));
+    VariantTensorDataWriter writer;
+    TF_ASSERT_OK(iterator->iterator()->Save(serialization_ctx.get(), &writer));
+    std::vector<const VariantTensorData*> data;
+    writer.GetData(&data);
+    VariantTensorDataReader reader(data);
+    std::unique_ptr<IteratorBase> restored_iterator;
+    TF_ASSERT_OK(RestoreIterator(iterator->ctx(), &reader,
+                                 dataset_params.iterator_prefix(),
+                                 *restored_dataset->dataset(),
+                                 &restored_iterator));
+    while (true) {
+      std::vector<Tensor> next;
+      TF_ASSERT_OK(restored_iterator->GetNext(iterator->ctx(), &next,
+                                              &end_of_sequence));
+      if (end_of_sequence) {
+        break;
+      }
+      outputs.insert(outputs.end(), next.begin(), next.end());
+    }
+    TF_EXPECT_OK(ExpectEqual(
+        outputs,
+        CreateTensors<int64_t>(TensorShape{1}, {{0}, {1}, {2}, {3}, {4}, {5},
+                                                {6}, {7}, {8}}),
+        /*compare_order=*/false));
+  }
+
+ private:
+  Status MakeDatasetInMode(ParallelInterleaveDatasetParams& params,
+                           bool adaptive,
+                           std::unique_ptr<TestDataset>* dataset) {
+    params.set_adaptive(adaptive);
+    return MakeDataset(params, dataset);
+  }
+};
+
+TEST_F(AdaptiveInterleaveCheckpointTest, RestoresAdaptiveCheckpoint) {
+  CheckRestoreAcrossAdaptiveModes(/*save_adaptive=*/true);
+}
+
+TEST_F(AdaptiveInterleaveCheckpointTest, RestoresNonAdaptiveCheckpoint) {
+  CheckRestoreAcrossAdaptiveModes(/*save_adaptive=*/false);
+}
+
 TEST_F(ParallelInterleaveDatasetOpTest, InvalidArguments) {
   std::vector<ParallelInterleaveDatasetParams> invalid_params = {
       ParallelInterleaveDatasetParamsWithInvalidCycleLength(),
@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/parallel_map_dataset_op.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <deque>
 #include <functional>
@@ -40,6 +41,8 @@ limitations under the License.
 #include "tensorflow/core/framework/stats_aggregator.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_util.h"
+#include "tensorflow/core/kernels/data/vectorized_map_plan.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/platform/status.h"
@@ -47,6 +50,7 @@ limitations under the License.
 #include "tensorflow/core/profiler/lib/traceme.h"
 #include "tensorflow/core/profiler/lib/traceme_encode.h"
 #include "tensorflow/core/protobuf/error_codes.pb.h"
+#include "tensorflow/core/util/batch_util.h"
 #include "tsl/platform/logging.h"
 
 namespace tensorflow {
@@ -102,10 +106,11 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
           DeterminismPolicy deterministic,
           std::unique_ptr<CapturedFunction> captured_func,
           bool preserve_cardinality, bool use_unbounded_threadpool,
-          int op_version)
+          int64_t vectorization_batch_size, int op_version)
       : Dataset(DatasetContext(ctx), input, num_parallel_calls, output_types,
                 output_shapes, deterministic, std::move(captured_func),
-                preserve_cardinality, use_unbounded_threadpool, op_version) {}
+                preserve_cardinality, use_unbounded_threadpool,
+                vectorization_batch_size, op_version) {}
 
   Dataset(DatasetContext dataset_context, const DatasetBase* input,
           int64_t num_parallel_calls, const DataTypeVector& output_types,
@@ -113,7 +118,7 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
           DeterminismPolicy deterministic,
           std::unique_ptr<CapturedFunction> captured_func,
           bool preserve_cardinality, bool use_unbounded_threadpool,
-          int op_version)
+          int64_t vectorization_batch_size, int op_version)
       : DatasetBase(std::move(dataset_context)),
         input_(input),
         num_parallel_calls_(num_parallel_calls),
@@ -122,6 +127,7 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
         deterministic_(deterministic),
         preserve_cardinality_(preserve_cardinality),
         use_unbounded_threadpool_(use_unbounded_threadpool),
+        vectorization_batch_size_(vectorization_batch_size),
         captured_func_(std::move(captured_func)),
         op_version_(op_version) {
     input_->Ref();
@@ -253,6 +259,15 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
                       &use_unbounded_threadpool_attr);
     attrs.emplace_back(kUseUnboundedThreadpool, use_unbounded_threadpool_attr);
 
+    if (op_version_ == 2) {
+      // Attr: vectorization_batch_size
+      AttrValue vectorization_batch_size_attr;
+      b->BuildAttrValue(vectorization_batch_size_,
+                        &vectorization_batch_size_attr);
+      attrs.emplace_back(kVectorizationBatchSize,
+                         vectorization_batch_size_attr);
+    }
+
     TF_RETURN_IF_ERROR(b->AddDataset(
         this,
         {std::make_pair(0, input_graph_node),
@@ -309,6 +324,7 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       ctx->MergeCheckpoint(iter_ctx->checkpoint());
       TF_RETURN_IF_ERROR(dataset()->captured_func_->Instantiate(
           ctx, &instantiated_captured_func_));
+      InitializeVectorization();
       if (ctx->warm_start() && !ctx->is_restoring()) {
         EnsureThreadsStarted(ctx);
       }
@@ -541,6 +557,43 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       cond_var_->notify_all();
     }
 
+    // Applies the map function to micro-batches of elements at once if it's
+    // vectorizable and the `vectorization_batch_size` attr is greater than 1.
+    void InitializeVectorization() {
+      vectorization_batch_size_ = dataset()->vectorization_batch_size_;
+      if (vectorization_batch_size_ <= 1) return;
+      const CapturedFunction& captured_func = *dataset()->captured_func_;
+      const FunctionDef* fdef =
+          captured_func.lib_def()->Find(captured_func.func().name());
+      Status s = fdef == nullptr
+                     ? errors::NotFound("Function ",
+                                        captured_func.func().name(),
+                                        " is not in the library.")
+                     : VectorizedMapPlan::Create(
+                           *fdef, captured_func.captured_inputs(),
+                           &vectorized_map_plan_);
+      if (!s.ok()) {
+        VLOG(1) << "Applying the map function element by element: " << s;
+        vectorized_map_plan_.reset();
+      }
+    }
+
+    // Gets the next input element into `input_element`. Returns false, after
+    // completing `result`, if there is none.
+    bool GetNextInput(const std::shared_ptr<IteratorContext>& ctx,
+                      const std::shared_ptr<InvocationResult>& result,
+                      std::vector<Tensor>* input_element)
+        TF_LOCKS_EXCLUDED(*mu_) {
+      result->status = input_impl_->GetNext(ctx.get(), input_element,
+                                            &result->end_of_input);
+      result->checkpoint.Merge(ctx->checkpoint());
+      if (result->end_of_input || !result->status.ok()) {
+        CallCompleted(ctx, result);
+        return false;
+      }
+      return true;
+    }
+
     void CallFunction(const std::shared_ptr<IteratorContext>& ctx,
                       const std::shared_ptr<InvocationResult>& result)
         TF_LOCKS_EXCLUDED(*mu_) {
@@ -550,14 +603,17 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       });
       // Get the next input element.
       std::vector<Tensor> input_element;
-      result->status = input_impl_->GetNext(ctx.get(), &input_element,
-                                            &result->end_of_input);
-      result->checkpoint.Merge(ctx->checkpoint());
-      if (result->end_of_input || !result->status.ok()) {
-        CallCompleted(ctx, result);
-        return;
+      if (GetNextInput(ctx, result, &input_element)) {
+        ApplyFunction(ctx, result, std::move(input_element));
       }
+    }
 
+    // Applies the map function to `input_element`, storing the result in
+    // `result->return_values`, and completes `result` when finished.
+    void ApplyFunction(const std::shared_ptr<IteratorContext>& ctx,
+                       const std::shared_ptr<InvocationResult>& result,
+                       std::vector<Tensor> input_element)
+        TF_LOCKS_EXCLUDED(*mu_) {
       auto done = [this, ctx, result](Status status) {
         if (!status.ok()) {
           result->status = AddErrorContext(status);
@@ -565,32 +621,182 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
         RecordBufferEnqueue(ctx.get(), result->return_values);
         CallCompleted(ctx, result);
       };
+      RunFunction(ctx, std::move(input_element), &result->return_values,
+                  std::move(done));
+    }
+
+    // Gets the next input elements of `results`, and applies the map function
+    // to them at once if they can be stacked. Falls back to applying it
+    // element by element otherwise, or if the vectorized call fails, so that
+    // errors are reported for the elements that cause them.
+    void CallFunctionVectorized(
+        const std::shared_ptr<IteratorContext>& ctx,
+        std::vector<std::shared_ptr<InvocationResult>> results)
+        TF_LOCKS_EXCLUDED(*mu_) {
+      tsl::profiler::TraceMe traceme([&] {
+        return tsl::profiler::TraceMeEncode(
+            "ParallelMapProduceVectorized",
+            {{"element_id", results.front()->uid},
+             {"batch_size", results.size()}});
+      });
+      auto input_elements =
+          std::make_shared<std::vector<std::vector<Tensor>>>();
+      input_elements->reserve(results.size());
+      size_t num_inputs = 0;
+      for (const auto& result : results) {
+        std::vector<Tensor> input_element;
+        if (GetNextInput(ctx, result, &input_element)) {
+          results[num_inputs++] = result;
+          input_elements->push_back(std::move(input_element));
+        }
+      }
+      results.resize(num_inputs);
+      std::vector<Tensor> batch;
+      if (results.size() < 2 ||
+          !StackInputElements(ctx.get(), *input_elements, &batch)) {
+        for (size_t i = 0; i < results.size(); ++i) {
+          ApplyFunction(ctx, results[i], std::move((*input_elements)[i]));
+        }
+        return;
+      }
+
+      auto batch_outputs = std::make_shared<std::vector<Tensor>>();
+      const int64_t start_time_ns = EnvTime::NowNanos();
+      auto done = [this, ctx, results = std::move(results), input_elements,
+                   batch_outputs, start_time_ns](Status status) {
+        if (status.ok()) {
+          status = UnstackOutputs(*batch_outputs, results);
+        }
+        if (!status.ok()) {
+          VLOG(2) << "Applying the map function to a micro-batch of "
+                  << results.size() << " elements one at a time: " << status;
+          for (size_t i = 0; i < results.size(); ++i) {
+            ApplyFunction(ctx, results[i], std::move((*input_elements)[i]));
+          }
+          return;
+        }
+        // The function records the processing time of the call once, but
+        // each element of the micro-batch took that long to map. Accounting
+        // for it per element keeps the model's estimate of the output time,
+        // which divides the processing time of an element by the number of
+        // parallel calls, in line with the elements actually in flight.
+        std::shared_ptr<model::Node> node = model_node();
+        if (node) {
+          node->add_processing_time((results.size() - 1) *
+                                    (EnvTime::NowNanos() - start_time_ns));
+        }
+        metrics::RecordTFDataVectorizedMap(results.size());
+        for (const auto& result : results) {
+          RecordBufferEnqueue(ctx.get(), result->return_values);
+          CallCompleted(ctx, result);
+        }
+      };
+      RunFunction(ctx, std::move(batch), batch_outputs.get(), std::move(done));
+    }
+
+    // Stacks `input_elements` into `batch`, if the map function can be applied
+    // to them at once.
+    bool StackInputElements(
+        IteratorContext* ctx,
+        const std::vector<std::vector<Tensor>>& input_elements,
+        std::vector<Tensor>* batch) {
+      const std::vector<Tensor>& first = input_elements.front();
+      if (!vectorized_map_plan_->CanVectorize(first)) {
+        return false;
+      }
+      for (const auto& input_element : input_elements) {
+        if (input_element.size() != first.size()) return false;
+        for (size_t j = 0; j < first.size(); ++j) {
+          if (input_element[j].dtype() != first[j].dtype() ||
+              input_element[j].shape() != first[j].shape()) {
+            return false;
+          }
+        }
+      }
+      batch->reserve(first.size());
+      for (size_t j = 0; j < first.size(); ++j) {
+        TensorShape shape = first[j].shape();
+        shape.InsertDim(0, input_elements.size());
+        batch->emplace_back(ctx->allocator({}), first[j].dtype(), shape);
+        for (size_t i = 0; i < input_elements.size(); ++i) {
+          if (!batch_util::CopyElementToSlice(input_elements[i][j],
+                                              &batch->back(), i)
+                   .ok()) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    // Unstacks the outputs of a vectorized call into the return values of
+    // `results`.
+    Status UnstackOutputs(
+        const std::vector<Tensor>& batch_outputs,
+        const std::vector<std::shared_ptr<InvocationResult>>& results) {
+      const auto& output_shapes = dataset()->output_shapes();
+      if (batch_outputs.size() != output_shapes.size()) {
+        return errors::InvalidArgument(
+            "The vectorized map function returned ", batch_outputs.size(),
+            " outputs; expected ", output_shapes.size(), ".");
+      }
+      for (size_t j = 0; j < batch_outputs.size(); ++j) {
+        const Tensor& output = batch_outputs[j];
+        if (output.dims() == 0 ||
+            output.dim_size(0) != static_cast<int64_t>(results.size())) {
+          return errors::InvalidArgument(
+              "The vectorized map function returned a tensor of shape ",
+              output.shape().DebugString(), " for a micro-batch of ",
+              results.size(), " elements.");
+        }
+        TensorShape element_shape = output.shape();
+        element_shape.RemoveDim(0);
+        if (!output_shapes[j].IsCompatibleWith(element_shape)) {
+          return errors::InvalidArgument(
+              "The vectorized map function returned elements of shape ",
+              element_shape.DebugString(), "; expected ",
+              output_shapes[j].DebugString(), ".");
+        }
+      }
+      for (size_t i = 0; i < results.size(); ++i) {
+        std::vector<Tensor>& return_values = results[i]->return_values;
+        return_values.reserve(batch_outputs.size());
+        for (const Tensor& output : batch_outputs) {
+          // Slices share the buffer of the batch, unless they are unaligned.
+          Tensor value = output.SubSlice(i);
+          return_values.push_back(value.IsAligned() ? std::move(value)
+                                                    : tensor::DeepCopy(value));
+        }
+      }
+      return absl::OkStatus();
+    }
 
-      // Apply the map function on `input_element`, storing the result in
-      // `result->return_values`, and invoking `done` when finished.
+    // Applies the map function to `args`, storing the result in `rets`, and
+    // invoking `done` when finished.
+    void RunFunction(const std::shared_ptr<IteratorContext>& ctx,
+                     std::vector<Tensor> args, std::vector<Tensor>* rets,
+                     std::function<void(Status)> done)
+        TF_LOCKS_EXCLUDED(*mu_) {
       if (use_unbounded_threadpool_) {
         auto runner_fn = [this](std::function<void()> fn) {
           this->unbounded_thread_pool_->Schedule(fn);
         };
         instantiated_captured_func_->RunAsync(
             runner_fn, ctx->cancellation_manager(), ctx->collective_executor(),
-            std::move(input_element), &result->return_values, done,
-            model_node());
+            std::move(args), rets, done, model_node());
       } else if (dataset()->captured_func_->use_inter_op_parallelism()) {
         instantiated_captured_func_->RunAsync(
-            ctx.get(), std::move(input_element), &result->return_values,
-            std::move(done), model_node());
+            ctx.get(), std::move(args), rets, std::move(done), model_node());
       } else {
         // In this case, the function will be executed using single-threaded
         // executor. We schedule it using `ctx->runner()` to enable concurrent
         // application of the function over different input elements.
         auto fn = std::bind(
-            [this, ctx, result](std::vector<Tensor> input_element) {
+            [this, ctx, rets](std::vector<Tensor> args) {
               return instantiated_captured_func_->Run(
-                  ctx.get(), std::move(input_element), &result->return_values,
-                  model_node());
+                  ctx.get(), std::move(args), rets, model_node());
             },
-            std::move(input_element));
+            std::move(args));
         (*ctx->runner())(
             [this, ctx, fn = std::move(fn), done = std::move(done)]() {
               Status s;
@@ -642,17 +848,32 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
         TF_LOCKS_EXCLUDED(*mu_) {
       RecordStart(ctx.get());
       auto cleanup = gtl::MakeCleanup([this, ctx] { RecordStop(ctx.get()); });
+      // When vectorizing, the parallel calls are grouped into micro-batches of
+      // `min(vectorization_batch_size_, num_parallel_calls)` calls, and a
+      // micro-batch is only scheduled, as a whole, once there is room for all
+      // its calls. The parallelism thus still bounds the number of elements in
+      // flight.
+      const int64_t micro_batch_size =
+          vectorized_map_plan_ ? vectorization_batch_size_ : 1;
       std::vector<std::shared_ptr<InvocationResult>> new_calls;
       {
         tf_shared_lock l(*mu_);  // mu_ == num_parallel_calls_->mu
         new_calls.reserve(num_parallel_calls_->value);
       }
-      auto busy = [this]() TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_) -> bool {
+      auto batch_size = [this, micro_batch_size]()
+                            TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_) -> int64_t {
+        return std::min(micro_batch_size, num_parallel_calls_->value);
+      };
+      auto busy = [this, &batch_size]() TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_)
+                      -> bool {
         int64_t num_parallel_calls = num_parallel_calls_->value;
-        return num_calls_ >= num_parallel_calls ||
-               invocation_results_.size() >= num_parallel_calls;
+        return num_calls_ + batch_size() > num_parallel_calls ||
+               static_cast<int64_t>(invocation_results_.size()) +
+                       batch_size() >
+                   num_parallel_calls;
       };
       while (true) {
+        int64_t calls_per_batch;
         {
           mutex_lock l(*mu_);
           while (!cancelled_ && busy()) {
@@ -663,16 +884,27 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
           if (cancelled_) {
             return;
           }
+          calls_per_batch = batch_size();
           while (!busy()) {
-            invocation_results_.push_back(
-                std::make_shared<InvocationResult>(ctx.get()));
-            new_calls.push_back(invocation_results_.back());
-            num_calls_++;
+            for (int64_t i = 0; i < calls_per_batch; ++i) {
+              invocation_results_.push_back(
+                  std::make_shared<InvocationResult>(ctx.get()));
+              new_calls.push_back(invocation_results_.back());
+              num_calls_++;
+            }
           }
           cond_var_->notify_all();
         }
-        for (const auto& call : new_calls) {
-          CallFunction(ctx, call);
+        if (calls_per_batch > 1) {
+          for (size_t i = 0; i < new_calls.size(); i += calls_per_batch) {
+            CallFunctionVectorized(
+                ctx, {new_calls.begin() + i,
+                      new_calls.begin() + i + calls_per_batch});
+          }
+        } else {
+          for (const auto& call : new_calls) {
+            CallFunction(ctx, call);
+          }
         }
         new_calls.clear();
       }
@@ -792,6 +1024,11 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
     // `input_impl_` so that `input_impl_` is destroyed first.
     std::unique_ptr<CancellationManager> cancellation_manager_;
     std::unique_ptr<InstantiatedCapturedFunction> instantiated_captured_func_;
+    // Number of elements to apply the map function to at once, if
+    // `vectorized_map_plan_` is set.
+    int64_t vectorization_batch_size_ = 0;
+    // Set if the map function is vectorizable.
+    std::unique_ptr<VectorizedMapPlan> vectorized_map_plan_;
     // Must be ordered after `cancellation_manager_` so that `input_impl_` is
     // destroyed first.
     std::unique_ptr<IteratorBase> input_impl_;
@@ -820,6 +1057,7 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
   const DeterminismPolicy deterministic_;
   const bool preserve_cardinality_;
   const bool use_unbounded_threadpool_;
+  const int64_t vectorization_batch_size_;
   const std::unique_ptr<CapturedFunction> captured_func_;
   const int op_version_;
   // This is used for random access provided by Get().
@@ -849,6 +1087,7 @@ ParallelMapDatasetOp::ParallelMapDatasetOp(OpKernelConstruction* ctx)
       deterministic_ = DeterminismPolicy(DeterminismPolicy::Type::kDefault);
     }
     use_unbounded_threadpool_ = false;
+    vectorization_batch_size_ = 0;
   }
   if (op_version_ == 2) {
     std::string deterministic;
@@ -857,6 +1096,11 @@ ParallelMapDatasetOp::ParallelMapDatasetOp(OpKernelConstruction* ctx)
         ctx, DeterminismPolicy::FromString(deterministic, &deterministic_));
     OP_REQUIRES_OK(
         ctx, ctx->GetAttr(kUseUnboundedThreadpool, &use_unbounded_threadpool_));
+    vectorization_batch_size_ = 0;
+    if (ctx->HasAttr(kVectorizationBatchSize)) {
+      OP_REQUIRES_OK(ctx, ctx->GetAttr(kVectorizationBatchSize,
+                                       &vectorization_batch_size_));
+    }
   }
   OP_REQUIRES_OK(ctx,
                  ctx->GetAttr(kPreserveCardinality, &preserve_cardinality_));
@@ -891,7 +1135,8 @@ void ParallelMapDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
   *output = new Dataset(ctx, input, num_parallel_calls, output_types_,
                         output_shapes_, deterministic_,
                         std::move(captured_func), preserve_cardinality_,
-                        use_unbounded_threadpool_, op_version_);
+                        use_unbounded_threadpool_, vectorization_batch_size_,
+                        op_version_);
 }
 
 std::unique_ptr<DatasetBase> MakeDataServiceUncompressDataset(
@@ -907,7 +1152,8 @@ std::unique_ptr<DatasetBase> MakeDataServiceUncompressDataset(
       DeterminismPolicy(DeterminismPolicy::Type::kDefault),
       std::move(captured_function),
       /*preserve_cardinality=*/true,
-      /*use_unbounded_threadpool=*/false, /*op_version=*/2);
+      /*use_unbounded_threadpool=*/false, /*vectorization_batch_size=*/0,
+      /*op_version=*/2);
 }
 
 namespace {
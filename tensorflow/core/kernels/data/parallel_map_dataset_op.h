@@ -40,6 +40,8 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
       "preserve_cardinality";
   static constexpr const char* const kUseUnboundedThreadpool =
       "use_unbounded_threadpool";
+  static constexpr const char* const kVectorizationBatchSize =
+      "vectorization_batch_size";
 
   explicit ParallelMapDatasetOp(OpKernelConstruction* ctx);
 
@@ -57,6 +59,7 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
   bool preserve_cardinality_;
   DeterminismPolicy deterministic_;
   bool use_unbounded_threadpool_;
+  int64_t vectorization_batch_size_;
 
   friend std::unique_ptr<DatasetBase> MakeDataServiceUncompressDataset(
       DatasetBase* input, std::unique_ptr<CapturedFunction> captured_function,
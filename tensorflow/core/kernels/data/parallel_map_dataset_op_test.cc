@@ -11,16 +11,21 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/parallel_map_dataset_op.h"
 
+#include <algorithm>
+
 #include <gtest/gtest.h>
 #include "xla/tsl/lib/core/status_test_util.h"
 #include "tensorflow/core/data/dataset_test_base.h"
 #include "tensorflow/core/data/name_utils.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
 
 namespace tensorflow {
 namespace data {
 namespace {
 
+using ::tensorflow::monitoring::testing::CellReader;
+
 constexpr char kNodeName[] = "parallel_map_dataset";
 constexpr int kOpVersion = 2;
 
@@ -79,10 +84,15 @@ class ParallelMapDatasetParams : public DatasetParams {
                     {"use_inter_op_parallelism", use_inter_op_parallelism_},
                     {"deterministic", deterministic_},
                     {"preserve_cardinality", preserve_cardinality_},
-                    {"metadata", ""}};
+                    {"metadata", ""},
+                    {"vectorization_batch_size", vectorization_batch_size_}};
     return absl::OkStatus();
   }
 
+  void set_vectorization_batch_size(int64_t vectorization_batch_size) {
+    vectorization_batch_size_ = vectorization_batch_size;
+  }
+
   string dataset_type() const override {
     return ParallelMapDatasetOp::kDatasetType;
   }
@@ -98,6 +108,7 @@ class ParallelMapDatasetParams : public DatasetParams {
   bool use_inter_op_parallelism_;
   std::string deterministic_;
   bool preserve_cardinality_;
+  int64_t vectorization_batch_size_ = 0;
 };
 
 class ParallelMapDatasetOpTest : public DatasetOpsTestBase {};
@@ -457,6 +468,57 @@ TEST_F(ParallelMapDatasetOpTest, InvalidNumParallelCalls) {
             absl::StatusCode::kInvalidArgument);
 }
 
+TEST_F(ParallelMapDatasetOpTest, VectorizedMapMatchesElementWiseMap) {
+  auto dataset_params = ParallelMapDatasetParams(
+      RangeDatasetParams(0, 50, 1),
+      /*other_arguments=*/{},
+      /*num_parallel_calls=*/3,
+      /*func=*/MapFunc("XTimesTwo", DT_INT64),
+      /*func_lib*/ {test::function::XTimesTwo()},
+      /*type_arguments=*/{},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({})},
+      /*use_inter_op_parallelism=*/true,
+      /*deterministic=*/DeterminismPolicy::kDeterministic,
+      /*preserve_cardinality=*/true,
+      /*node_name=*/kNodeName);
+  TF_ASSERT_OK(InitializeRuntime(dataset_params));
+
+  auto get_outputs = [&](std::vector<Tensor>* outputs) -> Status {
+    std::unique_ptr<TestDataset> dataset;
+    TF_RETURN_IF_ERROR(MakeDataset(dataset_params, &dataset));
+    std::unique_ptr<TestIterator> iterator;
+    TF_RETURN_IF_ERROR(MakeIterator(dataset_params, *dataset, &iterator));
+    bool end_of_sequence = false;
+    while (!end_of_sequence) {
+      std::vector<Tensor> next;
+      TF_RETURN_IF_ERROR(iterator->GetNext(&next, &end_of_sequence));
+      outputs->insert(outputs->end(), next.begin(), next.end());
+    }
+    return absl::OkStatus();
+  };
+  std::vector<Tensor> expected_outputs;
+  TF_ASSERT_OK(get_outputs(&expected_outputs));
+  ASSERT_EQ(expected_outputs.size(), 50);
+
+  // Micro-batches smaller than, equal to and larger than the parallelism,
+  // which caps their size. Micro-batches are scheduled whole, so all 50
+  // elements are mapped in micro-batches of that size, the last one possibly
+  // cut short by the end of the input.
+  for (int64_t batch_size : {2, 3, 16}) {
+    CellReader<int64_t> vectorized_map("/tensorflow/data/vectorized_map");
+    dataset_params.set_vectorization_batch_size(batch_size);
+    std::vector<Tensor> outputs;
+    TF_EXPECT_OK(get_outputs(&outputs));
+    TF_EXPECT_OK(ExpectEqual(outputs, expected_outputs,
+                             /*compare_order=*/true));
+    const int64_t micro_batch_size = std::min<int64_t>(batch_size, 3);
+    EXPECT_EQ(vectorized_map.Delta("elements"), 50);
+    EXPECT_EQ(vectorized_map.Delta("batches"),
+              (50 + micro_batch_size - 1) / micro_batch_size);
+  }
+}
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/shuffle_dataset_op.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <deque>
 #include <memory>
@@ -32,6 +33,8 @@ limitations under the License.
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/kernels/data/cache_spill_file.h"
+#include "tensorflow/core/kernels/data/compact_shuffle_buffer.h"
 #include "tensorflow/core/kernels/data/random_seed_ops.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/random/philox_random.h"
@@ -54,6 +57,11 @@ namespace data {
 /* static */ constexpr const char* const ShuffleDatasetOpBase::kOutputShapes;
 /* static */ constexpr const char* const
     ShuffleDatasetOpBase::kReshuffleEachIteration;
+/* static */ constexpr const char* const
+    ShuffleDatasetOpBase::kMemoryBudgetBytes;
+/* static */ constexpr const char* const
+    ShuffleDatasetOpBase::kSpillBudgetBytes;
+/* static */ constexpr const char* const ShuffleDatasetOpBase::kSpillDirectory;
 
 /* static */ constexpr const char* const ShuffleDatasetOp::kDatasetType;
 
@@ -75,6 +83,7 @@ constexpr char kSlicesEnd[] = "slices_end";
 constexpr char kSlicesReachedEndOfSequence[] = "slices_reached_end_of_sequence";
 constexpr char kSeedGenerator[] = "SeedGenerator";
 constexpr char kEpochNumRandomSamples[] = "epoch_num_random_samples";
+constexpr char kCompactBuffer[] = "compact_buffer";
 constexpr char kShuffleDatasetV1[] = "ShuffleDataset";
 constexpr char kShuffleDatasetV2[] = "ShuffleDatasetV2";
 constexpr char kShuffleDatasetV3[] = "ShuffleDatasetV3";
@@ -82,7 +91,20 @@ constexpr char kShuffleAndRepeatDatasetV1[] = "ShuffleAndRepeatDataset";
 constexpr char kShuffleAndRepeatDatasetV2[] = "ShuffleAndRepeatDatasetV2";
 
 ShuffleDatasetOpBase::ShuffleDatasetOpBase(OpKernelConstruction* ctx)
-    : UnaryDatasetOpKernel(ctx) {}
+    : UnaryDatasetOpKernel(ctx) {
+  if (ctx->HasAttr(kMemoryBudgetBytes)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kMemoryBudgetBytes,
+                                     &buffer_options_.memory_budget_bytes));
+  }
+  if (ctx->HasAttr(kSpillBudgetBytes)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kSpillBudgetBytes,
+                                     &buffer_options_.spill_budget_bytes));
+  }
+  if (ctx->HasAttr(kSpillDirectory)) {
+    OP_REQUIRES_OK(
+        ctx, ctx->GetAttr(kSpillDirectory, &buffer_options_.spill_directory));
+  }
+}
 
 // Abstract base dataset that implements a shuffling iterator.
 class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
@@ -90,12 +112,14 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
   ShuffleDatasetBase(OpKernelContext* ctx, const DatasetBase* input,
                      int64_t buffer_size,
                      std::shared_ptr<SeedGenerator> seed_generator,
-                     int64_t count)
+                     int64_t count,
+                     const CompactShuffleBuffer::Options& buffer_options = {})
       : DatasetBase(DatasetContext(ctx)),
         input_(input),
         buffer_size_(buffer_size),
         seed_generator_(std::move(seed_generator)),
         count_(count),
+        compact_buffer_options_(buffer_options),
         traceme_metadata_(
             {{"buffer_size",
               strings::Printf("%lld", static_cast<long long>(buffer_size))}}) {
@@ -165,6 +189,24 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
         seed_generator_.get());
   }
 
+  // Adds the attrs setting the byte budget of the shuffle buffer to `attrs`.
+  void AddBufferOptionsAttrs(
+      DatasetGraphDefBuilder* b,
+      std::vector<std::pair<StringPiece, AttrValue>>* attrs) const {
+    AttrValue memory_budget_bytes;
+    b->BuildAttrValue(compact_buffer_options_.memory_budget_bytes,
+                      &memory_budget_bytes);
+    attrs->emplace_back(kMemoryBudgetBytes, memory_budget_bytes);
+    AttrValue spill_budget_bytes;
+    b->BuildAttrValue(compact_buffer_options_.spill_budget_bytes,
+                      &spill_budget_bytes);
+    attrs->emplace_back(kSpillBudgetBytes, spill_budget_bytes);
+    AttrValue spill_directory;
+    b->BuildAttrValue(compact_buffer_options_.spill_directory,
+                      &spill_directory);
+    attrs->emplace_back(kSpillDirectory, spill_directory);
+  }
+
   void InitializeRandomAccessIndices() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
     const int64 cardinality = Cardinality();
     shuffled_indices_ = std::vector<std::int64_t>(cardinality);
@@ -191,7 +233,16 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
           seed_generator_(seed_generator),
           parent_generator_(seed_generator->seed(), seed_generator->seed2()),
           generator_(&parent_generator_) {
-      if (params.dataset->buffer_size_ == kUnknownCardinality) {
+      if (IsByteBudgeted()) {
+        // Byte-budgeted mode: `buffer_` stays empty, and `buffer_size_`
+        // only bounds the number of elements of `compact_buffer_`.
+        buffer_ = std::make_unique<std::vector<std::vector<Tensor>>>();
+        compact_buffer_ = std::make_unique<CompactShuffleBuffer>(
+            Env::Default(), params.dataset->compact_buffer_options_);
+        if (params.dataset->buffer_size_ != kUnknownCardinality) {
+          compact_buffer_->Resize(params.dataset->buffer_size_);
+        }
+      } else if (params.dataset->buffer_size_ == kUnknownCardinality) {
         buffer_ = std::make_unique<std::vector<std::vector<Tensor>>>();
       } else {
         buffer_ = std::make_unique<std::vector<std::vector<Tensor>>>(
@@ -207,7 +258,7 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       ResetRngs();
       // Initialize checkpoint_indices_ to the entire buffer.
       if (ctx->symbolic_checkpoint()) {
-        for (int64_t i = 0; i < buffer_->size(); ++i) {
+        for (int64_t i = 0; i < BufferCapacity(); ++i) {
           checkpoint_indices_.insert(i);
         }
       }
@@ -232,15 +283,24 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       // slice, and then remove the element from the slice.
       int64_t offset =
           Random() % (slices_.front()->end - slices_.front()->start);
-      int64_t index = (slices_.front()->start + offset) % buffer_->size();
-      *out_tensors = std::move(buffer_->at(index));
+      const int64_t capacity = BufferCapacity();
+      int64_t index = (slices_.front()->start + offset) % capacity;
+      const int64_t start = slices_.front()->start % capacity;
+      if (compact_buffer_) {
+        TF_RETURN_IF_ERROR(compact_buffer_->Take(index, out_tensors));
+        compact_buffer_->Swap(index, start);
+      } else {
+        *out_tensors = std::move(buffer_->at(index));
+        std::swap(buffer_->at(index), buffer_->at(start));
+      }
       this->RecordBufferDequeue(ctx, *out_tensors);
-      std::swap(buffer_->at(index),
-                buffer_->at(slices_.front()->start % buffer_->size()));
       checkpoint_indices_.insert(index);
-      checkpoint_indices_.insert(slices_.front()->start % buffer_->size());
+      checkpoint_indices_.insert(start);
       slices_.front()->start++;
       num_elements_--;
+      if (compact_buffer_ && compact_buffer_->spilled_bytes() > 0) {
+        TF_RETURN_IF_ERROR(PrefetchNextSample());
+      }
       return absl::OkStatus();
     }
 
@@ -284,7 +344,9 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       TF_RETURN_IF_ERROR(
           writer->WriteScalar(prefix(), kNumElements, num_elements_));
       const std::string key_prefix = absl::StrCat(prefix(), kColon, "buffer");
-      if (ctx->symbolic_checkpoint()) {
+      if (compact_buffer_) {
+        TF_RETURN_IF_ERROR(SaveCompactBuffer(ctx, writer));
+      } else if (ctx->symbolic_checkpoint()) {
         // When symbolic checkpointing is turned on, `writer`
         // already contains checkpoint of the shuffle buffer created by the
         // previous invocation of this instance and the indices that need to be
@@ -357,22 +419,41 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
             reader->ReadScalar(this->prefix(), kSlicesSize, &temp));
         slices_size = static_cast<size_t>(temp);
       }
+      // The buffer is restored from whichever form the checkpoint holds, so
+      // that the byte budget of the buffer can change across a restore.
       buffer_ = std::make_unique<std::vector<std::vector<Tensor>>>();
-      TF_RETURN_IF_ERROR(ReadElementsFromCheckpoint(
-          ctx, reader, absl::StrCat(prefix(), kColon, "buffer"),
-          buffer_.get()));
+      if (reader->Contains(absl::StrCat(prefix(), kColon, kCompactBuffer),
+                           kNumElements)) {
+        TF_RETURN_IF_ERROR(RestoreCompactBuffer(ctx, reader));
+      } else {
+        TF_RETURN_IF_ERROR(ReadElementsFromCheckpoint(
+            ctx, reader, absl::StrCat(prefix(), kColon, "buffer"),
+            buffer_.get()));
+        for (const auto& element : *buffer_) {
+          RecordBufferEnqueue(ctx, element);
+        }
+        if (!IsShuffleAll()) {
+          buffer_->resize(
+              std::max<int64_t>(buffer_->size(), dataset()->buffer_size_));
+        }
+        if (IsByteBudgeted()) {
+          compact_buffer_ = std::make_unique<CompactShuffleBuffer>(
+              Env::Default(), dataset()->compact_buffer_options_);
+          compact_buffer_->Resize(buffer_->size());
+          for (int64_t i = 0; i < buffer_->size(); ++i) {
+            if (!buffer_->at(i).empty()) {
+              TF_RETURN_IF_ERROR(compact_buffer_->Put(i, buffer_->at(i)));
+            }
+          }
+          buffer_->clear();
+        }
+      }
       if (ctx->symbolic_checkpoint()) {
         DCHECK(checkpoint_indices_.empty());
-        for (size_t i = 0; i < buffer_->size(); ++i) {
+        for (int64_t i = 0; i < BufferCapacity(); ++i) {
           checkpoint_indices_.insert(i);
         }
       }
-      for (const auto& element : *buffer_) {
-        RecordBufferEnqueue(ctx, element);
-      }
-      if (!IsShuffleAll()) {
-        buffer_->resize(dataset()->buffer_size_);
-      }
       slices_.clear();
       for (size_t i = 0; i < slices_size; ++i) {
         int64_t start;
@@ -439,6 +520,10 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       return dataset()->buffer_size_ == kUnknownCardinality;
     }
 
+    bool IsByteBudgeted() const {
+      return dataset()->compact_buffer_options_.memory_budget_bytes > 0;
+    }
+
     // Fills the shuffle buffer, preparing the buffer for sampling.
     Status FillBuffer(IteratorContext* ctx) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       int64_t start_micros = EnvTime::NowMicros();
@@ -463,7 +548,7 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
           slices_.back()->reached_end_of_sequence = true;
         }
         if (!end_of_input_sequence) {
-          AddToShuffleBuffer(ctx, std::move(input_element));
+          TF_RETURN_IF_ERROR(AddToShuffleBuffer(ctx, std::move(input_element)));
           continue;
         }
         input_impl_.reset();
@@ -500,7 +585,10 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
         // we need to add to the buffer.
         return true;
       }
-      return num_elements_ < buffer_->size();
+      if (compact_buffer_ && compact_buffer_->IsFull()) {
+        return false;
+      }
+      return num_elements_ < BufferCapacity();
     }
 
     Status PrepareNextEpoch(IteratorContext* ctx)
@@ -520,7 +608,8 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       return absl::OkStatus();
     }
 
-    void AddToShuffleBuffer(IteratorContext* ctx, std::vector<Tensor>&& element)
+    Status AddToShuffleBuffer(IteratorContext* ctx,
+                              std::vector<Tensor>&& element)
         TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       data_produced_ = true;
       if (num_elements_ == 0) {
@@ -528,7 +617,19 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
                 << BufferSizeString();
       }
       this->RecordBufferEnqueue(ctx, element);
-      if (num_elements_ == buffer_->size()) {
+      if (compact_buffer_) {
+        const int64_t capacity = BufferCapacity();
+        int64_t index;
+        if (num_elements_ == capacity) {
+          DCHECK(IsShuffleAll());
+          index = capacity;
+          compact_buffer_->Resize(capacity + 1);
+        } else {
+          index = slices_.back()->end % capacity;
+        }
+        checkpoint_indices_.insert(index);
+        TF_RETURN_IF_ERROR(compact_buffer_->Put(index, element));
+      } else if (num_elements_ == buffer_->size()) {
         DCHECK(IsShuffleAll());
         checkpoint_indices_.insert(buffer_->size());
         buffer_->push_back(element);
@@ -539,6 +640,108 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       }
       num_elements_++;
       slices_.back()->end++;
+      return absl::OkStatus();
+    }
+
+    // Returns the number of slots of the ring buffer holding the elements.
+    int64_t BufferCapacity() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return compact_buffer_ ? compact_buffer_->size() : buffer_->size();
+    }
+
+    // Saves the elements of `compact_buffer_` in their serialized form, so
+    // that saving does not need to materialize them.
+    Status SaveCompactBuffer(SerializationContext* ctx,
+                             IteratorStateWriter* writer)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const std::string key_prefix =
+          absl::StrCat(prefix(), kColon, kCompactBuffer);
+      TF_RETURN_IF_ERROR(
+          writer->WriteScalar(key_prefix, kNumElements, BufferCapacity()));
+      auto write_slot = [&](int64_t i) -> Status {
+        std::string record;
+        TF_RETURN_IF_ERROR(compact_buffer_->GetEncoded(i, &record));
+        return writer->WriteScalar(key_prefix, absl::StrCat("[", i, "]"),
+                                   tstring(std::move(record)));
+      };
+      if (ctx->symbolic_checkpoint()) {
+        for (int64_t i : checkpoint_indices_) {
+          if (i < BufferCapacity()) {
+            TF_RETURN_IF_ERROR(write_slot(i));
+          }
+        }
+        checkpoint_indices_.clear();
+        return absl::OkStatus();
+      }
+      for (int64_t i = 0; i < BufferCapacity(); ++i) {
+        TF_RETURN_IF_ERROR(write_slot(i));
+      }
+      return absl::OkStatus();
+    }
+
+    Status RestoreCompactBuffer(IteratorContext* ctx,
+                                IteratorStateReader* reader)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const std::string key_prefix =
+          absl::StrCat(prefix(), kColon, kCompactBuffer);
+      int64_t capacity;
+      TF_RETURN_IF_ERROR(reader->ReadScalar(key_prefix, kNumElements,
+                                            &capacity));
+      if (!IsShuffleAll()) {
+        capacity = std::max(capacity, dataset()->buffer_size_);
+      }
+      compact_buffer_.reset();
+      if (IsByteBudgeted()) {
+        compact_buffer_ = std::make_unique<CompactShuffleBuffer>(
+            Env::Default(), dataset()->compact_buffer_options_);
+        compact_buffer_->Resize(capacity);
+      } else {
+        buffer_->resize(capacity);
+      }
+      for (int64_t i = 0; i < capacity; ++i) {
+        const std::string key = absl::StrCat("[", i, "]");
+        if (!reader->Contains(key_prefix, key)) {
+          continue;
+        }
+        tstring record;
+        TF_RETURN_IF_ERROR(reader->ReadScalar(key_prefix, key, &record));
+        if (record.empty()) {
+          continue;
+        }
+        std::vector<Tensor> element;
+        TF_RETURN_IF_ERROR(DecodeElement(record, &element));
+        RecordBufferEnqueue(ctx, element);
+        if (compact_buffer_) {
+          TF_RETURN_IF_ERROR(compact_buffer_->PutEncoded(i, record));
+        } else {
+          buffer_->at(i) = std::move(element);
+        }
+      }
+      return absl::OkStatus();
+    }
+
+    // Guesses the slot the next `GetNextInternal()` samples and prefetches it
+    // if it is spilled. The guess reuses the next number of the generator,
+    // and assumes that the serving slice does not run out and is refilled up
+    // to the capacity of the buffer if it is also the one being filled. A
+    // wrong guess only costs a read.
+    Status PrefetchNextSample() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const Slice& slice = *slices_.front();
+      if (slice.start == slice.end) {
+        // The next sample starts a new epoch, with new seeds.
+        return absl::OkStatus();
+      }
+      int64_t end = slice.end;
+      if (slices_.size() == 1 && !slice.reached_end_of_sequence &&
+          !IsShuffleAll()) {
+        end += BufferCapacity() - num_elements_;
+      }
+      random::PhiloxRandom parent_generator(seed_, seed2_);
+      random::SingleSampleAdapter<random::PhiloxRandom> generator(
+          &parent_generator);
+      generator.Skip(num_random_samples_);
+      const int64_t offset = generator() % (end - slice.start);
+      return compact_buffer_->Prefetch((slice.start + offset) %
+                                       BufferCapacity());
     }
 
     void ClearEmptySlices() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
@@ -553,6 +756,11 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
     }
 
     std::string BufferSizeString() {
+      if (compact_buffer_) {
+        return absl::StrCat(
+            dataset()->buffer_size_, " (at most ",
+            dataset()->compact_buffer_options_.memory_budget_bytes, " bytes)");
+      }
       return absl::StrCat(dataset()->buffer_size_);
     }
 
@@ -560,6 +768,9 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
     SeedGenerator* const seed_generator_ TF_GUARDED_BY(mu_);  // Not owned.
     std::unique_ptr<std::vector<std::vector<Tensor>>> buffer_
         TF_GUARDED_BY(mu_);
+    // Holds the elements instead of `buffer_` when the shuffle buffer is
+    // byte-budgeted.
+    std::unique_ptr<CompactShuffleBuffer> compact_buffer_ TF_GUARDED_BY(mu_);
     // Holds the indices of `buffer_` that have changed since the previous
     // `SaveInternal()` and need to be updated in the MemoryCheckpoint
     // (if symbolic checkpointing is used) in the next `SaveInternal()`.
@@ -588,6 +799,7 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
   // fuse shuffle and repeat together, and make the shuffle dataset op
   // responsible for repeating as well.
   const int64_t count_;
+  const CompactShuffleBuffer::Options compact_buffer_options_;
   const TraceMeMetadata traceme_metadata_;
   mutable mutex mu_;
   mutable std::vector<std::int64_t> shuffled_indices_ TF_GUARDED_BY(mu_);
@@ -601,8 +813,10 @@ class ShuffleDatasetOp::Dataset : public ShuffleDatasetBase {
  public:
   Dataset(OpKernelContext* ctx, const DatasetBase* input, int64_t buffer_size,
           int64_t count, RandomSeeds&& seeds, SeedGeneratorManager* manager,
-          ResourceHandle&& resource_handle)
-      : ShuffleDatasetBase(ctx, input, buffer_size, manager->get(), count),
+          ResourceHandle&& resource_handle,
+          const CompactShuffleBuffer::Options& buffer_options)
+      : ShuffleDatasetBase(ctx, input, buffer_size, manager->get(), count,
+                           buffer_options),
         manager_(manager),
         resource_handle_(std::move(resource_handle)),
         resource_mgr_(ctx->resource_manager()),
@@ -635,12 +849,13 @@ class ShuffleDatasetOp::Dataset : public ShuffleDatasetBase {
     TF_RETURN_IF_ERROR(b->AddScalar(seeds_.input_seed2(), &seed2_node));
     b->BuildAttrValue(seed_generator_->reshuffle_each_iteration(),
                       &reshuffle_each_iteration);
+    std::vector<std::pair<StringPiece, AttrValue>> attrs = {
+        std::make_pair(kReshuffleEachIteration, reshuffle_each_iteration)};
+    AddBufferOptionsAttrs(b, &attrs);
     TF_RETURN_IF_ERROR(b->AddDataset(
         this,
         {input_graph_node, buffer_size_node, seed_node, seed2_node},  // Inputs
-        {std::make_pair(kReshuffleEachIteration,
-                        reshuffle_each_iteration)},  // Attrs
-        output));
+        attrs, output));
     return absl::OkStatus();
   }
 
@@ -713,8 +928,10 @@ class ShuffleDatasetOp::DatasetV3 : public ShuffleDatasetBase {
  public:
   DatasetV3(OpKernelContext* ctx, const DatasetBase* input, int64_t buffer_size,
             int64_t count, RandomSeeds&& seeds, SeedGeneratorManager* manager,
-            ResourceHandle&& resource_handle, bool owns_resource)
-      : ShuffleDatasetBase(ctx, input, buffer_size, manager->get(), count),
+            ResourceHandle&& resource_handle, bool owns_resource,
+            const CompactShuffleBuffer::Options& buffer_options)
+      : ShuffleDatasetBase(ctx, input, buffer_size, manager->get(), count,
+                           buffer_options),
         manager_(manager),
         owns_resource_(owns_resource),
         resource_handle_(std::move(resource_handle)),
@@ -753,13 +970,14 @@ class ShuffleDatasetOp::DatasetV3 : public ShuffleDatasetBase {
     AttrValue reshuffle_each_iteration;
     b->BuildAttrValue(seed_generator_->reshuffle_each_iteration(),
                       &reshuffle_each_iteration);
+    std::vector<std::pair<StringPiece, AttrValue>> attrs = {
+        std::make_pair(kReshuffleEachIteration, reshuffle_each_iteration)};
+    AddBufferOptionsAttrs(b, &attrs);
     TF_RETURN_IF_ERROR(
         b->AddDataset(this,
                       {input_graph_node, buffer_size_node, seed_node,
                        seed2_node, resource_handle_node},  // Inputs
-                      {std::make_pair(kReshuffleEachIteration,
-                                      reshuffle_each_iteration)},  // Attrs
-                      output));
+                      attrs, output));
     return absl::OkStatus();
   }
 
@@ -836,9 +1054,9 @@ void ShuffleDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
     }
 
     // Ownership of manager is transferred onto `DatasetV3`.
-    *output = new ShuffleDatasetOp::DatasetV3(ctx, input, buffer_size, count,
-                                              std::move(seeds), manager,
-                                              std::move(handle), owns_resource);
+    *output = new ShuffleDatasetOp::DatasetV3(
+        ctx, input, buffer_size, count, std::move(seeds), manager,
+        std::move(handle), owns_resource, buffer_options_);
   } else if (op_version_ == 2) {
     auto handle = HandleFromInput(ctx, 2);
     SeedGeneratorManager* manager = nullptr;
@@ -900,7 +1118,7 @@ void ShuffleDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
     // Ownership of manager is transferred onto `Dataset`.
     *output = new ShuffleDatasetOp::Dataset(ctx, input, buffer_size, count,
                                             std::move(seeds), manager,
-                                            std::move(handle));
+                                            std::move(handle), buffer_options_);
   }
 }
 
@@ -16,6 +16,7 @@ limitations under the License.
 #define TENSORFLOW_CORE_KERNELS_DATA_SHUFFLE_DATASET_OP_H_
 
 #include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/kernels/data/compact_shuffle_buffer.h"
 
 namespace tensorflow {
 namespace data {
@@ -30,11 +31,19 @@ class ShuffleDatasetOpBase : public UnaryDatasetOpKernel {
   static constexpr const char* const kOutputShapes = "output_shapes";
   static constexpr const char* const kReshuffleEachIteration =
       "reshuffle_each_iteration";
+  static constexpr const char* const kMemoryBudgetBytes =
+      "memory_budget_bytes";
+  static constexpr const char* const kSpillBudgetBytes = "spill_budget_bytes";
+  static constexpr const char* const kSpillDirectory = "spill_directory";
 
   explicit ShuffleDatasetOpBase(OpKernelConstruction* ctx);
 
  protected:
   class ShuffleDatasetBase;
+
+  // Byte budget of the shuffle buffer, set by the attrs of the ops that have
+  // them.
+  CompactShuffleBuffer::Options buffer_options_;
 };
 
 class ShuffleDatasetOp : public ShuffleDatasetOpBase {
@@ -78,6 +78,14 @@ class ShuffleDatasetParams : public DatasetParams {
     attr_vector->emplace_back("reshuffle_each_iteration",
                               reshuffle_each_iteration_);
     attr_vector->emplace_back("metadata", "");
+    if (count_ == 1) {
+      attr_vector->emplace_back(ShuffleDatasetOpBase::kMemoryBudgetBytes,
+                                buffer_options_.memory_budget_bytes);
+      attr_vector->emplace_back(ShuffleDatasetOpBase::kSpillBudgetBytes,
+                                buffer_options_.spill_budget_bytes);
+      attr_vector->emplace_back(ShuffleDatasetOpBase::kSpillDirectory,
+                                buffer_options_.spill_directory);
+    }
     return absl::OkStatus();
   }
 
@@ -90,12 +98,20 @@ class ShuffleDatasetParams : public DatasetParams {
 
   int64_t count() const { return count_; }
 
+  // Sets the byte budget of the shuffle buffer.
+  ShuffleDatasetParams& set_buffer_options(
+      const CompactShuffleBuffer::Options& buffer_options) {
+    buffer_options_ = buffer_options;
+    return *this;
+  }
+
  private:
   int64_t buffer_size_;
   int64_t seed_;
   int64_t seed2_;
   int64_t count_;
   bool reshuffle_each_iteration_;
+  CompactShuffleBuffer::Options buffer_options_;
 };
 
 class ShuffleDatasetOpTest : public DatasetOpsTestBase {};
@@ -221,6 +237,17 @@ ShuffleDatasetParams ShuffleDatasetParamsWithUnknownCardinality() {
                               /*node_name=*/kShuffleNodeName);
 }
 
+// Test case 1 with a byte-budgeted buffer that spills all but one element.
+// Sampling does not depend on where the elements are stored, so the outputs
+// are the same as for test case 1.
+ShuffleDatasetParams ByteBudgetedShuffleDatasetParams() {
+  CompactShuffleBuffer::Options buffer_options;
+  buffer_options.memory_budget_bytes = 1;
+  buffer_options.spill_budget_bytes = 1 << 20;
+  buffer_options.spill_directory = testing::TmpDir();
+  return ShuffleDatasetParams1().set_buffer_options(buffer_options);
+}
+
 ShuffleDatasetParams ShuffleDatasetParamsWithInvalidBufferSize() {
   return ShuffleDatasetParams(RangeDatasetParams(0, 0, 1),
                               /*buffer_size=*/-1,
@@ -337,7 +364,15 @@ std::vector<GetNextTestCase<ShuffleDatasetParams>> GetNextTestCases() {
        /*expected_reshuffle_outputs=*/
        CreateTensors<int64_t>(
            TensorShape({}),
-           {{1}, {6}, {0}, {5}, {2}, {7}, {4}, {3}, {9}, {8}})}};
+           {{1}, {6}, {0}, {5}, {2}, {7}, {4}, {3}, {9}, {8}})},
+      {/*dataset_params=*/ByteBudgetedShuffleDatasetParams(),
+       /*expected_shuffle_outputs=*/
+       CreateTensors<int64_t>(
+           TensorShape({}), {{2}, {3}, {0}, {5}, {6}, {4}, {7}, {8}, {9}, {1}}),
+       /*expected_reshuffle_outputs=*/
+       CreateTensors<int64_t>(
+           TensorShape({}),
+           {{2}, {3}, {0}, {5}, {6}, {4}, {7}, {8}, {9}, {1}})}};
 }
 
 class ParameterizedGetNextTest : public ShuffleDatasetOpTest,
@@ -537,7 +572,13 @@ IteratorSaveAndRestoreTestCases() {
            /*expected_shuffle_outputs=*/
            CreateTensors<int64_t>(
                TensorShape({}),
-               {{2}, {6}, {1}, {3}, {9}, {5}, {0}, {8}, {7}, {4}})}};
+               {{2}, {6}, {1}, {3}, {9}, {5}, {0}, {8}, {7}, {4}})},
+          {/*dataset_params=*/ByteBudgetedShuffleDatasetParams(),
+           /*breakpoints=*/{0, 4, 11},
+           /*expected_shuffle_outputs=*/
+           CreateTensors<int64_t>(
+               TensorShape({}),
+               {{2}, {3}, {0}, {5}, {6}, {4}, {7}, {8}, {9}, {1}})}};
 }
 
 class ParameterizedIteratorSaveAndRestoreTest
@@ -583,6 +624,50 @@ INSTANTIATE_TEST_CASE_P(ShuffleDatasetOpTest,
                         ParameterizedIteratorSaveAndRestoreTest,
                         ::testing::ValuesIn(IteratorSaveAndRestoreTestCases()));
 
+TEST_F(ShuffleDatasetOpTest, RestoresAcrossByteBudgets) {
+  // A checkpoint holds the buffer in the form of the iterator that saved it,
+  // and can be restored with or without a byte budget.
+  const std::vector<Tensor> expected_outputs = CreateTensors<int64_t>(
+      TensorShape({}), {{2}, {3}, {0}, {5}, {6}, {4}, {7}, {8}, {9}, {1}});
+  for (bool save_byte_budgeted : {false, true}) {
+    ShuffleDatasetParams save_params = save_byte_budgeted
+                                           ? ByteBudgetedShuffleDatasetParams()
+                                           : ShuffleDatasetParams1();
+    ShuffleDatasetParams restore_params =
+        save_byte_budgeted ? ShuffleDatasetParams1()
+                           : ByteBudgetedShuffleDatasetParams();
+    TF_ASSERT_OK(Initialize(save_params));
+    bool end_of_sequence = false;
+    std::vector<Tensor> out_tensors;
+    for (int i = 0; i < 4; ++i) {
+      std::vector<Tensor> next;
+      TF_ASSERT_OK(
+          iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+      out_tensors.insert(out_tensors.end(), next.begin(), next.end());
+    }
+    std::unique_ptr<SerializationContext> serialization_ctx;
+    TF_ASSERT_OK(CreateSerializationContext(&serialization_ctx));
+    VariantTensorDataWriter writer;
+    TF_ASSERT_OK(iterator_->Save(serialization_ctx.get(), &writer));
+    std::vector<const VariantTensorData*> data;
+    writer.GetData(&data);
+
+    TF_ASSERT_OK(Initialize(restore_params));
+    VariantTensorDataReader reader(data);
+    TF_ASSERT_OK(RestoreIterator(iterator_ctx_.get(), &reader,
+                                 restore_params.iterator_prefix(), *dataset_,
+                                 &iterator_));
+    while (!end_of_sequence) {
+      std::vector<Tensor> next;
+      TF_ASSERT_OK(
+          iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+      out_tensors.insert(out_tensors.end(), next.begin(), next.end());
+    }
+    TF_EXPECT_OK(ExpectEqual(out_tensors, expected_outputs,
+                             /*compare_order=*/true));
+  }
+}
+
 TEST_F(ShuffleDatasetOpTest, InvalidArguments) {
   std::vector<ShuffleDatasetParams> dataset_params_vec(
       {ShuffleDatasetParamsWithInvalidBufferSize(),
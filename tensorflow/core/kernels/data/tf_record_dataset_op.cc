@@ -15,8 +15,17 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/tf_record_dataset_op.h"
 
 #include <cstdint>
-
+#include <deque>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/cord.h"
 #include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/data/tfrecord_index.h"
 #include "tensorflow/core/data/utils.h"
 #include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
@@ -28,6 +37,7 @@ limitations under the License.
 #include "tensorflow/core/lib/io/zlib_compression_options.h"
 #include "tensorflow/core/lib/io/zlib_inputstream.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tsl/lib/io/read_ahead_record_reader.h"
 
 namespace tensorflow {
 namespace data {
@@ -40,16 +50,20 @@ namespace data {
 /* static */ constexpr const char* const TFRecordDatasetOp::kCompressionType;
 /* static */ constexpr const char* const TFRecordDatasetOp::kBufferSize;
 /* static */ constexpr const char* const TFRecordDatasetOp::kByteOffsets;
+/* static */ constexpr const char* const TFRecordDatasetOp::kUseReadAhead;
 
 constexpr char kTFRecordDataset[] = "TFRecordDataset";
 constexpr char kCurrentFileIndex[] = "current_file_index";
 constexpr char kOffset[] = "offset";
+constexpr char kShuffledElementCount[] = "shuffled_element_count";
 constexpr char kGcsFsPrefix[] = "gs://";
 constexpr char kS3FsPrefix[] = "s3://";
 constexpr int64_t kUnspecifiedBufferSize = -1;
 constexpr int64_t kDefaultBufferSize = 256LL << 10;  // 256KB
 constexpr int64_t kCloudTpuBlockSize = 127LL << 20;  // 127MB.
 constexpr int64_t kS3BlockSize = kCloudTpuBlockSize;
+// Number of records read at once when the dataset is globally shuffled.
+constexpr int64_t kShuffledReadBatchSize = 64;
 
 bool is_cloud_tpu_gcs_fs() {
 #if (defined(PLATFORM_CLOUD_TPU) && defined(TPU_GCS_FS)) || \
@@ -63,13 +77,15 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
  public:
   explicit Dataset(OpKernelContext* ctx, std::vector<string> filenames,
                    const string& compression_type, int64_t buffer_size,
-                   std::vector<int64_t> byte_offsets, int op_version)
+                   std::vector<int64_t> byte_offsets, bool use_read_ahead,
+                   int op_version)
       : DatasetBase(DatasetContext(ctx)),
         filenames_(std::move(filenames)),
         compression_type_(compression_type),
         options_(io::RecordReaderOptions::CreateRecordReaderOptions(
             compression_type)),
         byte_offsets_(std::move(byte_offsets)),
+        use_read_ahead_(use_read_ahead),
         op_version_(op_version) {
     if (buffer_size > 0) {
       options_.buffer_size = buffer_size;
@@ -107,6 +123,72 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
 
   Status CheckExternalState() const override { return absl::OkStatus(); }
 
+  // Random access requires uncompressed files with indexes written by
+  // //tensorflow/core/data:tfrecord_indexer. Only the index of the first file
+  // is looked up here; the others are when the cardinality is computed, which
+  // is then known rather than `kUnknownCardinality`.
+  absl::Status RandomIndexingCompatible() const override {
+    if (!compression_type_.empty()) {
+      return absl::FailedPreconditionError(
+          "Random access to TFRecord files requires them to be uncompressed.");
+    }
+    for (int64_t byte_offset : byte_offsets_) {
+      if (byte_offset != 0) {
+        return absl::FailedPreconditionError(
+            "Random access to TFRecord files does not support `byte_offsets`.");
+      }
+    }
+    mutex_lock l(index_mu_);
+    if (!index_exists_.has_value()) {
+      index_exists_ = absl::OkStatus();
+      if (!filenames_.empty()) {
+        const std::string index_filename =
+            TFRecordIndexFilename(TranslateFileName(filenames_[0]));
+        if (!Env::Default()->FileExists(index_filename).ok()) {
+          index_exists_ = absl::FailedPreconditionError(absl::StrCat(
+              "Random access to TFRecord files requires indexes, and ",
+              index_filename, " does not exist. Write the indexes of the "
+              "files with `bazel run //tensorflow/core/data:tfrecord_indexer "
+              "-- --files=<file patterns>`."));
+        }
+      }
+    }
+    return *index_exists_;
+  }
+
+  int64_t CardinalityInternal(CardinalityOptions options) const override {
+    if (options.compute_level() !=
+            CardinalityOptions::CARDINALITY_COMPUTE_MODERATE ||
+        !RandomIndexingCompatible().ok()) {
+      return kUnknownCardinality;
+    }
+    absl::StatusOr<IndexedTFRecordReader*> reader = GetIndexedReader();
+    if (!reader.ok()) {
+      LOG(WARNING) << "Failed to read the indexes of the TFRecord files: "
+                   << reader.status();
+      return kUnknownCardinality;
+    }
+    return (*reader)->num_records();
+  }
+
+  Status Get(OpKernelContext* ctx, int64 index,
+             std::vector<Tensor>* out_tensors) const override {
+    return Get(AnyContext(ctx), index, out_tensors);
+  }
+
+  Status Get(AnyContext ctx, int64 index,
+             std::vector<Tensor>* out_tensors) const override {
+    TF_RETURN_IF_ERROR(CheckRandomAccessCompatible(index));
+    TF_ASSIGN_OR_RETURN(IndexedTFRecordReader * reader, GetIndexedReader());
+    std::vector<tstring> records;
+    TF_RETURN_IF_ERROR(reader->Read({index}, &records));
+    out_tensors->clear();
+    out_tensors->emplace_back(ctx.allocator, DT_STRING, TensorShape({}));
+    RecordBytesRead(records[0]);
+    out_tensors->back().scalar<tstring>()() = std::move(records[0]);
+    return absl::OkStatus();
+  }
+
  protected:
   Status AsGraphDefInternal(SerializationContext* ctx,
                             DatasetGraphDefBuilder* b,
@@ -117,8 +199,14 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     TF_RETURN_IF_ERROR(b->AddScalar(compression_type_, &compression_type));
     Node* buffer_size = nullptr;
     TF_RETURN_IF_ERROR(b->AddScalar(options_.buffer_size, &buffer_size));
+    std::vector<std::pair<StringPiece, AttrValue>> attrs;
+    if (op_version_ > 1) {
+      AttrValue use_read_ahead;
+      b->BuildAttrValue(use_read_ahead_, &use_read_ahead);
+      attrs.emplace_back(kUseReadAhead, use_read_ahead);
+    }
     TF_RETURN_IF_ERROR(b->AddDataset(
-        this, {filenames, compression_type, buffer_size}, output));
+        this, {filenames, compression_type, buffer_size}, attrs, output));
     Node* byte_offsets = nullptr;
     TF_RETURN_IF_ERROR(b->AddVector(byte_offsets_, &byte_offsets));
     return absl::OkStatus();
@@ -137,18 +225,18 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
                            bool* end_of_sequence) override {
       out_tensors->reserve(1);
       mutex_lock l(mu_);
+      if (ctx->index_mapper() != nullptr) {
+        return GetNextShuffledLocked(ctx, out_tensors, end_of_sequence);
+      }
       do {
         // We are currently processing a file, so try to read the next record.
-        if (reader_) {
+        if (HasReaderLocked()) {
           out_tensors->emplace_back(ctx->allocator({}), DT_STRING,
                                     TensorShape({}));
           Status s =
-              reader_->ReadRecord(&out_tensors->back().scalar<tstring>()());
+              ReadRecordLocked(&out_tensors->back().scalar<tstring>()());
           if (s.ok()) {
-            static monitoring::CounterCell* bytes_counter =
-                metrics::GetTFDataBytesReadCounter(kDatasetType);
-            bytes_counter->IncrementBy(
-                out_tensors->back().scalar<tstring>()().size());
+            RecordBytesRead(out_tensors->back().scalar<tstring>()());
             *end_of_sequence = false;
             return absl::OkStatus();
           }
@@ -185,10 +273,10 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
       do {
         // We are currently processing a file, so try to skip reading
         // the next (num_to_skip - *num_skipped) record.
-        if (reader_) {
+        if (HasReaderLocked()) {
           int last_num_skipped;
-          Status s = reader_->SkipRecords(num_to_skip - *num_skipped,
-                                          &last_num_skipped);
+          Status s = SkipRecordsLocked(num_to_skip - *num_skipped,
+                                       &last_num_skipped);
           *num_skipped += last_num_skipped;
           if (s.ok()) {
             *end_of_sequence = false;
@@ -228,12 +316,15 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     Status SaveInternal(SerializationContext* ctx,
                         IteratorStateWriter* writer) override {
       mutex_lock l(mu_);
+      TF_RETURN_IF_ERROR(
+          writer->WriteScalar(prefix(), kShuffledElementCount,
+                              shuffled_element_count_));
       TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kCurrentFileIndex,
                                              current_file_index_));
 
-      if (reader_) {
+      if (HasReaderLocked()) {
         TF_RETURN_IF_ERROR(
-            writer->WriteScalar(prefix(), kOffset, reader_->TellOffset()));
+            writer->WriteScalar(prefix(), kOffset, TellOffsetLocked()));
       }
       return absl::OkStatus();
     }
@@ -241,6 +332,11 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     Status RestoreInternal(IteratorContext* ctx,
                            IteratorStateReader* reader) override {
       mutex_lock l(mu_);
+      if (ctx->restored_element_count().has_value()) {
+        shuffled_records_.clear();
+        return reader->ReadScalar(prefix(), kShuffledElementCount,
+                                  &shuffled_element_count_);
+      }
       ResetStreamsLocked();
       int64_t current_file_index;
       TF_RETURN_IF_ERROR(
@@ -249,15 +345,73 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
       if (reader->Contains(prefix(), kOffset)) {
         int64_t offset;
         TF_RETURN_IF_ERROR(reader->ReadScalar(prefix(), kOffset, &offset));
-        TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
-        TF_RETURN_IF_ERROR(reader_->SeekOffset(offset));
+        TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env(), offset));
       }
       return absl::OkStatus();
     }
 
    private:
-    // Sets up reader streams to read from the file at `current_file_index_`.
-    Status SetupStreamsLocked(Env* env) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    // Unlike `GlobalShuffleIterator`, reads records in batches so that the
+    // reads of records close to each other are coalesced, and the others are
+    // issued in parallel.
+    Status GetNextShuffledLocked(IteratorContext* ctx,
+                                 std::vector<Tensor>* out_tensors,
+                                 bool* end_of_sequence)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (shuffled_records_.empty()) {
+        TF_RETURN_IF_ERROR(ReadShuffledRecordsLocked(ctx));
+      }
+      if (shuffled_records_.empty()) {
+        *end_of_sequence = true;
+        return absl::OkStatus();
+      }
+      ShuffledRecord& next = shuffled_records_.front();
+      out_tensors->emplace_back(ctx->allocator({}), DT_STRING,
+                                TensorShape({}));
+      RecordBytesRead(next.record);
+      out_tensors->back().scalar<tstring>()() = std::move(next.record);
+      shuffled_element_count_ = next.element_count;
+      shuffled_records_.pop_front();
+      *end_of_sequence = false;
+      return absl::OkStatus();
+    }
+
+    // Reads the next `kShuffledReadBatchSize` records given by the index
+    // mapper. Checkpoints only count the records that were returned.
+    Status ReadShuffledRecordsLocked(IteratorContext* ctx)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      TF_ASSIGN_OR_RETURN(IndexedTFRecordReader * reader,
+                          dataset()->GetIndexedReader());
+      std::vector<int64_t> indices;
+      std::vector<int64_t> element_counts;
+      int64_t element_count = shuffled_element_count_;
+      while (indices.size() < kShuffledReadBatchSize) {
+        absl::StatusOr<size_t> index = ctx->index_mapper()(element_count++);
+        if (absl::IsNotFound(index.status())) {
+          continue;
+        }
+        if (absl::IsOutOfRange(index.status())) {
+          break;
+        }
+        TF_RETURN_IF_ERROR(index.status());
+        indices.push_back(*index);
+        element_counts.push_back(element_count);
+      }
+      std::vector<tstring> records;
+      TF_RETURN_IF_ERROR(reader->Read(indices, &records, ctx->runner()));
+      for (size_t i = 0; i < records.size(); ++i) {
+        shuffled_records_.push_back(
+            {element_counts[i], std::move(records[i])});
+      }
+      return absl::OkStatus();
+    }
+
+    // Sets up reader streams to read from the file at `current_file_index_`,
+    // starting at `offset` if it is given and at the byte offset of the file
+    // otherwise.
+    Status SetupStreamsLocked(Env* env,
+                              std::optional<int64_t> offset = std::nullopt)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       if (current_file_index_ >= dataset()->filenames_.size()) {
         return errors::InvalidArgument(
             "current_file_index_:", current_file_index_,
@@ -268,11 +422,19 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
       TF_RETURN_IF_ERROR(env->NewRandomAccessFile(
           TranslateFileName(dataset()->filenames_[current_file_index_]),
           &file_));
+      if (!offset.has_value() && !dataset()->byte_offsets_.empty()) {
+        offset = dataset()->byte_offsets_[current_file_index_];
+      }
+      if (dataset()->use_read_ahead_) {
+        // The read-ahead reader cannot seek, so it starts at the offset.
+        read_ahead_reader_ = std::make_unique<tsl::io::ReadAheadRecordReader>(
+            env, file_.get(), offset.value_or(0));
+        return absl::OkStatus();
+      }
       reader_ = std::make_unique<io::SequentialRecordReader>(
           file_.get(), dataset()->options_);
-      if (!dataset()->byte_offsets_.empty()) {
-        TF_RETURN_IF_ERROR(
-            reader_->SeekOffset(dataset()->byte_offsets_[current_file_index_]));
+      if (offset.has_value()) {
+        TF_RETURN_IF_ERROR(reader_->SeekOffset(*offset));
       }
       return absl::OkStatus();
     }
@@ -280,9 +442,43 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     // Resets all reader streams.
     void ResetStreamsLocked() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       reader_.reset();
+      read_ahead_reader_.reset();
       file_.reset();
     }
 
+    bool HasReaderLocked() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return reader_ != nullptr || read_ahead_reader_ != nullptr;
+    }
+
+    Status ReadRecordLocked(tstring* record) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (read_ahead_reader_) {
+        return read_ahead_reader_->ReadRecord(record);
+      }
+      return reader_->ReadRecord(record);
+    }
+
+    Status SkipRecordsLocked(int num_to_skip, int* num_skipped)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!read_ahead_reader_) {
+        return reader_->SkipRecords(num_to_skip, num_skipped);
+      }
+      // Skipped records reference the read buffers, so they are not copied.
+      *num_skipped = 0;
+      absl::Cord record;
+      while (*num_skipped < num_to_skip) {
+        TF_RETURN_IF_ERROR(read_ahead_reader_->ReadRecord(&record));
+        ++*num_skipped;
+      }
+      return absl::OkStatus();
+    }
+
+    uint64 TellOffsetLocked() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (read_ahead_reader_) {
+        return read_ahead_reader_->TellOffset();
+      }
+      return reader_->TellOffset();
+    }
+
     mutex mu_;
     size_t current_file_index_ TF_GUARDED_BY(mu_) = 0;
 
@@ -290,18 +486,63 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     // we must destroy `reader_` before `file_`.
     std::unique_ptr<RandomAccessFile> file_ TF_GUARDED_BY(mu_);
     std::unique_ptr<io::SequentialRecordReader> reader_ TF_GUARDED_BY(mu_);
+    // Used instead of `reader_` when the dataset uses read-ahead.
+    std::unique_ptr<tsl::io::ReadAheadRecordReader> read_ahead_reader_
+        TF_GUARDED_BY(mu_);
+
+    struct ShuffledRecord {
+      // Number of elements requested from the index mapper once this record
+      // is returned.
+      int64_t element_count;
+      tstring record;
+    };
+    // Records read ahead when the dataset is globally shuffled.
+    std::deque<ShuffledRecord> shuffled_records_ TF_GUARDED_BY(mu_);
+    int64_t shuffled_element_count_ TF_GUARDED_BY(mu_) = 0;
   };
 
+  static void RecordBytesRead(const tstring& record) {
+    static monitoring::CounterCell* bytes_counter =
+        metrics::GetTFDataBytesReadCounter(kDatasetType);
+    bytes_counter->IncrementBy(record.size());
+  }
+
+  // Returns the reader of the indexes of the files, creating it on first use.
+  absl::StatusOr<IndexedTFRecordReader*> GetIndexedReader() const {
+    mutex_lock l(index_mu_);
+    if (indexed_reader_ == nullptr) {
+      std::vector<std::string> filenames;
+      filenames.reserve(filenames_.size());
+      for (const std::string& filename : filenames_) {
+        filenames.push_back(TranslateFileName(filename));
+      }
+      TF_ASSIGN_OR_RETURN(
+          indexed_reader_,
+          IndexedTFRecordReader::Create(Env::Default(), std::move(filenames)));
+    }
+    return indexed_reader_.get();
+  }
+
   const std::vector<string> filenames_;
   const tstring compression_type_;
   io::RecordReaderOptions options_;
   const std::vector<int64_t> byte_offsets_;
+  const bool use_read_ahead_;
   const int op_version_;
+
+  mutable mutex index_mu_;
+  mutable std::optional<absl::Status> index_exists_ TF_GUARDED_BY(index_mu_);
+  mutable std::unique_ptr<IndexedTFRecordReader> indexed_reader_
+      TF_GUARDED_BY(index_mu_);
 };
 
 TFRecordDatasetOp::TFRecordDatasetOp(OpKernelConstruction* ctx)
     : DatasetOpKernel(ctx),
-      op_version_(ctx->def().op() == kTFRecordDataset ? 1 : 2) {}
+      op_version_(ctx->def().op() == kTFRecordDataset ? 1 : 2) {
+  if (ctx->HasAttr(kUseReadAhead)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kUseReadAhead, &use_read_ahead_));
+  }
+}
 
 void TFRecordDatasetOp::MakeDataset(OpKernelContext* ctx,
                                     DatasetBase** output) {
@@ -327,6 +568,11 @@ void TFRecordDatasetOp::MakeDataset(OpKernelContext* ctx,
   tstring compression_type;
   OP_REQUIRES_OK(ctx, ParseScalarArgument<tstring>(ctx, kCompressionType,
                                                    &compression_type));
+  OP_REQUIRES(ctx, !use_read_ahead_ || compression_type.empty(),
+              errors::InvalidArgument(
+                  "`use_read_ahead` requires uncompressed files, but "
+                  "`compression_type` is ",
+                  compression_type));
 
   int64_t buffer_size = kUnspecifiedBufferSize;
   OP_REQUIRES_OK(ctx,
@@ -380,7 +626,8 @@ void TFRecordDatasetOp::MakeDataset(OpKernelContext* ctx,
   }
 
   *output = new Dataset(ctx, std::move(filenames), compression_type,
-                        buffer_size, std::move(byte_offsets), op_version_);
+                        buffer_size, std::move(byte_offsets), use_read_ahead_,
+                        op_version_);
 }
 
 namespace {
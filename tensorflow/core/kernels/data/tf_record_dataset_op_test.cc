@@ -23,7 +23,9 @@ limitations under the License.
 #include "xla/tsl/lib/core/status_test_util.h"
 #include "tensorflow/core/data/dataset_test_base.h"
 #include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/data/tfrecord_index.h"
 #include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/dataset_options.pb.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/types.pb.h"
@@ -99,9 +101,14 @@ class TFRecordDatasetParams : public DatasetParams {
   Status GetAttributes(AttributeVector* attr_vector) const override {
     attr_vector->clear();
     attr_vector->emplace_back("metadata", "");
+    attr_vector->emplace_back("use_read_ahead", use_read_ahead_);
     return absl::OkStatus();
   }
 
+  void set_use_read_ahead(bool use_read_ahead) {
+    use_read_ahead_ = use_read_ahead;
+  }
+
   string dataset_type() const override {
     return TFRecordDatasetOp::kDatasetType;
   }
@@ -111,6 +118,7 @@ class TFRecordDatasetParams : public DatasetParams {
   CompressionType compression_type_;
   int64_t buffer_size_;
   std::vector<int64_t> byte_offsets_;
+  bool use_read_ahead_ = false;
 };
 
 class TFRecordDatasetOpTest : public DatasetOpsTestBase {};
@@ -227,6 +235,20 @@ TFRecordDatasetParams InvalidByteOffsets() {
                                /*node_name=*/kNodeName);
 }
 
+// Test case 6: multiple text files without compression, read ahead.
+TFRecordDatasetParams ReadAheadTFRecordDatasetParams() {
+  TFRecordDatasetParams dataset_params = TFRecordDatasetParams3();
+  dataset_params.set_use_read_ahead(true);
+  return dataset_params;
+}
+
+// Test case 7: Read byte_offsets for records, read ahead.
+TFRecordDatasetParams ReadAheadByteOffsetsTFRecordDatasetParams() {
+  TFRecordDatasetParams dataset_params = TFRecordDatasetParams4();
+  dataset_params.set_use_read_ahead(true);
+  return dataset_params;
+}
+
 std::vector<GetNextTestCase<TFRecordDatasetParams>> GetNextTestCases() {
   return {
       {/*dataset_params=*/TFRecordDatasetParams1(),
@@ -240,6 +262,13 @@ std::vector<GetNextTestCase<TFRecordDatasetParams>> GetNextTestCases() {
        CreateTensors<tstring>(
            TensorShape({}), {{"1"}, {"22"}, {"333"}, {"a"}, {"bb"}, {"ccc"}})},
       {/*dataset_params=*/TFRecordDatasetParams4(),
+       CreateTensors<tstring>(
+           TensorShape({}),
+           {{"1"}, {"22"}, {"333"}, {"bb"}, {"ccc"}, {"zzz"}})},
+      {/*dataset_params=*/ReadAheadTFRecordDatasetParams(),
+       CreateTensors<tstring>(
+           TensorShape({}), {{"1"}, {"22"}, {"333"}, {"a"}, {"bb"}, {"ccc"}})},
+      {/*dataset_params=*/ReadAheadByteOffsetsTFRecordDatasetParams(),
        CreateTensors<tstring>(
            TensorShape({}),
            {{"1"}, {"22"}, {"333"}, {"bb"}, {"ccc"}, {"zzz"}})}};
@@ -280,6 +309,13 @@ std::vector<SkipTestCase<TFRecordDatasetParams>> SkipTestCases() {
            /*expected_outputs=*/
            CreateTensors<tstring>(TensorShape({}), {{"bb"}})},
           {/*dataset_params=*/TFRecordDatasetParams3(),
+           /*num_to_skip*/ 7, /*expected_num_skipped*/ 6},
+
+          {/*dataset_params=*/ReadAheadTFRecordDatasetParams(),
+           /*num_to_skip*/ 4, /*expected_num_skipped*/ 4, /*get_next*/ true,
+           /*expected_outputs=*/
+           CreateTensors<tstring>(TensorShape({}), {{"bb"}})},
+          {/*dataset_params=*/ReadAheadTFRecordDatasetParams(),
            /*num_to_skip*/ 7, /*expected_num_skipped*/ 6}};
 }
 
@@ -319,6 +355,27 @@ TEST_F(TFRecordDatasetOpTest, Cardinality) {
   TF_ASSERT_OK(CheckDatasetCardinality(kUnknownCardinality));
 }
 
+TEST_F(TFRecordDatasetOpTest, CardinalityOfIndexedFiles) {
+  std::vector<tstring> filenames = {
+      absl::StrCat(testing::TmpDir(), "/tf_record_INDEXED_1"),
+      absl::StrCat(testing::TmpDir(), "/tf_record_INDEXED_2")};
+  TF_ASSERT_OK(CreateTestFiles(filenames,
+                               {{"1", "22", "333"}, {"a", "bb", "ccc", "dddd"}},
+                               CompressionType::UNCOMPRESSED));
+  for (const tstring& filename : filenames) {
+    TF_ASSERT_OK(WriteTFRecordIndex(Env::Default(), filename));
+  }
+  TFRecordDatasetParams dataset_params(filenames,
+                                       CompressionType::UNCOMPRESSED,
+                                       /*buffer_size=*/10,
+                                       /*byte_offsets=*/{},
+                                       /*node_name=*/kNodeName);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  CardinalityOptions options;
+  options.set_compute_level(CardinalityOptions::CARDINALITY_COMPUTE_MODERATE);
+  EXPECT_EQ(dataset_->Cardinality(options), 7);
+}
+
 TEST_F(TFRecordDatasetOpTest, IteratorOutputDtypes) {
   auto dataset_params = TFRecordDatasetParams1();
   TF_ASSERT_OK(Initialize(dataset_params));
@@ -352,6 +409,13 @@ TEST_F(TFRecordDatasetOpTest, InvalidByteOffsetsToSeek) {
       absl::StatusCode::kDataLoss);
 }
 
+TEST_F(TFRecordDatasetOpTest, ReadAheadRequiresUncompressedFiles) {
+  auto dataset_params = TFRecordDatasetParams1();
+  dataset_params.set_use_read_ahead(true);
+  EXPECT_EQ(Initialize(dataset_params).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
 std::vector<IteratorSaveAndRestoreTestCase<TFRecordDatasetParams>>
 IteratorSaveAndRestoreTestCases() {
   return {
@@ -365,6 +429,10 @@ IteratorSaveAndRestoreTestCases() {
        CreateTensors<tstring>(
            TensorShape({}), {{"1"}, {"22"}, {"333"}, {"a"}, {"bb"}, {"ccc"}})},
       {/*dataset_params=*/TFRecordDatasetParams3(),
+       /*breakpoints=*/{0, 2, 7},
+       CreateTensors<tstring>(
+           TensorShape({}), {{"1"}, {"22"}, {"333"}, {"a"}, {"bb"}, {"ccc"}})},
+      {/*dataset_params=*/ReadAheadTFRecordDatasetParams(),
        /*breakpoints=*/{0, 2, 7},
        CreateTensors<tstring>(
            TensorShape({}), {{"1"}, {"22"}, {"333"}, {"a"}, {"bb"}, {"ccc"}})}};
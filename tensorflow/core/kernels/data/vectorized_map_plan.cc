@@ -0,0 +1,188 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/vectorized_map_plan.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/platform/errors.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// Labels of the values of the function that don't derive from a component of
+// the element. Values that do are labeled with the index of a component of
+// the same shape.
+constexpr int kScalar = -1;
+constexpr int kNonScalar = -2;
+
+bool IsUnaryElementWise(absl::string_view op) {
+  static const auto* const ops = new absl::flat_hash_set<absl::string_view>({
+      "Abs", "Cast", "Ceil", "Cos", "Elu", "Erf", "Exp", "Expm1", "Floor",
+      "Identity", "IsFinite", "IsInf", "IsNan", "Log", "Log1p", "LogicalNot",
+      "Neg", "Reciprocal", "Relu", "Relu6", "Rint", "Round", "Rsqrt", "Selu",
+      "Sigmoid", "Sign", "Sin", "Softplus", "Sqrt", "Square", "Tanh",
+  });
+  return ops->contains(op);
+}
+
+bool IsBinaryElementWise(absl::string_view op) {
+  static const auto* const ops = new absl::flat_hash_set<absl::string_view>({
+      "Add", "AddV2", "BitwiseAnd", "BitwiseOr", "BitwiseXor", "Div",
+      "DivNoNan", "Equal", "FloorDiv", "FloorMod", "Greater", "GreaterEqual",
+      "Less", "LessEqual", "LogicalAnd", "LogicalOr", "Maximum", "Minimum",
+      "Mul", "MulNoNan", "NotEqual", "Pow", "RealDiv", "SquaredDifference",
+      "Sub", "TruncateDiv", "TruncateMod",
+  });
+  return ops->contains(op);
+}
+
+bool IsScalarConst(const NodeDef& node) {
+  if (node.op() != "Const") return false;
+  auto it = node.attr().find("value");
+  return it != node.attr().end() &&
+         !it->second.tensor().tensor_shape().unknown_rank() &&
+         it->second.tensor().tensor_shape().dim_size() == 0;
+}
+
+}  // namespace
+
+Status VectorizedMapPlan::Create(const FunctionDef& fdef,
+                                 const std::vector<Tensor>& captured_inputs,
+                                 std::unique_ptr<VectorizedMapPlan>* plan) {
+  const OpDef& signature = fdef.signature();
+  if (signature.is_stateful()) {
+    return errors::InvalidArgument("Function ", signature.name(),
+                                   " is stateful.");
+  }
+  const int num_components =
+      signature.input_arg_size() - static_cast<int>(captured_inputs.size());
+  if (num_components <= 0) {
+    return errors::InvalidArgument("Function ", signature.name(),
+                                   " doesn't take any element component.");
+  }
+  auto result = absl::WrapUnique(new VectorizedMapPlan(num_components));
+
+  // Labels of the function inputs and of the nodes, which all have a single
+  // output.
+  absl::flat_hash_map<std::string, int> labels;
+  for (int i = 0; i < signature.input_arg_size(); ++i) {
+    int label = i;
+    if (i >= num_components) {
+      label = TensorShapeUtils::IsScalar(
+                  captured_inputs[i - num_components].shape())
+                  ? kScalar
+                  : kNonScalar;
+    }
+    labels[signature.input_arg(i).name()] = label;
+  }
+  // Looks up the label of `input`, of the form "<arg>" or
+  // "<node>:<output>:<index>", if it's already known.
+  auto find_label = [&labels](absl::string_view input, int* label) {
+    auto it = labels.find(input.substr(0, input.find(':')));
+    if (it == labels.end()) return false;
+    *label = it->second;
+    return true;
+  };
+
+  // Nodes aren't topologically sorted, so label them in as many passes as it
+  // takes.
+  std::vector<const NodeDef*> pending;
+  for (const NodeDef& node : fdef.node_def()) {
+    pending.push_back(&node);
+  }
+  while (!pending.empty()) {
+    std::vector<const NodeDef*> next_pending;
+    for (const NodeDef* node : pending) {
+      const bool is_unary = IsUnaryElementWise(node->op());
+      const bool is_binary = IsBinaryElementWise(node->op());
+      if (!is_unary && !is_binary && !IsScalarConst(*node)) {
+        return errors::InvalidArgument("Op ", node->op(), " of node ",
+                                       node->name(), " isn't element-wise.");
+      }
+      const int num_inputs = is_unary ? 1 : is_binary ? 2 : 0;
+      if (node->input_size() != num_inputs) {
+        return errors::InvalidArgument("Node ", node->name(), " has ",
+                                       node->input_size(), " inputs; expected ",
+                                       num_inputs, ".");
+      }
+      int input_labels[2];
+      bool ready = true;
+      for (int i = 0; i < num_inputs; ++i) {
+        ready = ready && find_label(node->input(i), &input_labels[i]);
+      }
+      if (!ready) {
+        next_pending.push_back(node);
+        continue;
+      }
+      int label = kScalar;
+      for (int i = 0; i < num_inputs; ++i) {
+        if (input_labels[i] == kNonScalar) {
+          return errors::InvalidArgument(
+              "Node ", node->name(), " uses a non-scalar captured input.");
+        }
+        if (input_labels[i] == kScalar) continue;
+        if (label != kScalar && label != input_labels[i]) {
+          result->same_shape_components_.push_back({label, input_labels[i]});
+        }
+        label = input_labels[i];
+      }
+      labels[node->name()] = label;
+    }
+    if (next_pending.size() == pending.size()) {
+      return errors::InvalidArgument(
+          "Node ", pending.front()->name(),
+          " has inputs that are neither function inputs nor nodes.");
+    }
+    pending = std::move(next_pending);
+  }
+
+  for (const auto& output : signature.output_arg()) {
+    auto it = fdef.ret().find(output.name());
+    int label;
+    if (it == fdef.ret().end() || !find_label(it->second, &label)) {
+      return errors::InvalidArgument("Output ", output.name(),
+                                     " isn't computed by the function.");
+    }
+    if (label < 0) {
+      return errors::InvalidArgument(
+          "Output ", output.name(), " doesn't depend on the input element.");
+    }
+  }
+  *plan = std::move(result);
+  return absl::OkStatus();
+}
+
+bool VectorizedMapPlan::CanVectorize(const std::vector<Tensor>& element) const {
+  if (element.size() != num_components_) return false;
+  for (const Tensor& component : element) {
+    if (!DataTypeCanUseMemcpy(component.dtype())) return false;
+  }
+  for (const auto& [a, b] : same_shape_components_) {
+    if (element[a].shape() != element[b].shape()) return false;
+  }
+  return true;
+}
+
+}  // namespace data
+}  // namespace tensorflow
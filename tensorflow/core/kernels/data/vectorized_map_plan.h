@@ -0,0 +1,63 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_KERNELS_DATA_VECTORIZED_MAP_PLAN_H_
+#define TENSORFLOW_CORE_KERNELS_DATA_VECTORIZED_MAP_PLAN_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/framework/function.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/status.h"
+
+namespace tensorflow {
+namespace data {
+
+// Determines whether a map function can be applied to a micro-batch of
+// elements at once, by calling it on the elements stacked along a new leading
+// dimension and unstacking its outputs.
+//
+// This holds for functions made only of stateless element-wise ops, as long
+// as the operands of binary ops either have the same shape, or one of them is
+// a scalar that doesn't depend on the element (a constant or a captured
+// input). The analysis is conservative: functions using any other op are not
+// vectorizable, even if a vectorized equivalent exists.
+class VectorizedMapPlan {
+ public:
+  // Analyzes `fdef`, whose trailing inputs are bound to `captured_inputs`.
+  // Returns an error explaining why if the function isn't vectorizable.
+  static Status Create(const FunctionDef& fdef,
+                       const std::vector<Tensor>& captured_inputs,
+                       std::unique_ptr<VectorizedMapPlan>* plan);
+
+  // Returns whether elements like `element` can be stacked and mapped at once.
+  // All the elements of a micro-batch must have the same shapes.
+  bool CanVectorize(const std::vector<Tensor>& element) const;
+
+ private:
+  explicit VectorizedMapPlan(int num_components)
+      : num_components_(num_components) {}
+
+  const int num_components_;
+  // Pairs of components that binary ops combine, and whose shapes must thus be
+  // equal.
+  std::vector<std::pair<int, int>> same_shape_components_;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_DATA_VECTORIZED_MAP_PLAN_H_
@@ -0,0 +1,112 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/vectorized_map_plan.h"
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using FDH = FunctionDefHelper;
+
+// f(x) = x * 2 + 1, with its nodes out of order.
+FunctionDef AffineFunction() {
+  return FDH::Create(
+      "Affine", {"x: float"}, {"y: float"}, {},
+      {
+          {{"add"}, "AddV2", {"mul:z:0", "one:output:0"}, {{"T", DT_FLOAT}}},
+          {{"mul"}, "Mul", {"x", "two:output:0"}, {{"T", DT_FLOAT}}},
+          {{"one"}, "Const", {}, {{"value", 1.0f}, {"dtype", DT_FLOAT}}},
+          {{"two"}, "Const", {}, {{"value", 2.0f}, {"dtype", DT_FLOAT}}},
+      },
+      {{"y", "add:z:0"}});
+}
+
+// f(x, y, c) = (x + y) * c, where `c` is captured.
+FunctionDef ScaledSumFunction() {
+  return FDH::Create(
+      "ScaledSum", {"x: float", "y: float", "c: float"}, {"z: float"}, {},
+      {
+          {{"add"}, "AddV2", {"x", "y"}, {{"T", DT_FLOAT}}},
+          {{"mul"}, "Mul", {"add:z:0", "c"}, {{"T", DT_FLOAT}}},
+      },
+      {{"z", "mul:z:0"}});
+}
+
+TEST(VectorizedMapPlanTest, ElementWiseFunction) {
+  std::unique_ptr<VectorizedMapPlan> plan;
+  TF_ASSERT_OK(VectorizedMapPlan::Create(AffineFunction(), {}, &plan));
+  EXPECT_TRUE(plan->CanVectorize({test::AsTensor<float>({1, 2, 3})}));
+  EXPECT_FALSE(plan->CanVectorize(
+      {test::AsTensor<float>({1}), test::AsTensor<float>({2})}));
+}
+
+TEST(VectorizedMapPlanTest, CombinedComponentsNeedTheSameShape) {
+  std::unique_ptr<VectorizedMapPlan> plan;
+  TF_ASSERT_OK(VectorizedMapPlan::Create(ScaledSumFunction(),
+                                         {test::AsScalar<float>(2)}, &plan));
+  EXPECT_TRUE(plan->CanVectorize(
+      {test::AsTensor<float>({1, 2}), test::AsTensor<float>({3, 4})}));
+  // Stacking would turn the broadcast of `y` into a mismatch.
+  EXPECT_FALSE(plan->CanVectorize(
+      {test::AsTensor<float>({1, 2}), test::AsScalar<float>(3)}));
+}
+
+TEST(VectorizedMapPlanTest, NonScalarCapturedInput) {
+  std::unique_ptr<VectorizedMapPlan> plan;
+  EXPECT_TRUE(errors::IsInvalidArgument(VectorizedMapPlan::Create(
+      ScaledSumFunction(), {test::AsTensor<float>({1, 2})}, &plan)));
+}
+
+TEST(VectorizedMapPlanTest, NonElementWiseOp) {
+  FunctionDef fdef = FDH::Create(
+      "Sum", {"x: float"}, {"y: float"}, {},
+      {
+          {{"axis"}, "Const", {}, {{"value", 0}, {"dtype", DT_INT32}}},
+          {{"sum"},
+           "Sum",
+           {"x", "axis:output:0"},
+           {{"T", DT_FLOAT}, {"Tidx", DT_INT32}}},
+      },
+      {{"y", "sum:output:0"}});
+  std::unique_ptr<VectorizedMapPlan> plan;
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(VectorizedMapPlan::Create(fdef, {}, &plan)));
+}
+
+TEST(VectorizedMapPlanTest, OutputIndependentOfElement) {
+  FunctionDef fdef = FDH::Create(
+      "Constant", {"x: float"}, {"y: float"}, {},
+      {{{"one"}, "Const", {}, {{"value", 1.0f}, {"dtype", DT_FLOAT}}}},
+      {{"y", "one:output:0"}});
+  std::unique_ptr<VectorizedMapPlan> plan;
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(VectorizedMapPlan::Create(fdef, {}, &plan)));
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -15,6 +15,7 @@ limitations under the License.
 
 // See docs in ../ops/parsing_ops.cc.
 
+#include <memory>
 #include <numeric>
 #include <unordered_set>
 #include <vector>
@@ -30,6 +31,7 @@ limitations under the License.
 #include "tensorflow/core/lib/gtl/array_slice.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/protobuf.h"
 #include "tensorflow/core/util/example_proto_fast_parsing.h"
 #include "tensorflow/core/util/example_proto_helper.h"
@@ -92,8 +94,10 @@ class ParseExampleOp : public OpKernel {
 
     example::Result result;
     if (TensorShapeUtils::IsVector(serialized->shape())) {
-      OP_REQUIRES_OK(
-          ctx, ParseExampleVector(config, serialized, names, ctx, &result));
+      std::shared_ptr<const example::FastParseExamplePlan> plan;
+      OP_REQUIRES_OK(ctx, GetPlan(config, &plan));
+      OP_REQUIRES_OK(ctx, ParseExampleVector(config, *plan, serialized, names,
+                                             ctx, &result));
     } else {
       OP_REQUIRES_OK(ctx, ParseExampleScalar(config, serialized, ctx, &result));
     }
@@ -242,8 +246,30 @@ class ParseExampleOp : public OpKernel {
     return FastParseSingleExample(config, serialized_proto, result);
   }
 
+  // Returns a decode plan for `config`. The keys are inputs of the op, but
+  // they rarely change between steps: the plan compiled by the previous call
+  // is reused as long as it matches.
+  Status GetPlan(const example::FastParseExampleConfig& config,
+                 std::shared_ptr<const example::FastParseExamplePlan>* plan) {
+    {
+      tf_shared_lock l(plan_mu_);
+      if (plan_ != nullptr && plan_->Matches(config)) {
+        *plan = plan_;
+        return absl::OkStatus();
+      }
+    }
+    std::unique_ptr<example::FastParseExamplePlan> new_plan;
+    TF_RETURN_IF_ERROR(
+        example::FastParseExamplePlan::Compile(config, &new_plan));
+    mutex_lock l(plan_mu_);
+    plan_ = std::move(new_plan);
+    *plan = plan_;
+    return absl::OkStatus();
+  }
+
   // Parses a vector of examples.
   Status ParseExampleVector(const example::FastParseExampleConfig& config,
+                            const example::FastParseExamplePlan& plan,
                             const Tensor* serialized, const Tensor* names,
                             OpKernelContext* ctx,
                             example::Result* result) const {
@@ -252,7 +278,7 @@ class ParseExampleOp : public OpKernel {
     absl::Span<const tstring> slice(serialized_t.data(), serialized_t.size());
     absl::Span<const tstring> names_slice(names_t.data(), names_t.size());
     return FastParseExample(
-        config, slice, names_slice,
+        config, plan, slice, names_slice,
         ctx->device()->tensorflow_cpu_worker_threads()->workers, result);
   }
 
@@ -290,6 +316,9 @@ class ParseExampleOp : public OpKernel {
   ParseExampleAttrs attrs_;
   int op_version_;
   absl::once_flag flag_;
+  mutex plan_mu_;
+  std::shared_ptr<const example::FastParseExamplePlan> plan_
+      TF_GUARDED_BY(plan_mu_);
 };
 
 REGISTER_KERNEL_BUILDER(Name("ParseExample").Device(DEVICE_CPU),
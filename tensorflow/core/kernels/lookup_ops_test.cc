@@ -24,7 +24,10 @@ limitations under the License.
 #include "tensorflow/core/kernels/lookup_table_op.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/blocking_counter.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 namespace {
@@ -100,5 +103,154 @@ TEST_F(LookupOpsTest, AnonymousHashTable_RefCounting) {
   EXPECT_FALSE(alive);
 }
 
+Tensor Range(int64_t begin, int64_t end, int64_t scale = 1) {
+  Tensor t(DT_INT64, TensorShape({end - begin}));
+  for (int64_t i = begin; i < end; ++i) {
+    t.flat<int64_t>()(i - begin) = i * scale;
+  }
+  return t;
+}
+
+class MutableHashTableOpTest : public OpsTestBase {
+ public:
+  void TestBody() override {}
+
+  // Creates a MutableHashTableV2 of int64 -> int64 with `num_shards` shards
+  // and returns the table resource.
+  lookup::LookupInterface* MakeTable(int num_shards) {
+    TF_CHECK_OK(NodeDefBuilder("mutable_hash_table", "MutableHashTableV2")
+                    .Attr("key_dtype", DT_INT64)
+                    .Attr("value_dtype", DT_INT64)
+                    .Attr("num_shards", num_shards)
+                    .Finalize(node_def()));
+    TF_CHECK_OK(InitOp());
+    TF_CHECK_OK(RunOpKernel());
+    const ResourceHandle& handle = GetOutput(0)->scalar<ResourceHandle>()();
+    lookup::LookupInterface* table = nullptr;
+    TF_CHECK_OK(device_->resource_manager()->Lookup<lookup::LookupInterface>(
+        handle.container(), handle.name(), &table));
+    return table;
+  }
+};
+
+class MutableHashTableTest : public MutableHashTableOpTest,
+                             public ::testing::WithParamInterface<int> {};
+
+TEST_P(MutableHashTableTest, InsertFindRemove) {
+  lookup::LookupInterface* table = MakeTable(GetParam());
+  core::ScopedUnref unref(table);
+
+  TF_ASSERT_OK(table->Insert(nullptr, Range(0, 1000), Range(0, 1000, 2)));
+  EXPECT_EQ(1000, table->size());
+  TF_ASSERT_OK(table->Remove(nullptr, Range(0, 500)));
+  EXPECT_EQ(500, table->size());
+
+  Tensor values(DT_INT64, TensorShape({1500}));
+  Tensor default_value(DT_INT64, TensorShape({}));
+  default_value.scalar<int64_t>()() = -1;
+  TF_ASSERT_OK(table->Find(nullptr, Range(0, 1500), &values, default_value));
+  for (int64_t i = 0; i < 1500; ++i) {
+    EXPECT_EQ(i >= 500 && i < 1000 ? 2 * i : -1, values.flat<int64_t>()(i));
+  }
+
+  // Importing replaces the contents of every shard.
+  TF_ASSERT_OK(
+      table->ImportValues(nullptr, Range(2000, 2010), Range(2000, 2010, 3)));
+  EXPECT_EQ(10, table->size());
+  Tensor imported(DT_INT64, TensorShape({2}));
+  Tensor keys(DT_INT64, TensorShape({2}));
+  keys.flat<int64_t>()(0) = 600;
+  keys.flat<int64_t>()(1) = 2005;
+  TF_ASSERT_OK(table->Find(nullptr, keys, &imported, default_value));
+  EXPECT_EQ(-1, imported.flat<int64_t>()(0));
+  EXPECT_EQ(6015, imported.flat<int64_t>()(1));
+}
+
+TEST_P(MutableHashTableTest, ConcurrentFindAndInsert) {
+  lookup::LookupInterface* table = MakeTable(GetParam());
+  core::ScopedUnref unref(table);
+  constexpr int kNumKeys = 4096;
+  constexpr int kBatchSize = 64;
+
+  Tensor default_value(DT_INT64, TensorShape({}));
+  default_value.scalar<int64_t>()() = -1;
+  {
+    thread::ThreadPool pool(Env::Default(), "test", 8);
+    pool.Schedule([table]() {
+      for (int64_t begin = 0; begin < kNumKeys; begin += kBatchSize) {
+        TF_CHECK_OK(table->Insert(nullptr, Range(begin, begin + kBatchSize),
+                                  Range(begin, begin + kBatchSize, 2)));
+      }
+    });
+    for (int t = 0; t < 7; ++t) {
+      pool.Schedule([table, &default_value]() {
+        Tensor values(DT_INT64, TensorShape({kBatchSize}));
+        for (int64_t begin = 0; begin < kNumKeys; begin += kBatchSize) {
+          TF_CHECK_OK(table->Find(nullptr, Range(begin, begin + kBatchSize),
+                                  &values, default_value));
+          for (int64_t i = 0; i < kBatchSize; ++i) {
+            const int64_t v = values.flat<int64_t>()(i);
+            CHECK(v == -1 || v == 2 * (begin + i));
+          }
+        }
+      });
+    }
+  }
+  EXPECT_EQ(kNumKeys, table->size());
+}
+
+INSTANTIATE_TEST_SUITE_P(NumShards, MutableHashTableTest,
+                         ::testing::Values(1, 4, 16));
+
+// Measures concurrent lookups of 1024 keys on a table of 1M keys from
+// `num_threads` threads, for a table with `num_shards` shards.
+void BM_MutableHashTableConcurrentFind(::testing::benchmark::State& state) {
+  const int num_threads = state.range(0);
+  const int num_shards = state.range(1);
+  constexpr int64_t kNumKeys = 1 << 20;
+  constexpr int64_t kBatchSize = 1024;
+  constexpr int kBatchesPerThread = 64;
+
+  MutableHashTableOpTest test;
+  lookup::LookupInterface* table = test.MakeTable(num_shards);
+  core::ScopedUnref unref(table);
+  TF_CHECK_OK(table->Insert(nullptr, Range(0, kNumKeys), Range(0, kNumKeys)));
+  Tensor default_value(DT_INT64, TensorShape({}));
+  default_value.scalar<int64_t>()() = -1;
+  std::vector<Tensor> batches;
+  for (int i = 0; i < num_threads; ++i) {
+    Tensor keys(DT_INT64, TensorShape({kBatchSize}));
+    for (int64_t j = 0; j < kBatchSize; ++j) {
+      keys.flat<int64_t>()(j) = (j * 7919 + i * 104729) % kNumKeys;
+    }
+    batches.push_back(keys);
+  }
+
+  thread::ThreadPool pool(Env::Default(), "bench", num_threads);
+  for (auto s : state) {
+    BlockingCounter counter(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      pool.Schedule([&, i]() {
+        Tensor values(DT_INT64, TensorShape({kBatchSize}));
+        for (int b = 0; b < kBatchesPerThread; ++b) {
+          TF_CHECK_OK(table->Find(nullptr, batches[i], &values, default_value));
+        }
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * num_threads *
+                          kBatchesPerThread * kBatchSize);
+}
+BENCHMARK(BM_MutableHashTableConcurrentFind)
+    ->UseRealTime()
+    ->ArgPair(1, 1)
+    ->ArgPair(8, 1)
+    ->ArgPair(32, 1)
+    ->ArgPair(1, 32)
+    ->ArgPair(8, 32)
+    ->ArgPair(32, 32);
+
 }  // namespace
 }  // namespace tensorflow
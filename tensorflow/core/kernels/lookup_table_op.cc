@@ -16,9 +16,11 @@ limitations under the License.
 #include "tensorflow/core/kernels/lookup_table_op.h"
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
 #include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/types.h"
@@ -36,11 +38,155 @@ std::string UniqueNodeName(const std::string& base) {
   return strings::StrCat(base, "/", counter.fetch_add(1), "/", random::New64());
 }
 
+// Storage of the mutable hash tables below: `num_shards` independently locked
+// `std::unordered_map`s. A batch of keys is grouped by shard so that every
+// shard touched by the batch is locked once, and concurrent batches only
+// contend on the shards they have in common. A single shard is exactly one map
+// behind one mutex.
+template <class K, class V>
+class ShardedHashMap {
+ public:
+  using Map = std::unordered_map<K, V>;
+
+  explicit ShardedHashMap(int num_shards)
+      : shards_(std::max(num_shards, 1)) {}
+
+  int num_shards() const { return shards_.size(); }
+
+  // Sums the shard sizes. Not a consistent snapshot under concurrent updates.
+  size_t size() const {
+    size_t ret = 0;
+    for (const Shard& shard : shards_) {
+      tf_shared_lock l(shard.mu);
+      ret += shard.map.size();
+    }
+    return ret;
+  }
+
+  // Calls `fn(map, i)` for every position `i` of `keys`, where `map` is the
+  // shard owning `keys(i)`, held under a shared lock.
+  template <class Fn>
+  void ForEachShared(typename TTypes<K>::ConstFlat keys, Fn fn) const
+      TF_NO_THREAD_SAFETY_ANALYSIS {
+    if (shards_.size() == 1) {
+      tf_shared_lock l(shards_[0].mu);
+      for (int64_t i = 0; i < keys.size(); ++i) fn(shards_[0].map, i);
+      return;
+    }
+    ForEachInShardOrder(keys, [&](int s, const int64_t* begin,
+                                  const int64_t* end) {
+      tf_shared_lock l(shards_[s].mu);
+      for (const int64_t* i = begin; i != end; ++i) fn(shards_[s].map, *i);
+    });
+  }
+
+  // Like `ForEachShared()`, but holds exclusive locks and passes mutable maps.
+  template <class Fn>
+  void ForEachExclusive(typename TTypes<K>::ConstFlat keys, Fn fn)
+      TF_NO_THREAD_SAFETY_ANALYSIS {
+    if (shards_.size() == 1) {
+      mutex_lock l(shards_[0].mu);
+      for (int64_t i = 0; i < keys.size(); ++i) fn(shards_[0].map, i);
+      return;
+    }
+    ForEachInShardOrder(keys, [&](int s, const int64_t* begin,
+                                  const int64_t* end) {
+      mutex_lock l(shards_[s].mu);
+      for (const int64_t* i = begin; i != end; ++i) fn(shards_[s].map, *i);
+    });
+  }
+
+  // Calls `fn(*this)` with every shard held under an exclusive lock, for
+  // updates that must appear atomic to readers.
+  template <class Fn>
+  void WithAllExclusive(Fn fn) TF_NO_THREAD_SAFETY_ANALYSIS {
+    std::vector<mutex_lock> locks;
+    locks.reserve(shards_.size());
+    for (Shard& shard : shards_) locks.emplace_back(shard.mu);
+    fn(*this);
+  }
+
+  // Calls `fn(*this)` with every shard held under a shared lock.
+  template <class Fn>
+  auto WithAllShared(Fn fn) const TF_NO_THREAD_SAFETY_ANALYSIS {
+    std::vector<tf_shared_lock> locks;
+    locks.reserve(shards_.size());
+    for (const Shard& shard : shards_) locks.emplace_back(shard.mu);
+    return fn(*this);
+  }
+
+  // The accessors below require the locks taken by `WithAll*()`.
+  Map& MapFor(const K& key) TF_NO_THREAD_SAFETY_ANALYSIS {
+    return shards_[ShardFor(key)].map;
+  }
+  const Map& map(int s) const TF_NO_THREAD_SAFETY_ANALYSIS {
+    return shards_[s].map;
+  }
+  Map& mutable_map(int s) TF_NO_THREAD_SAFETY_ANALYSIS {
+    return shards_[s].map;
+  }
+  size_t UnlockedSize() const {
+    size_t ret = 0;
+    for (int s = 0; s < num_shards(); ++s) ret += map(s).size();
+    return ret;
+  }
+
+ private:
+  // Keeps the locks of different shards on different cache lines.
+  struct alignas(64) Shard {
+    mutable mutex mu;
+    Map map TF_GUARDED_BY(mu);
+  };
+
+  int ShardFor(const K& key) const {
+    if (shards_.size() == 1) return 0;
+    // Mixes the hash, since std::hash is the identity for integers.
+    const uint64 h =
+        static_cast<uint64>(std::hash<K>()(key)) * 0x9E3779B97F4A7C15ull;
+    return (h >> 32) % shards_.size();
+  }
+
+  // Calls `fn(s, begin, end)` once per shard `s` with the positions of the
+  // keys owned by `s`.
+  template <class Fn>
+  void ForEachInShardOrder(typename TTypes<K>::ConstFlat keys, Fn fn) const {
+    const int64_t n = keys.size();
+    // Counting sort of the positions by shard.
+    std::vector<int> shard_of(n);
+    std::vector<int64_t> offsets(shards_.size() + 1, 0);
+    for (int64_t i = 0; i < n; ++i) {
+      shard_of[i] = ShardFor(SubtleMustCopyIfIntegral(keys(i)));
+      ++offsets[shard_of[i] + 1];
+    }
+    for (size_t s = 0; s < shards_.size(); ++s) offsets[s + 1] += offsets[s];
+    std::vector<int64_t> positions(n);
+    std::vector<int64_t> next(offsets.begin(), offsets.end() - 1);
+    for (int64_t i = 0; i < n; ++i) positions[next[shard_of[i]]++] = i;
+    for (size_t s = 0; s < shards_.size(); ++s) {
+      if (offsets[s] == offsets[s + 1]) continue;
+      fn(s, positions.data() + offsets[s], positions.data() + offsets[s + 1]);
+    }
+  }
+
+  std::vector<Shard> shards_;
+};
+
+// Returns the number of shards requested by the "num_shards" attr of the
+// table op, or 1 for ops without the attr.
+inline int NumTableShards(OpKernel* kernel) {
+  int64_t num_shards = 1;
+  if (!TryGetNodeAttr(kernel->def(), "num_shards", &num_shards)) return 1;
+  return std::max<int64_t>(num_shards, 1);
+}
+
 // Lookup table that wraps an unordered_map, where the key and value data type
 // is specified. Each individual value must be a scalar. If vector values are
 // required, use MutableHashTableOfTensors.
 //
 // This table is mutable and thread safe - Insert can be called at any time.
+// The map can be split into several independently locked shards with the
+// "num_shards" attr, so that concurrent lookups scale with the number of
+// threads issuing them.
 //
 // Sample use case:
 //
@@ -53,12 +199,10 @@ std::string UniqueNodeName(const std::string& base) {
 template <class K, class V>
 class MutableHashTableOfScalars final : public LookupInterface {
  public:
-  MutableHashTableOfScalars(OpKernelContext* ctx, OpKernel* kernel) {}
+  MutableHashTableOfScalars(OpKernelContext* ctx, OpKernel* kernel)
+      : table_(NumTableShards(kernel)) {}
 
-  size_t size() const override {
-    tf_shared_lock l(mu_);
-    return table_.size();
-  }
+  size_t size() const override { return table_.size(); }
 
   Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
               const Tensor& default_value) override {
@@ -70,8 +214,7 @@ class MutableHashTableOfScalars final : public LookupInterface {
     int64_t default_total = default_flat.size();
     bool is_full_size_default = (total == default_total);
 
-    tf_shared_lock l(mu_);
-    for (int64_t i = 0; i < key_values.size(); ++i) {
+    table_.ForEachShared(key_values, [&](const Map& map, int64_t i) {
       // is_full_size_default is true:
       //   Each key has an independent default value, key_values(i)
       //   corresponding uses default_flat(i) as its default value.
@@ -79,9 +222,9 @@ class MutableHashTableOfScalars final : public LookupInterface {
       // is_full_size_default is false:
       //   All keys will share the default_flat(0) as default value.
       value_values(i) = gtl::FindWithDefault(
-          table_, SubtleMustCopyIfIntegral(key_values(i)),
+          map, SubtleMustCopyIfIntegral(key_values(i)),
           is_full_size_default ? default_flat(i) : default_flat(0));
-    }
+    });
 
     return absl::OkStatus();
   }
@@ -90,14 +233,23 @@ class MutableHashTableOfScalars final : public LookupInterface {
     const auto key_values = keys.flat<K>();
     const auto value_values = values.flat<V>();
 
-    mutex_lock l(mu_);
     if (clear) {
-      table_.clear();
+      table_.WithAllExclusive([&](ShardedHashMap<K, V>& table) {
+        for (int s = 0; s < table.num_shards(); ++s) {
+          table.mutable_map(s).clear();
+        }
+        for (int64_t i = 0; i < key_values.size(); ++i) {
+          const K key = SubtleMustCopyIfIntegral(key_values(i));
+          gtl::InsertOrUpdate(&table.MapFor(key), key,
+                              SubtleMustCopyIfIntegral(value_values(i)));
+        }
+      });
+      return absl::OkStatus();
     }
-    for (int64_t i = 0; i < key_values.size(); ++i) {
-      gtl::InsertOrUpdate(&table_, SubtleMustCopyIfIntegral(key_values(i)),
+    table_.ForEachExclusive(key_values, [&](Map& map, int64_t i) {
+      gtl::InsertOrUpdate(&map, SubtleMustCopyIfIntegral(key_values(i)),
                           SubtleMustCopyIfIntegral(value_values(i)));
-    }
+    });
     return absl::OkStatus();
   }
 
@@ -109,10 +261,9 @@ class MutableHashTableOfScalars final : public LookupInterface {
   Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
     const auto key_values = keys.flat<K>();
 
-    mutex_lock l(mu_);
-    for (int64_t i = 0; i < key_values.size(); ++i) {
-      table_.erase(SubtleMustCopyIfIntegral(key_values(i)));
-    }
+    table_.ForEachExclusive(key_values, [&](Map& map, int64_t i) {
+      map.erase(SubtleMustCopyIfIntegral(key_values(i)));
+    });
     return absl::OkStatus();
   }
 
@@ -122,17 +273,18 @@ class MutableHashTableOfScalars final : public LookupInterface {
   }
 
   Status ExportValues(OpKernelContext* ctx) override {
-    tf_shared_lock l(mu_);
-    int64_t size = table_.size();
-
-    Tensor* keys;
-    Tensor* values;
-    TF_RETURN_IF_ERROR(
-        ctx->allocate_output("keys", TensorShape({size}), &keys));
-    TF_RETURN_IF_ERROR(
-        ctx->allocate_output("values", TensorShape({size}), &values));
-    ExportKeysAndValues(keys, values);
-    return absl::OkStatus();
+    return table_.WithAllShared([&](const ShardedHashMap<K, V>& table) {
+      int64_t size = table.UnlockedSize();
+
+      Tensor* keys;
+      Tensor* values;
+      TF_RETURN_IF_ERROR(
+          ctx->allocate_output("keys", TensorShape({size}), &keys));
+      TF_RETURN_IF_ERROR(
+          ctx->allocate_output("values", TensorShape({size}), &values));
+      ExportKeysAndValues(table, keys, values);
+      return absl::OkStatus();
+    });
   }
 
   DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
@@ -144,25 +296,33 @@ class MutableHashTableOfScalars final : public LookupInterface {
   TensorShape value_shape() const override { return TensorShape(); }
 
   int64_t MemoryUsed() const override {
-    int64_t ret = 0;
-    tf_shared_lock l(mu_);
-    for (unsigned i = 0; i < table_.bucket_count(); ++i) {
-      size_t bucket_size = table_.bucket_size(i);
-      if (bucket_size == 0) {
-        ret++;
-      } else {
-        ret += bucket_size;
+    int64_t ret = table_.WithAllShared([](const ShardedHashMap<K, V>& table) {
+      int64_t ret = 0;
+      for (int s = 0; s < table.num_shards(); ++s) {
+        const Map& map = table.map(s);
+        for (unsigned i = 0; i < map.bucket_count(); ++i) {
+          size_t bucket_size = map.bucket_size(i);
+          if (bucket_size == 0) {
+            ret++;
+          } else {
+            ret += bucket_size;
+          }
+        }
       }
-    }
+      return ret;
+    });
     return sizeof(MutableHashTableOfScalars) + ret;
   }
 
   Status AsGraphDef(GraphDefBuilder* builder, Node** out) const override {
-    tf_shared_lock l(mu_);
-    int64_t size = table_.size();
-    Tensor keys(key_dtype(), TensorShape({size}));
-    Tensor values(value_dtype(), TensorShape({size}));
-    ExportKeysAndValues(&keys, &values);
+    Tensor keys;
+    Tensor values;
+    table_.WithAllShared([&](const ShardedHashMap<K, V>& table) {
+      int64_t size = table.UnlockedSize();
+      keys = Tensor(key_dtype(), TensorShape({size}));
+      values = Tensor(value_dtype(), TensorShape({size}));
+      ExportKeysAndValues(table, &keys, &values);
+    });
 
     // We set use_node_name_sharing with a unique node name so that the resource
     // can outlive the MutableHashTableV2 kernel. This means that the lifetime
@@ -170,13 +330,17 @@ class MutableHashTableOfScalars final : public LookupInterface {
     // is created in.
     // TODO(b/181695913): Provide a mechanism for deleting this resource
     // earlier when appropriate.
-    Node* table = ops::SourceOp(
-        "MutableHashTableV2",
+    const GraphDefBuilder::Options table_opts =
         builder->opts()
             .WithName(UniqueNodeName("MutableHashTableFromGraphDef"))
             .WithAttr("use_node_name_sharing", true)
             .WithAttr("key_dtype", key_dtype())
-            .WithAttr("value_dtype", value_dtype()));
+            .WithAttr("value_dtype", value_dtype());
+    Node* table = ops::SourceOp(
+        "MutableHashTableV2",
+        table_.num_shards() > 1
+            ? table_opts.WithAttr("num_shards", table_.num_shards())
+            : table_opts);
     Node* keys_node = ops::SourceOp(
         "Const",
         builder->opts().WithAttr("dtype", key_dtype()).WithAttr("value", keys));
@@ -195,21 +359,26 @@ class MutableHashTableOfScalars final : public LookupInterface {
   }
 
  private:
-  // Writes all keys and values into `keys` and `values`. `keys` and `values`
-  // must point to tensors of size `table_.size()`.
-  void ExportKeysAndValues(Tensor* keys, Tensor* values) const
-      TF_SHARED_LOCKS_REQUIRED(mu_) {
+  using Map = typename ShardedHashMap<K, V>::Map;
+
+  // Writes all keys and values of `table` into `keys` and `values`. `keys` and
+  // `values` must point to tensors of size `table.UnlockedSize()`.
+  // REQUIRES: all shards of `table` are locked.
+  static void ExportKeysAndValues(const ShardedHashMap<K, V>& table,
+                                  Tensor* keys, Tensor* values) {
     auto keys_data = keys->flat<K>();
     auto values_data = values->flat<V>();
     int64_t i = 0;
-    for (auto it = table_.begin(); it != table_.end(); ++it, ++i) {
-      keys_data(i) = it->first;
-      values_data(i) = it->second;
+    for (int s = 0; s < table.num_shards(); ++s) {
+      const Map& map = table.map(s);
+      for (auto it = map.begin(); it != map.end(); ++it, ++i) {
+        keys_data(i) = it->first;
+        values_data(i) = it->second;
+      }
     }
   }
 
-  mutable mutex mu_;
-  std::unordered_map<K, V> table_ TF_GUARDED_BY(mu_);
+  ShardedHashMap<K, V> table_;
 };
 
 // Lookup table that wraps an unordered_map. Behaves identical to
@@ -217,7 +386,8 @@ class MutableHashTableOfScalars final : public LookupInterface {
 template <class K, class V>
 class MutableHashTableOfTensors final : public LookupInterface {
  public:
-  MutableHashTableOfTensors(OpKernelContext* ctx, OpKernel* kernel) {
+  MutableHashTableOfTensors(OpKernelContext* ctx, OpKernel* kernel)
+      : table_(NumTableShards(kernel)) {
     OP_REQUIRES_OK(ctx,
                    GetNodeAttr(kernel->def(), "value_shape", &value_shape_));
     OP_REQUIRES(
@@ -226,10 +396,7 @@ class MutableHashTableOfTensors final : public LookupInterface {
                                 value_shape_.DebugString()));
   }
 
-  size_t size() const override {
-    tf_shared_lock l(mu_);
-    return table_.size();
-  }
+  size_t size() const override { return table_.size(); }
 
   Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
               const Tensor& default_value) override {
@@ -242,10 +409,9 @@ class MutableHashTableOfTensors final : public LookupInterface {
     int64_t default_total = default_flat.size();
     bool is_full_size_default = (total == default_total);
 
-    tf_shared_lock l(mu_);
-    for (int64_t i = 0; i < key_values.size(); ++i) {
-      ValueArray* value_vec =
-          gtl::FindOrNull(table_, SubtleMustCopyIfIntegral(key_values(i)));
+    table_.ForEachShared(key_values, [&](const Map& map, int64_t i) {
+      const ValueArray* value_vec =
+          gtl::FindOrNull(map, SubtleMustCopyIfIntegral(key_values(i)));
       if (value_vec != nullptr) {
         for (int64_t j = 0; j < value_dim; j++) {
           value_values(i, j) = value_vec->at(j);
@@ -262,7 +428,7 @@ class MutableHashTableOfTensors final : public LookupInterface {
               is_full_size_default ? default_flat(i, j) : default_flat(0, j);
         }
       }
-    }
+    });
 
     return absl::OkStatus();
   }
@@ -272,19 +438,30 @@ class MutableHashTableOfTensors final : public LookupInterface {
     const auto value_values = values.flat_inner_dims<V, 2>();
     int64_t value_dim = value_shape_.dim_size(0);
 
-    mutex_lock l(mu_);
-    if (clear) {
-      table_.clear();
-    }
-    for (int64_t i = 0; i < key_values.size(); ++i) {
+    auto make_value = [&](int64_t i) {
       ValueArray value_vec;
       for (int64_t j = 0; j < value_dim; j++) {
         V value = value_values(i, j);
         value_vec.push_back(value);
       }
-      gtl::InsertOrUpdate(&table_, SubtleMustCopyIfIntegral(key_values(i)),
-                          value_vec);
+      return value_vec;
+    };
+    if (clear) {
+      table_.WithAllExclusive([&](ShardedHashMap<K, ValueArray>& table) {
+        for (int s = 0; s < table.num_shards(); ++s) {
+          table.mutable_map(s).clear();
+        }
+        for (int64_t i = 0; i < key_values.size(); ++i) {
+          const K key = SubtleMustCopyIfIntegral(key_values(i));
+          gtl::InsertOrUpdate(&table.MapFor(key), key, make_value(i));
+        }
+      });
+      return absl::OkStatus();
     }
+    table_.ForEachExclusive(key_values, [&](Map& map, int64_t i) {
+      gtl::InsertOrUpdate(&map, SubtleMustCopyIfIntegral(key_values(i)),
+                          make_value(i));
+    });
     return absl::OkStatus();
   }
 
@@ -296,10 +473,9 @@ class MutableHashTableOfTensors final : public LookupInterface {
   Status Remove(OpKernelContext* ctx, const Tensor& keys) override {
     const auto key_values = keys.flat<K>();
 
-    mutex_lock l(mu_);
-    for (int64_t i = 0; i < key_values.size(); ++i) {
-      table_.erase(SubtleMustCopyIfIntegral(key_values(i)));
-    }
+    table_.ForEachExclusive(key_values, [&](Map& map, int64_t i) {
+      map.erase(SubtleMustCopyIfIntegral(key_values(i)));
+    });
     return absl::OkStatus();
   }
 
@@ -309,18 +485,20 @@ class MutableHashTableOfTensors final : public LookupInterface {
   }
 
   Status ExportValues(OpKernelContext* ctx) override {
-    tf_shared_lock l(mu_);
-    int64_t size = table_.size();
-    int64_t value_dim = value_shape_.dim_size(0);
-
-    Tensor* keys;
-    Tensor* values;
-    TF_RETURN_IF_ERROR(
-        ctx->allocate_output("keys", TensorShape({size}), &keys));
-    TF_RETURN_IF_ERROR(ctx->allocate_output(
-        "values", TensorShape({size, value_dim}), &values));
-    ExportKeysAndValues(keys, values);
-    return absl::OkStatus();
+    return table_.WithAllShared([&](const ShardedHashMap<K, ValueArray>&
+                                        table) {
+      int64_t size = table.UnlockedSize();
+      int64_t value_dim = value_shape_.dim_size(0);
+
+      Tensor* keys;
+      Tensor* values;
+      TF_RETURN_IF_ERROR(
+          ctx->allocate_output("keys", TensorShape({size}), &keys));
+      TF_RETURN_IF_ERROR(ctx->allocate_output(
+          "values", TensorShape({size, value_dim}), &values));
+      ExportKeysAndValues(table, keys, values);
+      return absl::OkStatus();
+    });
   }
 
   DataType key_dtype() const override { return DataTypeToEnum<K>::v(); }
@@ -332,25 +510,35 @@ class MutableHashTableOfTensors final : public LookupInterface {
   TensorShape value_shape() const override { return value_shape_; }
 
   int64_t MemoryUsed() const override {
-    int64_t ret = 0;
-    tf_shared_lock l(mu_);
-    for (unsigned i = 0; i < table_.bucket_count(); ++i) {
-      size_t bucket_size = table_.bucket_size(i);
-      if (bucket_size == 0) {
-        ret++;
-      } else {
-        ret += bucket_size;
-      }
-    }
+    int64_t ret =
+        table_.WithAllShared([](const ShardedHashMap<K, ValueArray>& table) {
+          int64_t ret = 0;
+          for (int s = 0; s < table.num_shards(); ++s) {
+            const Map& map = table.map(s);
+            for (unsigned i = 0; i < map.bucket_count(); ++i) {
+              size_t bucket_size = map.bucket_size(i);
+              if (bucket_size == 0) {
+                ret++;
+              } else {
+                ret += bucket_size;
+              }
+            }
+          }
+          return ret;
+        });
     return sizeof(MutableHashTableOfTensors) + ret;
   }
 
   Status AsGraphDef(GraphDefBuilder* builder, Node** out) const override {
-    tf_shared_lock l(mu_);
-    int64_t size = table_.size();
-    Tensor keys(key_dtype(), TensorShape({size}));
-    Tensor values(value_dtype(), TensorShape({size, value_shape_.dim_size(0)}));
-    ExportKeysAndValues(&keys, &values);
+    Tensor keys;
+    Tensor values;
+    table_.WithAllShared([&](const ShardedHashMap<K, ValueArray>& table) {
+      int64_t size = table.UnlockedSize();
+      keys = Tensor(key_dtype(), TensorShape({size}));
+      values =
+          Tensor(value_dtype(), TensorShape({size, value_shape_.dim_size(0)}));
+      ExportKeysAndValues(table, &keys, &values);
+    });
 
     // We set use_node_name_sharing with a unique node name so that the resource
     // can outlive the MutableHashTableOfTensorsV2 kernel. This means that the
@@ -358,14 +546,18 @@ class MutableHashTableOfTensors final : public LookupInterface {
     // manager it is created in.
     // TODO(b/181695913): Provide a mechanism for deleting this resource
     // earlier when appropriate.
-    Node* table =
-        ops::SourceOp("MutableHashTableOfTensorsV2",
-                      builder->opts()
-                          .WithName(UniqueNodeName("MutableHashTableOfTensors"))
-                          .WithAttr("use_node_name_sharing", true)
-                          .WithAttr("key_dtype", key_dtype())
-                          .WithAttr("value_dtype", value_dtype())
-                          .WithAttr("value_shape", value_shape_));
+    const GraphDefBuilder::Options table_opts =
+        builder->opts()
+            .WithName(UniqueNodeName("MutableHashTableOfTensors"))
+            .WithAttr("use_node_name_sharing", true)
+            .WithAttr("key_dtype", key_dtype())
+            .WithAttr("value_dtype", value_dtype())
+            .WithAttr("value_shape", value_shape_);
+    Node* table = ops::SourceOp(
+        "MutableHashTableOfTensorsV2",
+        table_.num_shards() > 1
+            ? table_opts.WithAttr("num_shards", table_.num_shards())
+            : table_opts);
     Node* keys_node = ops::SourceOp(
         "Const",
         builder->opts().WithAttr("dtype", key_dtype()).WithAttr("value", keys));
@@ -384,28 +576,33 @@ class MutableHashTableOfTensors final : public LookupInterface {
   }
 
  private:
-  // Writes all keys and values into `keys` and `values`. `keys` and `values`
-  // must point to tensors of size `table_.size()`.
-  void ExportKeysAndValues(Tensor* keys, Tensor* values) const
-      TF_SHARED_LOCKS_REQUIRED(mu_) {
+  typedef gtl::InlinedVector<V, 4> ValueArray;
+  using Map = typename ShardedHashMap<K, ValueArray>::Map;
+
+  // Writes all keys and values of `table` into `keys` and `values`. `keys` and
+  // `values` must point to tensors of size `table.UnlockedSize()`.
+  // REQUIRES: all shards of `table` are locked.
+  void ExportKeysAndValues(const ShardedHashMap<K, ValueArray>& table,
+                           Tensor* keys, Tensor* values) const {
     int64_t value_dim = value_shape_.dim_size(0);
     auto keys_data = keys->flat<K>();
     auto values_data = values->matrix<V>();
     int64_t i = 0;
-    for (auto it = table_.begin(); it != table_.end(); ++it, ++i) {
-      K key = it->first;
-      ValueArray value = it->second;
-      keys_data(i) = key;
-      for (int64_t j = 0; j < value_dim; j++) {
-        values_data(i, j) = value[j];
+    for (int s = 0; s < table.num_shards(); ++s) {
+      const Map& map = table.map(s);
+      for (auto it = map.begin(); it != map.end(); ++it, ++i) {
+        K key = it->first;
+        const ValueArray& value = it->second;
+        keys_data(i) = key;
+        for (int64_t j = 0; j < value_dim; j++) {
+          values_data(i, j) = value[j];
+        }
       }
     }
   }
 
   TensorShape value_shape_;
-  mutable mutex mu_;
-  typedef gtl::InlinedVector<V, 4> ValueArray;
-  std::unordered_map<K, ValueArray> table_ TF_GUARDED_BY(mu_);
+  ShardedHashMap<K, ValueArray> table_;
 };
 
 namespace {
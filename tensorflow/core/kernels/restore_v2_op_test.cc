@@ -26,14 +26,18 @@ limitations under the License.
 #include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_description.pb.h"
+#include "tensorflow/core/framework/tensor_slice.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/public/session_options.h"
 #include "tensorflow/core/public/version.h"
+#include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 
 namespace tensorflow {
 namespace {
@@ -50,6 +54,41 @@ Tensor MakeInput(const TensorShape& shape,
 class RestoreV2OpTest : public OpsTestBase {
  protected:
   // Makes an operation to restore two tensors
+  // Writes a checkpoint with a single mapped float tensor "corrupt" whose
+  // last element, but not its checksum, is changed after the fact.
+  void WriteCorruptCheckpoint(const string& filename) {
+    constexpr int kNumElements = 1 << 10;
+    {
+      BundleWriter::Options options;
+      options.data_alignment = 64;
+      BundleWriter writer(Env::Default(), filename, options);
+      TF_ASSERT_OK(writer.Add(
+          "corrupt", MakeInput<float>(TensorShape({kNumElements}),
+                                      [](int x) -> float { return x; })));
+      TF_ASSERT_OK(writer.Finish());
+    }
+    const string data_file = DataFilename(filename, 0, 1);
+    string contents;
+    TF_ASSERT_OK(ReadFileToString(Env::Default(), data_file, &contents));
+    const float corrupted = -1;
+    contents.replace(contents.size() - sizeof(float), sizeof(float),
+                     reinterpret_cast<const char*>(&corrupted),
+                     sizeof(float));
+    TF_ASSERT_OK(WriteStringToFile(Env::Default(), data_file, contents));
+  }
+
+  void MakeMmapRestoreOp(bool verify_mapped_checksums) {
+    TF_ASSERT_OK(NodeDefBuilder("myop", "RestoreV2")
+                     .Input(FakeInput())  // prefix
+                     .Input(FakeInput())  // tensor_names
+                     .Input(FakeInput())  // shape_and_slices
+                     .Attr("dtypes", {DT_FLOAT})
+                     .Attr("use_mmap", true)
+                     .Attr("verify_mapped_checksums", verify_mapped_checksums)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
   void MakeRestoreOp(DataType dt) {
     TF_ASSERT_OK(NodeDefBuilder("myop", "RestoreV2")
                      .Input(FakeInput())    // prefix
@@ -356,5 +395,168 @@ TEST_F(RestoreV2OpTest, RestoreAfterSaveV2) { RunTest("SaveV2"); }
 TEST_F(RestoreV2OpTest, RestoreAfterSaveSlicesV1) { RunTest("SaveSlices"); }
 TEST_F(RestoreV2OpTest, RestoreAfterSaveV1) { RunTest("Save"); }
 
+TEST_F(RestoreV2OpTest, RestoreManySmallTensorsInParallel) {
+  // Enough small tensors to be split into several restore shards.
+  constexpr int kNumTensors = 64;
+  constexpr int kNumElements = 64 << 10;
+  const string filename =
+      io::JoinPath(testing::TmpDir(), "tensor_many_small");
+  {
+    BundleWriter writer(Env::Default(), filename);
+    for (int i = 0; i < kNumTensors; ++i) {
+      TF_ASSERT_OK(writer.Add(
+          strings::StrCat("tensor_", i),
+          MakeInput<float>(TensorShape({kNumElements}),
+                           [i](int x) -> float { return i + x; })));
+    }
+    TF_ASSERT_OK(writer.Finish());
+  }
+
+  TF_ASSERT_OK(NodeDefBuilder("myop", "RestoreV2")
+                   .Input(FakeInput())  // prefix
+                   .Input(FakeInput())  // tensor_names
+                   .Input(FakeInput())  // shape_and_slices
+                   .Attr("dtypes", DataTypeVector(kNumTensors, DT_FLOAT))
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInput<tstring>(TensorShape({}),
+                    [&filename](int x) -> tstring { return filename; });
+  // Reverse order, so that the restore has to sort the keys.
+  AddInput<tstring>(TensorShape({kNumTensors}), [](int x) -> tstring {
+    return strings::StrCat("tensor_", kNumTensors - 1 - x);
+  });
+  AddInput<tstring>(TensorShape({kNumTensors}),
+                    [](int x) -> tstring { return ""; });
+  TF_ASSERT_OK(RunOpKernel());
+  for (int i = 0; i < kNumTensors; ++i) {
+    const int id = kNumTensors - 1 - i;
+    test::ExpectTensorEqual<float>(
+        MakeInput<float>(TensorShape({kNumElements}),
+                         [id](int x) -> float { return id + x; }),
+        *GetOutput(i));
+  }
+}
+
+TEST_F(RestoreV2OpTest, RestoreWithMmap) {
+  constexpr int kNumTensors = 8;
+  constexpr int kNumElements = 1 << 10;
+  const string filename = io::JoinPath(testing::TmpDir(), "tensor_mmap");
+  {
+    BundleWriter::Options options;
+    options.data_alignment = 64;
+    BundleWriter writer(Env::Default(), filename, options);
+    for (int i = 0; i < kNumTensors; ++i) {
+      TF_ASSERT_OK(writer.Add(
+          strings::StrCat("tensor_", i),
+          MakeInput<float>(TensorShape({kNumElements}),
+                           [i](int x) -> float { return i + x; })));
+    }
+    TF_ASSERT_OK(writer.Finish());
+  }
+
+  TF_ASSERT_OK(NodeDefBuilder("myop", "RestoreV2")
+                   .Input(FakeInput())  // prefix
+                   .Input(FakeInput())  // tensor_names
+                   .Input(FakeInput())  // shape_and_slices
+                   .Attr("dtypes", DataTypeVector(kNumTensors, DT_FLOAT))
+                   .Attr("use_mmap", true)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInput<tstring>(TensorShape({}),
+                    [&filename](int x) -> tstring { return filename; });
+  AddInput<tstring>(TensorShape({kNumTensors}), [](int x) -> tstring {
+    return strings::StrCat("tensor_", x);
+  });
+  AddInput<tstring>(TensorShape({kNumTensors}),
+                    [](int x) -> tstring { return ""; });
+  TF_ASSERT_OK(RunOpKernel());
+  for (int i = 0; i < kNumTensors; ++i) {
+    Tensor* output = GetOutput(i);
+    test::ExpectTensorEqual<float>(
+        MakeInput<float>(TensorShape({kNumElements}),
+                         [i](int x) -> float { return i + x; }),
+        *output);
+    TensorDescription description;
+    output->FillDescription(&description);
+    EXPECT_EQ(description.allocation_description().allocator_name(),
+              "BundleReaderMmap");
+  }
+}
+
+TEST_F(RestoreV2OpTest, RestoreSlicedTensorWithMmap) {
+  const string filename =
+      io::JoinPath(testing::TmpDir(), "tensor_mmap_sliced");
+  {
+    BundleWriter::Options options;
+    options.data_alignment = 64;
+    BundleWriter writer(Env::Default(), filename, options);
+    const TensorShape full_shape({4, 8});
+    for (int i = 0; i < 2; ++i) {
+      TensorSlice slice(2);
+      slice.set_start(0, 2 * i);
+      slice.set_length(0, 2);
+      TF_ASSERT_OK(writer.AddSlice(
+          "sliced", full_shape, slice,
+          MakeInput<float>(TensorShape({2, 8}),
+                           [i](int x) -> float { return 16 * i + x; })));
+    }
+    TF_ASSERT_OK(writer.Finish());
+  }
+
+  TF_ASSERT_OK(NodeDefBuilder("myop", "RestoreV2")
+                   .Input(FakeInput())  // prefix
+                   .Input(FakeInput())  // tensor_names
+                   .Input(FakeInput())  // shape_and_slices
+                   .Attr("dtypes", {DT_FLOAT})
+                   .Attr("use_mmap", true)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInput<tstring>(TensorShape({}),
+                    [&filename](int x) -> tstring { return filename; });
+  AddInput<tstring>(TensorShape({1}),
+                    [](int x) -> tstring { return "sliced"; });
+  AddInput<tstring>(TensorShape({1}), [](int x) -> tstring { return ""; });
+  TF_ASSERT_OK(RunOpKernel());
+  // Slices are assembled into a regular output buffer.
+  test::ExpectTensorEqual<float>(
+      MakeInput<float>(TensorShape({4, 8}), [](int x) -> float { return x; }),
+      *GetOutput(0));
+}
+
+TEST_F(RestoreV2OpTest, RestoreWithMmapDoesNotReadMappedTensors) {
+  const string filename =
+      io::JoinPath(testing::TmpDir(), "tensor_mmap_unverified");
+  WriteCorruptCheckpoint(filename);
+  MakeMmapRestoreOp(/*verify_mapped_checksums=*/false);
+  AddInput<tstring>(TensorShape({}),
+                    [&filename](int x) -> tstring { return filename; });
+  AddInput<tstring>(TensorShape({1}),
+                    [](int x) -> tstring { return "corrupt"; });
+  AddInput<tstring>(TensorShape({1}), [](int x) -> tstring { return ""; });
+  // The corruption goes unnoticed because the restore doesn't read the
+  // mapped bytes; they are only read from disk when the output is accessed.
+  TF_ASSERT_OK(RunOpKernel());
+  const Tensor& output = *GetOutput(0);
+  TensorDescription description;
+  output.FillDescription(&description);
+  EXPECT_EQ(description.allocation_description().allocator_name(),
+            "BundleReaderMmap");
+  EXPECT_EQ(output.flat<float>()(0), 0);
+  EXPECT_EQ(output.flat<float>()(output.NumElements() - 1), -1);
+}
+
+TEST_F(RestoreV2OpTest, RestoreWithMmapVerifiesChecksumsIfRequested) {
+  const string filename =
+      io::JoinPath(testing::TmpDir(), "tensor_mmap_verified");
+  WriteCorruptCheckpoint(filename);
+  MakeMmapRestoreOp(/*verify_mapped_checksums=*/true);
+  AddInput<tstring>(TensorShape({}),
+                    [&filename](int x) -> tstring { return filename; });
+  AddInput<tstring>(TensorShape({1}),
+                    [](int x) -> tstring { return "corrupt"; });
+  AddInput<tstring>(TensorShape({1}), [](int x) -> tstring { return ""; });
+  EXPECT_TRUE(errors::IsDataLoss(RunOpKernel()));
+}
+
 }  // namespace
 }  // namespace tensorflow
@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/save_restore_tensor.h"
 
+#include <algorithm>
 #include <memory>
 #include <numeric>
 #include <unordered_map>
@@ -28,6 +29,7 @@ limitations under the License.
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/gtl/array_slice.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
@@ -251,6 +253,37 @@ namespace {
 // Tensors larger than this threshold will be restored from a thread-pool.
 const int64_t kLargeShapeThreshold = 16 << 20;  // 16M
 
+// Smaller tensors are restored in shards of at least this many bytes, each
+// read by a single BundleReader with coalesced reads.
+const int64_t kMinRestoreShardBytes = 4 << 20;  // 4MB
+
+// Number of threads restoring large tensors when the session does not specify
+// intra-op parallelism.
+const int kDefaultRestoreThreads = 8;
+
+auto* restore_bytes_counter = monitoring::Counter<0>::New(
+    "/tensorflow/core/checkpoint/read/restore_v2_bytes",
+    "The number of tensor bytes restored by RestoreV2.");
+
+auto* restore_tensors_counter = monitoring::Counter<0>::New(
+    "/tensorflow/core/checkpoint/read/restore_v2_tensors",
+    "The number of tensors restored by RestoreV2.");
+
+auto* restore_time_usecs_counter = monitoring::Counter<0>::New(
+    "/tensorflow/core/checkpoint/read/restore_v2_time_usecs",
+    "The wall time spent in RestoreV2, in microseconds. Together with "
+    "restore_v2_bytes, gives the restore throughput.");
+
+// Options of the BundleReaders of a RestoreV2 op.
+BundleReader::Options ReaderOptions(BundleCache* cache, bool use_mmap,
+                                    bool verify_mapped_checksums) {
+  BundleReader::Options options;
+  options.cache = cache;
+  options.use_mmap = use_mmap;
+  options.verify_mapped_checksums = verify_mapped_checksums;
+  return options;
+}
+
 // A restore operation for a single tensor.  Small tensors may be restored
 // directly from the op thread to improve read locality.  Large tensors can be
 // restored from a thread pool: this requires creating a separate BundleReader
@@ -258,13 +291,15 @@ const int64_t kLargeShapeThreshold = 16 << 20;  // 16M
 struct RestoreOp {
   RestoreOp(OpKernelContext* context, int idx, const string& tensor_name,
             const string& shape_and_slice, const string& reader_prefix,
-            DataType dtype)
+            DataType dtype, bool use_mmap, bool verify_mapped_checksums)
       : context(context),
         idx(idx),
         tensor_name(tensor_name),
         shape_and_slice(shape_and_slice),
         reader_prefix(reader_prefix),
-        dtype(dtype) {}
+        dtype(dtype),
+        use_mmap(use_mmap),
+        verify_mapped_checksums(verify_mapped_checksums) {}
 
   // Move-only. It does not make sense to "run()" a copied RestoreOp.
   RestoreOp(const RestoreOp&) = delete;
@@ -285,7 +320,9 @@ struct RestoreOp {
 
   // Run this restore operation using a new BundleReader.
   void run_with_new_reader(BundleCache* cache) {
-    BundleReader reader(tsl::Env::Default(), reader_prefix, {cache, false});
+    BundleReader reader(
+        tsl::Env::Default(), reader_prefix,
+        ReaderOptions(cache, use_mmap, verify_mapped_checksums));
     if (!reader.status().ok()) {
       status = reader.status();
       return;
@@ -294,6 +331,17 @@ struct RestoreOp {
     status = run(&reader);
   }
 
+  // Returns a rough estimate of the number of bytes read by this op, used to
+  // balance restore shards.
+  int64_t estimated_bytes(BundleReader* reader) const {
+    TensorShape restored_full_shape;
+    if (!reader->LookupTensorShape(tensor_name, &restored_full_shape).ok()) {
+      return 0;
+    }
+    return restored_full_shape.num_elements() *
+           std::max(DataTypeSize(dtype), 1);
+  }
+
   Status run(BundleReader* reader) {
     TensorShape restored_full_shape;
     TF_RETURN_IF_ERROR(
@@ -301,8 +349,24 @@ struct RestoreOp {
 
     VLOG(1) << "Restoring tensor " << idx << " : " << tensor_name << " : "
             << restored_full_shape.num_elements();
+    // Full tensors saved as slices are assembled into an output buffer, so
+    // only unsliced entries can alias the mapped file.
+    bool stored_as_slices = false;
+    if (shape_and_slice.empty() && use_mmap) {
+      std::vector<TensorSlice> stored_slices;
+      TF_RETURN_IF_ERROR(
+          reader->LookupTensorSlices(tensor_name, &stored_slices));
+      stored_as_slices = !stored_slices.empty();
+    }
     Tensor* restored_tensor;
-    if (shape_and_slice.empty()) {
+    if (shape_and_slice.empty() && use_mmap && !stored_as_slices) {
+      // Lookup the full tensor, which may alias the mapped file and then does
+      // not need an output buffer.
+      Tensor tensor;
+      TF_RETURN_IF_ERROR(reader->Lookup(tensor_name, &tensor));
+      context->set_output(idx, tensor);
+      restored_tensor = context->mutable_output(idx);
+    } else if (shape_and_slice.empty()) {
       // Lookup the full tensor.
       TF_RETURN_IF_ERROR(
           context->allocate_output(idx, restored_full_shape, &restored_tensor));
@@ -350,22 +414,82 @@ struct RestoreOp {
     return absl::OkStatus();
   }
 
+  // Allocates the full output tensor of this op, to be filled by a batched
+  // lookup. REQUIRES: shape_and_slice.empty()
+  Status allocate_full_output(BundleReader* reader, Tensor** restored_tensor) {
+    TensorShape restored_full_shape;
+    TF_RETURN_IF_ERROR(
+        reader->LookupTensorShape(tensor_name, &restored_full_shape));
+    VLOG(1) << "Restoring tensor " << idx << " : " << tensor_name << " : "
+            << restored_full_shape.num_elements();
+    return context->allocate_output(idx, restored_full_shape, restored_tensor);
+  }
+
   OpKernelContext* context;
   int idx;
   string tensor_name;
   string shape_and_slice;
   string reader_prefix;
   DataType dtype;
+  bool use_mmap;
+  bool verify_mapped_checksums;
 
   ::tensorflow::Status status;
 };
 
+// Restores the full tensors of "ops" with a single "reader", so that tensors
+// stored next to each other are read with coalesced reads. Sets the status of
+// every op.
+void RunRestoreShard(absl::Span<RestoreOp* const> ops, BundleReader* reader) {
+  if (!ops.empty() && ops.front()->use_mmap) {
+    // Mapped tensors are not read, so there is nothing to coalesce.
+    for (RestoreOp* op : ops) {
+      op->status = op->run(reader);
+    }
+    return;
+  }
+  std::vector<std::string> keys;
+  std::vector<Tensor*> tensors;
+  keys.reserve(ops.size());
+  tensors.reserve(ops.size());
+  Status status;
+  for (RestoreOp* op : ops) {
+    Tensor* restored_tensor;
+    status = op->allocate_full_output(reader, &restored_tensor);
+    if (!status.ok()) break;
+    keys.push_back(op->tensor_name);
+    tensors.push_back(restored_tensor);
+  }
+  if (status.ok()) {
+    status = reader->LookupMany(keys, tensors);
+  }
+  for (RestoreOp* op : ops) {
+    op->status = status;
+  }
+}
+
+// Like "RunRestoreShard()", but with a new BundleReader.
+void RunRestoreShardWithNewReader(absl::Span<RestoreOp* const> ops,
+                                  const string& prefix, BundleCache* cache,
+                                  bool use_mmap, bool verify_mapped_checksums) {
+  BundleReader reader(tsl::Env::Default(), prefix,
+                      ReaderOptions(cache, use_mmap, verify_mapped_checksums));
+  if (!reader.status().ok()) {
+    for (RestoreOp* op : ops) {
+      op->status = reader.status();
+    }
+    return;
+  }
+  RunRestoreShard(ops, &reader);
+}
+
 }  // namespace
 
 Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
                         const Tensor& tensor_names,
                         const Tensor& shape_and_slices,
-                        absl::Span<const DataType> dtypes) {
+                        absl::Span<const DataType> dtypes, bool use_mmap,
+                        bool verify_mapped_checksums) {
   const string& prefix_string = prefix.scalar<tstring>()();
 
   const auto& tensor_names_flat = tensor_names.flat<tstring>();
@@ -375,12 +499,16 @@ Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
   restore_ops.reserve(tensor_names_flat.size());
   for (int i = 0; i < tensor_names_flat.size(); ++i) {
     restore_ops.push_back({context, i, tensor_names_flat(i),
-                           shape_and_slices_flat(i), prefix_string, dtypes[i]});
+                           shape_and_slices_flat(i), prefix_string, dtypes[i],
+                           use_mmap, verify_mapped_checksums});
   }
 
   tsl::Env* const env = tsl::Env::Default();
+  const uint64 start_time_usecs = env->NowMicros();
   BundleCache cache(env);
-  BundleReader default_reader(env, prefix_string, {&cache, false});
+  BundleReader default_reader(
+      env, prefix_string,
+      ReaderOptions(&cache, use_mmap, verify_mapped_checksums));
   TF_RETURN_IF_ERROR(default_reader.status());
 
   TF_RETURN_IF_ERROR(default_reader.SortForSequentialAccess<RestoreOp>(
@@ -405,68 +533,118 @@ Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
     return errors::InvalidArgument(error_msg);
   }
 
-  // Split restore ops into two groups: large and small. We schedule
-  // large ops first, to prevent them from waiting on the small op.
+  // Split restore ops into three groups: large ops, small full tensors, and
+  // small slices. We schedule large ops first, to prevent them from waiting on
+  // the small ops.
   std::vector<RestoreOp*> large_restore_ops;
   std::vector<RestoreOp*> small_restore_ops;
+  std::vector<RestoreOp*> small_slice_restore_ops;
+  std::vector<int64_t> small_restore_op_bytes;
+  int64_t small_restore_bytes = 0;
   for (RestoreOp& restore_op : restore_ops) {
     if (restore_op.is_large_shape(&default_reader)) {
       large_restore_ops.push_back(&restore_op);
-    } else {
+    } else if (restore_op.shape_and_slice.empty()) {
       small_restore_ops.push_back(&restore_op);
+      small_restore_op_bytes.push_back(
+          restore_op.estimated_bytes(&default_reader));
+      small_restore_bytes += small_restore_op_bytes.back();
+    } else {
+      small_slice_restore_ops.push_back(&restore_op);
     }
   }
 
-  if (context->session_config() != nullptr &&
-      context->session_config()->intra_op_parallelism_threads() > 0) {
-    // If an explicit restore parallelism is specified, we use it to run
-    // run both small and large restore ops in parallel.
-    auto reader_pool = std::make_unique<thread::ThreadPool>(
+  // Without an explicit restore parallelism, small tensors are restored on the
+  // device's CPU worker threads rather than on a pool created for this call.
+  const bool explicit_parallelism =
+      context->session_config() != nullptr &&
+      context->session_config()->intra_op_parallelism_threads() > 0;
+  const DeviceBase::CpuWorkerThreads* worker_threads =
+      context->device()->tensorflow_cpu_worker_threads();
+  const int num_threads =
+      explicit_parallelism
+          ? context->session_config()->intra_op_parallelism_threads()
+          : worker_threads->num_threads;
+
+  // Cut the small full tensors, which are in sequential file order, into
+  // contiguous shards of similar size, one per thread.
+  const int64_t shard_bytes = std::max(
+      kMinRestoreShardBytes, small_restore_bytes / std::max(num_threads, 1));
+  std::vector<absl::Span<RestoreOp* const>> small_shards;
+  {
+    size_t shard_begin = 0;
+    int64_t bytes = 0;
+    for (size_t i = 0; i < small_restore_ops.size(); ++i) {
+      bytes += small_restore_op_bytes[i];
+      if (bytes >= shard_bytes || i + 1 == small_restore_ops.size()) {
+        small_shards.push_back(absl::MakeConstSpan(small_restore_ops)
+                                   .subspan(shard_begin, i + 1 - shard_begin));
+        shard_begin = i + 1;
+        bytes = 0;
+      }
+    }
+  }
+
+  // Avoid creating a pool if everything can be read from the op thread and
+  // the device's worker threads.
+  std::unique_ptr<thread::ThreadPool> reader_pool;
+  if (!large_restore_ops.empty() ||
+      (explicit_parallelism &&
+       (small_shards.size() > 1 || !small_slice_restore_ops.empty()))) {
+    reader_pool = std::make_unique<thread::ThreadPool>(
         tsl::Env::Default(), "restore_tensors",
-        context->session_config()->intra_op_parallelism_threads());
+        explicit_parallelism ? num_threads : kDefaultRestoreThreads);
+  }
 
-    // Schedule large ops first, followed by the small.
-    for (auto* op : large_restore_ops) {
-      reader_pool->Schedule(
-          [op, &cache]() { op->run_with_new_reader(&cache); });
+  // Schedule large ops first, followed by the small.
+  for (auto* op : large_restore_ops) {
+    reader_pool->Schedule([op, &cache]() { op->run_with_new_reader(&cache); });
+  }
+  if (small_shards.size() > 1 && explicit_parallelism) {
+    for (auto shard : small_shards) {
+      reader_pool->Schedule([shard, &prefix_string, &cache, use_mmap,
+                             verify_mapped_checksums]() {
+        RunRestoreShardWithNewReader(shard, prefix_string, &cache, use_mmap,
+                                     verify_mapped_checksums);
+      });
     }
-    for (auto* op : small_restore_ops) {
+  } else if (small_shards.size() > 1) {
+    // The op thread takes part in restoring the shards. Shards are cut to be
+    // at least kMinRestoreShardBytes, which is a high enough cost for every
+    // shard to get a block of its own.
+    worker_threads->workers->ParallelFor(
+        small_shards.size(), /*cost_per_unit=*/shard_bytes,
+        [&](int64_t begin, int64_t end) {
+          for (int64_t i = begin; i < end; ++i) {
+            RunRestoreShardWithNewReader(small_shards[i], prefix_string,
+                                         &cache, use_mmap,
+                                         verify_mapped_checksums);
+          }
+        });
+  }
+  if (explicit_parallelism) {
+    // If an explicit restore parallelism is specified, we use it to run
+    // small slices in parallel too.
+    for (auto* op : small_slice_restore_ops) {
       reader_pool->Schedule(
           [op, &cache]() { op->run_with_new_reader(&cache); });
     }
-
-    // Wait for all scheduled work to finish and check the status of all
-    // ops that ran in the pool.
-    reader_pool.reset();
-    for (auto& op : restore_ops) {
-      TF_RETURN_IF_ERROR(op.status);
-    }
   } else {
-    // If no restore parallelism is specified, we run large restore ops with
-    // a modest parallelism, and small restore ops serially.
-
-    // Avoid creating a pool if there are no large restore ops.
-    std::unique_ptr<thread::ThreadPool> reader_pool;
-    if (!large_restore_ops.empty()) {
-      reader_pool.reset(
-          new thread::ThreadPool(Env::Default(), "restore_tensors", 8));
-      for (auto* op : large_restore_ops) {
-        reader_pool->Schedule(
-            [op, &cache]() { op->run_with_new_reader(&cache); });
-      }
-    }
-
-    // Read small tensors from the op thread.
-    for (auto* op : small_restore_ops) {
-      TF_RETURN_IF_ERROR(op->run(&default_reader));
+    // Otherwise read small slices from the op thread.
+    for (auto* op : small_slice_restore_ops) {
+      op->status = op->run(&default_reader);
     }
+  }
+  if (small_shards.size() == 1) {
+    RunRestoreShard(small_shards.front(), &default_reader);
+  }
 
-    // Wait for all scheduled work to finish and check the status of all
-    // ops that ran in the pool.
-    reader_pool.reset();
-    for (auto* op : large_restore_ops) {
-      TF_RETURN_IF_ERROR(op->status);
-    }
+  // Wait for all scheduled work to finish and check the status of all ops.
+  reader_pool.reset();
+  int64_t restored_bytes = 0;
+  for (auto& op : restore_ops) {
+    TF_RETURN_IF_ERROR(op.status);
+    restored_bytes += context->mutable_output(op.idx)->TotalBytes();
   }
 
   for (const RestoreOp& restore_op : restore_ops) {
@@ -478,6 +656,10 @@ Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
     }
   }
 
+  restore_bytes_counter->GetCell()->IncrementBy(restored_bytes);
+  restore_tensors_counter->GetCell()->IncrementBy(restore_ops.size());
+  restore_time_usecs_counter->GetCell()->IncrementBy(env->NowMicros() -
+                                                     start_time_usecs);
   return absl::OkStatus();
 }
 
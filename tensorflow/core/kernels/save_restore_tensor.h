@@ -63,10 +63,17 @@ void RestoreTensor(OpKernelContext* context,
 //   * "prefix" has 1 element, DT_STRING.
 //   * "tensor_names" and "shape_and_slices" shaped {N}, both DT_STRING.
 //   * "dtypes" has N elements, the datatypes of the to-restore tensors.
+//
+// If "use_mmap" is true, the data files are memory-mapped copy-on-write, and
+// suitably aligned full tensors are output as tensors aliasing the mapping
+// (see `BundleReader::Options::use_mmap`). Their checksums are only verified,
+// which reads them in full, if "verify_mapped_checksums" is true.
 Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
                         const Tensor& tensor_names,
                         const Tensor& shape_and_slices,
-                        absl::Span<const DataType> dtypes);
+                        absl::Span<const DataType> dtypes,
+                        bool use_mmap = false,
+                        bool verify_mapped_checksums = false);
 
 }  // namespace tensorflow
 
@@ -190,6 +190,9 @@ class RestoreV2 : public OpKernel {
  public:
   explicit RestoreV2(OpKernelConstruction* context) : OpKernel(context) {
     OP_REQUIRES_OK(context, context->GetAttr("dtypes", &dtypes_));
+    OP_REQUIRES_OK(context, context->GetAttr("use_mmap", &use_mmap_));
+    OP_REQUIRES_OK(context, context->GetAttr("verify_mapped_checksums",
+                                             &verify_mapped_checksums_));
   }
 
   void Compute(OpKernelContext* context) override {
@@ -229,8 +232,10 @@ class RestoreV2 : public OpKernel {
       return;
     }
     // If found, invokes the V2 reader.
-    OP_REQUIRES_OK(context, RestoreTensorsV2(context, prefix, tensor_names,
-                                             shape_and_slices, dtypes_));
+    OP_REQUIRES_OK(context,
+                   RestoreTensorsV2(context, prefix, tensor_names,
+                                    shape_and_slices, dtypes_, use_mmap_,
+                                    verify_mapped_checksums_));
 
     ResourceMgr* resource_manager = context->resource_manager();
     if (resource_manager != nullptr) {
@@ -256,6 +261,10 @@ class RestoreV2 : public OpKernel {
  private:
   // Expected dtypes of the to-restore tensors.
   std::vector<DataType> dtypes_;
+  // Whether to return tensors that alias the memory-mapped checkpoint.
+  bool use_mmap_ = false;
+  // Whether to verify the checksums of the tensors that alias the mapping.
+  bool verify_mapped_checksums_ = false;
 };
 REGISTER_KERNEL_BUILDER(Name("RestoreV2").Device(DEVICE_CPU), RestoreV2);
 
@@ -96,6 +96,13 @@ REGISTER_OP("BatchFunction")
     // NOTE: Support for `enable_large_batch_splitting == true` is still
     // developed in progress.
     .Attr("enable_large_batch_splitting: bool = false")
+    // If 'enable_earliest_deadline_first' is true, batch threads first serve
+    // the batch holding the input with the earliest step deadline, and inputs
+    // whose deadline passes while enqueued are failed with DEADLINE_EXCEEDED
+    // instead of being batched. A batch is scheduled early once its earliest
+    // deadline is less than 'deadline_margin_micros' away.
+    .Attr("enable_earliest_deadline_first: bool = false")
+    .Attr("deadline_margin_micros: int = 0")
     // TODO(apassos): Fix this shape inference function. It requires shape
     // inference of function calls.
     .SetShapeFn(shape_inference::UnknownShape)
@@ -175,6 +175,8 @@ REGISTER_OP("CompressElement")
     .Input("components: input_types")
     .Output("compressed: variant")
     .Attr("input_types: list(type) >= 1")
+    .Attr("codec: string = 'snappy'")
+    .Attr("adaptive_min_throughput_mbps: int = 200")
     .SetShapeFn(shape_inference::ScalarShape);
 
 REGISTER_OP("UncompressElement")
@@ -1203,6 +1205,10 @@ REGISTER_OP("SnapshotDatasetV2")
     .Attr("Treader_func_args: list(type) >= 0")
     .Attr("Tshard_func_args: list(type) >= 0")
     .Attr("metadata: string = ''")
+    .Attr("shared_cache: bool = false")
+    .Attr("shared_cache_max_bytes: int = 0")
+    .Attr("num_reader_shards: int = 1")
+    .Attr("reader_shard_index: int = 0")
     .SetTypeConstructor(full_type::VariadicTensorContainer(TFT_DATASET,
                                                            "output_types"))
     .SetShapeFn([](shape_inference::InferenceContext* c) {
@@ -29,7 +29,10 @@ using tsl::port::NUMAGetMemAffinity;
 using tsl::port::NUMAGetThreadNodeAffinity;
 using tsl::port::NUMAMalloc;
 using tsl::port::NUMANumNodes;
+using tsl::port::NUMARestoreThreadAffinity;
+using tsl::port::NUMASaveThreadAffinity;
 using tsl::port::NUMASetThreadNodeAffinity;
+using tsl::port::NUMAThreadAffinity;
 }  // namespace port
 }  // namespace tensorflow
 #endif  // TENSORFLOW_CORE_PLATFORM_NUMA_H_
@@ -15,13 +15,18 @@ limitations under the License.
 #include "tensorflow/core/util/example_proto_fast_parsing.h"
 
 #include <algorithm>
+#include <cstring>
 #include <functional>
+#include <numeric>
 #include <optional>
 #include <utility>
 #include <vector>
 
 #include "absl/base/casts.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "absl/numeric/bits.h"
 #include "absl/status/status.h"
 #include "absl/strings/substitute.h"
 #include "tensorflow/core/example/example.pb.h"
@@ -119,6 +124,90 @@ constexpr uint8 kVarintTag(uint32 tag) { return (tag << 3) | 0; }
 constexpr uint8 kDelimitedTag(uint32 tag) { return (tag << 3) | 2; }
 constexpr uint8 kFixed32Tag(uint32 tag) { return (tag << 3) | 5; }
 
+// Packed varints are decoded 8 bytes at a time (SWAR): the high bits of a
+// 64-bit word tell where each varint ends, and the 7-bit groups of a varint of
+// up to 8 bytes are compacted with a few masks and shifts instead of a
+// data-dependent loop. Runs of 8 single-byte varints, common for ids, labels
+// and lengths, are emitted without any compaction.
+constexpr uint64 kVarintContinuationBits = 0x8080808080808080ULL;
+
+inline uint64 LoadLittleEndian64(const uint8* p) {
+  uint64 word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+// Returns the number of varints ending in `[begin, end)`.
+inline size_t CountVarints(const uint8* begin, const uint8* end) {
+  size_t count = 0;
+  const uint8* p = begin;
+  if (port::kLittleEndian) {
+    for (; end - p >= 8; p += 8) {
+      count += absl::popcount(~LoadLittleEndian64(p) & kVarintContinuationBits);
+    }
+  }
+  for (; p < end; ++p) count += (*p & 0x80) == 0;
+  return count;
+}
+
+// Decodes one varint from `[*p, end)` byte by byte and advances `*p` past it.
+inline bool DecodeVarintSlow(const uint8** p, const uint8* end,
+                             uint64* value) {
+  uint64 result = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    const uint8 byte = *(*p)++;
+    result |= static_cast<uint64>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Decodes the packed varints in `[begin, end)` into `out`, which has room for
+// `capacity` values. Values beyond `capacity` are validated but dropped.
+// Returns false if the input is malformed.
+inline bool DecodePackedVarints(const uint8* begin, const uint8* end,
+                                int64_t* out, size_t capacity) {
+  const uint8* p = begin;
+  size_t n = 0;
+  if (port::kLittleEndian) {
+    while (end - p >= 8 && capacity - n >= 8) {
+      const uint64 word = LoadLittleEndian64(p);
+      const uint64 ends = ~word & kVarintContinuationBits;
+      if (ends == kVarintContinuationBits) {
+        for (int i = 0; i < 8; ++i) out[n + i] = (word >> (8 * i)) & 0x7f;
+        n += 8;
+        p += 8;
+        continue;
+      }
+      if (ends == 0) {
+        // A varint of 9 or 10 bytes.
+        uint64 value;
+        if (!DecodeVarintSlow(&p, end, &value)) return false;
+        out[n++] = static_cast<int64_t>(value);
+        continue;
+      }
+      const int num_bytes = absl::countr_zero(ends) / 8 + 1;
+      uint64 x = word & 0x7f7f7f7f7f7f7f7fULL;
+      if (num_bytes < 8) x &= (uint64{1} << (8 * num_bytes)) - 1;
+      x = ((x & 0x7f007f007f007f00ULL) >> 1) | (x & 0x007f007f007f007fULL);
+      x = ((x & 0x3fff00003fff0000ULL) >> 2) | (x & 0x00003fff00003fffULL);
+      x = ((x & 0x0fffffff00000000ULL) >> 4) | (x & 0x000000000fffffffULL);
+      out[n++] = static_cast<int64_t>(x);
+      p += num_bytes;
+    }
+  }
+  while (p < end) {
+    uint64 value;
+    if (!DecodeVarintSlow(&p, end, &value)) return false;
+    if (n < capacity) out[n] = static_cast<int64_t>(value);
+    ++n;
+  }
+  return true;
+}
+
 namespace parsed {
 
 // ParseDataType has to be called first, then appropriate ParseZzzzList.
@@ -307,10 +396,27 @@ class Feature {
         if (!stream.ReadVarint32(&packed_length)) return false;
         auto packed_limit = stream.PushLimit(packed_length);
 
-        while (!stream.ExpectAtEnd()) {
-          protobuf_uint64 n;  // There is no API for int64
-          if (!stream.ReadVarint64(&n)) return false;
-          int64_list->push_back(static_cast<int64_t>(n));
+        if (packed_length > 0) {
+          const void* packed_ptr;
+          int packed_size;
+          if (!stream.GetDirectBufferPointer(&packed_ptr, &packed_size) ||
+              packed_size < packed_length) {
+            return false;
+          }
+          const uint8* begin = static_cast<const uint8*>(packed_ptr);
+          const uint8* end = begin + packed_length;
+          if ((end[-1] & 0x80) != 0) return false;  // Truncated varint.
+
+          // Sizes the output once, then decodes straight into it.
+          const size_t initial_size = int64_list->size();
+          int64_list->resize(initial_size + CountVarints(begin, end));
+          const size_t capacity = int64_list->size() - initial_size;
+          if (!DecodePackedVarints(begin, end,
+                                   int64_list->data() + initial_size,
+                                   capacity)) {
+            return false;
+          }
+          if (!stream.Skip(packed_length)) return false;
         }
 
         stream.PopLimit(packed_limit);
@@ -592,8 +698,7 @@ void LogSparseFeatureDataLoss(StringPiece feature_name) {
 Status FastParseSerializedExample(
     const tstring& serialized_example, const tstring& example_name,
     const size_t example_index, const Config& config,
-    const PresizedCuckooMap<std::pair<size_t, Type>>& config_index,
-    SeededHasher hasher, std::vector<Tensor>* output_dense,
+    const FastParseExamplePlan& plan, std::vector<Tensor>* output_dense,
     std::vector<SparseBuffer>* output_varlen_dense,
     std::vector<SparseBuffer>* output_sparse,
     std::vector<SparseBuffer>* output_ragged,
@@ -629,23 +734,15 @@ Status FastParseSerializedExample(
     const StringPiece feature_name = name_and_feature.first;
     parsed::Feature& feature = name_and_feature.second;
 
-    std::pair<size_t, Type> d_and_type;
-    uint64 h = hasher(feature_name);
-    if (!config_index.Find(h, &d_and_type)) continue;
-
-    size_t d = d_and_type.first;
-    bool is_dense = d_and_type.second == Type::Dense;
-    bool is_ragged = d_and_type.second == Type::Ragged;
+    const FastParseExamplePlan::Feature* plan_feature =
+        plan.Find(feature_name);
+    if (plan_feature == nullptr) continue;
 
-    {
-      // Testing for PresizedCuckooMap collision.
-      // TODO(lew): Use dense_hash_map and avoid this and hasher creation.
-      const tstring& config_feature_name =
-          is_dense ? config.dense[d].feature_name
-                   : (is_ragged ? config.ragged[d].feature_name
-                                : config.sparse[d].feature_name);
-      if (feature_name != config_feature_name) continue;
-    }
+    size_t d = plan_feature->index;
+    bool is_dense =
+        plan_feature->type == FastParseExamplePlan::FeatureType::kDense;
+    bool is_ragged =
+        plan_feature->type == FastParseExamplePlan::FeatureType::kRagged;
 
     auto example_error = [&](StringPiece suffix) {
       return errors::InvalidArgument("Name: ", example_name,
@@ -1133,11 +1230,173 @@ void CopySparseBufferToTensor(DataType dtype, size_t offset, SparseBuffer* src,
 
 }  // namespace
 
+Status FastParseExamplePlan::Compile(
+    const FastParseExampleConfig& config,
+    std::unique_ptr<FastParseExamplePlan>* plan) {
+  std::vector<Slot> features;
+  features.reserve(config.dense.size() + config.sparse.size() +
+                   config.ragged.size());
+  absl::flat_hash_set<StringPiece> names;
+  auto add_feature = [&](const tstring& name, FeatureType type, size_t index,
+                         DataType dtype) {
+    if (!names.insert(name).second) {
+      return errors::InvalidArgument(
+          "Feature name appears more than once in the config: ", name);
+    }
+    Slot slot;
+    slot.name = name;
+    slot.feature = {type, index};
+    slot.dtype = dtype;
+    slot.used = true;
+    features.push_back(std::move(slot));
+    return absl::OkStatus();
+  };
+  for (size_t d = 0; d < config.dense.size(); ++d) {
+    TF_RETURN_IF_ERROR(add_feature(config.dense[d].feature_name,
+                                   FeatureType::kDense, d,
+                                   config.dense[d].dtype));
+  }
+  for (size_t d = 0; d < config.sparse.size(); ++d) {
+    TF_RETURN_IF_ERROR(add_feature(config.sparse[d].feature_name,
+                                   FeatureType::kSparse, d,
+                                   config.sparse[d].dtype));
+  }
+  for (size_t d = 0; d < config.ragged.size(); ++d) {
+    TF_RETURN_IF_ERROR(add_feature(config.ragged[d].feature_name,
+                                   FeatureType::kRagged, d,
+                                   config.ragged[d].dtype));
+  }
+
+  auto result = absl::WrapUnique(new FastParseExamplePlan);
+  result->num_features_ = features.size();
+  if (!features.empty()) {
+    // Half of the slots stay empty and buckets average 4 names, which keeps
+    // the displacement search short.
+    size_t num_slots = 1;
+    while (num_slots < 2 * features.size()) num_slots *= 2;
+    int bucket_bits = 0;
+    while ((size_t{4} << bucket_bits) < features.size()) ++bucket_bits;
+    result->bucket_shift_ = 64 - bucket_bits;
+    result->displacements_.resize(size_t{1} << bucket_bits);
+    result->slots_.resize(num_slots);
+
+    constexpr uint64 kFirstSeed = 0xDECAFCAFFE;
+    constexpr int kMaxSeeds = 100;
+    bool ok = false;
+    for (int i = 0; i < kMaxSeeds && !ok; ++i) {
+      ok = result->TryBuild(features, kFirstSeed + i);
+    }
+    if (!ok) {
+      return errors::Internal("Could not build a perfect hash table for ",
+                              features.size(), " feature names.");
+    }
+  }
+  *plan = std::move(result);
+  return absl::OkStatus();
+}
+
+bool FastParseExamplePlan::TryBuild(const std::vector<Slot>& features,
+                                    uint64 seed) {
+  seed_ = seed;
+  std::fill(slots_.begin(), slots_.end(), Slot());
+  std::fill(displacements_.begin(), displacements_.end(), 0);
+
+  std::vector<uint64> hashes(features.size());
+  std::vector<std::vector<int>> buckets(displacements_.size());
+  for (int i = 0; i < features.size(); ++i) {
+    const tstring& name = features[i].name;
+    hashes[i] = Hash64(name.data(), name.size(), seed);
+    buckets[BucketIndex(hashes[i])].push_back(i);
+  }
+  // Places the largest buckets first, while most slots are free.
+  std::vector<int> order(buckets.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&buckets](int a, int b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  const uint32 max_displacement = 4 * slots_.size();
+  std::vector<size_t> bucket_slots;
+  for (int b : order) {
+    const std::vector<int>& bucket = buckets[b];
+    if (bucket.empty()) break;
+    bool placed = false;
+    for (uint32 displacement = 0;
+         displacement < max_displacement && !placed; ++displacement) {
+      bucket_slots.clear();
+      placed = true;
+      for (int i : bucket) {
+        const size_t slot = SlotIndex(hashes[i], displacement);
+        if (slots_[slot].used ||
+            std::find(bucket_slots.begin(), bucket_slots.end(), slot) !=
+                bucket_slots.end()) {
+          placed = false;
+          break;
+        }
+        bucket_slots.push_back(slot);
+      }
+      if (placed) {
+        displacements_[b] = displacement;
+        for (int j = 0; j < bucket.size(); ++j) {
+          slots_[bucket_slots[j]] = features[bucket[j]];
+        }
+      }
+    }
+    if (!placed) return false;
+  }
+  return true;
+}
+
+bool FastParseExamplePlan::Matches(const FastParseExampleConfig& config) const {
+  if (config.dense.size() + config.sparse.size() + config.ragged.size() !=
+      num_features_) {
+    return false;
+  }
+  auto matches = [this](const tstring& name, FeatureType type, size_t index,
+                        DataType dtype) {
+    const Slot* slot = FindSlot(name);
+    return slot != nullptr && slot->feature.type == type &&
+           slot->feature.index == index && slot->dtype == dtype;
+  };
+  for (size_t d = 0; d < config.dense.size(); ++d) {
+    if (!matches(config.dense[d].feature_name, FeatureType::kDense, d,
+                 config.dense[d].dtype)) {
+      return false;
+    }
+  }
+  for (size_t d = 0; d < config.sparse.size(); ++d) {
+    if (!matches(config.sparse[d].feature_name, FeatureType::kSparse, d,
+                 config.sparse[d].dtype)) {
+      return false;
+    }
+  }
+  for (size_t d = 0; d < config.ragged.size(); ++d) {
+    if (!matches(config.ragged[d].feature_name, FeatureType::kRagged, d,
+                 config.ragged[d].dtype)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 Status FastParseExample(const Config& config,
                         absl::Span<const tstring> serialized,
                         absl::Span<const tstring> example_names,
                         thread::ThreadPool* thread_pool, Result* result) {
+  // Check config so we can safely CHECK(false) in switches on config.*.dtype
+  TF_RETURN_IF_ERROR(CheckConfigDataTypes(config));
+  std::unique_ptr<FastParseExamplePlan> plan;
+  TF_RETURN_IF_ERROR(FastParseExamplePlan::Compile(config, &plan));
+  return FastParseExample(config, *plan, serialized, example_names,
+                          thread_pool, result);
+}
+
+Status FastParseExample(const Config& config, const FastParseExamplePlan& plan,
+                        absl::Span<const tstring> serialized,
+                        absl::Span<const tstring> example_names,
+                        thread::ThreadPool* thread_pool, Result* result) {
   DCHECK(result != nullptr);
+  DCHECK(plan.Matches(config));
   // Check config so we can safely CHECK(false) in switches on config.*.dtype
   TF_RETURN_IF_ERROR(CheckConfigDataTypes(config));
 
@@ -1145,37 +1404,6 @@ Status FastParseExample(const Config& config,
     result->feature_stats.resize(serialized.size());
   }
 
-  size_t config_size =
-      config.dense.size() + config.sparse.size() + config.ragged.size();
-  SeededHasher hasher;
-  // Build config index.
-  PresizedCuckooMap<std::pair<size_t, Type>> config_index(config_size);
-  bool ok = true;
-  for (size_t i = 0; i < 1000; ++i) {
-    for (size_t d = 0; d < config.dense.size(); ++d) {
-      ok &= config_index.InsertUnique(hasher(config.dense[d].feature_name),
-                                      {d, Type::Dense});
-    }
-    for (size_t d = 0; d < config.sparse.size(); ++d) {
-      ok &= config_index.InsertUnique(hasher(config.sparse[d].feature_name),
-                                      {d, Type::Sparse});
-    }
-    for (size_t d = 0; d < config.ragged.size(); ++d) {
-      ok &= config_index.InsertUnique(hasher(config.ragged[d].feature_name),
-                                      {d, Type::Ragged});
-    }
-    if (ok) break;
-    LOG(WARNING) << "Collision found. This should happen only if you have "
-                    "around 2^32 entries in your config.";
-    hasher.seed++;
-    config_index.Clear(config_size);
-    ok = true;
-  }
-  if (!ok) {
-    return errors::Internal(
-        "Could not avoid collision. This should not happen.");
-  }
-
   // Allocate dense output for fixed length dense values
   // (variable-length dense and sparse and ragged have to be buffered).
   std::vector<Tensor> fixed_dense_values(config.dense.size());
@@ -1245,7 +1473,7 @@ Status FastParseExample(const Config& config,
       status_of_minibatch[minibatch] = FastParseSerializedExample(
           serialized[e],
           (!example_names.empty() ? example_names[e] : "<unknown>"), e, config,
-          config_index, hasher, &fixed_dense_values,
+          plan, &fixed_dense_values,
           &varlen_dense_buffers[minibatch], &sparse_buffers[minibatch],
           &ragged_buffers[minibatch], stats);
       if (!status_of_minibatch[minibatch].ok()) break;
@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_UTIL_EXAMPLE_PROTO_FAST_PARSING_H_
 #define TENSORFLOW_CORE_UTIL_EXAMPLE_PROTO_FAST_PARSING_H_
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -29,6 +30,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/lib/gtl/array_slice.h"
+#include "tensorflow/core/platform/hash.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/util/sparse/sparse_tensor.h"
 
@@ -130,6 +132,81 @@ struct Result {
   std::vector<PerExampleFeatureStats> feature_stats;
 };
 
+// The features of a FastParseExampleConfig compiled into a decode plan: a
+// perfect hash table that resolves the name of each feature found in an
+// Example to its sub-config with a single hash and probe.
+//
+// Compiling a plan costs a few hashes per feature and may retry with several
+// seeds, so callers that parse many batches with the same features (e.g.
+// kernels) should compile it once and reuse it. A plan only depends on the
+// names, kinds and dtypes of the features: the dense shapes and default values
+// of the config may change between calls.
+class FastParseExamplePlan {
+ public:
+  enum class FeatureType : uint8 { kDense, kSparse, kRagged };
+
+  struct Feature {
+    FeatureType type;
+    // Index of the sub-config in `FastParseExampleConfig::dense`, `sparse` or
+    // `ragged`, depending on `type`.
+    size_t index;
+  };
+
+  // Returns an error if `config` has two sub-configs with the same name.
+  static Status Compile(const FastParseExampleConfig& config,
+                        std::unique_ptr<FastParseExamplePlan>* plan);
+
+  // Returns true if `config` has the same features, in the same order, as the
+  // config this plan was compiled from.
+  bool Matches(const FastParseExampleConfig& config) const;
+
+  // Returns the feature named `feature_name`, or nullptr if the config has
+  // none.
+  const Feature* Find(StringPiece feature_name) const {
+    const Slot* slot = FindSlot(feature_name);
+    return slot == nullptr ? nullptr : &slot->feature;
+  }
+
+ private:
+  struct Slot {
+    tstring name;
+    Feature feature;
+    DataType dtype = DT_INVALID;
+    bool used = false;
+  };
+
+  FastParseExamplePlan() = default;
+
+  const Slot* FindSlot(StringPiece feature_name) const {
+    if (slots_.empty()) return nullptr;
+    const uint64 h = Hash64(feature_name.data(), feature_name.size(), seed_);
+    const Slot& slot = slots_[SlotIndex(h, displacements_[BucketIndex(h)])];
+    if (!slot.used || slot.name != feature_name) return nullptr;
+    return &slot;
+  }
+
+  // Tries to place every feature with the given seed. Returns false if some
+  // bucket cannot be displaced to free slots.
+  bool TryBuild(const std::vector<Slot>& features, uint64 seed);
+
+  size_t BucketIndex(uint64 h) const {
+    return bucket_shift_ >= 64 ? 0 : h >> bucket_shift_;
+  }
+  size_t SlotIndex(uint64 h, uint32 displacement) const {
+    const uint32 h1 = static_cast<uint32>(h);
+    const uint32 h2 = static_cast<uint32>(h >> 32) | 1;
+    return (h1 + displacement * h2) & (slots_.size() - 1);
+  }
+
+  uint64 seed_ = 0;
+  int bucket_shift_ = 64;
+  size_t num_features_ = 0;
+  // Displacement of the slots of the names in each bucket.
+  std::vector<uint32> displacements_;
+  // Power-of-two sized.
+  std::vector<Slot> slots_;
+};
+
 // Parses a batch of serialized Example protos and converts them into result
 // according to given config.
 // Given example names have to either be empty or the same size as serialized.
@@ -139,6 +216,14 @@ Status FastParseExample(const FastParseExampleConfig& config,
                         absl::Span<const tstring> example_names,
                         thread::ThreadPool* thread_pool, Result* result);
 
+// As above, but with a plan precompiled from a config with the same features
+// as `config` (see `FastParseExamplePlan::Matches`).
+Status FastParseExample(const FastParseExampleConfig& config,
+                        const FastParseExamplePlan& plan,
+                        absl::Span<const tstring> serialized,
+                        absl::Span<const tstring> example_names,
+                        thread::ThreadPool* thread_pool, Result* result);
+
 // TODO(mrry): Move the hash table construction into the config object.
 typedef FastParseExampleConfig FastParseSingleExampleConfig;
 
@@ -15,12 +15,15 @@ limitations under the License.
 
 #include "tensorflow/core/util/example_proto_fast_parsing.h"
 
+#include <memory>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "absl/strings/match.h"
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature.pb.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/platform/protobuf.h"
@@ -255,6 +258,23 @@ static string ExampleWithSomeFeatures() {
 
 TEST(FastParse, SomeFeatures) { TestCorrectness(ExampleWithSomeFeatures()); }
 
+TEST(FastParse, PackedInt64OfAllVarintLengths) {
+  Example example;
+  Int64List* int64_list =
+      (*example.mutable_features()->mutable_feature())["int64_list"]
+          .mutable_int64_list();
+  // Runs of one-byte varints interleaved with every other varint length,
+  // including the 10-byte encoding of negative values.
+  for (int i = 0; i < 20; ++i) int64_list->add_value(i);
+  for (int bits = 0; bits < 64; ++bits) {
+    int64_list->add_value(int64_t{1} << bits);
+    int64_list->add_value((int64_t{1} << bits) - 1);
+    int64_list->add_value(-(int64_t{1} << bits));
+    int64_list->add_value(bits);
+  }
+  TestCorrectness(Serialize(example));
+}
+
 static void AddDenseFeature(const char* feature_name, DataType dtype,
                             PartialTensorShape shape, bool variable_length,
                             size_t elements_per_stride,
@@ -429,6 +449,158 @@ TEST(TestFastParseExample, Empty) {
   EXPECT_TRUE(status.ok()) << status;
 }
 
+FastParseExampleConfig ConfigWithManyFeatures(int num_features) {
+  FastParseExampleConfig config;
+  for (int i = 0; i < num_features; ++i) {
+    const string name = strings::StrCat("feature_", i);
+    switch (i % 3) {
+      case 0:
+        config.dense.emplace_back(name, DT_INT64, PartialTensorShape({}),
+                                  Tensor(int64_t{-1}),
+                                  /*variable_length=*/false,
+                                  /*elements_per_stride=*/1);
+        break;
+      case 1:
+        config.sparse.emplace_back(name, DT_FLOAT);
+        break;
+      case 2:
+        config.ragged.emplace_back(name, DT_STRING, DT_INT64);
+        break;
+    }
+  }
+  return config;
+}
+
+TEST(FastParseExamplePlan, FindsEveryFeature) {
+  const FastParseExampleConfig config = ConfigWithManyFeatures(500);
+  std::unique_ptr<FastParseExamplePlan> plan;
+  TF_ASSERT_OK(FastParseExamplePlan::Compile(config, &plan));
+  for (size_t d = 0; d < config.dense.size(); ++d) {
+    const FastParseExamplePlan::Feature* feature =
+        plan->Find(config.dense[d].feature_name);
+    ASSERT_NE(feature, nullptr);
+    EXPECT_EQ(feature->type, FastParseExamplePlan::FeatureType::kDense);
+    EXPECT_EQ(feature->index, d);
+  }
+  for (size_t d = 0; d < config.sparse.size(); ++d) {
+    const FastParseExamplePlan::Feature* feature =
+        plan->Find(config.sparse[d].feature_name);
+    ASSERT_NE(feature, nullptr);
+    EXPECT_EQ(feature->type, FastParseExamplePlan::FeatureType::kSparse);
+    EXPECT_EQ(feature->index, d);
+  }
+  for (size_t d = 0; d < config.ragged.size(); ++d) {
+    const FastParseExamplePlan::Feature* feature =
+        plan->Find(config.ragged[d].feature_name);
+    ASSERT_NE(feature, nullptr);
+    EXPECT_EQ(feature->type, FastParseExamplePlan::FeatureType::kRagged);
+    EXPECT_EQ(feature->index, d);
+  }
+  EXPECT_EQ(plan->Find(""), nullptr);
+  EXPECT_EQ(plan->Find("feature_"), nullptr);
+  EXPECT_EQ(plan->Find("feature_500"), nullptr);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(plan->Find(strings::StrCat("absent_", i)), nullptr);
+  }
+}
+
+TEST(FastParseExamplePlan, EmptyConfig) {
+  std::unique_ptr<FastParseExamplePlan> plan;
+  TF_ASSERT_OK(FastParseExamplePlan::Compile(FastParseExampleConfig(), &plan));
+  EXPECT_EQ(plan->Find(""), nullptr);
+  EXPECT_EQ(plan->Find("test"), nullptr);
+  EXPECT_TRUE(plan->Matches(FastParseExampleConfig()));
+}
+
+TEST(FastParseExamplePlan, RejectsDuplicateNames) {
+  FastParseExampleConfig config;
+  config.sparse.push_back({"a", DT_STRING});
+  config.ragged.push_back({"a", DT_INT64, DT_INT64});
+  std::unique_ptr<FastParseExamplePlan> plan;
+  EXPECT_FALSE(FastParseExamplePlan::Compile(config, &plan).ok());
+}
+
+TEST(FastParseExamplePlan, Matches) {
+  const FastParseExampleConfig config = ConfigWithManyFeatures(10);
+  std::unique_ptr<FastParseExamplePlan> plan;
+  TF_ASSERT_OK(FastParseExamplePlan::Compile(config, &plan));
+  EXPECT_TRUE(plan->Matches(config));
+
+  FastParseExampleConfig other_defaults = config;
+  other_defaults.dense[0].default_value = Tensor(int64_t{7});
+  EXPECT_TRUE(plan->Matches(other_defaults));
+
+  FastParseExampleConfig other_dtype = config;
+  other_dtype.sparse[0].dtype = DT_INT64;
+  EXPECT_FALSE(plan->Matches(other_dtype));
+
+  FastParseExampleConfig reordered = config;
+  std::swap(reordered.sparse[0], reordered.sparse[1]);
+  EXPECT_FALSE(plan->Matches(reordered));
+
+  FastParseExampleConfig extra = config;
+  extra.sparse.push_back({"extra", DT_FLOAT});
+  EXPECT_FALSE(plan->Matches(extra));
+
+  FastParseExampleConfig renamed = config;
+  renamed.ragged[0].feature_name = "renamed";
+  EXPECT_FALSE(plan->Matches(renamed));
+}
+
+TEST(TestFastParseExample, PlanIsReusedAcrossDefaults) {
+  Example example;
+  auto& features = *example.mutable_features()->mutable_feature();
+  features["present"].mutable_int64_list()->add_value(300);
+  features["values"].mutable_int64_list()->add_value(1);
+  features["values"].mutable_int64_list()->add_value(-2);
+  features["unrequested"].mutable_float_list()->add_value(1.0);
+  const std::vector<tstring> serialized = {Serialize(example),
+                                           Serialize(Example())};
+
+  FastParseExampleConfig config;
+  config.dense.emplace_back("present", DT_INT64, PartialTensorShape({}),
+                            Tensor(int64_t{0}), /*variable_length=*/false,
+                            /*elements_per_stride=*/1);
+  config.sparse.push_back({"values", DT_INT64});
+  std::unique_ptr<FastParseExamplePlan> plan;
+  TF_ASSERT_OK(FastParseExamplePlan::Compile(config, &plan));
+
+  for (int64_t default_value : {-1, 42}) {
+    config.dense[0].default_value = Tensor(default_value);
+    Result result;
+    TF_ASSERT_OK(FastParseExample(config, *plan, serialized,
+                                  absl::Span<const tstring>(), nullptr,
+                                  &result));
+    ASSERT_EQ(result.dense_values.size(), 1);
+    EXPECT_EQ(result.dense_values[0].flat<int64_t>()(0), 300);
+    EXPECT_EQ(result.dense_values[0].flat<int64_t>()(1), default_value);
+    ASSERT_EQ(result.sparse_values.size(), 1);
+    ASSERT_EQ(result.sparse_values[0].NumElements(), 2);
+    EXPECT_EQ(result.sparse_values[0].flat<int64_t>()(0), 1);
+    EXPECT_EQ(result.sparse_values[0].flat<int64_t>()(1), -2);
+  }
+}
+
+TEST(TestFastParseExample, DenseInt64ShapeMismatch) {
+  Example example;
+  auto* values = (*example.mutable_features()->mutable_feature())["dense"]
+                     .mutable_int64_list();
+  for (int i = 0; i < 20; ++i) values->add_value(i * 1000);
+  const std::vector<tstring> serialized = {Serialize(example)};
+
+  FastParseExampleConfig config;
+  config.dense.emplace_back("dense", DT_INT64, PartialTensorShape({8}),
+                            Tensor(), /*variable_length=*/false,
+                            /*elements_per_stride=*/8);
+  Result result;
+  const Status status =
+      FastParseExample(config, serialized, absl::Span<const tstring>(),
+                       nullptr, &result);
+  EXPECT_FALSE(status.ok());
+  EXPECT_TRUE(absl::StrContains(status.message(), "Values size: 20"))
+      << status;
+}
+
 }  // namespace
 }  // namespace example
 }  // namespace tensorflow
@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
@@ -23,6 +24,7 @@ limitations under the License.
 #include "absl/base/call_once.h"
 #include "absl/synchronization/mutex.h"
 #include "xla/tsl/util/byte_swap_array.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
@@ -58,6 +60,9 @@ limitations under the License.
 
 #ifdef PLATFORM_WINDOWS
 #undef DeleteFile
+#else
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 namespace tensorflow {
@@ -84,6 +89,57 @@ const int64_t kMinSectionSize = static_cast<int64_t>(1) << 31;
 
 namespace {
 
+// A buffer that aliases a range of a copy-on-write mapping of a data file.
+// Keeps the mapping alive until every tensor referencing the range is
+// destroyed.
+class MappedTensorBuffer : public TensorBuffer {
+ public:
+  MappedTensorBuffer(std::shared_ptr<ReadOnlyMemoryRegion> region, void* data,
+                     size_t size)
+      : TensorBuffer(data),
+        region_(std::move(region)),
+        size_(size) {}
+
+  size_t size() const override { return size_; }
+  TensorBuffer* root_buffer() override { return this; }
+  void FillAllocationDescription(AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocator_name("BundleReaderMmap");
+  }
+  // The memory belongs to the mapping: never forward it to an op output, so
+  // that in-place updates copy the tensor rather than dirtying the mapping
+  // page by page.
+  bool OwnsMemory() const override { return false; }
+
+ private:
+  const std::shared_ptr<ReadOnlyMemoryRegion> region_;
+  const size_t size_;
+};
+
+// Makes the mapping "region" of the data file "filename" writable. Local files
+// are mapped privately, so a write to a mapped tensor then copies the touched
+// page instead of faulting, and never reaches the file. Returns false if the
+// mapping cannot be made copy-on-write, in which case it must not be used.
+bool MakeMappingCopyOnWrite(const string& filename,
+                            ReadOnlyMemoryRegion* region) {
+#ifdef PLATFORM_WINDOWS
+  return false;
+#else
+  StringPiece scheme, host, path;
+  io::ParseURI(filename, &scheme, &host, &path);
+  // Other file systems may hand out shared mappings or heap memory.
+  if (!scheme.empty() && scheme != "file") return false;
+  if (region->length() == 0) return true;
+  const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  const uintptr_t begin =
+      reinterpret_cast<uintptr_t>(region->data()) & ~(page_size - 1);
+  const uintptr_t end =
+      reinterpret_cast<uintptr_t>(region->data()) + region->length();
+  return mprotect(reinterpret_cast<void*>(begin), end - begin,
+                  PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
 // Reads "num_elements" string elements from file[offset, offset+size) into the
 // length-N "destination".  Discards the original content of "destination".
 //
@@ -785,7 +841,9 @@ BundleReader::BundleReader(Env* env, StringPiece prefix, Options options)
       iter_(nullptr),
       need_to_swap_bytes_(false),
       enable_multi_threading_for_testing_(
-          options.enable_multi_threading_for_testing) {
+          options.enable_multi_threading_for_testing),
+      use_mmap_(options.use_mmap),
+      verify_mapped_checksums_(options.verify_mapped_checksums) {
   if (cache_ == nullptr) {
     // Make a cache for use just by this BundleReader.
     owned_cache_ = std::make_unique<BundleCache>(env);
@@ -878,8 +936,26 @@ Status BundleReader::GetBundleEntryProto(StringPiece key,
 }
 
 Status BundleReader::GetValue(const BundleEntryProto& entry, Tensor* val) {
-  Tensor* ret = val;
   const TensorShape stored_shape(TensorShape(entry.shape()));
+  if (use_mmap_ && DataTypeCanUseMemcpy(entry.dtype()) &&
+      !need_to_swap_bytes_) {
+    // Mapped tensors do not need a buffer: try mapping before allocating one.
+    // A preallocated "val" is only replaced if it describes the same tensor.
+    const bool preallocated = val->NumElements() != 0;
+    if (preallocated && val->dtype() != entry.dtype()) {
+      return errors::InvalidArgument(
+          "Cannot restore tensor ", key(), " of type ",
+          DataTypeString(entry.dtype()), " into a tensor of type ",
+          DataTypeString(val->dtype()));
+    }
+    if (!preallocated || val->shape() == stored_shape) {
+      bool mapped = false;
+      TF_RETURN_IF_ERROR(GetMappedValue(entry, stored_shape, val, &mapped));
+      if (mapped) return absl::OkStatus();
+    }
+  }
+
+  Tensor* ret = val;
   if (val->NumElements() == 0) {
     ret = new Tensor(entry.dtype(), stored_shape);
   }
@@ -1019,6 +1095,72 @@ Status BundleReader::GetValue(const BundleEntryProto& entry, Tensor* val) {
   return absl::OkStatus();
 }
 
+Status BundleReader::GetMappedValue(const BundleEntryProto& entry,
+                                    const TensorShape& shape, Tensor* val,
+                                    bool* mapped) {
+  *mapped = false;
+  auto it = mapped_data_.find(entry.shard_id());
+  if (it == mapped_data_.end()) {
+    const string filename =
+        DataFilename(prefix_, entry.shard_id(), num_shards_);
+    std::unique_ptr<ReadOnlyMemoryRegion> region;
+    Status s = env_->NewReadOnlyMemoryRegionFromFile(filename, &region);
+    if (errors::IsUnimplemented(s)) {
+      VLOG(1) << "Memory-mapping is not supported for " << prefix_
+              << "; falling back to regular reads: " << s;
+    } else {
+      TF_RETURN_IF_ERROR(s);
+      if (!MakeMappingCopyOnWrite(filename, region.get())) {
+        VLOG(1) << "Cannot map " << filename
+                << " copy-on-write; falling back to regular reads.";
+        region.reset();
+      }
+    }
+    it = mapped_data_.emplace(entry.shard_id(), std::move(region)).first;
+  }
+  const std::shared_ptr<ReadOnlyMemoryRegion>& region = it->second;
+  if (region == nullptr || entry.size() == 0) return absl::OkStatus();
+
+  const int64_t expected_size =
+      shape.num_elements() * DataTypeSize(entry.dtype());
+  if (entry.size() != expected_size) {
+    return errors::DataLoss("Invalid size in bundle entry: key ", key(),
+                            "; stored size ", entry.size(),
+                            "; expected size ", expected_size);
+  }
+
+  if (entry.offset() < 0 || entry.offset() > region->length() ||
+      entry.size() > region->length() - entry.offset()) {
+    return errors::DataLoss("TensorBundle at ", prefix_, " shard ",
+                            entry.shard_id(), ": entry at offset ",
+                            entry.offset(), " of ", entry.size(),
+                            " bytes exceeds the data file size ",
+                            region->length());
+  }
+  char* data = const_cast<char*>(static_cast<const char*>(region->data())) +
+               entry.offset();
+  if (reinterpret_cast<uintptr_t>(data) % EIGEN_MAX_ALIGN_BYTES != 0) {
+    // Tensors must be aligned; see `BundleWriter::Options::data_alignment`.
+    return absl::OkStatus();
+  }
+  if (verify_mapped_checksums_) {
+    const uint32 actual_crc32c = crc32c::Value(data, entry.size());
+    if (crc32c::Unmask(entry.crc32c()) != actual_crc32c) {
+      return errors::DataLoss(
+          "TensorBundle at ", prefix_, " shard ", entry.shard_id(), " (",
+          entry.size(), " bytes): Checksum does not match: stored ",
+          strings::Printf("%08u", crc32c::Unmask(entry.crc32c())),
+          " vs. calculated on the mapped bytes ", actual_crc32c);
+    }
+  }
+
+  auto* buf = new MappedTensorBuffer(region, data, entry.size());
+  *val = Tensor(entry.dtype(), shape, buf);
+  buf->Unref();
+  *mapped = true;
+  return absl::OkStatus();
+}
+
 Status BundleReader::Lookup(StringPiece key, Tensor* val) {
   CHECK(val != nullptr);
   BundleEntryProto entry;
@@ -1033,6 +1175,112 @@ Status BundleReader::Lookup(StringPiece key, Tensor* val) {
   }
 }
 
+Status BundleReader::LookupMany(absl::Span<const std::string> keys,
+                                absl::Span<Tensor* const> vals) {
+  CHECK_EQ(keys.size(), vals.size());
+  struct Pending {
+    BundleEntryProto entry;
+    Tensor* val;
+  };
+  std::vector<Pending> pending;
+  pending.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    CHECK(vals[i] != nullptr);
+    BundleEntryProto entry;
+    TF_RETURN_IF_ERROR(GetBundleEntryProto(keys[i], &entry));
+    // Only full numeric tensors whose output buffer is already allocated can
+    // be served from a coalesced read; everything else takes the regular path.
+    if (!entry.slices().empty() || !DataTypeCanUseMemcpy(entry.dtype()) ||
+        need_to_swap_bytes_ || use_mmap_ || entry.size() == 0 ||
+        vals[i]->dtype() != entry.dtype() ||
+        vals[i]->TotalBytes() != entry.size()) {
+      TF_RETURN_IF_ERROR(Lookup(keys[i], vals[i]));
+      continue;
+    }
+    pending.push_back({std::move(entry), vals[i]});
+  }
+  std::stable_sort(pending.begin(), pending.end(),
+                   [](const Pending& a, const Pending& b) {
+                     return std::make_pair(a.entry.shard_id(),
+                                           a.entry.offset()) <
+                            std::make_pair(b.entry.shard_id(),
+                                           b.entry.offset());
+                   });
+
+  // Entries of a group may be separated by at most this many bytes of padding,
+  // which covers the alignment inserted by `BundleWriter`.
+  constexpr int64_t kMaxCoalescedGapBytes = 4096;
+  std::vector<const BundleEntryProto*> group_entries;
+  std::vector<Tensor*> group_vals;
+  size_t begin = 0;
+  while (begin < pending.size()) {
+    const BundleEntryProto& first = pending[begin].entry;
+    size_t end = begin + 1;
+    int64_t group_end = first.offset() + first.size();
+    while (end < pending.size()) {
+      const BundleEntryProto& next = pending[end].entry;
+      if (next.shard_id() != first.shard_id() || next.offset() < group_end ||
+          next.offset() - group_end > kMaxCoalescedGapBytes ||
+          next.offset() + next.size() - first.offset() >
+              kMaxCoalescedReadBytes) {
+        break;
+      }
+      group_end = next.offset() + next.size();
+      ++end;
+    }
+    if (end - begin == 1) {
+      TF_RETURN_IF_ERROR(GetValue(first, pending[begin].val));
+    } else {
+      group_entries.clear();
+      group_vals.clear();
+      for (size_t i = begin; i < end; ++i) {
+        group_entries.push_back(&pending[i].entry);
+        group_vals.push_back(pending[i].val);
+      }
+      TF_RETURN_IF_ERROR(GetCoalescedValues(group_entries, group_vals));
+    }
+    begin = end;
+  }
+  return absl::OkStatus();
+}
+
+Status BundleReader::GetCoalescedValues(
+    absl::Span<const BundleEntryProto* const> entries,
+    absl::Span<Tensor* const> vals) {
+  const BundleEntryProto& first = *entries.front();
+  const BundleEntryProto& last = *entries.back();
+  const int64_t range_offset = first.offset();
+  const size_t range_size = last.offset() + last.size() - range_offset;
+
+  RandomAccessFile* file = nullptr;
+  TF_RETURN_IF_ERROR(cache_->GetFile(
+      DataFilename(prefix_, first.shard_id(), num_shards_), &file));
+  std::unique_ptr<char[]> scratch(new char[range_size]);
+  StringPiece sp;
+  TF_RETURN_IF_ERROR(file->Read(range_offset, range_size, &sp, scratch.get()));
+  if (sp.size() != range_size) {
+    return errors::DataLoss("Requested ", range_size, " bytes but read ",
+                            sp.size(), " bytes from TensorBundle at ", prefix_,
+                            " shard ", first.shard_id());
+  }
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const BundleEntryProto& entry = *entries[i];
+    const char* src = sp.data() + (entry.offset() - range_offset);
+    const uint32 actual_crc32c = crc32c::Value(src, entry.size());
+    if (crc32c::Unmask(entry.crc32c()) != actual_crc32c) {
+      return errors::DataLoss(
+          "TensorBundle at ", prefix_, " shard ", entry.shard_id(), " (",
+          entry.size(), " bytes): Checksum does not match: stored ",
+          strings::Printf("%08u", crc32c::Unmask(entry.crc32c())),
+          " vs. calculated on the restored bytes ", actual_crc32c);
+    }
+    memcpy(const_cast<char*>(vals[i]->tensor_data().data()), src,
+           entry.size());
+  }
+  return absl::OkStatus();
+}
+
 Status BundleReader::ReadCurrent(Tensor* val) {
   CHECK(val != nullptr);
   BundleEntryProto entry;
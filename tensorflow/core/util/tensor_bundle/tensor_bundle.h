@@ -72,6 +72,7 @@ limitations under the License.
 #include "absl/container/flat_hash_map.h"
 #include "absl/functional/function_ref.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/tensor_slice.h"
@@ -117,7 +118,9 @@ class BundleWriter {
   struct Options {
     Options() {}
     // Alignment, in bytes, for tensor data.
-    // Must be >= 1. The default size of 1 densely packs tensors.
+    // Must be >= 1. The default size of 1 densely packs tensors. Set it to
+    // `EIGEN_MAX_ALIGN_BYTES` (or a multiple of it) to let readers created with
+    // `BundleReader::Options::use_mmap` restore tensors without copying.
     int data_alignment{1};
   };
   BundleWriter(Env* env, absl::string_view prefix,
@@ -212,6 +215,19 @@ class BundleReader {
 
     // For tests only.
     bool enable_multi_threading_for_testing = false;
+
+    // If true, local data files are memory-mapped copy-on-write and numeric
+    // tensors whose data is suitably aligned in the file are returned as
+    // tensors that alias the mapping instead of being copied. Pages are only
+    // read from disk when the tensor is first touched. Falls back to regular
+    // reads for other tensors and for files that cannot be mapped
+    // copy-on-write (e.g. on non-local file systems).
+    bool use_mmap = false;
+
+    // If false, mapped tensors skip the crc32c check, which would otherwise
+    // fault in every page of the tensor during restore. Only used if
+    // `use_mmap` is true.
+    bool verify_mapped_checksums = true;
   };
   BundleReader(Env* env, absl::string_view prefix, Options options);
 
@@ -261,9 +277,31 @@ class BundleReader {
   // tensor keyed by "key" does not exist in this bundle.
   //
   // Validates the stored crc32c checksum against the restored bytes.
+  //
+  // If the reader was created with `Options::use_mmap`, "val" may instead be
+  // replaced by a tensor aliasing the memory-mapped data file. The mapping
+  // stays alive as long as that tensor does, even after this reader is
+  // destroyed. The mapping is copy-on-write: writes to such tensors copy the
+  // touched pages and never modify the file.
   // REQUIRES: status().ok()
   Status Lookup(absl::string_view key, Tensor* val) TF_MUST_USE_RESULT;
 
+  // Looks up the tensors keyed by "keys" into "vals", with the same contract
+  // as calling "Lookup()" on each pair in turn.
+  //
+  // Numeric tensors stored next to each other in the same data file are read
+  // with a single large read of up to `kMaxCoalescedReadBytes` and then copied
+  // into their outputs, which is much cheaper than one read per tensor for
+  // checkpoints with many small variables. Keys are best passed in the order
+  // established by "SortForSequentialAccess()".
+  // REQUIRES: status().ok() && keys.size() == vals.size()
+  Status LookupMany(absl::Span<const std::string> keys,
+                    absl::Span<Tensor* const> vals) TF_MUST_USE_RESULT;
+
+  // Upper bound on the size of a single coalesced read issued by
+  // "LookupMany()".
+  static constexpr int64_t kMaxCoalescedReadBytes = 16 << 20;
+
   // Looks up the tensor pointed to by the internal iterator.
   //
   // On error, "val" may contain nonsense data.
@@ -322,6 +360,20 @@ class BundleReader {
   Status GetValue(const BundleEntryProto& entry,
                   Tensor* val) TF_MUST_USE_RESULT;
 
+  // Points "val" at the bytes of "entry" in the memory-mapped data file, as a
+  // tensor of the given "shape". Sets "*mapped" to false, without error, if
+  // the entry cannot be aliased (e.g. it is not suitably aligned), in which
+  // case the caller should fall back to reading it.
+  Status GetMappedValue(const BundleEntryProto& entry, const TensorShape& shape,
+                        Tensor* val, bool* mapped) TF_MUST_USE_RESULT;
+
+  // Reads the values of "entries" into "vals" with a single read of the byte
+  // range spanning them in their data file.
+  // REQUIRES: all entries are memcpy-able, stored in the same shard in
+  // increasing offset order, and "vals" have matching sizes.
+  Status GetCoalescedValues(absl::Span<const BundleEntryProto* const> entries,
+                            absl::Span<Tensor* const> vals) TF_MUST_USE_RESULT;
+
   // Reads the slice described by "slice_spec".  The corresponding full tensor
   // has key "ful_tensor_key" and metadata proto "full_tensor_entry".
   // REQUIRES: full_tensor_entry.slices_size() > 0
@@ -344,6 +396,12 @@ class BundleReader {
   // Owned InputBuffer objects. cache_ owns the underlying RandomAccessFiles.
   std::unordered_map<int32_t, io::InputBuffer*> data_;
 
+  // Memory-mapped data files, shared with the tensors that alias them. A null
+  // entry records that the file system cannot map the shard. Only used if
+  // `use_mmap_` is true.
+  std::unordered_map<int32_t, std::shared_ptr<ReadOnlyMemoryRegion>>
+      mapped_data_;
+
   // Maps each partitioned tensor's key to its stored slices (represented in a
   // TensorSliceSet).  Populated on-demand.
   std::unordered_map<std::string, checkpoint::TensorSliceSet*> tensor_slices_;
@@ -360,6 +418,9 @@ class BundleReader {
 
   bool enable_multi_threading_for_testing_ = false;
 
+  const bool use_mmap_ = false;
+  const bool verify_mapped_checksums_ = true;
+
   BundleReader(const BundleReader&) = delete;
   void operator=(const BundleReader&) = delete;
 };
@@ -24,6 +24,7 @@ limitations under the License.
 #endif  // _WIN32
 
 #include "absl/status/status.h"
+#include "tensorflow/core/framework/tensor_description.pb.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/tensor_util.h"
 #include "tensorflow/core/framework/types.pb.h"
@@ -1270,6 +1271,226 @@ TEST_F(TensorBundleAlignmentTest, AlignmentTest) {
   }
 }
 
+TEST(TensorBundleTest, LookupMany) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = 64;
+    BundleWriter writer(Env::Default(), Prefix("many"), opts);
+    TF_EXPECT_OK(writer.Add("foo_000", Constant_2x3<float>(0)));
+    TF_EXPECT_OK(writer.Add("foo_001", Constant_100x100<int64_t>(1)));
+    TF_EXPECT_OK(writer.Add("foo_002", Constant_2x3<tstring>("two")));
+    TF_EXPECT_OK(writer.Add("foo_003", Constant_2x3<double>(3)));
+    TF_EXPECT_OK(writer.Add("foo_004", Constant_2x3<int32>(4)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  BundleReader reader(Env::Default(), Prefix("many"));
+  TF_ASSERT_OK(reader.status());
+
+  Tensor t0(DT_FLOAT, TensorShape({2, 3}));
+  Tensor t1(DT_INT64, TensorShape({100, 100}));
+  Tensor t2(DT_STRING, TensorShape({2, 3}));
+  Tensor t3(DT_DOUBLE, TensorShape({2, 3}));
+  Tensor t4;  // Allocated by the reader.
+  // Out of order on purpose.
+  TF_ASSERT_OK(reader.LookupMany({"foo_003", "foo_000", "foo_004", "foo_002",
+                                  "foo_001"},
+                                 {&t3, &t0, &t4, &t2, &t1}));
+  test::ExpectTensorEqual<float>(Constant_2x3<float>(0), t0);
+  test::ExpectTensorEqual<int64_t>(Constant_100x100<int64_t>(1), t1);
+  test::ExpectTensorEqual<tstring>(Constant_2x3<tstring>("two"), t2);
+  test::ExpectTensorEqual<double>(Constant_2x3<double>(3), t3);
+  test::ExpectTensorEqual<int32>(Constant_2x3<int32>(4), t4);
+
+  EXPECT_TRUE(
+      errors::IsNotFound(reader.LookupMany({"foo_000", "bar"}, {&t0, &t1})));
+}
+
+TEST(TensorBundleTest, LookupManyDetectsCorruption) {
+  {
+    BundleWriter writer(Env::Default(), Prefix("many_corrupt"));
+    TF_EXPECT_OK(writer.Add("foo_000", Constant_2x3<float>(0)));
+    TF_EXPECT_OK(writer.Add("foo_001", Constant_2x3<float>(1)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  const string data_file = DataFilename(Prefix("many_corrupt"), 0, 1);
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), data_file, &contents));
+  contents[contents.size() - 1] ^= 0x1;
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), data_file, contents));
+
+  BundleReader reader(Env::Default(), Prefix("many_corrupt"));
+  TF_ASSERT_OK(reader.status());
+  Tensor t0(DT_FLOAT, TensorShape({2, 3}));
+  Tensor t1(DT_FLOAT, TensorShape({2, 3}));
+  EXPECT_TRUE(errors::IsDataLoss(
+      reader.LookupMany({"foo_000", "foo_001"}, {&t0, &t1})));
+}
+
+// Returns true if "t" aliases a memory-mapped data file.
+bool IsMapped(const Tensor& t) {
+  TensorDescription description;
+  t.FillDescription(&description);
+  return description.allocation_description().allocator_name() ==
+         "BundleReaderMmap";
+}
+
+TEST(TensorBundleTest, MmapAlignedTensors) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = 64;
+    BundleWriter writer(Env::Default(), Prefix("mmap"), opts);
+    TF_EXPECT_OK(writer.Add("foo_000", Constant_2x3<float>(0)));
+    TF_EXPECT_OK(writer.Add("foo_001", Constant_100x100<int64_t>(1)));
+    TF_EXPECT_OK(writer.Add("foo_002", Constant_2x3<tstring>("two")));
+    TF_EXPECT_OK(writer.Add("foo_003", Constant_2x3<double>(3)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  Tensor mapped;
+  {
+    BundleReader::Options options;
+    options.use_mmap = true;
+    BundleReader reader(Env::Default(), Prefix("mmap"), options);
+    TF_ASSERT_OK(reader.status());
+    Expect<float>(&reader, "foo_000", Constant_2x3<float>(0));
+    Expect<int64_t>(&reader, "foo_001", Constant_100x100<int64_t>(1));
+    Expect<tstring>(&reader, "foo_002", Constant_2x3<tstring>("two"));
+    Expect<double>(&reader, "foo_003", Constant_2x3<double>(3));
+
+    TF_ASSERT_OK(reader.Lookup("foo_001", &mapped));
+    EXPECT_TRUE(IsMapped(mapped));
+    Tensor str(DT_STRING, TensorShape({2, 3}));
+    TF_ASSERT_OK(reader.Lookup("foo_002", &str));
+    EXPECT_FALSE(IsMapped(str));
+  }
+  // The mapping outlives the reader.
+  test::ExpectTensorEqual<int64_t>(Constant_100x100<int64_t>(1), mapped);
+}
+
+TEST(TensorBundleTest, MmapTensorsAreCopyOnWrite) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = 64;
+    BundleWriter writer(Env::Default(), Prefix("mmap_cow"), opts);
+    TF_EXPECT_OK(writer.Add("foo", Constant_100x100<float>(1)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  BundleReader::Options options;
+  options.use_mmap = true;
+  {
+    BundleReader reader(Env::Default(), Prefix("mmap_cow"), options);
+    Tensor mapped;
+    TF_ASSERT_OK(reader.Lookup("foo", &mapped));
+    ASSERT_TRUE(IsMapped(mapped));
+    // In-place optimizations must not treat the mapping as owned memory.
+    EXPECT_FALSE(mapped.RefCountIsOne());
+    // Writes do not fault, and are private to the mapping.
+    mapped.flat<float>().setConstant(2);
+    test::ExpectTensorEqual<float>(Constant_100x100<float>(2), mapped);
+  }
+  BundleReader reader(Env::Default(), Prefix("mmap_cow"), options);
+  Expect<float>(&reader, "foo", Constant_100x100<float>(1));
+}
+
+TEST(TensorBundleTest, MmapChecksPreallocatedTensors) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = 64;
+    BundleWriter writer(Env::Default(), Prefix("mmap_preallocated"), opts);
+    TF_EXPECT_OK(writer.Add("foo", Constant_100x100<float>(1)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  BundleReader::Options options;
+  options.use_mmap = true;
+  BundleReader reader(Env::Default(), Prefix("mmap_preallocated"), options);
+
+  Tensor wrong_dtype(DT_INT32, TensorShape({100, 100}));
+  EXPECT_TRUE(errors::IsInvalidArgument(reader.Lookup("foo", &wrong_dtype)));
+  EXPECT_EQ(wrong_dtype.dtype(), DT_INT32);
+
+  Tensor wrong_shape(DT_FLOAT, TensorShape({10, 10}));
+  EXPECT_FALSE(reader.Lookup("foo", &wrong_shape).ok());
+  EXPECT_EQ(wrong_shape.shape(), TensorShape({10, 10}));
+  EXPECT_FALSE(IsMapped(wrong_shape));
+
+  Tensor matching(DT_FLOAT, TensorShape({100, 100}));
+  TF_ASSERT_OK(reader.Lookup("foo", &matching));
+  EXPECT_TRUE(IsMapped(matching));
+  test::ExpectTensorEqual<float>(Constant_100x100<float>(1), matching);
+}
+
+TEST(TensorBundleTest, MmapFallsBackForUnalignedTensors) {
+  {
+    BundleWriter writer(Env::Default(), Prefix("mmap_unaligned"));
+    TF_EXPECT_OK(writer.Add("foo_000", Constant(true, TensorShape({1}))));
+    TF_EXPECT_OK(writer.Add("foo_001", Constant_2x3<float>(1)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  BundleReader::Options options;
+  options.use_mmap = true;
+  BundleReader reader(Env::Default(), Prefix("mmap_unaligned"), options);
+  TF_ASSERT_OK(reader.status());
+  Expect<bool>(&reader, "foo_000", Constant(true, TensorShape({1})));
+  Tensor val;
+  TF_ASSERT_OK(reader.Lookup("foo_001", &val));
+  test::ExpectTensorEqual<float>(Constant_2x3<float>(1), val);
+  EXPECT_FALSE(IsMapped(val));
+}
+
+TEST(TensorBundleTest, MmapDetectsCorruption) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = 64;
+    BundleWriter writer(Env::Default(), Prefix("mmap_corrupt"), opts);
+    TF_EXPECT_OK(writer.Add("foo_000", Constant_2x3<float>(1)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  const string data_file = DataFilename(Prefix("mmap_corrupt"), 0, 1);
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), data_file, &contents));
+  contents[1] ^= 0x1;
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), data_file, contents));
+
+  BundleReader::Options options;
+  options.use_mmap = true;
+  {
+    BundleReader reader(Env::Default(), Prefix("mmap_corrupt"), options);
+    TF_ASSERT_OK(reader.status());
+    Tensor val;
+    EXPECT_TRUE(errors::IsDataLoss(reader.Lookup("foo_000", &val)));
+  }
+  options.verify_mapped_checksums = false;
+  {
+    BundleReader reader(Env::Default(), Prefix("mmap_corrupt"), options);
+    TF_ASSERT_OK(reader.status());
+    Tensor val;
+    TF_EXPECT_OK(reader.Lookup("foo_000", &val));
+  }
+}
+
+static void BM_BundleMmapRestore(::testing::benchmark::State& state) {
+  const bool use_mmap = state.range(0);
+  const int tensor_size = state.range(1);
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = 64;
+    BundleWriter writer(Env::Default(), Prefix("mmap_bench"), opts);
+    TF_CHECK_OK(writer.Add("big", Constant(32.1f, TensorShape({tensor_size}))));
+    TF_CHECK_OK(writer.Finish());
+  }
+  BundleReader::Options options;
+  options.use_mmap = use_mmap;
+  options.verify_mapped_checksums = false;
+  BundleReader reader(Env::Default(), Prefix("mmap_bench"), options);
+  TF_CHECK_OK(reader.status());
+  for (auto s : state) {
+    Tensor t;
+    TF_CHECK_OK(reader.Lookup("big", &t));
+  }
+  state.SetBytesProcessed(state.iterations() * tensor_size * sizeof(float));
+}
+
+BENCHMARK(BM_BundleMmapRestore)->ArgPair(0, 1048576)->ArgPair(1, 1048576);
+
 static void BM_BundleAlignment(::testing::benchmark::State& state) {
   {
     const int alignment = state.range(0);
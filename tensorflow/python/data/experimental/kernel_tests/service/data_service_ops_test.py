@@ -1317,7 +1317,7 @@ class DataServiceOpsGrpcDataTransferTest(
   @combinations.generate(
       combinations.times(
           test_base.default_test_combinations(),
-          combinations.combine(compression=[None, "AUTO"]),
+          combinations.combine(compression=[None, "AUTO", "ZSTD", "ADAPTIVE"]),
       )
   )
   def testDistributeCompression(self, compression):
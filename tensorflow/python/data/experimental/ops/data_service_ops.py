@@ -39,7 +39,15 @@ from tensorflow.python.saved_model import nested_structure_coder
 from tensorflow.python.util.tf_export import tf_export
 
 COMPRESSION_AUTO = "AUTO"
+COMPRESSION_ZSTD = "ZSTD"
+COMPRESSION_ADAPTIVE = "ADAPTIVE"
 COMPRESSION_NONE = None
+# Values of the `codec` attr of `CompressElement` for each compression.
+_COMPRESSION_CODECS = {
+    COMPRESSION_AUTO: "snappy",
+    COMPRESSION_ZSTD: "zstd",
+    COMPRESSION_ADAPTIVE: "adaptive",
+}
 _PARALLEL_EPOCHS = "parallel_epochs"
 _DISTRIBUTED_EPOCH = "distributed_epoch"
 
@@ -183,7 +191,10 @@ def _validate_job_name(job_name) -> None:
 
 
 def _validate_compression(compression) -> None:
-  valid_compressions = [COMPRESSION_AUTO, COMPRESSION_NONE]
+  valid_compressions = [
+      COMPRESSION_AUTO, COMPRESSION_ZSTD, COMPRESSION_ADAPTIVE,
+      COMPRESSION_NONE
+  ]
   if compression not in valid_compressions:
     raise ValueError(f"Invalid `compression` argument: {compression}. "
                      f"Must be one of {valid_compressions}.")
@@ -191,12 +202,13 @@ def _validate_compression(compression) -> None:
 
 def _get_compression_proto(
     compression) -> data_service_pb2.DataServiceMetadata.Compression:
-  if compression == COMPRESSION_AUTO:
+  if compression in _COMPRESSION_CODECS:
     return data_service_pb2.DataServiceMetadata.COMPRESSION_SNAPPY
   if compression == COMPRESSION_NONE:
     return data_service_pb2.DataServiceMetadata.COMPRESSION_OFF
-  raise ValueError(f"Invalid `compression` argument: {compression}. "
-                   f"Must be one of {[COMPRESSION_AUTO, COMPRESSION_NONE]}.")
+  raise ValueError(
+      f"Invalid `compression` argument: {compression}. Must be one of "
+      f"{[*_COMPRESSION_CODECS, COMPRESSION_NONE]}.")
 
 
 def _to_tensor(dataset_id) -> tensor.Tensor:
@@ -492,7 +504,9 @@ def _distribute(
       at runtime.
     compression: How to compress the dataset's elements before transferring them
       over the network. "AUTO" leaves the decision of how to compress up to the
-      tf.data service runtime. `None` indicates not to compress.
+      tf.data service runtime. "ZSTD" compresses with zstd. "ADAPTIVE" picks a
+      codec from measurements on the dataset's elements. `None` indicates not
+      to compress.
     cross_trainer_cache: (Optional.) If a `CrossTrainerCache` object is
       provided, dataset iteration will be shared across concurrently running
       trainers. See
@@ -751,7 +765,9 @@ def distribute(
       at runtime.
     compression: How to compress the dataset's elements before transferring them
       over the network. "AUTO" leaves the decision of how to compress up to the
-      tf.data service runtime. `None` indicates not to compress.
+      tf.data service runtime. "ZSTD" compresses with zstd. "ADAPTIVE" picks a
+      codec from measurements on the dataset's elements. `None` indicates not
+      to compress.
     cross_trainer_cache: (Optional.) If a `CrossTrainerCache` object is
       provided, dataset iteration will be shared across concurrently running
       trainers. See
@@ -799,7 +815,9 @@ def _register_dataset(
     dataset: A `tf.data.Dataset` to register with the tf.data service.
     compression: How to compress the dataset's elements before transferring them
       over the network. "AUTO" leaves the decision of how to compress up to the
-      tf.data service runtime. `None` indicates not to compress.
+      tf.data service runtime. "ZSTD" compresses with zstd. "ADAPTIVE" picks a
+      codec from measurements on the dataset's elements. `None` indicates not
+      to compress.
     dataset_id: (Optional.) By default, tf.data service generates a unique
       (string) ID for each registered dataset. If a `dataset_id` is provided, it
       will use the specified ID. If a dataset with a matching ID already exists,
@@ -825,9 +843,10 @@ def _register_dataset(
     encoded_spec = nested_structure_coder.encode_structure(
         dataset.element_spec).SerializeToString()
 
-  if compression == COMPRESSION_AUTO:
+  if compression != COMPRESSION_NONE:
+    codec = _COMPRESSION_CODECS[compression]
     dataset = dataset.map(
-        lambda *x: compression_ops.compress(x),
+        lambda *x: compression_ops.compress(x, codec=codec),
         num_parallel_calls=dataset_ops.AUTOTUNE)
   dataset = dataset._apply_debug_options()  # pylint: disable=protected-access
 
@@ -885,8 +904,9 @@ def register_dataset(
     dataset: A `tf.data.Dataset` to register with the tf.data service.
     compression: (Optional.) How to compress the dataset's elements before
       transferring them over the network. "AUTO" leaves the decision of how to
-      compress up to the tf.data service runtime. `None` indicates not to
-      compress.
+      compress up to the tf.data service runtime. "ZSTD" compresses with zstd.
+      "ADAPTIVE" picks a codec from measurements on the dataset's elements.
+      `None` indicates not to compress.
     dataset_id: (Optional.) By default, tf.data service generates a unique
       (string) ID for each registered dataset. If a `dataset_id` is provided, it
       will use the specified ID. If a dataset with a matching ID already exists,
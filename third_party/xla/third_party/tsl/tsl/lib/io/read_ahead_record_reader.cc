@@ -0,0 +1,283 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tsl/lib/io/read_ahead_record_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "tsl/lib/hash/crc32c.h"
+#include "tsl/lib/io/record_reader.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/file_system.h"
+#include "tsl/platform/raw_coding.h"
+
+namespace tsl {
+namespace io {
+namespace {
+
+// Byte ranges shorter than this are copied into the record instead of being
+// referenced, because a Cord node referencing external memory costs more than
+// the copy.
+constexpr size_t kMinExternalBytes = 512;
+
+void CopyCordToArray(const absl::Cord& cord, char* dst) {
+  for (absl::string_view piece : cord.Chunks()) {
+    std::memcpy(dst, piece.data(), piece.size());
+    dst += piece.size();
+  }
+}
+
+inline const char* GetChecksumErrorSuffix(uint64 offset) {
+  if (offset == 0) {
+    return " (Is this even a TFRecord file?)";
+  }
+  return "";
+}
+
+}  // namespace
+
+struct ReadAheadRecordReader::Chunk {
+  explicit Chunk(uint64 offset, size_t capacity)
+      : offset(offset), data(new char[capacity]) {}
+
+  const uint64 offset;
+  std::unique_ptr<char[]> data;
+  // The fields below are written by `ReadChunk()` under `mu_` and are
+  // immutable once `done` is true.
+  size_t size = 0;
+  absl::Status status;
+  bool done = false;
+};
+
+ReadAheadRecordReader::ReadAheadRecordReader(
+    Env* env, RandomAccessFile* file, uint64 offset,
+    const ReadAheadRecordReaderOptions& options)
+    : env_(env),
+      file_(file),
+      options_(options),
+      offset_(offset),
+      next_read_offset_(offset) {
+  DCHECK_GT(options_.read_size, 0);
+  DCHECK_GT(options_.max_reads_in_flight, 0);
+  io_pool_ = std::make_unique<thread::ThreadPool>(
+      env_, "read_ahead_record_reader_io",
+      std::max(1, options_.num_io_threads));
+  {
+    mutex_lock l(mu_);
+    ScheduleReadsLocked();
+  }
+  decode_thread_.reset(env_->StartThread(
+      ThreadOptions(), "read_ahead_record_reader_decode",
+      [this]() { DecodeLoop(); }));
+}
+
+ReadAheadRecordReader::~ReadAheadRecordReader() {
+  {
+    mutex_lock l(mu_);
+    cancelled_ = true;
+    chunk_cv_.notify_all();
+    space_cv_.notify_all();
+  }
+  // Joins the decoding thread, then waits for outstanding reads.
+  decode_thread_.reset();
+  io_pool_.reset();
+}
+
+void ReadAheadRecordReader::ScheduleReadsLocked() {
+  while (!eof_reached_ && !cancelled_ &&
+         chunks_.size() < static_cast<size_t>(options_.max_reads_in_flight)) {
+    auto chunk = std::make_shared<Chunk>(next_read_offset_, options_.read_size);
+    next_read_offset_ += options_.read_size;
+    chunks_.push_back(chunk);
+    io_pool_->Schedule(
+        [this, chunk = std::move(chunk)]() mutable { ReadChunk(chunk); });
+  }
+}
+
+void ReadAheadRecordReader::ReadChunk(std::shared_ptr<Chunk> chunk) {
+  absl::string_view result;
+  absl::Status s = file_->Read(chunk->offset, options_.read_size, &result,
+                               chunk->data.get());
+  if (errors::IsOutOfRange(s)) {
+    // A short read marks the end of the file.
+    s = absl::OkStatus();
+  }
+  if (s.ok() && !result.empty() && result.data() != chunk->data.get()) {
+    // Some file systems return a pointer into their own memory.
+    std::memmove(chunk->data.get(), result.data(), result.size());
+  }
+  mutex_lock l(mu_);
+  chunk->size = result.size();
+  chunk->status = s;
+  chunk->done = true;
+  chunk_cv_.notify_all();
+}
+
+absl::Status ReadAheadRecordReader::WaitForCurrentChunk(
+    std::shared_ptr<Chunk>* chunk) {
+  mutex_lock l(mu_);
+  while (true) {
+    if (cancelled_) {
+      return errors::Cancelled("ReadAheadRecordReader was destroyed");
+    }
+    DCHECK(!chunks_.empty());
+    std::shared_ptr<Chunk>& front = chunks_.front();
+    while (!front->done && !cancelled_) {
+      chunk_cv_.wait(l);
+    }
+    if (cancelled_) continue;
+    TF_RETURN_IF_ERROR(front->status);
+    const bool is_last =
+        static_cast<int64_t>(front->size) < options_.read_size;
+    if (is_last) eof_reached_ = true;
+    if (chunk_pos_ < front->size || is_last) {
+      *chunk = front;
+      return absl::OkStatus();
+    }
+    // The cursor is at the end of a full chunk: move on to the next one.
+    chunks_.pop_front();
+    chunk_pos_ = 0;
+    ScheduleReadsLocked();
+  }
+}
+
+absl::Status ReadAheadRecordReader::TakeBytes(size_t n, absl::Cord* out) {
+  while (n > 0) {
+    std::shared_ptr<Chunk> chunk;
+    TF_RETURN_IF_ERROR(WaitForCurrentChunk(&chunk));
+    const size_t available = chunk->size - chunk_pos_;
+    if (available == 0) {
+      return errors::OutOfRange("eof");
+    }
+    const size_t k = std::min(n, available);
+    absl::string_view bytes(chunk->data.get() + chunk_pos_, k);
+    if (k < kMinExternalBytes) {
+      out->Append(bytes);
+    } else {
+      out->Append(absl::MakeCordFromExternal(bytes, [chunk]() {}));
+    }
+    chunk_pos_ += k;
+    n -= k;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ReadAheadRecordReader::DecodeRecord(uint64 offset,
+                                                 Record* record) {
+  // Header: length and masked crc of length.
+  absl::Cord header;
+  absl::Status s = TakeBytes(RecordReader::kHeaderSize, &header);
+  if (!s.ok()) {
+    if (errors::IsOutOfRange(s) && !header.empty()) {
+      return errors::DataLoss("truncated record at ", offset,
+                              GetChecksumErrorSuffix(offset));
+    }
+    return s;
+  }
+  char header_bytes[RecordReader::kHeaderSize];
+  CopyCordToArray(header, header_bytes);
+  const uint32 masked_length_crc =
+      core::DecodeFixed32(header_bytes + sizeof(uint64));
+  if (crc32c::Unmask(masked_length_crc) !=
+      crc32c::Value(header_bytes, sizeof(uint64))) {
+    return errors::DataLoss("corrupted record at ", offset,
+                            GetChecksumErrorSuffix(offset));
+  }
+  const uint64 length = core::DecodeFixed64(header_bytes);
+
+  // Data and masked crc of data.
+  absl::Cord footer;
+  s = TakeBytes(length, &record->data);
+  if (s.ok()) s = TakeBytes(RecordReader::kFooterSize, &footer);
+  if (!s.ok()) {
+    if (errors::IsOutOfRange(s)) {
+      return errors::DataLoss("truncated record at ", offset);
+    }
+    return s;
+  }
+  char footer_bytes[RecordReader::kFooterSize];
+  CopyCordToArray(footer, footer_bytes);
+  if (crc32c::Unmask(core::DecodeFixed32(footer_bytes)) !=
+      crc32c::Value(record->data)) {
+    return errors::DataLoss("corrupted record at ", offset,
+                            GetChecksumErrorSuffix(offset));
+  }
+  record->end_offset = offset + RecordReader::kHeaderSize + length +
+                       RecordReader::kFooterSize;
+  return absl::OkStatus();
+}
+
+void ReadAheadRecordReader::DecodeLoop() {
+  uint64 offset = offset_;
+  absl::Status s;
+  while (true) {
+    Record record;
+    s = DecodeRecord(offset, &record);
+    if (!s.ok()) break;
+    offset = record.end_offset;
+
+    mutex_lock l(mu_);
+    while (buffered_record_bytes_ >= options_.max_buffered_record_bytes &&
+           !records_.empty() && !cancelled_) {
+      space_cv_.wait(l);
+    }
+    if (cancelled_) break;
+    buffered_record_bytes_ += record.data.size();
+    records_.push_back(std::move(record));
+    record_cv_.notify_one();
+  }
+  mutex_lock l(mu_);
+  decoder_status_ = s;
+  decoder_done_ = true;
+  record_cv_.notify_all();
+}
+
+absl::Status ReadAheadRecordReader::ReadRecord(absl::Cord* record) {
+  mutex_lock l(mu_);
+  while (records_.empty() && !decoder_done_) {
+    record_cv_.wait(l);
+  }
+  if (records_.empty()) {
+    return decoder_status_;
+  }
+  Record& front = records_.front();
+  buffered_record_bytes_ -= front.data.size();
+  *record = std::move(front.data);
+  offset_ = front.end_offset;
+  records_.pop_front();
+  space_cv_.notify_one();
+  return absl::OkStatus();
+}
+
+absl::Status ReadAheadRecordReader::ReadRecord(tstring* record) {
+  absl::Cord cord;
+  TF_RETURN_IF_ERROR(ReadRecord(&cord));
+  record->resize_uninitialized(cord.size());
+  CopyCordToArray(cord, record->mdata());
+  return absl::OkStatus();
+}
+
+absl::Status ReadAheadRecordReader::ReadRecordView(tstring* record) {
+  last_view_.Clear();
+  TF_RETURN_IF_ERROR(ReadRecord(&last_view_));
+  record->assign_as_view(last_view_.Flatten());
+  return absl::OkStatus();
+}
+
+}  // namespace io
+}  // namespace tsl
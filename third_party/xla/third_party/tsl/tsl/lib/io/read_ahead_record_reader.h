@@ -0,0 +1,168 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_TSL_LIB_IO_READ_AHEAD_RECORD_READER_H_
+#define TENSORFLOW_TSL_LIB_IO_READ_AHEAD_RECORD_READER_H_
+
+#include <deque>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/strings/cord.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/mutex.h"
+#include "tsl/platform/thread_annotations.h"
+#include "tsl/platform/threadpool.h"
+#include "tsl/platform/tstring.h"
+#include "tsl/platform/types.h"
+
+namespace tsl {
+class RandomAccessFile;
+
+namespace io {
+
+struct ReadAheadRecordReaderOptions {
+  // Number of bytes requested from the file by each read.
+  int64_t read_size = 4 << 20;
+
+  // Maximum number of reads issued ahead of the decoding cursor. Up to
+  // `read_size * max_reads_in_flight` bytes are buffered by the reader.
+  int max_reads_in_flight = 8;
+
+  // Number of threads issuing reads concurrently.
+  int num_io_threads = 4;
+
+  // Maximum number of bytes of decoded records buffered ahead of the
+  // consumer.
+  int64_t max_buffered_record_bytes = 64 << 20;
+};
+
+// Reads uncompressed TFRecord files sequentially, overlapping I/O, checksum
+// verification and consumption.
+//
+// Large reads of `read_size` bytes are issued ahead of the cursor, several at
+// a time, on a pool of I/O threads. A separate decoding thread frames records
+// out of the read buffers and verifies their CRC32C checksums. Records are
+// handed out as `absl::Cord`s that reference the read buffers directly, so
+// record payloads are never copied; a buffer is released once every record
+// referencing it has been destroyed.
+//
+// Unlike `RecordReader`, which decodes one record per call with small
+// synchronous reads, this reader is intended for high-throughput sequential
+// scans. It does not support compression or seeking.
+//
+// Note: this class is not thread safe; external synchronization required.
+class ReadAheadRecordReader {
+ public:
+  // Creates a reader that returns the records of "*file", starting with the
+  // record at `offset`. "*file" must remain live while this reader is in use.
+  ReadAheadRecordReader(
+      Env* env, RandomAccessFile* file, uint64 offset = 0,
+      const ReadAheadRecordReaderOptions& options =
+          ReadAheadRecordReaderOptions());
+
+  // Cancels outstanding reads and waits for them to complete.
+  ~ReadAheadRecordReader();
+
+  // Reads the next record into *record without copying its payload. Returns
+  // OK on success, OUT_OF_RANGE for end of file, or something else for an
+  // error. Once an error is returned, all subsequent calls return it too.
+  absl::Status ReadRecord(absl::Cord* record);
+
+  // Reads the next record into *record, copying it. Same return values as
+  // above.
+  absl::Status ReadRecord(tstring* record);
+
+  // Like `ReadRecord(tstring*)`, but makes *record a view of the record. The
+  // view is valid until the next call to any `ReadRecord*()` method or until
+  // this reader is destroyed.
+  absl::Status ReadRecordView(tstring* record);
+
+  // Returns the offset of the record that will be returned by the next call to
+  // `ReadRecord()`.
+  uint64 TellOffset() const { return offset_; }
+
+ private:
+  struct Chunk;
+
+  struct Record {
+    absl::Cord data;
+    uint64 end_offset;
+  };
+
+  // Issues reads until `max_reads_in_flight` chunks are ahead of the decoding
+  // cursor or the end of the file has been reached.
+  void ScheduleReadsLocked() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Reads `chunk` from the file. Runs on `io_pool_`.
+  void ReadChunk(std::shared_ptr<Chunk> chunk);
+
+  // Decodes records until the end of the file, an error, or cancellation. Runs
+  // on `decode_thread_`.
+  void DecodeLoop();
+
+  // Decodes the record at `offset`.
+  absl::Status DecodeRecord(uint64 offset, Record* record);
+
+  // Appends the next `n` bytes of the file to `out`. Returns OUT_OF_RANGE if
+  // the end of the file is reached before `n` bytes are read.
+  absl::Status TakeBytes(size_t n, absl::Cord* out);
+
+  // Blocks until the chunk under the decoding cursor has been read.
+  absl::Status WaitForCurrentChunk(std::shared_ptr<Chunk>* chunk);
+
+  Env* const env_;
+  RandomAccessFile* const file_;
+  const ReadAheadRecordReaderOptions options_;
+
+  // Offset of the next record returned to the consumer.
+  uint64 offset_;
+  // Keeps the record backing the latest `ReadRecordView()` alive.
+  absl::Cord last_view_;
+
+  mutex mu_;
+  condition_variable chunk_cv_;
+  condition_variable record_cv_;
+  condition_variable space_cv_;
+  bool cancelled_ TF_GUARDED_BY(mu_) = false;
+
+  // Chunks that have been issued and not yet fully consumed by the decoder,
+  // in file order. The first chunk contains the decoding cursor.
+  std::deque<std::shared_ptr<Chunk>> chunks_ TF_GUARDED_BY(mu_);
+  uint64 next_read_offset_ TF_GUARDED_BY(mu_);
+  bool eof_reached_ TF_GUARDED_BY(mu_) = false;
+  // Position of the decoding cursor within `chunks_.front()`. Only accessed by
+  // the decoding thread.
+  size_t chunk_pos_ = 0;
+
+  // Decoded records not yet returned to the consumer.
+  std::deque<Record> records_ TF_GUARDED_BY(mu_);
+  int64_t buffered_record_bytes_ TF_GUARDED_BY(mu_) = 0;
+  // Set when the decoder stops: OUT_OF_RANGE at the end of the file, or the
+  // error that stopped it.
+  absl::Status decoder_status_ TF_GUARDED_BY(mu_);
+  bool decoder_done_ TF_GUARDED_BY(mu_) = false;
+
+  std::unique_ptr<thread::ThreadPool> io_pool_;
+  std::unique_ptr<Thread> decode_thread_;
+
+  ReadAheadRecordReader(const ReadAheadRecordReader&) = delete;
+  void operator=(const ReadAheadRecordReader&) = delete;
+};
+
+}  // namespace io
+}  // namespace tsl
+
+#endif  // TENSORFLOW_TSL_LIB_IO_READ_AHEAD_RECORD_READER_H_
@@ -0,0 +1,277 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tsl/lib/io/read_ahead_record_reader.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/cord.h"
+#include "xla/tsl/lib/core/status_test_util.h"
+#include "tsl/lib/io/record_reader.h"
+#include "tsl/lib/io/record_writer.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/test.h"
+#include "tsl/platform/test_benchmark.h"
+
+namespace tsl {
+namespace io {
+namespace {
+
+// Returns `n` records with sizes cycling through small, medium and large
+// values so that records straddle read boundaries.
+std::vector<string> MakeRecords(int n) {
+  std::vector<string> records;
+  const int sizes[] = {0, 1, 7, 100, 511, 512, 4096, 70000};
+  for (int i = 0; i < n; ++i) {
+    records.push_back(string(sizes[i % 8], static_cast<char>('a' + i % 26)));
+  }
+  return records;
+}
+
+string WriteRecords(const std::vector<string>& records) {
+  Env* env = Env::Default();
+  string fname;
+  CHECK(env->LocalTempFilename(&fname));
+  std::unique_ptr<WritableFile> file;
+  TF_CHECK_OK(env->NewWritableFile(fname, &file));
+  RecordWriter writer(file.get());
+  for (const string& record : records) {
+    TF_CHECK_OK(writer.WriteRecord(record));
+  }
+  TF_CHECK_OK(writer.Close());
+  TF_CHECK_OK(file->Close());
+  return fname;
+}
+
+ReadAheadRecordReaderOptions SmallReadOptions(int64_t read_size) {
+  ReadAheadRecordReaderOptions options;
+  options.read_size = read_size;
+  options.max_reads_in_flight = 3;
+  options.num_io_threads = 2;
+  options.max_buffered_record_bytes = 1 << 16;
+  return options;
+}
+
+TEST(ReadAheadRecordReaderTest, ReadsAllRecords) {
+  const std::vector<string> records = MakeRecords(80);
+  const string fname = WriteRecords(records);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(Env::Default()->NewRandomAccessFile(fname, &file));
+
+  for (int64_t read_size : {12, 13, 1000, 65536, 4 << 20}) {
+    ReadAheadRecordReader reader(Env::Default(), file.get(), /*offset=*/0,
+                                 SmallReadOptions(read_size));
+    uint64 expected_offset = 0;
+    for (const string& expected : records) {
+      absl::Cord record;
+      TF_ASSERT_OK(reader.ReadRecord(&record)) << "read_size: " << read_size;
+      EXPECT_EQ(expected, string(record));
+      expected_offset += RecordReader::kHeaderSize + expected.size() +
+                         RecordReader::kFooterSize;
+      EXPECT_EQ(expected_offset, reader.TellOffset());
+    }
+    absl::Cord record;
+    EXPECT_TRUE(errors::IsOutOfRange(reader.ReadRecord(&record)));
+    // The reader keeps returning the same status.
+    EXPECT_TRUE(errors::IsOutOfRange(reader.ReadRecord(&record)));
+  }
+}
+
+TEST(ReadAheadRecordReaderTest, MatchesRecordReader) {
+  const std::vector<string> records = MakeRecords(64);
+  const string fname = WriteRecords(records);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(Env::Default()->NewRandomAccessFile(fname, &file));
+
+  RecordReader expected_reader(file.get());
+  ReadAheadRecordReader reader(Env::Default(), file.get(), /*offset=*/0,
+                               SmallReadOptions(4096));
+  uint64 offset = 0;
+  tstring expected, actual, view;
+  while (expected_reader.ReadRecord(&offset, &expected).ok()) {
+    TF_ASSERT_OK(reader.ReadRecord(&actual));
+    EXPECT_EQ(expected, actual);
+    EXPECT_EQ(offset, reader.TellOffset());
+  }
+  EXPECT_TRUE(errors::IsOutOfRange(reader.ReadRecordView(&view)));
+}
+
+TEST(ReadAheadRecordReaderTest, ReadRecordView) {
+  const std::vector<string> records = MakeRecords(40);
+  const string fname = WriteRecords(records);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(Env::Default()->NewRandomAccessFile(fname, &file));
+
+  ReadAheadRecordReader reader(Env::Default(), file.get(), /*offset=*/0,
+                               SmallReadOptions(1000));
+  tstring record;
+  for (const string& expected : records) {
+    TF_ASSERT_OK(reader.ReadRecordView(&record));
+    EXPECT_EQ(expected, record);
+  }
+}
+
+TEST(ReadAheadRecordReaderTest, StartsAtOffset) {
+  const std::vector<string> records = MakeRecords(10);
+  const string fname = WriteRecords(records);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(Env::Default()->NewRandomAccessFile(fname, &file));
+
+  uint64 offset = 0;
+  for (int i = 0; i < 3; ++i) {
+    offset += RecordReader::kHeaderSize + records[i].size() +
+              RecordReader::kFooterSize;
+  }
+  ReadAheadRecordReader reader(Env::Default(), file.get(), offset,
+                               SmallReadOptions(64));
+  tstring record;
+  for (int i = 3; i < records.size(); ++i) {
+    TF_ASSERT_OK(reader.ReadRecord(&record));
+    EXPECT_EQ(records[i], record);
+  }
+  EXPECT_TRUE(errors::IsOutOfRange(reader.ReadRecord(&record)));
+}
+
+TEST(ReadAheadRecordReaderTest, DetectsCorruption) {
+  const std::vector<string> records = MakeRecords(16);
+  const string fname = WriteRecords(records);
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), fname, &contents));
+  // Flip a byte in the payload of the fourth record.
+  uint64 offset = 0;
+  for (int i = 0; i < 3; ++i) {
+    offset += RecordReader::kHeaderSize + records[i].size() +
+              RecordReader::kFooterSize;
+  }
+  contents[offset + RecordReader::kHeaderSize + 3] ^= 0x1;
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), fname, contents));
+
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(Env::Default()->NewRandomAccessFile(fname, &file));
+  ReadAheadRecordReader reader(Env::Default(), file.get(), /*offset=*/0,
+                               SmallReadOptions(256));
+  tstring record;
+  for (int i = 0; i < 3; ++i) {
+    TF_ASSERT_OK(reader.ReadRecord(&record));
+  }
+  absl::Status s = reader.ReadRecord(&record);
+  EXPECT_TRUE(errors::IsDataLoss(s)) << s;
+  EXPECT_TRUE(errors::IsDataLoss(reader.ReadRecord(&record)));
+}
+
+TEST(ReadAheadRecordReaderTest, DetectsTruncation) {
+  const std::vector<string> records = MakeRecords(8);
+  const string fname = WriteRecords(records);
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), fname, &contents));
+  contents.resize(contents.size() - 2);
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), fname, contents));
+
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(Env::Default()->NewRandomAccessFile(fname, &file));
+  ReadAheadRecordReader reader(Env::Default(), file.get(), /*offset=*/0,
+                               SmallReadOptions(1024));
+  tstring record;
+  for (int i = 0; i < records.size() - 1; ++i) {
+    TF_ASSERT_OK(reader.ReadRecord(&record));
+  }
+  EXPECT_TRUE(errors::IsDataLoss(reader.ReadRecord(&record)));
+}
+
+TEST(ReadAheadRecordReaderTest, DestroyBeforeEndOfFile) {
+  const std::vector<string> records = MakeRecords(1000);
+  const string fname = WriteRecords(records);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(Env::Default()->NewRandomAccessFile(fname, &file));
+  absl::Cord record;
+  {
+    ReadAheadRecordReader reader(Env::Default(), file.get(), /*offset=*/0,
+                                 SmallReadOptions(4096));
+    for (int i = 0; i < 8; ++i) {
+      TF_ASSERT_OK(reader.ReadRecord(&record));
+    }
+  }
+  // Records outlive the reader.
+  EXPECT_EQ(records[7], string(record));
+}
+
+// Benchmarks sequentially reading a local file of `num_records` records of
+// `record_size` bytes with `RecordReader` and `ReadAheadRecordReader`.
+string WriteBenchmarkFile(int64_t record_size, int64_t num_records) {
+  Env* env = Env::Default();
+  string fname;
+  CHECK(env->LocalTempFilename(&fname));
+  std::unique_ptr<WritableFile> file;
+  TF_CHECK_OK(env->NewWritableFile(fname, &file));
+  RecordWriter writer(file.get());
+  const string record(record_size, 'x');
+  for (int64_t i = 0; i < num_records; ++i) {
+    TF_CHECK_OK(writer.WriteRecord(record));
+  }
+  TF_CHECK_OK(writer.Close());
+  TF_CHECK_OK(file->Close());
+  return fname;
+}
+
+void BM_RecordReader(::testing::benchmark::State& state) {
+  const int64_t record_size = state.range(0);
+  const int64_t num_records = (256 << 20) / record_size;
+  const string fname = WriteBenchmarkFile(record_size, num_records);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_CHECK_OK(Env::Default()->NewRandomAccessFile(fname, &file));
+
+  RecordReaderOptions options;
+  options.buffer_size = 256 << 10;
+  tstring record;
+  for (auto s : state) {
+    SequentialRecordReader reader(file.get(), options);
+    for (int64_t i = 0; i < num_records; ++i) {
+      TF_CHECK_OK(reader.ReadRecord(&record));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * num_records * record_size);
+  TF_CHECK_OK(Env::Default()->DeleteFile(fname));
+}
+BENCHMARK(BM_RecordReader)->UseRealTime()->Arg(100)->Arg(10 << 10)->Arg(1 << 20);
+
+void BM_ReadAheadRecordReader(::testing::benchmark::State& state) {
+  const int64_t record_size = state.range(0);
+  const int64_t num_records = (256 << 20) / record_size;
+  const string fname = WriteBenchmarkFile(record_size, num_records);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_CHECK_OK(Env::Default()->NewRandomAccessFile(fname, &file));
+
+  absl::Cord record;
+  for (auto s : state) {
+    ReadAheadRecordReader reader(Env::Default(), file.get());
+    for (int64_t i = 0; i < num_records; ++i) {
+      TF_CHECK_OK(reader.ReadRecord(&record));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * num_records * record_size);
+  TF_CHECK_OK(Env::Default()->DeleteFile(fname));
+}
+BENCHMARK(BM_ReadAheadRecordReader)
+    ->UseRealTime()
+    ->Arg(100)
+    ->Arg(10 << 10)
+    ->Arg(1 << 20);
+
+}  // namespace
+}  // namespace io
+}  // namespace tsl
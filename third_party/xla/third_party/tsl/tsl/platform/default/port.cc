@@ -257,6 +257,38 @@ int NUMAGetThreadNodeAffinity() {
   return node_index;
 }
 
+#ifdef TENSORFLOW_USE_NUMA
+struct NUMAThreadAffinity {
+  hwloc_cpuset_t cpuset;
+};
+#endif  // TENSORFLOW_USE_NUMA
+
+NUMAThreadAffinity* NUMASaveThreadAffinity() {
+#ifdef TENSORFLOW_USE_NUMA
+  if (HaveHWLocTopology()) {
+    hwloc_cpuset_t thread_cpuset = hwloc_bitmap_alloc();
+    if (hwloc_get_cpubind(hwloc_topology_handle, thread_cpuset,
+                          HWLOC_CPUBIND_THREAD) == 0) {
+      return new NUMAThreadAffinity{thread_cpuset};
+    }
+    LOG(ERROR) << "Call to hwloc_get_cpubind() failed";
+    hwloc_bitmap_free(thread_cpuset);
+  }
+#endif  // TENSORFLOW_USE_NUMA
+  return nullptr;
+}
+
+void NUMARestoreThreadAffinity(NUMAThreadAffinity* affinity) {
+#ifdef TENSORFLOW_USE_NUMA
+  if (affinity != nullptr) {
+    hwloc_set_cpubind(hwloc_topology_handle, affinity->cpuset,
+                      HWLOC_CPUBIND_THREAD);
+    hwloc_bitmap_free(affinity->cpuset);
+    delete affinity;
+  }
+#endif  // TENSORFLOW_USE_NUMA
+}
+
 void* NUMAMalloc(int node, size_t size, int minimum_alignment) {
 #ifdef TENSORFLOW_USE_NUMA
   if (HaveHWLocTopology()) {
@@ -39,6 +39,18 @@ void NUMASetThreadNodeAffinity(int node);
 // Returns NUMA node affinity of the current thread, kNUMANoAffinity if none.
 int NUMAGetThreadNodeAffinity();
 
+// The CPU affinity of a thread, as saved by NUMASaveThreadAffinity.
+struct NUMAThreadAffinity;
+
+// Saves the set of CPUs the current thread may run on, so that it can be
+// reinstated exactly after pinning the thread with NUMASetThreadNodeAffinity.
+// Returns nullptr if NUMA functions are not supported.
+NUMAThreadAffinity* NUMASaveThreadAffinity();
+
+// Binds the current thread to the CPUs saved in 'affinity' and frees it. Does
+// nothing if 'affinity' is nullptr.
+void NUMARestoreThreadAffinity(NUMAThreadAffinity* affinity);
+
 // Like AlignedMalloc, but allocates memory with affinity to the specified NUMA
 // node.
 //
@@ -57,5 +57,24 @@ TEST(Numa, SetNodeAffinity) {
   }
 }
 
+TEST(Numa, RestoreThreadAffinity) {
+  const int initial_node = port::NUMAGetThreadNodeAffinity();
+  if (port::NUMAEnabled()) {
+    int num_nodes = port::NUMANumNodes();
+    for (int request_node = 0; request_node < num_nodes; ++request_node) {
+      port::NUMAThreadAffinity* affinity = port::NUMASaveThreadAffinity();
+      EXPECT_NE(affinity, nullptr);
+      port::NUMASetThreadNodeAffinity(request_node);
+      EXPECT_EQ(port::NUMAGetThreadNodeAffinity(), request_node);
+      port::NUMARestoreThreadAffinity(affinity);
+      EXPECT_EQ(port::NUMAGetThreadNodeAffinity(), initial_node);
+    }
+  } else {
+    // Saving and restoring the affinity is a no-op without NUMA support.
+    port::NUMARestoreThreadAffinity(port::NUMASaveThreadAffinity());
+    EXPECT_EQ(port::NUMAGetThreadNodeAffinity(), initial_node);
+  }
+}
+
 }  // namespace internal
 }  // namespace tsl
@@ -116,6 +116,10 @@ void NUMASetThreadNodeAffinity(int node) {}
 
 int NUMAGetThreadNodeAffinity() { return kNUMANoAffinity; }
 
+NUMAThreadAffinity* NUMASaveThreadAffinity() { return nullptr; }
+
+void NUMARestoreThreadAffinity(NUMAThreadAffinity* affinity) {}
+
 void* NUMAMalloc(int node, size_t size, int minimum_alignment) {
   return tsl::port::AlignedMalloc(size, minimum_alignment);
 }
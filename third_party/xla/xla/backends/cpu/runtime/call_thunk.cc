@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/status/statusor.h"
@@ -54,4 +55,8 @@ CallThunk::ResourceUses CallThunk::resource_uses() const {
   return called_executor_.resource_uses();
 }
 
+std::vector<const ThunkSequence*> CallThunk::nested_thunk_sequences() const {
+  return {&called_executor_.thunk_sequence()};
+}
+
 }  // namespace xla::cpu
@@ -17,6 +17,7 @@ limitations under the License.
 #define XLA_BACKENDS_CPU_RUNTIME_CALL_THUNK_H_
 
 #include <memory>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "xla/backends/cpu/runtime/thunk.h"
@@ -36,6 +37,7 @@ class CallThunk final : public Thunk {
 
   BufferUses buffer_uses() const final;
   ResourceUses resource_uses() const final;
+  std::vector<const ThunkSequence*> nested_thunk_sequences() const final;
 
  private:
   CallThunk(Info info, ThunkExecutor called_executor);
@@ -114,4 +114,14 @@ ConditionalThunk::ResourceUses ConditionalThunk::resource_uses() const {
   return resource_uses;
 }
 
+std::vector<const ThunkSequence*> ConditionalThunk::nested_thunk_sequences()
+    const {
+  std::vector<const ThunkSequence*> sequences;
+  sequences.reserve(branch_executors_.size());
+  for (const auto& branch_executor : branch_executors_) {
+    sequences.push_back(&branch_executor.thunk_sequence());
+  }
+  return sequences;
+}
+
 }  // namespace xla::cpu
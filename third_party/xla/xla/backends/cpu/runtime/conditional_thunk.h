@@ -37,6 +37,7 @@ class ConditionalThunk final : public Thunk {
 
   BufferUses buffer_uses() const final;
   ResourceUses resource_uses() const final;
+  std::vector<const ThunkSequence*> nested_thunk_sequences() const final;
 
  private:
   ConditionalThunk(Info info, BufferAllocation::Slice branch_index_buffer,
@@ -17,15 +17,20 @@ limitations under the License.
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <functional>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <numeric>
+#include <optional>
 #include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/algorithm/container.h"
 #include "absl/base/dynamic_annotations.h"
@@ -38,6 +43,7 @@ limitations under the License.
 #include "absl/strings/str_join.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/types/span.h"
+#include "xla/backends/cpu/runtime/concurrency.h"
 #include "xla/backends/cpu/runtime/thunk.h"
 #include "xla/layout_util.h"
 #include "xla/primitive_util.h"
@@ -48,6 +54,7 @@ limitations under the License.
 #include "xla/stream_executor/device_memory.h"
 #include "xla/tsl/concurrency/async_value_ref.h"
 #include "xla/util.h"
+#include "xla/xla_data.pb.h"
 #include "tsl/platform/errors.h"
 #include "tsl/platform/logging.h"
 #include "tsl/platform/statusor.h"
@@ -86,36 +93,43 @@ static absl::Status VerifySortInputs(absl::Span<const SortThunk::Input> inputs,
 
 absl::StatusOr<std::unique_ptr<SortThunk>> SortThunk::Create(
     Info info, absl::Span<const Input> inputs, int64_t dimension,
-    bool is_stable, LessThan less_than) {
+    bool is_stable, LessThan less_than, std::optional<SortOrder> sort_order) {
   TF_RETURN_IF_ERROR(VerifySortInputs(inputs, dimension));
   return absl::WrapUnique(new SortThunk(std::move(info), inputs, dimension,
-                                        is_stable, std::move(less_than)));
+                                        is_stable, std::move(less_than),
+                                        sort_order));
 }
 
 absl::StatusOr<std::unique_ptr<SortThunk>> SortThunk::Create(
     Info info, absl::Span<const Input> inputs, int64_t dimension,
-    bool is_stable, std::string comparator_name) {
+    bool is_stable, std::string comparator_name,
+    std::optional<SortOrder> sort_order) {
   TF_RETURN_IF_ERROR(VerifySortInputs(inputs, dimension));
   return absl::WrapUnique(new SortThunk(std::move(info), inputs, dimension,
-                                        is_stable, std::move(comparator_name)));
+                                        is_stable, std::move(comparator_name),
+                                        sort_order));
 }
 
 SortThunk::SortThunk(Info info, absl::Span<const Input> inputs,
-                     int64_t dimension, bool is_stable, LessThan less_than)
+                     int64_t dimension, bool is_stable, LessThan less_than,
+                     std::optional<SortOrder> sort_order)
     : Thunk(Kind::kSort, std::move(info)),
       inputs_(inputs.begin(), inputs.end()),
       dimension_(dimension),
       is_stable_(is_stable),
+      sort_order_(sort_order),
       less_than_(std::move(less_than)),
       less_than_ptr_(&*less_than_) {}
 
 SortThunk::SortThunk(Info info, absl::Span<const Input> inputs,
                      int64_t dimension, bool is_stable,
-                     std::string comparator_name)
+                     std::string comparator_name,
+                     std::optional<SortOrder> sort_order)
     : Thunk(Kind::kSort, std::move(info)),
       inputs_(inputs.begin(), inputs.end()),
       dimension_(dimension),
       is_stable_(is_stable),
+      sort_order_(sort_order),
       comparator_name_(std::move(comparator_name)),
       less_than_ptr_(nullptr) {}
 
@@ -364,6 +378,248 @@ static SortDims GetSortDims(const Shape& shape, int64_t dimension) {
                   num_iterations};
 }
 
+// Rows with known sort order (see `SortThunk::SortOrder`) are sorted without
+// calling the comparator: the elements of the first input are mapped to
+// unsigned integer keys whose ascending order is the sort order, and the keys
+// are sorted together with their positions in the row, with a sorting network
+// for short rows and a radix sort for longer ones. All inputs are then
+// permuted by the sorted positions. Ties are broken by position, so these
+// sorts are always stable.
+
+// Rows of up to this many elements are sorted with a bitonic sorting network.
+static constexpr int64_t kMaxSortNetworkSize = 32;
+
+// Minimum number of elements to sort per task when sorting in parallel.
+static constexpr int64_t kMinParallelSortSize = 16 * 1024;
+
+namespace {
+
+// Scratch buffers for sorting rows with a known sort order, reused across the
+// rows sorted by one thread.
+struct SortScratch {
+  std::vector<uint32_t> keys;
+  std::vector<uint32_t> positions;
+  std::vector<uint32_t> keys_tmp;
+  std::vector<uint32_t> positions_tmp;
+  std::vector<uint64_t> network;
+  std::vector<std::byte> values;
+};
+
+}  // namespace
+
+static bool IsRadixSortable(PrimitiveType type) {
+  return type == F32 || type == S32 || type == BF16;
+}
+
+// Maps the bits of a floating point number to a key ordered like the IEEE
+// total order, by flipping all the bits of negative numbers and the sign bit of
+// positive ones. With IEEE comparisons -0 and +0 are equal, and NaNs are
+// unordered, in which case returns false.
+template <typename Bits>
+static bool FloatRadixKey(Bits bits, Bits sign_bit, Bits infinity,
+                          bool total_order, uint32_t* key) {
+  if (!total_order) {
+    if ((bits & static_cast<Bits>(~sign_bit)) > infinity) return false;
+    if (bits == sign_bit) bits = 0;
+  }
+  *key = (bits & sign_bit) ? static_cast<Bits>(~bits)
+                           : static_cast<Bits>(bits | sign_bit);
+  return true;
+}
+
+template <PrimitiveType type>
+static bool RadixKey(const std::byte* ptr, bool total_order, uint32_t* key) {
+  if constexpr (type == S32) {
+    uint32_t bits;
+    std::memcpy(&bits, ptr, sizeof(bits));
+    *key = bits ^ 0x80000000u;
+    return true;
+  } else if constexpr (type == F32) {
+    uint32_t bits;
+    std::memcpy(&bits, ptr, sizeof(bits));
+    return FloatRadixKey<uint32_t>(bits, 0x80000000u, 0x7f800000u, total_order,
+                                   key);
+  } else {
+    static_assert(type == BF16);
+    uint16_t bits;
+    std::memcpy(&bits, ptr, sizeof(bits));
+    return FloatRadixKey<uint16_t>(bits, 0x8000u, 0x7f80u, total_order, key);
+  }
+}
+
+// Sorts `scratch.keys` with a bitonic sorting network, and stores the original
+// positions of the sorted keys in `scratch.positions`. Keys are packed with
+// their positions into 64-bit integers, so that compare-exchanges are
+// branchless min/max operations the compiler can vectorize.
+static void SortNetwork(SortScratch& scratch) {
+  const int64_t size = scratch.keys.size();
+  int64_t padded_size = 1;
+  while (padded_size < size) padded_size *= 2;
+
+  std::vector<uint64_t>& v = scratch.network;
+  v.assign(padded_size, std::numeric_limits<uint64_t>::max());
+  for (int64_t i = 0; i < size; ++i) {
+    v[i] = (static_cast<uint64_t>(scratch.keys[i]) << 32) | i;
+  }
+
+  for (int64_t k = 2; k <= padded_size; k *= 2) {
+    for (int64_t j = k / 2; j > 0; j /= 2) {
+      for (int64_t i = 0; i < padded_size; ++i) {
+        int64_t l = i ^ j;
+        if (l <= i) continue;
+        uint64_t lo = std::min(v[i], v[l]);
+        uint64_t hi = std::max(v[i], v[l]);
+        bool ascending = (i & k) == 0;
+        v[i] = ascending ? lo : hi;
+        v[l] = ascending ? hi : lo;
+      }
+    }
+  }
+
+  scratch.positions.resize(size);
+  for (int64_t i = 0; i < size; ++i) {
+    scratch.positions[i] = static_cast<uint32_t>(v[i]);
+  }
+}
+
+// Sorts `scratch.keys` with a least significant digit radix sort on 8-bit
+// digits, and stores the original positions of the sorted keys in
+// `scratch.positions`. Digits that are the same for all keys are skipped.
+template <int key_bits>
+static void RadixSort(SortScratch& scratch) {
+  const int64_t size = scratch.keys.size();
+  scratch.positions.resize(size);
+  std::iota(scratch.positions.begin(), scratch.positions.end(), 0);
+  scratch.keys_tmp.resize(size);
+  scratch.positions_tmp.resize(size);
+
+  for (int shift = 0; shift < key_bits; shift += 8) {
+    const uint32_t* keys = scratch.keys.data();
+    const uint32_t* positions = scratch.positions.data();
+
+    std::array<int64_t, 256> offsets = {};
+    for (int64_t i = 0; i < size; ++i) {
+      ++offsets[(keys[i] >> shift) & 0xFF];
+    }
+    if (offsets[(keys[0] >> shift) & 0xFF] == size) continue;
+
+    int64_t offset = 0;
+    for (int64_t& digit_offset : offsets) {
+      int64_t count = digit_offset;
+      digit_offset = offset;
+      offset += count;
+    }
+
+    uint32_t* keys_tmp = scratch.keys_tmp.data();
+    uint32_t* positions_tmp = scratch.positions_tmp.data();
+    for (int64_t i = 0; i < size; ++i) {
+      int64_t dst = offsets[(keys[i] >> shift) & 0xFF]++;
+      keys_tmp[dst] = keys[i];
+      positions_tmp[dst] = positions[i];
+    }
+    scratch.keys.swap(scratch.keys_tmp);
+    scratch.positions.swap(scratch.positions_tmp);
+  }
+}
+
+// Moves the element at position `permutation[i]` of a strided row to position
+// `i`, for elements of `byte_width` bytes.
+template <size_t byte_width>
+static void PermuteRow(std::byte* row, int64_t size, int64_t stride,
+                       const uint32_t* permutation,
+                       std::vector<std::byte>& scratch) {
+  scratch.resize(size * byte_width);
+  for (int64_t i = 0; i < size; ++i) {
+    std::memcpy(scratch.data() + i * byte_width,
+                row + permutation[i] * stride * byte_width, byte_width);
+  }
+  for (int64_t i = 0; i < size; ++i) {
+    std::memcpy(row + i * stride * byte_width,
+                scratch.data() + i * byte_width, byte_width);
+  }
+}
+
+static void PermuteRow(std::byte* row, uint8_t byte_width, int64_t size,
+                       int64_t stride, const uint32_t* permutation,
+                       std::vector<std::byte>& scratch) {
+  switch (byte_width) {
+    case 1:
+      return PermuteRow<1>(row, size, stride, permutation, scratch);
+    case 2:
+      return PermuteRow<2>(row, size, stride, permutation, scratch);
+    case 4:
+      return PermuteRow<4>(row, size, stride, permutation, scratch);
+    case 8:
+      return PermuteRow<8>(row, size, stride, permutation, scratch);
+    case 16:
+      return PermuteRow<16>(row, size, stride, permutation, scratch);
+    default:
+      LOG(FATAL) << "Unsupported element byte width: " << byte_width;
+  }
+}
+
+// Sorts a row of all `rows` by the elements of the first one in the given
+// `sort_order`. Returns false, leaving the rows unchanged, if the elements
+// can't be ordered without the comparator.
+template <PrimitiveType type>
+static bool SortRowInOrder(const SortDims& sort_dims,
+                           absl::Span<std::byte* const> rows,
+                           absl::Span<const uint8_t> byte_widths,
+                           const SortThunk::SortOrder& sort_order,
+                           SortScratch& scratch) {
+  constexpr int kKeyBits = 8 * sizeof(primitive_util::NativeTypeOf<type>);
+  const int64_t size = sort_dims.sort_dim_size;
+  const int64_t stride = sort_dims.inner_dim_size;
+
+  // Flipping all bits of the keys reverses their order.
+  const uint32_t flip =
+      sort_order.direction == SortThunk::SortDirection::kDescending
+          ? static_cast<uint32_t>((uint64_t{1} << kKeyBits) - 1)
+          : 0;
+
+  scratch.keys.resize(size);
+  for (int64_t i = 0; i < size; ++i) {
+    uint32_t key;
+    if (!RadixKey<type>(rows[0] + i * stride * byte_widths[0],
+                        sort_order.total_order, &key)) {
+      return false;
+    }
+    scratch.keys[i] = key ^ flip;
+  }
+
+  if (size <= kMaxSortNetworkSize) {
+    SortNetwork(scratch);
+  } else {
+    RadixSort<kKeyBits>(scratch);
+  }
+
+  for (size_t i = 0; i < rows.size(); ++i) {
+    PermuteRow(rows[i], byte_widths[i], size, stride,
+               scratch.positions.data(), scratch.values);
+  }
+  return true;
+}
+
+static bool SortRowInOrder(PrimitiveType type, const SortDims& sort_dims,
+                           absl::Span<std::byte* const> rows,
+                           absl::Span<const uint8_t> byte_widths,
+                           const SortThunk::SortOrder& sort_order,
+                           SortScratch& scratch) {
+  switch (type) {
+    case F32:
+      return SortRowInOrder<F32>(sort_dims, rows, byte_widths, sort_order,
+                                 scratch);
+    case S32:
+      return SortRowInOrder<S32>(sort_dims, rows, byte_widths, sort_order,
+                                 scratch);
+    case BF16:
+      return SortRowInOrder<BF16>(sort_dims, rows, byte_widths, sort_order,
+                                  scratch);
+    default:
+      return false;
+  }
+}
+
 // Sorts `n` buffers in place.
 template <size_t n>
 static void SortInplace(const SortDims& sort_dims, int64_t offset,
@@ -397,20 +653,43 @@ static void SortInplace(const SortDims& sort_dims, int64_t offset,
   }
 }
 
-// Sorts `data` of the given `shape` along the `dimension` inplace.
-static absl::Status SortInplace(absl::Span<se::DeviceMemoryBase> data,
-                                absl::Span<const Shape> shapes,
-                                int64_t dimension, bool is_stable,
-                                SortThunk::LessThan* less_than) {
-  // All inputs have the same dimensions and layout, so we can use the first
-  // shape to get the sort dimensions.
-  SortDims sort_dims = GetSortDims(shapes[0], dimension);
+// Sorts the 1-dimensional slices in the [start, end) range of iterations of
+// `data` of the given `shapes` inplace.
+static absl::Status SortInplace(
+    const SortDims& sort_dims, int64_t start, int64_t end,
+    absl::Span<se::DeviceMemoryBase> data, absl::Span<const Shape> shapes,
+    bool is_stable, const std::optional<SortThunk::SortOrder>& sort_order,
+    SortThunk::LessThan* less_than) {
+  // Slices with a known sort order are sorted by the first input without
+  // calling the comparator, unless they contain elements the specialized
+  // kernels can't order.
+  bool sort_in_order =
+      sort_order.has_value() && IsRadixSortable(shapes[0].element_type()) &&
+      sort_dims.sort_dim_size <= std::numeric_limits<uint32_t>::max();
+
+  absl::InlinedVector<std::byte*, 8> rows(data.size());
+  absl::InlinedVector<uint8_t, 8> byte_widths(data.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    byte_widths[i] = primitive_util::ByteWidth(shapes[i].element_type());
+  }
+  SortScratch scratch;
 
   // Iterate over all the 1-dimensional slices of the buffers and sort them.
-  for (int64_t i = 0; i < sort_dims.num_iterations; ++i) {
+  for (int64_t i = start; i < end; ++i) {
     int64_t inner_idx = i % sort_dims.inner_dim_size;
     int64_t offset = inner_idx + (i - inner_idx) * sort_dims.sort_dim_size;
 
+    if (sort_in_order) {
+      for (size_t j = 0; j < data.size(); ++j) {
+        rows[j] = reinterpret_cast<std::byte*>(data[j].opaque()) +
+                  offset * byte_widths[j];
+      }
+      if (SortRowInOrder(shapes[0].element_type(), sort_dims, rows,
+                         byte_widths, *sort_order, scratch)) {
+        continue;
+      }
+    }
+
     auto sort = [&](auto num_inputs) {
       SortInplace<decltype(num_inputs)::value>(sort_dims, offset, data, shapes,
                                                is_stable, less_than);
@@ -512,6 +791,10 @@ tsl::AsyncValueRef<SortThunk::ExecuteEvent> SortThunk::Execute(
                                   input.slice.ToString(), data.back().opaque());
   }
 
+  // All inputs have the same dimensions and layout, so we can use the first
+  // shape to get the sort dimensions.
+  SortDims sort_dims = GetSortDims(shapes[0], dimension_);
+
   LessThan* less_than = less_than_ptr_.load();
 
   // Because thunks are owned by a parent CpuExecutable, we can safely assume
@@ -532,10 +815,63 @@ tsl::AsyncValueRef<SortThunk::ExecuteEvent> SortThunk::Execute(
     less_than_ptr_.store(less_than = &*less_than_);
   }
 
-  TF_RETURN_IF_ERROR(SortInplace(absl::MakeSpan(data), shapes, dimension_,
-                                 is_stable_, less_than));
+  // Slices are sorted independently, in parallel in the intra-op thread pool
+  // if there are enough elements to sort to amortize the scheduling overheads.
+  int64_t num_tasks = 1;
+  if (params.intra_op_threadpool != nullptr) {
+    num_tasks = std::min<int64_t>(
+        {sort_dims.num_iterations, params.intra_op_threadpool->numThreads(),
+         sort_dims.num_iterations * sort_dims.sort_dim_size /
+             kMinParallelSortSize});
+  }
+
+  if (ABSL_PREDICT_TRUE(num_tasks <= 1)) {
+    TF_RETURN_IF_ERROR(SortInplace(sort_dims, 0, sort_dims.num_iterations,
+                                   absl::MakeSpan(data), shapes, is_stable_,
+                                   sort_order_, less_than));
+    return OkExecuteEvent();
+  }
+
+  // State shared by the tasks sorting the slices in parallel. The comparator
+  // is a pure function, so it is safe to call from multiple threads.
+  struct ParallelSort {
+    absl::InlinedVector<se::DeviceMemoryBase, 8> data;
+    absl::InlinedVector<Shape, 8> shapes;
+    std::atomic<int64_t> pending_tasks;
+    absl::Mutex mutex;
+    absl::Status status ABSL_GUARDED_BY(mutex);
+  };
 
-  return OkExecuteEvent();
+  auto event = tsl::MakeConstructedAsyncValueRef<ExecuteEvent>();
+  auto state = std::make_shared<ParallelSort>();
+  state->data = std::move(data);
+  state->shapes = std::move(shapes);
+  state->pending_tasks = num_tasks;
+
+  ScheduleAll(params.intra_op_threadpool, num_tasks,
+              [this, event, state, sort_dims, num_tasks,
+               less_than](int64_t task_index) {
+                int64_t num_iterations = sort_dims.num_iterations;
+                absl::Status status = SortInplace(
+                    sort_dims, task_index * num_iterations / num_tasks,
+                    (task_index + 1) * num_iterations / num_tasks,
+                    absl::MakeSpan(state->data), state->shapes, is_stable_,
+                    sort_order_, less_than);
+                if (!status.ok()) {
+                  absl::MutexLock lock(&state->mutex);
+                  state->status.Update(status);
+                }
+                if (state->pending_tasks.fetch_sub(1) == 1) {
+                  absl::MutexLock lock(&state->mutex);
+                  if (state->status.ok()) {
+                    event.SetStateConcrete();
+                  } else {
+                    event.SetError(state->status);
+                  }
+                }
+              });
+
+  return event;
 }
 
 SortThunk::BufferUses SortThunk::buffer_uses() const {
@@ -46,13 +46,28 @@ class SortThunk final : public Thunk {
     Shape shape;
   };
 
+  enum class SortDirection : uint8_t { kAscending, kDescending };
+
+  // Order defined by a comparator that compares the elements of the first
+  // input with a single `compare` instruction. When it is known, and the first
+  // input is F32, S32 or BF16, the thunk sorts with radix sort and sorting
+  // networks instead of calling the comparator for every comparison.
+  struct SortOrder {
+    SortDirection direction = SortDirection::kAscending;
+    // Whether floating point elements are compared with a total order, rather
+    // than with IEEE comparisons that make NaNs unordered.
+    bool total_order = false;
+  };
+
   static absl::StatusOr<std::unique_ptr<SortThunk>> Create(
       Info info, absl::Span<const Input> inputs, int64_t dimension,
-      bool is_stable, LessThan less_than);
+      bool is_stable, LessThan less_than,
+      std::optional<SortOrder> sort_order = std::nullopt);
 
   static absl::StatusOr<std::unique_ptr<SortThunk>> Create(
       Info info, absl::Span<const Input> inputs, int64_t dimension,
-      bool is_stable, std::string comparator_name);
+      bool is_stable, std::string comparator_name,
+      std::optional<SortOrder> sort_order = std::nullopt);
 
   tsl::AsyncValueRef<ExecuteEvent> Execute(const ExecuteParams& params) final;
 
@@ -60,14 +75,17 @@ class SortThunk final : public Thunk {
 
  private:
   SortThunk(Info info, absl::Span<const Input> inputs, int64_t dimension,
-            bool is_stable, LessThan less_than);
+            bool is_stable, LessThan less_than,
+            std::optional<SortOrder> sort_order);
 
   SortThunk(Info info, absl::Span<const Input> inputs, int64_t dimension,
-            bool is_stable, std::string comparator_name);
+            bool is_stable, std::string comparator_name,
+            std::optional<SortOrder> sort_order);
 
   std::vector<Input> inputs_;
   int64_t dimension_;
   bool is_stable_;
+  std::optional<SortOrder> sort_order_;
 
   // Name of the comparator function, lazily resolved to a comparator function
   // pointer using Thunk::FunctionRegistry.
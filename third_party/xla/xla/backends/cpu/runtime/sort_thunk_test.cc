@@ -15,8 +15,14 @@ limitations under the License.
 
 #include "xla/backends/cpu/runtime/sort_thunk.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <optional>
 #include <string_view>
 #include <vector>
 
@@ -31,9 +37,17 @@ limitations under the License.
 #include "xla/shape_util.h"
 #include "xla/stream_executor/device_memory.h"
 #include "xla/tsl/concurrency/async_value_ref.h"
+#include "xla/types.h"
+#include "tsl/platform/env.h"
 #include "tsl/platform/logging.h"
 #include "tsl/platform/statusor.h"
 #include "tsl/platform/test.h"
+#include "tsl/platform/threadpool.h"
+
+#define EIGEN_USE_THREADS
+
+#include "Eigen/ThreadPool"
+#include "unsupported/Eigen/CXX11/Tensor"
 
 namespace xla::cpu {
 namespace {
@@ -237,6 +251,173 @@ TEST_P(SortThunkTest, Sort2DWithLayout) {
   EXPECT_EQ(indices, expected_indices);
 }
 
+// Sorts keys of type `T` and their int32 indices along the last dimension of
+// a [num_rows, row_size] shape with a known sort order, and returns the sorted
+// indices. The comparator must not be called.
+template <typename T>
+static std::vector<int32_t> SortInOrder(
+    PrimitiveType type, std::vector<T>& keys, int64_t num_rows, bool is_stable,
+    SortThunk::SortOrder sort_order,
+    const Eigen::ThreadPoolDevice* device = nullptr) {
+  int64_t row_size = keys.size() / num_rows;
+  std::vector<int32_t> indices(keys.size());
+  for (int64_t i = 0; i < indices.size(); ++i) indices[i] = i % row_size;
+
+  std::vector<MaybeOwningDeviceMemory> buffers;
+  size_t keys_size = keys.size() * sizeof(T);
+  size_t indices_size = indices.size() * sizeof(int32_t);
+  buffers.emplace_back(se::DeviceMemoryBase(keys.data(), keys_size));
+  buffers.emplace_back(se::DeviceMemoryBase(indices.data(), indices_size));
+  BufferAllocations allocations(buffers);
+
+  BufferAllocation alloc0(0, keys_size, 0);
+  BufferAllocation alloc1(1, indices_size, 0);
+  BufferAllocation::Slice slice0(&alloc0, 0, keys_size);
+  BufferAllocation::Slice slice1(&alloc1, 0, indices_size);
+
+  Shape keys_shape = ShapeUtil::MakeShape(type, {num_rows, row_size});
+  Shape indices_shape = ShapeUtil::MakeShape(S32, {num_rows, row_size});
+
+  auto thunk = SortThunk::Create(
+      {"sort"}, {{slice0, keys_shape}, {slice1, indices_shape}},
+      /*dimension=*/1, is_stable,
+      [](const void**) -> bool { LOG(FATAL) << "Unexpected comparison"; },
+      sort_order);
+  TF_CHECK_OK(thunk.status());
+
+  Thunk::ExecuteParams params;
+  params.buffer_allocations = &allocations;
+  params.intra_op_threadpool = device;
+
+  auto execute_event = (*thunk)->Execute(params);
+  tsl::BlockUntilReady(execute_event);
+  CHECK(!execute_event.IsError());
+  return indices;
+}
+
+TEST_P(SortThunkTest, SortInOrderBreaksTiesByPosition) {
+  bool is_stable = GetParam();
+
+  std::vector<float> keys = {2.0, 1.0, 2.0, 3.0, 1.0, -0.0, 0.0};
+  std::vector<int32_t> indices = SortInOrder<float>(
+      F32, keys, /*num_rows=*/1, is_stable,
+      {SortThunk::SortDirection::kDescending, /*total_order=*/false});
+
+  EXPECT_EQ(keys, std::vector<float>({3.0, 2.0, 2.0, 1.0, 1.0, -0.0, 0.0}));
+  EXPECT_EQ(indices, std::vector<int32_t>({3, 0, 2, 1, 4, 5, 6}));
+}
+
+TEST_P(SortThunkTest, SortInOrderWithTotalOrder) {
+  bool is_stable = GetParam();
+
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  float inf = std::numeric_limits<float>::infinity();
+  std::vector<float> keys = {1.0, nan, 0.0, -0.0, -inf};
+  std::vector<int32_t> indices = SortInOrder<float>(
+      F32, keys, /*num_rows=*/1, is_stable,
+      {SortThunk::SortDirection::kAscending, /*total_order=*/true});
+
+  EXPECT_EQ(indices, std::vector<int32_t>({4, 3, 2, 0, 1}));
+  EXPECT_TRUE(std::signbit(keys[1]));
+  EXPECT_TRUE(std::isnan(keys[4]));
+}
+
+TEST_P(SortThunkTest, SortInOrderBF16) {
+  bool is_stable = GetParam();
+
+  std::vector<bfloat16> keys = {bfloat16(0.5), bfloat16(-2.0), bfloat16(8.0),
+                                bfloat16(-0.25)};
+  std::vector<int32_t> indices = SortInOrder<bfloat16>(
+      BF16, keys, /*num_rows=*/1, is_stable,
+      {SortThunk::SortDirection::kDescending, /*total_order=*/false});
+
+  EXPECT_EQ(indices, std::vector<int32_t>({2, 0, 3, 1}));
+}
+
+TEST_P(SortThunkTest, SortInOrderLongRows) {
+  bool is_stable = GetParam();
+
+  // Large enough to sort the rows in parallel with radix sort.
+  constexpr int64_t kNumRows = 8;
+  constexpr int64_t kRowSize = 8192;
+
+  std::vector<int32_t> keys(kNumRows * kRowSize);
+  uint32_t state = 1;
+  for (int32_t& key : keys) {
+    state = state * 1664525u + 1013904223u;
+    key = static_cast<int32_t>(state) >> 8;  // many ties, some negative keys
+  }
+
+  // Reference sorted indices of each row.
+  std::vector<int32_t> expected(keys.size());
+  for (int64_t row = 0; row < kNumRows; ++row) {
+    auto begin = expected.begin() + row * kRowSize;
+    std::iota(begin, begin + kRowSize, 0);
+    std::stable_sort(begin, begin + kRowSize, [&](int32_t a, int32_t b) {
+      return keys[row * kRowSize + a] < keys[row * kRowSize + b];
+    });
+  }
+
+  tsl::thread::ThreadPool thread_pool(tsl::Env::Default(), "sort-test", 4);
+  Eigen::ThreadPoolDevice device(thread_pool.AsEigenThreadPool(),
+                                 thread_pool.NumThreads());
+
+  std::vector<int32_t> sorted_keys = keys;
+  std::vector<int32_t> indices = SortInOrder<int32_t>(
+      S32, sorted_keys, kNumRows, is_stable,
+      {SortThunk::SortDirection::kAscending, /*total_order=*/false}, &device);
+
+  EXPECT_EQ(indices, expected);
+  for (int64_t i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(sorted_keys[i], keys[(i / kRowSize) * kRowSize + indices[i]]);
+  }
+}
+
+TEST_P(SortThunkTest, SortInOrderFallsBackToComparatorForNaNs) {
+  bool is_stable = GetParam();
+
+  std::vector<MaybeOwningDeviceMemory> buffers;
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  std::vector<float> data = {2.0, nan, 1.0};
+
+  size_t size_in_bytes = data.size() * sizeof(float);
+  buffers.emplace_back(se::DeviceMemoryBase(data.data(), size_in_bytes));
+  BufferAllocations allocations(buffers);
+
+  BufferAllocation alloc(0, size_in_bytes, 0);
+  BufferAllocation::Slice slice(&alloc, 0, size_in_bytes);
+  Shape data_shape = ShapeUtil::MakeShape(F32, {3});
+
+  // Orders NaNs last, which IEEE comparisons can't express.
+  int64_t num_comparisons = 0;
+  auto nan_last = [&](const void** data) {
+    ++num_comparisons;
+    float lhs = *reinterpret_cast<const float*>(data[0]);
+    float rhs = *reinterpret_cast<const float*>(data[1]);
+    return std::isnan(rhs) ? !std::isnan(lhs) : lhs < rhs;
+  };
+
+  TF_ASSERT_OK_AND_ASSIGN(
+      auto thunk,
+      SortThunk::Create({"sort"}, {{slice, data_shape}}, /*dimension=*/0,
+                        is_stable, nan_last,
+                        SortThunk::SortOrder{
+                            SortThunk::SortDirection::kAscending,
+                            /*total_order=*/false}));
+
+  Thunk::ExecuteParams params;
+  params.buffer_allocations = &allocations;
+
+  auto execute_event = thunk->Execute(params);
+  tsl::BlockUntilReady(execute_event);
+  ASSERT_FALSE(execute_event.IsError());
+
+  EXPECT_GT(num_comparisons, 0);
+  EXPECT_EQ(data[0], 1.0);
+  EXPECT_EQ(data[1], 2.0);
+  EXPECT_TRUE(std::isnan(data[2]));
+}
+
 INSTANTIATE_TEST_SUITE_P(SortThunk, SortThunkTest, testing::Bool(),
                          testing::PrintToStringParamName());
 
@@ -53,6 +53,9 @@ struct ThreadPoolDevice;
 
 namespace xla::cpu {
 
+class ThunkProfiler;
+class ThunkSequence;
+
 // WARNING: This is under construction. Long term plan for XLA is to unify
 // runtimes between different backends and have a shared Thunk interface,
 // however for now we chose to have separate Thunk implementations in xla::cpu
@@ -97,6 +100,10 @@ class Thunk {
     std::string op_name;
     std::string module_name;
     int64_t module_id;
+
+    // Estimated cost of executing the thunk (flops and bytes accessed as
+    // estimated by HloCostAnalysis). Zero if unknown.
+    int64_t cost = 0;
   };
 
   // An abstract task runner that can be used by a ThunkExecutor (including
@@ -135,6 +142,14 @@ class Thunk {
   using ResourceUses = absl::InlinedVector<ResourceUse, 4>;
   virtual ResourceUses resource_uses() const { return {}; }
 
+  // Returns the thunk sequences executed by a thunk as a part of its execution
+  // (e.g. while loop condition and body). Only control flow thunks have nested
+  // thunk sequences, so we define a default implementation that returns an
+  // empty vector.
+  virtual std::vector<const ThunkSequence*> nested_thunk_sequences() const {
+    return {};
+  }
+
   //===--------------------------------------------------------------------===//
   // FunctionRegistry
   //===--------------------------------------------------------------------===//
@@ -280,6 +295,9 @@ class Thunk {
     TaskRunner* task_runner = nullptr;
     CollectiveExecuteParams* collective_params = nullptr;
     CustomCallExecuteParams* custom_call_params = nullptr;
+    // If not null, thunk executors sample executions of thunk sequences and
+    // record thunk execution times into the profiler.
+    ThunkProfiler* profiler = nullptr;
     ExecuteSession session = ExecuteSession(ExecuteSession::kMaxWorkers,
                                             ExecuteSession::kSplitThreshold);
   };
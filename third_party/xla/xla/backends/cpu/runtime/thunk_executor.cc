@@ -15,7 +15,10 @@ limitations under the License.
 
 #include "xla/backends/cpu/runtime/thunk_executor.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>  // NOLINT
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
@@ -34,6 +37,7 @@ limitations under the License.
 #include "absl/types/span.h"
 #include "xla/backends/cpu/runtime/resource_use.h"
 #include "xla/backends/cpu/runtime/thunk.h"
+#include "xla/backends/cpu/runtime/thunk_profiler.h"
 #include "xla/runtime/buffer_use.h"
 #include "xla/tsl/concurrency/async_value_ref.h"
 #include "tsl/platform/logging.h"
@@ -41,6 +45,21 @@ limitations under the License.
 
 namespace xla::cpu {
 
+// Offloading ready nodes to the task runner costs a few microseconds (we have
+// to wake up a worker thread), and with calibrated cost estimates we split the
+// ready queue only if it has at least this much work.
+static constexpr int64_t kMinSplitCostNanos = 20 * 1000;
+
+// With measured costs we refine cost estimates after the first execution, and
+// then after every `kCostEstimatesUpdateInterval` executions.
+static constexpr int64_t kCostEstimatesUpdateInterval = 16;
+
+static int64_t NowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
 ThunkExecutor::ThunkExecutor(ThunkSequence thunk_sequence,
                              std::vector<NodeDef> nodes_defs,
                              const ThunkExecutor::Options& options)
@@ -63,6 +82,22 @@ ThunkExecutor::ThunkExecutor(ThunkSequence thunk_sequence,
   // Erase redundant edges between nodes.
   int64_t num_erased_edges = RunTransitiveReductionAndUpdatePriorities();
 
+  // Estimate critical paths from the thunk costs estimated at compile time.
+  if (options_.use_critical_path_ready_queue) {
+    cost_model_ = std::make_unique<CostModel>();
+    cost_model_->static_costs.reserve(num_thunks_);
+    for (const std::unique_ptr<Thunk>& thunk : thunk_sequence_) {
+      cost_model_->static_costs.push_back(
+          std::max<int64_t>(1, thunk->info().cost));
+    }
+    cost_model_->measured_costs =
+        std::vector<std::atomic<int64_t>>(nodes_defs_.size());
+
+    std::shared_ptr<const CostEstimates> estimates = EstimateCosts();
+    absl::MutexLock lock(&cost_model_->mu);
+    cost_model_->estimates = std::move(estimates);
+  }
+
   // Check if constructed execution DAG is sequential: every node depends on the
   // completion of the previous node.
   for (NodeId i = 1; i < nodes_defs_.size() && is_sequential_; ++i) {
@@ -136,6 +171,8 @@ ThunkExecutor::ExecuteState::ExecuteState(ThunkExecutor* executor,
                                           Thunk::TaskRunner* runner)
     : executor(executor),
       runner(runner),
+      cost_model(nullptr),
+      profiler(nullptr),
       nodes(executor->nodes_defs().size()),
       execute_event(tsl::MakeConstructedAsyncValueRef<ExecuteEvent>()),
       pending_sink_nodes(executor->sink().size()),
@@ -155,25 +192,46 @@ tsl::AsyncValueRef<ThunkExecutor::ExecuteEvent> ThunkExecutor::Execute(
   if (ABSL_PREDICT_FALSE(num_thunks_ == 0)) {
     return Thunk::OkExecuteEventSingleton();
   }
-  if (ABSL_PREDICT_FALSE(num_thunks_ == 1)) {
+
+  // Sample execution for the thunk profiler. Sampled executions of a single
+  // thunk take the sequential path that records thunk timings.
+  std::shared_ptr<ThunkProfiler::Trace> trace;
+  if (ABSL_PREDICT_FALSE(params.profiler != nullptr)) {
+    trace = params.profiler->MaybeStartTrace(num_thunks_);
+  }
+
+  if (ABSL_PREDICT_FALSE(num_thunks_ == 1 && !trace)) {
     return thunk_sequence_[0]->Execute(params);
   }
 
   // If thunk sequence dependencies form a sequential execution graph, we skip
   // expensive async execution and simply run thunks one by one.
   if (is_sequential_) {
-    return ExecuteSequential(params);
+    return ExecuteSequential(params, std::move(trace));
   }
 
   // Create async execution state on heap and kick-off execution.
   auto state = std::make_unique<ExecuteState>(this, params.task_runner);
 
+  // Source nodes are ready to execute when the execution starts.
+  if (ABSL_PREDICT_FALSE(trace)) {
+    for (NodeId id : source_) trace->RecordReady(id);
+    state->profiler = params.profiler;
+    state->trace = std::move(trace);
+  }
+
   // When we kick-off execution we don't have to grab the session lock, as the
   // main thread is not counted towards the number of concurrent workers limit.
   // This also works for thunks with nested thunk executors (i.e., WhileThunk),
   // as launching nested thunk sequence must not reduce the available
   // concurrency for the other thunks executing in parallel.
-  if (options_.use_priority_ready_queue) {
+  if (options_.use_critical_path_ready_queue) {
+    state->cost_estimates = GetCostEstimatesForExecution();
+    if (options_.use_measured_costs) state->cost_model = cost_model_.get();
+    Execute(state.get(), params,
+            CriticalPathReadyQueue(state->cost_estimates.get(), source_),
+            /*lock=*/nullptr);
+  } else if (options_.use_priority_ready_queue) {
     Execute(state.get(), params, PriorityReadyQueue(nodes_defs_, source_),
             /*lock=*/nullptr);
   } else {
@@ -201,13 +259,18 @@ tsl::AsyncValueRef<ThunkExecutor::ExecuteEvent> ThunkExecutor::Execute(
 }
 
 tsl::AsyncValueRef<ThunkExecutor::ExecuteEvent>
-ThunkExecutor::ExecuteSequential(const Thunk::ExecuteParams& params) {
+ThunkExecutor::ExecuteSequential(const Thunk::ExecuteParams& params,
+                                 std::shared_ptr<ThunkProfiler::Trace> trace) {
   for (auto it = thunk_sequence_.begin(); it != thunk_sequence_.end(); ++it) {
     Thunk& thunk = **it;
+    size_t index = it - thunk_sequence_.begin();
+
+    if (ABSL_PREDICT_FALSE(trace)) trace->RecordStart(index);
     auto execute_event = thunk.Execute(params);
 
     // Fast path for thunks executed inline and returned OkExecuteEvent.
     if (ABSL_PREDICT_TRUE(thunk.IsOkExecuteEvent(execute_event))) {
+      if (ABSL_PREDICT_FALSE(trace)) trace->RecordEnd(index);
       continue;
     }
 
@@ -215,20 +278,30 @@ ThunkExecutor::ExecuteSequential(const Thunk::ExecuteParams& params) {
     // resume sequential execution starting from the next thunk.
     if (ABSL_PREDICT_FALSE(!execute_event.IsAvailable())) {
       auto event = tsl::MakeConstructedAsyncValueRef<ExecuteEvent>();
-      execute_event.AndThen([this, &params, it, event](absl::Status status) {
+      execute_event.AndThen([this, &params, it, index, event,
+                             trace = std::move(trace)](absl::Status status) {
         if (ABSL_PREDICT_FALSE(!status.ok())) {
           event.SetError(std::move(status));
         } else {
-          ResumeExecuteSequential(it + 1, params, std::move(event));
+          if (ABSL_PREDICT_FALSE(trace)) trace->RecordEnd(index);
+          ResumeExecuteSequential(it + 1, params, std::move(event),
+                                  std::move(trace));
         }
       });
       return event;
     }
 
-    // Abort execution if any of the thunks failed.
+    // Abort execution if any of the thunks failed. Traces of failed executions
+    // are dropped.
     if (ABSL_PREDICT_FALSE(execute_event.IsError())) {
       return execute_event;
     }
+
+    if (ABSL_PREDICT_FALSE(trace)) trace->RecordEnd(index);
+  }
+
+  if (ABSL_PREDICT_FALSE(trace)) {
+    params.profiler->FinishTrace(*trace, thunk_sequence_);
   }
 
   // If we got to the end of the sequence it means that all thunks have
@@ -238,27 +311,34 @@ ThunkExecutor::ExecuteSequential(const Thunk::ExecuteParams& params) {
 
 void ThunkExecutor::ResumeExecuteSequential(
     ThunkIterator it, const Thunk::ExecuteParams& params,
-    tsl::AsyncValueRef<ExecuteEvent> event) {
+    tsl::AsyncValueRef<ExecuteEvent> event,
+    std::shared_ptr<ThunkProfiler::Trace> trace) {
   for (; it != thunk_sequence_.end(); ++it) {
     Thunk& thunk = **it;
+    size_t index = it - thunk_sequence_.begin();
+
+    if (ABSL_PREDICT_FALSE(trace)) trace->RecordStart(index);
     auto execute_event = thunk.Execute(params);
 
     // Fast path for thunks executed inline and returned OkExecuteEvent.
     if (ABSL_PREDICT_TRUE(thunk.IsOkExecuteEvent(execute_event))) {
+      if (ABSL_PREDICT_FALSE(trace)) trace->RecordEnd(index);
       continue;
     }
 
     // If thunk execution is not completed yet, attach a continuation to
     // resume sequential execution starting from the next thunk.
     if (ABSL_PREDICT_FALSE(!execute_event.IsAvailable())) {
-      execute_event.AndThen(
-          [this, &params, it, event = std::move(event)](absl::Status status) {
-            if (ABSL_PREDICT_FALSE(!status.ok())) {
-              event.SetError(std::move(status));
-            } else {
-              ResumeExecuteSequential(it + 1, params, std::move(event));
-            }
-          });
+      execute_event.AndThen([this, &params, it, index, event = std::move(event),
+                             trace = std::move(trace)](absl::Status status) {
+        if (ABSL_PREDICT_FALSE(!status.ok())) {
+          event.SetError(std::move(status));
+        } else {
+          if (ABSL_PREDICT_FALSE(trace)) trace->RecordEnd(index);
+          ResumeExecuteSequential(it + 1, params, std::move(event),
+                                  std::move(trace));
+        }
+      });
       return;
     }
 
@@ -267,6 +347,12 @@ void ThunkExecutor::ResumeExecuteSequential(
       event.SetError(execute_event.GetError());
       return;
     }
+
+    if (ABSL_PREDICT_FALSE(trace)) trace->RecordEnd(index);
+  }
+
+  if (ABSL_PREDICT_FALSE(trace)) {
+    params.profiler->FinishTrace(*trace, thunk_sequence_);
   }
 
   // If we got to the end of the sequence it means that all thunks have
@@ -302,20 +388,36 @@ void ThunkExecutor::Execute(ExecuteState* state,
 
     // If we have multiple ready thunks, split the ready queue and offload
     // thunks processing to the task runner.
-    int64_t num_ready_thunks = ready_queue.Size();
-    if (ABSL_PREDICT_FALSE(has_runner && num_ready_thunks > split_threshold)) {
+    if (ABSL_PREDICT_FALSE(has_runner &&
+                           ready_queue.ShouldSplit(split_threshold))) {
       SplitReadyQueue(state, params, ready_queue, split_threshold);
     }
 
     // Execute thunk for the given node id. If execution is aborted, we keep
     // processing the nodes DAG without executing thunks.
+    bool abort = state->abort.load(std::memory_order_relaxed);
+
+    // Measure thunk execution time if we refine cost estimates with it.
+    CostModel* cost_model = ABSL_PREDICT_FALSE(abort) ? nullptr
+                                                      : state->cost_model;
+    int64_t start_nanos = ABSL_PREDICT_FALSE(cost_model) ? NowNanos() : 0;
+
+    // Record thunk timings if the execution is sampled by the profiler.
+    ThunkProfiler::Trace* trace =
+        ABSL_PREDICT_FALSE(abort) ? nullptr : state->trace.get();
+    if (ABSL_PREDICT_FALSE(trace)) trace->RecordStart(id);
+
     Thunk& thunk = *state->executor->thunk_sequence_[id];
     tsl::AsyncValueRef<ExecuteEvent> execute_event =
-        ABSL_PREDICT_FALSE(state->abort.load(std::memory_order_relaxed))
-            ? Thunk::OkExecuteEventSingleton()
-            : thunk.Execute(params);
+        ABSL_PREDICT_FALSE(abort) ? Thunk::OkExecuteEventSingleton()
+                                  : thunk.Execute(params);
 
     if (ABSL_PREDICT_TRUE(execute_event.IsAvailable())) {
+      if (ABSL_PREDICT_FALSE(cost_model)) {
+        cost_model->RecordExecutionTime(id, NowNanos() - start_nanos);
+      }
+      if (ABSL_PREDICT_FALSE(trace)) trace->RecordEnd(id);
+
       // If thunk execution is completed, process out edges in the current
       // thread and keep working on the ready queue.
       ProcessOutEdges(state, execute_event.AsPtr(), node, ready_queue);
@@ -332,10 +434,15 @@ void ThunkExecutor::Execute(ExecuteState* state,
       // queue, we will forward the lock that we already hold (note that the
       // lock might be empty, if `Execute` was called by the main thread).
       execute_event.AndThen(
-          [&params, &node, state, execute_event = execute_event.AsPtr(),
+          [&params, &node, state, id, cost_model, start_nanos, trace,
+           execute_event = execute_event.AsPtr(),
            ready_queue = ready_queue.CreateEmptyReadyQueue(),
            lock = ready_queue.Empty() ? std::move(lock)
                                       : params.session.Join()]() mutable {
+            if (ABSL_PREDICT_FALSE(cost_model)) {
+              cost_model->RecordExecutionTime(id, NowNanos() - start_nanos);
+            }
+            if (ABSL_PREDICT_FALSE(trace)) trace->RecordEnd(id);
             state->executor->ProcessOutEdges(state, execute_event, node,
                                              ready_queue);
             // If ready queue is empty, it might mean that we have completed an
@@ -360,7 +467,7 @@ inline ABSL_ATTRIBUTE_ALWAYS_INLINE void ThunkExecutor::SplitReadyQueue(
   // the task runner. Recursive work splitting creates a more uniform work
   // distribution across the task runner threads and avoids a situation when
   // we have a long tail of work that is processed by a single thread.
-  while (ready_queue.Size() > split_threshold) {
+  while (ready_queue.ShouldSplit(split_threshold)) {
     // Try to acquire a lock to offload ready thunks to the task runner. If
     // we can't get a lock, we will keep processing the ready queue in the
     // current thread as it means that we have enough concurrent workers
@@ -397,12 +504,16 @@ void ThunkExecutor::ProcessOutEdges(
   bool is_sink = node.out_edges->empty();
 
   // Append ready nodes to the back of the ready queue.
+  ThunkProfiler::Trace* trace = state->trace.get();
   for (NodeId out_edge : *node.out_edges) {
     ExecuteState::Node& out_node = state->node(out_edge);
 
     int64_t cnt = out_node.counter.fetch_sub(1, std::memory_order_release);
     DCHECK_GE(cnt, 1) << "Node counter can't drop below 0";
-    if (cnt == 1) ready_queue.Push(out_edge);
+    if (cnt == 1) {
+      if (ABSL_PREDICT_FALSE(trace)) trace->RecordReady(out_edge);
+      ready_queue.Push(out_edge);
+    }
   }
 
   // Drop the pending sink nodes counter if the node is a sink.
@@ -425,6 +536,11 @@ void ThunkExecutor::ProcessOutEdges(
       };
       state->execute_event.SetError(take_error());
     } else {
+      // All thunks completed execution, and their timings are visible to the
+      // current thread. Traces of failed executions are dropped.
+      if (ABSL_PREDICT_FALSE(trace)) {
+        state->profiler->FinishTrace(*trace, thunk_sequence_);
+      }
       state->execute_event.SetStateConcrete();
     }
   }
@@ -527,6 +643,104 @@ int64_t ThunkExecutor::RunTransitiveReductionAndUpdatePriorities() {
   return num_erased_edges;
 }
 
+std::shared_ptr<const ThunkExecutor::CostEstimates>
+ThunkExecutor::EstimateCosts() const {
+  DCHECK(cost_model_) << "Cost model must be initialized";
+  const std::vector<int64_t>& static_costs = cost_model_->static_costs;
+
+  auto estimates = std::make_shared<CostEstimates>();
+  estimates->costs.resize(nodes_defs_.size());
+
+  // Use measured costs for thunks that were executed at least once.
+  int64_t sum_measured_costs = 0;
+  int64_t sum_static_costs = 0;
+  for (NodeId i = 0; i < nodes_defs_.size(); ++i) {
+    int64_t measured_cost =
+        cost_model_->measured_costs[i].load(std::memory_order_relaxed);
+    estimates->costs[i] = measured_cost;
+    if (measured_cost > 0) {
+      sum_measured_costs += measured_cost;
+      sum_static_costs += static_costs[i];
+    }
+  }
+
+  // Scale static costs of thunks that were not executed yet to nanoseconds,
+  // using the ratio between measured and static costs of executed thunks.
+  estimates->calibrated = sum_static_costs > 0;
+  double scale = estimates->calibrated
+                     ? static_cast<double>(sum_measured_costs) /
+                           static_cast<double>(sum_static_costs)
+                     : 1.0;
+  for (NodeId i = 0; i < nodes_defs_.size(); ++i) {
+    if (estimates->costs[i] == 0) {
+      estimates->costs[i] =
+          std::max<int64_t>(1, std::llround(static_costs[i] * scale));
+    }
+  }
+
+  if (estimates->calibrated) {
+    estimates->split_cost = kMinSplitCostNanos;
+  }
+
+  // Nodes are sorted in topological order (all edges go from nodes with
+  // smaller ids to nodes with larger ids), and we compute critical paths in a
+  // single pass in reverse order. Transitive reduction doesn't change the
+  // critical paths, as all erased edges are shortcuts of longer paths.
+  estimates->critical_paths.resize(nodes_defs_.size());
+  for (NodeId i = nodes_defs_.size() - 1; i >= 0; --i) {
+    int64_t out_critical_path = 0;
+    for (NodeId out_edge : nodes_defs_[i].out_edges) {
+      out_critical_path =
+          std::max(out_critical_path, estimates->critical_paths[out_edge]);
+    }
+    estimates->critical_paths[i] = estimates->costs[i] + out_critical_path;
+  }
+
+  return estimates;
+}
+
+std::shared_ptr<const ThunkExecutor::CostEstimates>
+ThunkExecutor::GetCostEstimatesForExecution() {
+  int64_t num_executions =
+      cost_model_->num_executions.fetch_add(1, std::memory_order_relaxed);
+
+  bool update_estimates =
+      options_.use_measured_costs && num_executions > 0 &&
+      (num_executions == 1 ||
+       num_executions % kCostEstimatesUpdateInterval == 0);
+
+  if (ABSL_PREDICT_FALSE(update_estimates)) {
+    std::shared_ptr<const CostEstimates> estimates = EstimateCosts();
+    VLOG(3) << absl::StreamFormat(
+        "Updated ThunkExecutor cost estimates after %d executions: "
+        "critical_path=%d",
+        num_executions, *absl::c_max_element(estimates->critical_paths));
+    absl::MutexLock lock(&cost_model_->mu);
+    cost_model_->estimates = std::move(estimates);
+  }
+
+  absl::MutexLock lock(&cost_model_->mu);
+  return cost_model_->estimates;
+}
+
+std::shared_ptr<const ThunkExecutor::CostEstimates>
+ThunkExecutor::cost_estimates() const {
+  if (cost_model_ == nullptr) return nullptr;
+  absl::MutexLock lock(&cost_model_->mu);
+  return cost_model_->estimates;
+}
+
+void ThunkExecutor::CostModel::RecordExecutionTime(NodeId id, int64_t nanos) {
+  // Keep an exponential moving average of execution times. Concurrent
+  // executions of the same thunk might lose updates, which is fine for an
+  // estimate, and we don't want to pay for a CAS loop.
+  nanos = std::max<int64_t>(1, nanos);
+  std::atomic<int64_t>& cost = measured_costs[id];
+  int64_t average = cost.load(std::memory_order_relaxed);
+  cost.store(average == 0 ? nanos : average + (nanos - average) / 4,
+             std::memory_order_relaxed);
+}
+
 std::string ThunkExecutor::ToString() const {
   std::string str = absl::StrFormat(
       "ThunkExecutor: #thunks=%d #source_nodes=%d #sink_nodes=%d", num_thunks_,
@@ -540,6 +754,8 @@ std::string ThunkExecutor::ToString() const {
     }
   }
 
+  std::shared_ptr<const CostEstimates> estimates = cost_estimates();
+
   // Print thunks with a list of their dependencies;
   for (NodeId i = 0; i < num_thunks_; ++i) {
     const Thunk& thunk = *thunk_sequence_[i];
@@ -551,6 +767,11 @@ std::string ThunkExecutor::ToString() const {
                           i, thunk.info().op_name,
                           absl::StrJoin(in_edges[i], ", "), is_source, is_sink,
                           nodes_defs_[i].priority);
+    if (estimates) {
+      absl::StrAppendFormat(&str, ", cost=%d, critical_path=%d",
+                            estimates->costs[i],
+                            estimates->critical_paths[i]);
+    }
   }
 
   return str;
@@ -583,6 +804,10 @@ bool ThunkExecutor::FifoReadyQueue::Empty() const {
   return head_ == queue_.size();
 }
 
+bool ThunkExecutor::FifoReadyQueue::ShouldSplit(int64_t split_threshold) const {
+  return Size() > split_threshold;
+}
+
 ThunkExecutor::FifoReadyQueue
 ThunkExecutor::FifoReadyQueue::CreateEmptyReadyQueue() const {
   return FifoReadyQueue(absl::Span<const NodeId>());
@@ -624,9 +849,81 @@ size_t ThunkExecutor::PriorityReadyQueue::Size() const { return queue_.size(); }
 
 bool ThunkExecutor::PriorityReadyQueue::Empty() const { return queue_.empty(); }
 
+bool ThunkExecutor::PriorityReadyQueue::ShouldSplit(
+    int64_t split_threshold) const {
+  return Size() > split_threshold;
+}
+
 ThunkExecutor::PriorityReadyQueue
 ThunkExecutor::PriorityReadyQueue::CreateEmptyReadyQueue() const {
   return PriorityReadyQueue(nodes_defs_, {});
 }
 
+ThunkExecutor::CriticalPathReadyQueue::CriticalPathReadyQueue(
+    const CostEstimates* estimates, absl::Span<const NodeId> ready_nodes)
+    : estimates_(estimates),
+      queue_(ready_nodes.begin(), ready_nodes.end(), Compare{estimates}) {
+  for (NodeId id : ready_nodes) queued_cost_ += estimates_->costs[id];
+}
+
+void ThunkExecutor::CriticalPathReadyQueue::Push(NodeId id) {
+  queue_.push(id);
+  queued_cost_ += estimates_->costs[id];
+}
+
+ThunkExecutor::NodeId ThunkExecutor::CriticalPathReadyQueue::Pop() {
+  DCHECK(!Empty()) << "Queue must not be empty";
+  NodeId id = queue_.top();
+  queue_.pop();
+  queued_cost_ -= estimates_->costs[id];
+  return id;
+}
+
+ThunkExecutor::CriticalPathReadyQueue
+ThunkExecutor::CriticalPathReadyQueue::PopHalf() {
+  DCHECK(!Empty()) << "Queue must not be empty";
+
+  // Add nodes in the critical path order to the queue with the smaller cost.
+  // Popped queue gets the node with the longest critical path, because the
+  // caller already has a node to execute (the one it popped last).
+  CriticalPathReadyQueue popped(estimates_, {});
+  CriticalPathReadyQueue kept(estimates_, {});
+  while (!Empty()) {
+    NodeId id = Pop();
+    if (popped.queued_cost_ <= kept.queued_cost_) {
+      popped.Push(id);
+    } else {
+      kept.Push(id);
+    }
+  }
+
+  queue_ = std::move(kept.queue_);
+  queued_cost_ = kept.queued_cost_;
+  return popped;
+}
+
+size_t ThunkExecutor::CriticalPathReadyQueue::Size() const {
+  return queue_.size();
+}
+
+bool ThunkExecutor::CriticalPathReadyQueue::Empty() const {
+  return queue_.empty();
+}
+
+bool ThunkExecutor::CriticalPathReadyQueue::ShouldSplit(
+    int64_t split_threshold) const {
+  // With calibrated estimates we know how much work we have in the queue, and
+  // split it even if it has a single expensive node, or don't split at all if
+  // all ready nodes are cheap.
+  if (estimates_->calibrated) {
+    return !Empty() && queued_cost_ >= estimates_->split_cost;
+  }
+  return Size() > split_threshold;
+}
+
+ThunkExecutor::CriticalPathReadyQueue
+ThunkExecutor::CriticalPathReadyQueue::CreateEmptyReadyQueue() const {
+  return CriticalPathReadyQueue(estimates_, {});
+}
+
 }  // namespace xla::cpu
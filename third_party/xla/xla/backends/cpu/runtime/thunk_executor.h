@@ -20,6 +20,7 @@ limitations under the License.
 #include <cstddef>
 #include <cstdint>
 #include <limits>
+#include <memory>
 #include <new>
 #include <queue>
 #include <string>
@@ -34,6 +35,7 @@ limitations under the License.
 #include "absl/synchronization/mutex.h"
 #include "absl/types/span.h"
 #include "xla/backends/cpu/runtime/thunk.h"
+#include "xla/backends/cpu/runtime/thunk_profiler.h"
 #include "xla/tsl/concurrency/async_value_ref.h"
 
 namespace xla::cpu {
@@ -50,6 +52,17 @@ struct ThunkExecutorOptions {
   // Use priority ready queue to execute nodes according to their priority. By
   // default we use FIFO ready queue.
   bool use_priority_ready_queue = false;
+
+  // Use critical path ready queue to execute first the nodes with the longest
+  // estimated path to the sink nodes, where each node costs `Thunk::Info::cost`
+  // (at least one). Takes precedence over `use_priority_ready_queue`.
+  bool use_critical_path_ready_queue = false;
+
+  // If true, the critical path ready queue measures thunk execution times and
+  // periodically replaces the estimated node costs with the measured ones. Once
+  // execution times are known, the executor splits the ready queue only if it
+  // has enough work to amortize the cost of offloading it to another thread.
+  bool use_measured_costs = false;
 };
 }  // namespace internal
 
@@ -82,6 +95,21 @@ class ThunkExecutor {
     std::vector<NodeId> out_edges;
   };
 
+  // Estimated costs of executing the nodes and of the critical paths starting
+  // at them (the most expensive paths to the sink nodes). Costs are measured in
+  // nanoseconds if `calibrated` is true, and in `Thunk::Info::cost` units
+  // otherwise.
+  struct CostEstimates {
+    std::vector<int64_t> costs;
+    std::vector<int64_t> critical_paths;
+    bool calibrated = false;
+
+    // The ready queue is split if the cost of the ready nodes is at least
+    // `split_cost`, or if the number of ready nodes is above the execute
+    // session split threshold and estimates are not calibrated.
+    int64_t split_cost = std::numeric_limits<int64_t>::max();
+  };
+
   // Executes the thunk sequence using the prepared dataflow graph. Executor
   // uses runner to execute ready tasks concurrently. If runner is not provided,
   // executes all tasks in the caller thread.
@@ -99,10 +127,16 @@ class ThunkExecutor {
   BufferUses buffer_uses() const { return thunk_sequence_.buffer_uses(); }
   ResourceUses resource_uses() const { return thunk_sequence_.resource_uses(); }
 
+  const ThunkSequence& thunk_sequence() const { return thunk_sequence_; }
+
   std::string ToString() const;
 
   bool is_sequential() const { return is_sequential_; }
 
+  // Returns the cost estimates used by the critical path ready queue, or
+  // nullptr if it is not used.
+  std::shared_ptr<const CostEstimates> cost_estimates() const;
+
   // A ready queue that executes nodes in FIFO order.
   class FifoReadyQueue {
    public:
@@ -115,6 +149,7 @@ class ThunkExecutor {
 
     size_t Size() const;
     bool Empty() const;
+    bool ShouldSplit(int64_t split_threshold) const;
 
     FifoReadyQueue CreateEmptyReadyQueue() const;
 
@@ -136,6 +171,7 @@ class ThunkExecutor {
 
     size_t Size() const;
     bool Empty() const;
+    bool ShouldSplit(int64_t split_threshold) const;
 
     PriorityReadyQueue CreateEmptyReadyQueue() const;
 
@@ -154,6 +190,48 @@ class ThunkExecutor {
     InlinedPriorityQueue queue_;
   };
 
+  // A ready queue that executes nodes with the longest estimated critical path
+  // first, and keeps track of the estimated cost of the ready nodes.
+  class CriticalPathReadyQueue {
+   public:
+    CriticalPathReadyQueue(const CostEstimates* estimates,
+                           absl::Span<const NodeId> ready_nodes);
+
+    void Push(NodeId id);
+
+    NodeId Pop();
+
+    // Pops nodes with a cost of about half of the queued cost. Nodes are
+    // distributed in the critical path order, so that the most expensive paths
+    // end up in different queues.
+    CriticalPathReadyQueue PopHalf();
+
+    size_t Size() const;
+    bool Empty() const;
+    bool ShouldSplit(int64_t split_threshold) const;
+
+    int64_t queued_cost() const { return queued_cost_; }
+
+    CriticalPathReadyQueue CreateEmptyReadyQueue() const;
+
+   private:
+    struct Compare {
+      bool operator()(NodeId a, NodeId b) const {
+        // Break ties in favor of nodes that come first in the thunk sequence.
+        const std::vector<int64_t>& paths = estimates->critical_paths;
+        return paths[a] < paths[b] || (paths[a] == paths[b] && a > b);
+      }
+      const CostEstimates* estimates;
+    };
+
+    using InlinedPriorityQueue =
+        std::priority_queue<NodeId, absl::InlinedVector<NodeId, 8>, Compare>;
+
+    const CostEstimates* estimates_;
+    InlinedPriorityQueue queue_;
+    int64_t queued_cost_ = 0;
+  };
+
  private:
   // Align all atomic counters to a cache line boundary to avoid false
   // sharing between multiple worker threads.
@@ -164,6 +242,24 @@ class ThunkExecutor {
       64;
 #endif
 
+  // Thunk costs shared by all executions of the thunk sequence. Allocated on
+  // the heap, as the executor must be movable.
+  struct CostModel {
+    // Costs estimated at compile time, at least one for every thunk.
+    std::vector<int64_t> static_costs;
+
+    // Moving averages of measured execution times in nanoseconds, zero for
+    // thunks that were not executed yet.
+    std::vector<std::atomic<int64_t>> measured_costs;
+
+    alignas(kAtomicAlignment) std::atomic<int64_t> num_executions{0};
+
+    absl::Mutex mu;
+    std::shared_ptr<const CostEstimates> estimates ABSL_GUARDED_BY(mu);
+
+    void RecordExecutionTime(NodeId id, int64_t nanos);
+  };
+
   // A struct to keep the state of a running ThunkExecutor.
   struct ExecuteState {
     // At run time NodeDef instantiated as a Node with an atomic counter that
@@ -189,6 +285,18 @@ class ThunkExecutor {
     ThunkExecutor* executor;
     Thunk::TaskRunner* runner;
 
+    // A snapshot of the cost estimates used by the critical path ready queue,
+    // which stays the same for the whole execution.
+    std::shared_ptr<const CostEstimates> cost_estimates;
+
+    // If not null, thunk execution times are recorded into the cost model.
+    CostModel* cost_model;
+
+    // If not null, the execution is sampled by `profiler` and thunk timings are
+    // recorded into `trace`.
+    ThunkProfiler* profiler;
+    std::shared_ptr<ThunkProfiler::Trace> trace;
+
     absl::FixedArray<NodeStorage> nodes;
     tsl::AsyncValueRef<ExecuteEvent> execute_event;
 
@@ -206,15 +314,25 @@ class ThunkExecutor {
   ThunkExecutor(ThunkSequence thunk_sequence, std::vector<NodeDef> nodes_defs,
                 const Options& options);
 
+  // Returns cost estimates computed from the static and measured costs.
+  std::shared_ptr<const CostEstimates> EstimateCosts() const;
+
+  // Returns cost estimates for a new execution, and periodically refines them
+  // with the measured execution times.
+  std::shared_ptr<const CostEstimates> GetCostEstimatesForExecution();
+
   // Executes thunks sequentially starting from the first thunk in the sequence.
+  // If `trace` is not null, records thunk timings into it.
   tsl::AsyncValueRef<ExecuteEvent> ExecuteSequential(
-      const Thunk::ExecuteParams& params);
+      const Thunk::ExecuteParams& params,
+      std::shared_ptr<ThunkProfiler::Trace> trace);
 
   // Resumes sequential thunk execution starting from the given index.
   using ThunkIterator = typename ThunkSequence::iterator;
   void ResumeExecuteSequential(ThunkIterator it,
                                const Thunk::ExecuteParams& params,
-                               tsl::AsyncValueRef<ExecuteEvent> event);
+                               tsl::AsyncValueRef<ExecuteEvent> event,
+                               std::shared_ptr<ThunkProfiler::Trace> trace);
 
   // Executes nodes in the ready queue with given thunk parameters.
   template <typename ReadyQueue>
@@ -251,6 +369,9 @@ class ThunkExecutor {
   std::vector<NodeId> source_;
   std::vector<NodeId> sink_;
 
+  // Not null if the critical path ready queue is used.
+  std::unique_ptr<CostModel> cost_model_;
+
   // If NodeDef graph dependency structure is sequential and does not have any
   // opportunities for executing thunks concurrently, we skip the expensive
   // async execution and simply run thunks in the `thunk_sequence_` one by one.
@@ -18,6 +18,7 @@ limitations under the License.
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <random>
@@ -33,6 +34,7 @@ limitations under the License.
 #include "xla/backends/cpu/runtime/buffer_allocations.h"
 #include "xla/backends/cpu/runtime/resource_use.h"
 #include "xla/backends/cpu/runtime/thunk.h"
+#include "xla/backends/cpu/runtime/thunk_profiler.h"
 #include "xla/runtime/buffer_use.h"
 #include "xla/service/buffer_assignment.h"
 #include "xla/service/maybe_owning_device_memory.h"
@@ -72,13 +74,14 @@ class AddI32Thunk final : public Thunk {
   AddI32Thunk(std::string name, std::vector<BufferAllocation::Slice> srcs,
               std::vector<BufferAllocation::Slice> dsts,
               std::vector<std::string>* trace, bool use_shared_resource,
-              bool inject_error);
+              bool inject_error, int64_t cost);
 
   static std::unique_ptr<Thunk> Create(
       std::string name, std::vector<BufferAllocation::Slice> srcs,
       std::vector<BufferAllocation::Slice> dsts,
       std::vector<std::string>* trace = nullptr,
-      bool use_shared_resource = false, bool inject_error = false);
+      bool use_shared_resource = false, bool inject_error = false,
+      int64_t cost = 0);
 
   static std::vector<MaybeOwningDeviceMemory> AsDeviceMemory(
       absl::Span<std::vector<int32_t>* const> data);
@@ -104,10 +107,10 @@ class AddI32Thunk final : public Thunk {
 std::unique_ptr<Thunk> AddI32Thunk::Create(
     std::string name, std::vector<BufferAllocation::Slice> srcs,
     std::vector<BufferAllocation::Slice> dsts, std::vector<std::string>* trace,
-    bool use_shared_resource, bool inject_error) {
+    bool use_shared_resource, bool inject_error, int64_t cost) {
   return std::make_unique<AddI32Thunk>(std::move(name), std::move(srcs),
                                        std::move(dsts), trace,
-                                       use_shared_resource, inject_error);
+                                       use_shared_resource, inject_error, cost);
 }
 
 std::vector<MaybeOwningDeviceMemory> AddI32Thunk::AsDeviceMemory(
@@ -124,8 +127,10 @@ AddI32Thunk::AddI32Thunk(std::string name,
                          std::vector<BufferAllocation::Slice> srcs,
                          std::vector<BufferAllocation::Slice> dsts,
                          std::vector<std::string>* trace,
-                         bool use_shared_resource, bool inject_error)
-    : Thunk(Kind::kKernel, Info{name}),
+                         bool use_shared_resource, bool inject_error,
+                         int64_t cost)
+    : Thunk(Kind::kKernel, Info{name, /*module_name=*/"", /*module_id=*/0,
+                                cost}),
       srcs_(std::move(srcs)),
       dsts_(std::move(dsts)),
       trace_(trace),
@@ -336,6 +341,54 @@ TEST(ThunkExecutorTest, PriorityReadyQueueTest) {
   EXPECT_EQ(half2.Pop(), 1);
 }
 
+TEST(ThunkExecutorTest, CriticalPathReadyQueueTest) {
+  ThunkExecutor::CostEstimates estimates;
+  estimates.costs = {1, 1, 1, 10, 1, 1};
+  estimates.critical_paths = {1, 2, 3, 40, 5, 6};
+
+  ThunkExecutor::CriticalPathReadyQueue queue(&estimates, {});
+  // Check basic queue properties.
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_EQ(queue.Size(), 0);
+  EXPECT_EQ(queue.queued_cost(), 0);
+
+  queue.Push(1);
+  queue.Push(3);
+  queue.Push(2);
+  EXPECT_EQ(queue.queued_cost(), 12);
+
+  EXPECT_EQ(queue.Pop(), 3);
+  EXPECT_EQ(queue.Pop(), 2);
+  EXPECT_EQ(queue.Pop(), 1);
+
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_EQ(queue.queued_cost(), 0);
+
+  // Nodes are distributed between queues by their cost, and the popped half
+  // gets the node with the longest critical path.
+  for (ThunkExecutor::NodeId id : {0, 1, 2, 3, 4, 5}) queue.Push(id);
+
+  ThunkExecutor::CriticalPathReadyQueue half = queue.PopHalf();
+  EXPECT_EQ(half.Size(), 1);
+  EXPECT_EQ(half.queued_cost(), 10);
+  EXPECT_EQ(half.Pop(), 3);
+
+  EXPECT_EQ(queue.Size(), 5);
+  EXPECT_EQ(queue.queued_cost(), 5);
+  EXPECT_EQ(queue.Pop(), 5);
+
+  // Without calibrated estimates we split the queue by the number of nodes.
+  EXPECT_TRUE(queue.ShouldSplit(/*split_threshold=*/3));
+  EXPECT_FALSE(queue.ShouldSplit(/*split_threshold=*/4));
+
+  // With calibrated estimates we split the queue by the cost of the nodes.
+  estimates.calibrated = true;
+  estimates.split_cost = 4;
+  EXPECT_TRUE(queue.ShouldSplit(/*split_threshold=*/8));
+  estimates.split_cost = 5;
+  EXPECT_FALSE(queue.ShouldSplit(/*split_threshold=*/0));
+}
+
 TEST(ThunkExecutorTest, DependencyOrdering) {
   BufferAllocation alloc(/*index=*/0, /*size=*/80, /*color=*/0);
 
@@ -435,6 +488,130 @@ TEST(ThunkExecutorTest, TransitiveReduction) {
   EXPECT_EQ(executor.node_def(2).priority, 0);
 }
 
+TEST(ThunkExecutorTest, CriticalPathCosts) {
+  BufferAllocation alloc(/*index=*/0, /*size=*/80, /*color=*/0);
+
+  BufferAllocation::Slice slice0(&alloc, /*offset=*/0, /*size=*/40);
+  BufferAllocation::Slice slice1(&alloc, /*offset=*/40, /*size=*/40);
+
+  // Thunks `b` and `c` form a chain that is more expensive than thunk `a`,
+  // although `a` has more dependent nodes.
+  ThunkSequence sequence;
+  sequence.push_back(AddI32Thunk::Create("a", {slice0}, {slice0}, nullptr,
+                                         false, false, /*cost=*/10));
+  sequence.push_back(AddI32Thunk::Create("b", {slice1}, {slice1}, nullptr,
+                                         false, false, /*cost=*/100));
+  sequence.push_back(AddI32Thunk::Create("c", {slice1}, {slice1}, nullptr,
+                                         false, false, /*cost=*/100));
+  sequence.push_back(AddI32Thunk::Create("d", {slice0}, {slice0}, nullptr,
+                                         false, false, /*cost=*/0));
+  sequence.push_back(AddI32Thunk::Create("e", {slice0}, {slice0}, nullptr,
+                                         false, false, /*cost=*/0));
+
+  ThunkExecutor::Options options = OptionsForTest();
+  options.use_critical_path_ready_queue = true;
+
+  TF_ASSERT_OK_AND_ASSIGN(ThunkExecutor executor,
+                          ThunkExecutor::Create(std::move(sequence), options));
+
+  EXPECT_EQ(executor.node_def(0).priority, 2);
+  EXPECT_EQ(executor.node_def(1).priority, 1);
+
+  std::shared_ptr<const ThunkExecutor::CostEstimates> estimates =
+      executor.cost_estimates();
+  ASSERT_NE(estimates, nullptr);
+  EXPECT_FALSE(estimates->calibrated);
+  EXPECT_THAT(estimates->costs, ElementsAre(10, 100, 100, 1, 1));
+  EXPECT_THAT(estimates->critical_paths, ElementsAre(12, 200, 100, 2, 1));
+}
+
+TEST(ThunkExecutorTest, ExecuteCriticalPathFirst) {
+  BufferAllocation alloc(/*index=*/0, /*size=*/80, /*color=*/0);
+
+  BufferAllocation::Slice slice0(&alloc, /*offset=*/0, /*size=*/40);
+  BufferAllocation::Slice slice1(&alloc, /*offset=*/40, /*size=*/40);
+
+  std::vector<std::string> trace;
+
+  ThunkSequence sequence;
+  sequence.push_back(AddI32Thunk::Create("a", {slice0}, {slice0}, &trace,
+                                         false, false, /*cost=*/10));
+  sequence.push_back(AddI32Thunk::Create("b", {slice1}, {slice1}, &trace,
+                                         false, false, /*cost=*/100));
+  sequence.push_back(AddI32Thunk::Create("c", {slice1}, {slice1}, &trace,
+                                         false, false, /*cost=*/100));
+  sequence.push_back(AddI32Thunk::Create("d", {slice0}, {slice0}, &trace,
+                                         false, false, /*cost=*/10));
+
+  ThunkExecutor::Options options = OptionsForTest();
+  options.use_critical_path_ready_queue = true;
+
+  TF_ASSERT_OK_AND_ASSIGN(ThunkExecutor executor,
+                          ThunkExecutor::Create(std::move(sequence), options));
+
+  std::vector<int32_t> data(20, 1);  // shared src and dst allocation
+
+  auto buffers = AddI32Thunk::AsDeviceMemory({&data});
+  BufferAllocations allocations(buffers);
+
+  Thunk::ExecuteParams params = {nullptr, &allocations};
+
+  auto execute_event = executor.Execute(params);
+
+  tsl::BlockUntilReady(execute_event);
+  ASSERT_TRUE(execute_event.IsConcrete());
+
+  // FIFO ready queue would execute thunks in "a", "b", "d", "c" order.
+  EXPECT_THAT(trace, ElementsAre("b", "c", "a", "d"));
+  EXPECT_THAT(data, ElementsAre(4, 4, 4, 4, 4, 4, 4, 4, 4, 4,  // slice0
+                                4, 4, 4, 4, 4, 4, 4, 4, 4, 4));  // slice1
+}
+
+TEST(ThunkExecutorTest, ExecuteWithMeasuredCosts) {
+  BufferAllocation alloc(/*index=*/0, /*size=*/80, /*color=*/0);
+
+  BufferAllocation::Slice slice0(&alloc, /*offset=*/0, /*size=*/40);
+  BufferAllocation::Slice slice1(&alloc, /*offset=*/40, /*size=*/40);
+
+  ThunkSequence sequence;
+  sequence.push_back(AddI32Thunk::Create("a", {slice0}, {slice0}));
+  sequence.push_back(AddI32Thunk::Create("b", {slice1}, {slice1}));
+  sequence.push_back(AddI32Thunk::Create("c", {slice1}, {slice0}));
+
+  ThunkExecutor::Options options = OptionsForTest();
+  options.use_critical_path_ready_queue = true;
+  options.use_measured_costs = true;
+
+  TF_ASSERT_OK_AND_ASSIGN(ThunkExecutor executor,
+                          ThunkExecutor::Create(std::move(sequence), options));
+
+  std::vector<int32_t> data(20, 1);  // shared src and dst allocation
+
+  auto buffers = AddI32Thunk::AsDeviceMemory({&data});
+  BufferAllocations allocations(buffers);
+
+  Thunk::ExecuteParams params = {nullptr, &allocations};
+
+  // Cost estimates are refined with the execution times measured by the first
+  // execution when we start the second one.
+  EXPECT_FALSE(executor.cost_estimates()->calibrated);
+  for (int i = 0; i < 2; ++i) {
+    auto execute_event = executor.Execute(params);
+    tsl::BlockUntilReady(execute_event);
+    ASSERT_TRUE(execute_event.IsConcrete());
+  }
+
+  std::shared_ptr<const ThunkExecutor::CostEstimates> estimates =
+      executor.cost_estimates();
+  EXPECT_TRUE(estimates->calibrated);
+  EXPECT_LT(estimates->split_cost, std::numeric_limits<int64_t>::max());
+  for (ThunkExecutor::NodeId id : {0, 1}) {
+    EXPECT_GT(estimates->costs[id], 0);
+    EXPECT_EQ(estimates->critical_paths[id],
+              estimates->costs[id] + estimates->costs[2]);
+  }
+}
+
 TEST(ThunkExecutorTest, Execute) {
   BufferAllocation alloc(/*index=*/0, /*size=*/80, /*color=*/0);
 
@@ -479,6 +656,56 @@ TEST(ThunkExecutorTest, Execute) {
                                 2, 2, 2, 2, 2));               // slice1
 }
 
+TEST(ThunkExecutorTest, ExecuteWithProfiler) {
+  BufferAllocation alloc(/*index=*/0, /*size=*/80, /*color=*/0);
+
+  BufferAllocation::Slice slice0(&alloc, /*offset=*/0, /*size=*/40);
+  BufferAllocation::Slice slice1(&alloc, /*offset=*/40, /*size=*/40);
+
+  ThunkSequence sequence;
+  sequence.push_back(AddI32Thunk::Create("a", {slice0}, {slice0}));
+  sequence.push_back(AddI32Thunk::Create("b", {slice1}, {slice1}));
+  sequence.push_back(AddI32Thunk::Create("c", {slice1}, {slice0}));
+
+  ThunkSequence single_thunk_sequence;
+  single_thunk_sequence.push_back(AddI32Thunk::Create("d", {slice0}, {slice0}));
+
+  TF_ASSERT_OK_AND_ASSIGN(
+      ThunkExecutor executor,
+      ThunkExecutor::Create(std::move(sequence), OptionsForTest()));
+  TF_ASSERT_OK_AND_ASSIGN(
+      ThunkExecutor single_thunk_executor,
+      ThunkExecutor::Create(std::move(single_thunk_sequence),
+                            OptionsForTest()));
+  ASSERT_FALSE(executor.is_sequential());
+
+  std::vector<int32_t> data(20, 1);  // shared src and dst allocation
+
+  auto buffers = AddI32Thunk::AsDeviceMemory({&data});
+  BufferAllocations allocations(buffers);
+
+  ThunkProfiler profiler({/*sample_rate=*/1.0});
+
+  Thunk::ExecuteParams params = {nullptr, &allocations};
+  params.profiler = &profiler;
+
+  for (ThunkExecutor* e : {&executor, &executor, &single_thunk_executor}) {
+    auto execute_event = e->Execute(params);
+    tsl::BlockUntilReady(execute_event);
+    ASSERT_TRUE(execute_event.IsConcrete());
+  }
+
+  EXPECT_EQ(profiler.num_traces(), 3);
+
+  std::vector<ThunkProfiler::OpStats> op_stats = profiler.op_stats();
+  ASSERT_EQ(op_stats.size(), 4);
+  for (const ThunkProfiler::OpStats& stats : op_stats) {
+    EXPECT_EQ(stats.count, stats.op_name == "d" ? 1 : 2);
+    EXPECT_GE(stats.total_queue_wait_ns, 0);
+    EXPECT_LE(stats.min_ns, stats.max_ns);
+  }
+}
+
 //===----------------------------------------------------------------------===//
 // ThunkExecutor stress testing
 //===----------------------------------------------------------------------===//
@@ -486,6 +713,9 @@ TEST(ThunkExecutorTest, Execute) {
 // We generate random thunk sequences that may or may not use a shared resource.
 enum class SharedResourceUse { kNo, kAll, kRandom };
 
+// Ready queue used by the thunk executor.
+enum class ReadyQueue { kFifo, kPriority, kCriticalPath };
+
 struct GeneratedThunkSequence {
   BufferAllocation src_alloc;
   BufferAllocation dst_alloc;
@@ -566,12 +796,13 @@ GenerateThunkSequence(size_t num_elements, size_t num_thunks,
 // Parameterized thunk executor stress tests that builds a random thunk sequence
 // and optionally uses a thread pool to execute thunk executor tasks.
 class ThunkExecutorStressTest
-    : public testing::TestWithParam<
-          std::tuple<int32_t, bool, bool, SharedResourceUse, bool, bool>> {
+    : public testing::TestWithParam<std::tuple<int32_t, bool, bool,
+                                               SharedResourceUse, bool,
+                                               ReadyQueue>> {
  public:
   void SetUp() override {
     auto& [num_thunks, use_task_runner, use_device, shared_resource_use,
-           inject_errors, use_priority_ready_queue] = GetParam();
+           inject_errors, ready_queue] = GetParam();
 
     use_task_runner_ = use_task_runner;
     use_device_ = use_device;
@@ -611,7 +842,7 @@ class ThunkExecutorStressTest
 
 TEST_P(ThunkExecutorStressTest, Execute) {
   auto [num_thunks, use_task_runner, use_device, shared_resource_use,
-        inject_errors, use_priority_ready_queue] = GetParam();
+        inject_errors, ready_queue] = GetParam();
 
   TF_ASSERT_OK_AND_ASSIGN(
       std::unique_ptr<GeneratedThunkSequence> g,
@@ -620,7 +851,10 @@ TEST_P(ThunkExecutorStressTest, Execute) {
 
   ThunkExecutor::Options executor_options = {
       /*execute_sequential_buffer_threshold=*/0,
-      /*use_priority_ready_queue=*/use_priority_ready_queue,
+      /*use_priority_ready_queue=*/ready_queue == ReadyQueue::kPriority,
+      /*use_critical_path_ready_queue=*/ready_queue ==
+          ReadyQueue::kCriticalPath,
+      /*use_measured_costs=*/ready_queue == ReadyQueue::kCriticalPath,
   };
 
   TF_ASSERT_OK_AND_ASSIGN(
@@ -656,7 +890,9 @@ INSTANTIATE_TEST_SUITE_P(
                                      SharedResourceUse::kAll,
                                      SharedResourceUse::kRandom),
                      /*inject_errors=*/testing::Bool(),
-                     /*use_priority_ready_queue=*/testing::Bool()));
+                     /*ready_queue=*/
+                     testing::Values(ReadyQueue::kFifo, ReadyQueue::kPriority,
+                                     ReadyQueue::kCriticalPath)));
 
 //===----------------------------------------------------------------------===//
 // Performance benchmarks below
@@ -730,6 +966,46 @@ static void BM_PriorityReadyQueuePushPopHalf(benchmark::State& state) {
   }
 }
 
+static ThunkExecutor::CostEstimates CostEstimatesForBenchmark() {
+  ThunkExecutor::CostEstimates estimates;
+  for (size_t i = 0; i < 16; ++i) {
+    estimates.costs.push_back(1);
+    estimates.critical_paths.push_back(i);
+  }
+
+  std::default_random_engine rng;
+  absl::c_shuffle(estimates.critical_paths, rng);
+  return estimates;
+}
+
+static void BM_CriticalPathReadyQueuePushPop(benchmark::State& state) {
+  ThunkExecutor::CostEstimates estimates = CostEstimatesForBenchmark();
+  ThunkExecutor::CriticalPathReadyQueue queue(&estimates, {});
+  const size_t num_push_pop = state.range(0);
+
+  for (auto _ : state) {
+    for (int i = 0; i < num_push_pop; ++i) {
+      queue.Push(i);
+    }
+    for (int i = 0; i < num_push_pop; ++i) {
+      benchmark::DoNotOptimize(queue.Pop());
+    }
+  }
+}
+
+static void BM_CriticalPathReadyQueuePushPopHalf(benchmark::State& state) {
+  ThunkExecutor::CostEstimates estimates = CostEstimatesForBenchmark();
+  ThunkExecutor::CriticalPathReadyQueue queue(&estimates, {});
+  const size_t num_push_pop = state.range(0);
+
+  for (auto _ : state) {
+    for (int i = 0; i < num_push_pop; ++i) {
+      queue.Push(i);
+    }
+    benchmark::DoNotOptimize(queue.PopHalf());
+  }
+}
+
 #define BENCHMARK_READY_QUEUE(name) \
   BENCHMARK(name)                   \
       ->MeasureProcessCPUTime()     \
@@ -743,6 +1019,8 @@ BENCHMARK_READY_QUEUE(BM_FifoReadyQueuePushPop);
 BENCHMARK_READY_QUEUE(BM_FifoReadyQueuePushPopHalf);
 BENCHMARK_READY_QUEUE(BM_PriorityReadyQueuePushPop);
 BENCHMARK_READY_QUEUE(BM_PriorityReadyQueuePushPopHalf);
+BENCHMARK_READY_QUEUE(BM_CriticalPathReadyQueuePushPop);
+BENCHMARK_READY_QUEUE(BM_CriticalPathReadyQueuePushPopHalf);
 
 static void BM_CreateThunkExecutor(benchmark::State& state) {
   const size_t num_thunks = state.range(0);
@@ -845,5 +1123,42 @@ BENCHMARK_THUNK_EXECUTOR(BM_SequentialThunkExecutor);
 BENCHMARK_THUNK_EXECUTOR(BM_SyncThunkExecutor);
 BENCHMARK_THUNK_EXECUTOR(BM_AsyncThunkExecutor);
 
+// Measures the overhead of the thunk profiler at the sample rate given in
+// percent by the second argument, or without a profiler if it is negative.
+static void BM_ProfiledThunkExecutor(benchmark::State& state) {
+  const size_t num_thunks = state.range(0);
+  const int64_t sample_rate_percent = state.range(1);
+
+  auto g = GenerateThunkSequence(/*num_elements=*/1024, num_thunks,
+                                 /*shared_resource_use=*/SharedResourceUse::kNo,
+                                 /*inject_errors=*/false)
+               .value();
+  auto e =
+      ThunkExecutor::Create(std::move(g->sequence), OptionsForTest()).value();
+
+  BufferAllocations allocations(g->buffers);
+  Thunk::ExecuteParams params = {nullptr, &allocations};
+
+  ThunkProfiler profiler({/*sample_rate=*/sample_rate_percent / 100.0});
+  if (sample_rate_percent >= 0) params.profiler = &profiler;
+
+  for (auto _ : state) {
+    auto execute_event = e.Execute(params);
+    tsl::BlockUntilReady(execute_event);
+    CHECK(execute_event.IsConcrete());
+  }
+}
+
+BENCHMARK(BM_ProfiledThunkExecutor)
+    ->MeasureProcessCPUTime()
+    ->ArgPair(16, -1)
+    ->ArgPair(16, 0)
+    ->ArgPair(16, 1)
+    ->ArgPair(16, 100)
+    ->ArgPair(128, -1)
+    ->ArgPair(128, 0)
+    ->ArgPair(128, 1)
+    ->ArgPair(128, 100);
+
 }  // namespace
 }  // namespace xla::cpu
@@ -0,0 +1,308 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/backends/cpu/runtime/thunk_profiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "absl/synchronization/mutex.h"
+#include "xla/backends/cpu/runtime/thunk.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/logging.h"
+#include "tsl/profiler/protobuf/xplane.pb.h"
+#include "tsl/profiler/utils/time_utils.h"
+#include "tsl/profiler/utils/xplane_builder.h"
+
+namespace xla::cpu {
+
+// Folded stacks use `;` to separate frames and a space to separate the stack
+// from its count, so we replace them in frame names.
+static std::string FoldedStackFrame(std::string_view name) {
+  return absl::StrReplaceAll(name, {{";", "_"}, {" ", "_"}});
+}
+
+// Profilers that are alive in the process, exported to TSL profiler sessions.
+struct LiveProfilers {
+  absl::Mutex mu;
+  absl::flat_hash_set<const ThunkProfiler*> profilers ABSL_GUARDED_BY(mu);
+};
+
+static LiveProfilers& GetLiveProfilers() {
+  static auto* const live_profilers = new LiveProfilers();
+  return *live_profilers;
+}
+
+void ThunkProfiler::Trace::RecordReady(size_t index) {
+  timings_[index].ready_ns = tsl::profiler::GetCurrentTimeNanos();
+}
+
+void ThunkProfiler::Trace::RecordStart(size_t index) {
+  ThunkTiming& timing = timings_[index];
+  timing.start_ns = tsl::profiler::GetCurrentTimeNanos();
+  timing.thread_id = tsl::Env::Default()->GetCurrentThreadId();
+  if (timing.ready_ns == 0) timing.ready_ns = timing.start_ns;
+}
+
+void ThunkProfiler::Trace::RecordEnd(size_t index) {
+  timings_[index].end_ns = tsl::profiler::GetCurrentTimeNanos();
+}
+
+ThunkProfiler::ThunkProfiler(const Options& options) : options_(options) {
+  LiveProfilers& live_profilers = GetLiveProfilers();
+  absl::MutexLock lock(&live_profilers.mu);
+  live_profilers.profilers.insert(this);
+}
+
+ThunkProfiler::~ThunkProfiler() {
+  LiveProfilers& live_profilers = GetLiveProfilers();
+  absl::MutexLock lock(&live_profilers.mu);
+  live_profilers.profilers.erase(this);
+}
+
+void ThunkProfiler::RegisterThunkSequence(const ThunkSequence& thunk_sequence) {
+  absl::MutexLock lock(&mu_);
+
+  // Thunk sequences to register with the thunks that launch them. Parents are
+  // registered before the sequences they launch are visited.
+  std::vector<std::pair<const ThunkSequence*, const Thunk*>> worklist = {
+      {&thunk_sequence, nullptr}};
+  while (!worklist.empty()) {
+    auto [sequence, parent] = worklist.back();
+    worklist.pop_back();
+    for (const std::unique_ptr<Thunk>& thunk : *sequence) {
+      if (parent != nullptr) {
+        thunk_frames_[thunk.get()] = OpFrame{parent, StackFrames(*parent)};
+      }
+      for (const ThunkSequence* nested : thunk->nested_thunk_sequences()) {
+        worklist.push_back({nested, thunk.get()});
+      }
+    }
+  }
+}
+
+std::string ThunkProfiler::StackFrames(const Thunk& thunk) const {
+  auto it = thunk_frames_.find(&thunk);
+  return absl::StrCat(it != thunk_frames_.end()
+                          ? it->second.prefix
+                          : FoldedStackFrame(thunk.info().module_name),
+                      ";", Thunk::KindToString(thunk.kind()), ";",
+                      FoldedStackFrame(thunk.info().op_name));
+}
+
+size_t ThunkProfiler::AddThunk(const Thunk& thunk) {
+  auto [it, inserted] = op_index_.try_emplace(
+      std::make_pair(thunk.info().module_name, thunk.info().op_name),
+      op_stats_.size());
+  if (inserted) {
+    OpStats& stats = op_stats_.emplace_back();
+    stats.module_name = thunk.info().module_name;
+    stats.op_name = thunk.info().op_name;
+    stats.kind = thunk.kind();
+
+    auto frame = thunk_frames_.find(&thunk);
+    op_frames_.push_back(
+        frame != thunk_frames_.end()
+            ? frame->second
+            : OpFrame{nullptr, FoldedStackFrame(thunk.info().module_name)});
+  }
+  thunk_index_[&thunk] = it->second;
+  return it->second;
+}
+
+std::shared_ptr<ThunkProfiler::Trace> ThunkProfiler::MaybeStartTrace(
+    size_t num_thunks) {
+  if (options_.sample_rate <= 0.0) return nullptr;
+
+  thread_local absl::InsecureBitGen bitgen;
+  if (options_.sample_rate < 1.0 &&
+      !absl::Bernoulli(bitgen, options_.sample_rate)) {
+    return nullptr;
+  }
+  return std::make_shared<Trace>(num_thunks);
+}
+
+void ThunkProfiler::FinishTrace(const Trace& trace,
+                                const ThunkSequence& thunk_sequence) {
+  DCHECK_EQ(trace.timings().size(), thunk_sequence.size())
+      << "Trace must have a timing for every thunk";
+
+  std::vector<TraceEvent> events;
+  events.reserve(thunk_sequence.size());
+
+  absl::MutexLock lock(&mu_);
+  ++num_traces_;
+
+  for (size_t i = 0; i < thunk_sequence.size(); ++i) {
+    const ThunkTiming& timing = trace.timings()[i];
+    // Thunks are not executed if the execution was aborted.
+    if (timing.start_ns == 0 || timing.end_ns == 0) continue;
+
+    // Thunks are looked up by address, and only thunks traced for the first
+    // time are looked up by their names.
+    const Thunk* thunk = thunk_sequence[i].get();
+    auto it = thunk_index_.find(thunk);
+    size_t op_index = it != thunk_index_.end() ? it->second : AddThunk(*thunk);
+
+    OpStats& stats = op_stats_[op_index];
+    int64_t duration_ns = timing.end_ns - timing.start_ns;
+    stats.count += 1;
+    stats.total_ns += duration_ns;
+    stats.min_ns = std::min(stats.min_ns, duration_ns);
+    stats.max_ns = std::max(stats.max_ns, duration_ns);
+    stats.total_queue_wait_ns += timing.start_ns - timing.ready_ns;
+
+    events.push_back({op_index, timing});
+  }
+
+  if (options_.max_traces == 0) return;
+  if (traces_.size() == options_.max_traces) traces_.pop_front();
+  traces_.push_back(std::move(events));
+}
+
+int64_t ThunkProfiler::num_traces() const {
+  absl::MutexLock lock(&mu_);
+  return num_traces_;
+}
+
+std::vector<ThunkProfiler::OpStats> ThunkProfiler::op_stats() const {
+  std::vector<OpStats> stats;
+  {
+    absl::MutexLock lock(&mu_);
+    stats = op_stats_;
+  }
+  std::stable_sort(stats.begin(), stats.end(),
+                   [](const OpStats& a, const OpStats& b) {
+                     return a.total_ns > b.total_ns;
+                   });
+  return stats;
+}
+
+std::string ThunkProfiler::ToFoldedStacks() const {
+  absl::MutexLock lock(&mu_);
+
+  // Flamegraphs add up the times of nested frames, so the time of a thunk
+  // launching nested thunk sequences must not include their time.
+  std::vector<int64_t> self_ns(op_stats_.size());
+  for (size_t i = 0; i < op_stats_.size(); ++i) {
+    self_ns[i] += op_stats_[i].total_ns;
+    if (op_frames_[i].parent == nullptr) continue;
+    auto parent = thunk_index_.find(op_frames_[i].parent);
+    if (parent != thunk_index_.end()) {
+      self_ns[parent->second] -= op_stats_[i].total_ns;
+    }
+  }
+
+  std::vector<size_t> order(op_stats_.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return op_stats_[a].total_ns > op_stats_[b].total_ns;
+  });
+
+  std::string folded_stacks;
+  for (size_t i : order) {
+    const OpStats& stats = op_stats_[i];
+    absl::StrAppend(&folded_stacks, op_frames_[i].prefix, ";",
+                    Thunk::KindToString(stats.kind), ";",
+                    FoldedStackFrame(stats.op_name), " ",
+                    std::max<int64_t>(self_ns[i], 0), "\n");
+  }
+  return folded_stacks;
+}
+
+void ThunkProfiler::ExportLiveProfilers(tensorflow::profiler::XPlane* plane,
+                                        int64_t start_ns, int64_t end_ns) {
+  // Profilers are not destroyed while they are exported.
+  LiveProfilers& live_profilers = GetLiveProfilers();
+  absl::MutexLock lock(&live_profilers.mu);
+  for (const ThunkProfiler* profiler : live_profilers.profilers) {
+    profiler->ExportXPlane(plane, start_ns, end_ns);
+  }
+}
+
+void ThunkProfiler::ExportXPlane(tensorflow::profiler::XPlane* plane,
+                                 int64_t start_ns, int64_t end_ns) const {
+  absl::MutexLock lock(&mu_);
+
+  auto is_exported = [&](const TraceEvent& event) {
+    return event.timing.start_ns >= start_ns && event.timing.end_ns <= end_ns;
+  };
+
+  tsl::profiler::XPlaneBuilder builder(plane);
+  builder.SetName(kXPlaneName);
+
+  tsl::profiler::XStatMetadata* module_stat =
+      builder.GetOrCreateStatMetadata("hlo_module");
+  tsl::profiler::XStatMetadata* kind_stat =
+      builder.GetOrCreateStatMetadata("thunk_kind");
+  tsl::profiler::XStatMetadata* queue_wait_stat =
+      builder.GetOrCreateStatMetadata("queue_wait_ns");
+  tsl::profiler::XStatMetadata* trace_stat =
+      builder.GetOrCreateStatMetadata("trace_id");
+
+  // Events are added relative to the line timestamp, so all lines start at the
+  // earliest exported thunk execution.
+  int64_t timestamp_ns = std::numeric_limits<int64_t>::max();
+  for (const std::vector<TraceEvent>& events : traces_) {
+    for (const TraceEvent& event : events) {
+      if (!is_exported(event)) continue;
+      timestamp_ns = std::min(timestamp_ns, event.timing.start_ns);
+    }
+  }
+
+  // Traces retained by the profiler are numbered from the oldest one.
+  int64_t trace_id = num_traces_ - traces_.size();
+  for (const std::vector<TraceEvent>& events : traces_) {
+    for (const TraceEvent& event : events) {
+      if (!is_exported(event)) continue;
+      const OpStats& stats = op_stats_[event.op_index];
+
+      // Lines might already have events exported by other profilers.
+      tsl::profiler::XLineBuilder line =
+          builder.GetOrCreateLine(event.timing.thread_id);
+      if (line.Name().empty()) {
+        line.SetName(absl::StrCat("Thread ", event.timing.thread_id));
+        line.SetTimestampNs(timestamp_ns);
+      } else if (line.TimestampNs() > timestamp_ns) {
+        line.SetTimestampNsAndAdjustEventOffsets(timestamp_ns);
+      }
+
+      tsl::profiler::XEventBuilder xevent =
+          line.AddEvent(*builder.GetOrCreateEventMetadata(stats.op_name));
+      xevent.SetTimestampNs(event.timing.start_ns);
+      xevent.SetDurationNs(event.timing.end_ns - event.timing.start_ns);
+      xevent.AddStatValue(*module_stat, stats.module_name);
+      xevent.AddStatValue(*kind_stat, Thunk::KindToString(stats.kind));
+      xevent.AddStatValue(*queue_wait_stat,
+                          event.timing.start_ns - event.timing.ready_ns);
+      xevent.AddStatValue(*trace_stat, trace_id);
+    }
+    ++trace_id;
+  }
+}
+
+}  // namespace xla::cpu
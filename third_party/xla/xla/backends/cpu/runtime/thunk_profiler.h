@@ -0,0 +1,212 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_BACKENDS_CPU_RUNTIME_THUNK_PROFILER_H_
+#define XLA_BACKENDS_CPU_RUNTIME_THUNK_PROFILER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "xla/backends/cpu/runtime/thunk.h"
+#include "tsl/profiler/protobuf/xplane.pb.h"
+
+namespace xla::cpu {
+
+namespace internal {
+// Clang does not allow defining a nested struct with member initializer, as
+// a workaround we define a struct in internal namespace and create an alias.
+struct ThunkProfilerOptions {
+  // Fraction of thunk sequence executions to trace.
+  double sample_rate = 0.01;
+
+  // Number of most recent traces kept for exporting them as an XPlane.
+  size_t max_traces = 64;
+};
+}  // namespace internal
+
+// ThunkProfiler attributes wall time to the thunks executed by ThunkExecutor,
+// and to the HLO operations they were emitted for. It is cheap enough to stay
+// enabled in production: it samples executions of thunk sequences, and for a
+// sampled execution records when each thunk became ready to execute, when it
+// started and completed execution, and the worker thread that executed it.
+// Executions that are not sampled pay for a single random number draw.
+//
+// Executions of nested thunk sequences (e.g. while loop bodies) are sampled
+// independently of the thunk that launched them, and the time of that thunk
+// includes the time of its nested thunks.
+//
+// Traces are aggregated into per-HLO operation statistics, and the most recent
+// traces are kept for exporting them as an XPlane. Live profilers export their
+// traces to TSL profiler sessions (see ExportLiveProfilers). Thread-safe.
+//
+// The profiler identifies thunks by their addresses, so thunks it traces must
+// outlive it.
+class ThunkProfiler {
+ public:
+  using Options = internal::ThunkProfilerOptions;
+
+  // Timestamps (in nanoseconds since the epoch) of a thunk execution recorded
+  // by a trace, zero if not recorded.
+  struct ThunkTiming {
+    int64_t ready_ns = 0;
+    int64_t start_ns = 0;
+    int64_t end_ns = 0;
+    int64_t thread_id = 0;
+  };
+
+  // A trace of a sampled execution of a thunk sequence, with thunk timings
+  // indexed by the thunk position in the sequence. Each timing is recorded by
+  // the thread that processes the thunk, and the executor orders all records
+  // before it finishes the trace.
+  class Trace {
+   public:
+    explicit Trace(size_t num_thunks) : timings_(num_thunks) {}
+
+    // Records that all dependencies of the thunk completed.
+    void RecordReady(size_t index);
+
+    // Records the start of the thunk execution in the current thread. Thunks
+    // without recorded ready time were ready when they started.
+    void RecordStart(size_t index);
+
+    // Records the completion of the thunk execution.
+    void RecordEnd(size_t index);
+
+    absl::Span<const ThunkTiming> timings() const { return timings_; }
+
+   private:
+    std::vector<ThunkTiming> timings_;
+  };
+
+  // Execution statistics of the thunks emitted for an HLO operation.
+  struct OpStats {
+    std::string module_name;
+    std::string op_name;
+    Thunk::Kind kind;
+
+    int64_t count = 0;
+    int64_t total_ns = 0;
+    int64_t min_ns = std::numeric_limits<int64_t>::max();
+    int64_t max_ns = 0;
+
+    // Time between the thunk becoming ready and starting execution.
+    int64_t total_queue_wait_ns = 0;
+  };
+
+  explicit ThunkProfiler(const Options& options = Options());
+  ~ThunkProfiler();
+
+  ThunkProfiler(const ThunkProfiler&) = delete;
+  ThunkProfiler& operator=(const ThunkProfiler&) = delete;
+
+  // Records the thunks that launch the thunk sequences nested in
+  // `thunk_sequence`, recursively, so that folded stacks nest the stacks of
+  // nested thunks under them.
+  void RegisterThunkSequence(const ThunkSequence& thunk_sequence);
+
+  // Returns a trace for an execution of a thunk sequence with `num_thunks`
+  // thunks if the execution is sampled, and nullptr otherwise.
+  std::shared_ptr<Trace> MaybeStartTrace(size_t num_thunks);
+
+  // Adds a trace of a completed execution of `thunk_sequence` to the profile.
+  void FinishTrace(const Trace& trace, const ThunkSequence& thunk_sequence);
+
+  // Returns the number of finished traces.
+  int64_t num_traces() const;
+
+  // Returns per-HLO operation statistics sorted by decreasing total time.
+  std::vector<OpStats> op_stats() const;
+
+  // Returns the self time of HLO operations in the folded stacks format, one
+  // `<module>;<thunk kind>;<op> <nanoseconds>` line per operation, which can be
+  // rendered as a flamegraph by flamegraph.pl and similar tools. Operations of
+  // nested thunk sequences are nested under the registered thunks that launch
+  // them, i.e. `<module>;while;<while op>;kernel;<op> <nanoseconds>`, and the
+  // time of their parent is reduced by their time. As nested sequences are
+  // sampled independently, the self time of parents is an estimate.
+  std::string ToFoldedStacks() const;
+
+  // Exports the most recent traces to `plane`, with a line per worker thread
+  // and an event per thunk execution. Only thunk executions that started at or
+  // after `start_ns` and ended at or before `end_ns` are exported. `plane` may
+  // already contain events exported by other profilers.
+  void ExportXPlane(
+      tensorflow::profiler::XPlane* plane, int64_t start_ns = 0,
+      int64_t end_ns = std::numeric_limits<int64_t>::max()) const;
+
+  // Exports the traces of all live profilers to `plane` (see ExportXPlane).
+  static void ExportLiveProfilers(tensorflow::profiler::XPlane* plane,
+                                  int64_t start_ns, int64_t end_ns);
+
+  static constexpr std::string_view kXPlaneName = "/host:XLA:CPU thunks";
+
+ private:
+  // A thunk execution in a retained trace.
+  struct TraceEvent {
+    size_t op_index;
+    ThunkTiming timing;
+  };
+
+  // Position of an HLO operation in folded stacks.
+  struct OpFrame {
+    // Thunk that launched the thunk sequence of the operation, if registered.
+    const Thunk* parent = nullptr;
+    // Folded stack frames of the module and of the parent thunks.
+    std::string prefix;
+  };
+
+  // Returns the index of the statistics of the HLO operation of `thunk`, which
+  // is traced for the first time.
+  size_t AddThunk(const Thunk& thunk) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns the folded stack frames of `thunk`, prefixed by the frames of its
+  // module and of its registered parents.
+  std::string StackFrames(const Thunk& thunk) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  Options options_;
+
+  mutable absl::Mutex mu_;
+  int64_t num_traces_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Thunks launching nested thunk sequences, and folded stack frames of their
+  // nested thunks, keyed by the nested thunks.
+  absl::flat_hash_map<const Thunk*, OpFrame> thunk_frames_ ABSL_GUARDED_BY(mu_);
+
+  // Statistics of HLO operations indexed by their thunks, and by (module name,
+  // op name) for thunks that are traced for the first time.
+  absl::flat_hash_map<const Thunk*, size_t> thunk_index_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<std::pair<std::string, std::string>, size_t> op_index_
+      ABSL_GUARDED_BY(mu_);
+  std::vector<OpStats> op_stats_ ABSL_GUARDED_BY(mu_);
+  std::vector<OpFrame> op_frames_ ABSL_GUARDED_BY(mu_);
+
+  std::deque<std::vector<TraceEvent>> traces_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace xla::cpu
+
+#endif  // XLA_BACKENDS_CPU_RUNTIME_THUNK_PROFILER_H_
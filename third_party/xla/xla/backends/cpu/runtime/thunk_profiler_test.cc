@@ -0,0 +1,264 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/backends/cpu/runtime/thunk_profiler.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "xla/backends/cpu/runtime/thunk.h"
+#include "xla/tsl/concurrency/async_value_ref.h"
+#include "tsl/platform/test.h"
+#include "tsl/platform/test_benchmark.h"
+#include "tsl/profiler/protobuf/xplane.pb.h"
+#include "tsl/profiler/utils/time_utils.h"
+
+namespace xla::cpu {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAre;
+
+class NoOpThunk final : public Thunk {
+ public:
+  NoOpThunk(std::string module_name, std::string op_name)
+      : Thunk(Kind::kKernel, Info{std::move(op_name), std::move(module_name)}) {
+  }
+
+  tsl::AsyncValueRef<ExecuteEvent> Execute(const ExecuteParams&) final {
+    return OkExecuteEvent();
+  }
+
+  BufferUses buffer_uses() const final { return {}; }
+};
+
+// A thunk that plays the role of a control flow thunk launching `nested`.
+class NestedThunk final : public Thunk {
+ public:
+  NestedThunk(std::string module_name, std::string op_name,
+              ThunkSequence nested)
+      : Thunk(Kind::kWhile, Info{std::move(op_name), std::move(module_name)}),
+        nested_(std::move(nested)) {}
+
+  tsl::AsyncValueRef<ExecuteEvent> Execute(const ExecuteParams&) final {
+    return OkExecuteEvent();
+  }
+
+  BufferUses buffer_uses() const final { return {}; }
+
+  std::vector<const ThunkSequence*> nested_thunk_sequences() const final {
+    return {&nested_};
+  }
+
+ private:
+  ThunkSequence nested_;
+};
+
+ThunkSequence CreateThunkSequence() {
+  ThunkSequence sequence;
+  sequence.push_back(std::make_unique<NoOpThunk>("module", "a"));
+  sequence.push_back(std::make_unique<NoOpThunk>("module", "b"));
+  sequence.push_back(std::make_unique<NoOpThunk>("module", "a"));
+  return sequence;
+}
+
+// Records timings of all thunks in `sequence` executed one by one.
+void RecordTrace(ThunkProfiler& profiler, const ThunkSequence& sequence) {
+  std::shared_ptr<ThunkProfiler::Trace> trace =
+      profiler.MaybeStartTrace(sequence.size());
+  ASSERT_NE(trace, nullptr);
+  for (size_t i = 0; i < sequence.size(); ++i) {
+    trace->RecordReady(i);
+    trace->RecordStart(i);
+    trace->RecordEnd(i);
+  }
+  profiler.FinishTrace(*trace, sequence);
+}
+
+TEST(ThunkProfilerTest, SampleRate) {
+  ThunkProfiler never({/*sample_rate=*/0.0});
+  ThunkProfiler always({/*sample_rate=*/1.0});
+  ThunkProfiler sometimes({/*sample_rate=*/0.5});
+
+  size_t num_sampled = 0;
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(never.MaybeStartTrace(1), nullptr);
+    EXPECT_NE(always.MaybeStartTrace(1), nullptr);
+    num_sampled += sometimes.MaybeStartTrace(1) != nullptr;
+  }
+  EXPECT_GT(num_sampled, 0);
+  EXPECT_LT(num_sampled, 1000);
+}
+
+TEST(ThunkProfilerTest, AggregatesOpStats) {
+  ThunkSequence sequence = CreateThunkSequence();
+  ThunkProfiler profiler({/*sample_rate=*/1.0});
+  RecordTrace(profiler, sequence);
+  RecordTrace(profiler, sequence);
+
+  EXPECT_EQ(profiler.num_traces(), 2);
+
+  std::vector<ThunkProfiler::OpStats> op_stats = profiler.op_stats();
+  ASSERT_EQ(op_stats.size(), 2);
+  for (const ThunkProfiler::OpStats& stats : op_stats) {
+    EXPECT_EQ(stats.module_name, "module");
+    EXPECT_EQ(stats.kind, Thunk::Kind::kKernel);
+    EXPECT_EQ(stats.count, stats.op_name == "a" ? 4 : 2);
+    EXPECT_GE(stats.total_ns, stats.max_ns);
+    EXPECT_LE(stats.min_ns, stats.max_ns);
+    EXPECT_GE(stats.total_queue_wait_ns, 0);
+  }
+  EXPECT_GE(op_stats[0].total_ns, op_stats[1].total_ns);
+}
+
+TEST(ThunkProfilerTest, SkipsThunksThatWereNotExecuted) {
+  ThunkSequence sequence = CreateThunkSequence();
+  ThunkProfiler profiler({/*sample_rate=*/1.0});
+
+  std::shared_ptr<ThunkProfiler::Trace> trace =
+      profiler.MaybeStartTrace(sequence.size());
+  trace->RecordStart(1);
+  trace->RecordEnd(1);
+  profiler.FinishTrace(*trace, sequence);
+
+  std::vector<ThunkProfiler::OpStats> op_stats = profiler.op_stats();
+  ASSERT_EQ(op_stats.size(), 1);
+  EXPECT_EQ(op_stats[0].op_name, "b");
+  EXPECT_EQ(op_stats[0].count, 1);
+  EXPECT_EQ(op_stats[0].total_queue_wait_ns, 0);
+}
+
+TEST(ThunkProfilerTest, FoldedStacks) {
+  ThunkSequence sequence;
+  sequence.push_back(std::make_unique<NoOpThunk>("my module", "a;b"));
+
+  ThunkProfiler profiler({/*sample_rate=*/1.0});
+  EXPECT_THAT(profiler.ToFoldedStacks(), IsEmpty());
+
+  RecordTrace(profiler, sequence);
+  std::string folded_stacks = profiler.ToFoldedStacks();
+  EXPECT_THAT(folded_stacks, HasSubstr("my_module;kernel;a_b "));
+  EXPECT_EQ(folded_stacks.back(), '\n');
+}
+
+TEST(ThunkProfilerTest, FoldedStacksOfNestedThunks) {
+  ThunkSequence body;
+  body.push_back(std::make_unique<NoOpThunk>("module", "a"));
+  ThunkSequence sequence;
+  sequence.push_back(
+      std::make_unique<NestedThunk>("module", "w", std::move(body)));
+  const ThunkSequence& nested = *sequence[0]->nested_thunk_sequences()[0];
+
+  ThunkProfiler profiler({/*sample_rate=*/1.0});
+  profiler.RegisterThunkSequence(sequence);
+
+  // The nested sequence executes while the parent thunk executes.
+  std::shared_ptr<ThunkProfiler::Trace> trace = profiler.MaybeStartTrace(1);
+  trace->RecordStart(0);
+  RecordTrace(profiler, nested);
+  trace->RecordEnd(0);
+  profiler.FinishTrace(*trace, sequence);
+
+  std::vector<ThunkProfiler::OpStats> op_stats = profiler.op_stats();
+  ASSERT_EQ(op_stats.size(), 2);
+  auto parent_stats = absl::c_find_if(
+      op_stats, [](const auto& stats) { return stats.op_name == "w"; });
+  ASSERT_NE(parent_stats, op_stats.end());
+
+  // Nested stacks are nested under the parent, whose self time excludes
+  // them, so that the total time of all stacks is the time of the parent.
+  int64_t total_ns = 0;
+  std::vector<std::string> stacks;
+  for (std::string_view line :
+       absl::StrSplit(profiler.ToFoldedStacks(), '\n', absl::SkipEmpty())) {
+    std::pair<std::string_view, std::string_view> stack_and_ns =
+        absl::StrSplit(line, ' ');
+    int64_t ns;
+    ASSERT_TRUE(absl::SimpleAtoi(stack_and_ns.second, &ns));
+    total_ns += ns;
+    stacks.emplace_back(stack_and_ns.first);
+  }
+  EXPECT_THAT(stacks, UnorderedElementsAre("module;while;w",
+                                           "module;while;w;kernel;a"));
+  EXPECT_EQ(total_ns, parent_stats->total_ns);
+}
+
+TEST(ThunkProfilerTest, ExportXPlane) {
+  ThunkSequence sequence = CreateThunkSequence();
+  ThunkProfiler profiler({/*sample_rate=*/1.0, /*max_traces=*/2});
+  for (int i = 0; i < 3; ++i) RecordTrace(profiler, sequence);
+
+  tensorflow::profiler::XPlane plane;
+  profiler.ExportXPlane(&plane);
+
+  EXPECT_EQ(plane.name(), ThunkProfiler::kXPlaneName);
+  ASSERT_EQ(plane.lines_size(), 1);
+  EXPECT_EQ(plane.lines(0).events_size(), 6);
+  EXPECT_EQ(plane.event_metadata_size(), 2);
+
+  std::vector<std::string> stat_names;
+  for (const auto& id_and_metadata : plane.stat_metadata()) {
+    stat_names.push_back(id_and_metadata.second.name());
+  }
+  absl::c_sort(stat_names);
+  EXPECT_THAT(stat_names, ElementsAre("hlo_module", "queue_wait_ns",
+                                      "thunk_kind", "trace_id"));
+}
+
+TEST(ThunkProfilerTest, ExportLiveProfilers) {
+  ThunkSequence sequence = CreateThunkSequence();
+  ThunkProfiler profiler({/*sample_rate=*/1.0});
+  ThunkProfiler other_profiler({/*sample_rate=*/1.0});
+  RecordTrace(profiler, sequence);
+
+  // Only executions within the exported time range are exported.
+  int64_t start_ns = tsl::profiler::GetCurrentTimeNanos();
+  RecordTrace(profiler, sequence);
+  RecordTrace(other_profiler, sequence);
+  int64_t end_ns = tsl::profiler::GetCurrentTimeNanos();
+  RecordTrace(other_profiler, sequence);
+
+  tensorflow::profiler::XPlane plane;
+  ThunkProfiler::ExportLiveProfilers(&plane, start_ns, end_ns);
+
+  ASSERT_EQ(plane.lines_size(), 1);
+  const tensorflow::profiler::XLine& line = plane.lines(0);
+  ASSERT_EQ(line.events_size(), 6);
+  for (const tensorflow::profiler::XEvent& event : line.events()) {
+    EXPECT_GE(line.timestamp_ns() * 1000 + event.offset_ps(), start_ns * 1000);
+  }
+}
+
+static void BM_MaybeStartTrace(benchmark::State& state) {
+  ThunkProfiler profiler({/*sample_rate=*/0.01});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(profiler.MaybeStartTrace(16));
+  }
+}
+
+BENCHMARK(BM_MaybeStartTrace);
+
+}  // namespace
+}  // namespace xla::cpu
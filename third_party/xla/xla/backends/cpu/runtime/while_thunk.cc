@@ -20,6 +20,7 @@ limitations under the License.
 #include <memory>
 #include <optional>
 #include <utility>
+#include <vector>
 
 #include "absl/base/optimization.h"
 #include "absl/memory/memory.h"
@@ -287,4 +288,8 @@ WhileThunk::ResourceUses WhileThunk::resource_uses() const {
   return resource_uses;
 }
 
+std::vector<const ThunkSequence*> WhileThunk::nested_thunk_sequences() const {
+  return {&cond_executor_.thunk_sequence(), &body_executor_.thunk_sequence()};
+}
+
 }  // namespace xla::cpu
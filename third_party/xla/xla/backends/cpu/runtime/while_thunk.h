@@ -19,6 +19,7 @@ limitations under the License.
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "xla/backends/cpu/runtime/thunk.h"
@@ -46,6 +47,7 @@ class WhileThunk final : public Thunk {
 
   BufferUses buffer_uses() const final;
   ResourceUses resource_uses() const final;
+  std::vector<const ThunkSequence*> nested_thunk_sequences() const final;
 
  private:
   WhileThunk(Info info, BufferAllocation::Slice cond_buffer,
@@ -0,0 +1,82 @@
+/* Copyright 2018 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "xla/backends/cpu/runtime/thunk_profiler.h"
+#include "tsl/profiler/lib/profiler_factory.h"
+#include "tsl/profiler/lib/profiler_interface.h"
+#include "tsl/profiler/protobuf/profiler_options.pb.h"
+#include "tsl/profiler/protobuf/xplane.pb.h"
+#include "tsl/profiler/utils/time_utils.h"
+
+namespace xla {
+namespace profiler {
+namespace {
+
+// ThunkProfilerCollector collects the executions of XLA:CPU thunks sampled by
+// the thunk profilers of live executables during a profiling session.
+//
+// Thread-safety: This class is go/thread-compatible.
+class ThunkProfilerCollector : public tsl::profiler::ProfilerInterface {
+ public:
+  ThunkProfilerCollector() = default;
+
+  absl::Status Start() override {
+    start_ns_ = tsl::profiler::GetCurrentTimeNanos();
+    return absl::OkStatus();
+  }
+
+  absl::Status Stop() override {
+    stop_ns_ = tsl::profiler::GetCurrentTimeNanos();
+    return absl::OkStatus();
+  }
+
+  absl::Status CollectData(tensorflow::profiler::XSpace* space) override {
+    tensorflow::profiler::XPlane plane;
+    cpu::ThunkProfiler::ExportLiveProfilers(&plane, start_ns_, stop_ns_);
+    if (plane.lines_size() > 0) {
+      *space->add_planes() = std::move(plane);
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  int64_t start_ns_ = 0;
+  int64_t stop_ns_ = 0;
+
+  ThunkProfilerCollector(const ThunkProfilerCollector&) = delete;
+  void operator=(const ThunkProfilerCollector&) = delete;
+};
+
+std::unique_ptr<tsl::profiler::ProfilerInterface> CreateThunkProfilerCollector(
+    const tensorflow::ProfileOptions& options) {
+  return options.host_tracer_level() > 0
+             ? std::make_unique<ThunkProfilerCollector>()
+             : nullptr;
+}
+
+}  // namespace
+
+auto register_thunk_profiler_collector_factory = [] {
+  RegisterProfilerFactory(&CreateThunkProfilerCollector);
+  return 0;
+}();
+
+}  // namespace profiler
+}  // namespace xla
@@ -0,0 +1,100 @@
+/* Copyright 2018 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "xla/backends/cpu/runtime/thunk.h"
+#include "xla/backends/cpu/runtime/thunk_profiler.h"
+#include "xla/tsl/concurrency/async_value_ref.h"
+#include "xla/tsl/lib/core/status_test_util.h"
+#include "tsl/platform/test.h"
+#include "tsl/profiler/lib/profiler_factory.h"
+#include "tsl/profiler/lib/profiler_interface.h"
+#include "tsl/profiler/protobuf/profiler_options.pb.h"
+#include "tsl/profiler/protobuf/xplane.pb.h"
+
+namespace xla {
+namespace profiler {
+namespace {
+
+using ::xla::cpu::Thunk;
+using ::xla::cpu::ThunkProfiler;
+using ::xla::cpu::ThunkSequence;
+
+class NoOpThunk final : public Thunk {
+ public:
+  explicit NoOpThunk(std::string op_name)
+      : Thunk(Kind::kKernel, Info{std::move(op_name), "module"}) {}
+
+  tsl::AsyncValueRef<ExecuteEvent> Execute(const ExecuteParams&) final {
+    return OkExecuteEvent();
+  }
+
+  BufferUses buffer_uses() const final { return {}; }
+};
+
+// Records timings of all thunks in `sequence` executed one by one.
+void RecordTrace(ThunkProfiler& profiler, const ThunkSequence& sequence) {
+  std::shared_ptr<ThunkProfiler::Trace> trace =
+      profiler.MaybeStartTrace(sequence.size());
+  ASSERT_NE(trace, nullptr);
+  for (size_t i = 0; i < sequence.size(); ++i) {
+    trace->RecordStart(i);
+    trace->RecordEnd(i);
+  }
+  profiler.FinishTrace(*trace, sequence);
+}
+
+TEST(ThunkProfilerCollectorTest, CollectsThunkExecutionsAsXSpace) {
+  ThunkSequence sequence;
+  sequence.push_back(std::make_unique<NoOpThunk>("a"));
+  sequence.push_back(std::make_unique<NoOpThunk>("b"));
+
+  ThunkProfiler thunk_profiler({/*sample_rate=*/1.0});
+  RecordTrace(thunk_profiler, sequence);
+
+  tensorflow::ProfileOptions options;
+  options.set_host_tracer_level(2);
+  std::vector<std::unique_ptr<tsl::profiler::ProfilerInterface>> profilers =
+      tsl::profiler::CreateProfilers(options);
+  ASSERT_EQ(profilers.size(), 1);
+
+  // Only executions during the profiling session are collected.
+  TF_ASSERT_OK(profilers[0]->Start());
+  RecordTrace(thunk_profiler, sequence);
+  TF_ASSERT_OK(profilers[0]->Stop());
+  RecordTrace(thunk_profiler, sequence);
+
+  tensorflow::profiler::XSpace space;
+  TF_ASSERT_OK(profilers[0]->CollectData(&space));
+  ASSERT_EQ(space.planes_size(), 1);
+  EXPECT_EQ(space.planes(0).name(), ThunkProfiler::kXPlaneName);
+  ASSERT_EQ(space.planes(0).lines_size(), 1);
+  EXPECT_EQ(space.planes(0).lines(0).events_size(), 2);
+}
+
+TEST(ThunkProfilerCollectorTest, SkipsSessionsWithoutHostTraces) {
+  tensorflow::ProfileOptions options;
+  options.set_host_tracer_level(0);
+  EXPECT_TRUE(tsl::profiler::CreateProfilers(options).empty());
+}
+
+}  // namespace
+}  // namespace profiler
+}  // namespace xla
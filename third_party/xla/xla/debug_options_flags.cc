@@ -85,8 +85,13 @@ DebugOptions DefaultDebugOptionsIgnoringFlags() {
 #endif
   opts.set_xla_cpu_use_thunk_runtime(true);
   opts.set_xla_cpu_parallel_codegen_split_count(32);
+  opts.set_xla_cpu_persistent_cache_dir("");
+  opts.set_xla_cpu_persistent_cache_max_size_bytes(int64_t{4} << 30);
+  opts.set_xla_cpu_enable_critical_path_scheduling(false);
+  opts.set_xla_cpu_enable_critical_path_measured_costs(false);
   opts.set_xla_cpu_enable_concurrency_optimized_scheduler(false);
   opts.set_xla_cpu_prefer_vector_width(256);
+  opts.set_xla_cpu_thunk_profiler_sample_rate(0.0);
 
   opts.set_xla_cpu_enable_fast_math(false);
   // Disable forms of fast math that have caused users problems in the past.
@@ -834,6 +839,19 @@ void MakeDebugOptionsFlags(std::vector<tsl::Flag>* flag_list,
       debug_options->xla_cpu_parallel_codegen_split_count(),
       "Split LLVM module into at most this many parts before codegen to enable "
       "parallel compilation for the CPU backend."));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_persistent_cache_dir",
+      string_setter_for(&DebugOptions::set_xla_cpu_persistent_cache_dir),
+      debug_options->xla_cpu_persistent_cache_dir(),
+      "If not empty, keep the object files compiled by the CPU backend in this "
+      "directory, and reuse them instead of recompiling the same modules."));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_persistent_cache_max_size_bytes",
+      int64_setter_for(
+          &DebugOptions::set_xla_cpu_persistent_cache_max_size_bytes),
+      debug_options->xla_cpu_persistent_cache_max_size_bytes(),
+      "Maximum size of the CPU backend object cache directory. Non-positive "
+      "values disable eviction."));
   flag_list->push_back(tsl::Flag(
       "xla_cpu_enable_concurrency_optimized_scheduler",
       bool_setter_for(
@@ -841,11 +859,31 @@ void MakeDebugOptionsFlags(std::vector<tsl::Flag>* flag_list,
       debug_options->xla_cpu_enable_concurrency_optimized_scheduler(),
       "Use HLO module scheduler that is optimized for extracting concurrency "
       "from an HLO module by trading off extra memory pressure."));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_enable_critical_path_scheduling",
+      bool_setter_for(
+          &DebugOptions::set_xla_cpu_enable_critical_path_scheduling),
+      debug_options->xla_cpu_enable_critical_path_scheduling(),
+      "Execute first the ready thunks with the longest estimated critical "
+      "path to the end of the program, using costs from HloCostAnalysis."));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_enable_critical_path_measured_costs",
+      bool_setter_for(
+          &DebugOptions::set_xla_cpu_enable_critical_path_measured_costs),
+      debug_options->xla_cpu_enable_critical_path_measured_costs(),
+      "Refine thunk costs used for critical path scheduling with measured "
+      "thunk execution times."));
   flag_list->push_back(tsl::Flag(
       "xla_cpu_prefer_vector_width",
       int32_setter_for(&DebugOptions::set_xla_cpu_prefer_vector_width),
       debug_options->xla_cpu_prefer_vector_width(),
       "Preferred vector with for the XLA:CPU LLVM backend."));
+  flag_list->push_back(tsl::Flag(
+      "xla_cpu_thunk_profiler_sample_rate",
+      float_setter_for(&DebugOptions::set_xla_cpu_thunk_profiler_sample_rate),
+      debug_options->xla_cpu_thunk_profiler_sample_rate(),
+      "Fraction of thunk sequence executions traced by the XLA:CPU thunk "
+      "profiler, e.g. 0.01. Zero disables the profiler."));
   flag_list->push_back(tsl::Flag(
       "xla_gpu_crash_on_verification_failures",
       bool_setter_for(
@@ -117,6 +117,15 @@ llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> CompilerFunctor::operator()(
     }
   }
 
+  // The object cache must see the module before it is optimized.
+  if (object_cache_) {
+    if (std::unique_ptr<llvm::MemoryBuffer> obj_file =
+            object_cache_->getObject(&module)) {
+      RunPostCodegenHook(*obj_file);
+      return std::move(obj_file);
+    }
+  }
+
   llvm::OptimizationLevel opt_level;
   if (optimize_for_size_) {
     opt_level = llvm::OptimizationLevel::Os;
@@ -211,21 +220,29 @@ llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> CompilerFunctor::operator()(
   std::unique_ptr<llvm::MemoryBuffer> mc_memory_buffer(
       new llvm::SmallVectorMemoryBuffer(std::move(mc_stream_buffer)));
 
-  {  // Synchronize access to user-defined hooks.
-    absl::MutexLock lock(&mutex_);
-    if (post_codegen_hook_) {
-      llvm::Expected<std::unique_ptr<llvm::object::ObjectFile>> obj_file =
-          llvm::object::ObjectFile::createObjectFile(*mc_memory_buffer);
-      if (obj_file) {
-        post_codegen_hook_(*obj_file.get());
-      } else {
-        LOG(WARNING) << "Could not convert memory buffer to object file!";
-      }
-    }
+  if (object_cache_) {
+    object_cache_->notifyObjectCompiled(&module,
+                                        mc_memory_buffer->getMemBufferRef());
   }
 
+  RunPostCodegenHook(*mc_memory_buffer);
+
   return std::move(mc_memory_buffer);
 }
 
+void CompilerFunctor::RunPostCodegenHook(const llvm::MemoryBuffer& obj_file) {
+  // Synchronize access to user-defined hooks.
+  absl::MutexLock lock(&mutex_);
+  if (post_codegen_hook_) {
+    llvm::Expected<std::unique_ptr<llvm::object::ObjectFile>> object =
+        llvm::object::ObjectFile::createObjectFile(obj_file.getMemBufferRef());
+    if (object) {
+      post_codegen_hook_(*object.get());
+    } else {
+      LOG(WARNING) << "Could not convert memory buffer to object file!";
+    }
+  }
+}
+
 }  // namespace cpu
 }  // namespace xla
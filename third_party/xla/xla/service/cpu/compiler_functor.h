@@ -25,6 +25,7 @@ limitations under the License.
 #include "absl/base/thread_annotations.h"
 #include "absl/functional/any_invocable.h"
 #include "absl/synchronization/mutex.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
 #include "llvm/ExecutionEngine/Orc/Mangling.h"
 #include "llvm/IR/FMF.h"
@@ -32,6 +33,7 @@ limitations under the License.
 #include "llvm/IR/Module.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Target/TargetMachine.h"
 #include "xla/service/llvm_compiler.h"
 
@@ -39,6 +41,10 @@ namespace xla::cpu {
 
 // Functor class for compiling an LLVM module down to an object file. For use by
 // Orc JIT compile layer.
+//
+// If an `object_cache` is given, modules found in the cache are not compiled,
+// and compiled modules are added to the cache. Cached modules run the
+// pre-optimization and post-codegen hooks but not the post-optimization hook.
 class CompilerFunctor : public llvm::orc::IRCompileLayer::IRCompiler {
  public:
   // Returns an instance of llvm::TargetMachine for a compilation. It can be
@@ -59,7 +65,8 @@ class CompilerFunctor : public llvm::orc::IRCompileLayer::IRCompiler {
       absl::AnyInvocable<void(const llvm::object::ObjectFile&)>
           post_codegen_hook = nullptr,
       bool dfsan_enabled = false,
-      const std::vector<std::string>& dfsan_abi_list_files = {})
+      const std::vector<std::string>& dfsan_abi_list_files = {},
+      std::unique_ptr<llvm::ObjectCache> object_cache = nullptr)
       : IRCompiler(llvm::orc::IRSymbolMapper::ManglingOptions()),
         target_machine_builder_(std::move(target_machine_builder)),
         opt_level_(opt_level),
@@ -71,13 +78,16 @@ class CompilerFunctor : public llvm::orc::IRCompileLayer::IRCompiler {
         dfsan_abi_list_files_(dfsan_abi_list_files),
         pre_optimization_hook_(std::move(pre_optimization_hook)),
         post_optimization_hook_(std::move(post_optimization_hook)),
-        post_codegen_hook_(std::move(post_codegen_hook)) {}
+        post_codegen_hook_(std::move(post_codegen_hook)),
+        object_cache_(std::move(object_cache)) {}
 
   // Compile a Module to an ObjectFile.
   llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> operator()(
       llvm::Module& module) override;
 
  private:
+  void RunPostCodegenHook(const llvm::MemoryBuffer& obj_file);
+
   TargetMachineBuilder target_machine_builder_;
   const unsigned opt_level_;
   const bool optimize_for_size_;
@@ -92,6 +102,9 @@ class CompilerFunctor : public llvm::orc::IRCompileLayer::IRCompiler {
   absl::AnyInvocable<void(const llvm::object::ObjectFile&)> post_codegen_hook_
       ABSL_GUARDED_BY(mutex_);
 
+  // Thread-safe, as modules are compiled concurrently.
+  std::unique_ptr<llvm::ObjectCache> object_cache_;
+
   // Synchronizes access to user-defined compilation hooks.
   absl::Mutex mutex_;
 };
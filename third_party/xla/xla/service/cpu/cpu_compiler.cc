@@ -41,12 +41,16 @@ limitations under the License.
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
@@ -67,7 +71,6 @@ limitations under the License.
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/TargetParser/Host.h"
 #include "llvm/TargetParser/Triple.h"
-#include "llvm/Transforms/Utils/SplitModule.h"
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 #include "mlir/Dialect/Vector/IR/VectorOps.h"
 #include "mlir/Pass/PassManager.h"
@@ -121,7 +124,9 @@ limitations under the License.
 #include "xla/service/cpu/executable.pb.h"
 #include "xla/service/cpu/ir_emitter.h"
 #include "xla/service/cpu/ir_emitter2.h"
+#include "xla/service/cpu/module_split.h"
 #include "xla/service/cpu/parallel_task_assignment.h"
+#include "xla/service/cpu/persistent_object_cache.h"
 #include "xla/service/cpu/simple_orc_jit.h"
 #include "xla/service/cpu/target_machine_features.h"
 #include "xla/service/cpu/thunk_emitter.h"
@@ -208,6 +213,7 @@ limitations under the License.
 #include "tsl/platform/env.h"
 #include "tsl/platform/errors.h"
 #include "tsl/platform/logging.h"  // IWYU pragma: keep
+#include "tsl/platform/protobuf.h"
 #include "tsl/platform/status.h"
 #include "tsl/platform/statusor.h"
 #include "tsl/platform/threadpool.h"
@@ -1024,6 +1030,38 @@ CreateOrcJITPostCompilationHook(const HloModule* module,
   };
 }
 
+// Returns the object cache configured by the debug options of `module`, or
+// nullptr if there is none.
+std::unique_ptr<llvm::ObjectCache> CreatePersistentObjectCache(
+    const HloModule& module) {
+  const DebugOptions& debug_options = module.config().debug_options();
+  if (debug_options.xla_cpu_persistent_cache_dir().empty()) {
+    return nullptr;
+  }
+
+  // Besides the LLVM module, object files depend on the LLVM version, on the
+  // host machine and on the compilation options, all of which come from the
+  // debug options. The cache options themselves don't change object files.
+  DebugOptions key_options = debug_options;
+  key_options.clear_xla_cpu_persistent_cache_dir();
+  key_options.clear_xla_cpu_persistent_cache_max_size_bytes();
+  std::string serialized_options;
+  if (!tsl::SerializeToStringDeterministic(key_options, &serialized_options)) {
+    LOG(WARNING) << "Failed to serialize debug options, disabling the "
+                    "XLA:CPU object cache";
+    return nullptr;
+  }
+
+  std::string key_prefix = absl::StrCat(
+      LLVM_VERSION_STRING, ";", llvm::sys::getHostCPUName().str(), ";",
+      absl::StrJoin(DetectMachineAttributes(), ","), ";",
+      module.GetFingerprint128(), ";", serialized_options);
+  return std::make_unique<PersistentObjectCache>(
+      debug_options.xla_cpu_persistent_cache_dir(),
+      debug_options.xla_cpu_persistent_cache_max_size_bytes(),
+      std::move(key_prefix));
+}
+
 void InitializeLLVMCommandLineOptions(const HloModuleConfig& config) {
   llvm_ir::InitializeLLVMCommandLineOptions(
       config.debug_options().xla_backend_extra_options());
@@ -1200,31 +1238,44 @@ static void RemoveUnusedSymbols(llvm::Module& module) {
   }
 }
 
-// Clones a ThreadSafeModule from the given LLVM module in a new LLVM context.
-//
 // To enable parallel compilation, each LLVM module has to be owned by a
-// separate LLVM context. We take each part of the original module after a
-// split, and clone it into a new LLVM context.
-static llvm::orc::ThreadSafeModule CloneAsThreadSafeModule(
-    int64_t part, std::unique_ptr<llvm::Module> module) {
+// separate LLVM context. There is no way to clone a module from one context to
+// another, so we serialize each part of the original module after a split to
+// bitcode, and parse it back into a new LLVM context. Serialization reads the
+// context of the original module, which is not thread safe, but parsing can
+// run concurrently with the compilation of other parts.
+static llvm::SmallString<0> WriteModulePartBitcode(int64_t part,
+                                                   const llvm::Module& module) {
   TraceMe trace([&] {
-    return TraceMeEncode("CpuCompiler::CloneAsThreadSafeModule",
+    return TraceMeEncode("CpuCompiler::WriteModulePartBitcode",
                          {{"part", part}});
   });
 
-  // There is no way to clone a module from one context to another, so we need
-  // to serialize the module to bitcode and parse it back into the new context.
   llvm::SmallString<0> bc;
   llvm::raw_svector_ostream bcos(bc);
-  llvm::WriteBitcodeToFile(*module, bcos);
+  llvm::WriteBitcodeToFile(module, bcos);
+  return bc;
+}
+
+// Parses a ThreadSafeModule in a new LLVM context from the given bitcode of an
+// LLVM module part.
+static absl::StatusOr<llvm::orc::ThreadSafeModule> ParseModulePartBitcode(
+    int64_t part, const llvm::SmallString<0>& bc) {
+  TraceMe trace([&] {
+    return TraceMeEncode("CpuCompiler::ParseModulePartBitcode",
+                         {{"part", part}});
+  });
 
-  // Parse module back into its own LLVM context.
   auto clone_context = std::make_unique<llvm::LLVMContext>();
   auto clone_module = llvm::parseBitcodeFile(
       llvm::MemoryBufferRef(
           llvm::StringRef(bc.data(), bc.size()),
           absl::StrFormat("%s_part_%02d", kXlaModuleIdentifier, part)),
       *clone_context);
+  if (!clone_module) {
+    return Internal("Failed to parse LLVM module part %d: %s", part,
+                    llvm::toString(clone_module.takeError()));
+  }
 
   return llvm::orc::ThreadSafeModule(std::move(*clone_module),
                                      std::move(clone_context));
@@ -1245,28 +1296,26 @@ static CompiledSymbolsPart CollectCompiledSymbolsPart(
     const IrEmitter2& ir_emitter, const llvm::Module& module) {
   CompiledSymbolsPart syms;
 
-  auto find_kernel =
-      [&](llvm::StringRef name) -> std::optional<IrEmitter2::KernelInfo> {
-    for (auto& k : ir_emitter.kernels()) {
-      if (k.name == name) return k;
-    }
-    return std::nullopt;
-  };
-
-  auto find_comparator =
-      [&](llvm::StringRef name) -> std::optional<IrEmitter2::ComparatorInfo> {
-    for (auto& c : ir_emitter.comparators()) {
-      if (c.name == name) return c;
-    }
-    return std::nullopt;
-  };
+  // Modules with thousands of kernels are common, so look symbols up by name
+  // instead of scanning all kernels for each function.
+  absl::flat_hash_map<std::string_view, const IrEmitter2::KernelInfo*> kernels;
+  for (const auto& k : ir_emitter.kernels()) {
+    kernels.emplace(k.name, &k);
+  }
+  absl::flat_hash_map<std::string_view, const IrEmitter2::ComparatorInfo*>
+      comparators;
+  for (const auto& c : ir_emitter.comparators()) {
+    comparators.emplace(c.name, &c);
+  }
 
   for (auto& f : module.functions()) {
-    if (auto kernel = find_kernel(f.getName())) {
-      syms.kernels.push_back(*kernel);
+    std::string_view name(f.getName().data(), f.getName().size());
+    if (auto kernel = kernels.find(name); kernel != kernels.end()) {
+      syms.kernels.push_back(*kernel->second);
     }
-    if (auto comparator = find_comparator(f.getName())) {
-      syms.comparators.push_back(*comparator);
+    if (auto comparator = comparators.find(name);
+        comparator != comparators.end()) {
+      syms.comparators.push_back(*comparator->second);
     }
   }
 
@@ -1335,7 +1384,7 @@ CpuCompiler::CompileLegacyCpuExecutable(std::unique_ptr<HloModule> module) {
       llvm_ir::GetCpuFastMathFlags(module->config()), pre_optimization_ir_hook,
       post_optimization_ir_hook,
       CreateOrcJITPostCompilationHook(module.get(), &obj_files),
-      parallel_codegen_split_count);
+      parallel_codegen_split_count, CreatePersistentObjectCache(*module));
   if (!jit) {
     return Internal("Creating JIT failed: %s", llvm::toString(jit.takeError()));
   }
@@ -1461,9 +1510,11 @@ CpuCompiler::CompileLegacyCpuExecutable(std::unique_ptr<HloModule> module) {
     // JIT compile the LLVM IR module to in-memory machine code. We split the
     // module into `num_jit_dylibs` parts to allow parallel compilation. In
     // practice, all of the kernel functions are independent and don't call each
-    // other, so we can compile each individual part in parallel. We split
-    // module preserving locals, which should guarantee that all thread local
-    // computations end up in the same module with the corresponding kernel.
+    // other, so we can compile each individual part in parallel. Functions and
+    // globals referring to each other stay in the same part, which guarantees
+    // that all thread local computations end up in the same module with the
+    // corresponding kernel. Parts are balanced by their number of LLVM
+    // instructions, so that a few large fusions don't serialize compilation.
 
     // We rely on async executor to run compilation-related tasks in parallel.
     auto* async = GetCompilationAsyncExecutor();
@@ -1472,6 +1523,10 @@ CpuCompiler::CompileLegacyCpuExecutable(std::unique_ptr<HloModule> module) {
     // issue compile tasks in parallel without any interference.
     std::vector<CompiledSymbolsPart> compiled_parts;
 
+    // Bitcode of the LLVM module parts, which compilation tasks parse and add
+    // to the JIT before compiling them. Empty if the module is not split.
+    std::vector<llvm::SmallString<0>> compiled_parts_bitcode;
+
     VLOG(2) << "Compile LLVM module with " << ir_emitter2.kernels().size()
             << " kernels and " << ir_emitter2.comparators().size()
             << " comparators";
@@ -1490,19 +1545,16 @@ CpuCompiler::CompileLegacyCpuExecutable(std::unique_ptr<HloModule> module) {
         return TraceMeEncode("SplitModule", {{"num_parts", num_parts}});
       });
 
-      llvm::SplitModule(
+      SplitModuleByCost(
           *llvm_module, num_parts,
-          [&, n = 0](std::unique_ptr<llvm::Module> llvm_module_part) mutable {
+          [&](std::unique_ptr<llvm::Module> llvm_module_part) {
             // Collect symbols that are compiled in this LLVM module part.
             RemoveUnusedSymbols(*llvm_module_part);
             compiled_parts.push_back(
                 CollectCompiledSymbolsPart(ir_emitter2, *llvm_module_part));
-
-            // Clone LLVM module part into its own thread safe context.
-            auto tsm = CloneAsThreadSafeModule(n, std::move(llvm_module_part));
-            cantFail((*jit)->AddModule(std::move(tsm), /*dylib_index=*/n++));
-          },
-          /*PreserveLocals=*/true, /*RoundRobin=*/true);
+            compiled_parts_bitcode.push_back(WriteModulePartBitcode(
+                compiled_parts_bitcode.size(), *llvm_module_part));
+          });
 
       // Free resources used by the original LLVM module.
       llvm_module.reset();
@@ -1534,6 +1586,18 @@ CpuCompiler::CompileLegacyCpuExecutable(std::unique_ptr<HloModule> module) {
                               {"num_comparators", symbols.comparators.size()}});
       });
 
+      // Load LLVM module part into its own thread safe context.
+      if (!compiled_parts_bitcode.empty()) {
+        TF_ASSIGN_OR_RETURN(
+            llvm::orc::ThreadSafeModule tsm,
+            ParseModulePartBitcode(part, compiled_parts_bitcode[part]));
+        compiled_parts_bitcode[part] = llvm::SmallString<0>();
+        if (auto err = (*jit)->AddModule(std::move(tsm), part)) {
+          return Internal("Failed to add LLVM module part %d: %s", part,
+                          llvm::toString(std::move(err)));
+        }
+      }
+
       for (const auto& kernel : symbols.kernels) {
         TraceMe trace(
             [&] { return TraceMeEncode("Kernel", {{"name", kernel.name}}); });
@@ -44,6 +44,7 @@ limitations under the License.
 #include "xla/backends/cpu/runtime/buffer_allocations.h"
 #include "xla/backends/cpu/runtime/thunk.h"
 #include "xla/backends/cpu/runtime/thunk_executor.h"
+#include "xla/backends/cpu/runtime/thunk_profiler.h"
 #include "xla/executable_run_options.h"
 #include "xla/hlo/ir/hlo_computation.h"
 #include "xla/hlo/ir/hlo_input_output_alias_config.h"
@@ -54,6 +55,7 @@ limitations under the License.
 #include "xla/service/cpu/simple_orc_jit.h"
 #include "xla/service/custom_call_status.h"
 #include "xla/service/custom_call_status_internal.h"
+#include "xla/service/dump.h"
 #include "xla/service/executable.h"
 #include "xla/service/hlo_execution_profile.h"
 #include "xla/service/hlo_value.h"
@@ -69,10 +71,12 @@ limitations under the License.
 #include "xla/stream_executor/host/host_stream.h"
 #include "xla/tsl/concurrency/async_value_ref.h"
 #include "xla/util.h"
+#include "xla/xla.pb.h"
 #include "xla/xla_data.pb.h"
 #include "tsl/platform/env.h"
 #include "tsl/platform/logging.h"
 #include "tsl/platform/statusor.h"
+#include "tsl/profiler/protobuf/xplane.pb.h"
 
 namespace xla {
 namespace cpu {
@@ -186,8 +190,27 @@ absl::StatusOr<std::unique_ptr<CpuExecutable>> CpuExecutable::Create(
   executable->jit_->DoneCompiling();
   executable->function_registry_ = FunctionRegistry(executable->jit_.get());
 
-  TF_ASSIGN_OR_RETURN(executable->thunks_,
-                      ThunkExecutor::Create(std::move(thunks)));
+  const DebugOptions& debug_options =
+      executable->module().config().debug_options();
+  ThunkExecutor::Options thunk_executor_options;
+  thunk_executor_options.use_critical_path_ready_queue =
+      debug_options.xla_cpu_enable_critical_path_scheduling();
+  thunk_executor_options.use_measured_costs =
+      debug_options.xla_cpu_enable_critical_path_measured_costs();
+
+  TF_ASSIGN_OR_RETURN(
+      executable->thunks_,
+      ThunkExecutor::Create(std::move(thunks), thunk_executor_options));
+
+  if (debug_options.xla_cpu_thunk_profiler_sample_rate() > 0) {
+    ThunkProfiler::Options thunk_profiler_options;
+    thunk_profiler_options.sample_rate =
+        debug_options.xla_cpu_thunk_profiler_sample_rate();
+    executable->thunk_profiler_ =
+        std::make_unique<ThunkProfiler>(thunk_profiler_options);
+    executable->thunk_profiler_->RegisterThunkSequence(
+        executable->thunks_->thunk_sequence());
+  }
 
   // Re-index constants by their allocation index to allow efficient lookup.
   for (auto& constant : constants) {
@@ -218,6 +241,16 @@ CpuExecutable::~CpuExecutable() {
   if (has_module()) {
     XlaDebugInfoManager::Get()->UnregisterModule(module().unique_id());
   }
+
+  // Dump the thunk profile collected over the lifetime of the executable.
+  if (thunk_profiler_ && has_module() && thunk_profiler_->num_traces() > 0) {
+    DumpToFileInDir(module(), "", "thunk_profile.folded",
+                    thunk_profiler_->ToFoldedStacks());
+    tensorflow::profiler::XPlane plane;
+    thunk_profiler_->ExportXPlane(&plane);
+    DumpToFileInDir(module(), "", "thunk_profile.xplane.pb",
+                    plane.SerializeAsString());
+  }
 }
 
 static absl::StatusOr<MaybeOwningDeviceMemory> MemoryForAllocation(
@@ -400,7 +433,8 @@ absl::Status CpuExecutable::ExecuteThunks(
       run_options->intra_op_thread_pool(),
       &task_runner,
       &collective_execute_params,
-      &custom_call_execute_params};
+      &custom_call_execute_params,
+      thunk_profiler_.get()};
 
   auto executed_event = thunks_->Execute(execute_params);
   tsl::BlockUntilReady(executed_event);
@@ -30,6 +30,7 @@ limitations under the License.
 #include "absl/types/span.h"
 #include "xla/backends/cpu/runtime/thunk.h"
 #include "xla/backends/cpu/runtime/thunk_executor.h"
+#include "xla/backends/cpu/runtime/thunk_profiler.h"
 #include "xla/executable_run_options.h"
 #include "xla/hlo/ir/hlo_instruction.h"
 #include "xla/hlo/ir/hlo_module.h"
@@ -133,6 +134,10 @@ class CpuExecutable : public Executable {
   bool has_thunks() const { return thunks_.has_value(); }
   ThunkExecutor& thunks() { return *thunks_; }
 
+  // Returns the profiler sampling thunk executions, or nullptr if thunk
+  // executions are not profiled.
+  ThunkProfiler* thunk_profiler() { return thunk_profiler_.get(); }
+
   const BufferAssignment& buffer_assignment() const { return *assignment_; }
   absl::Span<const ConstantAllocation> constants() const { return constants_; }
 
@@ -228,6 +233,8 @@ class CpuExecutable : public Executable {
 
   // A thunk executor created from the compiled thunk sequence.
   std::optional<ThunkExecutor> thunks_;
+  // Not null if `xla_cpu_thunk_profiler_sample_rate` is positive.
+  std::unique_ptr<ThunkProfiler> thunk_profiler_;
   // Vector indexed by BufferAllocation::Index for efficient access.
   std::vector<ConstantAllocation> constants_;
   // On-demand JIT compiler for functions required by thunks.
@@ -0,0 +1,211 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/cpu/module_split.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Comdat.h"
+#include "llvm/IR/Constant.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/User.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+namespace xla::cpu {
+namespace {
+
+// Groups the global values defined by a module into clusters of global values
+// that refer to each other.
+class Clusters {
+ public:
+  explicit Clusters(const llvm::Module& module) {
+    for (const llvm::GlobalValue& gv : module.global_values()) {
+      if (gv.isDeclaration()) continue;
+      index_.emplace(&gv, parent_.size());
+      parent_.push_back(parent_.size());
+      values_.push_back(&gv);
+    }
+  }
+
+  void Union(const llvm::GlobalValue* a, const llvm::GlobalValue* b) {
+    auto it_a = index_.find(a);
+    auto it_b = index_.find(b);
+    if (it_a == index_.end() || it_b == index_.end()) return;
+    size_t root_a = Find(it_a->second);
+    size_t root_b = Find(it_b->second);
+    // Keep the global value defined first as the root, so that clusters are
+    // ordered deterministically.
+    if (root_a != root_b) {
+      parent_[std::max(root_a, root_b)] = std::min(root_a, root_b);
+    }
+  }
+
+  // Returns the index of the cluster of the `i`-th global value, which is the
+  // index of the first global value of the cluster.
+  size_t Find(size_t i) {
+    while (parent_[i] != i) {
+      parent_[i] = parent_[parent_[i]];
+      i = parent_[i];
+    }
+    return i;
+  }
+
+  size_t size() const { return values_.size(); }
+  const llvm::GlobalValue* value(size_t i) const { return values_[i]; }
+
+ private:
+  absl::flat_hash_map<const llvm::GlobalValue*, size_t> index_;
+  std::vector<size_t> parent_;
+  std::vector<const llvm::GlobalValue*> values_;
+};
+
+// Calls `f` for every global value referred to by `user`, looking through
+// constant expressions and aggregates.
+void ForEachReferencedGlobal(
+    const llvm::User* user,
+    absl::FunctionRef<void(const llvm::GlobalValue*)> f) {
+  std::vector<const llvm::User*> worklist = {user};
+  absl::flat_hash_set<const llvm::Constant*> visited;
+  while (!worklist.empty()) {
+    const llvm::User* next = worklist.back();
+    worklist.pop_back();
+    for (const llvm::Value* operand : next->operands()) {
+      if (auto* gv = llvm::dyn_cast<llvm::GlobalValue>(operand)) {
+        f(gv);
+      } else if (auto* constant = llvm::dyn_cast<llvm::Constant>(operand)) {
+        if (visited.insert(constant).second) worklist.push_back(constant);
+      }
+    }
+  }
+}
+
+// Calls `f` for every global value referred to by the definition of `gv`.
+void ForEachReferencedGlobal(
+    const llvm::GlobalValue& gv,
+    absl::FunctionRef<void(const llvm::GlobalValue*)> f) {
+  if (auto* function = llvm::dyn_cast<llvm::Function>(&gv)) {
+    if (function->hasPersonalityFn()) {
+      ForEachReferencedGlobal(function, f);
+    }
+    for (const llvm::BasicBlock& block : *function) {
+      for (const llvm::Instruction& instruction : block) {
+        ForEachReferencedGlobal(&instruction, f);
+      }
+    }
+  } else {
+    // Global variables refer to their initializer, aliases and ifuncs to their
+    // aliasee and resolver.
+    ForEachReferencedGlobal(llvm::cast<llvm::User>(&gv), f);
+  }
+}
+
+bool HasAppendingGlobals(const llvm::Module& module) {
+  for (const llvm::GlobalVariable& gv : module.globals()) {
+    if (gv.hasAppendingLinkage()) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+void SplitModuleByCost(
+    llvm::Module& module, size_t num_parts,
+    absl::FunctionRef<void(std::unique_ptr<llvm::Module>)> callback) {
+  if (HasAppendingGlobals(module)) {
+    llvm::SplitModule(
+        module, num_parts,
+        [&](std::unique_ptr<llvm::Module> part) { callback(std::move(part)); },
+        /*PreserveLocals=*/true, /*RoundRobin=*/true);
+    return;
+  }
+
+  Clusters clusters(module);
+  absl::flat_hash_map<const llvm::Comdat*, const llvm::GlobalValue*> comdats;
+  for (size_t i = 0; i < clusters.size(); ++i) {
+    const llvm::GlobalValue* gv = clusters.value(i);
+    if (const llvm::Comdat* comdat = gv->getComdat()) {
+      clusters.Union(gv, comdats.try_emplace(comdat, gv).first->second);
+    }
+    ForEachReferencedGlobal(*gv, [&](const llvm::GlobalValue* referenced) {
+      clusters.Union(gv, referenced);
+    });
+  }
+
+  // Estimate the compilation cost of each cluster. Every global value costs
+  // something, so that the parts get a similar number of them when there are
+  // no functions.
+  std::vector<int64_t> cost(clusters.size(), 0);
+  for (size_t i = 0; i < clusters.size(); ++i) {
+    int64_t gv_cost = 1;
+    if (auto* function = llvm::dyn_cast<llvm::Function>(clusters.value(i))) {
+      gv_cost += function->getInstructionCount();
+    }
+    cost[clusters.Find(i)] += gv_cost;
+  }
+
+  std::vector<size_t> roots;
+  for (size_t i = 0; i < clusters.size(); ++i) {
+    if (clusters.Find(i) == i) roots.push_back(i);
+  }
+  std::stable_sort(roots.begin(), roots.end(),
+                   [&](size_t a, size_t b) { return cost[a] > cost[b]; });
+
+  // Assign the most expensive clusters first, each to the least loaded part.
+  num_parts = std::max<size_t>(1, std::min(num_parts, roots.size()));
+  using Load = std::pair<int64_t, size_t>;  // (cost, part)
+  std::priority_queue<Load, std::vector<Load>, std::greater<Load>> loads;
+  for (size_t part = 0; part < num_parts; ++part) loads.push({0, part});
+
+  std::vector<size_t> cluster_part(clusters.size());
+  for (size_t root : roots) {
+    auto [load, part] = loads.top();
+    loads.pop();
+    cluster_part[root] = part;
+    loads.push({load + cost[root], part});
+  }
+
+  absl::flat_hash_map<const llvm::GlobalValue*, size_t> gv_part;
+  for (size_t i = 0; i < clusters.size(); ++i) {
+    gv_part[clusters.value(i)] = cluster_part[clusters.Find(i)];
+  }
+
+  for (size_t part = 0; part < num_parts; ++part) {
+    llvm::ValueToValueMapTy vmap;
+    callback(llvm::CloneModule(module, vmap, [&](const llvm::GlobalValue* gv) {
+      auto it = gv_part.find(gv);
+      return it != gv_part.end() && it->second == part;
+    }));
+  }
+}
+
+}  // namespace xla::cpu
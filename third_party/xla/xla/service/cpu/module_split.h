@@ -0,0 +1,44 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_CPU_MODULE_SPLIT_H_
+#define XLA_SERVICE_CPU_MODULE_SPLIT_H_
+
+#include <cstddef>
+#include <memory>
+
+#include "absl/functional/function_ref.h"
+#include "llvm/IR/Module.h"
+
+namespace xla::cpu {
+
+// Splits `module` into at most `num_parts` modules that can be compiled and
+// linked independently of each other, and passes them to `callback` in order.
+//
+// Unlike `llvm::SplitModule`, which balances the number of global values in
+// each part, parts are balanced by their estimated compilation cost: the
+// number of LLVM instructions in their functions. Global values referring to
+// each other are kept in the same part, so parts never need symbols defined by
+// other parts. Definitions that go to other parts become declarations.
+//
+// Modules with appending globals (e.g. `llvm.used`) are split with
+// `llvm::SplitModule` instead.
+void SplitModuleByCost(
+    llvm::Module& module, size_t num_parts,
+    absl::FunctionRef<void(std::unique_ptr<llvm::Module>)> callback);
+
+}  // namespace xla::cpu
+
+#endif  // XLA_SERVICE_CPU_MODULE_SPLIT_H_
@@ -0,0 +1,142 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/cpu/module_split.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "tsl/platform/test.h"
+
+namespace xla::cpu {
+namespace {
+
+// Returns the IR of a kernel named `name` with about `num_instructions`
+// instructions.
+std::string Kernel(const std::string& name, int num_instructions) {
+  std::string ir = absl::StrCat("define void @", name,
+                                "(ptr %p) {\n  %v0 = load i32, ptr %p\n");
+  for (int i = 1; i < num_instructions; ++i) {
+    absl::StrAppend(&ir, "  %v", i, " = add i32 %v", i - 1, ", ", i, "\n");
+  }
+  absl::StrAppend(&ir, "  store i32 %v", num_instructions - 1,
+                  ", ptr %p\n  ret void\n}\n");
+  return ir;
+}
+
+std::vector<std::unique_ptr<llvm::Module>> Split(llvm::Module& module,
+                                                 size_t num_parts) {
+  std::vector<std::unique_ptr<llvm::Module>> parts;
+  SplitModuleByCost(module, num_parts, [&](std::unique_ptr<llvm::Module> part) {
+    parts.push_back(std::move(part));
+  });
+  return parts;
+}
+
+// Returns the index of the part defining `name`, or -1 if none does. Expects
+// that at most one part defines it.
+int DefiningPart(const std::vector<std::unique_ptr<llvm::Module>>& parts,
+                 const std::string& name) {
+  int defining_part = -1;
+  for (int i = 0; i < parts.size(); ++i) {
+    const llvm::GlobalValue* gv = parts[i]->getNamedValue(name);
+    if (gv != nullptr && !gv->isDeclaration()) {
+      EXPECT_EQ(defining_part, -1) << name << " is defined by several parts";
+      defining_part = i;
+    }
+  }
+  return defining_part;
+}
+
+TEST(ModuleSplitTest, BalancesPartsByInstructionCount) {
+  llvm::LLVMContext context;
+  llvm::SMDiagnostic diagnostic;
+  std::unique_ptr<llvm::Module> module = llvm::parseAssemblyString(
+      absl::StrCat(Kernel("large", 100), Kernel("medium", 60),
+                   Kernel("small0", 40), Kernel("small1", 40)),
+      diagnostic, context);
+  ASSERT_NE(module, nullptr) << diagnostic.getMessage().str();
+
+  std::vector<std::unique_ptr<llvm::Module>> parts = Split(*module, 2);
+  ASSERT_EQ(parts.size(), 2);
+  // The two largest kernels go to different parts, and each small kernel goes
+  // to the least loaded part at the time.
+  EXPECT_EQ(DefiningPart(parts, "large"), 0);
+  EXPECT_EQ(DefiningPart(parts, "medium"), 1);
+  EXPECT_EQ(DefiningPart(parts, "small0"), 1);
+  EXPECT_EQ(DefiningPart(parts, "small1"), 0);
+  for (const auto& part_module : parts) {
+    EXPECT_FALSE(llvm::verifyModule(*part_module, &llvm::errs()));
+  }
+}
+
+TEST(ModuleSplitTest, KeepsReferencedGlobalsTogether) {
+  llvm::LLVMContext context;
+  llvm::SMDiagnostic diagnostic;
+  std::unique_ptr<llvm::Module> module = llvm::parseAssemblyString(
+      R"(
+        @constant = internal constant [2 x i32] [i32 1, i32 2]
+
+        define internal void @nested(ptr %p) {
+          %v = load i32, ptr @constant
+          store i32 %v, ptr %p
+          ret void
+        }
+
+        define void @kernel(ptr %p) {
+          call void @nested(ptr %p)
+          ret void
+        }
+
+        define void @other_kernel(ptr %p) {
+          %v = load i32, ptr getelementptr ([2 x i32], ptr @constant, i64 0,
+                                           i64 1)
+          store i32 %v, ptr %p
+          ret void
+        }
+
+        define void @independent_kernel(ptr %p) {
+          store i32 0, ptr %p
+          ret void
+        }
+      )",
+      diagnostic, context);
+  ASSERT_NE(module, nullptr) << diagnostic.getMessage().str();
+
+  std::vector<std::unique_ptr<llvm::Module>> parts = Split(*module, 4);
+  ASSERT_EQ(parts.size(), 2);
+  int part = DefiningPart(parts, "kernel");
+  EXPECT_EQ(DefiningPart(parts, "nested"), part);
+  EXPECT_EQ(DefiningPart(parts, "constant"), part);
+  EXPECT_EQ(DefiningPart(parts, "other_kernel"), part);
+  EXPECT_NE(DefiningPart(parts, "independent_kernel"), part);
+  for (const auto& part_module : parts) {
+    EXPECT_FALSE(llvm::verifyModule(*part_module, &llvm::errs()));
+  }
+}
+
+}  // namespace
+}  // namespace xla::cpu
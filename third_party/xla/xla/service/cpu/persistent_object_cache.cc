@@ -0,0 +1,312 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/cpu/persistent_object_cache.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/crc/crc32c.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/MemoryBufferRef.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+#include "xla/util.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/file_statistics.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/path.h"
+#include "tsl/platform/random.h"
+
+namespace xla::cpu {
+namespace {
+
+// Every cache entry starts with a header of `kHeaderSize` bytes: the magic
+// bytes, the size of the object file as a 64-bit integer and the CRC32C of
+// the object file as a 32-bit integer, padded to 8 bytes. Integers are in host
+// byte order, as entries are only ever read by the machine they target.
+constexpr std::string_view kMagic = "XLAOBJ01";
+constexpr size_t kHeaderSize = 24;
+
+// Infix of the names of the files entries are written to before they are
+// renamed. Temporary files older than `kStaleTemporaryNanos` are left over by
+// crashed writers and deleted on eviction.
+constexpr std::string_view kTemporaryInfix = ".tmp.";
+constexpr int64_t kStaleTemporaryNanos = int64_t{3600} * 1000 * 1000 * 1000;
+
+// Entries hit after `kRefreshNanos` since they were written are rewritten, so
+// that eviction, which goes by modification time, keeps them.
+constexpr int64_t kRefreshNanos = int64_t{3600} * 1000 * 1000 * 1000;
+
+// Estimated sizes of the cache directories this process inserted entries to.
+struct DirectorySizes {
+  absl::Mutex mu;
+  absl::flat_hash_map<std::string, int64_t> bytes ABSL_GUARDED_BY(mu);
+};
+
+DirectorySizes& GetDirectorySizes() {
+  static auto* const sizes = new DirectorySizes();
+  return *sizes;
+}
+
+std::string EncodeEntry(std::string_view object) {
+  std::string entry(kHeaderSize, '\0');
+  const uint64_t size = object.size();
+  const uint32_t crc = static_cast<uint32_t>(absl::ComputeCrc32c(object));
+  std::memcpy(entry.data(), kMagic.data(), kMagic.size());
+  std::memcpy(entry.data() + 8, &size, sizeof(size));
+  std::memcpy(entry.data() + 16, &crc, sizeof(crc));
+  entry.append(object);
+  return entry;
+}
+
+absl::StatusOr<std::string_view> DecodeEntry(std::string_view entry) {
+  if (entry.size() < kHeaderSize || entry.substr(0, 8) != kMagic) {
+    return Internal("Not an XLA:CPU object cache entry");
+  }
+  uint64_t size;
+  uint32_t crc;
+  std::memcpy(&size, entry.data() + 8, sizeof(size));
+  std::memcpy(&crc, entry.data() + 16, sizeof(crc));
+  std::string_view object = entry.substr(kHeaderSize);
+  if (object.size() != size) {
+    return Internal("Object file has %d bytes instead of %d", object.size(),
+                    size);
+  }
+  if (static_cast<uint32_t>(absl::ComputeCrc32c(object)) != crc) {
+    return Internal("Object file checksum mismatch");
+  }
+  return object;
+}
+
+}  // namespace
+
+PersistentObjectCache::PersistentObjectCache(std::string directory,
+                                             int64_t max_size_bytes,
+                                             std::string key_prefix,
+                                             tsl::Env* env)
+    : directory_(std::move(directory)),
+      max_size_bytes_(max_size_bytes),
+      key_prefix_(std::move(key_prefix)),
+      env_(env ? env : tsl::Env::Default()) {}
+
+std::string PersistentObjectCache::ModuleKey(const llvm::Module& module) const {
+  std::string bitcode;
+  llvm::raw_string_ostream os(bitcode);
+  llvm::WriteBitcodeToFile(module, os);
+  os.flush();
+
+  llvm::SHA256 sha256;
+  sha256.update(llvm::StringRef(key_prefix_));
+  sha256.update(llvm::StringRef(bitcode));
+  std::array<uint8_t, 32> hash = sha256.final();
+  return absl::BytesToHexString(std::string_view(
+      reinterpret_cast<const char*>(hash.data()), hash.size()));
+}
+
+std::string PersistentObjectCache::EntryPath(std::string_view key) const {
+  return tsl::io::JoinPath(directory_, absl::StrCat(key, kEntrySuffix));
+}
+
+std::optional<std::string> PersistentObjectCache::Lookup(
+    std::string_view key) {
+  std::string path = EntryPath(key);
+  std::string entry;
+  if (absl::Status s = tsl::ReadFileToString(env_, path, &entry); !s.ok()) {
+    if (!absl::IsNotFound(s)) {
+      LOG(WARNING) << "Failed to read XLA:CPU object cache entry " << path
+                   << ": " << s;
+    }
+    return std::nullopt;
+  }
+
+  absl::StatusOr<std::string_view> object = DecodeEntry(entry);
+  if (!object.ok()) {
+    LOG(WARNING) << "Dropping corrupted XLA:CPU object cache entry " << path
+                 << ": " << object.status();
+    env_->DeleteFile(path).IgnoreError();
+    return std::nullopt;
+  }
+
+  tsl::FileStatistics stat;
+  if (env_->Stat(path, &stat).ok() &&
+      static_cast<int64_t>(env_->NowNanos()) - stat.mtime_nsec >
+          kRefreshNanos) {
+    // Failing to refresh an entry only makes it more likely to be evicted.
+    if (absl::Status s = WriteEntry(path, entry); !s.ok()) {
+      LOG(WARNING) << "Failed to refresh XLA:CPU object cache entry " << path
+                   << ": " << s;
+    }
+  }
+  return std::string(*object);
+}
+
+absl::Status PersistentObjectCache::WriteEntry(const std::string& path,
+                                               std::string_view entry) {
+  // Write the entry to a temporary file and rename it, so that readers never
+  // see partially written entries.
+  std::string temp_path =
+      absl::StrCat(path, kTemporaryInfix, tsl::random::New64());
+  TF_RETURN_IF_ERROR(tsl::WriteStringToFile(env_, temp_path, entry));
+  if (absl::Status s = env_->RenameFile(temp_path, path); !s.ok()) {
+    env_->DeleteFile(temp_path).IgnoreError();
+    return s;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status PersistentObjectCache::Insert(std::string_view key,
+                                           std::string_view object) {
+  TF_RETURN_IF_ERROR(env_->RecursivelyCreateDir(directory_));
+
+  std::string path = EntryPath(key);
+  std::string entry = EncodeEntry(object);
+  TF_RETURN_IF_ERROR(WriteEntry(path, entry));
+  VLOG(2) << "Wrote XLA:CPU object cache entry " << path << " ("
+          << object.size() << " bytes)";
+
+  if (max_size_bytes_ <= 0) {
+    return absl::OkStatus();
+  }
+
+  // Listing the directory takes time linear in the number of entries, so we
+  // only do it when the estimated directory size goes over budget. Replaced
+  // entries are counted twice, which only makes the next listing earlier.
+  {
+    DirectorySizes& sizes = GetDirectorySizes();
+    absl::MutexLock lock(&sizes.mu);
+    auto it = sizes.bytes.find(directory_);
+    if (it != sizes.bytes.end()) {
+      it->second += entry.size();
+      if (it->second <= max_size_bytes_) {
+        return absl::OkStatus();
+      }
+    }
+  }
+  return MaybeEvict();
+}
+
+absl::Status PersistentObjectCache::MaybeEvict() {
+  struct Entry {
+    std::string path;
+    int64_t size;
+    int64_t mtime_nsec;
+  };
+
+  std::vector<std::string> children;
+  TF_RETURN_IF_ERROR(env_->GetChildren(directory_, &children));
+
+  std::vector<Entry> entries;
+  int64_t total_size = 0;
+  const int64_t now_nsec = env_->NowNanos();
+  for (const std::string& child : children) {
+    std::string path = tsl::io::JoinPath(directory_, child);
+    // Entries might be deleted concurrently by other processes.
+    tsl::FileStatistics stat;
+    if (!env_->Stat(path, &stat).ok() || stat.is_directory) continue;
+
+    if (absl::StrContains(child, kTemporaryInfix)) {
+      if (now_nsec - stat.mtime_nsec > kStaleTemporaryNanos) {
+        env_->DeleteFile(path).IgnoreError();
+      }
+    } else if (absl::EndsWith(child, kEntrySuffix)) {
+      entries.push_back({std::move(path), stat.length, stat.mtime_nsec});
+      total_size += stat.length;
+    }
+  }
+
+  // Evicting below the budget leaves room for the following inserts, which
+  // don't list the directory until they fill it.
+  if (total_size > max_size_bytes_) {
+    const int64_t target_size = max_size_bytes_ - max_size_bytes_ / 10;
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) {
+                return a.mtime_nsec < b.mtime_nsec;
+              });
+    for (const Entry& entry : entries) {
+      if (total_size <= target_size) break;
+      absl::Status s = env_->DeleteFile(entry.path);
+      if (!s.ok() && !absl::IsNotFound(s)) {
+        return s;
+      }
+      VLOG(2) << "Evicted XLA:CPU object cache entry " << entry.path;
+      total_size -= entry.size;
+    }
+  }
+
+  DirectorySizes& sizes = GetDirectorySizes();
+  absl::MutexLock lock(&sizes.mu);
+  sizes.bytes[directory_] = total_size;
+  return absl::OkStatus();
+}
+
+std::unique_ptr<llvm::MemoryBuffer> PersistentObjectCache::getObject(
+    const llvm::Module* module) {
+  std::string key = ModuleKey(*module);
+  if (std::optional<std::string> object = Lookup(key)) {
+    VLOG(1) << "XLA:CPU object cache hit for module "
+            << module->getModuleIdentifier() << ": " << key;
+    ++num_hits_;
+    return llvm::MemoryBuffer::getMemBufferCopy(
+        *object, module->getModuleIdentifier());
+  }
+
+  VLOG(1) << "XLA:CPU object cache miss for module "
+          << module->getModuleIdentifier() << ": " << key;
+  ++num_misses_;
+  absl::MutexLock lock(&mu_);
+  pending_keys_[module] = std::move(key);
+  return nullptr;
+}
+
+void PersistentObjectCache::notifyObjectCompiled(const llvm::Module* module,
+                                                 llvm::MemoryBufferRef object) {
+  std::string key;
+  {
+    absl::MutexLock lock(&mu_);
+    auto it = pending_keys_.find(module);
+    if (it == pending_keys_.end()) return;
+    key = std::move(it->second);
+    pending_keys_.erase(it);
+  }
+
+  // Failing to cache an object file must not fail the compilation.
+  absl::Status s = Insert(
+      key, std::string_view(object.getBufferStart(), object.getBufferSize()));
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to write XLA:CPU object cache entry: " << s;
+  }
+}
+
+}  // namespace xla::cpu
@@ -0,0 +1,120 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_CPU_PERSISTENT_OBJECT_CACHE_H_
+#define XLA_SERVICE_CPU_PERSISTENT_OBJECT_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/MemoryBufferRef.h"
+#include "tsl/platform/env.h"
+
+namespace xla::cpu {
+
+// An LLVM object cache that keeps the object files compiled by the XLA:CPU JIT
+// in a directory, so that processes compiling the same LLVM modules for the
+// same machine load the object files instead of running LLVM optimizations
+// and code generation again.
+//
+// Object files are keyed by the SHA-256 of a caller-provided key prefix and of
+// the bitcode of the module before optimizations. The key prefix must capture
+// everything besides the module that changes the compiled code, i.e. the
+// target machine and the compilation options. Each entry carries its size and
+// a CRC32C checksum, and entries that don't match them are dropped as misses.
+//
+// Entries are written to a temporary file and renamed, so concurrent readers
+// and writers, including other processes, never observe partial entries. Once
+// the directory holds more than `max_size_bytes`, entries are evicted starting
+// from the least recently used ones. Entries are rewritten when they are hit
+// after an hour since they were last written, which keeps hot entries in the
+// cache without writing them on every hit.
+//
+// Inserts keep a process-wide estimate of the size of the cache directory, and
+// only list it when the estimate goes over budget. Eviction then frees a tenth
+// of the budget, so the directory is listed once per that many inserted bytes
+// rather than on every insert. Entries inserted by other processes are
+// accounted for when the directory is listed.
+class PersistentObjectCache : public llvm::ObjectCache {
+ public:
+  // Suffix of the names of the cache entries in the cache directory.
+  static constexpr std::string_view kEntrySuffix = ".xlaobj";
+
+  // Creates a cache in `directory`. Non-positive `max_size_bytes` disables
+  // eviction.
+  PersistentObjectCache(std::string directory, int64_t max_size_bytes,
+                        std::string key_prefix, tsl::Env* env = nullptr);
+
+  // Returns the cache key of `module`.
+  std::string ModuleKey(const llvm::Module& module) const;
+
+  // Returns the object file with `key`, or std::nullopt if there is no valid
+  // entry for it. Refreshes the entry if it was not written recently.
+  std::optional<std::string> Lookup(std::string_view key);
+
+  // Stores `object` with `key`, and evicts entries if the cache directory might
+  // be over budget.
+  absl::Status Insert(std::string_view key, std::string_view object);
+
+  // llvm::ObjectCache API. The key of a module is computed by `getObject`,
+  // which is called before the module is optimized, and reused by
+  // `notifyObjectCompiled`.
+  void notifyObjectCompiled(const llvm::Module* module,
+                            llvm::MemoryBufferRef object) override;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(
+      const llvm::Module* module) override;
+
+  int64_t num_hits() const { return num_hits_.load(); }
+  int64_t num_misses() const { return num_misses_.load(); }
+
+ private:
+  std::string EntryPath(std::string_view key) const;
+
+  // Writes an encoded `entry` to `path` via a temporary file.
+  absl::Status WriteEntry(const std::string& path, std::string_view entry);
+
+  // Lists the cache directory and, if it holds more than `max_size_bytes_`,
+  // deletes the least recently used entries until it holds at most nine tenths
+  // of it. Updates the estimated size of the directory.
+  absl::Status MaybeEvict();
+
+  const std::string directory_;
+  const int64_t max_size_bytes_;
+  const std::string key_prefix_;
+  tsl::Env* const env_;
+
+  absl::Mutex mu_;
+  // Keys of the modules which missed the cache and are being compiled.
+  absl::flat_hash_map<const llvm::Module*, std::string> pending_keys_
+      ABSL_GUARDED_BY(mu_);
+
+  std::atomic<int64_t> num_hits_ = 0;
+  std::atomic<int64_t> num_misses_ = 0;
+};
+
+}  // namespace xla::cpu
+
+#endif  // XLA_SERVICE_CPU_PERSISTENT_OBJECT_CACHE_H_
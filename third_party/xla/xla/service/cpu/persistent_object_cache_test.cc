@@ -0,0 +1,210 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/cpu/persistent_object_cache.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "xla/tsl/lib/core/status_test_util.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/file_statistics.h"
+#include "tsl/platform/path.h"
+#include "tsl/platform/test.h"
+
+namespace xla::cpu {
+namespace {
+
+// Returns an empty cache directory for the test `name`.
+std::string CacheDirectory(const std::string& name) {
+  std::string directory = tsl::io::JoinPath(
+      tsl::testing::TmpDir(), "persistent_object_cache", name);
+  int64_t undeleted_files, undeleted_dirs;
+  tsl::Env::Default()
+      ->DeleteRecursively(directory, &undeleted_files, &undeleted_dirs)
+      .IgnoreError();
+  return directory;
+}
+
+std::string EntryPath(const std::string& directory, const std::string& key) {
+  return tsl::io::JoinPath(
+      directory, absl::StrCat(key, PersistentObjectCache::kEntrySuffix));
+}
+
+// An Env whose clock is `offset_nanos` ahead of the default one.
+class FutureEnv : public tsl::EnvWrapper {
+ public:
+  explicit FutureEnv(int64_t offset_nanos)
+      : tsl::EnvWrapper(tsl::Env::Default()), offset_nanos_(offset_nanos) {}
+
+  uint64_t NowNanos() const override {
+    return target()->NowNanos() + offset_nanos_;
+  }
+
+ private:
+  int64_t offset_nanos_;
+};
+
+std::unique_ptr<llvm::Module> CreateModule(llvm::LLVMContext& context,
+                                           const std::string& function_name) {
+  auto module = std::make_unique<llvm::Module>("test_module", context);
+  llvm::FunctionType* type =
+      llvm::FunctionType::get(llvm::Type::getVoidTy(context), false);
+  llvm::Function::Create(type, llvm::Function::ExternalLinkage, function_name,
+                         *module);
+  return module;
+}
+
+TEST(PersistentObjectCacheTest, InsertAndLookup) {
+  PersistentObjectCache cache(CacheDirectory("insert_and_lookup"),
+                              /*max_size_bytes=*/0, "prefix");
+  EXPECT_EQ(cache.Lookup("key"), std::nullopt);
+  TF_ASSERT_OK(cache.Insert("key", "object"));
+  EXPECT_EQ(cache.Lookup("key"), "object");
+  TF_ASSERT_OK(cache.Insert("key", "other object"));
+  EXPECT_EQ(cache.Lookup("key"), "other object");
+}
+
+TEST(PersistentObjectCacheTest, DropsCorruptedEntries) {
+  std::string directory = CacheDirectory("drops_corrupted_entries");
+  PersistentObjectCache cache(directory, /*max_size_bytes=*/0, "prefix");
+  TF_ASSERT_OK(cache.Insert("key", "object"));
+
+  std::string path = EntryPath(directory, "key");
+  std::string entry;
+  TF_ASSERT_OK(tsl::ReadFileToString(tsl::Env::Default(), path, &entry));
+  entry.back() ^= 1;
+  TF_ASSERT_OK(tsl::WriteStringToFile(tsl::Env::Default(), path, entry));
+
+  EXPECT_EQ(cache.Lookup("key"), std::nullopt);
+  EXPECT_FALSE(tsl::Env::Default()->FileExists(path).ok());
+
+  TF_ASSERT_OK(tsl::WriteStringToFile(tsl::Env::Default(), path, "truncated"));
+  EXPECT_EQ(cache.Lookup("key"), std::nullopt);
+}
+
+TEST(PersistentObjectCacheTest, EvictsOldestEntries) {
+  std::string directory = CacheDirectory("evicts_oldest_entries");
+  std::string object(1000, 'x');
+  PersistentObjectCache cache(directory, /*max_size_bytes=*/2500, "prefix");
+  for (int i = 0; i < 4; ++i) {
+    TF_ASSERT_OK(cache.Insert(absl::StrCat("key", i), object));
+    // Make sure that modification times are different.
+    tsl::Env::Default()->SleepForMicroseconds(10 * 1000);
+  }
+
+  EXPECT_EQ(cache.Lookup("key0"), std::nullopt);
+  EXPECT_EQ(cache.Lookup("key1"), std::nullopt);
+  EXPECT_EQ(cache.Lookup("key2"), object);
+  EXPECT_EQ(cache.Lookup("key3"), object);
+}
+
+TEST(PersistentObjectCacheTest, RefreshesEntriesOnHit) {
+  std::string directory = CacheDirectory("refreshes_entries_on_hit");
+  std::string object(1000, 'x');
+  PersistentObjectCache cache(directory, /*max_size_bytes=*/2500, "prefix");
+  for (int i = 0; i < 2; ++i) {
+    TF_ASSERT_OK(cache.Insert(absl::StrCat("key", i), object));
+    tsl::Env::Default()->SleepForMicroseconds(10 * 1000);
+  }
+
+  // Hits of recently written entries don't rewrite them.
+  tsl::FileStatistics written, hit;
+  TF_ASSERT_OK(
+      tsl::Env::Default()->Stat(EntryPath(directory, "key0"), &written));
+  EXPECT_EQ(cache.Lookup("key0"), object);
+  TF_ASSERT_OK(tsl::Env::Default()->Stat(EntryPath(directory, "key0"), &hit));
+  EXPECT_EQ(hit.mtime_nsec, written.mtime_nsec);
+
+  // A hit two hours later rewrites the entry, so that the next eviction
+  // removes the other entry even though it was written later.
+  FutureEnv future_env(int64_t{2} * 3600 * 1000 * 1000 * 1000);
+  PersistentObjectCache future_cache(directory, /*max_size_bytes=*/2500,
+                                     "prefix", &future_env);
+  EXPECT_EQ(future_cache.Lookup("key0"), object);
+  tsl::Env::Default()->SleepForMicroseconds(10 * 1000);
+  TF_ASSERT_OK(cache.Insert("key2", object));
+
+  EXPECT_EQ(cache.Lookup("key0"), object);
+  EXPECT_EQ(cache.Lookup("key1"), std::nullopt);
+  EXPECT_EQ(cache.Lookup("key2"), object);
+}
+
+TEST(PersistentObjectCacheTest, EvictsWhenEstimatedSizeIsOverBudget) {
+  std::string directory =
+      CacheDirectory("evicts_when_estimated_size_is_over_budget");
+  std::string object(1000, 'x');
+  PersistentObjectCache cache(directory, /*max_size_bytes=*/10000, "prefix");
+  TF_ASSERT_OK(cache.Insert("key0", object));
+
+  // An entry written by another process puts the directory over budget, but
+  // inserts don't list the directory until their own entries fill the budget.
+  std::string other_path = EntryPath(directory, "other");
+  TF_ASSERT_OK(tsl::WriteStringToFile(tsl::Env::Default(), other_path,
+                                      std::string(9000, 'x')));
+  for (int i = 1; i < 9; ++i) {
+    tsl::Env::Default()->SleepForMicroseconds(10 * 1000);
+    TF_ASSERT_OK(cache.Insert(absl::StrCat("key", i), object));
+  }
+  TF_EXPECT_OK(tsl::Env::Default()->FileExists(other_path));
+  EXPECT_EQ(cache.Lookup("key0"), object);
+
+  TF_ASSERT_OK(cache.Insert("key9", object));
+  EXPECT_FALSE(tsl::Env::Default()->FileExists(other_path).ok());
+  EXPECT_EQ(cache.Lookup("key0"), std::nullopt);
+  EXPECT_EQ(cache.Lookup("key9"), object);
+}
+
+TEST(PersistentObjectCacheTest, CachesModuleObjects) {
+  std::string directory = CacheDirectory("caches_module_objects");
+  llvm::LLVMContext context;
+  std::unique_ptr<llvm::Module> module = CreateModule(context, "f");
+  std::unique_ptr<llvm::Module> same_module = CreateModule(context, "f");
+  std::unique_ptr<llvm::Module> other_module = CreateModule(context, "g");
+
+  PersistentObjectCache cache(directory, /*max_size_bytes=*/0, "prefix");
+  EXPECT_EQ(cache.getObject(module.get()), nullptr);
+  cache.notifyObjectCompiled(
+      module.get(), llvm::MemoryBufferRef("object", "test_module"));
+
+  // Another cache in the same directory plays the role of another process.
+  PersistentObjectCache other_cache(directory, /*max_size_bytes=*/0, "prefix");
+  std::unique_ptr<llvm::MemoryBuffer> object =
+      other_cache.getObject(same_module.get());
+  ASSERT_NE(object, nullptr);
+  EXPECT_EQ(object->getBuffer(), "object");
+  EXPECT_EQ(other_cache.getObject(other_module.get()), nullptr);
+  EXPECT_EQ(other_cache.num_hits(), 1);
+  EXPECT_EQ(other_cache.num_misses(), 1);
+
+  // Modules compiled with different options don't share objects.
+  PersistentObjectCache cache_with_other_prefix(directory,
+                                                /*max_size_bytes=*/0, "other");
+  EXPECT_EQ(cache_with_other_prefix.getObject(same_module.get()), nullptr);
+  EXPECT_NE(cache.ModuleKey(*module),
+            cache_with_other_prefix.ModuleKey(*module));
+}
+
+}  // namespace
+}  // namespace xla::cpu
@@ -0,0 +1,112 @@
+/* Copyright 2024 The OpenXLA Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/literal.h"
+#include "xla/literal_util.h"
+#include "xla/service/cpu/persistent_object_cache.h"
+#include "xla/tests/hlo_test_base.h"
+#include "xla/tests/literal_test_util.h"
+#include "xla/xla.pb.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/file_statistics.h"
+#include "tsl/platform/path.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/platform/test.h"
+
+namespace xla::cpu {
+namespace {
+
+class CpuPersistentCacheTest : public HloTestBase {
+ protected:
+  CpuPersistentCacheTest()
+      : cache_dir_(tsl::io::JoinPath(
+            tsl::testing::TmpDir(), "cpu_persistent_cache_test",
+            ::testing::UnitTest::GetInstance()->current_test_info()->name())) {
+    int64_t undeleted_files, undeleted_dirs;
+    tsl::Env::Default()
+        ->DeleteRecursively(cache_dir_, &undeleted_files, &undeleted_dirs)
+        .IgnoreError();
+  }
+
+  DebugOptions GetDebugOptionsForTest() override {
+    DebugOptions debug_options = HloTestBase::GetDebugOptionsForTest();
+    debug_options.set_xla_cpu_persistent_cache_dir(cache_dir_);
+    return debug_options;
+  }
+
+  // Returns the modification times of the cache entries keyed by their names.
+  absl::flat_hash_map<std::string, int64_t> CacheEntries() {
+    absl::flat_hash_map<std::string, int64_t> entries;
+    std::vector<std::string> children;
+    EXPECT_TRUE(tsl::Env::Default()->GetChildren(cache_dir_, &children).ok());
+    for (const std::string& child : children) {
+      if (!absl::EndsWith(child, PersistentObjectCache::kEntrySuffix)) {
+        continue;
+      }
+      tsl::FileStatistics stat;
+      EXPECT_TRUE(tsl::Env::Default()
+                      ->Stat(tsl::io::JoinPath(cache_dir_, child), &stat)
+                      .ok());
+      entries[child] = stat.mtime_nsec;
+    }
+    return entries;
+  }
+
+  const std::string cache_dir_;
+};
+
+TEST_F(CpuPersistentCacheTest, SecondCompilationHitsCache) {
+  constexpr absl::string_view kHloText = R"(
+    HloModule PersistentCache
+
+    ENTRY main {
+      a = f32[4] parameter(0)
+      b = f32[4] add(a, a)
+      ROOT c = f32[4] multiply(b, a)
+    })";
+  Literal arg = LiteralUtil::CreateR1<float>({1, 2, 3, 4});
+  Literal expected = LiteralUtil::CreateR1<float>({2, 8, 18, 32});
+
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<HloModule> module,
+                          ParseAndReturnVerifiedModule(kHloText));
+  EXPECT_TRUE(LiteralTestUtil::Equal(
+      expected, ExecuteAndTransfer(std::move(module), {&arg})));
+  absl::flat_hash_map<std::string, int64_t> entries = CacheEntries();
+  ASSERT_FALSE(entries.empty());
+
+  // Make sure that entries written by the second compilation would have
+  // different modification times.
+  tsl::Env::Default()->SleepForMicroseconds(10 * 1000);
+
+  // All object files of the second compilation are loaded from the cache, so
+  // it doesn't write any entries.
+  TF_ASSERT_OK_AND_ASSIGN(module, ParseAndReturnVerifiedModule(kHloText));
+  EXPECT_TRUE(LiteralTestUtil::Equal(
+      expected, ExecuteAndTransfer(std::move(module), {&arg})));
+  EXPECT_EQ(CacheEntries(), entries);
+}
+
+}  // namespace
+}  // namespace xla::cpu
@@ -51,6 +51,7 @@ limitations under the License.
 #include "xla/backends/cpu/runtime/thunk.h"
 #include "xla/backends/cpu/runtime/topk_thunk.h"
 #include "xla/backends/cpu/runtime/while_thunk.h"
+#include "xla/comparison_util.h"
 #include "xla/cpu_function_runtime.h"
 #include "xla/hlo/ir/hlo_casting_utils.h"
 #include "xla/hlo/ir/hlo_computation.h"
@@ -67,6 +68,7 @@ limitations under the License.
 #include "xla/service/cpu/ir_emitter2.h"
 #include "xla/service/cpu/target_machine_features.h"
 #include "xla/service/hlo.pb.h"
+#include "xla/service/hlo_cost_analysis.h"
 #include "xla/service/hlo_module_config.h"
 #include "xla/shape.h"
 #include "xla/shape_util.h"
@@ -90,10 +92,24 @@ ThunkEmitter::ThunkEmitter(IrEmitter2& ir_emitter,
       communicator_resource_(
           Resource::Create(Resource::kCollectiveCommunicator)) {}
 
-static Thunk::Info ThunkInfo(const HloInstruction* instruction) {
+Thunk::Info ThunkEmitter::ThunkInfo(const HloInstruction* instruction) const {
   const HloModule* module = instruction->GetModule();
-  return Thunk::Info{std::string(instruction->name()),
-                     std::string(module->name()), module->unique_id()};
+  Thunk::Info info{std::string(instruction->name()),
+                   std::string(module->name()), module->unique_id()};
+  if (cost_analysis_.has_value()) {
+    info.cost = cost_analysis_->flop_count(*instruction) +
+                cost_analysis_->transcendental_count(*instruction) +
+                cost_analysis_->bytes_accessed(*instruction);
+  }
+  return info;
+}
+
+static int64_t ShapeSizeBytes(const Shape& shape) {
+  // On the cpu, opaques are pointers.
+  if (shape.IsOpaque()) {
+    return static_cast<int64_t>(sizeof(void*));
+  }
+  return ShapeUtil::ByteSizeOf(shape, sizeof(void*));
 }
 
 absl::StatusOr<ThunkSequence> ThunkEmitter::EmitEntryComputation(
@@ -101,6 +117,23 @@ absl::StatusOr<ThunkSequence> ThunkEmitter::EmitEntryComputation(
   if (!module.has_schedule()) {
     return absl::InternalError("HLO module must be scheduled to emit thunks");
   }
+
+  // Estimate thunk costs for the critical path ready queue. Costs are only a
+  // scheduling hint, and if cost analysis fails we emit thunks without them.
+  if (hlo_module_config_.debug_options()
+          .xla_cpu_enable_critical_path_scheduling()) {
+    cost_analysis_.emplace(ShapeSizeBytes);
+    for (const HloComputation* computation :
+         module.MakeNonfusionComputations()) {
+      if (absl::Status status = computation->Accept(&*cost_analysis_);
+          !status.ok()) {
+        VLOG(1) << "Failed to estimate thunk costs: " << status;
+        cost_analysis_.reset();
+        break;
+      }
+    }
+  }
+
   return EmitHloComputation(module.entry_computation());
 }
 
@@ -1011,6 +1044,49 @@ absl::StatusOr<ThunkSequence> ThunkEmitter::EmitDynamicUpdateSliceThunk(
   return MakeKernelThunkSequence(instruction, buffers, kernel);
 }
 
+// Returns the sort order of a sort whose comparator compares the elements of
+// the first operand with a single `compare` instruction, e.g. the sorts of
+// top-k and argsort, which lets the sort thunk sort without the comparator.
+static std::optional<SortThunk::SortOrder> MatchSortOrder(
+    const HloSortInstruction* sort) {
+  const HloInstruction* root = sort->to_apply()->root_instruction();
+  if (root->opcode() != HloOpcode::kCompare) return std::nullopt;
+
+  const HloInstruction* lhs = root->operand(0);
+  const HloInstruction* rhs = root->operand(1);
+  if (lhs->opcode() != HloOpcode::kParameter ||
+      rhs->opcode() != HloOpcode::kParameter) {
+    return std::nullopt;
+  }
+
+  // Parameters 0 and 1 are the compared elements of the first operand.
+  bool swapped;
+  if (lhs->parameter_number() == 0 && rhs->parameter_number() == 1) {
+    swapped = false;
+  } else if (lhs->parameter_number() == 1 && rhs->parameter_number() == 0) {
+    swapped = true;
+  } else {
+    return std::nullopt;
+  }
+
+  auto* compare = Cast<HloCompareInstruction>(root);
+  SortThunk::SortOrder sort_order;
+  switch (compare->direction()) {
+    case ComparisonDirection::kLt:
+      sort_order.direction = swapped ? SortThunk::SortDirection::kDescending
+                                     : SortThunk::SortDirection::kAscending;
+      break;
+    case ComparisonDirection::kGt:
+      sort_order.direction = swapped ? SortThunk::SortDirection::kAscending
+                                     : SortThunk::SortDirection::kDescending;
+      break;
+    default:
+      return std::nullopt;
+  }
+  sort_order.total_order = compare->order() == Comparison::Order::kTotal;
+  return sort_order;
+}
+
 absl::StatusOr<ThunkSequence> ThunkEmitter::EmitSortThunk(
     const HloInstruction* instruction) {
   auto* sort = Cast<HloSortInstruction>(instruction);
@@ -1048,7 +1124,8 @@ absl::StatusOr<ThunkSequence> ThunkEmitter::EmitSortThunk(
   TF_ASSIGN_OR_RETURN(
       thunks.emplace_back(),
       SortThunk::Create(ThunkInfo(instruction), inputs, sort->sort_dimension(),
-                        sort->is_stable(), comparator.name));
+                        sort->is_stable(), comparator.name,
+                        MatchSortOrder(sort)));
 
   return thunks;
 }
@@ -1098,7 +1175,7 @@ absl::StatusOr<ThunkSequence> ThunkEmitter::MakeKernelThunkSequence(
     const HloInstruction* instruction,
     const ThunkEmitter::HostKernelAllocationSlices& buffers,
     const IrEmitter2::KernelInfo& kernel,
-    std::optional<uint64_t> min_alignment) {
+    std::optional<uint64_t> min_alignment) const {
   return ThunkSequence::Of<KernelThunk>(
       ThunkInfo(instruction), buffers.arguments, buffers.results, kernel.name,
       kernel.thread_dims, kernel.invariant_arguments, min_alignment);
@@ -34,6 +34,7 @@ limitations under the License.
 #include "xla/service/buffer_assignment.h"
 #include "xla/service/cpu/ir_emitter2.h"
 #include "xla/service/cpu/target_machine_features.h"
+#include "xla/service/hlo_cost_analysis.h"
 #include "xla/service/hlo_module_config.h"
 #include "xla/shape_util.h"
 #include "xla/xla_data.pb.h"
@@ -72,6 +73,10 @@ class ThunkEmitter {
   absl::StatusOr<std::shared_ptr<Resource>> GetTokenResource(
       const HloInstruction* instruction, const ShapeIndex& index = {});
 
+  // Returns thunk info for the given instruction. If cost analysis is enabled,
+  // it includes the estimated cost of the instruction.
+  Thunk::Info ThunkInfo(const HloInstruction* instruction) const;
+
   absl::StatusOr<ThunkSequence> EmitHloComputation(
       const HloComputation* computation);
 
@@ -199,11 +204,11 @@ class ThunkEmitter {
       absl::Span<const PrimitiveType> supported_types);
 
   // Convenience function that creates a thunk sequence containing given kernel.
-  static absl::StatusOr<ThunkSequence> MakeKernelThunkSequence(
+  absl::StatusOr<ThunkSequence> MakeKernelThunkSequence(
       const HloInstruction* instruction,
       const ThunkEmitter::HostKernelAllocationSlices& buffers,
       const IrEmitter2::KernelInfo& kernel,
-      std::optional<uint64_t> min_alignment = std::nullopt);
+      std::optional<uint64_t> min_alignment = std::nullopt) const;
 
   IrEmitter2& ir_emitter_;
   const BufferAssignment& buffer_assignment_;
@@ -211,6 +216,9 @@ class ThunkEmitter {
   const TargetMachineFeatures& target_machine_features_;
   const HloModuleConfig& hlo_module_config_;
 
+  // Cost analysis for estimating thunk costs for critical path scheduling.
+  std::optional<HloCostAnalysis> cost_analysis_;
+
   // A global resource that is used to order all collective operations.
   std::shared_ptr<Resource> communicator_resource_;
 